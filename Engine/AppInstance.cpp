@@ -29,6 +29,7 @@
 #include <fstream>
 #include <limits>
 #include <list>
+#include <set>
 #include <cassert>
 #include <stdexcept>
 #include <sstream> // stringstream
@@ -201,6 +202,8 @@ public:
     void getSequenceNameFromWriter(const OutputEffectInstance* writer, QString* sequenceName);
 
     void startRenderingFullSequence(bool blocking, const RenderQueueItem& writerWork);
+
+    void groupRendersSharingNodes(const std::list<RenderQueueItem>& items, std::list<RenderQueueItem>* leaders);
 };
 
 AppInstance::AppInstance(int appID)
@@ -599,6 +602,17 @@ AppInstance::loadInternal(const CLArgs& cl,
             throw std::invalid_argument( tr("%1: No such file.").arg(scriptFilename).toStdString() );
         }
 
+        const QString& convertedProjectPath = cl.getConvertedProjectPath();
+        if ( !convertedProjectPath.isEmpty() ) {
+            if ( info.suffix() != QString::fromUtf8(NATRON_PROJECT_FILE_EXT) ) {
+                throw std::invalid_argument( tr("--convert-project only accepts .%1 project files.").arg( QString::fromUtf8(NATRON_PROJECT_FILE_EXT) ).toStdString() );
+            }
+            _imp->_currentProject->convertProjectFile(info.absoluteFilePath(), convertedProjectPath);
+            std::cout << tr("Converted %1 to %2").arg(scriptFilename).arg(convertedProjectPath).toStdString() << std::endl;
+
+            return;
+        }
+
         std::list<AppInstance::RenderWork> writersWork;
 
 
@@ -1807,10 +1821,58 @@ AppInstance::startWritersRendering(bool doBlockingRender,
     }
 
     if (appPTR->isBackground() || doBlockingRender) {
+        if ( appPTR->isRenderWorker() ) {
+            // Render the frames handed out by the process which started this one, see RenderWorkersPool
+            for (std::list<RenderQueueItem>::iterator it = itemsToQueue.begin(); it != itemsToQueue.end(); ++it) {
+                while ( appPTR->waitForFrameRangeToRender(&it->work.firstFrame, &it->work.lastFrame, &it->work.frameStep) ) {
+                    _imp->startRenderingFullSequence(true, *it);
+                }
+            }
+
+            return;
+        }
+
+        if ( appPTR->isBackground() && !renderInSeparateProcess && (appPTR->getRenderProcessesCount() > 1) ) {
+            // Split the frames of each writer across several processes. Videos must be written by a single process.
+            std::list<RenderQueueItem> inProcessItems;
+            QString projectPath;
+            for (std::list<RenderQueueItem>::const_iterator it = itemsToQueue.begin(); it != itemsToQueue.end(); ++it) {
+                if ( it->work.writer->isVideoWriter() ) {
+                    inProcessItems.push_back(*it);
+                    continue;
+                }
+                if ( projectPath.isEmpty() ) {
+                    // The processes load the project as modified by the command line
+                    getProject()->saveProject_imp(QString(), QString::fromUtf8("RENDER_SAVE.ntp"), true, false, &projectPath);
+                }
+                RenderWorkersPool workers(projectPath, it->work.writer, it->work.firstFrame, it->work.lastFrame, it->work.frameStep,
+                                          it->work.useRenderStats, appPTR->getRenderProcessesCount());
+                if ( !workers.render() ) {
+                    throw std::runtime_error( tr("Failed to render %1.").arg( QString::fromUtf8( it->work.writer->getScriptName_mt_safe().c_str() ) ).toStdString() );
+                }
+            }
+            if ( inProcessItems.empty() ) {
+                return;
+            }
+            itemsToQueue = inProcessItems;
+        }
+
+        // Writers sharing nodes upstream are rendered in a single pass by the first of them
+        std::list<RenderQueueItem> leaders;
+        if ( !renderInSeparateProcess && appPTR->getCurrentSettings()->isRenderWritersTogetherEnabled() && (getProject()->getProjectViewsCount() == 1) ) {
+            _imp->groupRendersSharingNodes(itemsToQueue, &leaders);
+        } else {
+            leaders = itemsToQueue;
+        }
+
         //blocking call, we don't want this function to return pre-maturely, in which case it would kill the app
-        QtConcurrent::blockingMap( itemsToQueue, [&](RenderQueueItem item) {
+        QtConcurrent::blockingMap( leaders, [&](RenderQueueItem item) {
             _imp->startRenderingFullSequence(true, item);
         });
+
+        for (std::list<RenderQueueItem>::const_iterator it = leaders.begin(); it != leaders.end(); ++it) {
+            it->work.writer->setRenderGroupWriters( std::list<OutputEffectInstancePtr>() );
+        }
     } else {
         bool isQueuingEnabled = appPTR->getCurrentSettings()->isRenderQueuingEnabled();
         if (isQueuingEnabled) {
@@ -1837,6 +1899,123 @@ AppInstance::startWritersRendering(bool doBlockingRender,
     }
 } // AppInstance::startWritersRendering
 
+/**
+ * @brief Adds to nodes all the nodes upstream of node, including the nodes inside the groups.
+ **/
+static void
+getUpstreamNodes(const NodePtr& node,
+                 std::set<NodePtr>* nodes)
+{
+    std::list<NodePtr> toVisit;
+
+    toVisit.push_back(node);
+    while ( !toVisit.empty() ) {
+        NodePtr n = toVisit.front();
+        toVisit.pop_front();
+
+        int nInputs = n->getNInputs();
+        for (int i = 0; i < nInputs; ++i) {
+            NodePtr input = n->getInput(i);
+            if ( input && nodes->insert(input).second ) {
+                toVisit.push_back(input);
+            }
+        }
+
+        NodeGroup* isGroup = n->isEffectGroup();
+        if (isGroup && n != node) {
+            NodePtr output = isGroup->getOutputNode(false);
+            if ( output && nodes->insert(output).second ) {
+                toVisit.push_back(output);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Groups the renders over the same frame range whose writers share nodes upstream: each group is rendered
+ * in a single pass by its first render, the leader, for which OutputEffectInstance::setRenderGroupWriters() is called
+ * with the other writers of the group. The frames of the shared nodes are then rendered once for the whole group
+ * instead of once per writer, the other writers fetching them from the cache.
+ * leaders receives the first render of each group, which are the renders to start.
+ **/
+void
+AppInstancePrivate::groupRendersSharingNodes(const std::list<RenderQueueItem>& items,
+                                             std::list<RenderQueueItem>* leaders)
+{
+    std::vector<RenderQueueItem> renders( items.begin(), items.end() );
+    std::vector<std::set<NodePtr> > upstreamNodes( renders.size() );
+    for (std::size_t i = 0; i < renders.size(); ++i) {
+        getUpstreamNodes(renders[i].work.writer->getNode(), &upstreamNodes[i]);
+    }
+
+    // groups[i] is the index of the leader of the group of render i
+    std::vector<std::size_t> groups( renders.size() );
+    for (std::size_t i = 0; i < renders.size(); ++i) {
+        groups[i] = i;
+        const AppInstance::RenderWork& w = renders[i].work;
+        for (std::size_t j = 0; j < i; ++j) {
+            const AppInstance::RenderWork& other = renders[j].work;
+            if ( (groups[j] != j) || (other.firstFrame != w.firstFrame) || (other.lastFrame != w.lastFrame) ||
+                 (other.frameStep != w.frameStep) || (other.useRenderStats != w.useRenderStats) ) {
+                continue;
+            }
+            bool shareNodes = false;
+            for (std::set<NodePtr>::const_iterator it = upstreamNodes[i].begin(); it != upstreamNodes[i].end() && !shareNodes; ++it) {
+                shareNodes = upstreamNodes[j].count(*it) > 0;
+            }
+            if (shareNodes) {
+                groups[i] = j;
+                // The nodes of this render are now shared with the group
+                upstreamNodes[j].insert( upstreamNodes[i].begin(), upstreamNodes[i].end() );
+                break;
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < renders.size(); ++i) {
+        if (groups[i] != i) {
+            continue;
+        }
+        leaders->push_back(renders[i]);
+
+        std::list<OutputEffectInstancePtr> writers;
+        QStringList names;
+        names.push_back( QString::fromUtf8( renders[i].work.writer->getScriptName_mt_safe().c_str() ) );
+        std::set<NodePtr> renderedNodes;
+        getUpstreamNodes(renders[i].work.writer->getNode(), &renderedNodes);
+        std::size_t nSharedNodes = 0;
+        for (std::size_t j = i + 1; j < renders.size(); ++j) {
+            if (groups[j] != i) {
+                continue;
+            }
+            OutputEffectInstance* writer = renders[j].work.writer;
+            writers.push_back( std::dynamic_pointer_cast<OutputEffectInstance>( writer->shared_from_this() ) );
+            names.push_back( QString::fromUtf8( writer->getScriptName_mt_safe().c_str() ) );
+
+            std::set<NodePtr> nodes;
+            getUpstreamNodes(writer->getNode(), &nodes);
+            for (std::set<NodePtr>::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+                if ( !renderedNodes.insert(*it).second ) {
+                    ++nSharedNodes;
+                }
+            }
+        }
+        if ( writers.empty() ) {
+            continue;
+        }
+        renders[i].work.writer->setRenderGroupWriters(writers);
+
+        if ( appPTR->isBackground() ) {
+            const AppInstance::RenderWork& w = renders[i].work;
+            int nFrames = (w.lastFrame - w.firstFrame) / w.frameStep + 1;
+            std::cout << tr("Rendering %1 in a single pass: %2 nodes are shared, saving %3 node renders")
+                         .arg( names.join( QString::fromUtf8(", ") ) )
+                         .arg(nSharedNodes)
+                         .arg(nSharedNodes * nFrames).toStdString() << std::endl;
+        }
+    }
+} // AppInstancePrivate::groupRendersSharingNodes
+
 void
 AppInstancePrivate::getSequenceNameFromWriter(const OutputEffectInstance* writer,
                                               QString* sequenceName)
@@ -222,6 +222,50 @@ public:
     {
     }
 
+    virtual void loadProjectGui(bool /*isAutosave*/, boost::archive::binary_iarchive & /*archive*/) const
+    {
+    }
+
+    virtual void saveProjectGui(boost::archive::binary_oarchive & /*archive*/)
+    {
+    }
+
+    /**
+     * @brief Captures the GUI layout of the project so that it can be written later with writeProjectGui(),
+     * possibly from another thread. Must be called on the main thread. Returns NULL if there is no GUI.
+     **/
+    virtual ProjectGuiSerializationPtr captureProjectGui()
+    {
+        return ProjectGuiSerializationPtr();
+    }
+
+    /**
+     * @brief Reads the GUI layout of a project without applying it, so that writeProjectGui() can write it
+     * to another archive. Returns NULL if there is no GUI to read it, e.g: in background mode.
+     **/
+    virtual ProjectGuiSerializationPtr readProjectGui(boost::archive::xml_iarchive & /*archive*/) const
+    {
+        return ProjectGuiSerializationPtr();
+    }
+
+    virtual ProjectGuiSerializationPtr readProjectGui(boost::archive::binary_iarchive & /*archive*/) const
+    {
+        return ProjectGuiSerializationPtr();
+    }
+
+    /**
+     * @brief Writes a GUI layout returned by captureProjectGui() or readProjectGui(). MT-safe.
+     **/
+    virtual void writeProjectGui(boost::archive::xml_oarchive & /*archive*/,
+                                 const ProjectGuiSerialization& /*serialization*/) const
+    {
+    }
+
+    virtual void writeProjectGui(boost::archive::binary_oarchive & /*archive*/,
+                                 const ProjectGuiSerialization& /*serialization*/) const
+    {
+    }
+
     virtual void setupViewersForViews(const std::vector<std::string>& /*viewNames*/)
     {
     }
@@ -128,6 +128,8 @@
 #include "Engine/ProcessHandler.h" // ProcessInputChannel
 #include "Engine/Project.h"
 #include "Engine/PrecompNode.h"
+#include "Engine/RamBufferPool.h"
+#include "Engine/RenderTrace.h"
 #include "Engine/ReadNode.h"
 #include "Engine/RotoPaint.h"
 #include "Engine/RotoSmear.h"
@@ -275,6 +277,7 @@ AppManager::AppManager()
     _instance = this;
 
     QObject::connect( this, SIGNAL(s_requestOFXDialogOnMainThread(OfxImageEffectInstance*,void*)), this, SLOT(onOFXDialogOnMainThreadReceived(OfxImageEffectInstance*,void*)) );
+    QObject::connect( this, SIGNAL(s_cachePurgesPending()), this, SLOT(processPendingCachePurges()), Qt::QueuedConnection );
 
 #ifdef __NATRON_WIN32__
     FileSystemModel::initDriveLettersToNetworkShareNamesMapping();
@@ -285,6 +288,7 @@ AppManager::AppManager()
 void
 AppManager::takeNatronGIL()
 {
+    RenderTraceSpan traceSpan("waitNatronGIL", "lock");
     _imp->natronPythonGIL.lock();
 }
 
@@ -456,6 +460,8 @@ AppManager::~AppManager()
     ///Caches may have launched some threads to delete images, wait for them to be done
     QThreadPool::globalInstance()->waitForDone();
 
+    _imp->tileScheduler.reset();
+
     ///Kill caches now because decreaseNCacheFilesOpened can be called
     _imp->_nodeCache->waitForDeleterThread();
     _imp->_diskCache->waitForDeleterThread();
@@ -945,11 +951,16 @@ AppManager::loadInternalAfterInitGui(const CLArgs& cl)
         size_t maxCacheRAM = _imp->_settings->getRamMaximumPercent() * getSystemTotalRAM();
         U64 viewerCacheSize = _imp->_settings->getMaximumViewerDiskCacheSize();
         U64 maxDiskCacheNode = _imp->_settings->getMaximumDiskCacheNodeSize();
+        int nShards = _imp->_settings->getCacheShardsCount();
+
+        double compressedPercent = _imp->_settings->getCompressedNodeCachePercent();
 
-        _imp->_nodeCache = std::make_shared<Cache<Image> >("NodeCache", NATRON_CACHE_VERSION, maxCacheRAM, 1.);
-        _imp->_diskCache = std::make_shared<Cache<Image> >("DiskCache", NATRON_CACHE_VERSION, maxDiskCacheNode, 0.);
-        _imp->_viewerCache = std::make_shared<Cache<FrameEntry> >("ViewerCache", NATRON_CACHE_VERSION, viewerCacheSize, 0.);
+        _imp->_nodeCache = std::make_shared<Cache<Image> >("NodeCache", NATRON_CACHE_VERSION, maxCacheRAM, 1. - compressedPercent, nShards);
+        _imp->_nodeCache->setMaximumCompressedSize(compressedPercent);
+        _imp->_diskCache = std::make_shared<Cache<Image> >("DiskCache", NATRON_CACHE_VERSION, maxDiskCacheNode, 0., nShards);
+        _imp->_viewerCache = std::make_shared<Cache<FrameEntry> >("ViewerCache", NATRON_CACHE_VERSION, viewerCacheSize, 0., nShards);
         _imp->setViewerCacheTileSize();
+        RamBufferPool::instance()->setMaximumFreeBytes(maxCacheRAM * NATRON_RAM_BUFFER_POOL_MAX_FREE_PERCENT);
     } catch (std::logic_error&) {
         // ignore
     }
@@ -997,6 +1008,11 @@ AppManager::loadInternalAfterInitGui(const CLArgs& cl)
 
     if ( isBackground() && !cl.getIPCPipeName().isEmpty() ) {
         _imp->initProcessInputChannel( cl.getIPCPipeName() );
+        _imp->isRenderWorker = cl.isRenderWorker();
+    }
+    _imp->renderProcessesCount = cl.getRenderProcessesCount();
+    if ( !cl.getTraceFilePath().isEmpty() ) {
+        RenderTrace::setEnabled(true);
     }
 
 
@@ -1040,6 +1056,13 @@ AppManager::loadInternalAfterInitGui(const CLArgs& cl)
         if ( ( (_imp->_appType == eAppTypeBackgroundAutoRun) ||
                ( _imp->_appType == eAppTypeBackgroundAutoRunLaunchedFromGui) ||
                ( _imp->_appType == eAppTypeInterpreter) ) && mainInstance ) {
+            if ( !cl.getTraceFilePath().isEmpty() ) {
+                RenderTrace::setEnabled(false);
+                std::string error;
+                if ( !RenderTrace::writeChromeTrace(cl.getTraceFilePath().toStdString(), &error) ) {
+                    std::cerr << error << std::endl;
+                }
+            }
             bool wasKilled = true;
             const AppInstanceVec& instances = appPTR->getAppInstances();
             for (AppInstanceVec::const_iterator it = instances.begin(); it != instances.end(); ++it) {
@@ -1311,9 +1334,11 @@ AppManager::wipeAndCreateDiskCacheStructure()
     clearAllCaches();
 
     assert(_imp->_diskCache);
-    _imp->cleanUpCacheDiskStructure( _imp->_diskCache->getCachePath(), false );
     assert(_imp->_viewerCache);
+    _imp->closeCacheJournals();
+    _imp->cleanUpCacheDiskStructure( _imp->_diskCache->getCachePath(), false );
     _imp->cleanUpCacheDiskStructure( _imp->_viewerCache->getCachePath() , true);
+    _imp->createCacheJournals();
 }
 
 AppInstancePtr
@@ -1369,13 +1394,41 @@ AppManager::writeToOutputPipe(const QString & longMessage,
     return true;
 }
 
+int
+AppManager::getRenderProcessesCount() const
+{
+    return _imp->renderProcessesCount;
+}
+
+bool
+AppManager::isRenderWorker() const
+{
+    return _imp->isRenderWorker;
+}
+
+bool
+AppManager::waitForFrameRangeToRender(int* firstFrame,
+                                      int* lastFrame,
+                                      int* frameStep)
+{
+    if (!_imp->_backgroundIPC) {
+        return false;
+    }
+
+    return _imp->_backgroundIPC->waitForFrameRange(firstFrame, lastFrame, frameStep);
+}
+
 void
 AppManager::setApplicationsCachesMaximumMemoryPercent(double p)
 {
     size_t maxCacheRAM = p * getSystemTotalRAM_conditionnally();
 
+    // The images evicted from the memory portion of the node cache are kept compressed in the rest of its RAM
+    double compressedPercent = _imp->_settings->getCompressedNodeCachePercent();
     _imp->_nodeCache->setMaximumCacheSize(maxCacheRAM);
-    _imp->_nodeCache->setMaximumInMemorySize(1);
+    _imp->_nodeCache->setMaximumInMemorySize(1. - compressedPercent);
+    _imp->_nodeCache->setMaximumCompressedSize(compressedPercent);
+    RamBufferPool::instance()->setMaximumFreeBytes(maxCacheRAM * NATRON_RAM_BUFFER_POOL_MAX_FREE_PERCENT);
 }
 
 void
@@ -2318,52 +2371,79 @@ AppManager::removeFromViewerCache(U64 hash)
 void
 AppManager::getMemoryStatsForCacheEntryHolder(const CacheEntryHolder* holder,
                                               std::size_t* ramOccupied,
+                                              std::size_t* compressedOccupied,
                                               std::size_t* diskOccupied) const
 {
     assert(holder);
 
     *ramOccupied = 0;
+    *compressedOccupied = 0;
     *diskOccupied = 0;
 
     std::size_t viewerCacheMem = 0;
+    std::size_t viewerCacheCompressed = 0;
     std::size_t viewerCacheDisk = 0;
     std::size_t diskCacheMem = 0;
+    std::size_t diskCacheCompressed = 0;
     std::size_t diskCacheDisk = 0;
     std::size_t nodeCacheMem = 0;
+    std::size_t nodeCacheCompressed = 0;
     std::size_t nodeCacheDisk = 0;
     const Node* isNode = dynamic_cast<const Node*>(holder);
     if (isNode) {
         ViewerInstance* isViewer = isNode->isEffectViewer();
         if (isViewer) {
-            _imp->_viewerCache->getMemoryStatsForCacheEntryHolder(holder, &viewerCacheMem, &viewerCacheDisk);
+            _imp->_viewerCache->getMemoryStatsForCacheEntryHolder(holder, &viewerCacheMem, &viewerCacheCompressed, &viewerCacheDisk);
         }
     }
-    _imp->_diskCache->getMemoryStatsForCacheEntryHolder(holder, &diskCacheMem, &diskCacheDisk);
-    _imp->_nodeCache->getMemoryStatsForCacheEntryHolder(holder, &nodeCacheMem, &nodeCacheDisk);
+    _imp->_diskCache->getMemoryStatsForCacheEntryHolder(holder, &diskCacheMem, &diskCacheCompressed, &diskCacheDisk);
+    _imp->_nodeCache->getMemoryStatsForCacheEntryHolder(holder, &nodeCacheMem, &nodeCacheCompressed, &nodeCacheDisk);
 
     *ramOccupied = diskCacheMem + viewerCacheMem + nodeCacheMem;
+    *compressedOccupied = diskCacheCompressed + viewerCacheCompressed + nodeCacheCompressed;
     *diskOccupied = diskCacheDisk + viewerCacheDisk + nodeCacheDisk;
 }
 
 void
-AppManager::removeAllImagesFromCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder,
-                                                                  U64 treeVersion)
+AppManager::removeAllImagesFromCachesWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder,
+                                                                   const std::vector<U64>& treeVersionsToKeep,
+                                                                   bool includeViewerCache)
 {
-    _imp->_nodeCache->removeAllEntriesWithDifferentNodeHashForHolderPublic(holder, treeVersion);
-}
-
-void
-AppManager::removeAllImagesFromDiskCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder,
-                                                                      U64 treeVersion)
-{
-    _imp->_diskCache->removeAllEntriesWithDifferentNodeHashForHolderPublic(holder, treeVersion);
+    // The holder may be destroyed before the requests are processed: only keep its ID
+    std::string holderID = holder->getCacheID();
+    bool mustNotify;
+    {
+        QMutexLocker k(&_imp->pendingCachePurgesMutex);
+        mustNotify = _imp->pendingImageCachePurges.empty() && _imp->pendingViewerCachePurges.empty();
+        _imp->pendingImageCachePurges[holderID] = treeVersionsToKeep;
+        if (includeViewerCache) {
+            _imp->pendingViewerCachePurges[holderID] = treeVersionsToKeep;
+        }
+    }
+    if ( isBackground() || !QCoreApplication::instance() ) {
+        // Background and command-line renders may not run an event loop to deliver the queued signal
+        processPendingCachePurges();
+    } else if (mustNotify) {
+        Q_EMIT s_cachePurgesPending();
+    }
 }
 
 void
-AppManager::removeAllTexturesFromCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder,
-                                                                    U64 treeVersion)
+AppManager::processPendingCachePurges()
 {
-    _imp->_viewerCache->removeAllEntriesWithDifferentNodeHashForHolderPublic(holder, treeVersion);
+    CacheHoldersNodeHashes imagePurges, viewerPurges;
+    {
+        QMutexLocker k(&_imp->pendingCachePurgesMutex);
+        imagePurges.swap(_imp->pendingImageCachePurges);
+        viewerPurges.swap(_imp->pendingViewerCachePurges);
+    }
+    if ( !imagePurges.empty() ) {
+        _imp->_nodeCache->removeAllEntriesWithDifferentNodeHashForHoldersPublic(imagePurges);
+        _imp->_diskCache->removeAllEntriesWithDifferentNodeHashForHoldersPublic(imagePurges);
+    }
+    if ( !viewerPurges.empty() ) {
+        _imp->_viewerCache->removeAllEntriesWithDifferentNodeHashForHoldersPublic(viewerPurges);
+    }
 }
 
 void
@@ -2404,6 +2484,14 @@ AppManager::getImageOrCreate(const ImageKey & key,
     return _imp->_nodeCache->getOrCreate(key, params, 0, returnValue);
 }
 
+void
+AppManager::getNodeCacheLockStats(U64* nLookups,
+                                  U64* nContendedLocks,
+                                  U64* lockWaitNSecs) const
+{
+    _imp->_nodeCache->getLockStats(nLookups, nContendedLocks, lockWaitNSecs);
+}
+
 bool
 AppManager::getImage_diskCache(const ImageKey & key,
                                std::list<ImagePtr>* returnValue) const
@@ -2431,6 +2519,20 @@ AppManager::getTexture(const FrameKey & key,
     return ret;
 }
 
+void
+AppManager::prefetchTextures(const std::vector<U64>& hashes) const
+{
+    _imp->_viewerCache->prefetch(hashes);
+}
+
+void
+AppManager::getViewerCachePrefetchStats(U64* nHits,
+                                        U64* nMisses,
+                                        U64* nTilesPrefetched) const
+{
+    _imp->_viewerCache->getPrefetchStats(nHits, nMisses, nTilesPrefetched);
+}
+
 bool
 AppManager::getTextureOrCreate(const FrameKey & key,
                                const FrameParamsPtr& params,
@@ -2449,7 +2551,8 @@ AppManager::isAggressiveCachingEnabled() const
 U64
 AppManager::getCachesTotalMemorySize() const
 {
-    return  _imp->_nodeCache->getMemoryCacheSize();
+    // The free blocks of the buffer pool are memory held on behalf of the caches
+    return  _imp->_nodeCache->getMemoryCacheSize() + _imp->_nodeCache->getCompressedCacheSize() + RamBufferPool::instance()->getFreeBytes();
 }
 
 U64
@@ -2760,6 +2863,12 @@ AppManager::checkCacheFreeMemoryIsGoodEnough()
     size_t systemRAMToKeepFree = getSystemTotalRAM() * appPTR->getCurrentSettings()->getUnreachableRamPercent();
     size_t totalFreeRAM = getAmountFreePhysicalRAM();
 
+    if ( (totalFreeRAM <= systemRAMToKeepFree) && (RamBufferPool::instance()->getFreeBytes() > 0) ) {
+        // Unused pooled buffers go first
+        RamBufferPool::instance()->trim(0);
+        totalFreeRAM = getAmountFreePhysicalRAM();
+    }
+
     while (totalFreeRAM <= systemRAMToKeepFree) {
 #ifdef NATRON_DEBUG_CACHE
         qDebug() << "Total system free RAM is below the threshold:" << printAsRAM(totalFreeRAM)
@@ -3308,6 +3417,12 @@ AppManager::getAppTLS() const
     return &_imp->globalTLS;
 }
 
+TileScheduler*
+AppManager::getTileScheduler() const
+{
+    return _imp->tileScheduler.get();
+}
+
 
 QString
 AppManager::getBoostVersion() const
@@ -3809,7 +3924,10 @@ PythonGILLocker::PythonGILLocker()
     QString threadname = (qApp && qApp->thread() == curThread) ? QString::fromUtf8("Main") : curThread->objectName();
     qDebug() << QString::fromUtf8("Thread '%1' is asking the Python GIL").arg(threadname);
 #endif
-    state = PyGILState_Ensure();
+    {
+        RenderTraceSpan traceSpan("waitPythonGIL", "lock");
+        state = PyGILState_Ensure();
+    }
 #ifdef DEBUG_PYTHON_GIL
     ++pythonCount[threadname];
     qDebug() << QString::fromUtf8("Thread '%1' got the Python GIL (%2)").arg(threadname).arg(pythonCount[threadname]);
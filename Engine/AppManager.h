@@ -205,6 +205,11 @@ public:
     bool getImageOrCreate(const ImageKey & key, const ImageParamsPtr& params,
                           ImagePtr* returnValue) const;
 
+    /**
+     * @brief Returns how many look-ups were made in the node cache and how much time they spent waiting on its locks.
+     **/
+    void getNodeCacheLockStats(U64* nLookups, U64* nContendedLocks, U64* lockWaitNSecs) const;
+
     bool getImage_diskCache(const ImageKey & key, std::list<ImagePtr>* returnValue) const;
 
     bool getImageOrCreate_diskCache(const ImageKey & key, const ImageParamsPtr& params,
@@ -213,6 +218,13 @@ public:
     bool getTexture(const FrameKey & key,
                     std::list<FrameEntryPtr>* returnValue) const;
 
+    /**
+     * @brief Reads ahead from the disk the textures of the viewer cache with the given hashes, see Cache::prefetch()
+     **/
+    void prefetchTextures(const std::vector<U64>& hashes) const;
+
+    void getViewerCachePrefetchStats(U64* nHits, U64* nMisses, U64* nTilesPrefetched) const;
+
     bool getTextureOrCreate(const FrameKey & key, const FrameParamsPtr& params,
                             FrameEntryLocker* locker,
                             FrameEntryPtr* returnValue) const;
@@ -234,12 +246,15 @@ public:
     void removeFromNodeCache(U64 hash);
     void removeFromViewerCache(U64 hash);
     /**
-     * @brief Given the following tree version, removes all images from the node cache with a matching
-     * tree version. This is useful to wipe the cache for one particular node.
+     * @brief Removes all images of the given holder from the node cache and the disk cache (and the viewer cache
+     * if includeViewerCache is true) whose tree version is not one of treeVersionsToKeep.
+     * This is useful to wipe the cache for one particular node.
+     * Requests are coalesced and processed once the main event loop is reached again, so that all
+     * the nodes whose hash changed following a parameter change are purged in a single pass over each cache.
      **/
-    void  removeAllImagesFromCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder, U64 treeVersion);
-    void  removeAllImagesFromDiskCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder, U64 treeVersion);
-    void  removeAllTexturesFromCacheWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder, U64 treeVersion);
+    void removeAllImagesFromCachesWithMatchingIDAndDifferentKey(const CacheEntryHolder* holder,
+                                                                const std::vector<U64>& treeVersionsToKeep,
+                                                                bool includeViewerCache);
 
     void removeAllCacheEntriesForHolder(const CacheEntryHolder* holder, bool blocking);
 
@@ -272,6 +287,23 @@ public:
      **/
     bool writeToOutputPipe(const QString & longMessage, const QString & shortMessage, bool printIfNoChannel);
 
+    /**
+     * @brief Returns the number of processes rendering the frames of each writer in background mode.
+     **/
+    int getRenderProcessesCount() const;
+
+    /**
+     * @brief Returns true if this background process renders the frames handed out by the main process
+     * with waitForFrameRangeToRender() instead of the frame range of the writer.
+     **/
+    bool isRenderWorker() const;
+
+    /**
+     * @brief Asks the main process the next frames to render. Returns false if there are no more frames
+     * to render.
+     **/
+    bool waitForFrameRangeToRender(int* firstFrame, int* lastFrame, int* frameStep);
+
     /**
      * @brief Abort any processing on all AppInstance. It is called in some very rare cases
      * such as when changing the number of threads used by the application or when a background render
@@ -489,6 +521,7 @@ public:
 
     void getMemoryStatsForCacheEntryHolder(const CacheEntryHolder* holder,
                                            std::size_t* ramOccupied,
+                                           std::size_t* compressedOccupied,
                                            std::size_t* diskOccupied) const;
 
     void setOFXHostHandle(void* handle);
@@ -496,6 +529,7 @@ public:
     OFX::Host::ImageEffect::Descriptor* getPluginContextAndDescribe(OFX::Host::ImageEffect::ImageEffectPlugin* plugin,
                                                                     NATRON_ENUM::ContextEnum* ctx);
     AppTLS* getAppTLS() const;
+    TileScheduler* getTileScheduler() const;
     const OfxHost* getOFXHost() const;
     GPUContextPool* getGPUContextPool() const;
 
@@ -637,8 +671,11 @@ public Q_SLOTS:
 
     void onOFXDialogOnMainThreadReceived(OfxImageEffectInstance* instance, void* instanceData);
 
+    void processPendingCachePurges();
+
 Q_SIGNALS:
 
+    void s_cachePurgesPending();
 
     void checkerboardSettingsChanged();
 
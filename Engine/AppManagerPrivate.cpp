@@ -60,8 +60,8 @@ GCC_DIAG_ON(unused-parameter)
 #include "Global/GLIncludes.h"
 #include "Global/ProcInfo.h"
 #include "Global/StrUtils.h"
-#include "Global/FStreamsSupport.h"
 
+#include "Engine/CacheJournal.h"
 #include "Engine/CacheSerialization.h"
 #include "Engine/CLArgs.h"
 #include "Engine/ExistenceCheckThread.h"
@@ -208,6 +208,7 @@ oom:
 NATRON_NAMESPACE_ENTER
 AppManagerPrivate::AppManagerPrivate()
     : globalTLS()
+    , tileScheduler( new TileScheduler() )
     , _appType(AppManager::eAppTypeBackground)
     , _appInstancesMutex()
     , _appInstances()
@@ -223,9 +224,14 @@ AppManagerPrivate::AppManagerPrivate()
     , _nodeCache()
     , _diskCache()
     , _viewerCache()
+    , pendingCachePurgesMutex()
+    , pendingImageCachePurges()
+    , pendingViewerCachePurges()
     , diskCachesLocationMutex()
     , diskCachesLocation()
     , _backgroundIPC()
+    , renderProcessesCount(1)
+    , isRenderWorker(false)
     , _loaded(false)
     , _binaryPath()
     , _nodesGlobalMemoryUse(0)
@@ -444,41 +450,32 @@ AppManagerPrivate::declareSettingsToPython()
     }
 }
 
-template <typename T>
 void
-saveCache(Cache<T>* cache)
+AppManagerPrivate::saveCaches()
 {
-    std::string cacheRestoreFilePath = cache->getRestoreFilePath();
-    FStreamsSupport::ofstream ofile;
-    FStreamsSupport::open(&ofile, cacheRestoreFilePath);
-
-    if (!ofile) {
-        std::cerr << "Failed to save cache to " << cacheRestoreFilePath.c_str() << std::endl;
-
-        return;
+    if (!appPTR->isBackground()) {
+        _viewerCache->syncJournal();
     }
+    _diskCache->syncJournal();
+} // saveCaches
 
+// Attaches an empty journal to the cache, the cache folder is assumed to be empty
+template <typename T>
+void
+createCacheJournal(Cache<T>* cache)
+{
+    CacheJournalPtr journal = std::make_shared<CacheJournal>();
 
-    typename Cache<T>::CacheTOC toc;
-    cache->save(&toc);
-    unsigned int version = cache->cacheVersion();
     try {
-        boost::archive::binary_oarchive oArchive(ofile);
-        oArchive << version;
-        oArchive << toc;
+        journal->open( cache->getJournalFilePath(), cache->cacheVersion() );
+        journal->finishRestore();
     } catch (const std::exception & e) {
-        qDebug() << "Failed to serialize the cache table of contents:" << e.what();
-    }
-}
+        qDebug() << "Failed to create the cache journal:" << e.what();
 
-void
-AppManagerPrivate::saveCaches()
-{
-    if (!appPTR->isBackground()) {
-        saveCache<FrameEntry>( _viewerCache.get() );
+        return;
     }
-    saveCache<Image>( _diskCache.get() );
-} // saveCaches
+    cache->setJournal(journal);
+}
 
 template <typename T>
 void
@@ -486,39 +483,23 @@ restoreCache(AppManagerPrivate* p,
              Cache<T>* cache)
 {
     if ( p->checkForCacheDiskStructure( cache->getCachePath(), cache->isTileCache() ) ) {
-        std::string settingsFilePath = cache->getRestoreFilePath();
-        FStreamsSupport::ifstream ifile;
-        FStreamsSupport::open(&ifile, settingsFilePath);
-        if (!ifile) {
-            std::cerr << "Failure to open cache restore file at: " << settingsFilePath << std::endl;
-
-            return;
-        }
-        typename Cache<T>::CacheTOC tableOfContents;
-        unsigned int cacheVersion = 0x1; //< default to 1 before NATRON_CACHE_VERSION was introduced
+        CacheJournalPtr journal = std::make_shared<CacheJournal>();
+        bool restored = false;
         try {
-            boost::archive::binary_iarchive iArchive(ifile);
-            if (cache->cacheVersion() >= NATRON_CACHE_VERSION) {
-                iArchive >> cacheVersion;
-            }
-            //Only load caches with same version, otherwise wipe it!
-            if ( cacheVersion == cache->cacheVersion() ) {
-                iArchive >> tableOfContents;
-            } else {
-                p->cleanUpCacheDiskStructure( cache->getCachePath(), cache->isTileCache() );
-            }
+            // Only load caches with same version, otherwise wipe it!
+            restored = journal->open( cache->getJournalFilePath(), cache->cacheVersion() );
         } catch (const std::exception & e) {
-            qDebug() << "Exception when reading disk cache TOC:" << e.what();
-            p->cleanUpCacheDiskStructure( cache->getCachePath(), cache->isTileCache() );
+            qDebug() << "Exception when reading disk cache journal:" << e.what();
+        }
+        if (restored) {
+            cache->restore(journal);
 
             return;
         }
-
-        QFile restoreFile( QString::fromUtf8( settingsFilePath.c_str() ) );
-        restoreFile.remove();
-
-        cache->restore(tableOfContents);
+        journal->close();
+        p->cleanUpCacheDiskStructure( cache->getCachePath(), cache->isTileCache() );
     }
+    createCacheJournal(cache);
 }
 
 void
@@ -528,6 +509,20 @@ AppManagerPrivate::restoreCaches()
     restoreCache<Image>( this, _diskCache.get() );
 } // restoreCaches
 
+void
+AppManagerPrivate::closeCacheJournals()
+{
+    _viewerCache->setJournal( CacheJournalPtr() );
+    _diskCache->setJournal( CacheJournalPtr() );
+}
+
+void
+AppManagerPrivate::createCacheJournals()
+{
+    createCacheJournal<FrameEntry>( _viewerCache.get() );
+    createCacheJournal<Image>( _diskCache.get() );
+}
+
 bool
 AppManagerPrivate::checkForCacheDiskStructure(const QString & cachePath, bool isTiled)
 {
@@ -536,7 +531,7 @@ AppManagerPrivate::checkForCacheDiskStructure(const QString & cachePath, bool is
     if ( !settingsFilePath.endsWith( QChar::fromLatin1('/') ) ) {
         settingsFilePath += QChar::fromLatin1('/');
     }
-    settingsFilePath += QString::fromUtf8("restoreFile." NATRON_CACHE_FILE_EXT);
+    settingsFilePath += QString::fromUtf8("journal." NATRON_CACHE_FILE_EXT);
 
     if ( !QFile::exists(settingsFilePath) ) {
         cleanUpCacheDiskStructure(cachePath, isTiled);
@@ -551,7 +546,7 @@ AppManagerPrivate::checkForCacheDiskStructure(const QString & cachePath, bool is
 
         /*Now counting actual data files in the cache*/
         /*check if there's 256 subfolders, otherwise reset cache.*/
-        int count = 0; // -1 because of the restoreFile
+        int count = 0;
         int subFolderCount = 0;
         Q_FOREACH(const QString &file, files) {
             QString subFolder(cachePath);
@@ -56,6 +56,7 @@
 #include "Engine/GPUContextPool.h"
 #include "Engine/GenericSchedulerThreadWatcher.h"
 #include "Engine/TLSHolder.h"
+#include "Engine/TileScheduler.h"
 
 // include breakpad after Engine, because it includes /usr/include/AssertMacros.h on OS X which defines a check(x) macro, which conflicts with boost
 #ifdef NATRON_USE_BREAKPAD
@@ -87,6 +88,7 @@ public:
     typedef std::shared_ptr<FrameEntryCache> FrameEntryCachePtr;
 
     AppTLS globalTLS;
+    std::unique_ptr<TileScheduler> tileScheduler; //< executes the tiles of host frame threaded renders
     AppManager::AppTypeEnum _appType; //< the type of app
     mutable QMutex _appInstancesMutex;
     std::vector<AppInstancePtr> _appInstances; //< the instances mapped against their ID
@@ -102,10 +104,15 @@ public:
     ImageCachePtr _nodeCache; //< Images cache
     ImageCachePtr _diskCache; //< Images disk cache (used by DiskCache nodes)
     FrameEntryCachePtr _viewerCache; //< Viewer textures cache
+    mutable QMutex pendingCachePurgesMutex; //< protects pendingImageCachePurges and pendingViewerCachePurges
+    CacheHoldersNodeHashes pendingImageCachePurges; //< purges of the node and disk caches not yet sent to the caches
+    CacheHoldersNodeHashes pendingViewerCachePurges; //< purges of the viewer cache not yet sent to the cache
     mutable QMutex diskCachesLocationMutex;
     QString diskCachesLocation;
     std::unique_ptr<ProcessInputChannel> _backgroundIPC; //< object used to communicate with the main app
     //if this app is background, see the ProcessInputChannel def
+    int renderProcessesCount; //< the number of processes rendering each writer, see --processes
+    bool isRenderWorker; //< true if this process renders the frames sent by the main app through _backgroundIPC
     bool _loaded; //< true when the first instance is completely loaded.
     QString _binaryPath; //< the path to the application's binary
     U64 _nodesGlobalMemoryUse; //< how much memory all the nodes are using (besides the cache)
@@ -219,6 +226,16 @@ public:
 
     void restoreCaches();
 
+    /**
+     * @brief Detaches and closes the journals of the caches, e.g: before their folder is removed.
+     **/
+    void closeCacheJournals();
+
+    /**
+     * @brief Attaches new empty journals to the caches.
+     **/
+    void createCacheJournals();
+
     static void addOpenGLRequirementsString(QString& str, OpenGLRequirementsTypeEnum type);
 
     bool checkForCacheDiskStructure(const QString & cachePath, bool isTiled);
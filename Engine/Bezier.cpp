@@ -32,6 +32,7 @@
 #include <cmath>
 #include <cassert>
 #include <stdexcept>
+#include <vector>
 
 #include <QtCore/QLineF>
 #include <QtCore/QDebug>
@@ -332,29 +333,18 @@ Bezier::bezierPointBboxUpdate(const Point & p0,
 // x and 2 for y). the Bbox is the Bbox of these points and the
 // extremal points (P0,P3)
 static void
-bezierSegmentBboxUpdate(bool useGuiCurves,
-                        const BezierCP & first,
-                        const BezierCP & last,
-                        double time,
-                        ViewIdx view,
-                        unsigned int mipmapLevel,
-                        const Transform::Matrix3x3& transform,
-                        RectD* bbox) ///< input/output
+bezierSegmentPointsBboxUpdate(Transform::Point3D p0M,
+                              Transform::Point3D p1M,
+                              Transform::Point3D p2M,
+                              Transform::Point3D p3M,
+                              unsigned int mipmapLevel,
+                              const Transform::Matrix3x3& transform,
+                              RectD* bbox) ///< input/output
 {
     Point p0, p1, p2, p3;
-    Transform::Point3D p0M, p1M, p2M, p3M;
 
     assert(bbox);
 
-    try {
-        first.getPositionAtTime(useGuiCurves, time, view, &p0M.x, &p0M.y);
-        first.getRightBezierPointAtTime(useGuiCurves, time, view, &p1M.x, &p1M.y);
-        last.getPositionAtTime(useGuiCurves, time, view, &p3M.x, &p3M.y);
-        last.getLeftBezierPointAtTime(useGuiCurves, time, view, &p2M.x, &p2M.y);
-    } catch (const std::exception & e) {
-        assert(false);
-    }
-
     p0M.z = p1M.z = p2M.z = p3M.z = 1;
 
     p0M = Transform::matApply(transform, p0M);
@@ -389,6 +379,31 @@ bezierSegmentBboxUpdate(bool useGuiCurves,
     Bezier::bezierPointBboxUpdate(p0, p1, p2, p3, bbox);
 }
 
+// Same as bezierSegmentPointsBboxUpdate, evaluating the control points of the segment at the time
+static void
+bezierSegmentBboxUpdate(bool useGuiCurves,
+                        const BezierCP & first,
+                        const BezierCP & last,
+                        double time,
+                        ViewIdx view,
+                        unsigned int mipmapLevel,
+                        const Transform::Matrix3x3& transform,
+                        RectD* bbox) ///< input/output
+{
+    Transform::Point3D p0M, p1M, p2M, p3M;
+
+    try {
+        first.getPositionAtTime(useGuiCurves, time, view, &p0M.x, &p0M.y);
+        first.getRightBezierPointAtTime(useGuiCurves, time, view, &p1M.x, &p1M.y);
+        last.getPositionAtTime(useGuiCurves, time, view, &p3M.x, &p3M.y);
+        last.getLeftBezierPointAtTime(useGuiCurves, time, view, &p2M.x, &p2M.y);
+    } catch (const std::exception & e) {
+        assert(false);
+    }
+
+    bezierSegmentPointsBboxUpdate(p0M, p1M, p2M, p3M, mipmapLevel, transform, bbox);
+}
+
 void
 Bezier::bezierSegmentListBboxUpdate(bool useGuiCurves,
                                     const BezierCPs & points,
@@ -437,6 +452,76 @@ Bezier::bezierSegmentListBboxUpdate(bool useGuiCurves,
     } // for()
 }
 
+void
+Bezier::bezierSegmentListBboxUpdateAtTimes(bool useGuiCurves,
+                                           const BezierCPs & points,
+                                           bool finished,
+                                           bool isOpenBezier,
+                                           const std::vector<double>& times,
+                                           ViewIdx view,
+                                           unsigned int mipmapLevel,
+                                           const std::vector<Transform::Matrix3x3>& transforms,
+                                           std::vector<RectD>* bboxes) ///< input/output
+{
+    assert( transforms.size() == times.size() && bboxes->size() == times.size() );
+    if ( points.empty() || times.empty() ) {
+        return;
+    }
+    const int nTimes = (int)times.size();
+    const int nPoints = (int)points.size();
+
+    // The position, left and right bezier points of each control point at each time: the 6 coordinates of the
+    // control point i at the time t are at (i * 6 + coordinate) * nTimes + t
+    std::vector<double> values(nPoints * 6 * nTimes);
+    {
+        int i = 0;
+        for (BezierCPs::const_iterator it = points.begin(); it != points.end(); ++it, ++i) {
+            double* cp = &values[i * 6 * nTimes];
+            (*it)->getPointsAtTimes(useGuiCurves, &times[0], nTimes, view, cp, cp + nTimes, cp + 2 * nTimes,
+                                    cp + 3 * nTimes, cp + 4 * nTimes, cp + 5 * nTimes);
+        }
+    }
+
+    for (int t = 0; t < nTimes; ++t) {
+        RectD* bbox = &(*bboxes)[t];
+        if (nPoints == 1) {
+            // only one point
+            Transform::Point3D p0;
+            p0.x = values[t];
+            p0.y = values[nTimes + t];
+            p0.z = 1;
+            p0 = Transform::matApply(transforms[t], p0);
+            bbox->x1 = p0.x;
+            bbox->x2 = p0.x;
+            bbox->y1 = p0.y;
+            bbox->y2 = p0.y;
+            continue;
+        }
+        // Same segments as bezierSegmentListBboxUpdate
+        for (int i = 0; i < nPoints; ++i) {
+            int next = i + 1;
+            if (next == nPoints) {
+                if (!finished && !isOpenBezier) {
+                    break;
+                }
+                next = 0;
+            }
+            const double* first = &values[i * 6 * nTimes + t];
+            const double* last = &values[next * 6 * nTimes + t];
+            Transform::Point3D p0M, p1M, p2M, p3M;
+            p0M.x = first[0];
+            p0M.y = first[nTimes];
+            p1M.x = first[4 * nTimes];
+            p1M.y = first[5 * nTimes];
+            p2M.x = last[2 * nTimes];
+            p2M.y = last[3 * nTimes];
+            p3M.x = last[0];
+            p3M.y = last[nTimes];
+            bezierSegmentPointsBboxUpdate(p0M, p1M, p2M, p3M, mipmapLevel, transforms[t], bbox);
+        }
+    }
+} // Bezier::bezierSegmentListBboxUpdateAtTimes
+
 inline double euclDist(double x1, double y1, double x2, double y2)
 {
     double dx = x2 - x1;
@@ -709,14 +794,13 @@ recursiveBezier(const Point& p0, const Point& p1, const Point& p2, const Point&
 #endif // #ifdef ROTO_BEZIER_EVAL_ITERATIVE
 
 // compute nbPointsperSegment points and update the bbox bounding box for the Bezier
-// segment from 'first' to 'last' evaluated at 'time'
+// segment with the control points p0M, p1M, p2M, p3M (before transform)
 // If nbPointsPerSegment is -1 then it will be automatically computed
 static void
-bezierSegmentEval(bool useGuiCurves,
-                  const BezierCP & first,
-                  const BezierCP & last,
-                  double time,
-                  ViewIdx view,
+bezierSegmentEval(Transform::Point3D p0M,
+                  Transform::Point3D p1M,
+                  Transform::Point3D p2M,
+                  Transform::Point3D p3M,
                   unsigned int mipmapLevel,
 #ifdef ROTO_BEZIER_EVAL_ITERATIVE
                   int nbPointsPerSegment,
@@ -725,20 +809,10 @@ bezierSegmentEval(bool useGuiCurves,
 #endif
                   const Transform::Matrix3x3& transform,
                   std::list<ParametricPoint >* points, ///< output
-                  RectD* bbox = NULL) ///< input/output (optional)
+                  RectD* bbox) ///< input/output (optional)
 {
-    Transform::Point3D p0M, p1M, p2M, p3M;
     Point p0, p1, p2, p3;
 
-    try {
-        first.getPositionAtTime(useGuiCurves, time, view, &p0M.x, &p0M.y);
-        first.getRightBezierPointAtTime(useGuiCurves, time, view, &p1M.x, &p1M.y);
-        last.getPositionAtTime(useGuiCurves, time, view, &p3M.x, &p3M.y);
-        last.getLeftBezierPointAtTime(useGuiCurves, time, view, &p2M.x, &p2M.y);
-    } catch (const std::exception & e) {
-        assert(false);
-    }
-
     p0M.z = p1M.z = p2M.z = p3M.z = 1;
 
     p0M = matApply(transform, p0M);
@@ -804,6 +878,43 @@ bezierSegmentEval(bool useGuiCurves,
     }
 } // bezierSegmentEval
 
+// Same as above for the Bezier segment from 'first' to 'last' evaluated at 'time'
+static void
+bezierSegmentEval(bool useGuiCurves,
+                  const BezierCP & first,
+                  const BezierCP & last,
+                  double time,
+                  ViewIdx view,
+                  unsigned int mipmapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                  int nbPointsPerSegment,
+#else
+                  double errorScale,
+#endif
+                  const Transform::Matrix3x3& transform,
+                  std::list<ParametricPoint >* points, ///< output
+                  RectD* bbox = NULL) ///< input/output (optional)
+{
+    Transform::Point3D p0M, p1M, p2M, p3M;
+
+    try {
+        first.getPositionAtTime(useGuiCurves, time, view, &p0M.x, &p0M.y);
+        first.getRightBezierPointAtTime(useGuiCurves, time, view, &p1M.x, &p1M.y);
+        last.getPositionAtTime(useGuiCurves, time, view, &p3M.x, &p3M.y);
+        last.getLeftBezierPointAtTime(useGuiCurves, time, view, &p2M.x, &p2M.y);
+    } catch (const std::exception & e) {
+        assert(false);
+    }
+
+    bezierSegmentEval(p0M, p1M, p2M, p3M, mipmapLevel,
+#ifdef ROTO_BEZIER_EVAL_ITERATIVE
+                      nbPointsPerSegment,
+#else
+                      errorScale,
+#endif
+                      transform, points, bbox);
+}
+
 /**
  * @brief Determines if the point (x,y) lies on the bezier curve segment defined by first and last.
  * @returns True if the point is close (according to the acceptance) to the curve, false otherwise.
@@ -2534,6 +2645,16 @@ Bezier::getKeyframesCount() const
     }
 }
 
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// The position and bezier points of a control point at the time of the evaluation
+struct BezierCPPointsAtTime
+{
+    Transform::Point3D position, left, right;
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
 void
 Bezier::deCastelJau(bool isOpenBezier,
                     bool useGuiCurves,
@@ -2560,7 +2681,21 @@ Bezier::deCastelJau(bool isOpenBezier,
 
     const bool isClosed = finished && !isOpenBezier;
 
-    for (BezierCPs::const_iterator it = cps.begin(); it != cps.end(); ++it) {
+    // Each control point is shared by two segments: evaluate its curves once for all the segments
+    std::vector<BezierCPPointsAtTime> cpsAtTime( cps.size() );
+    {
+        std::size_t i = 0;
+        for (BezierCPs::const_iterator it = cps.begin(); it != cps.end(); ++it, ++i) {
+            BezierCPPointsAtTime& cp = cpsAtTime[i];
+            (*it)->getPointsAtTime(useGuiCurves, time, ViewIdx(0),
+                                   &cp.position.x, &cp.position.y,
+                                   &cp.left.x, &cp.left.y,
+                                   &cp.right.x, &cp.right.y);
+        }
+    }
+
+    std::size_t index = 0;
+    for (BezierCPs::const_iterator it = cps.begin(); it != cps.end(); ++it, ++index) {
         if ( next == cps.end() ) {
             if (!finished) {
                 break;
@@ -2569,10 +2704,12 @@ Bezier::deCastelJau(bool isOpenBezier,
         }
 
         const bool isLastSegment = nextnext == cps.end();
+        const BezierCPPointsAtTime& first = cpsAtTime[index];
+        const BezierCPPointsAtTime& last = cpsAtTime[(index + 1) % cpsAtTime.size()];
 
         if (points) {
             std::list<ParametricPoint> segmentPoints;
-            bezierSegmentEval(useGuiCurves, *(*it), *(*next), time, ViewIdx(0), mipmapLevel, nBPointsPerSegment, transform, &segmentPoints, bbox);
+            bezierSegmentEval(first.position, first.right, last.left, last.position, mipmapLevel, nBPointsPerSegment, transform, &segmentPoints, bbox);
 
             // If we are a closed bezier or we are not on the last segment, remove the last point so we don't add duplicates
             if (isClosed || !isLastSegment) {
@@ -2583,7 +2720,7 @@ Bezier::deCastelJau(bool isOpenBezier,
             points->push_back(segmentPoints);
         } else {
             assert(pointsSingleList);
-            bezierSegmentEval(useGuiCurves, *(*it), *(*next), time, ViewIdx(0), mipmapLevel, nBPointsPerSegment, transform, pointsSingleList, bbox);
+            bezierSegmentEval(first.position, first.right, last.left, last.position, mipmapLevel, nBPointsPerSegment, transform, pointsSingleList, bbox);
             // If we are a closed bezier or we are not on the last segment, remove the last point so we don't add duplicates
             if (isClosed || !isLastSegment) {
                 if (!pointsSingleList->empty()) {
@@ -2883,41 +3020,53 @@ Bezier::getBoundingBox(double time) const
     }
 #endif
 
-    RectD bbox;
-    bool bboxSet = false;
+    // The control points are evaluated at all the motion blur samples at once
+    std::vector<double> times;
     for (double t = startTime; t <= endTime; t += mbFrameStep) {
-        RectD subBbox; // a very empty bbox
-        subBbox.setupInfinity();
-
-        Transform::Matrix3x3 transform;
-        getTransformAtTime(t, &transform);
+        times.push_back(t);
+    }
+    std::vector<Transform::Matrix3x3> transforms( times.size() );
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        getTransformAtTime(times[i], &transforms[i]);
+    }
+    std::vector<RectD> subBboxes( times.size() );
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        subBboxes[i].setupInfinity(); // a very empty bbox
+    }
 
+    {
         QMutexLocker l(&itemMutex);
-        bezierSegmentListBboxUpdate(false, _imp->points, _imp->finished, _imp->isOpenBezier, t, ViewIdx(0), 0, transform, &subBbox);
-
+        bezierSegmentListBboxUpdateAtTimes(false, _imp->points, _imp->finished, _imp->isOpenBezier, times, ViewIdx(0), 0, transforms, &subBboxes);
 
         if (useFeatherPoints() && !_imp->isOpenBezier) {
-            bezierSegmentListBboxUpdate(false, _imp->featherPoints, _imp->finished, _imp->isOpenBezier, t, ViewIdx(0), 0, transform, &subBbox);
-            // EDIT: Partial fix, just pad the BBOX by the feather distance. This might not be accurate but gives at least something
-            // enclosing the real bbox and close enough
-            double featherDistance = getFeatherDistance(t);
-            subBbox.x1 -= featherDistance;
-            subBbox.x2 += featherDistance;
-            subBbox.y1 -= featherDistance;
-            subBbox.y2 += featherDistance;
+            bezierSegmentListBboxUpdateAtTimes(false, _imp->featherPoints, _imp->finished, _imp->isOpenBezier, times, ViewIdx(0), 0, transforms, &subBboxes);
+            for (std::size_t i = 0; i < times.size(); ++i) {
+                // EDIT: Partial fix, just pad the BBOX by the feather distance. This might not be accurate but gives at least something
+                // enclosing the real bbox and close enough
+                double featherDistance = getFeatherDistance(times[i]);
+                subBboxes[i].x1 -= featherDistance;
+                subBboxes[i].x2 += featherDistance;
+                subBboxes[i].y1 -= featherDistance;
+                subBboxes[i].y2 += featherDistance;
+            }
         } else if (_imp->isOpenBezier) {
-            double brushSize = getBrushSizeKnob()->getValueAtTime(t);
-            double halfBrushSize = brushSize / 2. + 1;
-            subBbox.x1 -= halfBrushSize;
-            subBbox.x2 += halfBrushSize;
-            subBbox.y1 -= halfBrushSize;
-            subBbox.y2 += halfBrushSize;
-        }
-        if (!bboxSet) {
-            bboxSet = true;
-            bbox = subBbox;
+            for (std::size_t i = 0; i < times.size(); ++i) {
+                double brushSize = getBrushSizeKnob()->getValueAtTime(times[i]);
+                double halfBrushSize = brushSize / 2. + 1;
+                subBboxes[i].x1 -= halfBrushSize;
+                subBboxes[i].x2 += halfBrushSize;
+                subBboxes[i].y1 -= halfBrushSize;
+                subBboxes[i].y2 += halfBrushSize;
+            }
+        }
+    }
+
+    RectD bbox;
+    for (std::size_t i = 0; i < subBboxes.size(); ++i) {
+        if (i == 0) {
+            bbox = subBboxes[i];
         } else {
-            bbox.merge(subBbox);
+            bbox.merge(subBboxes[i]);
         }
     }
 
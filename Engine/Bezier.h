@@ -32,6 +32,7 @@
 #include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 // clang-format off
 CLANG_DIAG_OFF(deprecated-declarations)
@@ -483,6 +484,20 @@ public:
                                             const Transform::Matrix3x3& transform,
                                             RectD* bbox);
 
+    /**
+     * @brief Same as bezierSegmentListBboxUpdate at each of the times, with the transform of each time, e.g: the motion
+     * blur samples of a frame. Each control point is evaluated at all the times at once, see BezierCP::getPointsAtTimes.
+     **/
+    static void bezierSegmentListBboxUpdateAtTimes(bool useGuiCurves,
+                                                   const std::list<BezierCPPtr> & points,
+                                                   bool finished,
+                                                   bool isOpenBezier,
+                                                   const std::vector<double>& times,
+                                                   ViewIdx view,
+                                                   unsigned int mipmapLevel,
+                                                   const std::vector<Transform::Matrix3x3>& transforms,
+                                                   std::vector<RectD>* bboxes);
+
     /**
      * @brief Returns a const ref to the control points of the bezier curve. This can only ever be called on the main thread.
      **/
@@ -176,6 +176,36 @@ BezierCP::setRightBezierStaticPosition(bool useGuiCurves,
     _imp->guiRightY = y;
 }
 
+// Displaces the bezier point (x,y) so that it lies on the line going through the position (px,py) and
+// parallel to the segment between (x,y) and the opposite bezier point (qx,qy)
+static void
+realignBezierPoint(double px,
+                   double py,
+                   double qx,
+                   double qy,
+                   double* x,
+                   double* y)
+{
+    // The vector between the two bezier points
+    double vx = qx - *x;
+    double vy = qy - *y;
+    double v = std::sqrt(vx * vx + vy *vy);
+
+    if (v > 0.) {
+        // The normal vector
+        double nx = vy / v;
+        double ny = -vx / v;
+        // The (signed) distance from the position to the segment
+        double d = nx * (px - *x) + ny * (py - *y);
+        // displace the key point in the normal direction.
+        *x += d * nx;
+        *y += d * ny;
+        // Verify that d is now zero
+        // d = nx * (px - *x) + ny * (py - *y);
+        // qDebug() << 'd' << d;
+    }
+}
+
 bool
 BezierCP::getLeftBezierPointAtTime(bool useGuiCurves,
                                    double time,
@@ -222,23 +252,7 @@ BezierCP::getLeftBezierPointAtTime(bool useGuiCurves,
         double px, py, qx, qy;
         getPositionAtTime(useGuiCurves, time, view, &px, &py);
         getRightBezierPointAtTime(useGuiCurves, time, view, &qx, &qy, false);
-        // The vector between the two bezier points
-        double vx = qx - *x;
-        double vy = qy - *y;
-        double v = std::sqrt(vx * vx + vy *vy);
-        if (v > 0.) {
-            // The normal vector
-            double nx = vy / v;
-            double ny = -vx / v;
-            // The (signed) distance from the position to the segment
-            double d = nx * (px - *x) + ny * (py - *y);
-            // displace the key point in the normal direction.
-            *x += d * nx;
-            *y += d * ny;
-            // Verify that d is now zero
-            // d = nx * (px - *x) + ny * (py - *y);
-            // qDebug() << 'd' << d;
-        }
+        realignBezierPoint(px, py, qx, qy, x, y);
     }
 
     return ret;
@@ -290,28 +304,100 @@ BezierCP::getRightBezierPointAtTime(bool useGuiCurves,
         double px, py, qx, qy;
         getPositionAtTime(useGuiCurves, time, view, &px, &py);
         getLeftBezierPointAtTime(useGuiCurves, time, view, &qx, &qy, false);
-        // The vector between the two bezier points
-        double vx = qx - *x;
-        double vy = qy - *y;
-        double v = std::sqrt(vx * vx + vy *vy);
-        if (v > 0.) {
-            // The normal vector
-            double nx = vy / v;
-            double ny = -vx / v;
-            // The (signed) distance from the position to the segment
-            double d = nx * (px - *x) + ny * (py - *y);
-            // displace the key point in the normal direction.
-            *x += d * nx;
-            *y += d * ny;
-            // Verify that d is now zero
-            // d = nx * (px - *x) + ny * (py - *y);
-            // qDebug() << 'd' << d;
-        }
+        realignBezierPoint(px, py, qx, qy, x, y);
     }
 
     return ret;
 } // BezierCP::getRightBezierPointAtTime
 
+void
+BezierCP::getPointsAtTime(bool useGuiCurves,
+                          double time,
+                          ViewIdx view,
+                          double* x,
+                          double* y,
+                          double* leftX,
+                          double* leftY,
+                          double* rightX,
+                          double* rightY) const
+{
+    getPositionAtTime(useGuiCurves, time, view, x, y);
+    getLeftBezierPointAtTime(useGuiCurves, time, view, leftX, leftY, false);
+    getRightBezierPointAtTime(useGuiCurves, time, view, rightX, rightY, false);
+
+    // Same as the realignment of getLeftBezierPointAtTime and getRightBezierPointAtTime: each bezier point is
+    // realigned against the other one before it is realigned itself
+    if (!_imp->broken) {
+        double rawLeftX = *leftX;
+        double rawLeftY = *leftY;
+        realignBezierPoint(*x, *y, *rightX, *rightY, leftX, leftY);
+        realignBezierPoint(*x, *y, rawLeftX, rawLeftY, rightX, rightY);
+    }
+}
+
+/// Evaluates the x and y curves of a point at the times, or sets its static position if it is not animated
+static void
+getCurvesValuesAtTimes(const Curve& xCurve,
+                       const Curve& yCurve,
+                       const double* times,
+                       int count,
+                       double staticX,
+                       double staticY,
+                       double* x,
+                       double* y)
+{
+    if ( xCurve.isAnimated() ) {
+        xCurve.getValuesAt(times, count, x);
+        yCurve.getValuesAt(times, count, y);
+    } else {
+        std::fill(x, x + count, staticX);
+        std::fill(y, y + count, staticY);
+    }
+}
+
+void
+BezierCP::getPointsAtTimes(bool useGuiCurves,
+                           const double* times,
+                           int count,
+                           ViewIdx /*view*/,
+                           double* x,
+                           double* y,
+                           double* leftX,
+                           double* leftY,
+                           double* rightX,
+                           double* rightY) const
+{
+    double staticX, staticY, staticLeftX, staticLeftY, staticRightX, staticRightY;
+    {
+        QMutexLocker l(&_imp->staticPositionMutex);
+        staticX = useGuiCurves ? _imp->guiX : _imp->x;
+        staticY = useGuiCurves ? _imp->guiY : _imp->y;
+        staticLeftX = useGuiCurves ? _imp->guiLeftX : _imp->leftX;
+        staticLeftY = useGuiCurves ? _imp->guiLeftY : _imp->leftY;
+        staticRightX = useGuiCurves ? _imp->guiRightX : _imp->rightX;
+        staticRightY = useGuiCurves ? _imp->guiRightY : _imp->rightY;
+    }
+    if (!useGuiCurves) {
+        getCurvesValuesAtTimes(*_imp->curveX, *_imp->curveY, times, count, staticX, staticY, x, y);
+        getCurvesValuesAtTimes(*_imp->curveLeftBezierX, *_imp->curveLeftBezierY, times, count, staticLeftX, staticLeftY, leftX, leftY);
+        getCurvesValuesAtTimes(*_imp->curveRightBezierX, *_imp->curveRightBezierY, times, count, staticRightX, staticRightY, rightX, rightY);
+    } else {
+        getCurvesValuesAtTimes(*_imp->guiCurveX, *_imp->guiCurveY, times, count, staticX, staticY, x, y);
+        getCurvesValuesAtTimes(*_imp->guiCurveLeftBezierX, *_imp->guiCurveLeftBezierY, times, count, staticLeftX, staticLeftY, leftX, leftY);
+        getCurvesValuesAtTimes(*_imp->guiCurveRightBezierX, *_imp->guiCurveRightBezierY, times, count, staticRightX, staticRightY, rightX, rightY);
+    }
+
+    // Same realignment as getPointsAtTime
+    if (!_imp->broken) {
+        for (int i = 0; i < count; ++i) {
+            double rawLeftX = leftX[i];
+            double rawLeftY = leftY[i];
+            realignBezierPoint(x[i], y[i], rightX[i], rightY[i], &leftX[i], &leftY[i]);
+            realignBezierPoint(x[i], y[i], rawLeftX, rawLeftY, &rightX[i], &rightY[i]);
+        }
+    }
+}
+
 void
 BezierCP::setLeftBezierPointAtTime(bool useGuiCurves,
                                    double time,
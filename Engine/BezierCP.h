@@ -123,6 +123,18 @@ public:
 
     bool getRightBezierPointAtTime(bool useGuiCurves, double time, ViewIdx view, double *x, double *y, bool reAlign = true) const;
 
+    /**
+     * @brief Returns the position and the realigned left and right bezier points at the given time, evaluating each
+     * curve once: the results are the same as getPositionAtTime, getLeftBezierPointAtTime and getRightBezierPointAtTime.
+     **/
+    void getPointsAtTime(bool useGuiCurves, double time, ViewIdx view, double* x, double* y, double* leftX, double* leftY, double* rightX, double* rightY) const;
+
+    /**
+     * @brief Same as getPointsAtTime at count times, each output array having count elements: each curve is evaluated
+     * at all the times at once with Curve::getValuesAt(), which is faster if the times are increasing.
+     **/
+    void getPointsAtTimes(bool useGuiCurves, const double* times, int count, ViewIdx view, double* x, double* y, double* leftX, double* leftY, double* rightX, double* rightY) const;
+
     bool getBroken() const;
     
     bool hasKeyFrameAtTime(bool useGuiCurves, double time) const;
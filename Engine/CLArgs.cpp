@@ -69,6 +69,9 @@ public:
     bool clearCacheOnLaunch;
     bool clearOpenFXCacheOnLaunch;
     QString ipcPipe;
+    int renderProcessesCount;
+    bool isRenderWorker;
+    QString traceFilePath;
     std::optional<int> error;
     bool isInterpreterMode;
     std::list<std::pair<int, std::pair<int, int> > > frameRanges;
@@ -84,6 +87,7 @@ public:
     qint64 breakpadProcessPID;
 #endif
     QString exportDocsPath;
+    QString convertedProjectPath;
 
     CLArgsPrivate()
         : args()
@@ -99,6 +103,9 @@ public:
         , clearCacheOnLaunch(false)
         , clearOpenFXCacheOnLaunch(false)
         , ipcPipe()
+        , renderProcessesCount(1)
+        , isRenderWorker(false)
+        , traceFilePath()
         , isInterpreterMode(false)
         , frameRanges()
         , rangeSet(false)
@@ -113,6 +120,7 @@ public:
         , breakpadProcessPID(-1)
 #endif
         , exportDocsPath()
+        , convertedProjectPath()
     {
     }
 
@@ -259,6 +267,9 @@ CLArgs::operator=(const CLArgs& other)
     _imp->settingCommands = other._imp->settingCommands;
     _imp->isBackground = other._imp->isBackground;
     _imp->ipcPipe = other._imp->ipcPipe;
+    _imp->renderProcessesCount = other._imp->renderProcessesCount;
+    _imp->isRenderWorker = other._imp->isRenderWorker;
+    _imp->traceFilePath = other._imp->traceFilePath;
     _imp->error = other._imp->error;
     _imp->isInterpreterMode = other._imp->isInterpreterMode;
     _imp->frameRanges = other._imp->frameRanges;
@@ -267,6 +278,7 @@ CLArgs::operator=(const CLArgs& other)
     _imp->isEmpty = other._imp->isEmpty;
     _imp->imageFilename = other._imp->imageFilename;
     _imp->exportDocsPath = other._imp->exportDocsPath;
+    _imp->convertedProjectPath = other._imp->convertedProjectPath;
 }
 
 bool
@@ -374,7 +386,26 @@ CLArgs::printUsage(const std::string& programName)
         "     breakdown contains information about each nodes, render times etc...\n"
         "     This option is useful for debugging purposes or to control that a render\n"
         "     is working correctly.\n"
-        "     **Please note** that it does not work when writing video files."
+        "     **Please note** that it does not work when writing video files.\n"
+        "  --processes <count>\n"
+        "     Render with the given number of processes on this machine. The frame\n"
+        "     range of each Write node is split in chunks of frames which are handed\n"
+        "     out to the processes as they become idle, and a chunk is rendered again\n"
+        "     if its process crashes. This is faster than a single process when the\n"
+        "     graph contains plug-ins which cannot render several frames at once.\n"
+        "     Video files are always rendered by a single process.\n"
+        "  --trace <trace file path>\n"
+        "     Record the time spent by each thread in the steps of the render\n"
+        "     (renderRoI, tiles, cache look-ups, plug-in actions, Python GIL and\n"
+        "     OpenGL context waits) and write it to the given file when rendering\n"
+        "     is done, as a Chrome trace which can be opened in chrome://tracing or\n"
+        "     https://ui.perfetto.dev. This is useful to find where renders stall.\n"
+        "  --convert-project <output project file path>\n"
+        "     Do not render: write the project to the given file in the other format,\n"
+        "     i.e. an XML project is converted to the binary format and a binary\n"
+        "     project to XML. The binary format is faster to load and save, see the\n"
+        "     \"Save projects in binary format\" preference. The GUI layout (node graph,\n"
+        "     panes) is not converted: save the project from %1 to keep it.\n"
         "  <frameRanges>\n"
         "      One or more frame ranges, separated by commas.\n"
         "      Each frame range must be one of the following:\n"
@@ -391,6 +422,9 @@ CLArgs::printUsage(const std::string& programName)
         "  %1Renderer -w MyWriter /FastDisk/Pictures/sequence'###'.exr 1-100 /Users/Me/MyNatronProjects/MyProject.ntp\n"
         "  %1Renderer -w MyWriter -w MySecondWriter 1-10 /Users/Me/MyNatronProjects/MyProject.ntp\n"
         "  %1Renderer -w MyWriter 1-10 -l /Users/Me/Scripts/onProjectLoaded.py /Users/Me/MyNatronProjects/MyProject.ntp\n"
+        "  %1Renderer --processes 4 -w MyWriter 1-100 /Users/Me/MyNatronProjects/MyProject.ntp\n"
+        "  %1Renderer --trace /Users/Me/render-trace.json -w MyWriter 1-10 /Users/Me/MyNatronProjects/MyProject.ntp\n"
+        "  %1Renderer --convert-project /Users/Me/MyNatronProjects/MyProject-binary.ntp /Users/Me/MyNatronProjects/MyProject.ntp\n"
         "\n"
         /* Text must hold in 80 columns ************************************************/
         "Options for the execution of Python scripts:\n"
@@ -560,6 +594,24 @@ CLArgs::getIPCPipeName() const
     return _imp->ipcPipe;
 }
 
+int
+CLArgs::getRenderProcessesCount() const
+{
+    return _imp->renderProcessesCount;
+}
+
+bool
+CLArgs::isRenderWorker() const
+{
+    return _imp->isRenderWorker;
+}
+
+const QString&
+CLArgs::getTraceFilePath() const
+{
+    return _imp->traceFilePath;
+}
+
 bool
 CLArgs::areRenderStatsEnabled() const
 {
@@ -610,6 +662,12 @@ CLArgs::getExportDocsPath() const
     return _imp->exportDocsPath;
 }
 
+const QString &
+CLArgs::getConvertedProjectPath() const
+{
+    return _imp->convertedProjectPath;
+}
+
 QStringList::iterator
 CLArgsPrivate::findFileNameWithExtension(const QString& extension)
 {
@@ -966,6 +1024,24 @@ CLArgsPrivate::parse()
         }
     }
 
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("convert-project"), QString() );
+        if ( it != args.end() ) {
+            it = args.erase(it);
+
+            if ( it == args.end() || it->startsWith( QChar::fromLatin1('-') ) ) {
+                std::cout << tr("You must specify the path of the converted project").toStdString() << std::endl;
+                error = 1;
+
+                return;
+            }
+
+            convertedProjectPath = AppManager::qt_tildeExpansion(*it);
+            it = args.erase(it);
+            isBackground = true;
+        }
+    }
+
     {
         QStringList::iterator it = hasToken( QString::fromUtf8("IPCpipe"), QString() );
         if ( it != args.end() ) {
@@ -981,6 +1057,48 @@ CLArgsPrivate::parse()
         }
     }
 
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("render-worker"), QString() );
+        if ( it != args.end() ) {
+            it = args.erase(it);
+            isRenderWorker = true;
+        }
+    }
+
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("processes"), QString() );
+        if ( it != args.end() ) {
+            it = args.erase(it);
+            bool ok = false;
+            if ( it != args.end() ) {
+                renderProcessesCount = it->toInt(&ok);
+            }
+            if ( !ok || (renderProcessesCount < 1) ) {
+                std::cout << tr("You must specify a number of processes greater than 0 when using the --processes option").toStdString() << std::endl;
+                error = 1;
+
+                return;
+            }
+            it = args.erase(it);
+            isBackground = true;
+        }
+    }
+
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("trace"), QString() );
+        if ( it != args.end() ) {
+            it = args.erase(it);
+            if ( it == args.end() || it->startsWith( QChar::fromLatin1('-') ) ) {
+                std::cout << tr("You must specify the trace file path when using the --trace option").toStdString() << std::endl;
+                error = 1;
+
+                return;
+            }
+            traceFilePath = AppManager::qt_tildeExpansion(*it);
+            it = args.erase(it);
+        }
+    }
+
     {
         QStringList::iterator it = hasToken( QString::fromUtf8("onload"), QString::fromUtf8("l") );
         if ( it != args.end() ) {
@@ -1316,7 +1434,11 @@ CLArgsPrivate::parse()
     qDebug() << "breakpadComPipeFilePath:" << breakpadComPipeFilePath;
 #endif
     qDebug() << "exportDocsPath:" << exportDocsPath;
+    qDebug() << "convertedProjectPath:" << convertedProjectPath;
     qDebug() << "ipcPipe:" << ipcPipe;
+    qDebug() << "renderProcessesCount:" << renderProcessesCount;
+    qDebug() << "isRenderWorker:" << isRenderWorker;
+    qDebug() << "traceFilePath:" << traceFilePath;
     qDebug() << "defaultOnProjectLoadedScript:" << defaultOnProjectLoadedScript;
     qDebug() << "settingCommands:";
     for (auto&& it: settingCommands) {
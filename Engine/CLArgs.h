@@ -135,6 +135,21 @@ public:
     const QString& getDefaultOnProjectLoadedScript() const;
     const QString& getIPCPipeName() const;
 
+    /*
+     * @brief The number of processes rendering the frames of each writer, given by --processes
+     */
+    int getRenderProcessesCount() const;
+
+    /*
+     * @brief True if this process renders the frame ranges sent by the process which started it through the IPC pipe
+     */
+    bool isRenderWorker() const;
+
+    /*
+     * @brief The file where the render trace is written when rendering is done, given by --trace
+     */
+    const QString& getTraceFilePath() const;
+
     bool isPythonScript() const;
 
     bool areRenderStatsEnabled() const;
@@ -147,6 +162,7 @@ public:
     const QString& getBreakpadComPipeFilePath() const;
 #endif
     const QString& getExportDocsPath() const;
+    const QString& getConvertedProjectPath() const;
 
 private:
 
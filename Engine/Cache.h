@@ -33,12 +33,15 @@
 #include <fstream>
 #include <functional>
 #include <list>
+#include <map>
+#include <memory>
 #include <set>
 #include <cstddef>
 #include <utility>
 #include <algorithm> // min, max
 #include <string>
 #include <stdexcept>
+#include <atomic>
 
 #include "Global/GlobalDefines.h"
 #include "Global/StrUtils.h"
@@ -48,6 +51,7 @@ GCC_DIAG_OFF(deprecated)
 #include <QtCore/QThread>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QMutexLocker>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QObject>
 #include <QtCore/QBuffer>
 #include <QtCore/QRunnable>
@@ -55,9 +59,11 @@ GCC_DIAG_ON(deprecated)
 
 #include "Engine/AppManager.h" //for access to settings
 #include "Engine/CacheEntry.h"
+#include "Engine/CacheJournal.h"
 #include "Engine/ImageLocker.h"
 #include "Engine/LRUHashTable.h"
 #include "Engine/MemoryInfo.h" // getSystemTotalRAM
+#include "Engine/RamBufferPool.h"
 #include "Engine/Settings.h"
 #include "Engine/StandardPaths.h"
 
@@ -68,11 +74,60 @@ GCC_DIAG_ON(deprecated)
 
 #define NATRON_TILE_CACHE_FILE_SIZE_BYTES 2000000000
 
+///Number of prefetched hashes remembered to count the prefetch hits
+#define NATRON_CACHE_MAX_PREFETCHED_HASHES 4096
+
 ///When defined, number of opened files, memory size and disk size of the cache are printed whenever there's activity.
 //#define NATRON_DEBUG_CACHE
 
 NATRON_NAMESPACE_ENTER
 
+/**
+ * @brief Counters describing how much the threads looking-up the cache are waiting on each other.
+ **/
+struct CacheLockStats
+{
+    std::atomic<U64> nLookups; // number of calls to get() and getOrCreate()
+    std::atomic<U64> nContendedLocks; // number of times a cache lock was already taken by another thread
+    std::atomic<U64> lockWaitNSecs; // total time spent waiting on contended cache locks
+
+    CacheLockStats()
+        : nLookups(0)
+        , nContendedLocks(0)
+        , lockWaitNSecs(0)
+    {
+    }
+};
+
+/**
+ * @brief Same as QMutexLocker, except that the time spent waiting for the mutex is accumulated
+ * in the given stats when it is already locked by another thread.
+ **/
+class CacheLocker
+{
+    QMutex* _mutex;
+
+public:
+
+    CacheLocker(QMutex* mutex,
+                CacheLockStats* stats)
+        : _mutex(mutex)
+    {
+        if ( !_mutex->tryLock() ) {
+            QElapsedTimer timer;
+            timer.start();
+            _mutex->lock();
+            ++stats->nContendedLocks;
+            stats->lockWaitNSecs += timer.nsecsElapsed();
+        }
+    }
+
+    ~CacheLocker()
+    {
+        _mutex->unlock();
+    }
+};
+
 /**
  * @brief The point of this thread is to delete the content of the list in a separate thread so the thread calling
  * get() doesn't wait for all the entries to be deleted (which can be expensive for large images)
@@ -193,6 +248,127 @@ private:
     }
 };
 
+/**
+ * @brief Compresses the entries moved to the compressed portion of the cache, so that the threads evicting them
+ * do not wait for the compression. The RAM of an entry is released once it is compressed.
+ **/
+template <typename T>
+class CacheCompressorThread
+    : public QThread
+{
+    struct QueuedEntry
+    {
+        std::shared_ptr<T> entry;
+        U64 generation;
+    };
+
+    mutable QMutex _entriesQueueMutex;
+    std::list<QueuedEntry> _entriesQueue;
+    QWaitCondition _entriesQueueNotEmptyCond;
+    CacheAPI* cache;
+    QMutex mustQuitMutex;
+    QWaitCondition mustQuitCond;
+    bool mustQuit;
+
+public:
+
+    CacheCompressorThread(CacheAPI* cache)
+        : QThread()
+        , _entriesQueueMutex()
+        , _entriesQueue()
+        , _entriesQueueNotEmptyCond()
+        , cache(cache)
+        , mustQuitMutex()
+        , mustQuitCond()
+        , mustQuit(false)
+    {
+        setObjectName( QString::fromUtf8("CacheCompressor") );
+    }
+
+    virtual ~CacheCompressorThread()
+    {
+    }
+
+    /**
+     * @brief Queues an entry moved to the compressed portion, generation being the value returned by
+     * moveToCompressedPortion().
+     **/
+    void appendToQueue(const std::shared_ptr<T>& entry,
+                       U64 generation)
+    {
+        {
+            QMutexLocker k(&_entriesQueueMutex);
+            QueuedEntry queued;
+            queued.entry = entry;
+            queued.generation = generation;
+            _entriesQueue.push_back(queued);
+        }
+        if ( !isRunning() ) {
+            start(QThread::LowPriority);
+        } else {
+            QMutexLocker k(&_entriesQueueMutex);
+            _entriesQueueNotEmptyCond.wakeOne();
+        }
+    }
+
+    /**
+     * @brief The entries left in the queue are not compressed.
+     **/
+    void quitThread()
+    {
+        if ( !isRunning() ) {
+            return;
+        }
+        QMutexLocker k(&mustQuitMutex);
+        assert(!mustQuit);
+        mustQuit = true;
+
+        {
+            QMutexLocker k2(&_entriesQueueMutex);
+            _entriesQueue.clear();
+            _entriesQueue.push_back( QueuedEntry() );
+            _entriesQueueNotEmptyCond.wakeOne();
+        }
+        while (mustQuit) {
+            mustQuitCond.wait(k.mutex());
+        }
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        for (;; ) {
+            QueuedEntry front;
+            {
+                QMutexLocker k(&_entriesQueueMutex);
+                while ( _entriesQueue.empty() ) {
+                    _entriesQueueNotEmptyCond.wait(k.mutex());
+                }
+                front = _entriesQueue.front();
+                _entriesQueue.pop_front();
+            }
+            if (!front.entry) {
+                {
+                    QMutexLocker k(&_entriesQueueMutex);
+                    _entriesQueue.clear();
+                }
+                QMutexLocker k(&mustQuitMutex);
+                assert(mustQuit);
+                mustQuit = false;
+                mustQuitCond.wakeOne();
+
+                return;
+            }
+
+            // The entry may have been looked-up since it was queued, in which case it is not compressed
+            if ( front.entry->compressData(front.generation) ) {
+                cache->notifyMemoryDeallocated();
+            }
+        }
+    }
+};
+
 
 /**
  * @brief The point of this thread is to remove entries that we are sure are no longer needed
@@ -204,9 +380,17 @@ class CacheCleanerThread
     mutable QMutex _requestQueueMutex;
     struct CleanRequest
     {
-        std::string holderID;
-        U64 nodeHash;
-        bool removeAll;
+        // For each holder, the node hashes of its entries to keep
+        CacheHoldersNodeHashes nodeHashesToKeep;
+
+        // If true, this is not a request for a holder but a request to bring back the cache under its maximum size
+        bool enforceBudget;
+
+        CleanRequest()
+            : nodeHashesToKeep()
+            , enforceBudget(false)
+        {
+        }
     };
 
     std::list<CleanRequest> _requestsQueues;
@@ -235,16 +419,37 @@ public:
     {
     }
 
-    void appendToQueue(const std::string & holderID,
-                       U64 nodeHash,
-                       bool removeAll)
+    void appendToQueue(const CacheHoldersNodeHashes & nodeHashesToKeep)
     {
         {
             QMutexLocker k(&_requestQueueMutex);
             CleanRequest r;
-            r.holderID = holderID;
-            r.nodeHash = nodeHash;
-            r.removeAll = removeAll;
+            r.nodeHashesToKeep = nodeHashesToKeep;
+            _requestsQueues.push_back(r);
+        }
+        if ( !isRunning() ) {
+            start();
+        } else {
+            QMutexLocker k(&_requestQueueMutex);
+            _requestsQueueNotEmptyCond.wakeOne();
+        }
+    }
+
+    /**
+     * @brief Request the thread to evict entries from all shards of the cache until it fits again in its maximum size.
+     * Requests that are not yet processed are coalesced.
+     **/
+    void appendBudgetRequest()
+    {
+        {
+            QMutexLocker k(&_requestQueueMutex);
+            for (std::list<CleanRequest>::const_iterator it = _requestsQueues.begin(); it != _requestsQueues.end(); ++it) {
+                if (it->enforceBudget) {
+                    return;
+                }
+            }
+            CleanRequest r;
+            r.enforceBudget = true;
             _requestsQueues.push_back(r);
         }
         if ( !isRunning() ) {
@@ -314,7 +519,151 @@ private:
                     front = _requestsQueues.front();
                     _requestsQueues.pop_front();
                 }
-                cache->removeAllEntriesWithDifferentNodeHashForHolderPrivate(front.holderID, front.nodeHash, front.removeAll);
+                if (front.enforceBudget) {
+                    cache->clearExceedingEntries();
+                } else if ( !front.nodeHashesToKeep.empty() ) {
+                    cache->removeAllEntriesWithDifferentNodeHashForHoldersPrivate(front.nodeHashesToKeep);
+                }
+            }
+            // Wake-up threads waiting for memory in createInternal(), even if nothing could be evicted
+            cache->notifyMemoryDeallocated();
+        }
+    }
+};
+
+
+/**
+ * @brief Reads ahead the tiles of a tiled cache that are about to be read, e.g: the frames that follow the current one
+ * during playback, so that reading them back from the disk portion does not fault pages in lazily.
+ * All the tiles of a request are first hinted to the system so that it reads them asynchronously, then their pages
+ * are touched in order so that they are mapped by the time the render threads read them.
+ * A request replaces the one that is not processed yet, which describes a position of the playback that is already behind.
+ **/
+class CachePrefetchThread
+    : public QThread
+{
+public:
+
+    struct Tile
+    {
+        TileCacheFilePtr file;
+        std::size_t dataOffset;
+        std::size_t size;
+    };
+
+private:
+
+    // The mutex of the cache under which the tile files are created and resized
+    QMutex* _tileCacheMutex;
+    mutable QMutex _requestMutex;
+    std::vector<Tile> _request;
+    bool _hasRequest;
+    QWaitCondition _requestCond;
+    bool _mustQuit; // protected by _requestMutex
+    std::atomic<U64> _nTilesPrefetched;
+
+public:
+
+    CachePrefetchThread(QMutex* tileCacheMutex)
+        : QThread()
+        , _tileCacheMutex(tileCacheMutex)
+        , _requestMutex()
+        , _request()
+        , _hasRequest(false)
+        , _requestCond()
+        , _mustQuit(false)
+        , _nTilesPrefetched(0)
+    {
+        setObjectName( QString::fromUtf8("CachePrefetch") );
+    }
+
+    virtual ~CachePrefetchThread()
+    {
+    }
+
+    void appendRequest(const std::vector<Tile>& tiles)
+    {
+        {
+            QMutexLocker k(&_requestMutex);
+            if (_mustQuit) {
+                return;
+            }
+            _request = tiles;
+            _hasRequest = true;
+            _requestCond.wakeOne();
+        }
+        if ( !isRunning() ) {
+            start(QThread::LowPriority);
+        }
+    }
+
+    void quitThread()
+    {
+        if ( !isRunning() ) {
+            return;
+        }
+        {
+            QMutexLocker k(&_requestMutex);
+            _mustQuit = true;
+            _request.clear();
+            _hasRequest = false;
+            _requestCond.wakeOne();
+        }
+        wait();
+        QMutexLocker k(&_requestMutex);
+        _mustQuit = false;
+    }
+
+    U64 getTilesPrefetchedCount() const
+    {
+        return _nTilesPrefetched;
+    }
+
+private:
+
+    bool isRequestPending() const
+    {
+        QMutexLocker k(&_requestMutex);
+
+        return _hasRequest || _mustQuit;
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        for (;; ) {
+            std::vector<Tile> tiles;
+            {
+                QMutexLocker k(&_requestMutex);
+                while (!_hasRequest && !_mustQuit) {
+                    _requestCond.wait(k.mutex());
+                }
+                if (_mustQuit) {
+                    return;
+                }
+                tiles.swap(_request);
+                _hasRequest = false;
+            }
+
+            // The tile files may be remapped by the render threads while they are resized: the mapping is only read
+            // under the tile cache mutex, which is released between tiles so that allocations are not held up
+            for (std::size_t i = 0; i < tiles.size(); ++i) {
+                QMutexLocker k(_tileCacheMutex);
+                tiles[i].file->file->prefetch(tiles[i].file->file->data() + tiles[i].dataOffset, tiles[i].size);
+            }
+            for (std::size_t i = 0; i < tiles.size(); ++i) {
+                if ( isRequestPending() ) {
+                    break;
+                }
+                {
+                    QMutexLocker k(_tileCacheMutex);
+                    const volatile char* data = tiles[i].file->file->data() + tiles[i].dataOffset;
+                    char sum = 0;
+                    for (std::size_t b = 0; b < tiles[i].size; b += 4096) {
+                        sum += data[b];
+                    }
+                    Q_UNUSED(sum);
+                }
+                ++_nTilesPrefetched;
             }
         }
     }
@@ -394,8 +743,6 @@ public:
 
     struct SerializedEntry;
 
-    typedef std::list<SerializedEntry> CacheTOC;
-
 public:
 
 
@@ -477,24 +824,52 @@ public:
 
 private:
 
+    /**
+     * @brief A shard owns the entries whose hash falls in its portion of the hash space.
+     * Each shard has its own LRU containers and locks, so that threads looking-up entries of different
+     * shards do not wait on each other. The maximum size is global to the cache: the sizes of the shards
+     * are only used to pick which shard to evict from.
+     **/
+    struct Shard
+    {
+        QMutex lock; //protects memoryCache, compressedCache & diskCache
+        QMutex getLock; //prevents get() and getOrCreate() to be called simultaneously for entries of this shard
+        CacheContainer memoryCache;
+        CacheContainer compressedCache; // entries evicted from memoryCache whose data is kept compressed in RAM
+        CacheContainer diskCache;
+        std::size_t memorySize; // protected by the cache _sizeLock
+        std::size_t diskSize; // protected by the cache _sizeLock
+
+        Shard()
+            : lock()
+            , getLock()
+            , memoryCache()
+            , compressedCache()
+            , diskCache()
+            , memorySize(0)
+            , diskSize(0)
+        {
+        }
+    };
+
+    typedef std::shared_ptr<Shard> ShardPtr;
 
     std::size_t _maximumInMemorySize;     // the maximum size of the in-memory portion of the cache.(in % of the maximum cache size)
+    std::size_t _maximumCompressedSize;     // the maximum size of the compressed portion of the cache, 0 if it is disabled
     std::size_t _maximumCacheSize;     // maximum size allowed for the cache
 
     /*mutable because we need to change modify it in the sealEntryInternal function which
          is called by an external object that have a const ref to the cache.
      */
     mutable std::size_t _memoryCacheSize;     // current size of the cache in bytes
+    mutable std::size_t _compressedCacheSize;
     mutable std::size_t _diskCacheSize;
-    mutable QMutex _sizeLock; // protects _memoryCacheSize & _diskCacheSize & _maximumInMemorySize & _maximumCacheSize
-    mutable QMutex _lock; //protects _memoryCache & _diskCache
-    mutable QMutex _getLock;  //prevents get() and getOrCreate() to be called simultaneously
-
+    mutable QMutex _sizeLock; // protects the current and maximum sizes of the cache & the shards sizes
 
-    /*These 2 are mutable because we need to modify the LRU list even
-         when we call get() and we want this function to be const.*/
-    mutable CacheContainer _memoryCache;
-    mutable CacheContainer _diskCache;
+    // The shards are created once in the constructor and never change afterwards, hence
+    // the vector itself does not need to be protected.
+    std::vector<ShardPtr> _shards;
+    mutable CacheLockStats _lockStats;
     const std::string _cacheName;
     const unsigned int _version;
 
@@ -508,6 +883,7 @@ private:
     mutable DeleterThread<EntryType> _deleterThread;
     mutable QWaitCondition _memoryFullCondition; //< protected by _sizeLock
     mutable CacheCleanerThread _cleanerThread;
+    mutable CacheCompressorThread<EntryType> _compressorThread;
 
     // If tiled, the cache will consist only of a few large files that each contain tiles of the same size.
     // This is useful to cache chunks of data that always have the same size.
@@ -524,24 +900,39 @@ private:
     // When set these are used for fast search of a free tile
     TileCacheFileWPtr _nextAvailableCacheFile;
     int _nextAvailableCacheFileIndex;
+
+    // The persistent table of contents of the disk portion, set once the cache is restored.
+    // Removals are written right away whereas additions are kept in _journalPendingEntries and written by
+    // syncJournal(), once their data is flushed to the backing file.
+    mutable QMutex _journalMutex; // protects _journal & _journalPendingEntries
+    CacheJournalPtr _journal;
+    mutable std::map<const EntryType*, std::weak_ptr<EntryType> > _journalPendingEntries;
+
+    // Read-ahead of the disk portion of tiled caches, see prefetch()
+    mutable CachePrefetchThread _prefetchThread;
+    mutable QMutex _prefetchMutex; // protects _prefetchedHashes
+    mutable std::set<hash_type> _prefetchedHashes; // hashes prefetched but not read yet
+    mutable std::atomic<U64> _nPrefetchHits;
+    mutable std::atomic<U64> _nPrefetchMisses;
 public:
 
 
     Cache(const std::string & cacheName,
           unsigned int version,
           U64 maximumCacheSize,      // total size
-          double maximumInMemoryPercentage //how much should live in RAM
+          double maximumInMemoryPercentage, //how much should live in RAM
+          int nShards = 1 // in how many independently locked portions the hash space is split
           )
         : CacheAPI()
         , _maximumInMemorySize(maximumCacheSize * maximumInMemoryPercentage)
+        , _maximumCompressedSize(0)
         , _maximumCacheSize(maximumCacheSize)
         , _memoryCacheSize(0)
+        , _compressedCacheSize(0)
         , _diskCacheSize(0)
         , _sizeLock()
-        , _lock()
-        , _getLock()
-        , _memoryCache()
-        , _diskCache()
+        , _shards()
+        , _lockStats()
         , _cacheName(cacheName)
         , _version(version)
         , _signalEmitter()
@@ -550,6 +941,7 @@ public:
         , _deleterThread(this)
         , _memoryFullCondition()
         , _cleanerThread(this)
+        , _compressorThread(this)
         , _tileCacheMutex()
         , _isTiled(false)
         , _tileByteSize(0)
@@ -557,17 +949,50 @@ public:
         , _cacheFiles()
         , _nextAvailableCacheFile()
         , _nextAvailableCacheFileIndex(-1)
+        , _journalMutex()
+        , _journal()
+        , _journalPendingEntries()
+        , _prefetchThread(&_tileCacheMutex)
+        , _prefetchMutex()
+        , _prefetchedHashes()
+        , _nPrefetchHits(0)
+        , _nPrefetchMisses(0)
     {
         _signalEmitter = std::make_shared<CacheSignalEmitter>();
+        nShards = std::max(1, nShards);
+        for (int i = 0; i < nShards; ++i) {
+            _shards.push_back( std::make_shared<Shard>() );
+        }
     }
 
     virtual ~Cache()
     {
-        QMutexLocker locker(&_lock);
-
         _tearingDown = true;
-        _memoryCache.clear();
-        _diskCache.clear();
+        _prefetchThread.quitThread();
+        _compressorThread.quitThread();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            QMutexLocker locker(&_shards[i]->lock);
+            _shards[i]->memoryCache.clear();
+            _shards[i]->compressedCache.clear();
+            _shards[i]->diskCache.clear();
+        }
+    }
+
+    int getShardsCount() const
+    {
+        return (int)_shards.size();
+    }
+
+    /**
+     * @brief Returns the contention counters of the cache locks since the cache was created.
+     **/
+    void getLockStats(U64* nLookups,
+                      U64* nContendedLocks,
+                      U64* lockWaitNSecs) const
+    {
+        *nLookups = _lockStats.nLookups;
+        *nContendedLocks = _lockStats.nContendedLocks;
+        *lockWaitNSecs = _lockStats.lockWaitNSecs;
     }
 
     virtual bool isTileCache() const OVERRIDE FINAL
@@ -597,10 +1022,82 @@ public:
 
     void waitForDeleterThread()
     {
+        _prefetchThread.quitThread();
+        _compressorThread.quitThread();
         _deleterThread.quitThread();
         _cleanerThread.quitThread();
     }
 
+    /**
+     * @brief Relevant only for tiled caches: reads ahead, from a background thread, the tiles of the disk portion
+     * of the entries with the given hashes, which are about to be read. Hashes that are not in the cache are ignored.
+     * A call replaces the read-ahead requested by the previous call if it did not start yet.
+     **/
+    void prefetch(const std::vector<hash_type>& hashes) const
+    {
+        std::size_t tileByteSize;
+        {
+            QMutexLocker k(&_tileCacheMutex);
+            if (!_isTiled) {
+                return;
+            }
+            tileByteSize = _tileByteSize;
+        }
+
+        std::vector<CachePrefetchThread::Tile> tiles;
+        for (std::size_t i = 0; i < hashes.size(); ++i) {
+            {
+                QMutexLocker k(&_prefetchMutex);
+                if ( _prefetchedHashes.find(hashes[i]) != _prefetchedHashes.end() ) {
+                    continue;
+                }
+            }
+            std::list<EntryTypePtr> entries;
+            {
+                Shard& shard = getShard(hashes[i]);
+                CacheLocker locker(&shard.lock, &_lockStats);
+                CacheIterator found = shard.diskCache(hashes[i]);
+                if ( found == shard.diskCache.end() ) {
+                    continue;
+                }
+                entries = getValueFromIterator(found);
+            }
+            bool prefetched = false;
+            for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                CachePrefetchThread::Tile tile;
+                tile.file = (*it)->tryGetTileCacheFile(&tile.dataOffset);
+                if (tile.file) {
+                    tile.size = tileByteSize;
+                    tiles.push_back(tile);
+                    prefetched = true;
+                }
+            }
+            if (prefetched) {
+                QMutexLocker k(&_prefetchMutex);
+                if (_prefetchedHashes.size() >= NATRON_CACHE_MAX_PREFETCHED_HASHES) {
+                    _prefetchedHashes.clear();
+                }
+                _prefetchedHashes.insert(hashes[i]);
+            }
+        }
+        if ( !tiles.empty() ) {
+            _prefetchThread.appendRequest(tiles);
+        }
+    } // prefetch
+
+    /**
+     * @brief Returns the number of entries read from the disk portion of a tiled cache which were read ahead by prefetch()
+     * (hits) or not (misses), and the number of tiles read ahead.
+     **/
+    void getPrefetchStats(U64* nHits,
+                          U64* nMisses,
+                          U64* nTilesPrefetched) const
+    {
+        *nHits = _nPrefetchHits;
+        *nMisses = _nPrefetchMisses;
+        *nTilesPrefetched = _prefetchThread.getTilesPrefetchedCount();
+    }
+
     /**
      * @brief Look-up the cache for an entry whose key matches the params.
      * @param params The key identifying the entry we're looking for.
@@ -615,17 +1112,86 @@ public:
     bool get(const typename EntryType::key_type & key,
              std::list<EntryTypePtr>* returnValue) const
     {
-        ///Be atomic, so it cannot be created by another thread in the meantime
-        QMutexLocker getlocker(&_getLock);
+        Shard& shard = getShard( key.getHash() );
+
+        ++_lockStats.nLookups;
 
-        ///lock the cache before reading it.
-        QMutexLocker locker(&_lock);
+        // Referenced until the entry is looked-up again, so that it cannot be evicted once decompressed
+        EntryTypePtr decompressedEntry;
+        for (;; ) {
+            EntryTypePtr compressedEntry;
+            {
+                ///Be atomic, so it cannot be created by another thread in the meantime
+                CacheLocker getlocker(&shard.getLock, &_lockStats);
 
-        return getInternal(key, returnValue);
+                ///lock the shard before reading it.
+                CacheLocker locker(&shard.lock, &_lockStats);
+
+                if ( getInternal(shard, key, returnValue, &compressedEntry) ) {
+                    return true;
+                }
+                if (!compressedEntry) {
+                    return false;
+                }
+            }
+            decompressEntry(shard, compressedEntry);
+            decompressedEntry = compressedEntry;
+        }
     } // get
 
 private:
 
+    Shard& getShard(hash_type hash) const
+    {
+        return *_shards[hash % _shards.size()];
+    }
+
+    /**
+     * @brief Returns the indices of the shards, sorted by decreasing memory (or disk) size, so that
+     * eviction starts with the shards holding the most data.
+     **/
+    void getShardsSortedBySize(bool memory,
+                               std::vector<std::size_t>* indices) const
+    {
+        std::vector<std::pair<std::size_t, std::size_t> > sizes( _shards.size() );
+        {
+            QMutexLocker k(&_sizeLock);
+            for (std::size_t i = 0; i < _shards.size(); ++i) {
+                sizes[i].first = memory ? _shards[i]->memorySize : _shards[i]->diskSize;
+                sizes[i].second = i;
+            }
+        }
+        std::sort( sizes.begin(), sizes.end(), std::greater<std::pair<std::size_t, std::size_t> >() );
+        indices->resize( sizes.size() );
+        for (std::size_t i = 0; i < sizes.size(); ++i) {
+            (*indices)[i] = sizes[i].second;
+        }
+    }
+
+    static void addClamped(std::size_t* value,
+                           qint64 diff)
+    {
+        ///Avoid overflows, the sizes may not always fallback to 0
+        if (diff < 0) {
+            *value = (std::size_t)(-diff) > *value ? 0 : *value - (std::size_t)(-diff);
+        } else {
+            *value += (std::size_t)diff;
+        }
+    }
+
+    /**
+     * @brief Adds the given differences to the sizes of the cache and of the shard. _sizeLock must be taken.
+     **/
+    void addToSizes(Shard& shard,
+                    qint64 memoryDiff,
+                    qint64 diskDiff) const
+    {
+        addClamped(&_memoryCacheSize, memoryDiff);
+        addClamped(&shard.memorySize, memoryDiff);
+        addClamped(&_diskCacheSize, diskDiff);
+        addClamped(&shard.diskSize, diskDiff);
+    }
+
 
 
     virtual TileCacheFilePtr getTileCacheFile(const std::string& filepath, std::size_t dataOffset) OVERRIDE FINAL WARN_UNUSED_RETURN
@@ -784,12 +1350,13 @@ private:
     }
 
 
-    void createInternal(const typename EntryType::key_type & key,
+    void createInternal(Shard& shard,
+                        const typename EntryType::key_type & key,
                         const ParamsTypePtr & params,
                         ImageLockerHelper<EntryType>* entryLocker,
                         EntryTypePtr* returnValue) const
     {
-        //_lock must not be taken here
+        //shard.lock must not be taken here
 
         ///Before allocating the memory check that there's enough space to fit in memory
         appPTR->checkCacheFreeMemoryIsGoodEnough();
@@ -815,14 +1382,16 @@ private:
             maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
         }
         {
-            QMutexLocker locker(&_lock);
+            CacheLocker locker(&shard.lock, &_lockStats);
             std::list<EntryTypePtr> entriesToBeDeleted;
             double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             ///While the current cache size can't fit the new entry, erase the last recently used entries.
             ///Also if the total free RAM is under the limit of the system free RAM to keep free, erase LRU entries.
+            ///Only the shard of the entry is evicted here, the other shards are handled by the cleaner thread.
             while (occupationPercentage > NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictInMemoryEntry(deleted) ) {
+                std::size_t compressedSize = 0;
+                if ( !tryEvictInMemoryEntry(shard, deleted, &compressedSize) ) {
                     break;
                 }
 
@@ -830,9 +1399,13 @@ private:
                     entriesToBeDeleted.push_back(*it);
                     memoryCacheSize -= (*it)->size();
                 }
+                memoryCacheSize -= compressedSize;
 
                 occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             }
+            if ( (occupationPercentage > NATRON_CACHE_LIMIT_PERCENT) && (_shards.size() > 1) ) {
+                _cleanerThread.appendBudgetRequest();
+            }
 
             if ( !entriesToBeDeleted.empty() ) {
                 ///Launch a separate thread whose function will be to delete all the entries to be deleted
@@ -850,14 +1423,14 @@ private:
 
             //_memoryCacheSize member will get updated while images are being destroyed by the parallel thread.
             //we wait for cache memory occupation to be < 100% to be sure we don't hit swap here
-            while ( occupationPercentage >= 1. && _deleterThread.isWorking() ) {
+            while ( occupationPercentage >= 1. && ( _deleterThread.isWorking() || _cleanerThread.isWorking() ) ) {
                 _memoryFullCondition.wait(k.mutex());
                 occupationPercentage =  _maximumCacheSize == 0 ? 0.99 : (double)_memoryCacheSize / _maximumCacheSize;
             }
         }
         if (_isTiled) {
 
-            QMutexLocker locker(&_lock);
+            CacheLocker locker(&shard.lock, &_lockStats);
             // For tiled caches, we insert directly into the disk cache, so make sure there is room for it
             std::list<EntryTypePtr> entriesToBeDeleted;
             U64 diskCacheSize, maximumDiskCacheSize;
@@ -869,7 +1442,7 @@ private:
             double diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
             while (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
                 std::list<EntryTypePtr> deleted;
-                if ( !tryEvictDiskEntry(deleted) ) {
+                if ( !tryEvictDiskEntry(shard, deleted) ) {
                     break;
                 }
 
@@ -879,6 +1452,9 @@ private:
                 }
                 diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
             }
+            if ( (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) && (_shards.size() > 1) ) {
+                _cleanerThread.appendBudgetRequest();
+            }
             if ( !entriesToBeDeleted.empty() ) {
                 ///Launch a separate thread whose function will be to delete all the entries to be deleted
                 _deleterThread.appendToQueue(entriesToBeDeleted);
@@ -890,7 +1466,7 @@ private:
 
         }
         {
-            QMutexLocker locker(&_lock);
+            CacheLocker locker(&shard.lock, &_lockStats);
 
             try {
                 returnValue->reset( new EntryType(key, params, this ) );
@@ -909,7 +1485,7 @@ private:
                 if (entryLocker) {
                     entryLocker->lock(*returnValue);
                 }
-                sealEntry(*returnValue, _isTiled ? false : true);
+                sealEntry(shard, *returnValue, _isTiled ? false : true);
             }
         }
     } // createInternal
@@ -919,13 +1495,14 @@ public:
     void swapOrInsert(const EntryTypePtr& entryToBeEvicted,
                       const EntryTypePtr& newEntry)
     {
-        QMutexLocker locker(&_lock);
-
         const typename EntryType::key_type& key = entryToBeEvicted->getKey();
         typename EntryType::hash_type hash = entryToBeEvicted->getHashKey();
+        Shard& shard = getShard(hash);
+        CacheLocker locker(&shard.lock, &_lockStats);
+
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache(hash);
-        if ( memoryCached != _memoryCache.end() ) {
+        CacheIterator memoryCached = shard.memoryCache(hash);
+        if ( memoryCached != shard.memoryCache.end() ) {
             std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
             for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                 if ( ( (*it)->getKey() == key ) && ( (*it)->getParams() == entryToBeEvicted->getParams() ) ) {
@@ -937,19 +1514,20 @@ public:
             ret.push_back(newEntry);
         } else {
             ///Look in disk cache
-            CacheIterator diskCached = _diskCache(hash);
-            if ( diskCached != _diskCache.end() ) {
+            CacheIterator diskCached = shard.diskCache(hash);
+            if ( diskCached != shard.diskCache.end() ) {
                 ///Remove the old entry
                 std::list<EntryTypePtr> & ret = getValueFromIterator(diskCached);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     if ( ( (*it)->getKey() == key ) && ( (*it)->getParams() == entryToBeEvicted->getParams() ) ) {
+                        journalRemoveEntry(*it);
                         ret.erase(it);
                         break;
                     }
                 }
             }
             ///Insert in mem cache
-            _memoryCache.insert(hash, newEntry);
+            shard.memoryCache.insert(hash, newEntry);
         }
     }
 
@@ -988,29 +1566,42 @@ public:
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
 
-        {
-            ///Be atomic, so it cannot be created by another thread in the meantime
-            QMutexLocker getlocker(&_getLock);
-            std::list<EntryTypePtr> entries;
-            bool didGetSucceed;
+        Shard& shard = getShard( key.getHash() );
+
+        ++_lockStats.nLookups;
+
+        // Referenced until the entry is looked-up again, so that it cannot be evicted once decompressed
+        EntryTypePtr decompressedEntry;
+        for (;; ) {
+            EntryTypePtr compressedEntry;
             {
-                QMutexLocker locker(&_lock);
-                didGetSucceed = getInternal(key, &entries);
-            }
-            if (didGetSucceed) {
-                for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
-                    if (*(*it)->getParams() == *params) {
-                        *returnValue = *it;
+                ///Be atomic, so it cannot be created by another thread in the meantime
+                CacheLocker getlocker(&shard.getLock, &_lockStats);
+                std::list<EntryTypePtr> entries;
+                bool didGetSucceed;
+                {
+                    CacheLocker shardLocker(&shard.lock, &_lockStats);
+                    didGetSucceed = getInternal(shard, key, &entries, &compressedEntry);
+                }
+                if (didGetSucceed) {
+                    for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                        if (*(*it)->getParams() == *params) {
+                            *returnValue = *it;
 
-                        return true;
+                            return true;
+                        }
                     }
                 }
-            }
 
-            createInternal(key, params, locker, returnValue);
+                if (!compressedEntry) {
+                    createInternal(shard, key, params, locker, returnValue);
 
-            return false;
-        } // getlocker
+                    return false;
+                }
+            } // getlocker
+            decompressEntry(shard, compressedEntry);
+            decompressedEntry = compressedEntry;
+        }
     }
 
     /**
@@ -1018,6 +1609,12 @@ public:
      **/
     void clear()
     {
+        // The read-ahead holds references to the tile files, which would prevent their removal
+        _prefetchThread.quitThread();
+        {
+            QMutexLocker k(&_prefetchMutex);
+            _prefetchedHashes.clear();
+        }
         {
             QMutexLocker k(&_tileCacheMutex);
             _clearingCache = true;
@@ -1029,13 +1626,17 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            if ( !_isTiled && evictedFromMemory.second->isStoredOnDisk() ) {
-                evictedFromMemory.second->removeAnyBackingFile();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            Shard& shard = *_shards[i];
+            CacheLocker locker(&shard.lock, &_lockStats);
+            std::pair<hash_type, EntryTypePtr> evictedFromMemory = shard.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                if ( !_isTiled && evictedFromMemory.second->isStoredOnDisk() ) {
+                    evictedFromMemory.second->removeAnyBackingFile();
+                }
+                evictedFromMemory = shard.memoryCache.evict();
             }
-            evictedFromMemory = _memoryCache.evict();
+            clearCompressedPortion(shard);
         }
 
         if (_signalEmitter) {
@@ -1059,19 +1660,23 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-
-        /// An entry which has a use_count greater than 1 is not removable:
-        /// The backing file must not be removed because it might be read/written to
-        /// at the same time. The best we can do is just let it here in the cache.
-        std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
-        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-        //we'll let the user of these entries purge the extra entries left in the cache later on
-        while (evictedFromDisk.second) {
-            if (!_isTiled) {
-                evictedFromDisk.second->removeAnyBackingFile();
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            Shard& shard = *_shards[i];
+            CacheLocker locker(&shard.lock, &_lockStats);
+
+            /// An entry which has a use_count greater than 1 is not removable:
+            /// The backing file must not be removed because it might be read/written to
+            /// at the same time. The best we can do is just let it here in the cache.
+            std::pair<hash_type, EntryTypePtr> evictedFromDisk = shard.diskCache.evict();
+            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+            //we'll let the user of these entries purge the extra entries left in the cache later on
+            while (evictedFromDisk.second) {
+                journalRemoveEntry(evictedFromDisk.second);
+                if (!_isTiled) {
+                    evictedFromDisk.second->removeAnyBackingFile();
+                }
+                evictedFromDisk = shard.diskCache.evict();
             }
-            evictedFromDisk = _diskCache.evict();
         }
 
 
@@ -1088,51 +1693,59 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            // Move back the entry on disk if it can be store on disk
-            // For tiled caches, the tile is sharing the same file with other entries
-            // so we cannot close it, just remove the entry
-            if ( evictedFromMemory.second->isStoredOnDisk() && !_isTiled) {
-                evictedFromMemory.second->deallocate();
-                /*insert it back into the disk portion */
-
-                U64 diskCacheSize, maximumCacheSize;
-                {
-                    QMutexLocker k(&_sizeLock);
-                    diskCacheSize = _diskCacheSize;
-                    maximumCacheSize = _maximumCacheSize;
-                }
-
-                /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
-                while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
-                    {
-                        std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
-                        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-                        //we'll let the user of these entries purge the extra entries left in the cache later on
-                        if (!evictedFromDisk.second) {
-                            break;
-                        }
-                        ///Erase the file from the disk if we reach the limit.
-                        evictedFromDisk.second->removeAnyBackingFile();
-                    }
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            Shard& shard = *_shards[i];
+            CacheLocker locker(&shard.lock, &_lockStats);
+            std::pair<hash_type, EntryTypePtr> evictedFromMemory = shard.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                // Move back the entry on disk if it can be store on disk
+                // For tiled caches, the tile is sharing the same file with other entries
+                // so we cannot close it, just remove the entry
+                if ( evictedFromMemory.second->isStoredOnDisk() && !_isTiled) {
+                    evictedFromMemory.second->deallocate();
+                    /*insert it back into the disk portion */
+
+                    U64 diskCacheSize, maximumCacheSize;
                     {
                         QMutexLocker k(&_sizeLock);
                         diskCacheSize = _diskCacheSize;
                         maximumCacheSize = _maximumCacheSize;
                     }
-                }
 
-                /*update the disk cache size*/
-                CacheIterator existingDiskCacheEntry = _diskCache( evictedFromMemory.second->getHashKey() );
-                /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-                if ( existingDiskCacheEntry == _diskCache.end() ) {
-                    _diskCache.insert(evictedFromMemory.second->getHashKey(), evictedFromMemory.second);
+                    /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
+                    while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
+                        {
+                            std::pair<hash_type, EntryTypePtr> evictedFromDisk = shard.diskCache.evict();
+                            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+                            //we'll let the user of these entries purge the extra entries left in the cache later on
+                            if (!evictedFromDisk.second) {
+                                break;
+                            }
+                            journalRemoveEntry(evictedFromDisk.second);
+                            ///Erase the file from the disk if we reach the limit.
+                            evictedFromDisk.second->removeAnyBackingFile();
+                        }
+                        {
+                            QMutexLocker k(&_sizeLock);
+                            diskCacheSize = _diskCacheSize;
+                            maximumCacheSize = _maximumCacheSize;
+                        }
+                    }
+
+                    /*update the disk cache size*/
+                    CacheIterator existingDiskCacheEntry = shard.diskCache( evictedFromMemory.second->getHashKey() );
+                    /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
+                    if ( existingDiskCacheEntry == shard.diskCache.end() ) {
+                        shard.diskCache.insert(evictedFromMemory.second->getHashKey(), evictedFromMemory.second);
+                        journalAddEntry(evictedFromMemory.second);
+                    }
                 }
+
+                evictedFromMemory = shard.memoryCache.evict();
             }
 
-            evictedFromMemory = _memoryCache.evict();
+            // The compressed portion is in RAM too
+            clearCompressedPortion(shard);
         }
 
         _signalEmitter->blockSignals(false);
@@ -1141,59 +1754,119 @@ public:
         }
     } // clearInMemoryPortion
 
-    void clearExceedingEntries()
+    /**
+     * @brief Removes the entries of the compressed portion of the shard which are only referenced by the cache.
+     * The entries with other references (use_count() > 1) are kept, which includes the entries still queued to the
+     * compressor since the queue holds a reference to them.
+     **/
+    void clearCompressedPortion(Shard& shard)
+    {
+        assert( !shard.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evictedFromCompressed = shard.compressedCache.evict();
+        while (evictedFromCompressed.second) {
+            evictedFromCompressed = shard.compressedCache.evict();
+        }
+    }
+
+    /**
+     * @brief Evicts LRU entries until the cache fits again in its maximum size.
+     * The shards holding the most data are evicted first.
+     **/
+    virtual void clearExceedingEntries() OVERRIDE FINAL
     {
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
         std::list<EntryTypePtr> entriesToBeDeleted;
 
+        U64 memoryCacheSize, maximumInMemorySize;
         {
-            QMutexLocker locker(&_lock);
-            U64 memoryCacheSize, maximumInMemorySize;
-            {
-                QMutexLocker k(&_sizeLock);
-                memoryCacheSize = _memoryCacheSize;
-                maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
+            QMutexLocker k(&_sizeLock);
+            memoryCacheSize = _memoryCacheSize;
+            maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
+        }
+        double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
+        if ( (maximumInMemorySize > 1) && (RamBufferPool::instance()->getFreeBytes() > 0) ) {
+            // The free blocks of the buffer pool count in the RAM budget: they are given back to the system
+            // before evicting any entry
+            RamBufferPool* pool = RamBufferPool::instance();
+            U64 limit = (U64)(NATRON_CACHE_LIMIT_PERCENT * maximumInMemorySize);
+            if (memoryCacheSize + pool->getFreeBytes() >= limit) {
+                pool->trim(memoryCacheSize < limit ? limit - memoryCacheSize : 0);
             }
-            double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
-            while (occupationPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
-                std::list<EntryTypePtr> deleted;
-                if ( !tryEvictInMemoryEntry(deleted) ) {
-                    break;
-                }
+        }
+        if (occupationPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
+            std::vector<std::size_t> shardsOrder;
+            getShardsSortedBySize(true, &shardsOrder);
+            for (std::size_t i = 0; i < shardsOrder.size() && occupationPercentage >= NATRON_CACHE_LIMIT_PERCENT; ++i) {
+                Shard& shard = *_shards[shardsOrder[i]];
+                CacheLocker locker(&shard.lock, &_lockStats);
+                while (occupationPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
+                    std::list<EntryTypePtr> deleted;
+                    std::size_t compressedSize = 0;
+                    if ( !tryEvictInMemoryEntry(shard, deleted, &compressedSize) ) {
+                        break;
+                    }
 
-                for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    if ( !(*it)->isStoredOnDisk() ) {
-                        memoryCacheSize -= (*it)->size();
+                    for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
+                        if ( !(*it)->isStoredOnDisk() ) {
+                            memoryCacheSize -= (*it)->size();
+                        }
+                        entriesToBeDeleted.push_back(*it);
                     }
-                    entriesToBeDeleted.push_back(*it);
+                    memoryCacheSize -= compressedSize;
+                    occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
                 }
-                occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             }
+        }
 
-            U64 diskCacheSize, maximumDiskCacheSize;
-            {
-                QMutexLocker k(&_sizeLock);
-                diskCacheSize = _diskCacheSize;
-                maximumDiskCacheSize = std::max( (std::size_t)1, _maximumCacheSize - _maximumInMemorySize );
-            }
-            double diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
-            while (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
-                std::list<EntryTypePtr> deleted;
-                if ( !tryEvictDiskEntry(deleted) ) {
+        // The compressed portion may exceed its maximum size when it was reduced
+        U64 compressedCacheSize, maximumCompressedSize;
+        {
+            QMutexLocker k(&_sizeLock);
+            compressedCacheSize = _compressedCacheSize;
+            maximumCompressedSize = _maximumCompressedSize;
+        }
+        for (std::size_t i = 0; i < _shards.size() && compressedCacheSize > maximumCompressedSize; ++i) {
+            Shard& shard = *_shards[i];
+            CacheLocker locker(&shard.lock, &_lockStats);
+            while (compressedCacheSize > maximumCompressedSize) {
+                std::pair<hash_type, EntryTypePtr> evicted = shard.compressedCache.evict();
+                if (!evicted.second) {
                     break;
                 }
+                compressedCacheSize -= std::min( (std::size_t)compressedCacheSize, evicted.second->getCompressedPortionSize() );
+                entriesToBeDeleted.push_back(evicted.second);
+            }
+        }
 
-                for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    diskCacheSize -= (*it)->size();
-                    entriesToBeDeleted.push_back(*it);
+        U64 diskCacheSize, maximumDiskCacheSize;
+        {
+            QMutexLocker k(&_sizeLock);
+            diskCacheSize = _diskCacheSize;
+            maximumDiskCacheSize = std::max( (std::size_t)1, _maximumCacheSize - _maximumInMemorySize );
+        }
+        double diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
+        if (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
+            std::vector<std::size_t> shardsOrder;
+            getShardsSortedBySize(false, &shardsOrder);
+            for (std::size_t i = 0; i < shardsOrder.size() && diskPercentage >= NATRON_CACHE_LIMIT_PERCENT; ++i) {
+                Shard& shard = *_shards[shardsOrder[i]];
+                CacheLocker locker(&shard.lock, &_lockStats);
+                while (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
+                    std::list<EntryTypePtr> deleted;
+                    if ( !tryEvictDiskEntry(shard, deleted) ) {
+                        break;
+                    }
+
+                    for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
+                        diskCacheSize -= (*it)->size();
+                        entriesToBeDeleted.push_back(*it);
+                    }
+                    diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
                 }
-                diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
             }
-            
-
         }
-    }
+    } // clearExceedingEntries
 
     /**
      * @brief Get a copy of the cache at the moment it gets the lock for reading.
@@ -1202,20 +1875,23 @@ public:
      **/
     void getCopy(std::list<EntryTypePtr>* copy) const
     {
-        QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            Shard& shard = *_shards[i];
+            CacheLocker locker(&shard.lock, &_lockStats);
 
-        for (CacheIterator it = _memoryCache.begin(); it != _memoryCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert( copy->end(), entries.begin(), entries.end() );
-        }
-        for (CacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert( copy->end(), entries.begin(), entries.end() );
+            for (CacheIterator it = shard.memoryCache.begin(); it != shard.memoryCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert( copy->end(), entries.begin(), entries.end() );
+            }
+            for (CacheIterator it = shard.diskCache.begin(); it != shard.diskCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert( copy->end(), entries.begin(), entries.end() );
+            }
         }
     }
 
     /**
-     * @brief Removes the last recently used entry from the in-memory cache.
+     * @brief Removes the last recently used entry from the in-memory cache of the shard holding the most memory.
      * This is expensive since it takes the lock. Returns false
      * if there's nothing left to evict.
      **/
@@ -1224,33 +1900,46 @@ public:
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
         std::list<EntryTypePtr> entriesToBeDeleted;
-        bool ret;
-        {
-            QMutexLocker locker(&_lock);
-            ret = tryEvictInMemoryEntry(entriesToBeDeleted);
+        std::vector<std::size_t> shardsOrder;
+        getShardsSortedBySize(true, &shardsOrder);
+        for (std::size_t i = 0; i < shardsOrder.size(); ++i) {
+            Shard& shard = *_shards[shardsOrder[i]];
+            CacheLocker locker(&shard.lock, &_lockStats);
+            if ( tryEvictInMemoryEntry(shard, entriesToBeDeleted) ) {
+                return true;
+            }
         }
 
-        return ret;
+        return false;
     }
 
     /**
-     * @brief Removes the last recently used entry from the disk cache.
+     * @brief Removes the last recently used entry from the disk cache of the shard holding the most data on disk.
      * This is expensive since it takes the lock. Returns false
      * if there's nothing left to evict.
      **/
     bool evictLRUDiskEntry() const
     {
+        std::vector<std::size_t> shardsOrder;
+        getShardsSortedBySize(false, &shardsOrder);
+        for (std::size_t i = 0; i < shardsOrder.size(); ++i) {
+            Shard& shard = *_shards[shardsOrder[i]];
+            CacheLocker locker(&shard.lock, &_lockStats);
+            std::list<EntryTypePtr> entriesToBeDeleted;
+            if ( tryEvictDiskEntry(shard, entriesToBeDeleted) ) {
+                return true;
+            }
+        }
 
-        QMutexLocker locker(&_lock);
-        std::list<EntryTypePtr> entriesToBeDeleted;
-        return tryEvictDiskEntry(entriesToBeDeleted);
+        return false;
     }
 
     /**
      * @brief To be called by a CacheEntry whenever it's size changes.
      * This way the cache can keep track of the real memory footprint.
      **/
-    virtual void notifyEntrySizeChanged(std::size_t oldSize,
+    virtual void notifyEntrySizeChanged(U64 hash,
+                                        std::size_t oldSize,
                                         std::size_t newSize) const OVERRIDE FINAL
     {
         ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache
@@ -1258,15 +1947,7 @@ public:
 
         ///This function can only be called for RAM buffers or while a memory mapped file is mapped into the RAM, so
         ///we just have to modify the RAM size.
-
-        ///Avoid overflows, _memoryCacheSize may not always fallback to 0
-        qint64 diff = (qint64)newSize - (qint64)oldSize;
-
-        if (diff < 0) {
-            _memoryCacheSize = diff > (qint64)_memoryCacheSize ? 0 : _memoryCacheSize + diff;
-        } else {
-            _memoryCacheSize += diff;
-        }
+        addToSizes(getShard(hash), (qint64)newSize - (qint64)oldSize, 0);
 #ifdef NATRON_DEBUG_CACHE
         qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
 #endif
@@ -1275,24 +1956,26 @@ public:
     /**
      * @brief To be called by a CacheEntry on allocation.
      **/
-    virtual void notifyEntryAllocated(double time,
+    virtual void notifyEntryAllocated(U64 hash,
+                                      double time,
                                       std::size_t size,
                                       StorageModeEnum storage) const OVERRIDE FINAL
     {
         ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache, hence the
         ///lock should already be taken.
         QMutexLocker k(&_sizeLock);
+        Shard& shard = getShard(hash);
 
         if (storage == eStorageModeDisk) {
             if (_isTiled) {
                 // For tile caches, we do not control which portion of the cache is in memory, so just keep track of the disk portion
-                _diskCacheSize += size;
+                addToSizes(shard, 0, size);
             } else {
-                _memoryCacheSize += size;
+                addToSizes(shard, size, 0);
                 appPTR->increaseNCacheFilesOpened();
             }
         } else {
-            _memoryCacheSize += size;
+            addToSizes(shard, size, 0);
         }
 
         _signalEmitter->emitAddedEntry(time);
@@ -1306,19 +1989,20 @@ public:
     /**
      * @brief To be called by a CacheEntry on destruction.
      **/
-    virtual void notifyEntryDestroyed(double time,
+    virtual void notifyEntryDestroyed(U64 hash,
+                                      double time,
                                       std::size_t size,
                                       StorageModeEnum storage) const OVERRIDE FINAL
     {
         QMutexLocker k(&_sizeLock);
 
         if (storage == eStorageModeRAM) {
-            _memoryCacheSize = size > _memoryCacheSize ? 0 : _memoryCacheSize - size;
+            addToSizes(getShard(hash), -(qint64)size, 0);
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
 #endif
         } else if (storage == eStorageModeDisk) {
-            _diskCacheSize = size > _diskCacheSize ? 0 : _diskCacheSize - size;
+            addToSizes(getShard(hash), 0, -(qint64)size);
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
 #endif
@@ -1339,7 +2023,8 @@ public:
      * @brief To be called whenever an entry is deallocated from memory and put back on disk or whenever
      * it is reallocated in the RAM.
      **/
-    virtual void notifyEntryStorageChanged(StorageModeEnum oldStorage,
+    virtual void notifyEntryStorageChanged(U64 hash,
+                                           StorageModeEnum oldStorage,
                                            StorageModeEnum newStorage,
                                            double time,
                                            std::size_t size) const OVERRIDE FINAL
@@ -1350,12 +2035,12 @@ public:
             return;
         }
         QMutexLocker k(&_sizeLock);
+        Shard& shard = getShard(hash);
 
         assert(oldStorage != newStorage);
         assert(newStorage != eStorageModeNone);
         if (oldStorage == eStorageModeRAM) {
-            _memoryCacheSize = size > _memoryCacheSize ? 0 : _memoryCacheSize - size;
-            _diskCacheSize += size;
+            addToSizes(shard, -(qint64)size, size);
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
             qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
@@ -1363,8 +2048,7 @@ public:
             ///We switched from RAM to DISK that means the MemoryFile object has been destroyed hence the file has been closed.
             appPTR->decreaseNCacheFilesOpened();
         } else if (oldStorage == eStorageModeDisk) {
-            _memoryCacheSize += size;
-            _diskCacheSize = size > _diskCacheSize ? 0 : _diskCacheSize - size;
+            addToSizes(shard, size, -(qint64)size);
 #ifdef NATRON_DEBUG_CACHE
             qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
             qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
@@ -1373,15 +2057,33 @@ public:
             appPTR->increaseNCacheFilesOpened();
         } else {
             if (newStorage == eStorageModeRAM) {
-                _memoryCacheSize += size;
+                addToSizes(shard, size, 0);
             } else if (newStorage == eStorageModeDisk) {
-                _diskCacheSize += size;
+                addToSizes(shard, 0, size);
             }
         }
 
         _signalEmitter->emitEntryStorageChanged(time, (int)oldStorage, (int)newStorage);
     }
 
+    /**
+     * @brief To be called whenever an entry enters or leaves the compressed portion of the cache, or whenever
+     * its data is compressed.
+     **/
+    virtual void notifyEntryCompressionChanged(U64 hash,
+                                               qint64 memoryDiff,
+                                               qint64 compressedDiff) const OVERRIDE FINAL
+    {
+        QMutexLocker k(&_sizeLock);
+
+        addToSizes(getShard(hash), memoryDiff, 0);
+        addClamped(&_compressedCacheSize, compressedDiff);
+#ifdef NATRON_DEBUG_CACHE
+        qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
+        qDebug() << cacheName().c_str() << " compressed size: " << printAsRAM(_compressedCacheSize);
+#endif
+    }
+
     virtual void backingFileClosed() const OVERRIDE FINAL
     {
         assert(!_isTiled);
@@ -1414,12 +2116,12 @@ public:
         return cacheFolderName;
     }
 
-    std::string getRestoreFilePath() const
+    std::string getJournalFilePath() const
     {
         QString newCachePath( getCachePath() );
         StrUtils::ensureLastPathSeparator(newCachePath);
 
-        newCachePath.append( QString::fromUtf8("restoreFile." NATRON_CACHE_FILE_EXT) );
+        newCachePath.append( QString::fromUtf8("journal." NATRON_CACHE_FILE_EXT) );
 
         return newCachePath.toStdString();
     }
@@ -1438,6 +2140,17 @@ public:
         _maximumInMemorySize = _maximumCacheSize * percentage;
     }
 
+    /**
+     * @brief Sets the maximum size of the compressed portion, in which the entries evicted from the memory portion
+     * are kept compressed, as a percentage of the maximum cache size. 0 disables it.
+     **/
+    void setMaximumCompressedSize(double percentage)
+    {
+        QMutexLocker k(&_sizeLock);
+
+        _maximumCompressedSize = _maximumCacheSize * percentage;
+    }
+
     std::size_t getMaximumSize() const
     {
         QMutexLocker k(&_sizeLock);
@@ -1459,6 +2172,13 @@ public:
         return _memoryCacheSize;
     }
 
+    std::size_t getCompressedCacheSize() const
+    {
+        QMutexLocker k(&_sizeLock);
+
+        return _compressedCacheSize;
+    }
+
     std::size_t getDiskCacheSize() const
     {
         QMutexLocker k(&_sizeLock);
@@ -1466,6 +2186,19 @@ public:
         return _diskCacheSize;
     }
 
+    /**
+     * @brief Returns the size of the memory portion of each shard, their sum is getMemoryCacheSize().
+     **/
+    void getShardsMemorySize(std::vector<std::size_t>* sizes) const
+    {
+        QMutexLocker k(&_sizeLock);
+
+        sizes->resize( _shards.size() );
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            (*sizes)[i] = _shards[i]->memorySize;
+        }
+    }
+
     CacheSignalEmitterPtr activateSignalEmitter() const
     {
         return _signalEmitter;
@@ -1483,9 +2216,22 @@ public:
         std::list<EntryTypePtr> toRemove;
 
         {
-            QMutexLocker l(&_lock);
-            CacheIterator existingEntry = _memoryCache( entry->getHashKey() );
-            if ( existingEntry != _memoryCache.end() ) {
+            Shard& shard = getShard( entry->getHashKey() );
+            CacheLocker l(&shard.lock, &_lockStats);
+            CacheIterator existingEntry = shard.memoryCache( entry->getHashKey() );
+            if ( existingEntry != shard.memoryCache.end() ) {
+                std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
+                for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                    if ( (*it)->getKey() == entry->getKey() ) {
+                        toRemove.push_back(*it);
+                        ret.erase(it);
+                        break;
+                    }
+                }
+                if ( ret.empty() ) {
+                    shard.memoryCache.erase(existingEntry);
+                }
+            } else if ( ( existingEntry = shard.compressedCache( entry->getHashKey() ) ) != shard.compressedCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     if ( (*it)->getKey() == entry->getKey() ) {
@@ -1495,25 +2241,26 @@ public:
                     }
                 }
                 if ( ret.empty() ) {
-                    _memoryCache.erase(existingEntry);
+                    shard.compressedCache.erase(existingEntry);
                 }
             } else {
-                existingEntry = _diskCache( entry->getHashKey() );
-                if ( existingEntry != _diskCache.end() ) {
+                existingEntry = shard.diskCache( entry->getHashKey() );
+                if ( existingEntry != shard.diskCache.end() ) {
                     std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                     for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                         if ( (*it)->getKey() == entry->getKey() ) {
+                            journalRemoveEntry(*it);
                             toRemove.push_back(*it);
                             ret.erase(it);
                             break;
                         }
                     }
                     if ( ret.empty() ) {
-                        _diskCache.erase(existingEntry);
+                        shard.diskCache.erase(existingEntry);
                     }
                 }
             }
-        } // QMutexLocker l(&_lock);
+        } // CacheLocker l(&shard.lock);
         if ( !toRemove.empty() ) {
             _deleterThread.appendToQueue(toRemove);
 
@@ -1527,25 +2274,31 @@ public:
     {
         std::list<EntryTypePtr> toRemove;
         {
-            QMutexLocker l(&_lock);
-            CacheIterator existingEntry = _memoryCache( hash);
-            if ( existingEntry != _memoryCache.end() ) {
+            Shard& shard = getShard(hash);
+            CacheLocker l(&shard.lock, &_lockStats);
+            CacheIterator existingEntry = shard.memoryCache(hash);
+            if ( existingEntry != shard.memoryCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     toRemove.push_back(*it);
                 }
-                _memoryCache.erase(existingEntry);
+                shard.memoryCache.erase(existingEntry);
+            } else if ( ( existingEntry = shard.compressedCache(hash) ) != shard.compressedCache.end() ) {
+                std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
+                toRemove.insert( toRemove.end(), ret.begin(), ret.end() );
+                shard.compressedCache.erase(existingEntry);
             } else {
-                existingEntry = _diskCache( hash );
-                if ( existingEntry != _diskCache.end() ) {
+                existingEntry = shard.diskCache(hash);
+                if ( existingEntry != shard.diskCache.end() ) {
                     std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                     for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                        journalRemoveEntry(*it);
                         toRemove.push_back(*it);
                     }
-                    _diskCache.erase(existingEntry);
+                    shard.diskCache.erase(existingEntry);
                 }
             }
-        } // QMutexLocker l(&_lock);
+        } // CacheLocker l(&shard.lock);
 
         if ( !toRemove.empty() ) {
             _deleterThread.appendToQueue(toRemove);
@@ -1556,62 +2309,109 @@ public:
         }
     }
 
-    /*Saves cache to disk as a settings file.
-     */
-    void save(CacheTOC* tableOfContents);
+    /**
+     * @brief Moves the in-memory portion to the disk portion, flushes the backing files of the entries added to
+     * the disk portion since the last call and commits them to the journal. This is cheap: only the entries
+     * which changed since the last call are written.
+     **/
+    void syncJournal();
 
+    /**
+     * @brief Restores the disk portion from the records of the journal, which must have been opened,
+     * and attaches the journal to the cache.
+     **/
+    void restore(const CacheJournalPtr& journal);
 
-    /*Restores the cache from disk.*/
-    void restore(const CacheTOC & tableOfContents);
+    /**
+     * @brief Attaches the journal to the cache: entries entering and leaving the disk portion are recorded in it
+     * from now on. Passing NULL detaches and closes the current journal.
+     **/
+    void setJournal(const CacheJournalPtr& journal)
+    {
+        CacheJournalPtr oldJournal;
+        {
+            QMutexLocker k(&_journalMutex);
+            oldJournal = _journal;
+            _journal = journal;
+            _journalPendingEntries.clear();
+        }
+        if (oldJournal) {
+            oldJournal->close();
+        }
+    }
 
 
-    void removeAllEntriesWithDifferentNodeHashForHolderPublic(const CacheEntryHolder* holder,
-                                                              U64 nodeHash)
+    /**
+     * @brief Removes all entries of the holders in nodeHashesToKeep whose node hash is not listed for their holder.
+     * All holders are handled in a single pass over the cache, done asynchronously by the cleaner thread.
+     **/
+    void removeAllEntriesWithDifferentNodeHashForHoldersPublic(const CacheHoldersNodeHashes & nodeHashesToKeep)
     {
-        _cleanerThread.appendToQueue(holder->getCacheID(), nodeHash, false);
+        _cleanerThread.appendToQueue(nodeHashesToKeep);
     }
 
     void removeAllEntriesForHolderPublic(const CacheEntryHolder* holder,
                                          bool blocking)
     {
+        CacheHoldersNodeHashes toRemove;
+
+        toRemove[holder->getCacheID()];
         if (blocking) {
-            removeAllEntriesWithDifferentNodeHashForHolderPrivate(holder->getCacheID(), 0, true);
+            removeAllEntriesWithDifferentNodeHashForHoldersPrivate(toRemove);
         } else {
-            _cleanerThread.appendToQueue(holder->getCacheID(), 0, true);
+            _cleanerThread.appendToQueue(toRemove);
         }
     }
 
     void getMemoryStatsForCacheEntryHolder(const CacheEntryHolder* holder,
                                            std::size_t* ramOccupied,
+                                           std::size_t* compressedOccupied,
                                            std::size_t* diskOccupied) const
     {
         *ramOccupied = 0;
+        *compressedOccupied = 0;
         *diskOccupied = 0;
 
         std::string holderID = holder->getCacheID();
-        QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            Shard& shard = *_shards[i];
+            CacheLocker locker(&shard.lock, &_lockStats);
 
-        for (ConstCacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
-            if ( !entries.empty() ) {
-                const EntryTypePtr & front = entries.front();
+            for (ConstCacheIterator memIt = shard.memoryCache.begin(); memIt != shard.memoryCache.end(); ++memIt) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
 
-                if (front->getKey().getCacheHolderID() == holderID) {
-                    for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
-                        *ramOccupied += (*it)->size();
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *ramOccupied += (*it)->size();
+                        }
+                    }
+                }
+            }
+
+            for (ConstCacheIterator memIt = shard.compressedCache.begin(); memIt != shard.compressedCache.end(); ++memIt) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
+
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *compressedOccupied += (*it)->getCompressedPortionSize();
+                        }
                     }
                 }
             }
-        }
 
-        for (ConstCacheIterator memIt = _diskCache.begin(); memIt != _diskCache.end(); ++memIt) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
-            if ( !entries.empty() ) {
-                const EntryTypePtr & front = entries.front();
+            for (ConstCacheIterator memIt = shard.diskCache.begin(); memIt != shard.diskCache.end(); ++memIt) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
 
-                if (front->getKey().getCacheHolderID() == holderID) {
-                    for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
-                        *diskOccupied += (*it)->size();
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *diskOccupied += (*it)->size();
+                        }
                     }
                 }
             }
@@ -1620,22 +2420,20 @@ public:
 
 private:
 
-    virtual void removeAllEntriesWithDifferentNodeHashForHolderPrivate(const std::string & holderID,
-                                                                       U64 nodeHash,
-                                                                       bool removeAll) OVERRIDE FINAL
+    virtual void removeAllEntriesWithDifferentNodeHashForHoldersPrivate(const CacheHoldersNodeHashes & nodeHashesToKeep) OVERRIDE FINAL
     {
         std::list<EntryTypePtr> toDelete;
-        CacheContainer newMemCache, newDiskCache;
-        {
-            QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            Shard& shard = *_shards[i];
+            CacheContainer newMemCache, newCompressedCache, newDiskCache;
+            CacheLocker locker(&shard.lock, &_lockStats);
 
-            for (ConstCacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
+            for (ConstCacheIterator memIt = shard.memoryCache.begin(); memIt != shard.memoryCache.end(); ++memIt) {
                 const std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
                 if ( !entries.empty() ) {
                     const EntryTypePtr & front = entries.front();
 
-                    if ( (front->getKey().getCacheHolderID() == holderID) &&
-                         ( ( front->getKey().getTreeVersion() != nodeHash) || removeAll ) ) {
+                    if ( mustRemoveEntry(front, nodeHashesToKeep) ) {
                         for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
                             toDelete.push_back(*it);
                         }
@@ -1646,14 +2444,27 @@ private:
                 }
             }
 
-            for (ConstCacheIterator dIt = _diskCache.begin(); dIt != _diskCache.end(); ++dIt) {
+            for (ConstCacheIterator cIt = shard.compressedCache.begin(); cIt != shard.compressedCache.end(); ++cIt) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(cIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
+
+                    if ( mustRemoveEntry(front, nodeHashesToKeep) ) {
+                        toDelete.insert( toDelete.end(), entries.begin(), entries.end() );
+                    } else {
+                        newCompressedCache.insert(front->getHashKey(), entries);
+                    }
+                }
+            }
+
+            for (ConstCacheIterator dIt = shard.diskCache.begin(); dIt != shard.diskCache.end(); ++dIt) {
                 const std::list<EntryTypePtr> & entries = getValueFromIterator(dIt);
                 if ( !entries.empty() ) {
                     const EntryTypePtr & front = entries.front();
 
-                    if ( (front->getKey().getCacheHolderID() == holderID) &&
-                         ( ( front->getKey().getTreeVersion() != nodeHash) || removeAll ) ) {
+                    if ( mustRemoveEntry(front, nodeHashesToKeep) ) {
                         for (typename std::list<EntryTypePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+                            journalRemoveEntry(*it);
                             toDelete.push_back(*it);
                         }
                     } else {
@@ -1663,9 +2474,10 @@ private:
                 }
             }
 
-            _memoryCache = newMemCache;
-            _diskCache = newDiskCache;
-        } // QMutexLocker locker(&_lock);
+            shard.memoryCache = newMemCache;
+            shard.compressedCache = newCompressedCache;
+            shard.diskCache = newDiskCache;
+        } // for all shards
 
         if ( !toDelete.empty() ) {
             _deleterThread.appendToQueue(toDelete);
@@ -1674,18 +2486,37 @@ private:
             ///that the separate thread will delete
             toDelete.clear();
         }
-    } // removeAllEntriesWithDifferentNodeHashForHolderPrivate
+    } // removeAllEntriesWithDifferentNodeHashForHoldersPrivate
+
+    static bool mustRemoveEntry(const EntryTypePtr & entry,
+                                const CacheHoldersNodeHashes & nodeHashesToKeep)
+    {
+        CacheHoldersNodeHashes::const_iterator found = nodeHashesToKeep.find( entry->getKey().getCacheHolderID() );
+
+        if ( found == nodeHashesToKeep.end() ) {
+            return false;
+        }
+
+        return std::find( found->second.begin(), found->second.end(), entry->getKey().getTreeVersion() ) == found->second.end();
+    }
 
-    bool getInternal(const typename EntryType::key_type & key,
-                     std::list<EntryTypePtr>* returnValue) const
+    /**
+     * @brief Looks-up the entries matching the key in the shard. If the matching entry is in the compressed portion,
+     * false is returned and it is set in compressedEntry: it must be passed to decompressEntry() once the shard is
+     * unlocked and then looked-up again.
+     **/
+    bool getInternal(Shard& shard,
+                     const typename EntryType::key_type & key,
+                     std::list<EntryTypePtr>* returnValue,
+                     EntryTypePtr* compressedEntry) const
     {
         ///Private should be locked
-        assert( !_lock.tryLock() );
+        assert( !shard.lock.tryLock() );
 
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache( key.getHash() );
+        CacheIterator memoryCached = shard.memoryCache( key.getHash() );
 
-        if ( memoryCached != _memoryCache.end() ) {
+        if ( memoryCached != shard.memoryCache.end() ) {
             ///we found something with a matching hash key. There may be several entries linked to
             ///this key, we need to find one with matching params
             std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
@@ -1702,11 +2533,13 @@ private:
             }
 
             return returnValue->size() > 0;
+        } else if ( ( *compressedEntry = findInCompressedPortion(shard, key) ) ) {
+            return false;
         } else {
             ///fallback on the disk cache internal container
-            CacheIterator diskCached = _diskCache( key.getHash() );
+            CacheIterator diskCached = shard.diskCache( key.getHash() );
 
-            if ( diskCached == _diskCache.end() ) {
+            if ( diskCached == shard.diskCache.end() ) {
                 /*the entry was neither in memory or disk, just allocate a new one*/
                 return false;
             } else {
@@ -1727,18 +2560,20 @@ private:
                                 (*it)->reOpenFileMapping();
                             } catch (const std::exception & e) {
                                 qDebug() << "Error while reopening cache file: " << e.what();
+                                journalRemoveEntry(*it);
                                 ret.erase(it);
 
                                 return false;
                             } catch (...) {
                                 qDebug() << "Error while reopening cache file";
+                                journalRemoveEntry(*it);
                                 ret.erase(it);
 
                                 return false;
                             }
 
                             //put it back into the RAM
-                            _memoryCache.insert( (*it)->getHashKey(), *it );
+                            shard.memoryCache.insert( (*it)->getHashKey(), *it );
 
 
                             U64 memoryCacheSize, maximumInMemorySize;
@@ -1751,7 +2586,7 @@ private:
 
                             //now clear extra entries from the disk cache so it doesn't exceed the RAM limit.
                             while (memoryCacheSize > maximumInMemorySize) {
-                                if ( !tryEvictInMemoryEntry(entriesToBeDeleted) ) {
+                                if ( !tryEvictInMemoryEntry(shard, entriesToBeDeleted) ) {
                                     break;
                                 }
 
@@ -1770,12 +2605,23 @@ private:
                             _signalEmitter->emitAddedEntry( key.getTime() );
                         }
 
+                        if (_isTiled) {
+                            QMutexLocker k(&_prefetchMutex);
+                            if ( _prefetchedHashes.erase( key.getHash() ) ) {
+                                ++_nPrefetchHits;
+                            } else {
+                                ++_nPrefetchMisses;
+                            }
+                        }
+
                         if (!_isTiled) {
 
+                            // The entry is now in the memory portion, which is not part of the journal
+                            journalRemoveEntry(*it);
                             ret.erase(it);
 
                             ///Remove it from the disk cache
-                            _diskCache.erase(diskCached);
+                            shard.diskCache.erase(diskCached);
                         }
 
                         return true;
@@ -1789,39 +2635,186 @@ private:
         }
     } // getInternal
 
+    /**
+     * @brief Returns the entry matching the key in the compressed portion of the shard, if any.
+     **/
+    EntryTypePtr findInCompressedPortion(Shard& shard,
+                                         const typename EntryType::key_type & key) const
+    {
+        assert( !shard.lock.tryLock() );
+
+        CacheIterator compressedCached = shard.compressedCache( key.getHash() );
+        if ( compressedCached == shard.compressedCache.end() ) {
+            return EntryTypePtr();
+        }
+
+        std::list<EntryTypePtr> & ret = getValueFromIterator(compressedCached);
+        for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+            if ( (*it)->getKey() == key ) {
+                return *it;
+            }
+        }
+
+        return EntryTypePtr();
+    }
+
+    /**
+     * @brief Removes the entry from the compressed portion of the shard, returns false if it is not in it.
+     **/
+    bool eraseFromCompressedPortion(Shard& shard,
+                                    const EntryTypePtr& entry) const
+    {
+        assert( !shard.lock.tryLock() );
+
+        CacheIterator compressedCached = shard.compressedCache( entry->getHashKey() );
+        if ( compressedCached == shard.compressedCache.end() ) {
+            return false;
+        }
+
+        std::list<EntryTypePtr> & ret = getValueFromIterator(compressedCached);
+        for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+            if (*it == entry) {
+                ret.erase(it);
+                if ( ret.empty() ) {
+                    shard.compressedCache.erase(compressedCached);
+                }
+
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Decompresses an entry returned by findInCompressedPortion() and moves it back to the memory portion.
+     * The shard must not be locked: the decompression is expensive and would hold up all the other lookups of the shard.
+     * The entry stays in the compressed portion meanwhile, so that a concurrent lookup of the same entry finds it and
+     * only waits for its decompression on the entry lock, instead of creating another one.
+     **/
+    void decompressEntry(Shard& shard,
+                         const EntryTypePtr& entry) const
+    {
+        std::list<EntryTypePtr> entriesToBeDeleted;
+        bool decompressed = true;
+        try {
+            entry->moveFromCompressedPortion();
+        } catch (const std::exception & e) {
+            qDebug() << "Error while decompressing cache entry: " << e.what();
+            decompressed = false;
+        }
+
+        {
+            CacheLocker locker(&shard.lock, &_lockStats);
+
+            // Another lookup may have moved it to the memory portion meanwhile, or it may have been removed from the cache
+            if ( !eraseFromCompressedPortion(shard, entry) ) {
+                return;
+            }
+            if (!decompressed) {
+                entriesToBeDeleted.push_back(entry);
+            } else {
+                sealEntry(shard, entry, true);
+
+                //now make room in the memory portion for the decompressed entry
+                U64 memoryCacheSize, maximumInMemorySize;
+                {
+                    QMutexLocker k(&_sizeLock);
+                    memoryCacheSize = _memoryCacheSize;
+                    maximumInMemorySize = _maximumInMemorySize;
+                }
+                while (memoryCacheSize > maximumInMemorySize) {
+                    std::list<EntryTypePtr> deleted;
+                    std::size_t compressedSize = 0;
+                    if ( !tryEvictInMemoryEntry(shard, deleted, &compressedSize) ) {
+                        break;
+                    }
+                    for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
+                        memoryCacheSize -= std::min( (std::size_t)memoryCacheSize, (*it)->size() );
+                        entriesToBeDeleted.push_back(*it);
+                    }
+                    memoryCacheSize -= std::min( (U64)compressedSize, memoryCacheSize );
+                }
+            }
+        }
+        if ( !entriesToBeDeleted.empty() ) {
+            _deleterThread.appendToQueue(entriesToBeDeleted);
+        }
+    } // decompressEntry
+
     /** @brief Inserts into the cache an entry that was previously allocated by the createInternal()
      * function. This is called directly by createInternal() if the allocation was successful
      **/
-    void sealEntry(const EntryTypePtr & entry,
+    void sealEntry(Shard& shard,
+                   const EntryTypePtr & entry,
                    bool inMemory) const
     {
-        assert( !_lock.tryLock() );   // must be locked
+        assert( !shard.lock.tryLock() );   // must be locked
         typename EntryType::hash_type hash = entry->getHashKey();
 
         if (inMemory) {
             /*if the entry doesn't exist on the memory cache,make a new list and insert it*/
-            CacheIterator existingEntry = _memoryCache(hash);
-            if ( existingEntry == _memoryCache.end() ) {
-                _memoryCache.insert(hash, entry);
+            CacheIterator existingEntry = shard.memoryCache(hash);
+            if ( existingEntry == shard.memoryCache.end() ) {
+                shard.memoryCache.insert(hash, entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
             }
         } else {
-            CacheIterator existingEntry = _diskCache(hash);
-            if ( existingEntry == _diskCache.end() ) {
-                _diskCache.insert(hash, entry);
+            CacheIterator existingEntry = shard.diskCache(hash);
+            if ( existingEntry == shard.diskCache.end() ) {
+                shard.diskCache.insert(hash, entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
             }
+            journalAddEntry(entry);
+        }
+    }
+
+    std::string serializeEntryForJournal(const EntryType& entry) const;
+
+    /**
+     * @brief Records that the entry entered the disk portion. It is written to the journal by the next syncJournal().
+     **/
+    void journalAddEntry(const EntryTypePtr& entry) const
+    {
+        QMutexLocker k(&_journalMutex);
+
+        if (_journal) {
+            _journalPendingEntries[entry.get()] = entry;
+        }
+    }
+
+    /**
+     * @brief Records that the entry left the disk portion.
+     **/
+    void journalRemoveEntry(const EntryTypePtr& entry) const
+    {
+        QMutexLocker k(&_journalMutex);
+
+        if (!_journal) {
+            return;
         }
+        if ( _journalPendingEntries.erase( entry.get() ) ) {
+            // It was never written to the journal
+            return;
+        }
+        _journal->appendRemove( entry->getHashKey(), CacheJournal::getEntryLocation( entry->getFilePath(), entry->getOffsetInFile() ) );
     }
 
-    bool tryEvictInMemoryEntry(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    /**
+     * @brief Evicts the least recently used entry of the memory portion of the shard. If the compressed portion
+     * is enabled, entries in RAM are moved to it and their size is added to movedToCompressedPortion, otherwise they
+     * are added to entriesToBeDeleted.
+     **/
+    bool tryEvictInMemoryEntry(Shard& shard,
+                               std::list<EntryTypePtr> & entriesToBeDeleted,
+                               std::size_t* movedToCompressedPortion = 0) const
     {
-        assert( !_lock.tryLock() );
-        std::pair<hash_type, EntryTypePtr> evicted = _memoryCache.evict();
+        assert( !shard.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evicted = shard.memoryCache.evict();
         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
         //we'll let the user of these entries purge the extra entries left in the cache later on
         if (!evicted.second) {
@@ -1832,7 +2825,14 @@ private:
         // If the cache is tiled, the entry is sharing the same file with other entries so we cannot close the file.
         // Just deallocate it
         if ( !evicted.second->isStoredOnDisk()) {
-            entriesToBeDeleted.push_back(evicted.second);
+            std::size_t entrySize = evicted.second->size();
+            if ( tryMoveToCompressedPortion(shard, evicted.first, evicted.second) ) {
+                if (movedToCompressedPortion) {
+                    *movedToCompressedPortion += entrySize;
+                }
+            } else {
+                entriesToBeDeleted.push_back(evicted.second);
+            }
         } else {
 
             assert( evicted.second.unique() );
@@ -1852,13 +2852,14 @@ private:
 
             /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
             while ( ( diskCacheSize  + evicted.second->size() ) >= (maximumCacheSize - maximumInMemorySize) ) {
-                std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
+                std::pair<hash_type, EntryTypePtr> evictedFromDisk = shard.diskCache.evict();
                 //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
                 //we'll let the user of these entries purge the extra entries left in the cache later on
                 if (!evictedFromDisk.second) {
                     break;
                 }
 
+                journalRemoveEntry(evictedFromDisk.second);
                 ///Erase the file from the disk if we reach the limit.
                 evictedFromDisk.second->removeAnyBackingFile();
 
@@ -1876,28 +2877,84 @@ private:
                 diskCacheSize -= fsize;
             }
 
-            CacheIterator existingDiskCacheEntry = _diskCache(evicted.first);
+            CacheIterator existingDiskCacheEntry = shard.diskCache(evicted.first);
             /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-            if ( existingDiskCacheEntry == _diskCache.end() ) {
-                _diskCache.insert(evicted.first, evicted.second);
+            if ( existingDiskCacheEntry == shard.diskCache.end() ) {
+                shard.diskCache.insert(evicted.first, evicted.second);
             } else {   /*append to the existing list*/
                 getValueFromIterator(existingDiskCacheEntry).push_back(evicted.second);
             }
+            journalAddEntry(evicted.second);
         } // if (!evicted.second->isStoredOnDisk())
 
         return true;
     } // tryEvictEntry
 
-    bool tryEvictDiskEntry(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    /**
+     * @brief Moves an entry evicted from the memory portion of the shard to its compressed portion and queues it
+     * to the compressor thread, after making room by deleting the least recently used compressed entries.
+     * Returns false if the compressed portion is disabled or cannot hold the entry.
+     **/
+    bool tryMoveToCompressedPortion(Shard& shard,
+                                    hash_type hash,
+                                    const EntryTypePtr& entry) const
+    {
+        assert( !shard.lock.tryLock() );
+
+        U64 compressedCacheSize, maximumCompressedSize;
+        {
+            QMutexLocker k(&_sizeLock);
+            compressedCacheSize = _compressedCacheSize;
+            maximumCompressedSize = _maximumCompressedSize;
+        }
+        std::size_t entrySize = entry->size();
+        if ( (maximumCompressedSize == 0) || (entrySize > maximumCompressedSize) ||
+             (entry->getParams()->getStorageInfo().mode != eStorageModeRAM) || !entry->isAllocated() ) {
+            return false;
+        }
+
+        std::list<EntryTypePtr> entriesToBeDeleted;
+        while (compressedCacheSize + entrySize > maximumCompressedSize) {
+            // Only the entries referenced by the cache alone are evicted: the queue of the compressor references the
+            // entries it did not compress yet, so they stay along with the entries used elsewhere
+            std::pair<hash_type, EntryTypePtr> evicted = shard.compressedCache.evict();
+            if (!evicted.second) {
+                break;
+            }
+            compressedCacheSize -= std::min( (std::size_t)compressedCacheSize, evicted.second->getCompressedPortionSize() );
+            entriesToBeDeleted.push_back(evicted.second);
+        }
+        if ( !entriesToBeDeleted.empty() ) {
+            _deleterThread.appendToQueue(entriesToBeDeleted);
+        }
+        if (compressedCacheSize + entrySize > maximumCompressedSize) {
+            return false;
+        }
+
+        U64 generation = entry->moveToCompressedPortion();
+        CacheIterator existingCompressedEntry = shard.compressedCache(hash);
+        if ( existingCompressedEntry == shard.compressedCache.end() ) {
+            shard.compressedCache.insert(hash, entry);
+        } else {
+            getValueFromIterator(existingCompressedEntry).push_back(entry);
+        }
+        _compressorThread.appendToQueue(entry, generation);
+
+        return true;
+    } // tryMoveToCompressedPortion
+
+    bool tryEvictDiskEntry(Shard& shard,
+                           std::list<EntryTypePtr> & entriesToBeDeleted) const
     {
 
-        assert( !_lock.tryLock() );
-        std::pair<hash_type, EntryTypePtr> evicted = _diskCache.evict();
+        assert( !shard.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evicted = shard.diskCache.evict();
         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
         //we'll let the user of these entries purge the extra entries left in the cache later on
         if (!evicted.second) {
             return false;
         }
+        journalRemoveEntry(evicted.second);
         if (!_isTiled) {
             // Erase the file from the disk if we reach the limit.
             evicted.second->removeAnyBackingFile();
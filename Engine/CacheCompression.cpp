@@ -0,0 +1,422 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheCompression.h"
+
+#include <algorithm> // min
+#include <cstring> // memcpy
+#include <functional>
+
+CLANG_DIAG_OFF(deprecated)
+#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
+CLANG_DIAG_ON(deprecated)
+
+// Matches are at least this long
+#define LZ_MIN_MATCH 4
+
+// Matches are searched at most this far behind, so that the offset fits 16 bits
+#define LZ_MAX_OFFSET 65535
+
+#define LZ_HASH_LOG 14
+
+// The last bytes of a block are always literals, so that the match search never reads past the end
+#define LZ_LAST_LITERALS 5
+#define LZ_MF_LIMIT 12
+
+// Set on the size of a chunk stored without compression
+#define CHUNK_RAW_FLAG 0x80000000U
+
+// rawSize (8 bytes), elementSize (4 bytes), chunks count (4 bytes)
+#define HEADER_BYTES 16
+
+NATRON_NAMESPACE_ENTER
+
+namespace CacheCompression {
+
+static void
+writeU32(U32 v,
+         unsigned char* dst)
+{
+    dst[0] = (unsigned char)v;
+    dst[1] = (unsigned char)(v >> 8);
+    dst[2] = (unsigned char)(v >> 16);
+    dst[3] = (unsigned char)(v >> 24);
+}
+
+static U32
+readU32(const unsigned char* src)
+{
+    return (U32)src[0] | ( (U32)src[1] << 8 ) | ( (U32)src[2] << 16 ) | ( (U32)src[3] << 24 );
+}
+
+static U32
+read32(const unsigned char* p)
+{
+    U32 v;
+
+    std::memcpy(&v, p, sizeof(v));
+
+    return v;
+}
+
+static U32
+hashSequence(U32 sequence)
+{
+    return (sequence * 2654435761U) >> (32 - LZ_HASH_LOG);
+}
+
+/**
+ * @brief Appends to dst a length which did not fit in the 4 bits of the token.
+ **/
+static bool
+writeLength(std::size_t length,
+            unsigned char** dst,
+            const unsigned char* dstEnd)
+{
+    while (length >= 255) {
+        if (*dst >= dstEnd) {
+            return false;
+        }
+        *(*dst)++ = 255;
+        length -= 255;
+    }
+    if (*dst >= dstEnd) {
+        return false;
+    }
+    *(*dst)++ = (unsigned char)length;
+
+    return true;
+}
+
+/**
+ * @brief Appends a sequence: a token holding the literals and match lengths, the literals and the match offset.
+ * A matchLength of 0 ends the block. Returns false if dst is too small.
+ **/
+static bool
+writeSequence(const unsigned char* literals,
+              std::size_t literalsLength,
+              std::size_t offset,
+              std::size_t matchLength,
+              unsigned char** dst,
+              const unsigned char* dstEnd)
+{
+    if (*dst >= dstEnd) {
+        return false;
+    }
+    unsigned char* token = (*dst)++;
+    *token = (unsigned char)( std::min(literalsLength, (std::size_t)15) << 4 );
+    if ( (literalsLength >= 15) && !writeLength(literalsLength - 15, dst, dstEnd) ) {
+        return false;
+    }
+    if ( (std::size_t)(dstEnd - *dst) < literalsLength ) {
+        return false;
+    }
+    if (literalsLength > 0) {
+        std::memcpy(*dst, literals, literalsLength);
+        *dst += literalsLength;
+    }
+    if (matchLength == 0) {
+        return true;
+    }
+
+    if (dstEnd - *dst < 2) {
+        return false;
+    }
+    *(*dst)++ = (unsigned char)offset;
+    *(*dst)++ = (unsigned char)(offset >> 8);
+    std::size_t length = matchLength - LZ_MIN_MATCH;
+    *token |= (unsigned char)std::min(length, (std::size_t)15);
+
+    return length < 15 || writeLength(length - 15, dst, dstEnd);
+}
+
+std::size_t
+lzCompress(const unsigned char* src,
+           std::size_t size,
+           unsigned char* dst,
+           std::size_t dstCapacity)
+{
+    unsigned char* op = dst;
+    const unsigned char* dstEnd = dst + dstCapacity;
+    std::size_t anchor = 0;
+
+    if (size > LZ_MF_LIMIT) {
+        std::vector<U32> table( (std::size_t)1 << LZ_HASH_LOG, 0xFFFFFFFFU );
+        const std::size_t mfLimit = size - LZ_MF_LIMIT;
+        const std::size_t matchLimit = size - LZ_LAST_LITERALS;
+        std::size_t ip = 0;
+        while (ip < mfLimit) {
+            const U32 sequence = read32(src + ip);
+            const U32 h = hashSequence(sequence);
+            std::size_t ref = table[h];
+            table[h] = (U32)ip;
+            if ( (ref == 0xFFFFFFFFU) || (ip - ref > LZ_MAX_OFFSET) || (read32(src + ref) != sequence) ) {
+                // Skip faster over data which does not compress
+                ip += 1 + ( (ip - anchor) >> 6 );
+                continue;
+            }
+
+            // Extend the match backwards over the pending literals, then forwards
+            while ( (ip > anchor) && (ref > 0) && (src[ip - 1] == src[ref - 1]) ) {
+                --ip;
+                --ref;
+            }
+            std::size_t length = LZ_MIN_MATCH;
+            while ( (ip + length < matchLimit) && (src[ref + length] == src[ip + length]) ) {
+                ++length;
+            }
+            if ( !writeSequence(src + anchor, ip - anchor, ip - ref, length, &op, dstEnd) ) {
+                return 0;
+            }
+            ip += length;
+            anchor = ip;
+            if (ip < mfLimit) {
+                table[hashSequence( read32(src + ip - 2) )] = (U32)(ip - 2);
+            }
+        }
+    }
+    if ( !writeSequence(src + anchor, size - anchor, 0, 0, &op, dstEnd) || (op >= dstEnd) ) {
+        return 0;
+    }
+
+    return op - dst;
+} // lzCompress
+
+static bool
+readLength(const unsigned char** ip,
+           const unsigned char* srcEnd,
+           std::size_t* length)
+{
+    unsigned char b;
+
+    do {
+        if (*ip >= srcEnd) {
+            return false;
+        }
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+
+    return true;
+}
+
+bool
+lzDecompress(const unsigned char* src,
+             std::size_t srcSize,
+             unsigned char* dst,
+             std::size_t dstSize)
+{
+    const unsigned char* ip = src;
+    const unsigned char* srcEnd = src + srcSize;
+    unsigned char* op = dst;
+    unsigned char* dstEnd = dst + dstSize;
+    // The data always ends with a sequence without a match, even if it is empty
+    bool lastSequenceRead = false;
+
+    while (ip < srcEnd) {
+        const unsigned char token = *ip++;
+        std::size_t literalsLength = token >> 4;
+        if ( (literalsLength == 15) && !readLength(&ip, srcEnd, &literalsLength) ) {
+            return false;
+        }
+        if ( ( (std::size_t)(srcEnd - ip) < literalsLength ) || ( (std::size_t)(dstEnd - op) < literalsLength ) ) {
+            return false;
+        }
+        std::memcpy(op, ip, literalsLength);
+        ip += literalsLength;
+        op += literalsLength;
+        if (ip == srcEnd) {
+            // The last sequence has no match
+            lastSequenceRead = true;
+            break;
+        }
+
+        if (srcEnd - ip < 2) {
+            return false;
+        }
+        const std::size_t offset = (std::size_t)ip[0] | ( (std::size_t)ip[1] << 8 );
+        ip += 2;
+        std::size_t matchLength = token & 15;
+        if ( (matchLength == 15) && !readLength(&ip, srcEnd, &matchLength) ) {
+            return false;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if ( (offset == 0) || ( (std::size_t)(op - dst) < offset ) || ( (std::size_t)(dstEnd - op) < matchLength ) ) {
+            return false;
+        }
+        const unsigned char* match = op - offset;
+        if (offset >= matchLength) {
+            std::memcpy(op, match, matchLength);
+            op += matchLength;
+        } else {
+            // The match overlaps the bytes it produces
+            for (std::size_t i = 0; i < matchLength; ++i) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return lastSequenceRead && op == dstEnd;
+} // lzDecompress
+
+static std::size_t
+getChunkBytes(std::size_t elementSize)
+{
+    return std::max( (std::size_t)1, NATRON_CACHE_COMPRESSION_CHUNK_BYTES / elementSize ) * elementSize;
+}
+
+void
+compress(const unsigned char* data,
+         std::size_t size,
+         std::size_t elementSize,
+         std::vector<unsigned char>* compressed)
+{
+    elementSize = std::max( (std::size_t)1, elementSize );
+    const std::size_t chunkBytes = getChunkBytes(elementSize);
+    const std::size_t nChunks = (size + chunkBytes - 1) / chunkBytes;
+
+    compressed->resize(HEADER_BYTES + nChunks * 4);
+    writeU32( (U32)size, &(*compressed)[0] );
+    writeU32( (U32)( (U64)size >> 32 ), &(*compressed)[4] );
+    writeU32( (U32)elementSize, &(*compressed)[8] );
+    writeU32( (U32)nChunks, &(*compressed)[12] );
+
+    std::vector<unsigned char> shuffled(std::min(chunkBytes, size));
+    std::vector<unsigned char> chunk(shuffled.size());
+    for (std::size_t c = 0; c < nChunks; ++c) {
+        const unsigned char* src = data + c * chunkBytes;
+        const std::size_t chunkSize = std::min(chunkBytes, size - c * chunkBytes);
+        const std::size_t nElements = chunkSize / elementSize;
+
+        // Byte b of all the elements goes to plane b. The bytes of an incomplete last element are left at the end
+        for (std::size_t b = 0; b < elementSize; ++b) {
+            unsigned char* plane = &shuffled[0] + b * nElements;
+            const unsigned char* srcByte = src + b;
+            for (std::size_t i = 0; i < nElements; ++i, srcByte += elementSize) {
+                plane[i] = *srcByte;
+            }
+        }
+        std::memcpy(&shuffled[0] + nElements * elementSize, src + nElements * elementSize, chunkSize - nElements * elementSize);
+
+        std::size_t chunkCompressedSize = lzCompress(&shuffled[0], chunkSize, &chunk[0], chunkSize);
+        if (chunkCompressedSize == 0) {
+            compressed->insert(compressed->end(), src, src + chunkSize);
+            writeU32( (U32)chunkSize | CHUNK_RAW_FLAG, &(*compressed)[HEADER_BYTES + c * 4] );
+        } else {
+            compressed->insert(compressed->end(), chunk.begin(), chunk.begin() + chunkCompressedSize);
+            writeU32( (U32)chunkCompressedSize, &(*compressed)[HEADER_BYTES + c * 4] );
+        }
+    }
+} // compress
+
+std::size_t
+getDecompressedSize(const std::vector<unsigned char>& compressed)
+{
+    if (compressed.size() < HEADER_BYTES) {
+        return 0;
+    }
+
+    return (std::size_t)( (U64)readU32(&compressed[0]) | ( (U64)readU32(&compressed[4]) << 32 ) );
+}
+
+namespace {
+struct ChunkToDecompress
+{
+    const unsigned char* src;
+    std::size_t srcSize;
+    bool isRaw;
+    unsigned char* dst;
+    std::size_t dstSize;
+};
+}
+
+bool
+decompress(const std::vector<unsigned char>& compressed,
+           unsigned char* data,
+           std::size_t size)
+{
+    if ( (compressed.size() < HEADER_BYTES) || (getDecompressedSize(compressed) != size) ) {
+        return false;
+    }
+    const std::size_t elementSize = readU32(&compressed[8]);
+    const std::size_t nChunks = readU32(&compressed[12]);
+    if ( (elementSize == 0) || (compressed.size() < HEADER_BYTES + nChunks * 4) ) {
+        return false;
+    }
+    const std::size_t chunkBytes = getChunkBytes(elementSize);
+    if ( nChunks != (size + chunkBytes - 1) / chunkBytes ) {
+        return false;
+    }
+
+    std::vector<ChunkToDecompress> chunks(nChunks);
+    std::size_t offset = HEADER_BYTES + nChunks * 4;
+    for (std::size_t c = 0; c < nChunks; ++c) {
+        const U32 chunkInfo = readU32(&compressed[HEADER_BYTES + c * 4]);
+        chunks[c].srcSize = chunkInfo & ~CHUNK_RAW_FLAG;
+        chunks[c].isRaw = (chunkInfo & CHUNK_RAW_FLAG) != 0;
+        chunks[c].dst = data + c * chunkBytes;
+        chunks[c].dstSize = std::min(chunkBytes, size - c * chunkBytes);
+        if ( (compressed.size() - offset < chunks[c].srcSize) || ( chunks[c].isRaw && (chunks[c].srcSize != chunks[c].dstSize) ) ) {
+            return false;
+        }
+        chunks[c].src = &compressed[0] + offset;
+        offset += chunks[c].srcSize;
+    }
+
+    std::vector<char> chunkSucceeded(nChunks, 0);
+    std::function<void (ChunkToDecompress&)> decompressChunk = [&](ChunkToDecompress& chunk) {
+        if (chunk.isRaw) {
+            std::memcpy(chunk.dst, chunk.src, chunk.dstSize);
+            chunkSucceeded[&chunk - &chunks[0]] = 1;
+
+            return;
+        }
+        std::vector<unsigned char> shuffled(chunk.dstSize);
+        if ( !lzDecompress(chunk.src, chunk.srcSize, &shuffled[0], chunk.dstSize) ) {
+            return;
+        }
+        const std::size_t nElements = chunk.dstSize / elementSize;
+        for (std::size_t b = 0; b < elementSize; ++b) {
+            const unsigned char* plane = &shuffled[0] + b * nElements;
+            unsigned char* dstByte = chunk.dst + b;
+            for (std::size_t i = 0; i < nElements; ++i, dstByte += elementSize) {
+                *dstByte = plane[i];
+            }
+        }
+        std::memcpy(chunk.dst + nElements * elementSize, &shuffled[0] + nElements * elementSize, chunk.dstSize - nElements * elementSize);
+        chunkSucceeded[&chunk - &chunks[0]] = 1;
+    };
+    if (nChunks <= 1) {
+        std::for_each(chunks.begin(), chunks.end(), decompressChunk);
+    } else {
+        QtConcurrent::map(chunks, decompressChunk).waitForFinished();
+    }
+
+    return std::find(chunkSucceeded.begin(), chunkSucceeded.end(), 0) == chunkSucceeded.end();
+} // decompress
+
+} // namespace CacheCompression
+
+NATRON_NAMESPACE_EXIT
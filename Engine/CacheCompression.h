@@ -0,0 +1,83 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_CacheCompression_h
+#define Natron_Engine_CacheCompression_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <vector>
+
+#include "Global/GlobalDefines.h"
+
+// The data is split in chunks of this size which are compressed independently, so that they can be
+// decompressed in parallel
+#define NATRON_CACHE_COMPRESSION_CHUNK_BYTES (1024 * 1024)
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Fast lossless codec used by the compressed portion of the caches.
+ * The bytes of each element (e.g. a float or half component) are first shuffled into byte planes, which puts
+ * together the slowly varying sign and exponent bytes of pixel data, then each plane is compressed with a
+ * LZ77 coder in the spirit of LZ4: no entropy coding, so that decompression runs at memory speed.
+ * Chunks which do not compress are stored as is.
+ **/
+namespace CacheCompression {
+
+/**
+ * @brief Compresses size bytes of src into dst with the LZ77 coder, without the byte shuffle nor the chunking of
+ * compress(). Returns the compressed size, or 0 if it would not be smaller than dstCapacity.
+ **/
+std::size_t lzCompress(const unsigned char* src, std::size_t size, unsigned char* dst, std::size_t dstCapacity);
+
+/**
+ * @brief Decompresses the output of lzCompress() into dst, which must be exactly the size of the data.
+ * Returns false if the compressed data is corrupted or is not the size of dst once decompressed.
+ **/
+bool lzDecompress(const unsigned char* src, std::size_t srcSize, unsigned char* dst, std::size_t dstSize);
+
+/**
+ * @brief Compresses size bytes of data made of elements of elementSize bytes into compressed.
+ **/
+void compress(const unsigned char* data, std::size_t size, std::size_t elementSize, std::vector<unsigned char>* compressed);
+
+/**
+ * @brief Returns the size of the data held by the output of compress(), or 0 if it is not valid.
+ **/
+std::size_t getDecompressedSize(const std::vector<unsigned char>& compressed);
+
+/**
+ * @brief Decompresses the output of compress() into data, which must be getDecompressedSize() bytes large.
+ * The chunks are decompressed in parallel. Returns false if the compressed data is corrupted.
+ **/
+bool decompress(const std::vector<unsigned char>& compressed, unsigned char* data, std::size_t size);
+
+} // namespace CacheCompression
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_CacheCompression_h
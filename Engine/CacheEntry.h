@@ -33,6 +33,8 @@
 #include <cstdio> // for std::remove
 #include <cstring> // for std::memcpy
 #include <stdexcept>
+#include <map>
+#include <string>
 #include <vector>
 #ifndef _WIN32
 #include <fstream>
@@ -56,9 +58,11 @@
 #endif
 
 #include "Engine/Hash64.h"
+#include "Engine/CacheCompression.h"
 #include "Engine/CacheEntryHolder.h"
 #include "Engine/MemoryFile.h"
 #include "Engine/NonKeyParams.h"
+#include "Engine/RamBufferPool.h"
 #include "Engine/Texture.h"
 #include "Engine/EngineFwd.h"
 #include "Global/GlobalDefines.h"
@@ -74,12 +78,14 @@ class RamBuffer
 {
     T* data;
     U64 count;
+    std::size_t blockSize; // size of the block returned by the RamBufferPool
 
 public:
 
     RamBuffer()
         : data(0)
         , count(0)
+        , blockSize(0)
     {
     }
 
@@ -97,6 +103,7 @@ public:
     {
         std::swap(data, other.data);
         std::swap(count, other.count);
+        std::swap(blockSize, other.blockSize);
     }
 
     U64 size() const
@@ -110,32 +117,33 @@ public:
             return;
         }
         count = size;
+        std::size_t nBytes = size * sizeof(T);
         if (data) {
-            free(data);
+            // The content does not have to be preserved: keep the block if it has the right size
+            if (RamBufferPool::getBlockSize(nBytes) == blockSize) {
+                return;
+            }
+            RamBufferPool::instance()->release(data, blockSize);
             data = 0;
+            blockSize = 0;
         }
-        if (count == 0) {
-            return;
-        }
-        data = (T*)malloc( size * sizeof(T) );
-        if (!data) {
-            throw std::bad_alloc();
-        }
+        data = (T*)RamBufferPool::instance()->allocate(nBytes, &blockSize);
     }
 
     void clear()
     {
         count = 0;
         if (data) {
-            free(data);
+            RamBufferPool::instance()->release(data, blockSize);
             data = 0;
+            blockSize = 0;
         }
     }
 
     ~RamBuffer()
     {
         if (data) {
-            free(data);
+            RamBufferPool::instance()->release(data, blockSize);
             data = 0;
         }
     }
@@ -153,6 +161,9 @@ public:
 
 typedef TileCacheFilePtr TileCacheFilePtr;
 
+/// For each cache entry holder ID, the node hashes of the entries of this holder to keep in the cache
+typedef std::map<std::string, std::vector<U64> > CacheHoldersNodeHashes;
+
 /**
  * @brief Defines the API of the Cache as seen by the cache entries
  **/
@@ -180,17 +191,17 @@ public:
      * @brief To be called by a CacheEntry whenever it's size is changed.
      * This way the cache can keep track of the real memory footprint.
      **/
-    virtual void notifyEntrySizeChanged(size_t oldSize, size_t newSize) const = 0;
+    virtual void notifyEntrySizeChanged(U64 hash, size_t oldSize, size_t newSize) const = 0;
 
     /**
      * @brief To be called by a CacheEntry on allocation.
      **/
-    virtual void notifyEntryAllocated(double time, size_t size, StorageModeEnum storage) const = 0;
+    virtual void notifyEntryAllocated(U64 hash, double time, size_t size, StorageModeEnum storage) const = 0;
 
     /**
      * @brief To be called by a CacheEntry on destruction.
      **/
-    virtual void notifyEntryDestroyed(double time, size_t size, StorageModeEnum storage) const = 0;
+    virtual void notifyEntryDestroyed(U64 hash, double time, size_t size, StorageModeEnum storage) const = 0;
 
     /**
      * @brief Called by the Cache deleter thread to wake up sleeping threads that were attempting to create a new image
@@ -206,14 +217,25 @@ public:
      * @brief To be called whenever an entry is deallocated from memory and put back on disk or whenever
      * it is reallocated in the RAM.
      **/
-    virtual void notifyEntryStorageChanged(StorageModeEnum oldStorage, StorageModeEnum newStorage,
+    virtual void notifyEntryStorageChanged(U64 hash, StorageModeEnum oldStorage, StorageModeEnum newStorage,
                                            double time, size_t size) const = 0;
 
     /**
-     * @brief Remove from the cache all entries that matches the holderID and have a different nodeHash than the given one.
-     * @param removeAll If true, remove even entries that match the nodeHash
+     * @brief To be called whenever an entry enters or leaves the compressed portion of the cache, or whenever
+     * its data is compressed, with the changes of the bytes it occupies in the memory and compressed portions.
+     **/
+    virtual void notifyEntryCompressionChanged(U64 hash, qint64 memoryDiff, qint64 compressedDiff) const = 0;
+
+    /**
+     * @brief Remove from the cache all entries of the holders in nodeHashesToKeep whose node hash is not
+     * listed for their holder. Holders mapped to an empty list have all their entries removed.
+     **/
+    virtual void removeAllEntriesWithDifferentNodeHashForHoldersPrivate(const CacheHoldersNodeHashes& nodeHashesToKeep) = 0;
+
+    /**
+     * @brief Evict least recently used entries until the cache fits again in its maximum size.
      **/
-    virtual void removeAllEntriesWithDifferentNodeHashForHolderPrivate(const std::string& holderID, U64 nodeHash, bool removeAll) = 0;
+    virtual void clearExceedingEntries() = 0;
 
     /**
      * @brief Relevant only for tiled caches. This will allocate the memory required for a tile in the cache and lock it.
@@ -547,6 +569,14 @@ public:
         return _cacheFileDataOffset;
     }
 
+    /**
+     * @brief Returns the file of the tiled cache holding this buffer, if any
+     **/
+    TileCacheFilePtr getTileCacheFile() const
+    {
+        return _cacheFile;
+    }
+
     void reOpenFileMapping() const
     {
         assert(!_backingFile && _storageMode == eStorageModeDisk);
@@ -771,6 +801,10 @@ public:
         , _cache()
         , _entryLock(QReadWriteLock::Recursive)
         , _removeBackingFileBeforeDestruction(false)
+        , _compressedData()
+        , _isInCompressedPortion(false)
+        , _compressedPortionSize(0)
+        , _compressionGeneration(0)
     {
     }
 
@@ -789,6 +823,10 @@ public:
         , _cache(cache)
         , _entryLock(QReadWriteLock::Recursive)
         , _removeBackingFileBeforeDestruction(false)
+        , _compressedData()
+        , _isInCompressedPortion(false)
+        , _compressedPortionSize(0)
+        , _compressionGeneration(0)
     {
     }
 
@@ -850,7 +888,7 @@ public:
         }
 
         if (_cache) {
-            _cache->notifyEntryAllocated( getTime(), size(), storageInfo.mode );
+            _cache->notifyEntryAllocated( getHashKey(), getTime(), size(), storageInfo.mode );
         }
     }
 
@@ -875,9 +913,9 @@ public:
 
         if (_cache) {
             if (_cache->isTileCache()) {
-                _cache->notifyEntryAllocated(getTime(), size, eStorageModeDisk);
+                _cache->notifyEntryAllocated(getHashKey(), getTime(), size, eStorageModeDisk);
             } else {
-                _cache->notifyEntryStorageChanged(eStorageModeNone, eStorageModeDisk, getTime(), size);
+                _cache->notifyEntryStorageChanged(getHashKey(), eStorageModeNone, eStorageModeDisk, getTime(), size);
             }
         }
     }
@@ -952,7 +990,7 @@ public:
             _data.reOpenFileMapping();
         }
         if (_cache) {
-            _cache->notifyEntryStorageChanged( eStorageModeDisk, eStorageModeRAM, getTime(), size() );
+            _cache->notifyEntryStorageChanged( getHashKey(), eStorageModeDisk, eStorageModeRAM, getTime(), size() );
         }
     }
 
@@ -963,30 +1001,38 @@ public:
     {
         std::size_t sz = size();
         bool dataAllocated;
+        std::size_t compressedPortionSize;
         double time = getTime();
         {
             QWriteLocker k(&_entryLock);
             dataAllocated = _data.isAllocated();
             _data.deallocate();
+            compressedPortionSize = _compressedPortionSize;
+            std::vector<unsigned char>().swap(_compressedData);
+            _isInCompressedPortion = false;
+            _compressedPortionSize = 0;
         }
 
         if (_cache) {
             const CacheEntryStorageInfo& info = _params->getStorageInfo();
-            if (info.mode == eStorageModeDisk) {
+            if (compressedPortionSize > 0) {
+                // The memory of the entry was accounted in the compressed portion
+                _cache->notifyEntryCompressionChanged(getHashKey(), 0, -(qint64)compressedPortionSize);
+            } else if (info.mode == eStorageModeDisk) {
                 if (dataAllocated) {
                     if (_cache->isTileCache()) {
-                         _cache->notifyEntryDestroyed(time, sz, eStorageModeDisk);
+                         _cache->notifyEntryDestroyed(getHashKey(), time, sz, eStorageModeDisk);
                     } else {
-                        _cache->notifyEntryStorageChanged( eStorageModeRAM, eStorageModeDisk, time, sz );
+                        _cache->notifyEntryStorageChanged( getHashKey(), eStorageModeRAM, eStorageModeDisk, time, sz );
                     }
                 }
             } else if (info.mode == eStorageModeRAM) {
                 if (dataAllocated) {
-                    _cache->notifyEntryDestroyed(time, sz, eStorageModeRAM);
+                    _cache->notifyEntryDestroyed(getHashKey(), time, sz, eStorageModeRAM);
                 }
             } else if (info.mode == eStorageModeGLTex) {
                 if (dataAllocated) {
-                    _cache->notifyEntryDestroyed(time, sz, eStorageModeGLTex);
+                    _cache->notifyEntryDestroyed(getHashKey(), time, sz, eStorageModeGLTex);
                 }
             }
         }
@@ -1024,6 +1070,22 @@ public:
         return _data.getOffsetInFile();
     }
 
+    /**
+     * @brief If the entry is a tile of a tiled cache, returns the file holding it and sets its offset in the file.
+     * Returns NULL if the entry is not stored in a tiled cache or if it is being written by another thread.
+     **/
+    TileCacheFilePtr tryGetTileCacheFile(std::size_t* dataOffset) const
+    {
+        if ( !_entryLock.tryLockForRead() ) {
+            return TileCacheFilePtr();
+        }
+        TileCacheFilePtr ret = _data.getTileCacheFile();
+        *dataOffset = _data.getOffsetInFile();
+        _entryLock.unlock();
+
+        return ret;
+    }
+
 
     bool isStoredOnDisk() const
     {
@@ -1037,6 +1099,123 @@ public:
         return _data.isAllocated();
     }
 
+    /**
+     * @brief Returns the size in bytes of the elements the data is made of, which the compression of the data
+     * relies on (@see Image::getCompressionElementSize())
+     **/
+    virtual std::size_t getCompressionElementSize() const
+    {
+        return sizeof(DataType);
+    }
+
+    /**
+     * @brief Called by the cache when the entry, which must be allocated in RAM, is moved to the compressed portion.
+     * The memory of the entry is accounted in the compressed portion from now on, even before compressData()
+     * releases it. Returns the generation to pass to compressData().
+     **/
+    U64 moveToCompressedPortion()
+    {
+        std::size_t sz = size();
+        U64 generation;
+        {
+            QWriteLocker k(&_entryLock);
+            assert( !_isInCompressedPortion && _data.isAllocated() && (_data.getStorageMode() == eStorageModeRAM) );
+            _isInCompressedPortion = true;
+            _compressedPortionSize = sz;
+            generation = ++_compressionGeneration;
+        }
+        if (_cache) {
+            _cache->notifyEntryCompressionChanged(getHashKey(), -(qint64)sz, sz);
+        }
+
+        return generation;
+    }
+
+    /**
+     * @brief Compresses the data of an entry moved to the compressed portion by moveToCompressedPortion() and
+     * releases its RAM. This is expensive and is done by the compressor thread of the cache without the cache lock:
+     * returns false if the entry left the compressed portion since the generation was returned.
+     **/
+    bool compressData(U64 generation)
+    {
+        std::vector<unsigned char> compressed;
+        std::size_t dataBytes;
+        {
+            // The data does not change while the entry is in the compressed portion, nothing else uses it
+            QReadLocker k(&_entryLock);
+            if ( !isCompressionPending(generation) ) {
+                return false;
+            }
+            dataBytes = _data.size();
+            CacheCompression::compress( (const unsigned char*)_data.readable(), dataBytes, getCompressionElementSize(), &compressed );
+        }
+
+        qint64 compressedDiff;
+        {
+            QWriteLocker k(&_entryLock);
+            if ( !isCompressionPending(generation) ) {
+                return false;
+            }
+            _compressedData.swap(compressed);
+            _data.deallocate();
+            compressedDiff = (qint64)_compressedData.size() - (qint64)dataBytes;
+            _compressedPortionSize += compressedDiff;
+        }
+        if (_cache) {
+            _cache->notifyEntryCompressionChanged(getHashKey(), 0, compressedDiff);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Called by the cache when the entry is looked-up in the compressed portion: decompresses its data
+     * if compressData() was called and moves its memory back to the memory portion.
+     * WARNING: This function throws a std::bad_alloc if the allocation fails.
+     **/
+    void moveFromCompressedPortion()
+    {
+        std::size_t compressedPortionSize;
+        {
+            QWriteLocker k(&_entryLock);
+            if (!_isInCompressedPortion) {
+                return;
+            }
+            if ( !_compressedData.empty() ) {
+                std::size_t dataBytes = CacheCompression::getDecompressedSize(_compressedData);
+                _data.allocateRAM(dataBytes / sizeof(DataType));
+                if ( !CacheCompression::decompress( _compressedData, (unsigned char*)_data.writable(), _data.size() ) ) {
+                    _data.deallocate();
+                    throw std::runtime_error("Corrupted compressed cache entry");
+                }
+                std::vector<unsigned char>().swap(_compressedData);
+            }
+            compressedPortionSize = _compressedPortionSize;
+            _isInCompressedPortion = false;
+            _compressedPortionSize = 0;
+        }
+        if (_cache) {
+            _cache->notifyEntryCompressionChanged(getHashKey(), size(), -(qint64)compressedPortionSize);
+        }
+    }
+
+    bool isCompressed() const
+    {
+        QReadLocker k(&_entryLock);
+
+        return !_compressedData.empty();
+    }
+
+    /**
+     * @brief Returns the bytes the entry occupies in the compressed portion of the cache, 0 if it is not in it.
+     **/
+    std::size_t getCompressedPortionSize() const
+    {
+        QReadLocker k(&_entryLock);
+
+        return _compressedPortionSize;
+    }
+
     virtual void syncBackingFile() const OVERRIDE FINAL
     {
         QWriteLocker k(&_entryLock);
@@ -1064,10 +1243,10 @@ public:
             _cache->backingFileClosed();
         }
         if (isAlloc) {
-            _cache->notifyEntryDestroyed(getTime(), getElementsCountFromParams(), eStorageModeRAM);
+            _cache->notifyEntryDestroyed(getHashKey(), getTime(), getElementsCountFromParams(), eStorageModeRAM);
         } else {
             ///size() will return 0 at this point, we have to recompute it
-            _cache->notifyEntryDestroyed(getTime(), getElementsCountFromParams(), eStorageModeDisk);
+            _cache->notifyEntryDestroyed(getHashKey(), getTime(), getElementsCountFromParams(), eStorageModeDisk);
         }
     }
 
@@ -1143,7 +1322,7 @@ protected:
 
         _data.swap(other._data);
         if (_cache) {
-            _cache->notifyEntrySizeChanged( oldSize, size() );
+            _cache->notifyEntrySizeChanged( getHashKey(), oldSize, size() );
         }
     }
 
@@ -1243,6 +1422,11 @@ private:
         _data.restoreBufferFromFile(path, offset, this, isTileCache);
     }
 
+    bool isCompressionPending(U64 generation) const
+    {
+        return _isInCompressedPortion && _compressedData.empty() && (_compressionGeneration == generation) && _data.isAllocated();
+    }
+
 protected:
 
     friend class Buffer<DataType>;
@@ -1253,6 +1437,17 @@ protected:
     const CacheAPI* _cache;
     mutable QReadWriteLock _entryLock;
     bool _removeBackingFileBeforeDestruction;
+
+    // The data while the entry is in the compressed portion of the cache, once compressData() released its RAM
+    std::vector<unsigned char> _compressedData;
+    bool _isInCompressedPortion;
+
+    // Bytes accounted in the compressed portion of the cache for this entry
+    std::size_t _compressedPortionSize;
+
+    // Incremented whenever the entry enters the compressed portion, so that a compression started before the
+    // entry left it is dropped
+    U64 _compressionGeneration;
 };
 
 NATRON_NAMESPACE_EXIT
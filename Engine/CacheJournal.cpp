@@ -0,0 +1,562 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheJournal.h"
+
+#ifdef __NATRON_WIN32__
+#include <io.h> // _commit
+#include <windows.h> // MoveFileExW
+#else
+#include <unistd.h> // fsync
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio> // rename
+#include <cstring> // memcpy, memcmp
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+
+#include "Global/StrUtils.h"
+
+// Increment this when the layout of the records changes
+#define NATRON_CACHE_JOURNAL_FORMAT_VERSION 1
+
+#define NATRON_CACHE_JOURNAL_MAGIC "NatronCacheTOC"
+
+NATRON_NAMESPACE_ENTER
+
+enum CacheJournalRecordTypeEnum
+{
+    // An entry was added to the disk portion of the cache. Followed by the serialized entry.
+    eCacheJournalRecordTypeAdd = 1,
+
+    // An entry was removed from the disk portion of the cache
+    eCacheJournalRecordTypeRemove,
+
+    // All additions before this record are committed
+    eCacheJournalRecordTypeSync,
+
+    // All additions since the last sync point are discarded. Written when opening a journal that ends with
+    // uncommitted additions, since their data may not have reached the disk.
+    eCacheJournalRecordTypeRollback
+};
+
+struct CacheJournalFileHeader
+{
+    char magic[16];
+    U32 formatVersion;
+    U32 cacheVersion;
+};
+
+struct CacheJournalRecordHeader
+{
+    U32 type;
+    U32 payloadSize;
+    U64 hash;
+    U64 location;
+    U64 checksum; // of this header, with the checksum set to 0, followed by the payload
+};
+
+static_assert(sizeof(CacheJournalFileHeader) == 24, "The journal header must not be padded");
+static_assert(sizeof(CacheJournalRecordHeader) == 32, "The journal records must not be padded");
+
+// 64-bit FNV-1a
+static U64
+hashBytes(U64 hash,
+          const char* data,
+          std::size_t size)
+{
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static U64
+computeRecordChecksum(const CacheJournalRecordHeader& header,
+                      const char* payload)
+{
+    CacheJournalRecordHeader h = header;
+
+    h.checksum = 0;
+
+    return hashBytes( hashBytes( 0xcbf29ce484222325ULL, (const char*)&h, sizeof(h) ), payload, header.payloadSize );
+}
+
+struct CacheJournalPrivate
+{
+    mutable QMutex lock; //< protects all members
+
+    QFile file;
+
+    // Set by open() until finishRestore() is called
+    uchar* mapping;
+    std::vector<CacheJournal::Record> restoredRecords;
+
+    // End of the last complete record found by open()
+    qint64 validEnd;
+    bool mustRollback;
+
+    // Number of additions and removals in the file, and number of additions not removed
+    std::size_t nRecords;
+    std::size_t nLiveRecords;
+
+    CacheJournalPrivate()
+        : lock()
+        , file()
+        , mapping(0)
+        , restoredRecords()
+        , validEnd(0)
+        , mustRollback(false)
+        , nRecords(0)
+        , nLiveRecords(0)
+    {
+    }
+
+    void scan(const char* data, qint64 size);
+
+    void writeFileHeader(QFile& f, unsigned int cacheVersion);
+
+    void writeRecord(QFile& f,
+                     CacheJournalRecordTypeEnum type,
+                     U64 hash,
+                     U64 location,
+                     const char* payload,
+                     std::size_t payloadSize);
+
+    void flush(QFile& f);
+
+    void unmap();
+};
+
+void
+CacheJournalPrivate::scan(const char* data,
+                          qint64 size)
+{
+    typedef std::map<std::pair<U64, U64>, std::size_t> LiveRecordsMap;
+    typedef std::multimap<std::pair<U64, U64>, std::size_t> UncommittedRecordsMap;
+
+    // Index in records of the live additions, by hash and location
+    LiveRecordsMap live;
+    std::vector<CacheJournal::Record> records;
+    std::vector<bool> removed;
+    // Index in records of the additions since the last sync, in order, and by hash and location.
+    // An addition removed before the next sync is cancelled and filtered out of uncommitted at the sync.
+    std::vector<std::size_t> uncommitted;
+    UncommittedRecordsMap uncommittedByKey;
+    std::vector<bool> cancelled;
+    const auto isCancelled = [&cancelled](std::size_t i) -> bool {
+        return cancelled[i];
+    };
+
+    qint64 pos = sizeof(CacheJournalFileHeader);
+
+    validEnd = pos;
+    nRecords = 0;
+    while (pos + (qint64)sizeof(CacheJournalRecordHeader) <= size) {
+        CacheJournalRecordHeader header;
+        std::memcpy( &header, data + pos, sizeof(header) );
+        const char* payload = data + pos + sizeof(header);
+        if ( (qint64)header.payloadSize > size - pos - (qint64)sizeof(header) ) {
+            // The record was not fully written
+            break;
+        }
+        if ( header.checksum != computeRecordChecksum(header, payload) ) {
+            break;
+        }
+        switch ( (CacheJournalRecordTypeEnum)header.type ) {
+        case eCacheJournalRecordTypeAdd: {
+            CacheJournal::Record r;
+            r.hash = header.hash;
+            r.location = header.location;
+            r.payload = payload;
+            r.payloadSize = header.payloadSize;
+            uncommittedByKey.insert( std::make_pair(std::make_pair(r.hash, r.location), records.size()) );
+            uncommitted.push_back( records.size() );
+            records.push_back(r);
+            removed.push_back(true);
+            cancelled.push_back(false);
+            ++nRecords;
+            break;
+        }
+        case eCacheJournalRecordTypeRemove: {
+            LiveRecordsMap::iterator found = live.find( std::make_pair(header.hash, header.location) );
+            if ( found != live.end() ) {
+                removed[found->second] = true;
+                live.erase(found);
+            }
+            // Cancels the first uncommitted addition of that entry, equal keys are kept in insertion order
+            UncommittedRecordsMap::iterator foundUncommitted = uncommittedByKey.find( std::make_pair(header.hash, header.location) );
+            if ( foundUncommitted != uncommittedByKey.end() ) {
+                cancelled[foundUncommitted->second] = true;
+                uncommittedByKey.erase(foundUncommitted);
+            }
+            ++nRecords;
+            break;
+        }
+        case eCacheJournalRecordTypeSync: {
+            uncommitted.erase( std::remove_if(uncommitted.begin(), uncommitted.end(), isCancelled), uncommitted.end() );
+            for (std::size_t i = 0; i < uncommitted.size(); ++i) {
+                const CacheJournal::Record& r = records[uncommitted[i]];
+                std::pair<LiveRecordsMap::iterator, bool> ok = live.insert( std::make_pair(std::make_pair(r.hash, r.location), uncommitted[i]) );
+                if (!ok.second) {
+                    // The same location was re-used: the previous entry is obsolete
+                    removed[ok.first->second] = true;
+                    ok.first->second = uncommitted[i];
+                }
+                removed[uncommitted[i]] = false;
+            }
+            uncommitted.clear();
+            uncommittedByKey.clear();
+            break;
+        }
+        case eCacheJournalRecordTypeRollback:
+            uncommitted.clear();
+            uncommittedByKey.clear();
+            break;
+        default:
+            // Unknown record, consider the file is corrupted from here
+            pos = size;
+            continue;
+        }
+        pos += sizeof(header) + header.payloadSize;
+        validEnd = pos;
+    }
+
+    restoredRecords.clear();
+    restoredRecords.reserve( live.size() );
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        if (!removed[i]) {
+            restoredRecords.push_back(records[i]);
+        }
+    }
+    nLiveRecords = restoredRecords.size();
+    uncommitted.erase( std::remove_if(uncommitted.begin(), uncommitted.end(), isCancelled), uncommitted.end() );
+    mustRollback = !uncommitted.empty();
+} // CacheJournalPrivate::scan
+
+void
+CacheJournalPrivate::writeFileHeader(QFile& f,
+                                     unsigned int cacheVersion)
+{
+    CacheJournalFileHeader header;
+
+    std::memset( &header, 0, sizeof(header) );
+    std::memcpy( header.magic, NATRON_CACHE_JOURNAL_MAGIC, sizeof(NATRON_CACHE_JOURNAL_MAGIC) );
+    header.formatVersion = NATRON_CACHE_JOURNAL_FORMAT_VERSION;
+    header.cacheVersion = cacheVersion;
+    if ( f.write( (const char*)&header, sizeof(header) ) != (qint64)sizeof(header) ) {
+        throw std::runtime_error( "Could not write the cache journal " + f.fileName().toStdString() );
+    }
+}
+
+void
+CacheJournalPrivate::writeRecord(QFile& f,
+                                 CacheJournalRecordTypeEnum type,
+                                 U64 hash,
+                                 U64 location,
+                                 const char* payload,
+                                 std::size_t payloadSize)
+{
+    if ( !f.isOpen() ) {
+        return;
+    }
+    CacheJournalRecordHeader header;
+    header.type = type;
+    header.payloadSize = (U32)payloadSize;
+    header.hash = hash;
+    header.location = location;
+    header.checksum = computeRecordChecksum(header, payload);
+
+    // Write the record with a single call, the file is unbuffered
+    std::string buf(sizeof(header) + payloadSize, '\0');
+    std::memcpy( &buf[0], &header, sizeof(header) );
+    if (payloadSize) {
+        std::memcpy(&buf[sizeof(header)], payload, payloadSize);
+    }
+    if ( f.write( buf.data(), (qint64)buf.size() ) != (qint64)buf.size() ) {
+        qDebug() << "Could not write to the cache journal" << f.fileName() << ":" << f.errorString();
+    }
+}
+
+void
+CacheJournalPrivate::flush(QFile& f)
+{
+    if ( !f.isOpen() ) {
+        return;
+    }
+    f.flush();
+#ifdef __NATRON_WIN32__
+    _commit( f.handle() );
+#else
+    ::fsync( f.handle() );
+#endif
+}
+
+void
+CacheJournalPrivate::unmap()
+{
+    if (mapping) {
+        file.unmap(mapping);
+        mapping = 0;
+    }
+    restoredRecords.clear();
+}
+
+CacheJournal::CacheJournal()
+    : _imp( new CacheJournalPrivate() )
+{
+}
+
+CacheJournal::~CacheJournal()
+{
+    close();
+}
+
+bool
+CacheJournal::open(const std::string& filePath,
+                   unsigned int cacheVersion)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->unmap();
+    _imp->file.close();
+    _imp->file.setFileName( QString::fromUtf8( filePath.c_str() ) );
+    if ( !_imp->file.open(QIODevice::ReadWrite | QIODevice::Unbuffered) ) {
+        throw std::runtime_error( "Could not open the cache journal " + filePath + ": " + _imp->file.errorString().toStdString() );
+    }
+
+    bool restored = false;
+    qint64 size = _imp->file.size();
+    if ( size >= (qint64)sizeof(CacheJournalFileHeader) ) {
+        _imp->mapping = _imp->file.map(0, size);
+        if (!_imp->mapping) {
+            throw std::runtime_error( "Could not map the cache journal " + filePath + ": " + _imp->file.errorString().toStdString() );
+        }
+        CacheJournalFileHeader header;
+        std::memcpy( &header, _imp->mapping, sizeof(header) );
+        if ( (std::memcmp( header.magic, NATRON_CACHE_JOURNAL_MAGIC, sizeof(NATRON_CACHE_JOURNAL_MAGIC) ) == 0) &&
+             (header.formatVersion == NATRON_CACHE_JOURNAL_FORMAT_VERSION) &&
+             (header.cacheVersion == cacheVersion) ) {
+            _imp->scan( (const char*)_imp->mapping, size );
+            restored = true;
+        } else {
+            _imp->unmap();
+        }
+    }
+
+    if (!restored) {
+        _imp->file.resize(0);
+        _imp->file.seek(0);
+        _imp->writeFileHeader(_imp->file, cacheVersion);
+        _imp->validEnd = sizeof(CacheJournalFileHeader);
+        _imp->mustRollback = false;
+        _imp->nRecords = 0;
+        _imp->nLiveRecords = 0;
+    }
+
+    return restored;
+} // CacheJournal::open
+
+void
+CacheJournal::close()
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->unmap();
+    _imp->file.close();
+}
+
+std::string
+CacheJournal::getFilePath() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->file.fileName().toStdString();
+}
+
+const std::vector<CacheJournal::Record>&
+CacheJournal::getRestoredRecords() const
+{
+    return _imp->restoredRecords;
+}
+
+void
+CacheJournal::finishRestore()
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->unmap();
+    if ( !_imp->file.isOpen() ) {
+        return;
+    }
+
+    // Drop any incomplete record at the end of the file
+    if ( _imp->file.size() != _imp->validEnd ) {
+        _imp->file.resize(_imp->validEnd);
+    }
+    _imp->file.seek(_imp->validEnd);
+    if (_imp->mustRollback) {
+        _imp->writeRecord(_imp->file, eCacheJournalRecordTypeRollback, 0, 0, 0, 0);
+        _imp->flush(_imp->file);
+        _imp->mustRollback = false;
+    }
+}
+
+void
+CacheJournal::appendAdd(U64 hash,
+                        U64 location,
+                        const char* payload,
+                        std::size_t payloadSize)
+{
+    QMutexLocker k(&_imp->lock);
+
+    assert(!_imp->mapping);
+    _imp->writeRecord(_imp->file, eCacheJournalRecordTypeAdd, hash, location, payload, payloadSize);
+    ++_imp->nRecords;
+    ++_imp->nLiveRecords;
+}
+
+void
+CacheJournal::appendRemove(U64 hash,
+                           U64 location)
+{
+    QMutexLocker k(&_imp->lock);
+
+    assert(!_imp->mapping);
+    _imp->writeRecord(_imp->file, eCacheJournalRecordTypeRemove, hash, location, 0, 0);
+    ++_imp->nRecords;
+    if (_imp->nLiveRecords > 0) {
+        --_imp->nLiveRecords;
+    }
+}
+
+void
+CacheJournal::sync()
+{
+    QMutexLocker k(&_imp->lock);
+
+    assert(!_imp->mapping);
+    _imp->writeRecord(_imp->file, eCacheJournalRecordTypeSync, 0, 0, 0, 0);
+    _imp->flush(_imp->file);
+}
+
+bool
+CacheJournal::needsCompaction() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->nRecords > 2 * _imp->nLiveRecords + NATRON_CACHE_JOURNAL_MIN_RECORDS_TO_COMPACT;
+}
+
+std::size_t
+CacheJournal::getLiveRecordsCount() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->nLiveRecords;
+}
+
+/**
+ * @brief Replaces the file at filePath by the file at tmpFilePath in a single step,
+ * so that a crash leaves either the old or the new journal, never none.
+ **/
+static bool
+replaceFile(const QString& tmpFilePath,
+            const QString& filePath)
+{
+#ifdef __NATRON_WIN32__
+    std::wstring tmpPath = StrUtils::utf8_to_utf16( tmpFilePath.toStdString() );
+    std::wstring path = StrUtils::utf8_to_utf16( filePath.toStdString() );
+
+    return ::MoveFileExW(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+
+    return std::rename( tmpFilePath.toStdString().c_str(), filePath.toStdString().c_str() ) == 0;
+#endif
+}
+
+void
+CacheJournal::rewrite(const std::vector<Record>& records)
+{
+    QMutexLocker k(&_imp->lock);
+    QString filePath = _imp->file.fileName();
+    QString tmpFilePath = filePath + QString::fromUtf8(".tmp");
+
+    // Read the cache version of the current journal before it is replaced
+    CacheJournalFileHeader header;
+    _imp->file.seek(0);
+    if ( _imp->file.read( (char*)&header, sizeof(header) ) != (qint64)sizeof(header) ) {
+        throw std::runtime_error( "Could not read the cache journal " + filePath.toStdString() );
+    }
+
+    {
+        QFile tmpFile(tmpFilePath);
+        if ( !tmpFile.open(QIODevice::WriteOnly | QIODevice::Truncate) ) {
+            throw std::runtime_error( "Could not write the cache journal " + tmpFilePath.toStdString() );
+        }
+        _imp->writeFileHeader(tmpFile, header.cacheVersion);
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            _imp->writeRecord(tmpFile, eCacheJournalRecordTypeAdd, records[i].hash, records[i].location, records[i].payload, records[i].payloadSize);
+        }
+        _imp->writeRecord(tmpFile, eCacheJournalRecordTypeSync, 0, 0, 0, 0);
+        _imp->flush(tmpFile);
+    }
+
+    // The records may point into the mapping, release it only now
+    _imp->unmap();
+    _imp->file.close();
+    if ( !replaceFile(tmpFilePath, filePath) ) {
+        throw std::runtime_error( "Could not replace the cache journal " + filePath.toStdString() );
+    }
+    if ( !_imp->file.open(QIODevice::ReadWrite | QIODevice::Unbuffered) ) {
+        throw std::runtime_error( "Could not open the cache journal " + filePath.toStdString() );
+    }
+    _imp->validEnd = _imp->file.size();
+    _imp->file.seek(_imp->validEnd);
+    _imp->mustRollback = false;
+    _imp->nRecords = records.size();
+    _imp->nLiveRecords = records.size();
+} // CacheJournal::rewrite
+
+U64
+CacheJournal::getEntryLocation(const std::string& filePath,
+                               std::size_t dataOffset)
+{
+    U64 offset = dataOffset;
+    U64 hash = hashBytes( 0xcbf29ce484222325ULL, filePath.data(), filePath.size() );
+
+    return hashBytes( hash, (const char*)&offset, sizeof(offset) );
+}
+
+NATRON_NAMESPACE_EXIT
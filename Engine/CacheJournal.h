@@ -0,0 +1,170 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_CacheJournal_h
+#define Natron_Engine_CacheJournal_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+// The journal is compacted when it holds more than this many records on top of twice the live ones
+#define NATRON_CACHE_JOURNAL_MIN_RECORDS_TO_COMPACT 4096
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief A read-only std::streambuf over a block of memory, used to decode the records of the journal
+ * directly from the file mapping without copying them.
+ **/
+class CacheJournalStreamBuf
+    : public std::streambuf
+{
+public:
+
+    CacheJournalStreamBuf(const char* data,
+                          std::size_t size)
+    {
+        char* p = const_cast<char*>(data);
+
+        setg(p, p, p + size);
+    }
+};
+
+/**
+ * @brief The persistent table of contents of a disk cache.
+ * Instead of serializing the whole table of contents when quitting, the cache appends a record to this
+ * file whenever an entry enters or leaves its disk portion. A record is a fixed size header (type, entry hash,
+ * location of the data and checksum) followed by the serialized entry for additions.
+ * Additions only become valid once a sync point is written (see sync()), so that an entry is never restored
+ * before its data was flushed to its backing file.
+ * When opening, the file is mapped in memory and scanned once: the scan stops at the first incomplete or corrupted
+ * record, so that a crash only loses the entries added since the last sync point.
+ * This class is MT-safe.
+ **/
+struct CacheJournalPrivate;
+class CacheJournal
+{
+public:
+
+    /**
+     * @brief A live entry of the journal. When returned by getRestoredRecords() the payload points into the file
+     * mapping and remains valid until finishRestore() is called.
+     **/
+    struct Record
+    {
+        U64 hash;
+        U64 location;
+        const char* payload;
+        std::size_t payloadSize;
+    };
+
+    CacheJournal();
+
+    ~CacheJournal();
+
+    /**
+     * @brief Opens the journal at the given path, creating it if needed, and scans its records.
+     * Returns true if an existing journal written for the same cache version was found, in which case its live
+     * records can be retrieved with getRestoredRecords().
+     * Returns false if the journal was created, or if it was written by another cache version or its header is
+     * corrupted, in which case it is emptied and the cache files it referenced should be removed.
+     * This function throws an exception if the file cannot be opened.
+     **/
+    bool open(const std::string& filePath, unsigned int cacheVersion);
+
+    /**
+     * @brief Closes the file. Records appended after this call are ignored.
+     **/
+    void close();
+
+    std::string getFilePath() const;
+
+    /**
+     * @brief Returns the live records found by open(), that is the additions committed by a sync point
+     * which were not removed afterwards, in the order they were added.
+     **/
+    const std::vector<Record>& getRestoredRecords() const;
+
+    /**
+     * @brief Releases the file mapping and discards any incomplete record at the end of the file.
+     * Must be called once the restored records are no longer used and before appending new records.
+     **/
+    void finishRestore();
+
+    /**
+     * @brief Appends a record adding an entry. It becomes valid at the next sync().
+     **/
+    void appendAdd(U64 hash, U64 location, const char* payload, std::size_t payloadSize);
+
+    /**
+     * @brief Appends a record removing the entry previously added with the same hash and location.
+     **/
+    void appendRemove(U64 hash, U64 location);
+
+    /**
+     * @brief Appends a sync point, committing all additions appended before, and flushes the file to the disk.
+     **/
+    void sync();
+
+    /**
+     * @brief Returns true if most of the records of the file are obsolete and the journal should be rewritten
+     * with rewrite().
+     **/
+    bool needsCompaction() const;
+
+    /**
+     * @brief Replaces the content of the journal with the given additions, followed by a sync point.
+     * The file is written next to the journal and renamed over it, so that a crash during the rewrite keeps the
+     * previous journal.
+     **/
+    void rewrite(const std::vector<Record>& records);
+
+    /**
+     * @brief Returns the number of live records, as counted by the additions and removals appended so far.
+     **/
+    std::size_t getLiveRecordsCount() const;
+
+    /**
+     * @brief Returns an identifier of the place where the data of an entry is stored, used to tell apart
+     * entries that share the same hash.
+     **/
+    static U64 getEntryLocation(const std::string& filePath, std::size_t dataOffset);
+
+private:
+
+    std::unique_ptr<CacheJournalPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_CacheJournal_h
@@ -28,8 +28,13 @@
 
 #include "Global/Macros.h"
 
+#include <istream>
 #include <list>
+#include <map>
 #include <set>
+#include <sstream> // ostringstream
+#include <string>
+#include <vector>
 #include <cstddef>
 #include <stdexcept>
 
@@ -51,7 +56,10 @@ GCC_DIAG_ON(unused-parameter)
 // clang-format on
 #endif
 
+#include <QtCore/QFileInfo>
+
 #include "Engine/Cache.h"
+#include "Engine/CacheJournal.h"
 #include "Engine/ImageSerialization.h"
 #include "Engine/ImageParamsSerialization.h"
 #include "Engine/FrameEntrySerialization.h"
@@ -70,57 +78,140 @@ GCC_DIAG_ON(unused-parameter)
 
 NATRON_NAMESPACE_ENTER
 
-/*Saves cache to disk as a settings file.
- */
+// Serializes an entry of the disk portion as the payload of a journal record
+template<typename EntryType>
+std::string
+Cache<EntryType>::serializeEntryForJournal(const EntryType& entry) const
+{
+    SerializedEntry serialization;
+
+    serialization.hash = entry.getHashKey();
+    serialization.params = entry.getParams();
+    serialization.key = entry.getKey();
+    serialization.size = entry.dataSize();
+    serialization.filePath = entry.getFilePath();
+    serialization.dataOffsetInFile = entry.getOffsetInFile();
+#ifdef DEBUG
+    if ( !_isTiled && !CacheAPI::checkFileNameMatchesHash(serialization.filePath, serialization.hash) ) {
+        qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
+    }
+#endif
+
+    std::ostringstream ss;
+    {
+        boost::archive::binary_oarchive oArchive(ss, boost::archive::no_header);
+        oArchive << serialization;
+    }
+
+    return ss.str();
+}
+
 template<typename EntryType>
 void
-Cache<EntryType>::save(CacheTOC* tableOfContents)
+Cache<EntryType>::syncJournal()
 {
     clearInMemoryPortion(false);
+
+    CacheJournalPtr journal;
     {
-        QMutexLocker l(&_lock);     // must be locked
-
-        for (ConstCacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
-            const std::list<EntryTypePtr> & listOfValues  = getValueFromIterator(it);
-            for (typename std::list<EntryTypePtr>::const_iterator it2 = listOfValues.begin(); it2 != listOfValues.end(); ++it2) {
-                if ( (*it2)->isStoredOnDisk() ) {
-                    SerializedEntry serialization;
-                    serialization.hash = (*it2)->getHashKey();
-                    serialization.params = (*it2)->getParams();
-                    serialization.key = (*it2)->getKey();
-                    serialization.size = (*it2)->dataSize();
-                    serialization.filePath = (*it2)->getFilePath();
-                    serialization.dataOffsetInFile = (*it2)->getOffsetInFile();
-
-                    (*it2)->syncBackingFile();
-                    
-                    tableOfContents->push_back(serialization);
-#ifdef DEBUG
-                    if ( !_isTiled && !CacheAPI::checkFileNameMatchesHash(serialization.filePath, serialization.hash) ) {
-                        qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
+        QMutexLocker k(&_journalMutex);
+        journal = _journal;
+    }
+    if (!journal) {
+        return;
+    }
+
+    if ( journal->needsCompaction() ) {
+        // Most records of the journal are obsolete: rewrite it from the disk portion.
+        // All shards are locked, in order and before the journal lock like everywhere else, so that no entry
+        // enters or leaves the disk portion meanwhile.
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            _shards[i]->lock.lock();
+        }
+        {
+            QMutexLocker k(&_journalMutex);
+            std::list<std::string> payloads;
+            std::vector<CacheJournal::Record> records;
+            for (std::size_t i = 0; i < _shards.size(); ++i) {
+                Shard& shard = *_shards[i];
+                for (ConstCacheIterator it = shard.diskCache.begin(); it != shard.diskCache.end(); ++it) {
+                    const std::list<EntryTypePtr> & listOfValues  = getValueFromIterator(it);
+                    for (typename std::list<EntryTypePtr>::const_iterator it2 = listOfValues.begin(); it2 != listOfValues.end(); ++it2) {
+                        // A tile is only written once its memory was allocated
+                        if ( !(*it2)->isStoredOnDisk() || (*it2)->getFilePath().empty() ) {
+                            continue;
+                        }
+                        (*it2)->syncBackingFile();
+                        payloads.push_back( serializeEntryForJournal(**it2) );
+                        CacheJournal::Record r;
+                        r.hash = (*it2)->getHashKey();
+                        r.location = CacheJournal::getEntryLocation( (*it2)->getFilePath(), (*it2)->getOffsetInFile() );
+                        r.payload = payloads.back().data();
+                        r.payloadSize = payloads.back().size();
+                        records.push_back(r);
+                        _journalPendingEntries.erase( it2->get() );
                     }
-#endif
                 }
             }
+            try {
+                journal->rewrite(records);
+            } catch (const std::exception & e) {
+                qDebug() << "Failed to compact the cache journal:" << e.what();
+            }
+        }
+        for (std::size_t i = 0; i < _shards.size(); ++i) {
+            _shards[i]->lock.unlock();
         }
+
+        return;
     }
-}
+
+    QMutexLocker k(&_journalMutex);
+    for (typename std::map<const EntryType*, std::weak_ptr<EntryType> >::iterator it = _journalPendingEntries.begin(); it != _journalPendingEntries.end();) {
+        EntryTypePtr entry = it->second.lock();
+        if (!entry) {
+            _journalPendingEntries.erase(it++);
+            continue;
+        }
+        // A tile is only written once its memory was allocated
+        if ( !entry->isStoredOnDisk() || entry->getFilePath().empty() ) {
+            ++it;
+            continue;
+        }
+        entry->syncBackingFile();
+        std::string payload = serializeEntryForJournal(*entry);
+        journal->appendAdd( entry->getHashKey(), CacheJournal::getEntryLocation( entry->getFilePath(), entry->getOffsetInFile() ), payload.data(), payload.size() );
+        _journalPendingEntries.erase(it++);
+    }
+    journal->sync();
+} // syncJournal
 
 /*Restores the cache from disk.*/
 template<typename EntryType>
 void
-Cache<EntryType>::restore(const CacheTOC & tableOfContents)
+Cache<EntryType>::restore(const CacheJournalPtr& journal)
 {
-    ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
-    ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
-    std::list<EntryTypePtr> entriesToBeDeleted;
+    const std::vector<CacheJournal::Record>& records = journal->getRestoredRecords();
+    std::vector<CacheJournal::Record> restoredRecords;
+    restoredRecords.reserve( records.size() );
 
     std::set<QString> usedFilePaths;
-    for (typename CacheTOC::const_iterator it =
-             tableOfContents.begin(); it != tableOfContents.end(); ++it) {
-        if ( it->hash != it->key.getHash() ) {
+    usedFilePaths.insert( QFileInfo( QString::fromUtf8( journal->getFilePath().c_str() ) ).absoluteFilePath() );
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        // Decode the entry directly from the file mapping
+        SerializedEntry serialization;
+        try {
+            CacheJournalStreamBuf buf(records[i].payload, records[i].payloadSize);
+            std::istream is(&buf);
+            boost::archive::binary_iarchive iArchive(is, boost::archive::no_header);
+            iArchive >> serialization;
+        } catch (const std::exception & e) {
+            qDebug() << "Failed to read a cache journal record:" << e.what();
+            continue;
+        }
+        if ( serialization.hash != serialization.key.getHash() ) {
             /*
-             * If this warning is printed this means that the value computed by it->key()
+             * If this warning is printed this means that the value computed by serialization.key.getHash()
              * is different than the value stored prior to serialiazing this entry. In other words there're
              * 2 possibilities:
              * 1) The key has changed since it has been added to the cache: maybe you forgot to serialize some
@@ -132,7 +223,7 @@ Cache<EntryType>::restore(const CacheTOC & tableOfContents)
         }
 
 #ifdef DEBUG
-        if ( !_isTiled && !checkFileNameMatchesHash(it->filePath, it->hash) ) {
+        if ( !_isTiled && !checkFileNameMatchesHash(serialization.filePath, serialization.hash) ) {
             qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
         }
 #endif
@@ -140,13 +231,13 @@ Cache<EntryType>::restore(const CacheTOC & tableOfContents)
         EntryType* value = NULL;
 
         try {
-            value = new EntryType(it->key, it->params, this);
-            if (it->size != getTileSizeBytes()) {
+            value = new EntryType(serialization.key, serialization.params, this);
+            if (serialization.size != getTileSizeBytes()) {
                 delete value;
                 continue;
             }
             ///This will not put the entry back into RAM, instead we just insert back the entry into the disk cache
-            value->restoreMetadataFromFile(it->size, it->filePath, it->dataOffsetInFile);
+            value->restoreMetadataFromFile(serialization.size, serialization.filePath, serialization.dataOffsetInFile);
         } catch (const std::exception & e) {
             qDebug() << e.what();
             delete value;
@@ -155,10 +246,24 @@ Cache<EntryType>::restore(const CacheTOC & tableOfContents)
         const std::string& filePath = value->getFilePath();
         usedFilePaths.insert(QString::fromUtf8(filePath.c_str()));
         {
-            QMutexLocker locker(&_lock);
-            sealEntry(EntryTypePtr(value), false /*inMemory*/);
+            Shard& shard = getShard( value->getHashKey() );
+            QMutexLocker locker(&shard.lock);
+            sealEntry(shard, EntryTypePtr(value), false /*inMemory*/);
+        }
+        restoredRecords.push_back(records[i]);
+    }
+
+    // Drop the records of the entries that could not be restored and the obsolete records.
+    // This must be done before finishRestore() since the records point into the file mapping.
+    if ( ( restoredRecords.size() != records.size() ) || journal->needsCompaction() ) {
+        try {
+            journal->rewrite(restoredRecords);
+        } catch (const std::exception & e) {
+            qDebug() << "Failed to compact the cache journal:" << e.what();
         }
     }
+    journal->finishRestore();
+    setJournal(journal);
 
     // Remove from the cache all files that are not referenced by the table of contents
     QString cachePath = getCachePath();
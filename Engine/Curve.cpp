@@ -33,6 +33,7 @@
 #include "Engine/AppManager.h"
 
 #include "Engine/CurvePrivate.h"
+#include "Engine/Hash64.h"
 #include "Engine/Interpolation.h"
 #include "Engine/KnobTypes.h"
 #include "Engine/KnobFile.h"
@@ -286,8 +287,24 @@ Curve::Curve(KnobI *owner,
 }
 
 Curve::Curve(const Curve & other)
-    : _imp( new CurvePrivate(*other._imp) )
+    : _imp(new CurvePrivate)
 {
+    QMutexLocker l(&other._imp->_lock);
+    *_imp = *other._imp;
+    // the copy may be evaluated by getValueAtUnlocked()
+    _imp->ensureFlatKeyFrames();
+}
+
+CurvePtr
+Curve::getReadOnlyCopy() const
+{
+    QMutexLocker l(&_imp->_lock);
+
+    if (!_imp->readOnlyCopy) {
+        _imp->readOnlyCopy = std::make_shared<Curve>(*this);
+    }
+
+    return _imp->readOnlyCopy;
 }
 
 Curve::~Curve()
@@ -301,6 +318,7 @@ Curve::setPeriodic(bool periodic)
     QMutexLocker k(&_imp->_lock);
     _imp->isPeriodic = periodic;
     _imp->keyFrames.clear();
+    _imp->invalidateFlatKeyFrames();
 }
 
 bool
@@ -321,6 +339,7 @@ Curve::clearKeyFrames()
     QMutexLocker l(&_imp->_lock);
 
     _imp->keyFrames.clear();
+    _imp->invalidateFlatKeyFrames();
 }
 
 bool
@@ -441,6 +460,7 @@ Curve::addKeyFrame(KeyFrame key)
 std::pair<KeyFrameSet::iterator, bool> Curve::addKeyFrameNoUpdate(const KeyFrame & cp)
 {
     // PRIVATE - should not lock
+    _imp->invalidateFlatKeyFrames();
     if (!_imp->isParametric) { //< if keyframes are clamped to integers
         std::pair<KeyFrameSet::iterator, bool> newKey = _imp->keyFrames.insert(cp);
         // keyframe at this time exists, erase and insert again
@@ -780,15 +800,54 @@ Curve::getKeyFrameWithTime(double time,
     return true;
 }
 
+/// the first keyframe with time > t
+static KeyFrameSet::const_iterator
+keyFramesUpperBound(const KeyFrameSet &keyFrames,
+                    double t)
+{
+    return keyFrames.upper_bound( KeyFrame(t, 0.) );
+}
+
+static std::vector<KeyFrame>::const_iterator
+keyFramesUpperBound(const std::vector<KeyFrame> &keyFrames,
+                    double t)
+{
+    return std::upper_bound( keyFrames.begin(), keyFrames.end(), KeyFrame(t, 0.), KeyFrame_compare_time() );
+}
+
+/// Same as keyFramesUpperBound(), but first checks the interval of the previous evaluation, whose index is in hint:
+/// the times evaluated in a batch are usually increasing.
+static std::vector<KeyFrame>::const_iterator
+keyFramesUpperBoundWithHint(const std::vector<KeyFrame> &keyFrames,
+                            double t,
+                            int* hint)
+{
+    int nKeys = (int)keyFrames.size();
+    int i = *hint;
+
+    for (int j = 0; j < 2 && i <= nKeys; ++j, ++i) {
+        if ( ( (i == nKeys) || (t < keyFrames[i].getTime()) ) && ( (i == 0) || (keyFrames[i - 1].getTime() <= t) ) ) {
+            *hint = i;
+
+            return keyFrames.begin() + i;
+        }
+    }
+    std::vector<KeyFrame>::const_iterator ret = keyFramesUpperBound(keyFrames, t);
+    *hint = (int)( ret - keyFrames.begin() );
+
+    return ret;
+}
+
 /// compute interpolation parameters from keyframes and an iterator
 /// to the next keyframe (the first with time > t)
+template <typename KeyFrames>
 static void
-interParams(const KeyFrameSet &keyFrames,
+interParams(const KeyFrames &keyFrames,
             bool isPeriodic,
             double xMin,
             double xMax,
             double *t,
-            KeyFrameSet::const_iterator itup,
+            typename KeyFrames::const_iterator itup,
             double *tcur,
             double *vcur,
             double *vcurDerivRight,
@@ -814,7 +873,7 @@ interParams(const KeyFrameSet &keyFrames,
             }
             assert(*t >= minKeyFrameX && *t <= minKeyFrameX + period);
         }
-        itup = keyFrames.upper_bound(KeyFrame(*t, 0.));
+        itup = keyFramesUpperBound(keyFrames, *t);
     }
     if ( itup == keyFrames.begin() ) {
         // We are in the case where all keys have a greater time
@@ -824,7 +883,7 @@ interParams(const KeyFrameSet &keyFrames,
             *vnext = itup->getValue();
             *vnextDerivLeft = itup->getLeftDerivative();
             *interpNext = itup->getInterpolation();
-            KeyFrameSet::const_reverse_iterator last =  keyFrames.rbegin();
+            typename KeyFrames::const_reverse_iterator last =  keyFrames.rbegin();
             *tcur = last->getTime() - period;
             *vcur = last->getValue();
             *vcurDerivRight = last->getRightDerivative();
@@ -845,8 +904,8 @@ interParams(const KeyFrameSet &keyFrames,
         // We are in the case where no key has a greater time
         // If periodic, we are in-between the last keyframe and xMax
         if (isPeriodic) {
-            KeyFrameSet::const_iterator next = keyFrames.begin();
-            KeyFrameSet::const_reverse_iterator prev = keyFrames.rbegin();
+            typename KeyFrames::const_iterator next = keyFrames.begin();
+            typename KeyFrames::const_reverse_iterator prev = keyFrames.rbegin();
             *tcur = prev->getTime();
             *vcur = prev->getValue();
             *vcurDerivRight = prev->getRightDerivative();
@@ -857,7 +916,7 @@ interParams(const KeyFrameSet &keyFrames,
             *interpNext = next->getInterpolation();
         } else {
 
-            KeyFrameSet::const_reverse_iterator itlast = keyFrames.rbegin();
+            typename KeyFrames::const_reverse_iterator itlast = keyFrames.rbegin();
             *tcur = itlast->getTime();
             *vcur = itlast->getValue();
             *vcurDerivRight = itlast->getRightDerivative();
@@ -871,7 +930,7 @@ interParams(const KeyFrameSet &keyFrames,
     } else {
         // between two keyframes
         // get the last keyframe with time <= t
-        KeyFrameSet::const_iterator itcur = itup;
+        typename KeyFrames::const_iterator itcur = itup;
         --itcur;
         assert(itcur->getTime() <= *t);
         *tcur = itcur->getTime();
@@ -891,6 +950,27 @@ Curve::getValueAt(double t,
 {
     QMutexLocker l(&_imp->_lock);
 
+    return getValueAtInternal(t, doClamp);
+}
+
+double
+Curve::getValueAtUnlocked(double t) const
+{
+#ifdef NATRON_CURVE_USE_CACHE
+    // the evaluation modifies the cache of results
+    QMutexLocker l(&_imp->_lock);
+#endif
+    // the copy constructor built the array of keyframes
+    assert(_imp->flatKeyFramesValid || _imp->keyFrames.empty());
+
+    return getValueAtInternal(t, false);
+}
+
+double
+Curve::getValueAtInternal(double t,
+                          bool doClamp) const
+{
+    // PRIVATE - should not lock
     if ( _imp->keyFrames.empty() ) {
         //throw std::runtime_error("Curve has no control points!");
 
@@ -911,40 +991,7 @@ Curve::getValueAt(double t,
     } else
 #endif
     {
-        // even when there is only one keyframe, there may be tangents!
-        //if (_imp->keyFrames.size() == 1) {
-        //    //if there's only 1 keyframe, don't bother interpolating
-        //    return (*_imp->keyFrames.begin()).getValue();
-        //}
-        double tcur, tnext;
-        double vcurDerivRight, vnextDerivLeft, vcur, vnext;
-        KeyframeTypeEnum interp, interpNext;
-        KeyFrame k(t, 0.);
-        // find the first keyframe with time greater than t
-        KeyFrameSet::const_iterator itup;
-        itup = _imp->keyFrames.upper_bound(k);
-        interParams(_imp->keyFrames,
-                    _imp->isPeriodic,
-                    _imp->xMin,
-                    _imp->xMax,
-                    &t,
-                    itup,
-                    &tcur,
-                    &vcur,
-                    &vcurDerivRight,
-                    &interp,
-                    &tnext,
-                    &vnext,
-                    &vnextDerivLeft,
-                    &interpNext);
-
-        v = Interpolation::interpolate(tcur, vcur,
-                                       vcurDerivRight,
-                                       vnextDerivLeft,
-                                       tnext, vnext,
-                                       t,
-                                       interp,
-                                       interpNext);
+        v = interpolateAt(t, NULL);
 #ifdef NATRON_CURVE_USE_CACHE
         _imp->resultCache[t] = v;
 #endif
@@ -954,6 +1001,57 @@ Curve::getValueAt(double t,
         v = clampValueToCurveYRange(v);
     }
 
+    return roundToCurveType(v);
+} // getValueAtInternal
+
+double
+Curve::interpolateAt(double t,
+                     int* hint) const
+{
+    // PRIVATE - should not lock
+    assert( !_imp->keyFrames.empty() );
+    _imp->ensureFlatKeyFrames();
+    const std::vector<KeyFrame>& keyFrames = _imp->flatKeyFrames;
+
+    // even when there is only one keyframe, there may be tangents!
+    //if (_imp->keyFrames.size() == 1) {
+    //    //if there's only 1 keyframe, don't bother interpolating
+    //    return (*_imp->keyFrames.begin()).getValue();
+    //}
+    double tcur, tnext;
+    double vcurDerivRight, vnextDerivLeft, vcur, vnext;
+    KeyframeTypeEnum interp, interpNext;
+    // find the first keyframe with time greater than t
+    std::vector<KeyFrame>::const_iterator itup;
+    itup = hint ? keyFramesUpperBoundWithHint(keyFrames, t, hint) : keyFramesUpperBound(keyFrames, t);
+    interParams(keyFrames,
+                _imp->isPeriodic,
+                _imp->xMin,
+                _imp->xMax,
+                &t,
+                itup,
+                &tcur,
+                &vcur,
+                &vcurDerivRight,
+                &interp,
+                &tnext,
+                &vnext,
+                &vnextDerivLeft,
+                &interpNext);
+
+    return Interpolation::interpolate(tcur, vcur,
+                                      vcurDerivRight,
+                                      vnextDerivLeft,
+                                      tnext, vnext,
+                                      t,
+                                      interp,
+                                      interpNext);
+}
+
+double
+Curve::roundToCurveType(double v) const
+{
+    // PRIVATE - should not lock
     switch (_imp->type) {
     case CurvePrivate::eCurveTypeString:
     case CurvePrivate::eCurveTypeInt:
@@ -969,7 +1067,38 @@ Curve::getValueAt(double t,
 
         return v;
     }
-} // getValueAt
+}
+
+void
+Curve::getValuesAt(const double* times,
+                   int count,
+                   double* values,
+                   bool doClamp) const
+{
+    QMutexLocker l(&_imp->_lock);
+
+    if ( _imp->keyFrames.empty() ) {
+        std::fill(values, values + count, 0.);
+
+        return;
+    }
+
+    bool clamp = doClamp && mustClamp();
+    YRange range = clamp ? getCurveYRange() : YRange(0., 0.);
+    int hint = 0;
+    for (int i = 0; i < count; ++i) {
+        double v = interpolateAt(times[i], &hint);
+        if (clamp) {
+            // same as clampValueToCurveYRange()
+            if (v > range.max) {
+                v = range.max;
+            } else if (v < range.min) {
+                v = range.min;
+            }
+        }
+        values[i] = roundToCurveType(v);
+    }
+}
 
 double
 Curve::getDerivativeAt(double t) const
@@ -1249,6 +1378,7 @@ Curve::setXRange(double a,
 
     _imp->xMin = a;
     _imp->xMax = b;
+    _imp->readOnlyCopy.reset();
 }
 
 std::pair<double, double> Curve::getXRange() const
@@ -1274,6 +1404,22 @@ Curve::getKeyFrames_mt_safe() const
     return _imp->keyFrames;
 }
 
+void
+Curve::appendToHash(Hash64* hash) const
+{
+    QMutexLocker l(&_imp->_lock);
+
+    hash->append( (U64)_imp->keyFrames.size() );
+    hash->append(_imp->isPeriodic);
+    for (KeyFrameSet::const_iterator it = _imp->keyFrames.begin(); it != _imp->keyFrames.end(); ++it) {
+        hash->append( it->getTime() );
+        hash->append( it->getValue() );
+        hash->append( (int)it->getInterpolation() );
+        hash->append( it->getLeftDerivative() );
+        hash->append( it->getRightDerivative() );
+    }
+}
+
 KeyFrameSet::iterator
 Curve::setKeyFrameValueAndTimeNoUpdate(double value,
                                        double time,
@@ -1648,6 +1794,7 @@ Curve::refreshDerivatives(Curve::CurveChangedReasonEnum reason,
     newKey.setLeftDerivative(vcurDerivLeft);
     newKey.setRightDerivative(vcurDerivRight);
 
+    _imp->invalidateFlatKeyFrames();
     std::pair<KeyFrameSet::iterator, bool> newKeyIt = _imp->keyFrames.insert(newKey);
 
     // keyframe at this time exists, erase and insert again
@@ -1814,6 +1961,7 @@ Curve::setYRange(double yMin,
 
     _imp->yMin = yMin;
     _imp->yMax = yMax;
+    _imp->readOnlyCopy.reset();
 }
 
 bool
@@ -1827,6 +1975,7 @@ void
 Curve::onCurveChanged()
 {
     // PRIVATE - should not lock
+    _imp->invalidateFlatKeyFrames();
     if (_imp->owner) {
         _imp->owner->clearExpressionsResults(_imp->dimensionInOwner);
     }
@@ -251,12 +251,35 @@ public:
      */
     double getValueAt(double t, bool clamp = true) const WARN_UNUSED_RETURN;
 
+    /**
+     * @brief Same as getValueAt(t, false) but does not lock the curve: only call it on a curve which is not modified
+     * anymore, such as the copies held by KnobValuesSnapshot.
+     **/
+    double getValueAtUnlocked(double t) const WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Returns a copy of this curve which is never modified, to be evaluated with getValueAtUnlocked().
+     * The copy is made once and shared by all the callers until this curve changes.
+     **/
+    CurvePtr getReadOnlyCopy() const WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Same as getValueAt() for count times, locking the curve once. The evaluation is faster if the times are
+     * increasing.
+     **/
+    void getValuesAt(const double* times, int count, double* values, bool clamp = true) const;
+
     double getDerivativeAt(double t) const WARN_UNUSED_RETURN;
 
     double getIntegrateFromTo(double t1, double t2) const WARN_UNUSED_RETURN;
 
     KeyFrameSet getKeyFrames_mt_safe() const WARN_UNUSED_RETURN;
 
+    /**
+     * @brief Appends the keyframes (time, value, interpolation and derivatives) of the curve to the hash.
+     **/
+    void appendToHash(Hash64* hash) const;
+
     void clearKeyFrames();
 
     /**
@@ -368,6 +391,16 @@ private:
 
     double clampValueToCurveYRange(double v) const WARN_UNUSED_RETURN;
 
+    double getValueAtInternal(double t, bool doClamp) const WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Interpolates the keyframes at t, without clamping nor rounding. If hint is not NULL, it is the index of
+     * the keyframe found by the previous call and is updated.
+     **/
+    double interpolateAt(double t, int* hint) const WARN_UNUSED_RETURN;
+
+    double roundToCurveType(double v) const WARN_UNUSED_RETURN;
+
     void setKeyframesInternal(const KeyFrameSet& keys, bool refreshDerivatives);
 
     ///returns an iterator to the new keyframe in the keyframe set and
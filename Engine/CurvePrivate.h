@@ -28,6 +28,8 @@
 
 #include "Global/Macros.h"
 
+#include <vector>
+
 #include <QtCore/QMutex>
 #include <QtCore/QRecursiveMutex>
 
@@ -55,6 +57,13 @@ struct CurvePrivate
 
     KeyFrameSet keyFrames;
 
+    // keyFrames as a sorted array, searched by the evaluation: rebuilt by the first evaluation after the keyframes changed
+    std::vector<KeyFrame> flatKeyFrames;
+    bool flatKeyFramesValid;
+
+    // A copy of the curve which is never modified, shared by the renders until the curve changes: see getReadOnlyCopy()
+    CurvePtr readOnlyCopy;
+
 #ifdef NATRON_CURVE_USE_CACHE
     std::map<double, double> resultCache; //< a cache for interpolations
 #endif
@@ -71,6 +80,9 @@ struct CurvePrivate
 
     CurvePrivate()
         : keyFrames()
+        , flatKeyFrames()
+        , flatKeyFramesValid(false)
+        , readOnlyCopy()
 #ifdef NATRON_CURVE_USE_CACHE
         , resultCache()
 #endif
@@ -96,6 +108,8 @@ struct CurvePrivate
     void operator=(const CurvePrivate & other)
     {
         keyFrames = other.keyFrames;
+        flatKeyFramesValid = false;
+        readOnlyCopy.reset();
         owner = other.owner;
         dimensionInOwner = other.dimensionInOwner;
         isParametric = other.isParametric;
@@ -107,7 +121,20 @@ struct CurvePrivate
         isPeriodic = other.isPeriodic;
     }
 
-    
+    void invalidateFlatKeyFrames()
+    {
+        flatKeyFramesValid = false;
+        readOnlyCopy.reset();
+    }
+
+    // Should be locked
+    void ensureFlatKeyFrames()
+    {
+        if (!flatKeyFramesValid) {
+            flatKeyFrames.assign( keyFrames.begin(), keyFrames.end() );
+            flatKeyFramesValid = true;
+        }
+    }
 };
 
 NATRON_NAMESPACE_EXIT
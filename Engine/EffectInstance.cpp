@@ -52,6 +52,7 @@
 #include "Engine/ImageParams.h"
 #include "Engine/KnobFile.h"
 #include "Engine/KnobTypes.h"
+#include "Engine/KnobValuesSnapshot.h"
 #include "Engine/Log.h"
 #include "Engine/MemoryInfo.h" // printAsRAM
 #include "Engine/Node.h"
@@ -64,6 +65,7 @@
 #include "Engine/PluginMemory.h"
 #include "Engine/Project.h"
 #include "Engine/RenderStats.h"
+#include "Engine/RenderTrace.h"
 #include "Engine/RotoContext.h"
 #include "Engine/RotoDrawableItem.h"
 #include "Engine/ReadNode.h"
@@ -318,6 +320,17 @@ EffectInstance::setParallelRenderArgsTLS(double time,
     args->tilesSupported = getNode()->getCurrentSupportTiles();
     args->stats = stats;
     args->openGLContext = glContext;
+    // Analysis renders may set the values they read, e.g. the tracks of the tracker
+    if (!isAnalysis) {
+        // The knobs are only copied when the node hash changed since the previous render: during playback each frame
+        // reuses the snapshot of the first one, the animation curves it holds are valid at any time
+        QMutexLocker k(&_imp->knobsSnapshotMutex);
+        if ( !_imp->knobsSnapshot || (args->nodeHash == 0) || (args->nodeHash != _imp->knobsSnapshotHash) ) {
+            _imp->knobsSnapshot = KnobValuesSnapshot::create( getKnobs_mt_safe() );
+            _imp->knobsSnapshotHash = args->nodeHash;
+        }
+        args->knobsSnapshot = _imp->knobsSnapshot;
+    }
     argsList.push_back(args);
 }
 
@@ -1628,6 +1641,7 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool /*useCache*/,
                                                     const OSGLContextAttacherPtr& glContextAttacher,
                                                     ImagePtr* image)
 {
+    RenderTraceSpan traceSpan("cacheLookup", "cache", this);
     ImageList cachedImages;
     bool isCached = false;
 
@@ -1664,6 +1678,9 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool /*useCache*/,
         ///A ptr to a higher resolution of the image or an image with different comps/bitdepth
         ImagePtr imageToConvert;
 
+        ///Float images are cached as half floats when the user chose so in the preferences
+        const bool acceptHalfForFloat = bitdepth == eImageBitDepthFloat && appPTR->getCurrentSettings()->isNodeCacheHalfFloatEnabled();
+
         for (ImageList::iterator it = cachedImages.begin(); it != cachedImages.end(); ++it) {
             unsigned int imgMMlevel = (*it)->getMipmapLevel();
             const ImagePlaneDesc & imgComps = (*it)->getComponents();
@@ -1692,15 +1709,14 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool /*useCache*/,
             }*/
 
             bool convertible = (imgComps.isColorPlane() && components.isColorPlane()) || (imgComps == components);
-            if ( (imgMMlevel == mipmapLevel) && convertible &&
-                 ( getSizeOfForBitDepth(imgDepth) >= getSizeOfForBitDepth(bitdepth) ) /* && imgComps == components && imgDepth == bitdepth*/ ) {
+            bool deepEnough = ( getSizeOfForBitDepth(imgDepth) >= getSizeOfForBitDepth(bitdepth) ) || (acceptHalfForFloat && imgDepth == eImageBitDepthHalf);
+            if ( (imgMMlevel == mipmapLevel) && convertible && deepEnough /* && imgComps == components && imgDepth == bitdepth*/ ) {
                 ///We found  a matching image
 
                 *image = *it;
                 break;
             } else {
-                if ( (*it)->getStorageMode() != eStorageModeRAM || (imgMMlevel >= mipmapLevel) || !convertible ||
-                     ( getSizeOfForBitDepth(imgDepth) < getSizeOfForBitDepth(bitdepth) ) ) {
+                if ( (*it)->getStorageMode() != eStorageModeRAM || (imgMMlevel >= mipmapLevel) || !convertible || !deepEnough ) {
                     ///Either smaller resolution or not enough components or bit-depth is not as deep, don't use the image
                     continue;
                 }
@@ -2157,8 +2173,10 @@ EffectInstance::Implementation::tiledRenderingFunctor(EffectInstance::Implementa
                                                                         args.processChannels,
                                                                         args.planes);
 
-    //Exit of the host frame threading thread
-    appPTR->getAppTLS()->cleanupTLSForThread();
+    //Exit of the host frame threading thread. The calling thread also executes tiles and must keep its own TLS
+    if (callingThread != curThread) {
+        appPTR->getAppTLS()->cleanupTLSForThread();
+    }
 
     return ret;
 }
@@ -2184,6 +2202,7 @@ EffectInstance::Implementation::tiledRenderingFunctor(const RectToRender & rectT
                                                       const std::bitset<4>& processChannels,
                                                       const ImagePlanesToRenderPtr & planes) // when MT, planes is a copy so there's is no data race
 {
+    RenderTraceSpan traceSpan("tile", "render", _publicInterface);
     ///There cannot be the same thread running 2 concurrent instances of renderRoI on the same effect.
 #ifdef DEBUG
     {
@@ -3021,6 +3040,7 @@ EffectInstance::onSignificantEvaluateAboutToBeCalled(KnobI* knob)
     abortAnyEvaluation();
 
     NodePtr node = getNode();
+    node->invalidateKnobsHash();
     if ( !node->isNodeCreated() ) {
         return;
     }
@@ -3035,8 +3055,13 @@ EffectInstance::onSignificantEvaluateAboutToBeCalled(KnobI* knob)
     if (isMT) {
         node->refreshIdentityState();
 
-        //Increments the knobs age following a change
-        node->incrementKnobsAge();
+        if ( knob && node->isContentBasedHashEnabled() && !dynamic_cast<KnobButton*>(knob) ) {
+            //The knobs values are part of the hash: setting back a knob to a previous value gives back the previous hash
+            node->computeHash();
+        } else {
+            //Increments the knobs age following a change
+            node->incrementKnobsAge();
+        }
     }
 }
 
@@ -3720,6 +3745,7 @@ EffectInstance::render_public(const RenderActionArgs & args)
 {
     NON_RECURSIVE_ACTION();
     REPORT_CURRENT_THREAD_ACTION( kOfxImageEffectActionRender, getNode() );
+    RenderTraceSpan traceSpan("render", "action", this);
 
     return render(args);
 }
@@ -3780,6 +3806,7 @@ EffectInstance::isIdentity_public(bool useIdentityCache, // only set to true whe
         /// Don't call isIdentity if plugin is sequential only.
         if (getSequentialPreference() != eSequentialPreferenceOnlySequential) {
             try {
+                RenderTraceSpan traceSpan("isIdentity", "action", this);
                 *inputView = view;
                 ret = isIdentity(time, scale, renderWindow, view, inputTime, inputView, inputNb);
             } catch (...) {
@@ -3881,7 +3908,7 @@ EffectInstance::getRegionOfDefinition_public(U64 hash,
         StatusEnum ret;
         {
             RECURSIVE_ACTION();
-
+            RenderTraceSpan traceSpan("getRegionOfDefinition", "action", this);
 
             ret = getRegionOfDefinition(hash, time, supportsRenderScaleMaybe() == eSupportsNo ? RenderScale::identity : scale, view, rod);
 
@@ -3929,6 +3956,7 @@ EffectInstance::getRegionsOfInterest_public(double time,
     NON_RECURSIVE_ACTION();
     assert(outputRoD.x2 >= outputRoD.x1 && outputRoD.y2 >= outputRoD.y1);
     assert(renderWindow.x2 >= renderWindow.x1 && renderWindow.y2 >= renderWindow.y1);
+    RenderTraceSpan traceSpan("getRegionsOfInterest", "action", this);
 
     getRegionsOfInterest(time, scale, outputRoD, renderWindow, view, ret);
 }
@@ -3947,6 +3975,7 @@ EffectInstance::getFramesNeeded_public(U64 hash,
     }
 
     try {
+        RenderTraceSpan traceSpan("getFramesNeeded", "action", this);
         framesNeeded = getFramesNeeded(time, view);
     } catch (std::exception &e) {
         if ( !hasPersistentMessage() ) { // plugin may already have set a message
@@ -4007,6 +4036,7 @@ EffectInstance::beginSequenceRender_public(double first,
 {
     NON_RECURSIVE_ACTION();
     REPORT_CURRENT_THREAD_ACTION( kOfxImageEffectActionBeginSequenceRender, getNode() );
+    RenderTraceSpan traceSpan("beginSequenceRender", "action", this);
     EffectTLSDataPtr tls = _imp->tlsData->getOrCreateTLSData();
     assert(tls);
     ++tls->beginEndRenderCount;
@@ -4030,6 +4060,7 @@ EffectInstance::endSequenceRender_public(double first,
 {
     NON_RECURSIVE_ACTION();
     REPORT_CURRENT_THREAD_ACTION( kOfxImageEffectActionEndSequenceRender, getNode() );
+    RenderTraceSpan traceSpan("endSequenceRender", "action", this);
     EffectTLSDataPtr tls = _imp->tlsData->getOrCreateTLSData();
     assert(tls);
     --tls->beginEndRenderCount;
@@ -5192,6 +5223,18 @@ EffectInstance::getCurrentView() const
     return ViewIdx(0);
 }
 
+const KnobValuesSnapshot*
+EffectInstance::getKnobValuesSnapshotTLS() const
+{
+    EffectTLSDataPtr tls = _imp->tlsData->getTLSData();
+
+    if ( !tls || tls->frameArgs.empty() ) {
+        return 0;
+    }
+
+    return tls->frameArgs.back()->knobsSnapshot.get();
+}
+
 SequenceTime
 EffectInstance::getFrameRenderArgsCurrentTime() const
 {
@@ -856,6 +856,7 @@ public:
     virtual void abortAnyEvaluation(bool keepOldestRender = true) OVERRIDE FINAL;
     virtual double getCurrentTime() const OVERRIDE WARN_UNUSED_RETURN;
     virtual ViewIdx getCurrentView() const OVERRIDE WARN_UNUSED_RETURN;
+    virtual const KnobValuesSnapshot* getKnobValuesSnapshotTLS() const OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual bool getCanTransform() const
     {
         return false;
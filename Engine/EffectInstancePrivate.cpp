@@ -430,6 +430,10 @@ EffectInstance::Implementation::Implementation(EffectInstance* publicInterface)
     , renderClonesMutex()
     , renderClonesPool()
     , mustSyncPrivateData(false)
+    , mustSyncPrivateDataMutex()
+    , knobsSnapshotMutex()
+    , knobsSnapshot()
+    , knobsSnapshotHash(0)
 {
     tlsData = std::make_shared<TLSHolder<EffectTLSData> >();
     actionsCache = std::make_shared<ActionsCache>(appPTR->getHardwareIdealThreadCount() * 2);
@@ -240,6 +240,9 @@ public:
     std::list<EffectInstancePtr> renderClonesPool;
     bool mustSyncPrivateData; //!< true if the effect's knobs were changed but instanceChanged could not be called (e.g. when loading a PyPlug), so that syncPrivateData should be called in getPreferredMetadata_public before calling getPreferredMetadata
     mutable QMutex mustSyncPrivateDataMutex; //!< protects mustSyncPrivateData
+    QMutex knobsSnapshotMutex; //!< protects knobsSnapshot and knobsSnapshotHash
+    KnobValuesSnapshotPtr knobsSnapshot; //!< the snapshot of the knobs of the last render, reused while the node hash does not change
+    U64 knobsSnapshotHash; //!< the node hash knobsSnapshot was taken with
 
 public:
     void runChangedParamCallback(KnobI* k, bool userEdited, const std::string & callback);
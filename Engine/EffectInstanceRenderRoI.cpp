@@ -38,7 +38,6 @@
 #include <QtCore/QThreadPool>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QCoreApplication>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
 #include <QtConcurrentRun> // QtCore on Qt4, QtConcurrent on Qt5
 
 #include "Global/QtCompat.h"
@@ -63,12 +62,14 @@
 #include "Engine/PluginMemory.h"
 #include "Engine/Project.h"
 #include "Engine/RenderStats.h"
+#include "Engine/RenderTrace.h"
 #include "Engine/RotoContext.h"
 #include "Engine/RotoDrawableItem.h"
 #include "Engine/Settings.h"
 #include "Engine/Timer.h"
 #include "Engine/Transform.h"
 #include "Engine/ThreadPool.h"
+#include "Engine/TileScheduler.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/ViewerInstance.h"
 
@@ -76,6 +77,35 @@
 
 NATRON_NAMESPACE_ENTER
 
+/*
+ * @brief Split the non-identity rects to render in tiles of about NATRON_TILE_SCHEDULER_TILE_PIXELS pixels, with
+ * at least one tile per thread, so that the TileScheduler can balance them across threads.
+ */
+static void
+splitRectsToRenderInTiles(std::list<EffectInstance::RectToRender>* rectsToRender)
+{
+    int nThreads = appPTR->getTileScheduler()->getMaxConcurrency();
+
+    if (nThreads <= 1) {
+        return;
+    }
+    std::list<EffectInstance::RectToRender> tiles;
+    for (std::list<EffectInstance::RectToRender>::const_iterator it = rectsToRender->begin(); it != rectsToRender->end(); ++it) {
+        if (it->isIdentity) {
+            tiles.push_back(*it);
+            continue;
+        }
+        int nTiles = (int)std::max( (U64)nThreads, it->rect.area() / NATRON_TILE_SCHEDULER_TILE_PIXELS );
+        std::vector<RectI> splits = it->rect.splitIntoSmallerRects(nTiles);
+        for (std::size_t i = 0; i < splits.size(); ++i) {
+            EffectInstance::RectToRender r = *it;
+            r.rect = splits[i];
+            tiles.push_back(r);
+        }
+    }
+    rectsToRender->swap(tiles);
+}
+
 /*
  * @brief Split all rects to render in smaller rects and check if each one of them is identity.
  * For identity rectangles, we just call renderRoI again on the identity input in the tiledRenderingFunctor.
@@ -326,6 +356,8 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         return eRenderRoIRetCodeOk;
     }
 
+    RenderTraceSpan traceSpan("renderRoI", "render", this);
+
     // Make sure this call is not made recursively from getImage on a render clone on which we are already calling renderRoI.
     // If so, forward the call to the main instance
     if (_imp->mainInstance) {
@@ -1244,9 +1276,10 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         // If the plug-in is eRenderSafetyFullySafeFrame that means it wants the host to perform SMP aka slice up the RoI into chunks
         // but if the effect doesn't support tiles it won't work.
         // Also check that the number of threads indicating by the settings are appropriate for this render mode.
+        // The tiles are executed by the TileScheduler on which the calling thread always participates, so there is
+        // no need to fall back to a single thread when the thread pool is busy.
         if ( !frameArgs->tilesSupported || (nbThreads == -1) || (nbThreads == 1) ||
-            ( (nbThreads == 0) && (appPTR->getHardwareIdealThreadCount() == 1) ) ||
-            ( QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount() )) {
+            ( (nbThreads == 0) && (appPTR->getHardwareIdealThreadCount() == 1) ) ) {
             safety = eRenderSafetyFullySafe;
         }
     }
@@ -1255,24 +1288,6 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
     if (tryIdentityOptim) {
         optimizeRectsToRender(this, inputsRoDIntersectionPixel, rectsLeftToRender, args.time, args.view, renderMappedScale, &planesToRender->rectsToRender);
     } else {
-        // If plug-in wants host frame threading and there is only 1 rect to render, split it
-        /*if (safety == eRenderSafetyFullySafeFrame && rectsLeftToRender.size() == 1 && frameArgs->tilesSupported) {
-            QThreadPool* tp = QThreadPool::globalInstance();
-            int nThreads = (tp->maxThreadCount() - tp->activeThreadCount());
-
-            std::vector<RectI> splits;
-            if (nThreads > 1) {
-                splits = rectsLeftToRender.front().splitIntoSmallerRects(nThreads);
-            } else {
-                splits.push_back(rectsLeftToRender.front());
-            }
-            for (std::vector<RectI>::iterator it = splits.begin(); it != splits.end(); ++it) {
-                RectToRender r;
-                r.rect = *it;
-                r.isIdentity = false;
-                planesToRender->rectsToRender.push_back(r);
-            }
-        }*/
         for (std::list<RectI>::iterator it = rectsLeftToRender.begin(); it != rectsLeftToRender.end(); ++it) {
             RectToRender r;
             r.rect = *it;
@@ -1281,6 +1296,11 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         }
     }
 
+    // If plug-in wants host frame threading, split the rectangles in tiles for the TileScheduler
+    if ( (safety == eRenderSafetyFullySafeFrame) && !planesToRender->useOpenGL ) {
+        splitRectsToRenderInTiles(&planesToRender->rectsToRender);
+    }
+
     bool hasSomethingToRender = !planesToRender->rectsToRender.empty();
 
     ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1361,6 +1381,15 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
     ///For all planes, if needed allocate the associated image
     if (hasSomethingToRender) {
 
+        // Float images may be cached as half floats: the plug-in still renders in a float temporary image which is
+        // converted when copied to the cached image, see renderHandler, and the image is converted back to float
+        // before being returned below.
+        ImageBitDepthEnum cachedBitDepth = args.bitdepth;
+        if ( createInCache && (storage == eStorageModeRAM) && (args.bitdepth == eImageBitDepthFloat) &&
+             !isPaintingOverItselfEnabled() && appPTR->getCurrentSettings()->isNodeCacheHalfFloatEnabled() ) {
+            cachedBitDepth = eImageBitDepthHalf;
+        }
+
         if (glContextLocker) {
             glContextLocker->attach();
         }
@@ -1393,7 +1422,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
                                    upscaledImageBounds,
                                    isProjectFormat,
                                    *components,
-                                   args.bitdepth,
+                                   cachedBitDepth,
                                    planesToRender->outputPremult,
                                    fieldingOrder,
                                    par,
@@ -1964,13 +1993,18 @@ EffectInstance::renderRoIInternal(EffectInstance* self,
 
 #else
 
-            std::function<RenderingFunctorRetEnum(const RectToRender&)> render = [&](const RectToRender& rect) {
-                return self->_imp->tiledRenderingFunctor(*tiledArgs, rect, currentThread);
+            std::vector<const RectToRender*> tiles;
+            tiles.reserve( planesToRender->rectsToRender.size() );
+            for (std::list<RectToRender>::const_iterator it = planesToRender->rectsToRender.begin(); it != planesToRender->rectsToRender.end(); ++it) {
+                tiles.push_back(&*it);
+            }
+            std::vector<EffectInstance::RenderingFunctorRetEnum> ret( tiles.size(), eRenderingFunctorRetFailed );
+            std::function<void(int)> render = [&](int i) {
+                ret[i] = self->_imp->tiledRenderingFunctor(*tiledArgs, *tiles[i], currentThread);
             };
 
-            QFuture<RenderingFunctorRetEnum> ret = QtConcurrent::mapped(planesToRender->rectsToRender, render);
-            ret.waitForFinished();
-            QFuture<EffectInstance::RenderingFunctorRetEnum>::const_iterator it2;
+            appPTR->getTileScheduler()->run( (int)tiles.size(), render );
+            std::vector<EffectInstance::RenderingFunctorRetEnum>::const_iterator it2;
 
 #endif
             for (it2 = ret.begin(); it2 != ret.end(); ++it2) {
@@ -76,6 +76,8 @@ SOURCES += \
     BlockingBackgroundRender.cpp \
     CLArgs.cpp \
     Cache.cpp \
+    CacheCompression.cpp \
+    CacheJournal.cpp \
     CoonsRegularization.cpp \
     CreateNodeArgs.cpp \
     Curve.cpp \
@@ -99,6 +101,7 @@ SOURCES += \
     GenericSchedulerThreadWatcher.cpp \
     GroupInput.cpp \
     GroupOutput.cpp \
+    Half.cpp \
     Hash64.cpp \
     HistogramCPU.cpp \
     HostOverlaySupport.cpp \
@@ -109,6 +112,7 @@ SOURCES += \
     ImageMaskMix.cpp \
     ImageParamsSerialization.cpp \
     ImagePlaneDesc.cpp \
+    ImageScopes.cpp \
     Interpolation.cpp \
     JoinViewsNode.cpp \
     Knob.cpp \
@@ -116,11 +120,13 @@ SOURCES += \
     KnobFile.cpp \
     KnobSerialization.cpp \
     KnobTypes.cpp \
+    KnobValuesSnapshot.cpp \
     LibraryBinary.cpp \
     Log.cpp \
     Lut.cpp \
     Markdown.cpp \
     MemoryFile.cpp \
+    NativeExpression.cpp \
     MemoryInfo.cpp \
     NoOpBase.cpp \
     Node.cpp \
@@ -166,17 +172,20 @@ SOURCES += \
     PyParameter.cpp \
     PyRoto.cpp \
     PyTracker.cpp \
+    RamBufferPool.cpp \
     ReadNode.cpp \
     RectD.cpp \
     RectI.cpp \
     RenderScale.cpp \
     RenderStats.cpp \
+    RenderTrace.cpp \
     RotoContext.cpp \
     RotoDrawableItem.cpp \
     RotoItem.cpp \
     RotoLayer.cpp \
     RotoPaint.cpp \
     RotoPaintInteract.cpp \
+    RotoShapeRasterizer.cpp \
     RotoSmear.cpp \
     RotoStrokeItem.cpp \
     RotoUndoCommand.cpp \
@@ -189,6 +198,7 @@ SOURCES += \
     Texture.cpp \
     TextureRect.cpp \
     ThreadPool.cpp \
+    TileScheduler.cpp \
     TimeLine.cpp \
     Timer.cpp \
     TrackMarker.cpp \
@@ -201,6 +211,7 @@ SOURCES += \
     Transform.cpp \
     Utils.cpp \
     ViewerInstance.cpp \
+    ViewerPrefetcher.cpp \
     WriteNode.cpp \
     ../Global/glad_source.c \
     ../Global/FStreamsSupport.cpp \
@@ -226,8 +237,10 @@ HEADERS += \
     BufferableObject.h \
     CLArgs.h \
     Cache.h \
+    CacheCompression.h \
     CacheEntry.h \
     CacheEntryHolder.h \
+    CacheJournal.h \
     CacheSerialization.h \
     ChoiceOption.h \
     CoonsRegularization.h \
@@ -260,6 +273,7 @@ HEADERS += \
     GenericSchedulerThreadWatcher.h \
     GroupInput.h \
     GroupOutput.h \
+    Half.h \
     Hash64.h \
     HistogramCPU.h \
     HostOverlaySupport.h \
@@ -269,6 +283,7 @@ HEADERS += \
     ImageParams.h \
     ImageParamsSerialization.h \
     ImagePlaneDesc.h \
+    ImageScopes.h \
     ImageSerialization.h \
     Interpolation.h \
     JoinViewsNode.h \
@@ -280,6 +295,7 @@ HEADERS += \
     KnobImpl.h \
     KnobSerialization.h \
     KnobTypes.h \
+    KnobValuesSnapshot.h \
     LRUHashTable.h \
     LibraryBinary.h \
     Log.h \
@@ -287,6 +303,7 @@ HEADERS += \
     Lut.h \
     Markdown.h \
     MemoryFile.h \
+    NativeExpression.h \
     MemoryInfo.h \
     MergingEnum.h \
     NoOpBase.h \
@@ -335,6 +352,7 @@ HEADERS += \
     PyParameter.h \
     PyRoto.h \
     PyTracker.h \
+    RamBufferPool.h \
     ReadNode.h \
     RectD.h \
     RectDSerialization.h \
@@ -342,6 +360,7 @@ HEADERS += \
     RectISerialization.h \
     RenderScale.h \
     RenderStats.h \
+    RenderTrace.h \
     RotoContext.h \
     RotoContextPrivate.h \
     RotoContextSerialization.h \
@@ -354,6 +373,7 @@ HEADERS += \
     RotoPaint.h \
     RotoPaintInteract.h \
     RotoPoint.h \
+    RotoShapeRasterizer.h \
     RotoSmear.h \
     RotoStrokeItem.h \
     RotoStrokeItemSerialization.h \
@@ -371,6 +391,7 @@ HEADERS += \
     TextureRectSerialization.h \
     ThreadPool.h \
     ThreadStorage.h \
+    TileScheduler.h \
     TimeLine.h \
     TimeLineKeyFrames.h \
     Timer.h \
@@ -391,6 +412,7 @@ HEADERS += \
     ViewIdx.h \
     ViewerInstance.h \
     ViewerInstancePrivate.h \
+    ViewerPrefetcher.h \
     WriteNode.h \
     fstream_mingw.h \
     ../Global/Enums.h \
@@ -37,6 +37,8 @@
 
 namespace boost {
 namespace archive {
+class binary_iarchive;
+class binary_oarchive;
 class xml_iarchive;
 class xml_oarchive;
 }
@@ -130,6 +132,7 @@ class BlockingBackgroundRender;
 class BufferableObject;
 class CLArgs;
 class CacheEntryHolder;
+class CacheJournal;
 class CacheSignalEmitter;
 class ChoiceExtraData;
 class CreateNodeArgs;
@@ -190,9 +193,11 @@ class KnobSignalSlotHandler;
 class KnobString;
 class KnobTLSData;
 class KnobTable;
+class KnobValuesSnapshot;
 class LibraryBinary;
 class LogEntry;
 class MemoryFile;
+class NativeExpression;
 class Node;
 class NodeCollection;
 class NodeFrameRequest;
@@ -229,6 +234,7 @@ class ProcessHandler;
 class ProcessInputChannel;
 class Project;
 class ProjectBeingLoadedInfo;
+class ProjectGuiSerialization;
 class ProjectSerialization;
 class RectD;
 class RectI;
@@ -253,6 +259,7 @@ class TLSHolderBase;
 class Texture;
 class TextureRect;
 class TileCacheFile;
+class TileScheduler;
 class TimeLapse;
 class TimeLine;
 class TrackArgs;
@@ -331,6 +338,7 @@ typedef std::shared_ptr<Bezier> BezierPtr;
 typedef std::shared_ptr<BezierCP> BezierCPPtr;
 typedef std::shared_ptr<BezierSerialization> BezierSerializationPtr;
 typedef std::shared_ptr<BufferableObject> BufferableObjectPtr;
+typedef std::shared_ptr<CacheJournal> CacheJournalPtr;
 typedef std::shared_ptr<CacheSignalEmitter> CacheSignalEmitterPtr;
 typedef std::shared_ptr<Curve> CurvePtr;
 typedef std::shared_ptr<EffectInstance> EffectInstancePtr;
@@ -379,7 +387,9 @@ typedef std::shared_ptr<KnobSignalSlotHandler> KnobSignalSlotHandlerPtr;
 typedef std::shared_ptr<KnobString> KnobStringPtr;
 typedef std::shared_ptr<KnobTLSData> KnobTLSDataPtr;
 typedef std::shared_ptr<KnobTable> KnobTablePtr;
+typedef std::shared_ptr<const KnobValuesSnapshot> KnobValuesSnapshotPtr;
 typedef std::shared_ptr<MemoryFile> MemoryFilePtr;
+typedef std::shared_ptr<NativeExpression> NativeExpressionPtr;
 typedef std::shared_ptr<Node> NodePtr;
 typedef std::shared_ptr<NodeCollection> NodeCollectionPtr;
 typedef std::shared_ptr<NodeFrameRequest> NodeFrameRequestPtr;
@@ -400,6 +410,8 @@ typedef std::shared_ptr<PluginMemory> PluginMemoryPtr;
 typedef std::shared_ptr<PrecompNode> PrecompNodePtr;
 typedef std::shared_ptr<ProcessHandler> ProcessHandlerPtr;
 typedef std::shared_ptr<Project> ProjectPtr;
+typedef std::shared_ptr<ProjectGuiSerialization> ProjectGuiSerializationPtr;
+typedef std::shared_ptr<ProjectSerialization> ProjectSerializationPtr;
 typedef std::shared_ptr<RenderEngine> RenderEnginePtr;
 typedef std::shared_ptr<RenderStats> RenderStatsPtr;
 typedef std::shared_ptr<RenderingFlagSetter> RenderingFlagSetterPtr;
@@ -33,6 +33,7 @@
 
 #include "Engine/AppManager.h"
 #include "Engine/OSGLContext.h"
+#include "Engine/RenderTrace.h"
 #include "Engine/Settings.h"
 
 NATRON_NAMESPACE_ENTER
@@ -117,8 +118,11 @@ GPUContextPool::attachGLContextToRender(bool checkIfGLLoaded)
     int maxContexts = settings ? std::max(settings->getMaxOpenGLContexts(), 1) : 1;
 
 #ifndef NATRON_RENDER_SHARED_CONTEXT
-    while (_imp->glContextPool.empty() && (int)_imp->attachedGLContexts.size() >= maxContexts) {
-        _imp->glContextPoolEmpty.wait(k.mutex());
+    if ( _imp->glContextPool.empty() && ( (int)_imp->attachedGLContexts.size() >= maxContexts ) ) {
+        RenderTraceSpan traceSpan("waitGLContext", "lock");
+        while (_imp->glContextPool.empty() && (int)_imp->attachedGLContexts.size() >= maxContexts) {
+            _imp->glContextPoolEmpty.wait(k.mutex());
+        }
     }
     if ( _imp->glContextPool.empty() ) {
         assert( (int)_imp->attachedGLContexts.size() < maxContexts );
@@ -0,0 +1,127 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Half.h"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+// The F16C kernels are compiled with the target attribute and selected at runtime, see hasF16C()
+#define NATRON_HALF_X86_F16C
+#include <immintrin.h>
+#endif
+
+#include "Engine/Lut.h"
+
+NATRON_NAMESPACE_ENTER
+
+#ifdef NATRON_HALF_X86_F16C
+
+static bool
+detectF16C()
+{
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+}
+
+static bool
+hasF16C()
+{
+    static const bool supported = detectF16C();
+
+    // setSIMDLevel(eSIMDLevelScalar) disables the F16C kernels too, so that the tests can compare them with the scalar code
+    return supported && Color::getSIMDLevel() != Color::eSIMDLevelScalar;
+}
+
+__attribute__((target("avx,f16c")))
+static void
+halfToFloatRow_f16c(const Half* from,
+                    float* to,
+                    std::size_t count)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i h = _mm_loadu_si128( (const __m128i*)(from + i) );
+        _mm256_storeu_ps( to + i, _mm256_cvtph_ps(h) );
+    }
+    for (; i < count; ++i) {
+        to[i] = from[i];
+    }
+}
+
+__attribute__((target("avx,f16c")))
+static void
+floatToHalfRow_f16c(const float* from,
+                    Half* to,
+                    std::size_t count)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 f = _mm256_loadu_ps(from + i);
+        _mm_storeu_si128( (__m128i*)(to + i), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT) );
+    }
+    for (; i < count; ++i) {
+        to[i] = from[i];
+    }
+}
+
+#endif // NATRON_HALF_X86_F16C
+
+void
+halfToFloatRow(const Half* from,
+               float* to,
+               std::size_t count)
+{
+#ifdef NATRON_HALF_X86_F16C
+    if ( hasF16C() ) {
+        halfToFloatRow_f16c(from, to, count);
+
+        return;
+    }
+#endif
+    for (std::size_t i = 0; i < count; ++i) {
+        to[i] = from[i];
+    }
+}
+
+void
+floatToHalfRow(const float* from,
+               Half* to,
+               std::size_t count)
+{
+#ifdef NATRON_HALF_X86_F16C
+    if ( hasF16C() ) {
+        floatToHalfRow_f16c(from, to, count);
+
+        return;
+    }
+#endif
+    for (std::size_t i = 0; i < count; ++i) {
+        to[i] = from[i];
+    }
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,196 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_HALF_H
+#define NATRON_ENGINE_HALF_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <cstring> // for std::memcpy
+
+#include "Global/GlobalDefines.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief A 16-bit IEEE 754 half-precision float, the storage of eImageBitDepthHalf images. It has the same layout
+ * as the OpenEXR half and as the pixels of kOfxBitDepthHalf images.
+ * It converts implicitly from and to float, so that the pixel templates can be instantiated for it: the arithmetic
+ * is done in float. Note that a conditional expression mixing a Half and a number is ambiguous, one of them has
+ * to be cast.
+ * Use halfToFloatRow() and floatToHalfRow() for bulk conversions, they use the F16C instructions when available.
+ **/
+class Half
+{
+public:
+
+    Half()
+    {
+    }
+
+    Half(float f)
+        : _bits( floatToBits(f) )
+    {
+    }
+
+    operator float() const
+    {
+        return bitsToFloat(_bits);
+    }
+
+    Half& operator+=(float f)
+    {
+        _bits = floatToBits(bitsToFloat(_bits) + f);
+
+        return *this;
+    }
+
+    Half& operator-=(float f)
+    {
+        _bits = floatToBits(bitsToFloat(_bits) - f);
+
+        return *this;
+    }
+
+    Half& operator*=(float f)
+    {
+        _bits = floatToBits(bitsToFloat(_bits) * f);
+
+        return *this;
+    }
+
+    Half& operator/=(float f)
+    {
+        _bits = floatToBits(bitsToFloat(_bits) / f);
+
+        return *this;
+    }
+
+    U16 bits() const
+    {
+        return _bits;
+    }
+
+    static Half fromBits(U16 bits)
+    {
+        Half ret;
+
+        ret._bits = bits;
+
+        return ret;
+    }
+
+    /**
+     * @brief Rounds f to the nearest half, ties to even. Values above the half range become infinite
+     * and NaNs stay NaNs.
+     **/
+    static U16 floatToBits(float f)
+    {
+        // See https://gist.github.com/rygorous/2156668 (float_to_half_fast3_rtne)
+        const U32 f32infty = 255U << 23;
+        const U32 f16max = (127U + 16U) << 23;
+        const U32 denormMagicBits = ( (127U - 15U) + (23U - 10U) + 1U ) << 23;
+        U32 u;
+
+        std::memcpy( &u, &f, sizeof(u) );
+
+        const U32 sign = u & 0x80000000U;
+        U16 ret;
+
+        u ^= sign;
+        if (u >= f16max) {
+            // Inf or NaN (all exponent bits set): NaN -> qNaN and Inf -> Inf, overflows become Inf
+            ret = (u > f32infty) ? 0x7e00 : 0x7c00;
+        } else if ( u < (113U << 23) ) {
+            // The result is a subnormal or zero: let the FPU do the rounding by adding 0.5
+            float magic, v;
+            std::memcpy( &magic, &denormMagicBits, sizeof(magic) );
+            std::memcpy( &v, &u, sizeof(v) );
+            v += magic;
+            std::memcpy( &u, &v, sizeof(u) );
+            ret = (U16)(u - denormMagicBits);
+        } else {
+            const U32 mantissaOdd = (u >> 13) & 1U;
+
+            // update the exponent, rounding bias part 1
+            u += (U32)(15 - 127) << 23;
+            u += 0xfff;
+            // rounding bias part 2
+            u += mantissaOdd;
+            ret = (U16)(u >> 13);
+        }
+
+        return (U16)( ret | (sign >> 16) );
+    }
+
+    static float bitsToFloat(U16 h)
+    {
+        // See https://gist.github.com/rygorous/2144712 (half_to_float_fast5)
+        const U32 shiftedExp = 0x7c00U << 13; // exponent mask after shift
+        U32 u = ( (U32)h & 0x7fffU ) << 13; // exponent/mantissa bits
+        const U32 exp = shiftedExp & u; // just the exponent
+        float ret;
+
+        u += (U32)(127 - 15) << 23; // exponent adjust
+        if (exp == shiftedExp) {
+            // Inf/NaN: extra exponent adjust
+            u += (U32)(128 - 16) << 23;
+        } else if (exp == 0) {
+            // Zero/subnormal: extra exponent adjust, then renormalize
+            const U32 magicBits = 113U << 23;
+            float magic;
+            std::memcpy( &magic, &magicBits, sizeof(magic) );
+            u += 1U << 23;
+            std::memcpy( &ret, &u, sizeof(ret) );
+            ret -= magic;
+            std::memcpy( &u, &ret, sizeof(u) );
+        }
+        u |= ( (U32)h & 0x8000U ) << 16; // sign bit
+        std::memcpy( &ret, &u, sizeof(ret) );
+
+        return ret;
+    }
+
+private:
+
+    U16 _bits;
+};
+
+/**
+ * @brief Converts count halfs to floats. Uses the F16C instructions when the CPU supports them and
+ * Color::getSIMDLevel() is not eSIMDLevelScalar.
+ **/
+void halfToFloatRow(const Half* from, float* to, std::size_t count);
+
+/**
+ * @brief Converts count floats to halfs, rounding to the nearest. Uses the F16C instructions when the CPU
+ * supports them and Color::getSIMDLevel() is not eSIMDLevelScalar.
+ **/
+void floatToHalfRow(const float* from, Half* to, std::size_t count);
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_HALF_H
@@ -34,6 +34,9 @@
 
 #include "Engine/EngineFwd.h"
 
+// Number of rows of the waveform and of the rows and columns of the vectorscope computed by HistogramCPU
+#define NATRON_HISTOGRAM_SCOPE_ROWS 256
+
 NATRON_NAMESPACE_ENTER
 
 struct HistogramCPUPrivate;
@@ -69,6 +72,8 @@ public:
     ///to the histogramProduced signal.
     ///
     ///This function returns in histogram1 the first histogram of the produced histogram
+    ///For the waveform and vectorscope modes, histogram1 contains NATRON_HISTOGRAM_SCOPE_ROWS rows
+    ///of binsCount (waveform) or NATRON_HISTOGRAM_SCOPE_ROWS (vectorscope) counts, see ImageScopes.
     bool getMostRecentlyProducedHistogram(std::vector<float>* histogram1,
                                           std::vector<float>* histogram2,
                                           std::vector<float>* histogram3,
@@ -40,176 +40,378 @@
 
 NATRON_NAMESPACE_ENTER
 
-#define BM_GET(i, j) (&_map[( i - _bounds.bottom() ) * _bounds.width() + ( j - _bounds.left() )])
-
 #define PIXEL_UNAVAILABLE 2
 
-template <int trimap>
+// The state of a tile whose pixels are not all in the same state
+#define TILE_STATE_MIXED 3
+
+// The pixels of a mixed tile take 2 bits each
+#define TILE_ROW_BYTES (NATRON_BITMAP_TILE_SIZE / 4)
+#define TILE_BYTES (TILE_ROW_BYTES * NATRON_BITMAP_TILE_SIZE)
+
+#define STATE_MASK(state) ( 1 << (state) )
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// Index of the tile containing the coordinate, the tiles are aligned on multiples of NATRON_BITMAP_TILE_SIZE
+inline int
+tileIndex(int coord)
+{
+    return coord >= 0 ? coord / NATRON_BITMAP_TILE_SIZE : -( (NATRON_BITMAP_TILE_SIZE - 1 - coord) / NATRON_BITMAP_TILE_SIZE );
+}
+
+inline int
+getPackedPixel(const unsigned char* row,
+               int x)
+{
+    return ( row[x >> 2] >> ( (x & 3) * 2 ) ) & 3;
+}
+
+inline void
+setPackedPixel(unsigned char* row,
+               int x,
+               int value)
+{
+    unsigned char& byte = row[x >> 2];
+    const int shift = (x & 3) * 2;
+
+    byte = (unsigned char)( ( byte & ~(3 << shift) ) | (value << shift) );
+}
+
+// Sets the pixels [x1, x2[ of a row of a tile
+void
+fillPackedRow(unsigned char* row,
+              int x1,
+              int x2,
+              int value)
+{
+    while ( (x1 < x2) && (x1 & 3) ) {
+        setPackedPixel(row, x1, value);
+        ++x1;
+    }
+    while ( (x2 > x1) && (x2 & 3) ) {
+        --x2;
+        setPackedPixel(row, x2, value);
+    }
+    if (x1 < x2) {
+        std::memset( row + (x1 >> 2), value * 0x55, (x2 - x1) >> 2 );
+    }
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+void
+Bitmap::initialize(const RectI & bounds)
+{
+    _bounds = bounds;
+    if ( _bounds.isNull() ) {
+        _tilesX1 = _tilesY1 = _tilesWidth = _tilesHeight = 0;
+    } else {
+        _tilesX1 = tileIndex(_bounds.x1);
+        _tilesY1 = tileIndex(_bounds.y1);
+        _tilesWidth = tileIndex(_bounds.x2 - 1) - _tilesX1 + 1;
+        _tilesHeight = tileIndex(_bounds.y2 - 1) - _tilesY1 + 1;
+    }
+    _tileStates.assign( (std::size_t)_tilesWidth * _tilesHeight, 0 );
+    _tilePixels.clear();
+    _tilePixels.resize( _tileStates.size() );
+    _mixedTilesCount = 0;
+}
+
+void
+Bitmap::setTo1()
+{
+    std::fill(_tileStates.begin(), _tileStates.end(), 1);
+    for (std::size_t i = 0; i < _tilePixels.size(); ++i) {
+        std::vector<unsigned char>().swap(_tilePixels[i]);
+    }
+    _mixedTilesCount = 0;
+}
+
 RectI
-minimalNonMarkedBbox_internal(const RectI& roi,
-                              const RectI& _bounds,
-                              const std::vector<char>& _map,
-                              bool* isBeingRenderedElsewhere)
+Bitmap::getTileRect(int tx,
+                    int ty) const
 {
-    RectI bbox;
+    const int x1 = (_tilesX1 + tx) * NATRON_BITMAP_TILE_SIZE;
+    const int y1 = (_tilesY1 + ty) * NATRON_BITMAP_TILE_SIZE;
 
-    assert( _bounds.contains(roi) );
-    bbox = roi;
+    return RectI(x1, y1, x1 + NATRON_BITMAP_TILE_SIZE, y1 + NATRON_BITMAP_TILE_SIZE).intersect(_bounds);
+}
 
-    //find bottom
-    for (int i = bbox.bottom(); i < bbox.top(); ++i) {
-        const char* buf = BM_GET( i, bbox.left() );
-
-        if (trimap) {
-            const char* lineEnd = buf + bbox.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (!*buf) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    metUnavailablePixel = true;
-                }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else if (metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag if the whole row is not 0
-                ++bbox.y1;
-            } else {
-                ++bbox.y1;
+unsigned char*
+Bitmap::getTilePixelsForWriting(int index)
+{
+    std::vector<unsigned char>& pixels = _tilePixels[index];
+
+    if (_tileStates[index] != TILE_STATE_MIXED) {
+        pixels.assign( TILE_BYTES, (unsigned char)(_tileStates[index] * 0x55) );
+        _tileStates[index] = TILE_STATE_MIXED;
+        ++_mixedTilesCount;
+    }
+
+    return &pixels.front();
+}
+
+void
+Bitmap::setUniformTile(int index,
+                       unsigned char state)
+{
+    if (_tileStates[index] == TILE_STATE_MIXED) {
+        std::vector<unsigned char>().swap(_tilePixels[index]);
+        --_mixedTilesCount;
+    }
+    _tileStates[index] = state;
+}
+
+void
+Bitmap::compactTile(int tx,
+                    int ty)
+{
+    const int index = ty * _tilesWidth + tx;
+
+    assert(_tileStates[index] == TILE_STATE_MIXED);
+    const unsigned char* pixels = &_tilePixels[index].front();
+    const RectI tileRect = getTileRect(tx, ty);
+    const int originX = (_tilesX1 + tx) * NATRON_BITMAP_TILE_SIZE;
+    const int originY = (_tilesY1 + ty) * NATRON_BITMAP_TILE_SIZE;
+    const int state = getPackedPixel(pixels + (tileRect.y1 - originY) * TILE_ROW_BYTES, tileRect.x1 - originX);
+
+    for (int y = tileRect.y1; y < tileRect.y2; ++y) {
+        const unsigned char* row = pixels + (y - originY) * TILE_ROW_BYTES;
+        for (int x = tileRect.x1; x < tileRect.x2; ++x) {
+            if (getPackedPixel(row, x - originX) != state) {
+                return;
             }
-        } else {
-            const char* lineEnd = buf + bbox.width();
-            while (buf < lineEnd) {
-                if ( !*buf || (*buf == PIXEL_UNAVAILABLE) ) {
-                    buf = 0;
-                    break;
+        }
+    }
+    setUniformTile(index, (unsigned char)state);
+}
+
+bool
+Bitmap::containsAny(const RectI& roi,
+                    int statesMask) const
+{
+    const RectI rect = roi.intersect(_bounds);
+
+    if ( rect.isNull() ) {
+        return false;
+    }
+    const int tx1 = tileIndex(rect.x1) - _tilesX1;
+    const int tx2 = tileIndex(rect.x2 - 1) - _tilesX1;
+    const int ty1 = tileIndex(rect.y1) - _tilesY1;
+    const int ty2 = tileIndex(rect.y2 - 1) - _tilesY1;
+
+    for (int ty = ty1; ty <= ty2; ++ty) {
+        for (int tx = tx1; tx <= tx2; ++tx) {
+            const int index = ty * _tilesWidth + tx;
+            const int state = _tileStates[index];
+            if (state != TILE_STATE_MIXED) {
+                if ( statesMask & STATE_MASK(state) ) {
+                    return true;
                 }
-                ++buf;
+                continue;
             }
-            if (!buf) {
-                break;
-            } else {
-                ++bbox.y1;
+            const RectI part = rect.intersect( getTileRect(tx, ty) );
+            const unsigned char* pixels = &_tilePixels[index].front();
+            const int originX = (_tilesX1 + tx) * NATRON_BITMAP_TILE_SIZE;
+            const int originY = (_tilesY1 + ty) * NATRON_BITMAP_TILE_SIZE;
+            for (int y = part.y1; y < part.y2; ++y) {
+                const unsigned char* row = pixels + (y - originY) * TILE_ROW_BYTES;
+                for (int x = part.x1; x < part.x2; ++x) {
+                    if ( statesMask & STATE_MASK( getPackedPixel(row, x - originX) ) ) {
+                        return true;
+                    }
+                }
             }
         }
     }
 
-    //find top (will do zero iteration if the bbox is already empty)
-    for (int i = bbox.top() - 1; i >= bbox.bottom(); --i) {
-        const char* buf = BM_GET( i, bbox.left() );
+    return false;
+}
 
-        if (trimap) {
-            const char* lineEnd = buf + bbox.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (!*buf) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    metUnavailablePixel = true;
+int
+Bitmap::findFirst(const RectI& line,
+                  int statesMask) const
+{
+    // The pixels of a row are visited from left to right and the pixels of a column from bottom to top
+    assert(line.width() == 1 || line.height() == 1);
+    const RectI rect = line.intersect(_bounds);
+    if ( rect.isNull() ) {
+        return -1;
+    }
+    const int tx1 = tileIndex(rect.x1) - _tilesX1;
+    const int tx2 = tileIndex(rect.x2 - 1) - _tilesX1;
+    const int ty1 = tileIndex(rect.y1) - _tilesY1;
+    const int ty2 = tileIndex(rect.y2 - 1) - _tilesY1;
+
+    for (int ty = ty1; ty <= ty2; ++ty) {
+        for (int tx = tx1; tx <= tx2; ++tx) {
+            const int index = ty * _tilesWidth + tx;
+            const int state = _tileStates[index];
+            if (state != TILE_STATE_MIXED) {
+                if ( statesMask & STATE_MASK(state) ) {
+                    return state;
                 }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else if (metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag if the whole row is not 0
-                --bbox.y2;
-            } else {
-                --bbox.y2;
+                continue;
             }
-        } else {
-            const char* lineEnd = buf + bbox.width();
-            while (buf < lineEnd) {
-                if ( !*buf || (*buf == PIXEL_UNAVAILABLE) ) {
-                    buf = 0;
-                    break;
+            const RectI part = rect.intersect( getTileRect(tx, ty) );
+            const unsigned char* pixels = &_tilePixels[index].front();
+            const int originX = (_tilesX1 + tx) * NATRON_BITMAP_TILE_SIZE;
+            const int originY = (_tilesY1 + ty) * NATRON_BITMAP_TILE_SIZE;
+            for (int y = part.y1; y < part.y2; ++y) {
+                const unsigned char* row = pixels + (y - originY) * TILE_ROW_BYTES;
+                for (int x = part.x1; x < part.x2; ++x) {
+                    const int pixel = getPackedPixel(row, x - originX);
+                    if ( statesMask & STATE_MASK(pixel) ) {
+                        return pixel;
+                    }
                 }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else {
-                --bbox.y2;
             }
         }
     }
 
-    // avoid making bbox.width() iterations for nothing
-    if ( bbox.isNull() ) {
-        return bbox;
-    }
+    return -1;
+}
 
-    //find left
-    for (int j = bbox.left(); j < bbox.right(); ++j) {
-        const char* pix = BM_GET(bbox.bottom(), j);
-        bool metUnavailablePixel = false;
+/*
+   Removes the lines (rows for the bottom and top sides, columns for the left and right sides) on the given side of rect
+   until a line contains a pixel in stopMask.
+   flagged is set if a removed line contains a pixel in trimmedFlagMask, or if the first pixel in stopMask of the line
+   that stopped the trimming is in stopFlagMask.
+   The lines are first removed by bands up to the next tile edge, so that uniform tiles are checked only once.
+ */
+void
+Bitmap::trimLines(RectI* rect,
+                  SideEnum side,
+                  int stopMask,
+                  int trimmedFlagMask,
+                  int stopFlagMask,
+                  bool* flagged) const
+{
+    while ( !rect->isNull() ) {
+        RectI band = *rect;
+        switch (side) {
+        case eSideBottom:
+            band.y2 = std::min(rect->y2, (tileIndex(rect->y1) + 1) * NATRON_BITMAP_TILE_SIZE);
+            break;
+        case eSideTop:
+            band.y1 = std::max(rect->y1, tileIndex(rect->y2 - 1) * NATRON_BITMAP_TILE_SIZE);
+            break;
+        case eSideLeft:
+            band.x2 = std::min(rect->x2, (tileIndex(rect->x1) + 1) * NATRON_BITMAP_TILE_SIZE);
+            break;
+        case eSideRight:
+            band.x1 = std::max(rect->x1, tileIndex(rect->x2 - 1) * NATRON_BITMAP_TILE_SIZE);
+            break;
+        }
 
-        for ( int i = bbox.bottom(); i < bbox.top(); ++i, pix += _bounds.width() ) {
-            if (!*pix) {
-                pix = 0;
-                break;
-            } else if (*pix == PIXEL_UNAVAILABLE) {
-                if (trimap) {
-                    metUnavailablePixel = true;
-                } else {
-                    pix = 0;
-                    break;
-                }
+        if ( !containsAny(band, stopMask) ) {
+            if ( flagged && trimmedFlagMask && containsAny(band, trimmedFlagMask) ) {
+                *flagged = true;
             }
-        }
-        if (pix) {
-            ++bbox.x1;
-            if (trimap && metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag is the whole column is not 0
+            switch (side) {
+            case eSideBottom:
+                rect->y1 = band.y2;
+                break;
+            case eSideTop:
+                rect->y2 = band.y1;
+                break;
+            case eSideLeft:
+                rect->x1 = band.x2;
+                break;
+            case eSideRight:
+                rect->x2 = band.x1;
+                break;
             }
-        } else {
-            break;
+            continue;
         }
-    }
 
-    //find right
-    for (int j = bbox.right() - 1; j >= bbox.left(); --j) {
-        const char* pix = BM_GET(bbox.bottom(), j);
-        bool metUnavailablePixel = false;
-
-        for ( int i = bbox.bottom(); i < bbox.top(); ++i, pix += _bounds.width() ) {
-            if (!*pix) {
-                pix = 0;
+        // One of the lines of the band stops the trimming: remove the lines one by one until it
+        for (;;) {
+            RectI line = *rect;
+            switch (side) {
+            case eSideBottom:
+                line.y2 = line.y1 + 1;
                 break;
-            } else if (*pix == PIXEL_UNAVAILABLE) {
-                if (trimap) {
-                    metUnavailablePixel = true;
-                } else {
-                    pix = 0;
-                    break;
+            case eSideTop:
+                line.y1 = line.y2 - 1;
+                break;
+            case eSideLeft:
+                line.x2 = line.x1 + 1;
+                break;
+            case eSideRight:
+                line.x1 = line.x2 - 1;
+                break;
+            }
+            if ( containsAny(line, stopMask) ) {
+                if (flagged && stopFlagMask) {
+                    int first = findFirst(line, stopMask);
+                    if ( (first >= 0) && ( stopFlagMask & STATE_MASK(first) ) ) {
+                        *flagged = true;
+                    }
                 }
+
+                return;
             }
-        }
-        if (pix) {
-            --bbox.x2;
-            if (trimap && metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag is the whole column is not 0
+            if ( flagged && trimmedFlagMask && containsAny(line, trimmedFlagMask) ) {
+                *flagged = true;
+            }
+            switch (side) {
+            case eSideBottom:
+                ++rect->y1;
+                break;
+            case eSideTop:
+                --rect->y2;
+                break;
+            case eSideLeft:
+                ++rect->x1;
+                break;
+            case eSideRight:
+                --rect->x2;
+                break;
             }
-        } else {
-            break;
         }
     }
+} // Bitmap::trimLines
+
+template <int trimap>
+RectI
+Bitmap::minimalNonMarkedBbox_internal(const RectI& roi,
+                                      bool* isBeingRenderedElsewhere) const
+{
+    assert( _bounds.contains(roi) );
+    RectI bbox = roi;
+
+    // With the trimap, the lines without 0 are removed and flag the image as being rendered elsewhere if they contain 2s
+    // (only flag if the whole line is not 0).
+    // Otherwise only the lines of 1s are removed.
+    const int stopMask = trimap ? STATE_MASK(0) : ( STATE_MASK(0) | STATE_MASK(PIXEL_UNAVAILABLE) );
+    const int flagMask = trimap ? STATE_MASK(PIXEL_UNAVAILABLE) : 0;
+    bool* flagged = trimap ? isBeingRenderedElsewhere : NULL;
+
+    //find bottom
+    trimLines(&bbox, eSideBottom, stopMask, flagMask, 0, flagged);
+    //find top (will do nothing if the bbox is already empty)
+    trimLines(&bbox, eSideTop, stopMask, flagMask, 0, flagged);
+
+    // avoid checking the columns for nothing
+    if ( bbox.isNull() ) {
+        return bbox;
+    }
+
+    //find left
+    trimLines(&bbox, eSideLeft, stopMask, flagMask, 0, flagged);
+    //find right
+    trimLines(&bbox, eSideRight, stopMask, flagMask, 0, flagged);
 
     return bbox;
 } // minimalNonMarkedBbox_internal
 
-
 template <int trimap>
 void
-minimalNonMarkedRects_internal(const RectI & roi,
-                               const RectI& _bounds,
-                               const std::vector<char>& _map,
-                               std::list<RectI>& ret,
-                               bool* isBeingRenderedElsewhere)
+Bitmap::minimalNonMarkedRects_internal(const RectI & roi,
+                                       std::list<RectI>& ret,
+                                       bool* isBeingRenderedElsewhere) const
 {
     assert(ret.empty());
     ///Any out of bounds portion is pushed to the rectangles to render
@@ -243,7 +445,7 @@ minimalNonMarkedRects_internal(const RectI & roi,
         return;
     }
 
-    RectI bboxM = minimalNonMarkedBbox_internal<trimap>(intersection, _bounds, _map, isBeingRenderedElsewhere);
+    RectI bboxM = minimalNonMarkedBbox_internal<trimap>(intersection, isBeingRenderedElsewhere);
     assert( (trimap && isBeingRenderedElsewhere) || (!trimap && !isBeingRenderedElsewhere) );
 
     //#define NATRON_BITMAP_DISABLE_OPTIMIZATION
@@ -277,45 +479,18 @@ minimalNonMarkedRects_internal(const RectI & roi,
     // CXXXXXXXXXXDDD
     // AAAAAAAAAAAAAA
 
+    // The lines of A, B, C and D contain no 1. With the trimap they contain only 0s, and the image is flagged as
+    // being rendered elsewhere if the first pixel which is not 0 on the line that stops them is 2.
+    const int stopMask = trimap ? ( STATE_MASK(1) | STATE_MASK(PIXEL_UNAVAILABLE) ) : STATE_MASK(1);
+    const int stopFlagMask = trimap ? STATE_MASK(PIXEL_UNAVAILABLE) : 0;
+    bool* flagged = trimap ? isBeingRenderedElsewhere : NULL;
+
     // First, find if there's an "A" rectangle, and push it to the result
     //find bottom
     RectI bboxX = bboxM;
     RectI bboxA = bboxX;
-    bboxA.set_top( bboxX.bottom() );
-    for (int i = bboxX.bottom(); i < bboxX.top(); ++i) {
-        const char* buf = BM_GET( i, bboxX.left() );
-        if (trimap) {
-            const char* lineEnd = buf + bboxX.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (*buf == 1) {
-                    buf = 0;
-                    break;
-                } else if ( (*buf == PIXEL_UNAVAILABLE) && trimap ) {
-                    buf = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-                ++buf;
-            }
-            if (buf) {
-                ++bboxX.y1;
-                bboxA.y2 = bboxX.y1;
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        } else {
-            if ( !memchr( buf, 1, bboxX.width() ) ) {
-                ++bboxX.y1;
-                bboxA.y2 = bboxX.y1;
-            } else {
-                break;
-            }
-        }
-    }
+    trimLines(&bboxX, eSideBottom, stopMask, 0, stopFlagMask, flagged);
+    bboxA.y2 = bboxX.y1;
     if ( !bboxA.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxA);
     }
@@ -323,108 +498,24 @@ minimalNonMarkedRects_internal(const RectI & roi,
     // Now, find the "B" rectangle
     //find top
     RectI bboxB = bboxX;
-    bboxB.set_bottom( bboxX.top() );
-    for (int i = bboxX.top() - 1; i >= bboxX.bottom(); --i) {
-        const char* buf = BM_GET( i, bboxX.left() );
-
-        if (trimap) {
-            const char* lineEnd = buf + bboxX.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (*buf == 1) {
-                    buf = 0;
-                    break;
-                } else if ( (*buf == PIXEL_UNAVAILABLE) && trimap ) {
-                    buf = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-                ++buf;
-            }
-            if (buf) {
-                --bboxX.y2;
-                bboxB.y1 = bboxX.y2;
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        } else {
-            if ( !memchr( buf, 1, bboxX.width() ) ) {
-                --bboxX.y2;
-                bboxB.y1 = bboxX.y2;
-            } else {
-                break;
-            }
-        }
-    }
+    trimLines(&bboxX, eSideTop, stopMask, 0, stopFlagMask, flagged);
+    bboxB.y1 = bboxX.y2;
     if ( !bboxB.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxB);
     }
 
     //find left
     RectI bboxC = bboxX;
-    bboxC.set_right( bboxX.left() );
-    if ( bboxX.bottom() < bboxX.top() ) {
-        for (int j = bboxX.left(); j < bboxX.right(); ++j) {
-            const char* pix = BM_GET(bboxX.bottom(), j);
-            bool metUnavailablePixel = false;
-
-            for ( int i = bboxX.bottom(); i < bboxX.top(); ++i, pix += _bounds.width() ) {
-                if (*pix == 1) {
-                    pix = 0;
-                    break;
-                } else if ( trimap && (*pix == PIXEL_UNAVAILABLE) ) {
-                    pix = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-            }
-            if (pix) {
-                ++bboxX.x1;
-                bboxC.x2 = bboxX.x1;
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        }
-    }
+    trimLines(&bboxX, eSideLeft, stopMask, 0, stopFlagMask, flagged);
+    bboxC.x2 = bboxX.x1;
     if ( !bboxC.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxC);
     }
 
     //find right
     RectI bboxD = bboxX;
-    bboxD.set_left( bboxX.right() );
-    if ( bboxX.bottom() < bboxX.top() ) {
-        for (int j = bboxX.right() - 1; j >= bboxX.left(); --j) {
-            const char* pix = BM_GET(bboxX.bottom(), j);
-            bool metUnavailablePixel = false;
-
-            for ( int i = bboxX.bottom(); i < bboxX.top(); ++i, pix += _bounds.width() ) {
-                if (*pix == 1) {
-                    pix = 0;
-                    break;
-                } else if ( trimap && (*pix == PIXEL_UNAVAILABLE) ) {
-                    pix = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-            }
-            if (pix) {
-                --bboxX.x2;
-                bboxD.x1 = bboxX.x2;
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        }
-    }
+    trimLines(&bboxX, eSideRight, stopMask, 0, stopFlagMask, flagged);
+    bboxD.x1 = bboxX.x2;
     if ( !bboxD.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxD);
     }
@@ -450,14 +541,14 @@ minimalNonMarkedRects_internal(const RectI & roi,
     assert( bboxD.bottom() == bboxX.bottom() );
 
     // get the bounding box of what's left (the X rectangle in the drawing above)
-    bboxX = minimalNonMarkedBbox_internal<trimap>(bboxX, _bounds, _map, isBeingRenderedElsewhere);
+    bboxX = minimalNonMarkedBbox_internal<trimap>(bboxX, isBeingRenderedElsewhere);
 
     if ( !bboxX.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxX);
     }
 
 #endif // NATRON_BITMAP_DISABLE_OPTIMIZATION
-} // minimalNonMarkedRects
+} // minimalNonMarkedRects_internal
 
 RectI
 Bitmap::minimalNonMarkedBbox(const RectI & roi) const
@@ -470,7 +561,7 @@ Bitmap::minimalNonMarkedBbox(const RectI & roi) const
         }
     }
 
-    return minimalNonMarkedBbox_internal<0>(realRoi, _bounds, _map, NULL);
+    return minimalNonMarkedBbox_internal<0>(realRoi, NULL);
 }
 
 void
@@ -484,7 +575,7 @@ Bitmap::minimalNonMarkedRects(const RectI & roi,
             return;
         }
     }
-    minimalNonMarkedRects_internal<0>(realRoi, _bounds, _map, ret, NULL);
+    minimalNonMarkedRects_internal<0>(realRoi, ret, NULL);
 }
 
 #if NATRON_ENABLE_TRIMAP
@@ -501,7 +592,7 @@ Bitmap::minimalNonMarkedBbox_trimap(const RectI & roi,
         }
     }
 
-    return minimalNonMarkedBbox_internal<1>(realRoi, _bounds, _map, isBeingRenderedElsewhere);
+    return minimalNonMarkedBbox_internal<1>(realRoi, isBeingRenderedElsewhere);
 }
 
 void
@@ -517,48 +608,52 @@ Bitmap::minimalNonMarkedRects_trimap(const RectI & roi,
             return;
         }
     }
-    minimalNonMarkedRects_internal<1>(realRoi, _bounds, _map, ret, isBeingRenderedElsewhere);
+    minimalNonMarkedRects_internal<1>(realRoi, ret, isBeingRenderedElsewhere);
 }
 
 #endif
 
 void
-Bitmap::markFor(const RectI & roi, char value)
+Bitmap::markFor(const RectI & roi,
+                char value)
 {
-    int x1 = std::max(roi.x1, _bounds.x1);
-    int y1 = std::max(roi.y1, _bounds.y1);
-    int x2 = std::min(roi.x2, _bounds.x2);
-    int y2 = std::min(roi.y2, _bounds.y2);
+    const RectI rect = roi.intersect(_bounds);
 
-    char* buf = BM_GET(y1, x1);
-    int w = _bounds.width();
-    int roiw = x2 - x1;
-
-    for (int i = y1; i < y2; ++i, buf += w) {
-        std::memset( buf, value, roiw);
+    if ( rect.isNull() ) {
+        return;
+    }
+    const int tx1 = tileIndex(rect.x1) - _tilesX1;
+    const int tx2 = tileIndex(rect.x2 - 1) - _tilesX1;
+    const int ty1 = tileIndex(rect.y1) - _tilesY1;
+    const int ty2 = tileIndex(rect.y2 - 1) - _tilesY1;
+
+    for (int ty = ty1; ty <= ty2; ++ty) {
+        for (int tx = tx1; tx <= tx2; ++tx) {
+            const int index = ty * _tilesWidth + tx;
+            const RectI tileRect = getTileRect(tx, ty);
+            const RectI part = rect.intersect(tileRect);
+            if (part == tileRect) {
+                setUniformTile(index, (unsigned char)value);
+                continue;
+            }
+            if (_tileStates[index] == value) {
+                continue;
+            }
+            unsigned char* pixels = getTilePixelsForWriting(index);
+            const int originX = (_tilesX1 + tx) * NATRON_BITMAP_TILE_SIZE;
+            const int originY = (_tilesY1 + ty) * NATRON_BITMAP_TILE_SIZE;
+            for (int y = part.y1; y < part.y2; ++y) {
+                fillPackedRow(pixels + (y - originY) * TILE_ROW_BYTES, part.x1 - originX, part.x2 - originX, value);
+            }
+            compactTile(tx, ty);
+        }
     }
 }
 
 bool
 Bitmap::isNonMarked(const RectI & roi) const
 {
-    int x1 = std::max(roi.x1, _bounds.x1);
-    int y1 = std::max(roi.y1, _bounds.y1);
-    int x2 = std::min(roi.x2, _bounds.x2);
-    int y2 = std::min(roi.y2, _bounds.y2);
-
-    const char* buf = BM_GET(y1, x1);
-    int w = _bounds.width();
-    int roiw = x2 - x1;
-
-    for (int i = y1; i < y2; ++i, buf += w) {
-        for (int j = 0; j < roiw; ++j) {
-            if (buf[j]) {
-                return false;
-            }
-        }
-    }
-    return true;
+    return !containsAny( roi, STATE_MASK(1) | STATE_MASK(PIXEL_UNAVAILABLE) );
 }
 
 #if NATRON_ENABLE_TRIMAP
@@ -573,32 +668,39 @@ Bitmap::markForRendering(const RectI & roi)
 void
 Bitmap::swap(Bitmap& other)
 {
-    _map.swap(other._map);
-    _bounds = other._bounds;
+    std::swap(_bounds, other._bounds);
+    std::swap(_tilesX1, other._tilesX1);
+    std::swap(_tilesY1, other._tilesY1);
+    std::swap(_tilesWidth, other._tilesWidth);
+    std::swap(_tilesHeight, other._tilesHeight);
+    _tileStates.swap(other._tileStates);
+    _tilePixels.swap(other._tilePixels);
+    std::swap(_mixedTilesCount, other._mixedTilesCount);
     _dirtyZone.clear(); //merge(other._dirtyZone);
     _dirtyZoneSet = false;
 }
 
-const char*
-Bitmap::getBitmapAt(int x,
-                    int y) const
+int
+Bitmap::getPixel(int x,
+                 int y) const
 {
-    if ( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) ) {
-        return BM_GET(y, x);
-    } else {
-        return NULL;
+    assert( x >= _bounds.x1 && x < _bounds.x2 && y >= _bounds.y1 && y < _bounds.y2 );
+    const int tx = tileIndex(x) - _tilesX1;
+    const int ty = tileIndex(y) - _tilesY1;
+    const int index = ty * _tilesWidth + tx;
+
+    if (_tileStates[index] != TILE_STATE_MIXED) {
+        return _tileStates[index];
     }
+    const unsigned char* row = &_tilePixels[index].front() + ( y - (_tilesY1 + ty) * NATRON_BITMAP_TILE_SIZE ) * TILE_ROW_BYTES;
+
+    return getPackedPixel( row, x - (_tilesX1 + tx) * NATRON_BITMAP_TILE_SIZE );
 }
 
-char*
-Bitmap::getBitmapAt(int x,
-                    int y)
+std::size_t
+Bitmap::getMemorySize() const
 {
-    if ( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) ) {
-        return BM_GET(y, x);
-    } else {
-        return NULL;
-    }
+    return _tileStates.size() * ( sizeof(unsigned char) + sizeof(std::vector<unsigned char>) ) + _mixedTilesCount * TILE_BYTES;
 }
 
 #ifdef DEBUG
@@ -609,9 +711,6 @@ Image::printUnrenderedPixels(const RectI& roi) const
         return;
     }
     QReadLocker k(&_entryLock);
-    const char* bm = _bitmap.getBitmapAt(roi.x1, roi.y1);
-    int roiw = roi.x2 - roi.x1;
-    int boundsW = _bitmap.getBounds().width();
     RectD bboxUnrendered;
     bboxUnrendered.setupInfinity();
     RectD bboxUnavailable;
@@ -620,10 +719,10 @@ Image::printUnrenderedPixels(const RectI& roi) const
     bool hasUnrendered = false;
     bool hasUnavailable = false;
 
-    for ( int y = roi.y1; y < roi.y2; ++y,
-          bm += (boundsW - roiw) ) {
-        for (int x = roi.x1; x < roi.x2; ++x, ++bm) {
-            if (*bm == 0) {
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        for (int x = roi.x1; x < roi.x2; ++x) {
+            int state = _bitmap.getPixel(x, y);
+            if (state == 0) {
                 if (x < bboxUnrendered.x1) {
                     bboxUnrendered.x1 = x;
                 }
@@ -637,7 +736,7 @@ Image::printUnrenderedPixels(const RectI& roi) const
                     bboxUnrendered.y2 = y;
                 }
                 hasUnrendered = true;
-            } else if (*bm == PIXEL_UNAVAILABLE) {
+            } else if (state == PIXEL_UNAVAILABLE) {
                 if (x < bboxUnavailable.x1) {
                     bboxUnavailable.x1 = x;
                 }
@@ -671,6 +770,7 @@ Image::Image(const ImageKey & key,
              const ImageParamsPtr& params,
              const CacheAPI* cache)
     : CacheEntryHelper<unsigned char, ImageKey, ImageParams>(key, params, cache)
+    , _bitmapMemorySize(0)
     , _useBitmap(true)
 {
     _bitDepth = params->getBitDepth();
@@ -686,6 +786,7 @@ Image::Image(const ImageKey & key,
 Image::Image(const ImageKey & key,
              const ImageParamsPtr& params)
     : CacheEntryHelper<unsigned char, ImageKey, ImageParams>( key, params, NULL )
+    , _bitmapMemorySize(0)
     , _useBitmap(false)
 {
     _bitDepth = params->getBitDepth();
@@ -715,6 +816,7 @@ Image::Image(const ImagePlaneDesc& components,
              StorageModeEnum storage,
              U32 textureTarget)
     : CacheEntryHelper<unsigned char, ImageKey, ImageParams>()
+    , _bitmapMemorySize(0)
     , _useBitmap(useBitmap)
 {
     setCacheEntry(makeKey(0, 0, false, 0, ViewIdx(0), false, false),
@@ -773,6 +875,8 @@ Image::onMemoryAllocated(bool diskRestoration)
     if (diskRestoration) {
         _bitmap.setTo1();
     }
+    // The size of the entry is notified to the cache once allocated
+    _bitmapMemorySize = _bitmap.getMemorySize();
 
 #ifdef DEBUG
     if (!diskRestoration) {
@@ -782,6 +886,19 @@ Image::onMemoryAllocated(bool diskRestoration)
 #endif
 }
 
+void
+Image::onBitmapChanged()
+{
+    const std::size_t newSize = _bitmap.getMemorySize();
+    const std::size_t oldSize = _bitmapMemorySize.exchange(newSize);
+
+    // Only the entries allocated in the memory portion are counted with size(), the others are accounted when they
+    // get there
+    if ( _cache && (newSize != oldSize) && _data.isAllocated() && !_isInCompressedPortion ) {
+        _cache->notifyEntrySizeChanged(getHashKey(), oldSize, newSize);
+    }
+}
+
 void
 Image::setBitmapDirtyZone(const RectI& zone)
 {
@@ -900,7 +1017,7 @@ Image::pasteFromForDepth(const Image & srcImg,
     ///Cannot copy images with different bit depth, this is not the purpose of this function.
     ///@see convert
     assert( getBitDepth() == srcImg.getBitDepth() );
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthHalf && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
     // NOTE: before removing the following asserts, please explain why an empty image may happen
 
     QWriteLocker k(&_entryLock);
@@ -1035,9 +1152,7 @@ Image::resizeInternal(const Image* srcImg,
             std::size_t memsize = a * pixelSize;
             std::memset(pix, 0, memsize);
             if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
-                char* bm = wacc.bitmapAt(aRect.x1, aRect.y1);
-                assert(bm);
-                std::memset(bm, 1, a);
+                (*outputImage)->_bitmap.markForRendered(aRect);
             }
         }
         if ( !cRect.isNull() ) {
@@ -1047,9 +1162,7 @@ Image::resizeInternal(const Image* srcImg,
             std::size_t memsize = a * pixelSize;
             std::memset(pix, 0, memsize);
             if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
-                char* bm = (char*)wacc.bitmapAt(cRect.x1, cRect.y1);
-                assert(bm);
-                std::memset(bm, 1, a);
+                (*outputImage)->_bitmap.markForRendered(cRect);
             }
         }
         if ( !bRect.isNull() ) {
@@ -1059,13 +1172,11 @@ Image::resizeInternal(const Image* srcImg,
             std::size_t rowsize = mw * pixelSize;
             int bw = bRect.width();
             std::size_t rectRowSize = bw * pixelSize;
-            char* bm = ( setBitmapTo1 && (*outputImage)->usesBitMap() ) ? wacc.bitmapAt(bRect.x1, bRect.y1) : 0;
             for (int y = bRect.y1; y < bRect.y2; ++y, pix += rowsize) {
                 std::memset(pix, 0, rectRowSize);
-                if (bm) {
-                    std::memset(bm, 1, bw);
-                    bm += mw;
-                }
+            }
+            if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
+                (*outputImage)->_bitmap.markForRendered(bRect);
             }
         }
         if ( !dRect.isNull() ) {
@@ -1075,15 +1186,16 @@ Image::resizeInternal(const Image* srcImg,
             std::size_t rowsize = mw * pixelSize;
             int dw = dRect.width();
             std::size_t rectRowSize = dw * pixelSize;
-            char* bm = ( setBitmapTo1 && (*outputImage)->usesBitMap() ) ? wacc.bitmapAt(dRect.x1, dRect.y1) : 0;
             for (int y = dRect.y1; y < dRect.y2; ++y, pix += rowsize) {
                 std::memset(pix, 0, rectRowSize);
-                if (bm) {
-                    std::memset(bm, 1, dw);
-                    bm += mw;
-                }
+            }
+            if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
+                (*outputImage)->_bitmap.markForRendered(dRect);
             }
         }
+        if (setBitmapTo1) {
+            (*outputImage)->onBitmapChanged();
+        }
     } // fillWithBlackAndTransparent
 
 
@@ -1095,7 +1207,7 @@ Image::resizeInternal(const Image* srcImg,
         (*outputImage)->pasteFromForDepth<unsigned short>(*srcImg, srcBounds, srcImg->usesBitMap(), false);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        (*outputImage)->pasteFromForDepth<Half>(*srcImg, srcBounds, srcImg->usesBitMap(), false);
         break;
     case eImageBitDepthFloat:
         (*outputImage)->pasteFromForDepth<float>(*srcImg, srcBounds, srcImg->usesBitMap(), false);
@@ -1152,6 +1264,7 @@ Image::ensureBounds(const RectI& newBounds,
     swapBuffer(*tmpImg);
     if ( usesBitMap() ) {
         _bitmap.swap(tmpImg->_bitmap);
+        onBitmapChanged();
     }
 
     return true;
@@ -1366,7 +1479,7 @@ Image::pasteFrom(const Image & src,
             pasteFromForDepth<unsigned short>(src, srcRoi, copyBitmap, true);
             break;
         case eImageBitDepthHalf:
-            assert(false);
+            pasteFromForDepth<Half>(src, srcRoi, copyBitmap, true);
             break;
         case eImageBitDepthFloat:
             pasteFromForDepth<float>(src, srcRoi, copyBitmap, true);
@@ -1385,7 +1498,7 @@ Image::fillForDepthForComponents(const RectI & roi_,
                                  float b,
                                  float a)
 {
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthHalf && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
 
     const RectI roi = roi_.intersect(_bounds);
     if (roi.isNull()) {
@@ -1503,7 +1616,7 @@ Image::fill(const RectI & roi,
         fillForDepth<unsigned short, 65535>(roi, r, g, b, a);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        fillForDepth<Half, 1>(roi, r, g, b, a);
         break;
     case eImageBitDepthFloat:
         fillForDepth<float, 1>(roi, r, g, b, a);
@@ -1793,6 +1906,7 @@ Image::halveRoIForDepth(const RectI & roi,
     assert( _bounds.contains(roi) );
     assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) ||
             (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) ||
+            (getBitDepth() == eImageBitDepthHalf && sizeof(PIX) == 2) ||
             (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
 
     ///handle case where there is only 1 column/row
@@ -1810,10 +1924,8 @@ Image::halveRoIForDepth(const RectI & roi,
     ///The source rectangle, intersected to this image region of definition in pixels
     const RectI &srcBounds = _bounds;
     const RectI &dstBounds = output->_bounds;
-    const RectI &srcBmBounds = _bitmap.getBounds();
-    const RectI &dstBmBounds = output->_bitmap.getBounds();
     assert( !copyBitMap || usesBitMap() );
-    assert( !usesBitMap() || (srcBmBounds == srcBounds && dstBmBounds == dstBounds) );
+    assert( !usesBitMap() || (_bitmap.getBounds() == srcBounds && output->_bitmap.getBounds() == dstBounds) );
 
     // the srcRoD of the output should be enclosed in half the roi.
     // It does not have to be exactly half of the input.
@@ -1837,25 +1949,17 @@ Image::halveRoIForDepth(const RectI & roi,
 
 
     const PIX* const srcPixels      = (const PIX*)pixelAt(srcBounds.x1,   srcBounds.y1);
-    const char* const srcBmPixels   = _bitmap.getBitmapAt(srcBmBounds.x1, srcBmBounds.y1);
     PIX* const dstPixels          = (PIX*)output->pixelAt(dstBounds.x1,   dstBounds.y1);
-    char* const dstBmPixels = output->_bitmap.getBitmapAt(dstBmBounds.x1, dstBmBounds.y1);
     int srcRowSize = srcBounds.width() * _nbComponents;
     int dstRowSize = dstBounds.width() * _nbComponents;
 
     // offset pointers so that srcData and dstData correspond to pixel (0,0)
     const PIX* const srcData = srcPixels - (srcBounds.x1 * _nbComponents + srcRowSize * srcBounds.y1);
     PIX* const dstData       = dstPixels - (dstBounds.x1 * _nbComponents + dstRowSize * dstBounds.y1);
-    const int srcBmRowSize = srcBmBounds.width();
-    const int dstBmRowSize = dstBmBounds.width();
-    const char* const srcBmData = srcBmPixels - (srcBmBounds.x1 + srcBmRowSize * srcBmBounds.y1);
-    char* const dstBmData       = dstBmPixels - (dstBmBounds.x1 + dstBmRowSize * dstBmBounds.y1);
 
     for (int y = dstRoI.y1; y < dstRoI.y2; ++y) {
         const PIX* const srcLineStart    = srcData + y * 2 * srcRowSize;
         PIX* const dstLineStart          = dstData + y     * dstRowSize;
-        const char* const srcBmLineStart = srcBmData + y * 2 * srcBmRowSize;
-        char* const dstBmLineStart       = dstBmData + y     * dstBmRowSize;
 
         // The current dst row, at y, covers the src rows y*2 (thisRow) and y*2+1 (nextRow).
         // Check that if are within srcBounds.
@@ -1867,9 +1971,7 @@ Image::halveRoIForDepth(const RectI & roi,
 
         for (int x = dstRoI.x1; x < dstRoI.x2; ++x) {
             const PIX* const srcPixStart    = srcLineStart   + x * 2 * _nbComponents;
-            const char* const srcBmPixStart = srcBmLineStart + x * 2;
             PIX* const dstPixStart          = dstLineStart   + x * _nbComponents;
-            char* const dstBmPixStart       = dstBmLineStart + x;
 
             // The current dst col, at y, covers the src cols x*2 (thisCol) and x*2+1 (nextCol).
             // Check that if are within srcBounds.
@@ -1885,9 +1987,6 @@ Image::halveRoIForDepth(const RectI & roi,
                 for (int k = 0; k < _nbComponents; ++k) {
                     dstPixStart[k] = 0;
                 }
-                if (copyBitMap) {
-                    dstBmPixStart[0] = 0;
-                }
                 continue;
             }
 
@@ -1895,10 +1994,10 @@ Image::halveRoIForDepth(const RectI & roi,
                 ///a b
                 ///c d
 
-                const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : 0;
-                const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + _nbComponents) : 0;
-                const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize) : 0;
-                const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + _nbComponents)  : 0;
+                const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : PIX(0);
+                const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + _nbComponents) : PIX(0);
+                const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize) : PIX(0);
+                const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + _nbComponents)  : PIX(0);
 #ifdef DEBUG_NAN
                 assert( !std::isnan(a) ); // check for NaN
                 assert( !std::isnan(b) ); // check for NaN
@@ -1909,42 +2008,14 @@ Image::halveRoIForDepth(const RectI & roi,
                 assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
                 dstPixStart[k] = (a + b + c + d) / sum;
             }
-
-            if (copyBitMap) {
-                ///a b
-                ///c d
-
-                char a = (pickThisCol && pickThisRow) ? *(srcBmPixStart) : 0;
-                char b = (pickNextCol && pickThisRow) ? *(srcBmPixStart + 1) : 0;
-                char c = (pickThisCol && pickNextRow) ? *(srcBmPixStart + srcBmRowSize) : 0;
-                char d = (pickNextCol && pickNextRow) ? *(srcBmPixStart + srcBmRowSize  + 1)  : 0;
-#if NATRON_ENABLE_TRIMAP
-                /*
-                   The only correct solution is to convert pixels being rendered to 0 otherwise the caller
-                   would have to wait for the original fullscale image render to be finished and then re-downscale again.
-                 */
-                if (a == PIXEL_UNAVAILABLE) {
-                    a = 0;
-                }
-                if (b == PIXEL_UNAVAILABLE) {
-                    b = 0;
-                }
-                if (c == PIXEL_UNAVAILABLE) {
-                    c = 0;
-                }
-                if (d == PIXEL_UNAVAILABLE) {
-                    d = 0;
-                }
-#endif
-                assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
-                assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
-                assert(a + b + c + d <= sum); // bitmaps are 0 or 1
-                // the following is an integer division, the result can be 0 or 1
-                dstBmPixStart[0] = (a + b + c + d) / sum;
-                assert(dstBmPixStart[0] == 0 || dstBmPixStart[0] == 1);
-            }
         }
     }
+
+    if (copyBitMap) {
+        // A pixel of the output is rendered only if all the pixels it covers in this image are rendered
+        output->_bitmap.halveBitmapPortion(dstRoI, _bitmap);
+        output->onBitmapChanged();
+    }
 } // halveRoIForDepth
 
 // code proofread and fixed by @devernay on 8/8/2014
@@ -1962,7 +2033,7 @@ Image::halveRoI(const RectI & roi,
         halveRoIForDepth<unsigned short, 65535>(roi, copyBitMap, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        halveRoIForDepth<Half, 1>(roi, copyBitMap, output);
         break;
     case eImageBitDepthFloat:
         halveRoIForDepth<float, 1>(roi, copyBitMap, output);
@@ -2055,7 +2126,7 @@ Image::halve1DImage(const RectI & roi,
         halve1DImageForDepth<unsigned short, 65535>(roi, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        halve1DImageForDepth<Half, 1>(roi, output);
         break;
     case eImageBitDepthFloat:
         halve1DImageForDepth<float, 1>(roi, output);
@@ -2083,7 +2154,7 @@ Image::downscaleMipmap(const RectD& dstRod,
     double par = getPixelAspectRatio();
     unsigned int downscaleLvls = toLevel - fromLevel;
 
-    assert( !copyBitMap || _bitmap.getBitmap() );
+    assert( !copyBitMap || usesBitMap() );
 
     RectI dstRoI  = roi.downscalePowerOfTwoSmallestEnclosing(downscaleLvls);
     ImagePtr tmpImg = std::make_shared<Image>( getComponents(), dstRod, dstRoI, toLevel, par, getBitDepth(), getPremultiplication(), getFieldingOrder(), true);
@@ -2174,7 +2245,7 @@ Image::upscaleMipmapForDepth(const RectI & roi,
                              Image* output) const
 {
     assert( getBitDepth() == output->getBitDepth() );
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthHalf && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
 
     ///You should not call this function with a level equal to 0.
     assert(fromLevel > toLevel);
@@ -2264,7 +2335,7 @@ Image::upscaleMipmap(const RectI & roi,
         upscaleMipmapForDepth<unsigned short, 65535>(roi, fromLevel, toLevel, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        upscaleMipmapForDepth<Half, 1>(roi, fromLevel, toLevel, output);
         break;
     case eImageBitDepthFloat:
         upscaleMipmapForDepth<float, 1>(roi, fromLevel, toLevel, output);
@@ -2357,25 +2428,8 @@ Image::copyBitmapRowPortion(int x1,
                             int y,
                             const Image& other)
 {
-    _bitmap.copyRowPortion(x1, x2, y, other._bitmap);
-}
-
-void
-Bitmap::copyRowPortion(int x1,
-                       int x2,
-                       int y,
-                       const Bitmap& other)
-{
-    const char* srcBitmap = other.getBitmapAt(x1, y);
-    char* dstBitmap = getBitmapAt(x1, y);
-    const char* end = dstBitmap + (x2 - x1);
-
-    assert(srcBitmap && dstBitmap);
-    while (dstBitmap < end) {
-        *dstBitmap = /**srcBitmap == PIXEL_UNAVAILABLE ? 0 : */ *srcBitmap;
-        ++dstBitmap;
-        ++srcBitmap;
-    }
+    _bitmap.copyBitmapPortion(RectI(x1, y, x2, y + 1), other._bitmap);
+    onBitmapChanged();
 }
 
 void
@@ -2383,6 +2437,7 @@ Image::copyBitmapPortion(const RectI& roi,
                          const Image& other)
 {
     _bitmap.copyBitmapPortion(roi, other._bitmap);
+    onBitmapChanged();
 }
 
 void
@@ -2392,21 +2447,85 @@ Bitmap::copyBitmapPortion(const RectI& roi,
     assert(roi.x1 >= _bounds.x1 && roi.x2 <= _bounds.x2 && roi.y1 >= _bounds.y1 && roi.y2 <= _bounds.y2);
     assert(roi.x1 >= other._bounds.x1 && roi.x2 <= other._bounds.x2 && roi.y1 >= other._bounds.y1 && roi.y2 <= other._bounds.y2);
 
-    int srcRowSize = other._bounds.width();
-    int dstRowSize = _bounds.width();
-    const char* srcBitmap = other.getBitmapAt(roi.x1, roi.y1);
-    char* dstBitmap = getBitmapAt(roi.x1, roi.y1);
-
-    for (int y = roi.y1; y < roi.y2; ++y,
-         srcBitmap += srcRowSize,
-         dstBitmap += dstRowSize) {
-        const char* srcCur = srcBitmap;
-        const char* srcEnd = srcBitmap + roi.width();
-        char* dstCur = dstBitmap;
-        while (srcCur < srcEnd) {
-            *dstCur = /**srcCur == PIXEL_UNAVAILABLE ? 0 : */ *srcCur;
-            ++srcCur;
-            ++dstCur;
+    if ( roi.isNull() ) {
+        return;
+    }
+    const int tx1 = tileIndex(roi.x1) - _tilesX1;
+    const int tx2 = tileIndex(roi.x2 - 1) - _tilesX1;
+    const int ty1 = tileIndex(roi.y1) - _tilesY1;
+    const int ty2 = tileIndex(roi.y2 - 1) - _tilesY1;
+
+    for (int ty = ty1; ty <= ty2; ++ty) {
+        for (int tx = tx1; tx <= tx2; ++tx) {
+            const RectI part = roi.intersect( getTileRect(tx, ty) );
+            int uniformState = -1;
+            for (int state = 0; state <= PIXEL_UNAVAILABLE; ++state) {
+                if ( !other.containsAny( part, 7 & ~STATE_MASK(state) ) ) {
+                    uniformState = state;
+                    break;
+                }
+            }
+            if (uniformState != -1) {
+                markFor(part, (char)uniformState);
+                continue;
+            }
+            unsigned char* pixels = getTilePixelsForWriting(ty * _tilesWidth + tx);
+            const int originX = (_tilesX1 + tx) * NATRON_BITMAP_TILE_SIZE;
+            const int originY = (_tilesY1 + ty) * NATRON_BITMAP_TILE_SIZE;
+            for (int y = part.y1; y < part.y2; ++y) {
+                unsigned char* row = pixels + (y - originY) * TILE_ROW_BYTES;
+                for (int x = part.x1; x < part.x2; ++x) {
+                    setPackedPixel( row, x - originX, other.getPixel(x, y) );
+                }
+            }
+            compactTile(tx, ty);
+        }
+    }
+}
+
+void
+Bitmap::halveBitmapPortion(const RectI& dstRoI,
+                           const Bitmap& other)
+{
+    const RectI roi = dstRoI.intersect(_bounds);
+
+    if ( roi.isNull() ) {
+        return;
+    }
+
+    /*
+       The only correct solution is to convert pixels being rendered to 0 otherwise the caller
+       would have to wait for the original fullscale image render to be finished and then re-downscale again.
+     */
+    const int notRenderedMask = STATE_MASK(0) | STATE_MASK(PIXEL_UNAVAILABLE);
+    const int tx1 = tileIndex(roi.x1) - _tilesX1;
+    const int tx2 = tileIndex(roi.x2 - 1) - _tilesX1;
+    const int ty1 = tileIndex(roi.y1) - _tilesY1;
+    const int ty2 = tileIndex(roi.y2 - 1) - _tilesY1;
+
+    for (int ty = ty1; ty <= ty2; ++ty) {
+        for (int tx = tx1; tx <= tx2; ++tx) {
+            const RectI part = roi.intersect( getTileRect(tx, ty) );
+            const RectI srcPart = RectI(part.x1 * 2, part.y1 * 2, part.x2 * 2, part.y2 * 2).intersect(other._bounds);
+            if ( !other.containsAny(srcPart, notRenderedMask) ) {
+                markFor(part, 1);
+                continue;
+            }
+            if ( !other.containsAny( srcPart, STATE_MASK(1) ) ) {
+                markFor(part, 0);
+                continue;
+            }
+            unsigned char* pixels = getTilePixelsForWriting(ty * _tilesWidth + tx);
+            const int originX = (_tilesX1 + tx) * NATRON_BITMAP_TILE_SIZE;
+            const int originY = (_tilesY1 + ty) * NATRON_BITMAP_TILE_SIZE;
+            for (int y = part.y1; y < part.y2; ++y) {
+                unsigned char* row = pixels + (y - originY) * TILE_ROW_BYTES;
+                for (int x = part.x1; x < part.x2; ++x) {
+                    const RectI srcPixels(x * 2, y * 2, x * 2 + 2, y * 2 + 2);
+                    setPackedPixel(row, x - originX, other.containsAny(srcPixels, notRenderedMask) ? 0 : 1);
+                }
+            }
+            compactTile(tx, ty);
         }
     }
 }
@@ -2461,6 +2580,9 @@ Image::premultForDepth(const RectI& roi)
     case eImageBitDepthShort:
         premultInternal<unsigned short, doPremult>(roi);
         break;
+    case eImageBitDepthHalf:
+        premultInternal<Half, doPremult>(roi);
+        break;
     case eImageBitDepthFloat:
         premultInternal<float, doPremult>(roi);
         break;
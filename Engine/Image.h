@@ -31,6 +31,7 @@
 #include <list>
 #include <map>
 #include <algorithm> // min, max
+#include <atomic>
 #include <bitset>
 
 #include "Global/GlobalDefines.h"
@@ -44,6 +45,7 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/ImagePlaneDesc.h"
 #include "Engine/ImageParams.h"
 #include "Engine/CacheEntry.h"
+#include "Engine/Half.h"
 #include "Engine/OutputSchedulerThread.h"
 #include "Engine/RectD.h"
 #include "Engine/ViewIdx.h"
@@ -64,12 +66,29 @@ public:
     }
 };
 
+/// The bitmap of an image stores the render state of its pixels by tiles of this size (in pixels)
+#define NATRON_BITMAP_TILE_SIZE 64
+
+/**
+ * @brief The render state of each pixel of an image: 0 when it is not rendered, 1 when it is rendered, and
+ * 2 when it is being rendered by another thread (with NATRON_ENABLE_TRIMAP).
+ * The pixels are grouped in tiles of NATRON_BITMAP_TILE_SIZE x NATRON_BITMAP_TILE_SIZE pixels, aligned on multiples
+ * of that size so that the bitmaps of different images share the same grid. A tile whose pixels are all in the same
+ * state only stores that state, and the other tiles store 2 bits per pixel. Since renders mark whole rectangles, only
+ * the tiles on the edges of these rectangles store their pixels, and the queries skip the uniform tiles.
+ **/
 class Bitmap
 {
 public:
     Bitmap(const RectI & bounds)
-        : _bounds(bounds)
-        , _map( bounds.area() )
+        : _bounds()
+        , _tilesX1(0)
+        , _tilesY1(0)
+        , _tilesWidth(0)
+        , _tilesHeight(0)
+        , _tileStates()
+        , _tilePixels()
+        , _mixedTilesCount(0)
         , _dirtyZone()
         , _dirtyZoneSet(false)
     {
@@ -77,33 +96,30 @@ public:
         // "identities" images (i.e: images that are just a link to another image). See EffectInstance :
         // "!!!Note that if isIdentity is true it will allocate an empty image object with 0 bytes of data."
         //assert(!rod.isNull());
-        std::fill(_map.begin(), _map.end(), 0);
+        initialize(bounds);
     }
 
     Bitmap()
         : _bounds()
-        , _map()
+        , _tilesX1(0)
+        , _tilesY1(0)
+        , _tilesWidth(0)
+        , _tilesHeight(0)
+        , _tileStates()
+        , _tilePixels()
+        , _mixedTilesCount(0)
         , _dirtyZone()
         , _dirtyZoneSet(false)
     {
     }
 
-    void initialize(const RectI & bounds)
-    {
-        _bounds = bounds;
-        _map.resize( _bounds.area() );
-
-        std::fill(_map.begin(), _map.end(), 0);
-    }
+    void initialize(const RectI & bounds);
 
     ~Bitmap()
     {
     }
 
-    void setTo1()
-    {
-        std::fill(_map.begin(), _map.end(), 1);
-    }
+    void setTo1();
 
     const RectI & getBounds() const
     {
@@ -133,22 +149,25 @@ public:
 
     void swap(Bitmap& other);
 
-    const char* getBitmap() const
-    {
-        return &_map.front();
-    }
+    ///Returns the state of the pixel (x,y), which must be in the bounds
+    int getPixel(int x, int y) const;
 
-    char* getBitmap()
-    {
-        return &_map.front();
-    }
+    void copyBitmapPortion(const RectI& roi, const Bitmap& other);
 
-    const char* getBitmapAt(int x, int y) const;
-    char* getBitmapAt(int x, int y);
+    /**
+     * @brief Sets each pixel of dstRoI to 1 if all the pixels of other it covers at the mipmap level above are 1,
+     * and to 0 otherwise, see Image::halveRoI()
+     **/
+    void halveBitmapPortion(const RectI& dstRoI, const Bitmap& other);
 
-    void copyRowPortion(int x1, int x2, int y, const Bitmap& other);
+    ///Returns the number of tiles of the bitmap
+    std::size_t getTilesCount() const
+    {
+        return _tileStates.size();
+    }
 
-    void copyBitmapPortion(const RectI& roi, const Bitmap& other);
+    ///Returns the number of bytes currently used to store the state of the pixels
+    std::size_t getMemorySize() const;
 
     void setDirtyZone(const RectI& zone)
     {
@@ -157,11 +176,58 @@ public:
     }
 
 private:
+
+    enum SideEnum
+    {
+        eSideBottom = 0,
+        eSideTop,
+        eSideLeft,
+        eSideRight
+    };
+
     void markFor(const RectI & roi, char value);
 
+    ///Returns the part of the tile (tx,ty) that is in the bounds
+    RectI getTileRect(int tx, int ty) const;
+
+    ///Returns the pixels of the tile at index, allocating them first if the tile was uniform
+    unsigned char* getTilePixelsForWriting(int index);
+
+    ///Sets all the pixels of the tile at index to state, releasing its pixels if it was mixed
+    void setUniformTile(int index, unsigned char state);
+
+    ///If all the pixels of the tile in the bounds have the same state, only store that state
+    void compactTile(int tx, int ty);
+
+    ///Returns true if rect contains a pixel whose state s is in statesMask (i.e: statesMask & (1 << s))
+    bool containsAny(const RectI& rect, int statesMask) const;
+
+    ///Returns the state of the first pixel of the row or column line that is in statesMask, or -1
+    int findFirst(const RectI& line, int statesMask) const;
+
+    void trimLines(RectI* rect, SideEnum side, int stopMask, int trimmedFlagMask, int stopFlagMask, bool* flagged) const;
+
+    template <int trimap>
+    RectI minimalNonMarkedBbox_internal(const RectI& roi, bool* isBeingRenderedElsewhere) const;
+
+    template <int trimap>
+    void minimalNonMarkedRects_internal(const RectI & roi, std::list<RectI>& ret, bool* isBeingRenderedElsewhere) const;
+
 private:
     RectI _bounds;
-    std::vector<char> _map;
+
+    ///Index of the first tile of the grid and number of tiles in each direction
+    int _tilesX1, _tilesY1;
+    int _tilesWidth, _tilesHeight;
+
+    ///For each tile, the state of all its pixels, or 3 when they differ
+    std::vector<unsigned char> _tileStates;
+
+    ///For each mixed tile, 2 bits per pixel, empty for the others
+    std::vector<std::vector<unsigned char> > _tilePixels;
+
+    ///Number of mixed tiles, so that getMemorySize() does not visit all the tiles
+    std::size_t _mixedTilesCount;
 
     /**
      * This represents the zone that has potentially something to render. In minimalNonMarkedRects
@@ -300,15 +366,9 @@ public:
     };
     virtual size_t size() const OVERRIDE FINAL
     {
-        std::size_t dt = dataSize();
-        bool got = _entryLock.tryLockForRead();
-
-        dt += _bitmap.getBounds().area();
-        if (got) {
-            _entryLock.unlock();
-        }
-
-        return dt;
+        // The memory of the bitmap is atomic: the cache calls this while notified of its changes by onBitmapChanged(),
+        // which holds the entry lock
+        return dataSize() + _bitmapMemorySize.load();
     }
 
     ///Overridden from BufferableObject
@@ -317,6 +377,12 @@ public:
         return size();
     }
 
+    ///The bytes of the components are compressed, not the bytes of the unsigned char buffer
+    virtual std::size_t getCompressionElementSize() const OVERRIDE FINAL
+    {
+        return getSizeOfForBitDepth(_bitDepth);
+    }
+
     unsigned int getMipmapLevel() const
     {
         return this->_params->getMipmapLevel();
@@ -405,14 +471,6 @@ public:
 
             return img->pixelAt(x, y);
         }
-
-        const char* bitmapAt(int x,
-                             int y) const
-        {
-            assert(img);
-
-            return img->getBitmapAt(x, y);
-        }
     };
 
     typedef std::shared_ptr<ReadAccess> ReadAccessPtr;
@@ -457,14 +515,6 @@ public:
         {
             return img->pixelAt(x, y);
         }
-
-        char* bitmapAt(int x,
-                       int y) const
-        {
-            assert(img);
-
-            return img->getBitmapAt(x, y);
-        }
     };
 
     typedef std::shared_ptr<WriteAccess> WriteAccessPtr;
@@ -491,18 +541,6 @@ private:
      * of an image.
      **/
 
-    const char* getBitmapAt(int x,
-                            int y) const
-    {
-        return this->_bitmap.getBitmapAt(x, y);
-    }
-
-    char* getBitmapAt(int x,
-                      int y)
-    {
-        return this->_bitmap.getBitmapAt(x, y);
-    }
-
     /**
      * @brief Access pixels. The pointer must be cast to the appropriate type afterwards.
      **/
@@ -682,6 +720,7 @@ public:
         QWriteLocker locker(&_entryLock);
         const RectI intersection = _bounds.intersect(roi);
         _bitmap.markForRendered(intersection);
+        onBitmapChanged();
     }
 
 #if NATRON_ENABLE_TRIMAP
@@ -694,6 +733,7 @@ public:
         QWriteLocker locker(&_entryLock);
         const RectI intersection = _bounds.intersect(roi);
         _bitmap.markForRendering(intersection);
+        onBitmapChanged();
     }
 
 #endif
@@ -706,6 +746,7 @@ public:
         QWriteLocker locker(&_entryLock);
         const RectI intersection = _bounds.intersect(roi);
         _bitmap.clear(intersection);
+        onBitmapChanged();
     }
 
 #ifdef DEBUG
@@ -1019,10 +1060,17 @@ private:
 
     bool checkForNaNsNoLock(const RectI& roi) const WARN_UNUSED_RETURN;
 
+    /**
+     * @brief Must be called after the bitmap changed, with the entry lock taken for writing if the image is shared.
+     * Notifies the cache of the change of the memory used by the bitmap, which is counted in size().
+     **/
+    void onBitmapChanged();
+
 private:
     ImageBitDepthEnum _bitDepth;
     int _depthBytesSize;
     Bitmap _bitmap;
+    std::atomic<std::size_t> _bitmapMemorySize; // the memory of the bitmap counted in size()
     RectD _rod;     // rod in canonical coordinates (not the same as the OFX::Image RoD, which is in pixel coordinates)
     RectI _bounds;
     double _par;
@@ -1064,6 +1112,10 @@ template<>
 inline float
 Image::clampIfInt(float v) { return v; }
 
+template<>
+inline Half
+Image::clampIfInt(float v) { return v; }
+
 NATRON_NAMESPACE_EXIT
 
 #endif // NATRON_ENGINE_IMAGE_H
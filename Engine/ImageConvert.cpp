@@ -103,6 +103,88 @@ Image::convertPixelDepth(float pix)
     return pix;
 }
 
+template <>
+Half
+Image::convertPixelDepth(unsigned char pix)
+{
+    return Color::intToFloat<256>(pix);
+}
+
+template <>
+Half
+Image::convertPixelDepth(unsigned short pix)
+{
+    return Color::intToFloat<65536>(pix);
+}
+
+template <>
+Half
+Image::convertPixelDepth(float pix)
+{
+    return pix;
+}
+
+template <>
+Half
+Image::convertPixelDepth(Half pix)
+{
+    return pix;
+}
+
+template <>
+unsigned char
+Image::convertPixelDepth(Half pix)
+{
+    return (unsigned char)Color::floatToInt<256>(pix);
+}
+
+template <>
+unsigned short
+Image::convertPixelDepth(Half pix)
+{
+    return (unsigned short)Color::floatToInt<65536>(pix);
+}
+
+template <>
+float
+Image::convertPixelDepth(Half pix)
+{
+    return pix;
+}
+
+///Converts a row between depths without colorspace conversion, returns false if there is no
+///vectorized version for these depths
+template <typename SRCPIX, typename DSTPIX>
+static bool
+convertRowDepth(const SRCPIX* /*src*/,
+                DSTPIX* /*dst*/,
+                std::size_t /*count*/)
+{
+    return false;
+}
+
+template <>
+bool
+convertRowDepth(const Half* src,
+                float* dst,
+                std::size_t count)
+{
+    halfToFloatRow(src, dst, count);
+
+    return true;
+}
+
+template <>
+bool
+convertRowDepth(const float* src,
+                Half* dst,
+                std::size_t count)
+{
+    floatToHalfRow(src, dst, count);
+
+    return true;
+}
+
 static const Color::Lut*
 lutFromColorspace(ViewerColorSpaceEnum cs)
 {
@@ -160,6 +242,25 @@ Image::convertToFormatInternal_sameComps(const RectI & renderWindow,
     if ( intersection.isNull() ) {
         return;
     }
+
+    if (!srcLutOp && !dstLutOp) {
+        // No error diffusion is needed, e.g. half <-> float: convert whole rows
+        const std::size_t rowElements = (std::size_t)intersection.width() * nComp;
+        bool converted = true;
+        for (int y = 0; y < intersection.height() && converted; ++y) {
+            const SRCPIX* srcPixels = (const SRCPIX*)srcImg.pixelAt(intersection.x1, intersection.y1 + y);
+            DSTPIX* dstPixels = (DSTPIX*)dstImg.pixelAt(intersection.x1, intersection.y1 + y);
+            converted = convertRowDepth<SRCPIX, DSTPIX>(srcPixels, dstPixels, rowElements);
+        }
+        if (converted) {
+            if (copyBitmap) {
+                dstImg.copyBitmapPortion(intersection, srcImg);
+            }
+
+            return;
+        }
+    }
+
     for (int y = 0; y < intersection.height(); ++y) {
         // coverity[dont_call]
         int start = rand() % intersection.width();
@@ -204,7 +305,7 @@ Image::convertToFormatInternal_sameComps(const RectI & renderWindow,
                                                              Color::floatToInt<0xff01>(pixFloat) );
                             pix = error[k] >> 8;
                         } else if (dstDepth == eImageBitDepthShort) {
-                            pix = dstLutOp ? dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) :
+                            pix = dstLutOp ? (DSTPIX)dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) :
                                   convertPixelDepth<float, DSTPIX>(pixFloat);
                         } else {
                             if (dstLutOp) {
@@ -340,11 +441,11 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
                         break;
                     case 3:
                         // RGB is opaque, so no alpha, unless channelForAlpha is 0-2
-                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? 0. : srcPixels[channelForAlpha]);
+                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? SRCPIX(0) : srcPixels[channelForAlpha]);
                         break;
                     case 2:
                         // XY is opaque unless channelForAlpha is  0-1
-                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? 0. : srcPixels[channelForAlpha]);
+                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? SRCPIX(0) : srcPixels[channelForAlpha]);
                         break;
                     case 1:
                         // just copy alpha disregarding channelForAlpha
@@ -426,7 +527,7 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
                                                                      Color::floatToInt<0xff01>(pixFloat) );
                                     pix = error[k] >> 8;
                                 } else if (dstMaxValue == 65535) {
-                                    pix = dstLutOp ? dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) :
+                                    pix = dstLutOp ? (DSTPIX)dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) :
                                           convertPixelDepth<float, DSTPIX>(pixFloat);
                                 } else {
                                     if (dstLutOp) {
@@ -699,6 +800,9 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                              dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternal_sameComps<Half, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
+                                                                               srcColorSpace,
+                                                                               dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternal_sameComps<float, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
@@ -725,6 +829,9 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                                 dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternal_sameComps<Half, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
+                                                                                  srcColorSpace,
+                                                                                  dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternal_sameComps<float, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
@@ -737,8 +844,34 @@ Image::convertToFormatCommon(const RectI & renderWindow,
             break;
         }
 
-        case eImageBitDepthHalf:
+        case eImageBitDepthHalf: {
+            switch ( getBitDepth() ) {
+            case eImageBitDepthByte:
+                convertToFormatInternal_sameComps<unsigned char, Half, 255, 1>(renderWindow, *this, *dstImg,
+                                                                               srcColorSpace,
+                                                                               dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthShort:
+                convertToFormatInternal_sameComps<unsigned short, Half, 65535, 1>(renderWindow, *this, *dstImg,
+                                                                                  srcColorSpace,
+                                                                                  dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthHalf:
+                ///Same as a copy
+                convertToFormatInternal_sameComps<Half, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                    srcColorSpace,
+                                                                    dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthFloat:
+                convertToFormatInternal_sameComps<float, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                     srcColorSpace,
+                                                                     dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthNone:
+                break;
+            }
             break;
+        }
 
         case eImageBitDepthFloat: {
             switch ( getBitDepth() ) {
@@ -753,6 +886,9 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                    dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternal_sameComps<Half, float, 1, 1>(renderWindow, *this, *dstImg,
+                                                                     srcColorSpace,
+                                                                     dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthFloat:
                 ///Same as a copy
@@ -790,6 +926,12 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                            copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
+                                                                             srcColorSpace,
+                                                                             dstColorSpace,
+                                                                             channelForAlpha,
+                                                                             useAlpha0,
+                                                                             copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternalForDepth<float, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
@@ -826,6 +968,12 @@ Image::convertToFormatCommon(const RectI & renderWindow,
 
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
+                                                                                srcColorSpace,
+                                                                                dstColorSpace,
+                                                                                channelForAlpha,
+                                                                                useAlpha0,
+                                                                                copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternalForDepth<float, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
@@ -840,8 +988,45 @@ Image::convertToFormatCommon(const RectI & renderWindow,
             }
             break;
         }
-        case eImageBitDepthHalf:
+        case eImageBitDepthHalf: {
+            switch ( getBitDepth() ) {
+            case eImageBitDepthByte:
+                convertToFormatInternalForDepth<unsigned char, Half, 255, 1>(renderWindow, *this, *dstImg,
+                                                                             srcColorSpace,
+                                                                             dstColorSpace,
+                                                                             channelForAlpha,
+                                                                             useAlpha0,
+                                                                             copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthShort:
+                convertToFormatInternalForDepth<unsigned short, Half, 65535, 1>(renderWindow, *this, *dstImg,
+                                                                                srcColorSpace,
+                                                                                dstColorSpace,
+                                                                                channelForAlpha,
+                                                                                useAlpha0,
+                                                                                copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                  srcColorSpace,
+                                                                  dstColorSpace,
+                                                                  channelForAlpha,
+                                                                  useAlpha0,
+                                                                  copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthFloat:
+                convertToFormatInternalForDepth<float, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                   srcColorSpace,
+                                                                   dstColorSpace,
+                                                                   channelForAlpha,
+                                                                   useAlpha0,
+                                                                   copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthNone:
+                break;
+            }
             break;
+        }
         case eImageBitDepthFloat: {
             switch ( getBitDepth() ) {
             case eImageBitDepthByte:
@@ -862,6 +1047,12 @@ Image::convertToFormatCommon(const RectI & renderWindow,
 
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, float, 1, 1>(renderWindow, *this, *dstImg,
+                                                                   srcColorSpace,
+                                                                   dstColorSpace,
+                                                                   channelForAlpha,
+                                                                   useAlpha0,
+                                                                   copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternalForDepth<float, float, 1, 1>(renderWindow, *this, *dstImg,
@@ -0,0 +1,483 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ImageScopes.h"
+
+#include <algorithm>
+#include <cassert>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Engine/AppManager.h"
+#include "Engine/Image.h"
+#include "Engine/TileScheduler.h"
+
+NATRON_NAMESPACE_ENTER
+
+// Offsets returned by getChannelOffset() for the channels which are not read directly
+#define SCOPES_CHANNEL_LUMINANCE -1
+#define SCOPES_CHANNEL_MISSING -2
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+/**
+ * @brief The pixels of the rect of an image that the scopes read.
+ **/
+struct ScopesSource
+{
+    RectI rect;
+    const float* pixels; //< the bottom-left pixel of the rect
+    std::size_t rowElements; //< number of floats between two rows
+    int nComps;
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+/**
+ * @brief Clips the rect to the image and fills src. Returns false if there is nothing to read.
+ * The pixels remain valid as long as acc lives.
+ **/
+static bool
+getScopesSource(const ImagePtr& image,
+                const RectI& rect,
+                const Image::ReadAccess& acc,
+                ScopesSource* src)
+{
+    if ( !image || ( image->getBitDepth() != eImageBitDepthFloat ) ) {
+        // Images come from the viewer which is in float
+        assert(!image);
+
+        return false;
+    }
+    src->rect = rect.intersect( image->getBounds() );
+    if ( src->rect.isNull() ) {
+        return false;
+    }
+    src->pixels = (const float*)acc.pixelAt(src->rect.x1, src->rect.y1);
+    src->rowElements = image->getRowElements();
+    src->nComps = (int)image->getComponentsCount();
+
+    return src->pixels != 0;
+}
+
+/**
+ * @brief Returns the offset of the channel in a pixel, or one of SCOPES_CHANNEL_LUMINANCE and SCOPES_CHANNEL_MISSING.
+ **/
+static int
+getChannelOffset(DisplayChannelsEnum channel,
+                 int nComps)
+{
+    switch (channel) {
+    case eDisplayChannelsR:
+    case eDisplayChannelsG:
+    case eDisplayChannelsB: {
+        int offset = (int)channel - (int)eDisplayChannelsR;
+
+        return nComps >= 3 ? offset : SCOPES_CHANNEL_MISSING;
+    }
+    case eDisplayChannelsA:
+        if (nComps == 4) {
+            return 3;
+        }
+
+        return nComps == 1 ? 0 : SCOPES_CHANNEL_MISSING;
+    case eDisplayChannelsY:
+        return nComps >= 3 ? SCOPES_CHANNEL_LUMINANCE : SCOPES_CHANNEL_MISSING;
+    default:
+        return SCOPES_CHANNEL_MISSING;
+    }
+}
+
+/**
+ * @brief Computes the bin of each of the width pixels of a row, or binsCount for the pixels out of [vmin, vmax[.
+ * There is no branch in the loops, so that the compiler vectorizes them.
+ **/
+template <int nComps>
+static void
+computeRowBinsForComps(const float* pix,
+                       int width,
+                       int offset,
+                       float vmin,
+                       float scale,
+                       int binsCount,
+                       int* bins)
+{
+    const float maxBin = (float)binsCount;
+
+    if (offset == SCOPES_CHANNEL_LUMINANCE) {
+        for (int x = 0; x < width; ++x) {
+            const float* p = pix + x * nComps;
+            float f = (0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] - vmin) * scale;
+            bins[x] = (f >= 0.f && f < maxBin) ? (int)f : binsCount;
+        }
+    } else {
+        for (int x = 0; x < width; ++x) {
+            float f = (pix[x * nComps + offset] - vmin) * scale;
+            bins[x] = (f >= 0.f && f < maxBin) ? (int)f : binsCount;
+        }
+    }
+}
+
+#ifdef __SSE2__
+/**
+ * @brief Same as computeRowBinsForComps<4>, 4 pixels at a time, which are transposed to get one register per channel.
+ * Returns the number of pixels processed, the remaining ones must be processed by computeRowBinsForComps.
+ **/
+static int
+computeRowBinsRGBA_SSE2(const float* pix,
+                        int width,
+                        int offset,
+                        float vmin,
+                        float scale,
+                        int binsCount,
+                        int* bins)
+{
+    const __m128 vminV = _mm_set1_ps(vmin);
+    const __m128 scaleV = _mm_set1_ps(scale);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 maxBinV = _mm_set1_ps( (float)binsCount );
+    const __m128i outOfRangeV = _mm_set1_epi32(binsCount);
+    const __m128 rWeight = _mm_set1_ps(0.299f);
+    const __m128 gWeight = _mm_set1_ps(0.587f);
+    const __m128 bWeight = _mm_set1_ps(0.114f);
+    int x = 0;
+
+    for (; x + 4 <= width; x += 4) {
+        __m128 p0 = _mm_loadu_ps(pix + x * 4);
+        __m128 p1 = _mm_loadu_ps(pix + x * 4 + 4);
+        __m128 p2 = _mm_loadu_ps(pix + x * 4 + 8);
+        __m128 p3 = _mm_loadu_ps(pix + x * 4 + 12);
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        __m128 v;
+        switch (offset) {
+        case 0:
+            v = p0;
+            break;
+        case 1:
+            v = p1;
+            break;
+        case 2:
+            v = p2;
+            break;
+        case 3:
+            v = p3;
+            break;
+        default:
+            v = _mm_add_ps( _mm_add_ps( _mm_mul_ps(rWeight, p0), _mm_mul_ps(gWeight, p1) ), _mm_mul_ps(bWeight, p2) );
+            break;
+        }
+        __m128 f = _mm_mul_ps(_mm_sub_ps(v, vminV), scaleV);
+        // both comparisons are false for NaNs
+        __m128i inRange = _mm_castps_si128( _mm_and_ps( _mm_cmpge_ps(f, zero), _mm_cmplt_ps(f, maxBinV) ) );
+        __m128i b = _mm_cvttps_epi32(f);
+        b = _mm_or_si128( _mm_and_si128(inRange, b), _mm_andnot_si128(inRange, outOfRangeV) );
+        _mm_storeu_si128( (__m128i*)(bins + x), b );
+    }
+
+    return x;
+}
+
+#endif // __SSE2__
+
+static void
+computeRowBins(const float* pix,
+               int width,
+               int nComps,
+               int offset,
+               float vmin,
+               float scale,
+               int binsCount,
+               int* bins)
+{
+    switch (nComps) {
+    case 1:
+        computeRowBinsForComps<1>(pix, width, offset, vmin, scale, binsCount, bins);
+        break;
+    case 2:
+        computeRowBinsForComps<2>(pix, width, offset, vmin, scale, binsCount, bins);
+        break;
+    case 3:
+        computeRowBinsForComps<3>(pix, width, offset, vmin, scale, binsCount, bins);
+        break;
+    case 4: {
+        int x = 0;
+#ifdef __SSE2__
+        // viewer images are RGBA: the compiler does not vectorize the strided loads by itself at -O2
+        x = computeRowBinsRGBA_SSE2(pix, width, offset, vmin, scale, binsCount, bins);
+#endif
+        computeRowBinsForComps<4>(pix + x * 4, width - x, offset, vmin, scale, binsCount, bins + x);
+        break;
+    }
+    default:
+        assert(false);
+        std::fill(bins, bins + width, binsCount);
+        break;
+    }
+}
+
+/**
+ * @brief Calls func(i) for each task, on the threads of the TileScheduler if the application has one.
+ **/
+static void
+runScopesTasks(int nTasks,
+               const std::function<void(int)>& func)
+{
+    TileScheduler* scheduler = appPTR ? appPTR->getTileScheduler() : 0;
+
+    if ( !scheduler || (nTasks <= 1) ) {
+        for (int i = 0; i < nTasks; ++i) {
+            func(i);
+        }
+    } else {
+        scheduler->run(nTasks, func);
+    }
+}
+
+/**
+ * @brief Returns the number of tasks to process the given number of pixels, at most maxTasks.
+ **/
+static int
+getScopesTasksCount(const RectI& rect,
+                    int maxTasks)
+{
+    TileScheduler* scheduler = appPTR ? appPTR->getTileScheduler() : 0;
+    int maxConcurrency = scheduler ? scheduler->getMaxConcurrency() : 1;
+    int nTasks = (int)std::min( (U64)maxConcurrency, rect.area() / NATRON_IMAGE_SCOPES_MIN_PIXELS_PER_TASK );
+
+    return std::max( 1, std::min(nTasks, maxTasks) );
+}
+
+void
+ImageScopes::computeHistograms(const ImagePtr& image,
+                               const RectI& rect,
+                               const std::vector<DisplayChannelsEnum>& channels,
+                               int binsCount,
+                               double vmin,
+                               double vmax,
+                               std::vector<std::vector<float> >* histograms)
+{
+    assert(histograms);
+    const int nChannels = (int)channels.size();
+    histograms->resize(nChannels);
+    for (int c = 0; c < nChannels; ++c) {
+        (*histograms)[c].assign(std::max(0, binsCount), 0.f);
+    }
+    if ( (binsCount <= 0) || (vmax <= vmin) || (nChannels == 0) ) {
+        return;
+    }
+
+    Image::ReadAccess acc = image ? image->getReadRights() : Image::ReadAccess(0);
+    ScopesSource src;
+    if ( !getScopesSource(image, rect, acc, &src) ) {
+        return;
+    }
+    std::vector<int> offsets(nChannels);
+    for (int c = 0; c < nChannels; ++c) {
+        offsets[c] = getChannelOffset(channels[c], src.nComps);
+    }
+
+    const int width = src.rect.width();
+    const int height = src.rect.height();
+    const int nTasks = getScopesTasksCount(src.rect, height);
+    const float scale = (float)(binsCount / (vmax - vmin));
+
+    // The bins of each task and channel, the last one counts the pixels out of range
+    const std::size_t countsSize = (std::size_t)binsCount + 1;
+    std::vector<std::vector<U32> > counts(nTasks);
+
+    runScopesTasks(nTasks, [&](int t) {
+        int y1 = (int)( (U64)height * t / nTasks );
+        int y2 = (int)( (U64)height * (t + 1) / nTasks );
+        std::vector<U32>& taskCounts = counts[t];
+        taskCounts.assign(countsSize * nChannels, 0);
+        std::vector<int> bins(width);
+        for (int y = y1; y < y2; ++y) {
+            const float* row = src.pixels + y * src.rowElements;
+            for (int c = 0; c < nChannels; ++c) {
+                if (offsets[c] == SCOPES_CHANNEL_MISSING) {
+                    continue;
+                }
+                computeRowBins(row, width, src.nComps, offsets[c], (float)vmin, scale, binsCount, &bins[0]);
+                U32* channelCounts = &taskCounts[countsSize * c];
+                for (int x = 0; x < width; ++x) {
+                    ++channelCounts[bins[x]];
+                }
+            }
+        }
+    });
+
+    for (int t = 0; t < nTasks; ++t) {
+        for (int c = 0; c < nChannels; ++c) {
+            const U32* taskCounts = &counts[t][countsSize * c];
+            std::vector<float>& histogram = (*histograms)[c];
+            for (int b = 0; b < binsCount; ++b) {
+                histogram[b] += (float)taskCounts[b];
+            }
+        }
+    }
+} // ImageScopes::computeHistograms
+
+void
+ImageScopes::computeWaveform(const ImagePtr& image,
+                             const RectI& rect,
+                             DisplayChannelsEnum channel,
+                             int columnsCount,
+                             int binsCount,
+                             double vmin,
+                             double vmax,
+                             std::vector<float>* waveform)
+{
+    assert(waveform);
+    waveform->assign( (std::size_t)std::max(0, columnsCount) * std::max(0, binsCount), 0.f );
+    if ( (columnsCount <= 0) || (binsCount <= 0) || (vmax <= vmin) ) {
+        return;
+    }
+
+    Image::ReadAccess acc = image ? image->getReadRights() : Image::ReadAccess(0);
+    ScopesSource src;
+    if ( !getScopesSource(image, rect, acc, &src) ) {
+        return;
+    }
+    const int offset = getChannelOffset(channel, src.nComps);
+    if (offset == SCOPES_CHANNEL_MISSING) {
+        return;
+    }
+
+    const int width = src.rect.width();
+    const int height = src.rect.height();
+    const float scale = (float)(binsCount / (vmax - vmin));
+
+    // The tasks own disjoint ranges of columns of the waveform, so they count directly in it.
+    // The extra row counts the pixels out of range.
+    const int nTasks = getScopesTasksCount(src.rect, columnsCount);
+    std::vector<U32> counts( (std::size_t)columnsCount * (binsCount + 1), 0 );
+
+    runScopesTasks(nTasks, [&](int t) {
+        int c1 = (int)( (U64)columnsCount * t / nTasks );
+        int c2 = (int)( (U64)columnsCount * (t + 1) / nTasks );
+        // The image columns x such that x * columnsCount / width is in [c1, c2)
+        int x1 = (int)( ( (U64)c1 * width + columnsCount - 1 ) / columnsCount );
+        int x2 = (int)( ( (U64)c2 * width + columnsCount - 1 ) / columnsCount );
+        int taskWidth = x2 - x1;
+        if (taskWidth <= 0) {
+            return;
+        }
+        std::vector<int> columns(taskWidth);
+        for (int x = 0; x < taskWidth; ++x) {
+            columns[x] = (int)( (U64)(x1 + x) * columnsCount / width );
+        }
+        std::vector<int> bins(taskWidth);
+        for (int y = 0; y < height; ++y) {
+            const float* row = src.pixels + y * src.rowElements + (std::size_t)x1 * src.nComps;
+            computeRowBins(row, taskWidth, src.nComps, offset, (float)vmin, scale, binsCount, &bins[0]);
+            for (int x = 0; x < taskWidth; ++x) {
+                ++counts[(std::size_t)bins[x] * columnsCount + columns[x]];
+            }
+        }
+    });
+
+    std::copy( counts.begin(), counts.begin() + waveform->size(), waveform->begin() );
+} // ImageScopes::computeWaveform
+
+/**
+ * @brief Computes the index in the vectorscope of each of the width pixels of a row, or size * size for
+ * the pixels whose chroma is out of range.
+ **/
+template <int nComps>
+static void
+computeRowChromaBins(const float* pix,
+                     int width,
+                     int size,
+                     int* bins)
+{
+    const float scale = (float)size;
+    const float maxBin = (float)size;
+    const int outOfRange = size * size;
+
+    for (int x = 0; x < width; ++x) {
+        const float* p = pix + x * nComps;
+        float u = (-0.168736f * p[0] - 0.331264f * p[1] + 0.5f * p[2] + 0.5f) * scale;
+        float v = (0.5f * p[0] - 0.418688f * p[1] - 0.081312f * p[2] + 0.5f) * scale;
+        // Chroma of exactly 0.5 belong to the last bin
+        u = (u == maxBin) ? maxBin - 1.f : u;
+        v = (v == maxBin) ? maxBin - 1.f : v;
+        bool inRange = u >= 0.f && u < maxBin && v >= 0.f && v < maxBin;
+        bins[x] = inRange ? (int)v * size + (int)u : outOfRange;
+    }
+}
+
+void
+ImageScopes::computeVectorscope(const ImagePtr& image,
+                                const RectI& rect,
+                                int size,
+                                std::vector<float>* vectorscope)
+{
+    assert(vectorscope);
+    vectorscope->assign( (std::size_t)std::max(0, size) * std::max(0, size), 0.f );
+    if (size <= 0) {
+        return;
+    }
+
+    Image::ReadAccess acc = image ? image->getReadRights() : Image::ReadAccess(0);
+    ScopesSource src;
+    if ( !getScopesSource(image, rect, acc, &src) || (src.nComps < 3) ) {
+        return;
+    }
+
+    const int width = src.rect.width();
+    const int height = src.rect.height();
+    const int nTasks = getScopesTasksCount(src.rect, height);
+    const std::size_t countsSize = (std::size_t)size * size + 1;
+    std::vector<std::vector<U32> > counts(nTasks);
+
+    runScopesTasks(nTasks, [&](int t) {
+        int y1 = (int)( (U64)height * t / nTasks );
+        int y2 = (int)( (U64)height * (t + 1) / nTasks );
+        std::vector<U32>& taskCounts = counts[t];
+        taskCounts.assign(countsSize, 0);
+        std::vector<int> bins(width);
+        for (int y = y1; y < y2; ++y) {
+            const float* row = src.pixels + y * src.rowElements;
+            if (src.nComps == 4) {
+                computeRowChromaBins<4>(row, width, size, &bins[0]);
+            } else {
+                computeRowChromaBins<3>(row, width, size, &bins[0]);
+            }
+            for (int x = 0; x < width; ++x) {
+                ++taskCounts[bins[x]];
+            }
+        }
+    });
+
+    for (int t = 0; t < nTasks; ++t) {
+        for (std::size_t i = 0; i < vectorscope->size(); ++i) {
+            (*vectorscope)[i] += (float)counts[t][i];
+        }
+    }
+} // ImageScopes::computeVectorscope
+
+NATRON_NAMESPACE_EXIT
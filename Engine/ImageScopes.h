@@ -0,0 +1,95 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_ImageScopes_h
+#define Natron_Engine_ImageScopes_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+
+#include "Global/Enums.h"
+#include "Engine/RectI.h"
+#include "Engine/EngineFwd.h"
+
+// Minimum number of pixels processed by a task of the scopes
+#define NATRON_IMAGE_SCOPES_MIN_PIXELS_PER_TASK (64 * 1024)
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Computes the histograms, waveforms and vectorscopes of the float images displayed by the viewers.
+ * The image is read row by row: the bins of a whole row are first computed in a loop the compiler vectorizes,
+ * then counted. The rows are split across the threads of the TileScheduler, each task counting in its own bins,
+ * which are summed at the end.
+ * Channels are selected with the DisplayChannelsEnum of the viewer: R, G, B, A or Y, the luminance computed
+ * like the viewer does (0.299 R + 0.587 G + 0.114 B).
+ * These functions are MT-safe.
+ **/
+class ImageScopes
+{
+public:
+
+    /**
+     * @brief Computes the histogram of each channel in a single pass over the rect of the image.
+     * A pixel whose value v satisfies vmin <= v < vmax is counted in bin (v - vmin) * binsCount / (vmax - vmin),
+     * other pixels are ignored. histograms[i] receives the binsCount bins of channels[i].
+     **/
+    static void computeHistograms(const ImagePtr& image,
+                                  const RectI& rect,
+                                  const std::vector<NATRON_ENUM::DisplayChannelsEnum>& channels,
+                                  int binsCount,
+                                  double vmin,
+                                  double vmax,
+                                  std::vector<std::vector<float> >* histograms);
+
+    /**
+     * @brief Computes the waveform of a channel: for each of the columnsCount columns of the scope, which spans the
+     * width of the rect, the histogram of the pixels of the corresponding image columns with binsCount bins in [vmin, vmax[.
+     * waveform receives binsCount rows of columnsCount counts, the row of the lowest values first.
+     **/
+    static void computeWaveform(const ImagePtr& image,
+                                const RectI& rect,
+                                NATRON_ENUM::DisplayChannelsEnum channel,
+                                int columnsCount,
+                                int binsCount,
+                                double vmin,
+                                double vmax,
+                                std::vector<float>* waveform);
+
+    /**
+     * @brief Computes the vectorscope of the rect: the 2D histogram of the chroma (Cb, Cr) of the pixels in the
+     * Rec.601 YCbCr matching the luminance above. Both are in [-0.5, 0.5] and split in size bins.
+     * vectorscope receives size rows (Cr, lowest first) of size counts (Cb, lowest first).
+     **/
+    static void computeVectorscope(const ImagePtr& image,
+                                   const RectI& rect,
+                                   int size,
+                                   std::vector<float>* vectorscope);
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_ImageScopes_h
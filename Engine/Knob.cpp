@@ -31,6 +31,7 @@
 #include <stdexcept>
 #include <sstream> // stringstream
 #include <cctype> // isspace
+#include <cmath> // floor
 
 #include <QtCore/QDataStream>
 #include <QtCore/QDateTime>
@@ -51,6 +52,7 @@
 #include "Engine/KnobSerialization.h"
 #include "Engine/KnobTypes.h"
 #include "Engine/LibraryBinary.h"
+#include "Engine/NativeExpression.h"
 #include "Engine/Node.h"
 #include "Engine/Project.h"
 #include "Engine/StringAnimationManager.h"
@@ -360,6 +362,10 @@ typedef std::vector<std::pair<int, KnobIWPtr> > MastersMap;
 ///a curve for each dimension
 typedef std::vector<CurvePtr> CurvesMap;
 
+// A validated expression is stored as the assignment of its function to this variable, see validateExpression()
+static const char kExpressionFunctionPrefix[] = "ret = ";
+static const std::size_t kExpressionFunctionPrefixLen = sizeof(kExpressionFunctionPrefix) - 1;
+
 struct Expr
 {
     std::string expression; //< the one modified by Natron
@@ -370,10 +376,15 @@ struct Expr
     ///The list of pair<knob, dimension> dpendencies for an expression
     std::list<std::pair<KnobIWPtr, int> > dependencies;
 
-    //PyObject* code;
+    ///The compiled look-up of the Python function of the expression, created on the first evaluation
+    ///and released when the expression changes. Only accessed with the Python GIL held.
+    PyObject* code;
+
+    ///The expression compiled to native code, or null if it is not in the subset supported by NativeExpression.
+    NativeExpressionPtr native;
 
     Expr()
-        : expression(), originalExpression(), exprInvalid(), hasRet(false) /*, code(0)*/ {}
+        : expression(), originalExpression(), exprInvalid(), hasRet(false), code(0), native() {}
 };
 
 struct KnobHelperPrivate
@@ -579,6 +590,21 @@ KnobHelper::KnobHelper(KnobHolder* holder,
 
 KnobHelper::~KnobHelper()
 {
+    bool hasCode = false;
+    for (std::size_t i = 0; i < _imp->expressions.size(); ++i) {
+        if (_imp->expressions[i].code) {
+            hasCode = true;
+            break;
+        }
+    }
+    // Python may already be finalized when the application quits
+    if ( hasCode && Py_IsInitialized() ) {
+        PythonGILLocker pgl;
+        for (std::size_t i = 0; i < _imp->expressions.size(); ++i) {
+            Py_XDECREF(_imp->expressions[i].code);
+            _imp->expressions[i].code = 0;
+        }
+    }
 }
 
 void
@@ -1836,6 +1862,14 @@ KnobHelper::evaluateValueChangeInternal(int dimension,
     /// the application responsiveness
     onInternalValueChanged(dimension, time, view);
 
+    EffectInstance* isEffect = dynamic_cast<EffectInstance*>(_imp->holder);
+    if (isEffect) {
+        NodePtr node = isEffect->getNode();
+        if (node) {
+            node->invalidateKnobsHash();
+        }
+    }
+
     bool ret = false;
     if ( ( (originalReason != eValueChangedReasonTimeChanged) || evaluateValueChangeOnTimeChange() ) && _imp->holder ) {
         _imp->holder->beginChanges();
@@ -2661,7 +2695,7 @@ KnobHelper::validateExpression(const std::string& expression,
     script.append(exprCpy);
     script.append(exprFuncPrefix + exprFuncName + " = " + exprFuncName);
 
-    std::string funcExecScript = "ret = " + exprFuncPrefix + exprFuncName;
+    std::string funcExecScript = kExpressionFunctionPrefix + exprFuncPrefix + exprFuncName;
 
     ///Try to compile the expression and evaluate it, if it doesn't have a good syntax, throw an exception
     ///with the error.
@@ -2855,17 +2889,21 @@ KnobHelper::setExpressionInternal(int dimension,
         }
     }
 
+    // Simple single-line expressions are evaluated without Python by the render threads
+    NativeExpressionPtr native;
+    if ( exprInvalid.empty() && !hasRetVariable && !dynamic_cast<KnobStringBase*>(this) ) {
+        native = NativeExpression::compile(expression, this, dimension);
+    }
+
     //Set internal fields
 
     {
         QMutexLocker k(&_imp->expressionMutex);
+        _imp->expressions[dimension].native = native;
         _imp->expressions[dimension].hasRet = hasRetVariable;
         _imp->expressions[dimension].expression = exprCpy;
         _imp->expressions[dimension].originalExpression = expression;
         _imp->expressions[dimension].exprInvalid = exprInvalid;
-
-        ///This may throw an exception upon failure
-        //NATRON_PYTHON_NAMESPACE::compilePyScript(exprCpy, &_imp->expressions[dimension].code);
     }
 
     if ( getHolder() ) {
@@ -2943,6 +2981,66 @@ KnobHelper::getExpressionDependencies(int dimension,
     return false;
 }
 
+void
+KnobHelper::appendToHash(Hash64* hash)
+{
+    int dims = getDimension();
+
+    for (int i = 0; i < dims; ++i) {
+        appendDimensionToHash(i, 0, hash);
+    }
+}
+
+void
+KnobHelper::appendDimensionToHash(int dimension,
+                                  int depth,
+                                  Hash64* hash)
+{
+    std::pair<int, KnobIPtr> master = getMaster(dimension);
+
+    if (master.second) {
+        // The values are read from the master knob
+        master.second->appendDimensionToHash(master.first, depth, hash);
+
+        return;
+    }
+
+    std::string expr;
+    std::list<std::pair<KnobIWPtr, int> > dependencies;
+    {
+        QMutexLocker k(&_imp->expressionMutex);
+        expr = _imp->expressions[dimension].expression;
+        dependencies = _imp->expressions[dimension].dependencies;
+    }
+    if ( !expr.empty() ) {
+        Hash64_appendQString( hash, QString::fromUtf8( expr.c_str() ) );
+        if (depth < NATRON_KNOB_HASH_MAX_EXPRESSION_DEPTH) {
+            for (std::list<std::pair<KnobIWPtr, int> >::const_iterator it = dependencies.begin(); it != dependencies.end(); ++it) {
+                KnobIPtr dependency = it->first.lock();
+                if (!dependency) {
+                    continue;
+                }
+                int depDims = dependency->getDimension();
+                if ( (it->second >= 0) && (it->second < depDims) ) {
+                    dependency->appendDimensionToHash(it->second, depth + 1, hash);
+                } else {
+                    for (int i = 0; i < depDims; ++i) {
+                        dependency->appendDimensionToHash(i, depth + 1, hash);
+                    }
+                }
+            }
+        }
+    }
+
+    // The expression may also read the curve or the value of the knob itself
+    CurvePtr curve = getCurve(ViewIdx(0), dimension, true);
+    if ( curve && (curve->getKeyFramesCount() > 0) ) {
+        curve->appendToHash(hash);
+    } else {
+        appendValueToHash(dimension, hash);
+    }
+}
+
 void
 KnobHelper::clearExpression(int dimension,
                             bool clearResults)
@@ -2955,8 +3053,9 @@ KnobHelper::clearExpression(int dimension,
         _imp->expressions[dimension].expression.clear();
         _imp->expressions[dimension].originalExpression.clear();
         _imp->expressions[dimension].exprInvalid.clear();
-        //Py_XDECREF(_imp->expressions[dimension].code); //< new ref
-        //_imp->expressions[dimension].code = 0;
+        Py_XDECREF(_imp->expressions[dimension].code); //< new ref
+        _imp->expressions[dimension].code = 0;
+        _imp->expressions[dimension].native.reset();
     }
     KnobIPtr thisShared = shared_from_this();
     {
@@ -3066,6 +3165,22 @@ catchErrors(PyObject* mainModule,
     return true;
 }
 
+/// Evaluates the expression of the dimension without Python, returns false if it has no native form.
+bool
+KnobHelper::evaluateNativeExpression(double time,
+                                     ViewIdx view,
+                                     int dimension,
+                                     double* ret) const
+{
+    NativeExpressionPtr native;
+    {
+        QMutexLocker k(&_imp->expressionMutex);
+        native = _imp->expressions[dimension].native;
+    }
+
+    return native && native->evaluate(time, view, ret);
+}
+
 ///The return value must be Py_DECRREF
 /// The Python GIL must be held before calling this, so the the PyObject remains valid.
 bool
@@ -3075,17 +3190,67 @@ KnobHelper::executeExpression(double time,
                               PyObject** ret,
                               std::string* error) const
 {
+#if PY_VERSION_HEX >= 0x030400F0
+    assert(PyGILState_Check());  // Not available prior to Python 3.4
+#endif
+
     std::string expr;
+    PyObject* code;
     {
         QMutexLocker k(&_imp->expressionMutex);
-        expr = _imp->expressions[dimension].expression;
+        Expr& e = _imp->expressions[dimension];
+        expr = e.expression;
+        if ( !e.code && e.exprInvalid.empty() && (expr.compare(0, kExpressionFunctionPrefixLen, kExpressionFunctionPrefix) == 0) ) {
+            // A valid expression is "ret = <path of the expression function>": compile the look-up of the function once
+            // instead of parsing a call of the function at each evaluation
+            e.code = Py_CompileString(expr.c_str() + kExpressionFunctionPrefixLen, "<expression>", Py_eval_input);
+            if (!e.code) {
+                PyErr_Clear();
+            }
+        }
+        code = e.code;
+        Py_XINCREF(code);
     }
-    std::stringstream ss;
 
-    ss << expr << '(' << time << ", " <<  view << ")\n";
+    if (!code) {
+        std::stringstream ss;
 
-    return executeExpression(ss.str(), ret, error);
-}
+        ss << expr << '(' << time << ", " <<  view << ")\n";
+
+        return executeExpression(ss.str(), ret, error);
+    }
+
+    PyObject* mainModule = NATRON_PYTHON_NAMESPACE::getMainModule();
+    PyObject* globalDict = PyModule_GetDict(mainModule);
+
+    PyErr_Clear();
+
+    *ret = 0;
+    PyObject* func = PyEval_EvalCode(code, globalDict, globalDict); // new ref
+    Py_DECREF(code);
+    if (func) {
+        // Pass integer frames as Python ints, as they were when the call was formatted as a string
+        PyObject* frameArg = ( time == std::floor(time) ) ? PyLong_FromLong( (long)time ) : PyFloat_FromDouble(time);
+        PyObject* viewArg = PyLong_FromLong(view);
+        *ret = PyObject_CallFunctionObjArgs(func, frameArg, viewArg, NULL);
+        Py_XDECREF(frameArg);
+        Py_XDECREF(viewArg);
+        Py_DECREF(func);
+    }
+    if ( !catchErrors(mainModule, error) ) {
+        Py_XDECREF(*ret);
+        *ret = 0;
+
+        return false;
+    }
+    if (!*ret) {
+        *error = "Missing 'ret' attribute";
+
+        return false;
+    }
+
+    return true;
+} // KnobHelper::executeExpression
 
 
 /// The return value must be Py_DECRREF
@@ -6500,6 +6665,20 @@ AnimatingKnobStringHelper::saveAnimation(std::map<int, std::string>* keyframes)
     _animation->save(keyframes);
 }
 
+void
+AnimatingKnobStringHelper::appendToHash(Hash64* hash)
+{
+    KnobHelper::appendToHash(hash);
+
+    // The keyframes of the curve only index the strings held by the animation manager
+    std::map<int, std::string> keyframes;
+    _animation->save(&keyframes);
+    for (std::map<int, std::string>::const_iterator it = keyframes.begin(); it != keyframes.end(); ++it) {
+        hash->append(it->first);
+        Hash64_appendQString( hash, QString::fromUtf8( it->second.c_str() ) );
+    }
+}
+
 /***************************KNOB EXPLICIT TEMPLATE INSTANTIATION******************************************/
 
 
@@ -49,6 +49,9 @@
 #define NATRON_USER_MANAGED_KNOBS_PAGE_LABEL "User"
 #define NATRON_USER_MANAGED_KNOBS_PAGE "userNatron"
 
+// How many levels of expression dependencies are followed when hashing the values of a knob
+#define NATRON_KNOB_HASH_MAX_EXPRESSION_DEPTH 4
+
 NATRON_NAMESPACE_ENTER
 
 class KnobSignalSlotHandler
@@ -704,6 +707,19 @@ public:
      **/
     virtual bool getExpressionDependencies(int dimension, std::list<std::pair<KnobIWPtr, int> >& dependencies) const = 0;
 
+    /**
+     * @brief Appends to the hash everything that determines the values returned by the knob during a render:
+     * its static values or animation curves, its master knobs and its expressions along with the knobs they depend on.
+     * This is used by nodes to identify the images they render by the values of their parameters.
+     **/
+    virtual void appendToHash(Hash64* hash) = 0;
+
+    /**
+     * @brief Same as appendToHash() for a single dimension. Expression dependencies are followed up to
+     * NATRON_KNOB_HASH_MAX_EXPRESSION_DEPTH levels starting from the given depth.
+     **/
+    virtual void appendDimensionToHash(int dimension, int depth, Hash64* hash) = 0;
+
 
     /**
      * @brief Calls setValueAtTime with a reason of eValueChangedReasonUserEdited.
@@ -1494,12 +1510,30 @@ protected:
     template <typename T>
     static T pyObjectToType(PyObject* o);
 
+    /**
+     * @brief Converts the result of a NativeExpression like pyObjectToType() converts the Python value it stands for.
+     **/
+    template <typename T>
+    static T nativeExpressionResultToType(double value);
+
     virtual void refreshListenersAfterValueChange(ViewSpec view, NATRON_ENUM::ValueChangedReasonEnum reason, int dimension) OVERRIDE FINAL;
 
 public:
 
     virtual bool isExpressionUsingRetVariable(int dimension = 0) const OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual bool getExpressionDependencies(int dimension, std::list<std::pair<KnobIWPtr, int> >& dependencies) const OVERRIDE FINAL;
+    virtual void appendToHash(Hash64* hash) OVERRIDE;
+    virtual void appendDimensionToHash(int dimension, int depth, Hash64* hash) OVERRIDE FINAL;
+
+protected:
+
+    /**
+     * @brief Appends the static (non-animated) value of the given dimension to the hash.
+     **/
+    virtual void appendValueToHash(int dimension, Hash64* hash) const = 0;
+
+public:
+
     virtual std::string getExpression(int dimension) const OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual const std::vector<std::shared_ptr<Curve>  > & getCurves() const OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual void setAnimationEnabled(bool val) OVERRIDE FINAL;
@@ -1625,6 +1659,13 @@ protected:
      **/
     void resetMaster(int dimension);
 
+    /**
+     * @brief Evaluates the expression of the given dimension without Python if it was compiled by NativeExpression.
+     * Returns false if it was not or if the evaluation failed, in which case it must be evaluated by executeExpression().
+     * This does not take the Python GIL.
+     **/
+    bool evaluateNativeExpression(double time, ViewIdx view, int dimension, double* ret) const;
+
     ///The return value must be Py_DECRREF
     /// The Python GIL must be held before calling this, so the the PyObject remains valid.
     bool executeExpression(double time, ViewIdx view, int dimension, PyObject** ret, std::string* error) const;
@@ -1787,11 +1828,11 @@ public:
 
 
     /*
-       For each dimension, the results of the expressions at a given pair <frame, time> is stored so
+       For each dimension, the results of the expressions at a given pair <frame, view> is stored so
        that we're able to get the same value again for the same render.
        Of course, this saved in the project to retrieve the same values between 2 runs of the project.
      */
-    typedef std::map<double, T> FrameValueMap;
+    typedef std::map<std::pair<double, int>, T> FrameValueMap;
     typedef std::vector<FrameValueMap> ExprResults;
 
 
@@ -2101,6 +2142,13 @@ public:
 
     bool getValueFromCurve(double time, ViewSpec view, int dimension, bool useGuiCurve, bool byPassMaster, bool clamp, T* ret);
 
+    /**
+     * @brief Reads the value from the snapshot of the knob values taken when the render of the current thread started.
+     * If time is NULL, the current time is used. Returns false if the thread is not rendering or the dimension
+     * was not copied to the snapshot.
+     **/
+    bool getValueFromRenderSnapshot(const double* time, int dimension, bool clamp, T* ret);
+
 protected:
 
     virtual void resetExtraToDefaultValue(int /*dimension*/) {}
@@ -2109,6 +2157,8 @@ private:
 
     virtual void copyValuesFromCurve(int dim) OVERRIDE FINAL;
 
+    virtual void appendValueToHash(int dimension, Hash64* hash) const OVERRIDE FINAL;
+
     virtual bool hasDefaultValueChanged(int dimension) const OVERRIDE FINAL;
 
     void initMinMax();
@@ -2311,6 +2361,8 @@ public:
 
     std::string getStringAtTime(double time, ViewSpec view, int dimension);
 
+    virtual void appendToHash(Hash64* hash) OVERRIDE;
+
 protected:
 
     virtual void cloneExtraData(KnobI* other, int dimension = -1, int otherDimension = -1) OVERRIDE;
@@ -2680,6 +2732,15 @@ public:
         return ViewIdx(0);
     }
 
+    /**
+     * @brief Returns the snapshot of the knob values taken when the render of the current thread started, or NULL
+     * if the thread is not rendering. The snapshot is valid until the render returns.
+     **/
+    virtual const KnobValuesSnapshot* getKnobValuesSnapshotTLS() const
+    {
+        return 0;
+    }
+
     int getPageIndex(const KnobPage* page) const;
 
 
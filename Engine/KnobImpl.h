@@ -46,7 +46,9 @@
 #include "Engine/AppInstance.h"
 #include "Engine/Project.h"
 #include "Engine/EffectInstance.h"
+#include "Engine/Hash64.h"
 #include "Engine/KnobTypes.h"
+#include "Engine/KnobValuesSnapshot.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/EngineFwd.h"
 
@@ -376,6 +378,35 @@ KnobHelper::pyObjectToType(PyObject* o)
     return NATRON_PYTHON_NAMESPACE::PyStringToStdString(o);
 }
 
+template <>
+int
+KnobHelper::nativeExpressionResultToType(double value)
+{
+    return (int)value;
+}
+
+template <>
+bool
+KnobHelper::nativeExpressionResultToType(double value)
+{
+    return value != 0.;
+}
+
+template <>
+double
+KnobHelper::nativeExpressionResultToType(double value)
+{
+    return value;
+}
+
+template <>
+std::string
+KnobHelper::nativeExpressionResultToType(double /*value*/)
+{
+    // Expressions of string parameters are never compiled to native code
+    return std::string();
+}
+
 inline unsigned int
 hashFunction(unsigned int a)
 {
@@ -480,7 +511,7 @@ Knob<T>::getValueFromExpression(double time,
 
     {
         QMutexLocker k(&_valueMutex);
-        typename FrameValueMap::iterator found = _exprRes[dimension].find(time);
+        typename FrameValueMap::iterator found = _exprRes[dimension].find( std::make_pair(time, (int)view) );
         if ( found != _exprRes[dimension].end() ) {
             *ret = found->second;
 
@@ -492,7 +523,14 @@ Knob<T>::getValueFromExpression(double time,
     {
         EXPR_RECURSION_LEVEL();
         std::string error;
-        bool exprOk = evaluateExpression(time, view,  dimension, ret, &error);
+        bool exprOk;
+        double nativeRet;
+        if ( evaluateNativeExpression(time, view, dimension, &nativeRet) ) {
+            *ret = nativeExpressionResultToType<T>(nativeRet);
+            exprOk = true;
+        } else {
+            exprOk = evaluateExpression(time, view,  dimension, ret, &error);
+        }
         if (!exprOk) {
             setExpressionInvalid(dimension, false, error);
 
@@ -509,7 +547,7 @@ Knob<T>::getValueFromExpression(double time,
     }
 
     QMutexLocker k(&_valueMutex);
-    _exprRes[dimension].insert( std::make_pair(time, *ret) );
+    _exprRes[dimension].insert( std::make_pair(std::make_pair(time, (int)view), *ret) );
 
     return true;
 }
@@ -568,7 +606,7 @@ Knob<T>::getValueFromExpression_pod(double time,
 
 
     QMutexLocker k(&_valueMutex);
-    typename FrameValueMap::iterator found = _exprRes[dimension].find(time);
+    typename FrameValueMap::iterator found = _exprRes[dimension].find( std::make_pair(time, (int)view) );
     if ( found != _exprRes[dimension].end() ) {
         *ret = found->second;
 
@@ -580,7 +618,8 @@ Knob<T>::getValueFromExpression_pod(double time,
     {
         EXPR_RECURSION_LEVEL();
         std::string error;
-        bool exprOk = evaluateExpression_pod(time, view, dimension, ret, &error);
+        bool exprOk = evaluateNativeExpression(time, view, dimension, ret) ||
+                      evaluateExpression_pod(time, view, dimension, ret, &error);
         if (!exprOk) {
             setExpressionInvalid(dimension, false, error);
 
@@ -597,7 +636,7 @@ Knob<T>::getValueFromExpression_pod(double time,
     }
 
     //QWriteLocker k(&_valueMutex);
-    _exprRes[dimension].insert( std::make_pair(time, *ret) );
+    _exprRes[dimension].insert( std::make_pair(std::make_pair(time, (int)view), *ret) );
 
     return true;
 }
@@ -699,6 +738,12 @@ Knob<T>::getValue(int dimension,
     if ( ( dimension >= (int)_values.size() ) || (dimension < 0) ) {
         return T();
     }
+    if (!useGuiValues) {
+        T ret;
+        if ( getValueFromRenderSnapshot(NULL, dimension, clamp, &ret) ) {
+            return ret;
+        }
+    }
     std::string hasExpr = getExpression(dimension);
     if ( !hasExpr.empty() ) {
         T ret;
@@ -805,6 +850,46 @@ KnobStringBase::getValueFromCurve(double time,
     return false;
 }
 
+template <typename T>
+bool
+Knob<T>::getValueFromRenderSnapshot(const double* time,
+                                    int dimension,
+                                    bool clamp,
+                                    T* ret)
+{
+    KnobHolder* holder = getHolder();
+
+    if (!holder) {
+        return false;
+    }
+    const KnobValuesSnapshot* snapshot = holder->getKnobValuesSnapshotTLS();
+    if (!snapshot) {
+        return false;
+    }
+    const KnobDimensionSnapshot* dim = snapshot->getDimension(this, dimension);
+    if (!dim) {
+        return false;
+    }
+    if (!dim->curve) {
+        *ret = (T)(clamp ? dim->clampedValue : dim->value);
+    } else {
+        *ret = (T)dim->getValueAtTime(time ? *time : getCurrentTime(), clamp);
+    }
+
+    return true;
+}
+
+template <>
+bool
+KnobStringBase::getValueFromRenderSnapshot(const double* /*time*/,
+                                           int /*dimension*/,
+                                           bool /*clamp*/,
+                                           std::string* /*ret*/)
+{
+    // string knobs are not copied to the snapshot
+    return false;
+}
+
 template<typename T>
 T
 Knob<T>::getValueAtTime(double time,
@@ -819,6 +904,12 @@ Knob<T>::getValueAtTime(double time,
     }
 
     bool useGuiValues = QThread::currentThread() == qApp->thread();
+    if (!useGuiValues && !byPassMaster) {
+        T ret;
+        if ( getValueFromRenderSnapshot(&time, dimension, clamp, &ret) ) {
+            return ret;
+        }
+    }
     std::string hasExpr = getExpression(dimension);
     if ( !hasExpr.empty() ) {
         T ret;
@@ -3007,6 +3098,29 @@ Knob<T>::copyValuesFromCurve(int dim)
 
 }
 
+template<typename T>
+void
+Knob<T>::appendValueToHash(int dimension,
+                           Hash64* hash) const
+{
+    QMutexLocker l(&_valueMutex);
+
+    hash->append(_values[dimension]);
+}
+
+template<>
+void
+KnobStringBase::appendValueToHash(int dimension,
+                                  Hash64* hash) const
+{
+    std::string v;
+    {
+        QMutexLocker l(&_valueMutex);
+        v = _values[dimension];
+    }
+    Hash64_appendQString( hash, QString::fromUtf8( v.c_str() ) );
+}
+
 NATRON_NAMESPACE_EXIT
 
 #endif // KNOBIMPL_H
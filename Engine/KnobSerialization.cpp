@@ -57,6 +57,13 @@ ValueSerialization::ValueSerialization()
 , _master()
 , _expression()
 , _exprHasRetVar(false)
+, _enabled(true)
+, _hasMaster(false)
+, _curve()
+, _value(0.)
+, _defaultValue(0.)
+, _stringValue()
+, _stringDefaultValue()
 {
 
 }
@@ -70,6 +77,13 @@ ValueSerialization::ValueSerialization(KnobSerializationBase* serialization,
     , _master()
     , _expression()
     , _exprHasRetVar(false)
+    , _enabled(true)
+    , _hasMaster(false)
+    , _curve()
+    , _value(0.)
+    , _defaultValue(0.)
+    , _stringValue()
+    , _stringDefaultValue()
 {
 }
 
@@ -93,6 +107,13 @@ ValueSerialization::ValueSerialization(const KnobIPtr & knob,
     , _master()
     , _expression()
     , _exprHasRetVar(false)
+    , _enabled(true)
+    , _hasMaster(false)
+    , _curve()
+    , _value(0.)
+    , _defaultValue(0.)
+    , _stringValue()
+    , _stringDefaultValue()
 {
     initForSave(knob, dimension, exprHasRetVar, expr);
 }
@@ -130,7 +151,32 @@ ValueSerialization::initForSave(const KnobIPtr & knob,
         _master.masterDimension = -1;
     }
 
-}
+    _enabled = knob->isEnabled(dimension);
+    _hasMaster = knob->isSlave(dimension);
+    if ( knob->isAnimated(dimension) ) {
+        _curve = std::make_shared<Curve>( *knob->getCurve(ViewIdx(0), dimension, true) );
+    } else {
+        _curve.reset();
+    }
+
+    KnobIntBase* isInt = dynamic_cast<KnobIntBase*>( knob.get() );
+    KnobBoolBase* isBool = dynamic_cast<KnobBoolBase*>( knob.get() );
+    KnobDoubleBase* isDouble = dynamic_cast<KnobDoubleBase*>( knob.get() );
+    KnobStringBase* isString = dynamic_cast<KnobStringBase*>( knob.get() );
+    if (isInt) {
+        _value = isInt->getValue(dimension);
+        _defaultValue = isInt->getDefaultValue(dimension);
+    } else if (isBool) {
+        _value = isBool->getValue(dimension);
+        _defaultValue = isBool->getDefaultValue(dimension);
+    } else if (isDouble) {
+        _value = isDouble->getValue(dimension);
+        _defaultValue = isDouble->getDefaultValue(dimension);
+    } else if (isString) {
+        _stringValue = isString->getValue(dimension);
+        _stringDefaultValue = isString->getDefaultValue(dimension);
+    }
+} // ValueSerialization::initForSave
 
 void
 ValueSerialization::setChoiceExtraLabel(const std::string& label)
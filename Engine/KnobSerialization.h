@@ -255,6 +255,14 @@ struct ValueSerialization
     std::string _expression;
     bool _exprHasRetVar;
 
+    // The state of the knob is captured by initForSave, so that the serialization can be written
+    // from another thread while the knob is being edited (see Project::startBackgroundAutoSave)
+    bool _enabled;
+    bool _hasMaster;
+    CurvePtr _curve; //< null if the dimension is not animated
+    double _value, _defaultValue; //< for int, bool and double knobs
+    std::string _stringValue, _stringDefaultValue;
+
     ValueSerialization();
 
     ///Load
@@ -292,48 +300,43 @@ struct ValueSerialization
         KnobGroup* isGrp = dynamic_cast<KnobGroup*>( _knob.get() );
         KnobSeparator* isSep = dynamic_cast<KnobSeparator*>( _knob.get() );
         KnobButton* btn = dynamic_cast<KnobButton*>( _knob.get() );
-        bool enabled = _knob->isEnabled(_dimension);
+        bool enabled = _enabled;
         ar & ::boost::serialization::make_nvp("Enabled", enabled);
-        bool hasAnimation = _knob->isAnimated(_dimension);
+        bool hasAnimation = (bool)_curve;
         ar & ::boost::serialization::make_nvp("HasAnimation", hasAnimation);
 
         if (hasAnimation) {
-            ar & ::boost::serialization::make_nvp( "Curve", *( _knob->getCurve(ViewIdx(0), _dimension, true) ) );
+            ar & ::boost::serialization::make_nvp( "Curve", *_curve );
         }
 
         if (isInt && !isChoice) {
-            int v = isInt->getValue(_dimension);
-            int defV = isInt->getDefaultValue(_dimension);
+            int v = (int)_value;
+            int defV = (int)_defaultValue;
             ar & ::boost::serialization::make_nvp("Value", v);
             ar & ::boost::serialization::make_nvp("Default", defV);
         } else if (isBool && !isPage && !isGrp && !isSep && !btn) {
-            bool v = isBool->getValue(_dimension);
-            bool defV = isBool->getDefaultValue(_dimension);
+            bool v = _value != 0.;
+            bool defV = _defaultValue != 0.;
             ar & ::boost::serialization::make_nvp("Value", v);
             ar & ::boost::serialization::make_nvp("Default", defV);
         } else if (isDouble && !isParametric) {
-            double v = isDouble->getValue(_dimension);
-            double defV = isDouble->getDefaultValue(_dimension);
+            double v = _value;
+            double defV = _defaultValue;
             ar & ::boost::serialization::make_nvp("Value", v);
             ar & ::boost::serialization::make_nvp("Default", defV);
         } else if (isChoice) {
-            int v = isChoice->getValue(_dimension);
-            int defV = isChoice->getDefaultValue(_dimension);
-            std::vector<ChoiceOption> entries = isChoice->getEntries_mt_safe();
-            std::string label;
-            if ( ( v < (int)entries.size() ) && (v >= 0) ) {
-                label = entries[v].id;
-            }
+            int v = (int)_value;
+            int defV = (int)_defaultValue;
             ar & ::boost::serialization::make_nvp("Value", v);
             ar & ::boost::serialization::make_nvp("Default", defV);
         } else if (isString) {
-            std::string v = isString->getValue(_dimension);
-            std::string defV = isString->getDefaultValue(_dimension);
+            std::string v = _stringValue;
+            std::string defV = _stringDefaultValue;
             ar & ::boost::serialization::make_nvp("Value", v);
             ar & ::boost::serialization::make_nvp("Default", defV);
         }
 
-        bool hasMaster = _knob->isSlave(_dimension);
+        bool hasMaster = _hasMaster;
         ar & ::boost::serialization::make_nvp("HasMaster", hasMaster);
         if (hasMaster) {
             ar & ::boost::serialization::make_nvp("Master", _master);
@@ -512,6 +515,8 @@ class KnobSerialization
     bool _masterIsAlias;
     std::vector<std::pair<std::string, bool> > _expressions; //< used when deserializing, we can't restore it before all knobs have been restored.
     std::list<Curve > parametricCurves;
+    std::map<int, std::string> _stringAnimation; //< used when serializing
+    bool _isSecret; //< used when serializing
     mutable TypeExtraData* _extraData;
     bool _isUserKnob;
     std::string _label;
@@ -544,7 +549,7 @@ private:
         ar & ::boost::serialization::make_nvp("Name", name);
         ar & ::boost::serialization::make_nvp("Type", _typeName);
         ar & ::boost::serialization::make_nvp("Dimension", _dimension);
-        bool secret = _knob->getIsSecret();
+        bool secret = _isSecret;
         ar & ::boost::serialization::make_nvp("Secret", secret);
         ar & ::boost::serialization::make_nvp("MasterIsAlias", _masterIsAlias);
 
@@ -555,12 +560,10 @@ private:
 
         ////restore extra datas
         if (isParametric) {
-            std::list<Curve > curves;
-            isParametric->saveParametricCurves(&curves);
+            std::list<Curve > curves = parametricCurves;
             ar & ::boost::serialization::make_nvp("ParametricCurves", curves);
         } else if (isString) {
-            std::map<int, std::string> extraDatas;
-            isString->getAnimation().save(&extraDatas);
+            std::map<int, std::string> extraDatas = _stringAnimation;
             ar & ::boost::serialization::make_nvp("StringsAnimation", extraDatas);
         }
         ChoiceExtraData* cdata = dynamic_cast<ChoiceExtraData*>(_extraData);
@@ -602,7 +605,7 @@ private:
             }
 
             if ( isDouble && (isDouble->getDimension() == 2) ) {
-                bool useOverlay = isDouble->getHasHostOverlayHandle();
+                bool useOverlay = _useHostOverlay;
                 ar & ::boost::serialization::make_nvp("HasOverlayHandle", useOverlay);
             }
         }
@@ -802,6 +805,7 @@ public:
         : _knob()
         , _dimension(0)
         , _masterIsAlias(false)
+        , _isSecret(false)
         , _extraData(NULL)
         , _isUserKnob(false)
         , _label()
@@ -846,6 +850,19 @@ public:
         _isPersistent = knob->getIsPersistent();
         _animationEnabled = knob->isAnimationEnabled();
         _tooltip = knob->getHintToolTip();
+        _isSecret = knob->getIsSecret();
+
+        KnobParametric* isParametric = dynamic_cast<KnobParametric*>( _knob.get() );
+        AnimatingKnobStringHelper* isAnimatedString = dynamic_cast<AnimatingKnobStringHelper*>( _knob.get() );
+        KnobDouble* isDouble = dynamic_cast<KnobDouble*>( _knob.get() );
+        if (isParametric) {
+            isParametric->saveParametricCurves(&parametricCurves);
+        } else if (isAnimatedString) {
+            isAnimatedString->getAnimation().save(&_stringAnimation);
+        }
+        if ( isDouble && (isDouble->getDimension() == 2) ) {
+            _useHostOverlay = isDouble->getHasHostOverlayHandle();
+        }
 
         KnobChoice* isChoice = dynamic_cast<KnobChoice*>( _knob.get() );
         if (isChoice) {
@@ -921,6 +938,7 @@ public:
         , _dimension(0)
         , _masters()
         , _masterIsAlias(false)
+        , _isSecret(false)
         , _extraData(NULL)
         , _isUserKnob(false)
         , _label()
@@ -44,6 +44,7 @@
 #include "Engine/Curve.h"
 #include "Engine/EffectInstance.h"
 #include "Engine/Format.h"
+#include "Engine/Hash64.h"
 #include "Engine/Image.h"
 #include "Engine/KnobFile.h"
 #include "Engine/KnobSerialization.h"
@@ -2265,6 +2266,16 @@ KnobParametric::saveParametricCurves(std::list<Curve >* curves) const
     }
 }
 
+void
+KnobParametric::appendToHash(Hash64* hash)
+{
+    KnobDoubleBase::appendToHash(hash);
+
+    for (U32 i = 0; i < _curves.size(); ++i) {
+        _curves[i]->appendToHash(hash);
+    }
+}
+
 void
 KnobParametric::loadParametricCurves(const std::list<Curve > & curves)
 {
@@ -1052,6 +1052,8 @@ public:
 
     void loadParametricCurves(const std::list<Curve > & curves);
 
+    virtual void appendToHash(Hash64* hash) OVERRIDE FINAL;
+
 Q_SIGNALS:
 
 
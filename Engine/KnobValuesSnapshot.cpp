@@ -0,0 +1,124 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "KnobValuesSnapshot.h"
+
+#include <algorithm> // sort, lower_bound
+
+#include "Engine/Curve.h"
+#include "Engine/Knob.h"
+#include "Engine/ViewIdx.h"
+
+NATRON_NAMESPACE_ENTER
+
+double
+KnobDimensionSnapshot::getValueAtTime(double time,
+                                      bool clamp) const
+{
+    if (!curve) {
+        return clamp ? clampedValue : value;
+    }
+    double v = curve->getValueAtUnlocked(time);
+    if (clamp) {
+        v = std::max( curveMin, std::min(curveMax, v) );
+    }
+
+    return v;
+}
+
+template <typename T>
+static void
+appendKnobDimensions(Knob<T>* knob,
+                     std::vector<KnobDimensionSnapshot>* dimensions)
+{
+    int nDims = knob->getDimension();
+
+    dimensions->resize(nDims);
+    for (int i = 0; i < nDims; ++i) {
+        KnobDimensionSnapshot& dim = (*dimensions)[i];
+        if ( !knob->getExpression(i).empty() || knob->getMaster(i).second ) {
+            continue;
+        }
+        dim.isSet = true;
+        CurvePtr curve = knob->canAnimate() ? knob->getCurve(ViewIdx(0), i) : CurvePtr();
+        if ( curve && curve->isAnimated() ) {
+            // The copy is shared with the previous snapshots if the curve did not change since
+            dim.curve = curve->getReadOnlyCopy();
+            Curve::YRange range = curve->getCurveYRange();
+            dim.curveMin = range.min;
+            dim.curveMax = range.max;
+        } else {
+            // getValueAtTime() reads the values of the render, even on the main thread
+            dim.value = (double)knob->getValueAtTime(0., i, ViewIdx(0), false, true);
+            dim.clampedValue = (double)knob->getValueAtTime(0., i, ViewIdx(0), true, true);
+        }
+    }
+}
+
+KnobValuesSnapshotPtr
+KnobValuesSnapshot::create(const KnobsVec& knobs)
+{
+    KnobValuesSnapshotPtr ret( new KnobValuesSnapshot() );
+
+    ret->_knobs.reserve( knobs.size() );
+    for (KnobsVec::const_iterator it = knobs.begin(); it != knobs.end(); ++it) {
+        KnobSnapshot knob;
+        knob.knob = it->get();
+        KnobIntBase* isInt = dynamic_cast<KnobIntBase*>( it->get() );
+        KnobBoolBase* isBool = dynamic_cast<KnobBoolBase*>( it->get() );
+        KnobDoubleBase* isDouble = dynamic_cast<KnobDoubleBase*>( it->get() );
+        if (isInt) {
+            appendKnobDimensions(isInt, &knob.dimensions);
+        } else if (isBool) {
+            appendKnobDimensions(isBool, &knob.dimensions);
+        } else if (isDouble) {
+            appendKnobDimensions(isDouble, &knob.dimensions);
+        } else {
+            continue;
+        }
+        ret->_knobs.push_back(knob);
+    }
+    std::sort( ret->_knobs.begin(), ret->_knobs.end() );
+
+    return ret;
+}
+
+const KnobDimensionSnapshot*
+KnobValuesSnapshot::getDimension(const KnobI* knob,
+                                 int dimension) const
+{
+    std::vector<KnobSnapshot>::const_iterator found = std::lower_bound(_knobs.begin(), _knobs.end(), knob);
+
+    if ( ( found == _knobs.end() ) || (found->knob != knob) ) {
+        return 0;
+    }
+    if ( (dimension < 0) || ( dimension >= (int)found->dimensions.size() ) || !found->dimensions[dimension].isSet ) {
+        return 0;
+    }
+
+    return &found->dimensions[dimension];
+}
+
+NATRON_NAMESPACE_EXIT
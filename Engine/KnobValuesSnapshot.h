@@ -0,0 +1,119 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_KnobValuesSnapshot_h
+#define Natron_Engine_KnobValuesSnapshot_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief The value of a dimension of a knob at the time a render started: either a constant value or a private copy
+ * of its animation curve.
+ **/
+struct KnobDimensionSnapshot
+{
+    // False if the dimension is driven by an expression or slaved to another knob
+    bool isSet;
+    double value;
+    double clampedValue;
+
+    // A copy of the curve of the knob, which is never modified and is shared by the snapshots taken while the curve
+    // does not change: NULL if the dimension is not animated
+    CurvePtr curve;
+
+    // The range the curve values are clamped to
+    double curveMin, curveMax;
+
+    KnobDimensionSnapshot()
+        : isSet(false)
+        , value(0.)
+        , clampedValue(0.)
+        , curve()
+        , curveMin(0.)
+        , curveMax(0.)
+    {
+    }
+
+    double getValueAtTime(double time, bool clamp) const;
+};
+
+/**
+ * @brief An immutable copy of the values and animation curves of the knobs of an effect, taken once when the render
+ * of a frame starts and held by the ParallelRenderArgs of the render. The curves are only copied when they changed
+ * since the previous snapshot, see Curve::getReadOnlyCopy().
+ * The render threads read the parameters from the snapshot instead of the knobs, without taking any lock.
+ * Only the dimensions of int, bool and double knobs which are neither driven by an expression nor slaved to another
+ * knob are copied: the others are read from the knob.
+ **/
+class KnobValuesSnapshot
+{
+    struct KnobSnapshot
+    {
+        const KnobI* knob;
+        std::vector<KnobDimensionSnapshot> dimensions;
+
+        bool operator<(const KnobSnapshot& other) const
+        {
+            return knob < other.knob;
+        }
+
+        bool operator<(const KnobI* other) const
+        {
+            return knob < other;
+        }
+    };
+
+public:
+
+    /**
+     * @brief Copies the values of knobs. This must be called on the thread starting the render.
+     **/
+    static KnobValuesSnapshotPtr create(const KnobsVec& knobs);
+
+    /**
+     * @brief Returns the snapshot of the given dimension of knob, or NULL if it was not copied.
+     **/
+    const KnobDimensionSnapshot* getDimension(const KnobI* knob, int dimension) const;
+
+private:
+
+    KnobValuesSnapshot()
+        : _knobs()
+    {
+    }
+
+    // Sorted by knob address
+    std::vector<KnobSnapshot> _knobs;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_KnobValuesSnapshot_h
@@ -27,8 +27,16 @@
 
 #include <cstring> // for std::memcpy
 #include <algorithm> // min, max
+#include <atomic>
 #include <cassert>
 #include <stdexcept>
+#include <vector>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+// The SIMD kernels are compiled with the target attribute and selected at runtime, see getSIMDLevel()
+#define NATRON_LUT_X86_SIMD
+#include <immintrin.h>
+#endif
 
 #include "Engine/RectI.h"
 
@@ -346,6 +354,298 @@ Lut::fillTables() const
     }
 }
 
+///////////////////////
+/////////////////////////////////////////// ROW KERNELS //////////////////////////////////////////////
+///////////////////////
+
+static SIMDLevelEnum
+detectSIMDLevel()
+{
+#ifdef NATRON_LUT_X86_SIMD
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports("avx2") ) {
+        return eSIMDLevelAVX2;
+    }
+    if ( __builtin_cpu_supports("sse4.1") ) {
+        return eSIMDLevelSSE41;
+    }
+#endif
+
+    return eSIMDLevelScalar;
+}
+
+static std::atomic<int> simdLevelCap(eSIMDLevelAVX2);
+
+SIMDLevelEnum
+getSIMDLevel()
+{
+    static const SIMDLevelEnum supportedLevel = detectSIMDLevel();
+
+    return (SIMDLevelEnum)std::min( (int)supportedLevel, simdLevelCap.load() );
+}
+
+void
+setSIMDLevel(SIMDLevelEnum level)
+{
+    simdLevelCap = (int)level;
+}
+
+// The per-value conversion done by toUint8xxRow(), table is NULL when there is no lut
+static inline unsigned short
+toUint8xx(const unsigned short* table,
+          float v)
+{
+    if (table) {
+        return table[hipart(v)];
+    }
+
+    return charToUint8xx( (unsigned char)floatToInt<256>(v) );
+}
+
+static void
+toUint8xxRow_scalar(const unsigned short* table,
+                    const float* from,
+                    int W,
+                    int nComps,
+                    const int offsets[3],
+                    int alphaOffset,
+                    bool applyGainOffset,
+                    double gain,
+                    double offset,
+                    unsigned short* to[3])
+{
+    for (int x = 0; x < W; ++x, from += nComps) {
+        for (int c = 0; c < 3; ++c) {
+            float v = from[offsets[c]];
+            if (alphaOffset >= 0) {
+                v *= from[alphaOffset];
+            }
+            if (applyGainOffset) {
+                v = (float)(v * gain + offset);
+            }
+            to[c][x] = toUint8xx(table, v);
+        }
+    }
+}
+
+#ifdef NATRON_LUT_X86_SIMD
+
+__attribute__((target("sse4.1")))
+static void
+toUint8xxRow_sse41(const unsigned short* table,
+                   const float* from,
+                   int W,
+                   const int offsets[3],
+                   int alphaOffset,
+                   bool applyGainOffset,
+                   double gain,
+                   double offset,
+                   unsigned short* to[3])
+{
+    const __m128d gain2 = _mm_set1_pd(gain);
+    const __m128d offset2 = _mm_set1_pd(offset);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 scale = _mm_set1_ps(255.f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i byteMax = _mm_set1_epi32(255);
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    int x = 0;
+
+    for (; x + 4 <= W; x += 4) {
+        __m128 ch[4];
+        ch[0] = _mm_loadu_ps(from + x * 4);
+        ch[1] = _mm_loadu_ps(from + x * 4 + 4);
+        ch[2] = _mm_loadu_ps(from + x * 4 + 8);
+        ch[3] = _mm_loadu_ps(from + x * 4 + 12);
+        _MM_TRANSPOSE4_PS(ch[0], ch[1], ch[2], ch[3]);
+        for (int c = 0; c < 3; ++c) {
+            __m128 v = ch[offsets[c]];
+            if (alphaOffset >= 0) {
+                v = _mm_mul_ps(v, ch[alphaOffset]);
+            }
+            if (applyGainOffset) {
+                __m128d lo = _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd(v), gain2), offset2);
+                __m128d hi = _mm_add_pd(_mm_mul_pd(_mm_cvtps_pd( _mm_movehl_ps(v, v) ), gain2), offset2);
+                v = _mm_movelh_ps( _mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi) );
+            }
+            if (table) {
+                alignas(16) int idx[4];
+                _mm_store_si128( (__m128i*)idx, _mm_srli_epi32(_mm_castps_si128(v), 16) );
+                to[c][x] = table[idx[0]];
+                to[c][x + 1] = table[idx[1]];
+                to[c][x + 2] = table[idx[2]];
+                to[c][x + 3] = table[idx[3]];
+            } else {
+                // floatToInt<256>: 0 if v <= 0, 255 if v >= 1, (int)(v * 255 + 0.5) otherwise
+                __m128i i = _mm_cvttps_epi32( _mm_add_ps(_mm_mul_ps(v, scale), half) );
+                i = _mm_castps_si128( _mm_blendv_ps( _mm_castsi128_ps(i), _mm_castsi128_ps(byteMax), _mm_cmpge_ps(v, one) ) );
+                i = _mm_castps_si128( _mm_blendv_ps( _mm_castsi128_ps(i), zero, _mm_cmple_ps(v, zero) ) );
+                i = _mm_slli_epi32(_mm_and_si128(i, byteMask), 8);
+                _mm_storel_epi64( (__m128i*)(to[c] + x), _mm_packus_epi32(i, i) );
+            }
+        }
+    }
+    if (x < W) {
+        unsigned short* tail[3] = { to[0] + x, to[1] + x, to[2] + x };
+        toUint8xxRow_scalar(table, from + x * 4, W - x, 4, offsets, alphaOffset, applyGainOffset, gain, offset, tail);
+    }
+} // toUint8xxRow_sse41
+
+__attribute__((target("avx2")))
+static void
+toUint8xxRow_avx2(const unsigned short* table,
+                  const float* from,
+                  int W,
+                  const int offsets[3],
+                  int alphaOffset,
+                  bool applyGainOffset,
+                  double gain,
+                  double offset,
+                  unsigned short* to[3])
+{
+    const __m256d gain4 = _mm256_set1_pd(gain);
+    const __m256d offset4 = _mm256_set1_pd(offset);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 scale = _mm256_set1_ps(255.f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256i byteMax = _mm256_set1_epi32(255);
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    // After the in-lane transposition, the low lane holds the pixels 0,2,4,6 and the high lane the pixels 1,3,5,7
+    const __m256i pixelOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    int x = 0;
+
+    for (; x + 8 <= W; x += 8) {
+        __m256 p01 = _mm256_loadu_ps(from + x * 4);
+        __m256 p23 = _mm256_loadu_ps(from + x * 4 + 8);
+        __m256 p45 = _mm256_loadu_ps(from + x * 4 + 16);
+        __m256 p67 = _mm256_loadu_ps(from + x * 4 + 24);
+        __m256 t0 = _mm256_unpacklo_ps(p01, p23);
+        __m256 t1 = _mm256_unpackhi_ps(p01, p23);
+        __m256 t2 = _mm256_unpacklo_ps(p45, p67);
+        __m256 t3 = _mm256_unpackhi_ps(p45, p67);
+        __m256 ch[4];
+        ch[0] = _mm256_permutevar8x32_ps(_mm256_shuffle_ps( t0, t2, _MM_SHUFFLE(1, 0, 1, 0) ), pixelOrder);
+        ch[1] = _mm256_permutevar8x32_ps(_mm256_shuffle_ps( t0, t2, _MM_SHUFFLE(3, 2, 3, 2) ), pixelOrder);
+        ch[2] = _mm256_permutevar8x32_ps(_mm256_shuffle_ps( t1, t3, _MM_SHUFFLE(1, 0, 1, 0) ), pixelOrder);
+        ch[3] = _mm256_permutevar8x32_ps(_mm256_shuffle_ps( t1, t3, _MM_SHUFFLE(3, 2, 3, 2) ), pixelOrder);
+        for (int c = 0; c < 3; ++c) {
+            __m256 v = ch[offsets[c]];
+            if (alphaOffset >= 0) {
+                v = _mm256_mul_ps(v, ch[alphaOffset]);
+            }
+            if (applyGainOffset) {
+                __m256d lo = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtps_pd( _mm256_castps256_ps128(v) ), gain4), offset4);
+                __m256d hi = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtps_pd( _mm256_extractf128_ps(v, 1) ), gain4), offset4);
+                v = _mm256_insertf128_ps(_mm256_castps128_ps256( _mm256_cvtpd_ps(lo) ), _mm256_cvtpd_ps(hi), 1);
+            }
+            if (table) {
+                alignas(32) int idx[8];
+                _mm256_store_si256( (__m256i*)idx, _mm256_srli_epi32(_mm256_castps_si256(v), 16) );
+                for (int i = 0; i < 8; ++i) {
+                    to[c][x + i] = table[idx[i]];
+                }
+            } else {
+                __m256i i = _mm256_cvttps_epi32( _mm256_add_ps(_mm256_mul_ps(v, scale), half) );
+                i = _mm256_castps_si256( _mm256_blendv_ps( _mm256_castsi256_ps(i), _mm256_castsi256_ps(byteMax), _mm256_cmp_ps(v, one, _CMP_GE_OQ) ) );
+                i = _mm256_castps_si256( _mm256_blendv_ps( _mm256_castsi256_ps(i), zero, _mm256_cmp_ps(v, zero, _CMP_LE_OQ) ) );
+                i = _mm256_slli_epi32(_mm256_and_si256(i, byteMask), 8);
+                // packus works per lane: the 4 low values of each lane end up in the 64 low bits of each lane
+                __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(i, i), _MM_SHUFFLE(3, 1, 2, 0));
+                _mm_storeu_si128( (__m128i*)(to[c] + x), _mm256_castsi256_si128(packed) );
+            }
+        }
+    }
+    if (x < W) {
+        unsigned short* tail[3] = { to[0] + x, to[1] + x, to[2] + x };
+        toUint8xxRow_scalar(table, from + x * 4, W - x, 4, offsets, alphaOffset, applyGainOffset, gain, offset, tail);
+    }
+} // toUint8xxRow_avx2
+
+// Converts the W bytes of from to floats through the given 256 entries table
+__attribute__((target("avx2")))
+static void
+lookupBytes_avx2(const float* table,
+                 const unsigned char* from,
+                 int W,
+                 float* to)
+{
+    int x = 0;
+
+    for (; x + 8 <= W; x += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)(from + x) ) );
+        _mm256_storeu_ps( to + x, _mm256_i32gather_ps(table, idx, 4) );
+    }
+    for (; x < W; ++x) {
+        to[x] = table[from[x]];
+    }
+}
+
+// Same as lookupBytes_avx2() for packed 4-component pixels, but the 4th component is converted linearly by intToFloat<256>()
+__attribute__((target("avx2")))
+static void
+lookupBytesLinearAlpha_avx2(const float* table,
+                            const unsigned char* from,
+                            int nPixels,
+                            float* to)
+{
+    const __m256 scale = _mm256_set1_ps( (float)255 );
+    int x = 0;
+
+    for (; x + 2 <= nPixels; x += 2) {
+        __m256i idx = _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)(from + x * 4) ) );
+        __m256 colors = _mm256_i32gather_ps(table, idx, 4);
+        __m256 alphas = _mm256_div_ps(_mm256_cvtepi32_ps(idx), scale);
+        _mm256_storeu_ps( to + x * 4, _mm256_blend_ps(colors, alphas, 0x88) );
+    }
+    for (; x < nPixels; ++x) {
+        to[x * 4] = table[from[x * 4]];
+        to[x * 4 + 1] = table[from[x * 4 + 1]];
+        to[x * 4 + 2] = table[from[x * 4 + 2]];
+        to[x * 4 + 3] = intToFloat<256>(from[x * 4 + 3]);
+    }
+}
+
+#endif // NATRON_LUT_X86_SIMD
+
+void
+toUint8xxRow(const Lut* lut,
+             const float* from,
+             int W,
+             int nComps,
+             const int offsets[3],
+             int alphaOffset,
+             bool applyGainOffset,
+             double gain,
+             double offset,
+             unsigned short* to[3])
+{
+    const unsigned short* table = 0;
+
+    if (lut) {
+        lut->validate();
+        table = lut->toFunc_hipart_to_uint8xx;
+    }
+#ifdef NATRON_LUT_X86_SIMD
+    if (nComps == 4) {
+        switch ( getSIMDLevel() ) {
+        case eSIMDLevelAVX2:
+            toUint8xxRow_avx2(table, from, W, offsets, alphaOffset, applyGainOffset, gain, offset, to);
+
+            return;
+        case eSIMDLevelSSE41:
+            toUint8xxRow_sse41(table, from, W, offsets, alphaOffset, applyGainOffset, gain, offset, to);
+
+            return;
+        case eSIMDLevelScalar:
+            break;
+        }
+    }
+#endif
+    toUint8xxRow_scalar(table, from, W, nComps, offsets, alphaOffset, applyGainOffset, gain, offset, to);
+}
+
 #ifdef DEAD_CODE
 void
 Lut::to_byte_planar(unsigned char* to,
@@ -466,9 +766,15 @@ Lut::to_byte_packed(unsigned char* to,
 
     validate();
 
+    const int W = rect.x2 - rect.x1;
+    const int offsets[3] = { inROffset, inGOffset, inBOffset };
+    const int alphaOffset = (inputHasAlpha && premult) ? inAOffset : -1;
+    std::vector<unsigned short> rowBuffer(W * 3);
+    unsigned short* rows[3] = { &rowBuffer[0], &rowBuffer[W], &rowBuffer[2 * W] };
+
     for (int y = rect.y1; y < rect.y2; ++y) {
         // coverity[dont_call]
-        int start = rand() % (rect.x2 - rect.x1) + rect.x1;
+        int start = rand() % W;
         unsigned error_r, error_g, error_b;
         error_r = error_g = error_b = 0x80;
         int srcY = y;
@@ -478,40 +784,40 @@ Lut::to_byte_packed(unsigned char* to,
 
 
         int dstY = dstBounds.y2 - y - 1;
-        const float *src_pixels = from + (srcY * (srcBounds.x2 - srcBounds.x1) * inPackingSize);
-        unsigned char *dst_pixels = to + (dstY * (dstBounds.x2 - dstBounds.x1) * outPackingSize);
+        const float *src_pixels = from + (srcY * (srcBounds.x2 - srcBounds.x1) + rect.x1) * inPackingSize;
+        unsigned char *dst_pixels = to + (dstY * (dstBounds.x2 - dstBounds.x1) + rect.x1) * outPackingSize;
+        // convert the whole line to 8.8 fixed point first, only the error diffusion is sequential
+        toUint8xxRow(this, src_pixels, W, inPackingSize, offsets, alphaOffset, false, 1., 0., rows);
         /* go forwards from starting point to end of line: */
-        for (int x = start; x < rect.x2; ++x) {
-            int inCol = x * inPackingSize;
+        for (int x = start; x < W; ++x) {
             int outCol = x * outPackingSize;
-            float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;
-            error_r = (error_r & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inROffset] * a)];
-            error_g = (error_g & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inGOffset] * a)];
-            error_b = (error_b & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inBOffset] * a)];
+            error_r = (error_r & 0xff) + rows[0][x];
+            error_g = (error_g & 0xff) + rows[1][x];
+            error_b = (error_b & 0xff) + rows[2][x];
             assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
             dst_pixels[outCol + outROffset] = (unsigned char)(error_r >> 8);
             dst_pixels[outCol + outGOffset] = (unsigned char)(error_g >> 8);
             dst_pixels[outCol + outBOffset] = (unsigned char)(error_b >> 8);
             if (outputHasAlpha) {
                 // alpha is linear and should not be dithered
+                float a = (alphaOffset >= 0) ? src_pixels[x * inPackingSize + alphaOffset] : 1.f;
                 dst_pixels[outCol + outAOffset] = floatToInt<256>(a);
             }
         }
         /* go backwards from starting point to start of line: */
         error_r = error_g = error_b = 0x80;
-        for (int x = start - 1; x >= rect.x1; --x) {
-            int inCol = x * inPackingSize;
+        for (int x = start - 1; x >= 0; --x) {
             int outCol = x * outPackingSize;
-            float a = (inputHasAlpha && premult) ? src_pixels[inCol + inAOffset] : 1.f;
-            error_r = (error_r & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inROffset] * a)];
-            error_g = (error_g & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inGOffset] * a)];
-            error_b = (error_b & 0xff) + toFunc_hipart_to_uint8xx[hipart(src_pixels[inCol + inBOffset] * a)];
+            error_r = (error_r & 0xff) + rows[0][x];
+            error_g = (error_g & 0xff) + rows[1][x];
+            error_b = (error_b & 0xff) + rows[2][x];
             assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
             dst_pixels[outCol + outROffset] = (unsigned char)(error_r >> 8);
             dst_pixels[outCol + outGOffset] = (unsigned char)(error_g >> 8);
             dst_pixels[outCol + outBOffset] = (unsigned char)(error_b >> 8);
             if (outputHasAlpha) {
                 // alpha is linear and should not be dithered
+                float a = (alphaOffset >= 0) ? src_pixels[x * inPackingSize + alphaOffset] : 1.f;
                 dst_pixels[outCol + outAOffset] = floatToInt<256>(a);
             }
         }
@@ -600,6 +906,13 @@ Lut::from_byte_planar(float* to,
 {
     validate();
     if (!alpha) {
+#ifdef NATRON_LUT_X86_SIMD
+        if ( (inDelta == 1) && (outDelta == 1) && (getSIMDLevel() == eSIMDLevelAVX2) ) {
+            lookupBytes_avx2(fromFunc_uint8_to_float, from, W, to);
+
+            return;
+        }
+#endif
         for (int f = 0, t = 0; f < W; f += inDelta, t += outDelta) {
             to[f] = fromFunc_uint8_to_float[(int)from[f]];
         }
@@ -676,6 +989,10 @@ Lut::from_byte_packed(float* to,
     outPackingSize = outputHasAlpha ? 4 : 3;
 
     validate();
+#ifdef NATRON_LUT_X86_SIMD
+    // when the packings are the same, the channels do not move and only the alpha is not looked up
+    const bool useAVX2 = (inputPacking == outputPacking) && inputHasAlpha && !premult && (getSIMDLevel() == eSIMDLevelAVX2);
+#endif
     for (int y = rect.y1; y < rect.y2; ++y) {
         int srcY = y;
         if (invertY) {
@@ -684,6 +1001,12 @@ Lut::from_byte_packed(float* to,
 
         const unsigned char *src_pixels = from + (srcY * (srcBounds.x2 - srcBounds.x1) * inPackingSize);
         float *dst_pixels = to + (y * (dstBounds.x2 - dstBounds.x1) * outPackingSize);
+#ifdef NATRON_LUT_X86_SIMD
+        if (useAVX2) {
+            lookupBytesLinearAlpha_avx2(fromFunc_uint8_to_float, src_pixels + rect.x1 * 4, rect.x2 - rect.x1, dst_pixels + rect.x1 * 4);
+            continue;
+        }
+#endif
         for (int x = rect.x1; x < rect.x2; ++x) {
             int inCol = x * inPackingSize;
             int outCol = x * outPackingSize;
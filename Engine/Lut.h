@@ -59,6 +59,26 @@ enum PixelPackingEnum
 };
 
 
+/// @enum The instruction sets that the row conversions may use, see getSIMDLevel()
+enum SIMDLevelEnum
+{
+    eSIMDLevelScalar = 0,
+    eSIMDLevelSSE41,
+    eSIMDLevelAVX2
+};
+
+/**
+ * @brief Returns the best instruction set supported by the CPU, detected at runtime,
+ * capped by the level given to setSIMDLevel().
+ **/
+SIMDLevelEnum getSIMDLevel();
+
+/**
+ * @brief Caps the instruction set used by the row conversions. The tests use it to compare the
+ * SIMD kernels with the scalar code.
+ **/
+void setSIMDLevel(SIMDLevelEnum level);
+
 /* @brief Converts a float ranging in [0 - 1.f] in the desired color-space to linear color-space also ranging in [0 - 1.f]*/
 typedef float (*fromColorSpaceFunctionV1)(float v);
 
@@ -145,6 +165,9 @@ class Lut
     mutable QMutex _lock;         ///< protects init_
 
     friend class LutManager;
+    friend void toUint8xxRow(const Lut* lut, const float* from, int W, int nComps, const int offsets[3], int alphaOffset,
+                             bool applyGainOffset, double gain, double offset, unsigned short* to[3]);
+
     ///private constructor, used by LutManager
     Lut(const std::string & name,
         fromColorSpaceFunctionV1 fromFunc,
@@ -357,6 +380,19 @@ public:
                            PixelPackingEnum inputPacking, PixelPackingEnum outputPacking, bool invertY, bool premult) const;
 };
 
+/**
+ * @brief Converts W pixels of a packed float row to 8.8 fixed point values in [0 - 0xff00] for the R, G and B
+ * channels, ready for the error diffusion done in Lut::to_byte_packed() and by the viewer.
+ * The channel c of the pixel i is from[i * nComps + offsets[c]], which is:
+   - multiplied (in float) by the alpha at alphaOffset in the pixel, if alphaOffset >= 0
+   - transformed (in double) by v * gain + offset, if applyGainOffset is true
+   - converted by lut->toColorSpaceUint8xxFromLinearFloatFast(v), or by charToUint8xx(floatToInt<256>(v)) if lut is NULL
+ * 4-component rows are converted with SSE4.1 or AVX2 if the CPU supports it, the result is bit-exact
+ * with the scalar code whatever the instruction set.
+ **/
+void toUint8xxRow(const Lut* lut, const float* from, int W, int nComps, const int offsets[3], int alphaOffset,
+                  bool applyGainOffset, double gain, double offset, unsigned short* to[3]);
+
 
 namespace Linear {
 /////the following functions expects a float input buffer, one could extend it to cover all bitdepths.
@@ -413,6 +413,30 @@ MemoryFile::flush(FlushTypeEnum type, void* data, std::size_t size)
     return false;
 }
 
+bool
+MemoryFile::prefetch(void* data,
+                     std::size_t size)
+{
+    if ( !_imp->data || (size == 0) ) {
+        return false;
+    }
+#if defined(__NATRON_UNIX__)
+    // madvise requires an address aligned on a page boundary
+    static const std::size_t pageSize = (std::size_t)sysconf(_SC_PAGESIZE);
+    char* begin = static_cast<char*>(data);
+    char* alignedBegin = _imp->data + ( (std::size_t)(begin - _imp->data) / pageSize ) * pageSize;
+
+    return ::posix_madvise(alignedBegin, size + (begin - alignedBegin), POSIX_MADV_WILLNEED) == 0;
+#else
+    // PrefetchVirtualMemory is not available on all supported versions of Windows: the caller is expected
+    // to touch the pages from a background thread instead.
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+
+    return false;
+#endif
+}
+
 MemoryFile::~MemoryFile()
 {
     if (_imp->data) {
@@ -146,6 +146,13 @@ public:
      **/
     bool flush(FlushTypeEnum type, void* data, std::size_t size);
 
+    /**
+     * @brief Hints the system that the portion starting at data and spanning size bytes will be read soon,
+     * so that it starts reading it from the backing file asynchronously.
+     * Returns false if the hint is not supported on this system.
+     **/
+    bool prefetch(void* data, std::size_t size);
+
     /**
      * @brief Returns the filepath of the backing file.
      **/
@@ -0,0 +1,1070 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "NativeExpression.h"
+
+#include <cassert>
+#include <cctype>
+#include <cmath>
+#include <cstdlib> // strtod
+#include <cstring> // strlen
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "Engine/EffectInstance.h"
+#include "Engine/Knob.h"
+#include "Engine/KnobTypes.h"
+#include "Engine/Node.h"
+#include "Engine/NodeGroup.h"
+#include "Engine/PyExprUtils.h"
+
+NATRON_NAMESPACE_ENTER
+
+enum NativeExpressionOpEnum
+{
+    eNativeExpressionOpConstant = 0,
+    eNativeExpressionOpFrame,
+    eNativeExpressionOpView,
+    eNativeExpressionOpNegate,
+    eNativeExpressionOpAdd,
+    eNativeExpressionOpSubtract,
+    eNativeExpressionOpMultiply,
+    eNativeExpressionOpDivide,
+    eNativeExpressionOpFloorDivide,
+    eNativeExpressionOpModulo,
+    eNativeExpressionOpPower,
+    eNativeExpressionOpFunction,
+    eNativeExpressionOpKnob
+};
+
+enum NativeExpressionFunctionEnum
+{
+    eNativeExpressionFunctionSin = 0,
+    eNativeExpressionFunctionCos,
+    eNativeExpressionFunctionTan,
+    eNativeExpressionFunctionAsin,
+    eNativeExpressionFunctionAcos,
+    eNativeExpressionFunctionAtan,
+    eNativeExpressionFunctionAtan2,
+    eNativeExpressionFunctionSinh,
+    eNativeExpressionFunctionCosh,
+    eNativeExpressionFunctionTanh,
+    eNativeExpressionFunctionExp,
+    eNativeExpressionFunctionLog,
+    eNativeExpressionFunctionLog10,
+    eNativeExpressionFunctionLog2,
+    eNativeExpressionFunctionSqrt,
+    eNativeExpressionFunctionPow,
+    eNativeExpressionFunctionFabs,
+    eNativeExpressionFunctionFmod,
+    eNativeExpressionFunctionFloor,
+    eNativeExpressionFunctionCeil,
+    eNativeExpressionFunctionTrunc,
+    eNativeExpressionFunctionHypot,
+    eNativeExpressionFunctionDegrees,
+    eNativeExpressionFunctionRadians,
+    eNativeExpressionFunctionAbs,
+    eNativeExpressionFunctionMin,
+    eNativeExpressionFunctionMax,
+    eNativeExpressionFunctionInt,
+    eNativeExpressionFunctionFloat,
+    eNativeExpressionFunctionBoxstep,
+    eNativeExpressionFunctionLinearstep,
+    eNativeExpressionFunctionSmoothstep,
+    eNativeExpressionFunctionGaussstep,
+    eNativeExpressionFunctionRemap,
+    eNativeExpressionFunctionMix,
+    eNativeExpressionFunctionNoise
+};
+
+struct NativeExpressionFunction
+{
+    const char* name;
+    NativeExpressionFunctionEnum function;
+    int minArgs;
+    int maxArgs; //< -1 if variadic
+};
+
+// The functions of the math module (imported in the scope of expressions) and the builtins
+static const NativeExpressionFunction kMathFunctions[] = {
+    { "sin", eNativeExpressionFunctionSin, 1, 1 },
+    { "cos", eNativeExpressionFunctionCos, 1, 1 },
+    { "tan", eNativeExpressionFunctionTan, 1, 1 },
+    { "asin", eNativeExpressionFunctionAsin, 1, 1 },
+    { "acos", eNativeExpressionFunctionAcos, 1, 1 },
+    { "atan", eNativeExpressionFunctionAtan, 1, 1 },
+    { "atan2", eNativeExpressionFunctionAtan2, 2, 2 },
+    { "sinh", eNativeExpressionFunctionSinh, 1, 1 },
+    { "cosh", eNativeExpressionFunctionCosh, 1, 1 },
+    { "tanh", eNativeExpressionFunctionTanh, 1, 1 },
+    { "exp", eNativeExpressionFunctionExp, 1, 1 },
+    { "log", eNativeExpressionFunctionLog, 1, 2 },
+    { "log10", eNativeExpressionFunctionLog10, 1, 1 },
+    { "log2", eNativeExpressionFunctionLog2, 1, 1 },
+    { "sqrt", eNativeExpressionFunctionSqrt, 1, 1 },
+    { "pow", eNativeExpressionFunctionPow, 2, 2 },
+    { "fabs", eNativeExpressionFunctionFabs, 1, 1 },
+    { "fmod", eNativeExpressionFunctionFmod, 2, 2 },
+    { "floor", eNativeExpressionFunctionFloor, 1, 1 },
+    { "ceil", eNativeExpressionFunctionCeil, 1, 1 },
+    { "trunc", eNativeExpressionFunctionTrunc, 1, 1 },
+    { "hypot", eNativeExpressionFunctionHypot, 2, 2 },
+    { "degrees", eNativeExpressionFunctionDegrees, 1, 1 },
+    { "radians", eNativeExpressionFunctionRadians, 1, 1 },
+    { "abs", eNativeExpressionFunctionAbs, 1, 1 },
+    { "min", eNativeExpressionFunctionMin, 2, -1 },
+    { "max", eNativeExpressionFunctionMax, 2, -1 },
+    { "int", eNativeExpressionFunctionInt, 1, 1 },
+    { "float", eNativeExpressionFunctionFloat, 1, 1 },
+    { 0, eNativeExpressionFunctionSin, 0, 0 }
+};
+
+// The static functions of the ExprUtils class returning a float from floats
+static const NativeExpressionFunction kExprUtilsFunctions[] = {
+    { "boxstep", eNativeExpressionFunctionBoxstep, 2, 2 },
+    { "linearstep", eNativeExpressionFunctionLinearstep, 3, 3 },
+    { "smoothstep", eNativeExpressionFunctionSmoothstep, 3, 3 },
+    { "gaussstep", eNativeExpressionFunctionGaussstep, 3, 3 },
+    { "remap", eNativeExpressionFunctionRemap, 5, 5 },
+    { "mix", eNativeExpressionFunctionMix, 3, 3 },
+    { "noise", eNativeExpressionFunctionNoise, 1, 1 },
+    { 0, eNativeExpressionFunctionSin, 0, 0 }
+};
+
+static const NativeExpressionFunction*
+findFunction(const NativeExpressionFunction* table,
+             const std::string& name)
+{
+    for (; table->name; ++table) {
+        if (name == table->name) {
+            return table;
+        }
+    }
+
+    return 0;
+}
+
+struct NativeExpressionInstruction
+{
+    NativeExpressionOpEnum op;
+    double value; //< for eNativeExpressionOpConstant
+    int index; //< the function for eNativeExpressionOpFunction, the knob reference for eNativeExpressionOpKnob
+    int nArgs; //< number of values popped from the stack by eNativeExpressionOpFunction and eNativeExpressionOpKnob
+};
+
+/**
+ * @brief A parameter read by the expression. Its value is read through the typed pointer which is set,
+ * its animation curve through the untyped one.
+ **/
+struct NativeExpressionKnob
+{
+    KnobIWPtr knob;
+    std::weak_ptr<KnobDoubleBase> doubleKnob;
+    std::weak_ptr<KnobIntBase> intKnob;
+    std::weak_ptr<KnobBoolBase> boolKnob;
+    int dimension;
+    bool readCurve;
+
+    // The nodes referenced by their name to reach the parameter
+    std::vector<NodeWPtr> nodes;
+};
+
+struct NativeExpressionPrivate
+{
+    std::vector<NativeExpressionInstruction> program;
+    std::vector<NativeExpressionKnob> knobs;
+
+    NativeExpressionPrivate()
+        : program()
+        , knobs()
+    {
+    }
+
+    bool readKnob(const NativeExpressionKnob& k, bool atTime, double time, double* value) const;
+};
+
+bool
+NativeExpressionPrivate::readKnob(const NativeExpressionKnob& k,
+                                  bool atTime,
+                                  double time,
+                                  double* value) const
+{
+    // A deleted node is only deactivated while the deletion can be undone, but it is not in the scope of Python
+    // expressions anymore: let Python report the error
+    for (std::vector<NodeWPtr>::const_iterator it = k.nodes.begin(); it != k.nodes.end(); ++it) {
+        NodePtr node = it->lock();
+        if ( !node || !node->isActivated() ) {
+            return false;
+        }
+    }
+    if (k.readCurve) {
+        KnobIPtr knob = k.knob.lock();
+        if (!knob) {
+            return false;
+        }
+        *value = knob->getRawCurveValueAt(time, ViewSpec::current(), k.dimension);
+
+        return true;
+    }
+    if ( std::shared_ptr<KnobDoubleBase> knob = k.doubleKnob.lock() ) {
+        *value = atTime ? knob->getValueAtTime(time, k.dimension) : knob->getValue(k.dimension);
+    } else if ( std::shared_ptr<KnobIntBase> knob = k.intKnob.lock() ) {
+        *value = atTime ? knob->getValueAtTime(time, k.dimension) : knob->getValue(k.dimension);
+    } else if ( std::shared_ptr<KnobBoolBase> knob = k.boolKnob.lock() ) {
+        *value = ( atTime ? knob->getValueAtTime(time, k.dimension) : knob->getValue(k.dimension) ) ? 1. : 0.;
+    } else {
+        // The parameter was deleted: let Python report the error
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Python floor division and modulo of floats: the modulo has the sign of the divisor
+ **/
+static void
+pythonDivMod(double x,
+             double y,
+             double* floorDiv,
+             double* mod)
+{
+    double m = std::fmod(x, y);
+    double div = (x - m) / y;
+
+    if (m != 0.) {
+        if ( (y < 0.) != (m < 0.) ) {
+            m += y;
+            div -= 1.;
+        }
+    } else {
+        m = std::copysign(0., y);
+    }
+    if (div != 0.) {
+        double f = std::floor(div);
+        if (div - f > 0.5) {
+            f += 1.;
+        }
+        div = f;
+    } else {
+        div = std::copysign(0., x / y);
+    }
+    *floorDiv = div;
+    *mod = m;
+}
+
+/**
+ * @brief Evaluates a function, returning false wherever Python could raise an exception.
+ **/
+static bool
+evaluateFunction(NativeExpressionFunctionEnum function,
+                 const double* args,
+                 int nArgs,
+                 double* result)
+{
+    for (int i = 0; i < nArgs; ++i) {
+        if ( !std::isfinite(args[i]) ) {
+            return false;
+        }
+    }
+    double r = 0.;
+    switch (function) {
+    case eNativeExpressionFunctionSin:
+        r = std::sin(args[0]);
+        break;
+    case eNativeExpressionFunctionCos:
+        r = std::cos(args[0]);
+        break;
+    case eNativeExpressionFunctionTan:
+        r = std::tan(args[0]);
+        break;
+    case eNativeExpressionFunctionAsin:
+        r = std::asin(args[0]);
+        break;
+    case eNativeExpressionFunctionAcos:
+        r = std::acos(args[0]);
+        break;
+    case eNativeExpressionFunctionAtan:
+        r = std::atan(args[0]);
+        break;
+    case eNativeExpressionFunctionAtan2:
+        r = std::atan2(args[0], args[1]);
+        break;
+    case eNativeExpressionFunctionSinh:
+        r = std::sinh(args[0]);
+        break;
+    case eNativeExpressionFunctionCosh:
+        r = std::cosh(args[0]);
+        break;
+    case eNativeExpressionFunctionTanh:
+        r = std::tanh(args[0]);
+        break;
+    case eNativeExpressionFunctionExp:
+        r = std::exp(args[0]);
+        break;
+    case eNativeExpressionFunctionLog:
+        if ( (args[0] <= 0.) || ( (nArgs == 2) && ( (args[1] <= 0.) || (args[1] == 1.) ) ) ) {
+            return false;
+        }
+        r = (nArgs == 2) ? std::log(args[0]) / std::log(args[1]) : std::log(args[0]);
+        break;
+    case eNativeExpressionFunctionLog10:
+        if (args[0] <= 0.) {
+            return false;
+        }
+        r = std::log10(args[0]);
+        break;
+    case eNativeExpressionFunctionLog2:
+        if (args[0] <= 0.) {
+            return false;
+        }
+        r = std::log2(args[0]);
+        break;
+    case eNativeExpressionFunctionSqrt:
+        r = std::sqrt(args[0]);
+        break;
+    case eNativeExpressionFunctionPow:
+        if ( ( (args[0] == 0.) && (args[1] < 0.) ) || ( (args[0] < 0.) && (std::floor(args[1]) != args[1]) ) ) {
+            return false;
+        }
+        r = std::pow(args[0], args[1]);
+        break;
+    case eNativeExpressionFunctionFabs:
+    case eNativeExpressionFunctionAbs:
+        r = std::fabs(args[0]);
+        break;
+    case eNativeExpressionFunctionFmod:
+        if (args[1] == 0.) {
+            return false;
+        }
+        r = std::fmod(args[0], args[1]);
+        break;
+    case eNativeExpressionFunctionFloor:
+        r = std::floor(args[0]);
+        break;
+    case eNativeExpressionFunctionCeil:
+        r = std::ceil(args[0]);
+        break;
+    case eNativeExpressionFunctionTrunc:
+    case eNativeExpressionFunctionInt:
+        r = std::trunc(args[0]);
+        break;
+    case eNativeExpressionFunctionHypot:
+        r = std::hypot(args[0], args[1]);
+        break;
+    case eNativeExpressionFunctionDegrees:
+        r = args[0] * (180. / M_PI);
+        break;
+    case eNativeExpressionFunctionRadians:
+        r = args[0] * (M_PI / 180.);
+        break;
+    case eNativeExpressionFunctionMin:
+        r = args[0];
+        for (int i = 1; i < nArgs; ++i) {
+            if (args[i] < r) {
+                r = args[i];
+            }
+        }
+        break;
+    case eNativeExpressionFunctionMax:
+        r = args[0];
+        for (int i = 1; i < nArgs; ++i) {
+            if (args[i] > r) {
+                r = args[i];
+            }
+        }
+        break;
+    case eNativeExpressionFunctionFloat:
+        r = args[0];
+        break;
+    case eNativeExpressionFunctionBoxstep:
+        r = NATRON_PYTHON_NAMESPACE::ExprUtils::boxstep(args[0], args[1]);
+        break;
+    case eNativeExpressionFunctionLinearstep:
+        r = NATRON_PYTHON_NAMESPACE::ExprUtils::linearstep(args[0], args[1], args[2]);
+        break;
+    case eNativeExpressionFunctionSmoothstep:
+        r = NATRON_PYTHON_NAMESPACE::ExprUtils::smoothstep(args[0], args[1], args[2]);
+        break;
+    case eNativeExpressionFunctionGaussstep:
+        r = NATRON_PYTHON_NAMESPACE::ExprUtils::gaussstep(args[0], args[1], args[2]);
+        break;
+    case eNativeExpressionFunctionRemap:
+        r = NATRON_PYTHON_NAMESPACE::ExprUtils::remap(args[0], args[1], args[2], args[3], args[4]);
+        break;
+    case eNativeExpressionFunctionMix:
+        r = NATRON_PYTHON_NAMESPACE::ExprUtils::mix(args[0], args[1], args[2]);
+        break;
+    case eNativeExpressionFunctionNoise:
+        r = NATRON_PYTHON_NAMESPACE::ExprUtils::noise(args[0]);
+        break;
+    } // switch
+    if ( !std::isfinite(r) ) {
+        // Domain or range error
+        return false;
+    }
+    *result = r;
+
+    return true;
+} // evaluateFunction
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+enum TokenTypeEnum
+{
+    eTokenTypeEnd = 0,
+    eTokenTypeNumber,
+    eTokenTypeName,
+    eTokenTypeOperator
+};
+
+struct Token
+{
+    TokenTypeEnum type;
+    std::string text;
+    double value;
+};
+
+/**
+ * @brief Recursive descent parser of the supported subset, following the grammar and the precedence of Python.
+ * Anything outside of the subset throws std::invalid_argument.
+ **/
+class ExpressionCompiler
+{
+public:
+
+    ExpressionCompiler(const std::string& expression,
+                       KnobHelper* knob,
+                       int dimension,
+                       NativeExpressionPrivate* output)
+        : _expr(expression)
+        , _pos(0)
+        , _token()
+        , _knob(knob)
+        , _dimension(dimension)
+        , _node()
+        , _collection()
+        , _siblings()
+        , _out(output)
+        , _depth(0)
+    {
+        EffectInstance* effect = dynamic_cast<EffectInstance*>( knob->getHolder() );
+        if (!effect) {
+            throw std::invalid_argument("not a parameter of a node");
+        }
+        _node = effect->getNode();
+        _collection = _node ? _node->getGroup() : NodeCollectionPtr();
+        if (!_collection) {
+            throw std::invalid_argument("the node is not in a group");
+        }
+
+        // The nodes declared in the scope of the expression, see KnobHelperPrivate::declarePythonVariables()
+        NodesList siblings = _collection->getNodes();
+        for (NodesList::iterator it = siblings.begin(); it != siblings.end(); ++it) {
+            if ( (*it)->isActivated() && !(*it)->getParentMultiInstance() ) {
+                _siblings[(*it)->getScriptName_mt_safe()] = *it;
+            }
+        }
+    }
+
+    void compile()
+    {
+        next();
+        parseExpression();
+        if (_token.type != eTokenTypeEnd) {
+            throw std::invalid_argument("unexpected token");
+        }
+        assert(_depth == 1);
+    }
+
+private:
+
+    enum ScopeTypeEnum
+    {
+        eScopeTypeNode = 0,
+        eScopeTypeApp,
+        eScopeTypeKnob
+    };
+
+    void next()
+    {
+        while ( _pos < _expr.size() && ( (_expr[_pos] == ' ') || (_expr[_pos] == '\t') ) ) {
+            ++_pos;
+        }
+        _token.text.clear();
+        _token.value = 0.;
+        if ( _pos >= _expr.size() ) {
+            _token.type = eTokenTypeEnd;
+
+            return;
+        }
+        char c = _expr[_pos];
+        if ( std::isdigit( (unsigned char)c ) || ( (c == '.') && (_pos + 1 < _expr.size()) && std::isdigit( (unsigned char)_expr[_pos + 1] ) ) ) {
+            const char* start = _expr.c_str() + _pos;
+            char* end = 0;
+            // Only decimal literals are supported: reject the hexadecimal, binary, octal and complex ones and the underscores
+            if ( (c == '0') && (_pos + 1 < _expr.size()) && std::isalpha( (unsigned char)_expr[_pos + 1] ) && (_expr[_pos + 1] != 'e') && (_expr[_pos + 1] != 'E') ) {
+                throw std::invalid_argument("unsupported literal");
+            }
+            _token.value = std::strtod(start, &end);
+            _pos += end - start;
+            if ( (_pos < _expr.size()) && ( std::isalnum( (unsigned char)_expr[_pos] ) || (_expr[_pos] == '_') || (_expr[_pos] == '.') ) ) {
+                throw std::invalid_argument("unsupported literal");
+            }
+            _token.type = eTokenTypeNumber;
+
+            return;
+        }
+        if ( std::isalpha( (unsigned char)c ) || (c == '_') ) {
+            std::size_t start = _pos;
+            while ( _pos < _expr.size() && ( std::isalnum( (unsigned char)_expr[_pos] ) || (_expr[_pos] == '_') ) ) {
+                ++_pos;
+            }
+            _token.type = eTokenTypeName;
+            _token.text = _expr.substr(start, _pos - start);
+
+            return;
+        }
+        static const char* const operators[] = { "**", "//", "+", "-", "*", "/", "%", "(", ")", ",", ".", 0 };
+        for (int i = 0; operators[i]; ++i) {
+            std::size_t len = std::strlen(operators[i]);
+            if (_expr.compare(_pos, len, operators[i]) == 0) {
+                _token.type = eTokenTypeOperator;
+                _token.text = operators[i];
+                _pos += len;
+
+                // Reject the augmented and comparison operators starting like ours
+                if ( (_pos < _expr.size()) && (_expr[_pos] == '=') ) {
+                    throw std::invalid_argument("unsupported operator");
+                }
+
+                return;
+            }
+        }
+        throw std::invalid_argument("unsupported character");
+    } // next
+
+    bool isOperator(const char* op) const
+    {
+        return _token.type == eTokenTypeOperator && _token.text == op;
+    }
+
+    void expectOperator(const char* op)
+    {
+        if ( !isOperator(op) ) {
+            throw std::invalid_argument(std::string("expected ") + op);
+        }
+        next();
+    }
+
+    std::string expectName()
+    {
+        if (_token.type != eTokenTypeName) {
+            throw std::invalid_argument("expected a name");
+        }
+        std::string ret = _token.text;
+        next();
+
+        return ret;
+    }
+
+    void emit(NativeExpressionOpEnum op,
+              int nPopped,
+              double value = 0.,
+              int index = 0)
+    {
+        NativeExpressionInstruction i;
+
+        i.op = op;
+        i.value = value;
+        i.index = index;
+        i.nArgs = nPopped;
+        _out->program.push_back(i);
+        _depth += 1 - nPopped;
+        if (_depth > NATRON_NATIVE_EXPRESSION_MAX_STACK_DEPTH) {
+            throw std::invalid_argument("expression too deep");
+        }
+    }
+
+    // expression := term (('+' | '-') term)*
+    void parseExpression()
+    {
+        parseTerm();
+        for (;;) {
+            if ( isOperator("+") ) {
+                next();
+                parseTerm();
+                emit(eNativeExpressionOpAdd, 2);
+            } else if ( isOperator("-") ) {
+                next();
+                parseTerm();
+                emit(eNativeExpressionOpSubtract, 2);
+            } else {
+                break;
+            }
+        }
+    }
+
+    // term := factor (('*' | '/' | '//' | '%') factor)*
+    void parseTerm()
+    {
+        parseFactor();
+        for (;;) {
+            NativeExpressionOpEnum op;
+            if ( isOperator("*") ) {
+                op = eNativeExpressionOpMultiply;
+            } else if ( isOperator("/") ) {
+                op = eNativeExpressionOpDivide;
+            } else if ( isOperator("//") ) {
+                op = eNativeExpressionOpFloorDivide;
+            } else if ( isOperator("%") ) {
+                op = eNativeExpressionOpModulo;
+            } else {
+                break;
+            }
+            next();
+            parseFactor();
+            emit(op, 2);
+        }
+    }
+
+    // factor := ('+' | '-') factor | power
+    void parseFactor()
+    {
+        if ( isOperator("-") ) {
+            next();
+            parseFactor();
+            emit(eNativeExpressionOpNegate, 1);
+        } else if ( isOperator("+") ) {
+            next();
+            parseFactor();
+        } else {
+            parsePower();
+        }
+    }
+
+    // power := primary ['**' factor]
+    void parsePower()
+    {
+        parsePrimary();
+        if ( isOperator("**") ) {
+            next();
+            parseFactor();
+            emit(eNativeExpressionOpPower, 2);
+        }
+    }
+
+    // primary := number | '(' expression ')' | name...
+    void parsePrimary()
+    {
+        if (_token.type == eTokenTypeNumber) {
+            double value = _token.value;
+            next();
+            emit(eNativeExpressionOpConstant, 0, value);
+        } else if ( isOperator("(") ) {
+            next();
+            parseExpression();
+            expectOperator(")");
+        } else if (_token.type == eTokenTypeName) {
+            parseName();
+        } else {
+            throw std::invalid_argument("unexpected token");
+        }
+    }
+
+    /**
+     * @brief Returns true if the name refers to a variable defined in the scope of the expression,
+     * which would hide the builtins of the same name.
+     **/
+    bool isScopeVariable(const std::string& name) const
+    {
+        return _siblings.find(name) != _siblings.end() ||
+               name == "thisNode" || name == "thisParam" || name == "thisGroup" || name == "app" ||
+               name == "random" || name == "randomInt" || name == "curve" || name == "dimension";
+    }
+
+    void parseName()
+    {
+        std::string name = expectName();
+
+        if ( (name == "thisParam") || (name == "thisNode") || (name == "thisGroup") || ( _siblings.find(name) != _siblings.end() ) ) {
+            parseReference(name);
+        } else if (name == "dimension") {
+            emit(eNativeExpressionOpConstant, 0, _dimension);
+        } else if (name == "curve") {
+            parseKnobFunction( _knob->shared_from_this(), std::vector<NodeWPtr>(), name );
+        } else if ( isScopeVariable(name) ) {
+            throw std::invalid_argument("unsupported variable");
+        } else if (name == "frame") {
+            emit(eNativeExpressionOpFrame, 0);
+        } else if (name == "view") {
+            emit(eNativeExpressionOpView, 0);
+        } else if (name == "pi") {
+            emit(eNativeExpressionOpConstant, 0, M_PI);
+        } else if (name == "e") {
+            emit(eNativeExpressionOpConstant, 0, M_E);
+        } else if ( (name == "ExprUtils") || (name == "NatronEngine") ) {
+            if (name == "NatronEngine") {
+                expectOperator(".");
+                if (expectName() != "ExprUtils") {
+                    throw std::invalid_argument("unsupported attribute");
+                }
+            }
+            expectOperator(".");
+            const NativeExpressionFunction* f = findFunction( kExprUtilsFunctions, expectName() );
+            if (!f) {
+                throw std::invalid_argument("unsupported function");
+            }
+            parseFunctionCall(*f);
+        } else {
+            const NativeExpressionFunction* f = findFunction(kMathFunctions, name);
+            if (!f) {
+                throw std::invalid_argument("unsupported name");
+            }
+            parseFunctionCall(*f);
+        }
+    } // parseName
+
+    void parseFunctionCall(const NativeExpressionFunction& f)
+    {
+        expectOperator("(");
+        int nArgs = 0;
+        if ( !isOperator(")") ) {
+            for (;;) {
+                parseExpression();
+                ++nArgs;
+                if ( !isOperator(",") ) {
+                    break;
+                }
+                next();
+            }
+        }
+        expectOperator(")");
+        if ( (nArgs < f.minArgs) || ( (f.maxArgs >= 0) && (nArgs > f.maxArgs) ) ) {
+            throw std::invalid_argument("wrong number of arguments");
+        }
+        emit(eNativeExpressionOpFunction, nArgs, 0., (int)f.function);
+    }
+
+    /**
+     * @brief Follows the attributes of the given variable of the scope until a parameter, then parses the
+     * function called on it.
+     **/
+    void parseReference(const std::string& variable)
+    {
+        ScopeTypeEnum type;
+        NodePtr node;
+        KnobIPtr knob;
+        std::vector<NodeWPtr> referencedNodes;
+
+        if (variable == "thisParam") {
+            type = eScopeTypeKnob;
+            knob = _knob->shared_from_this();
+        } else if (variable == "thisNode") {
+            type = eScopeTypeNode;
+            node = _node;
+        } else if (variable == "thisGroup") {
+            NodeGroup* isGroup = dynamic_cast<NodeGroup*>( _collection.get() );
+            if (isGroup) {
+                type = eScopeTypeNode;
+                node = isGroup->getNode();
+            } else {
+                type = eScopeTypeApp;
+            }
+        } else {
+            type = eScopeTypeNode;
+            node = _siblings[variable];
+            referencedNodes.push_back(node);
+        }
+
+        while (type != eScopeTypeKnob) {
+            expectOperator(".");
+            std::string attribute = expectName();
+            if (type == eScopeTypeApp) {
+                node = _collection->getNodeByName(attribute);
+                if ( !node || !node->isActivated() ) {
+                    throw std::invalid_argument("unknown node");
+                }
+                referencedNodes.push_back(node);
+                type = eScopeTypeNode;
+            } else {
+                assert(node);
+                KnobIPtr nodeKnob = node->getKnobByName(attribute);
+                NodePtr child;
+                NodeGroup* isGroup = dynamic_cast<NodeGroup*>( node->getEffectInstance().get() );
+                if (isGroup) {
+                    child = isGroup->getNodeByName(attribute);
+                    if ( child && !child->isActivated() ) {
+                        child.reset();
+                    }
+                }
+                if (nodeKnob && !child) {
+                    knob = nodeKnob;
+                    type = eScopeTypeKnob;
+                } else if (child && !nodeKnob) {
+                    node = child;
+                    referencedNodes.push_back(node);
+                } else {
+                    throw std::invalid_argument("unknown or ambiguous attribute");
+                }
+            }
+        }
+
+        expectOperator(".");
+        parseKnobFunction( knob, referencedNodes, expectName() );
+    } // parseReference
+
+    /**
+     * @brief Parses the argument of a dimension, which must be known when compiling.
+     **/
+    int parseDimensionArgument(const KnobIPtr& knob)
+    {
+        int ret;
+
+        if ( (_token.type == eTokenTypeNumber) && (_token.value == std::floor(_token.value)) ) {
+            ret = (int)_token.value;
+        } else if ( (_token.type == eTokenTypeName) && (_token.text == "dimension") ) {
+            ret = _dimension;
+        } else {
+            throw std::invalid_argument("the dimension must be a constant");
+        }
+        next();
+        if ( (ret < 0) || ( ret >= knob->getDimension() ) ) {
+            throw std::invalid_argument("invalid dimension");
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief Parses the call of get(), getValue(), getValueAtTime() or curve() on the given parameter, reached through
+     * the given nodes.
+     **/
+    void parseKnobFunction(const KnobIPtr& knob,
+                           const std::vector<NodeWPtr>& referencedNodes,
+                           const std::string& function)
+    {
+        // Only the parameters whose Python get() returns numbers, see PyParameter.h
+        KnobI* k = knob.get();
+        bool isColor = dynamic_cast<KnobColor*>(k) != 0;
+        bool isSupported = isColor || dynamic_cast<KnobDouble*>(k) || dynamic_cast<KnobInt*>(k) ||
+                           dynamic_cast<KnobChoice*>(k) || dynamic_cast<KnobBool*>(k);
+        if (!isSupported) {
+            throw std::invalid_argument("unsupported parameter type");
+        }
+
+        NativeExpressionKnob ref;
+        ref.knob = knob;
+        ref.dimension = 0;
+        ref.readCurve = (function == "curve");
+        ref.nodes = referencedNodes;
+        bool hasTime = false;
+        expectOperator("(");
+        if (function == "get") {
+            if ( !isOperator(")") ) {
+                parseExpression();
+                hasTime = true;
+            }
+            expectOperator(")");
+            if ( isColor || (knob->getDimension() > 1) ) {
+                // get() returns a tuple
+                expectOperator(".");
+                std::string field = expectName();
+                static const char* const xyz[] = { "x", "y", "z", 0 };
+                static const char* const rgba[] = { "r", "g", "b", "a", 0 };
+                const char* const* fields = isColor ? rgba : xyz;
+                ref.dimension = -1;
+                for (int i = 0; fields[i]; ++i) {
+                    if (field == fields[i]) {
+                        ref.dimension = i;
+                    }
+                }
+                if ( (ref.dimension < 0) || ( ref.dimension >= knob->getDimension() ) ) {
+                    throw std::invalid_argument("unknown tuple field");
+                }
+            }
+        } else if (function == "getValue") {
+            if ( !isOperator(")") ) {
+                ref.dimension = parseDimensionArgument(knob);
+            }
+            expectOperator(")");
+        } else if ( (function == "getValueAtTime") || (function == "curve") ) {
+            parseExpression();
+            hasTime = true;
+            if ( isOperator(",") ) {
+                next();
+                ref.dimension = parseDimensionArgument(knob);
+            }
+            expectOperator(")");
+        } else {
+            throw std::invalid_argument("unsupported function");
+        }
+
+        if (!ref.readCurve) {
+            ref.doubleKnob = std::dynamic_pointer_cast<KnobDoubleBase>(knob);
+            ref.intKnob = std::dynamic_pointer_cast<KnobIntBase>(knob);
+            ref.boolKnob = std::dynamic_pointer_cast<KnobBoolBase>(knob);
+        }
+        _out->knobs.push_back(ref);
+        emit(eNativeExpressionOpKnob, hasTime ? 1 : 0, 0., (int)_out->knobs.size() - 1);
+    } // parseKnobFunction
+
+    const std::string& _expr;
+    std::size_t _pos;
+    Token _token;
+    KnobHelper* _knob;
+    int _dimension;
+    NodePtr _node;
+    NodeCollectionPtr _collection;
+    std::map<std::string, NodePtr> _siblings;
+    NativeExpressionPrivate* _out;
+    int _depth;
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+NativeExpression::NativeExpression()
+    : _imp( new NativeExpressionPrivate() )
+{
+}
+
+NativeExpression::~NativeExpression()
+{
+}
+
+NativeExpressionPtr
+NativeExpression::compile(const std::string& expression,
+                          KnobHelper* knob,
+                          int dimension)
+{
+    NativeExpressionPtr ret( new NativeExpression() );
+
+    try {
+        ExpressionCompiler compiler(expression, knob, dimension, ret->_imp.get());
+        compiler.compile();
+    } catch (const std::exception& /*e*/) {
+        // Not in the supported subset, Python evaluates it
+        return NativeExpressionPtr();
+    }
+
+    return ret;
+}
+
+bool
+NativeExpression::evaluate(double time,
+                           ViewIdx view,
+                           double* result) const
+{
+    double stack[NATRON_NATIVE_EXPRESSION_MAX_STACK_DEPTH];
+    int top = 0;
+
+    for (std::vector<NativeExpressionInstruction>::const_iterator it = _imp->program.begin(); it != _imp->program.end(); ++it) {
+        switch (it->op) {
+        case eNativeExpressionOpConstant:
+            stack[top++] = it->value;
+            break;
+        case eNativeExpressionOpFrame:
+            stack[top++] = time;
+            break;
+        case eNativeExpressionOpView:
+            stack[top++] = (double)view.value();
+            break;
+        case eNativeExpressionOpNegate:
+            stack[top - 1] = -stack[top - 1];
+            break;
+        case eNativeExpressionOpAdd:
+            --top;
+            stack[top - 1] += stack[top];
+            break;
+        case eNativeExpressionOpSubtract:
+            --top;
+            stack[top - 1] -= stack[top];
+            break;
+        case eNativeExpressionOpMultiply:
+            --top;
+            stack[top - 1] *= stack[top];
+            break;
+        case eNativeExpressionOpDivide:
+            --top;
+            if (stack[top] == 0.) {
+                return false;
+            }
+            stack[top - 1] /= stack[top];
+            break;
+        case eNativeExpressionOpFloorDivide:
+        case eNativeExpressionOpModulo: {
+            --top;
+            if (stack[top] == 0.) {
+                return false;
+            }
+            double floorDiv, mod;
+            pythonDivMod(stack[top - 1], stack[top], &floorDiv, &mod);
+            stack[top - 1] = (it->op == eNativeExpressionOpModulo) ? mod : floorDiv;
+            break;
+        }
+        case eNativeExpressionOpPower: {
+            --top;
+            double x = stack[top - 1];
+            double y = stack[top];
+            // 0 ** -1 raises ZeroDivisionError and (-8) ** (1/3) is a complex number
+            if ( ( (x == 0.) && (y < 0.) ) || ( (x < 0.) && std::isfinite(y) && (std::floor(y) != y) ) ) {
+                return false;
+            }
+            double r = std::pow(x, y);
+            if ( !std::isfinite(r) && std::isfinite(x) && std::isfinite(y) ) {
+                // OverflowError
+                return false;
+            }
+            stack[top - 1] = r;
+            break;
+        }
+        case eNativeExpressionOpFunction:
+            top -= it->nArgs;
+            if ( !evaluateFunction( (NativeExpressionFunctionEnum)it->index, &stack[top], it->nArgs, &stack[top] ) ) {
+                return false;
+            }
+            ++top;
+            break;
+        case eNativeExpressionOpKnob: {
+            double t = time;
+            if (it->nArgs == 1) {
+                t = stack[--top];
+            }
+            if ( !_imp->readKnob(_imp->knobs[it->index], it->nArgs == 1, t, &stack[top]) ) {
+                return false;
+            }
+            ++top;
+            break;
+        }
+        } // switch
+    }
+    assert(top == 1);
+    *result = stack[0];
+
+    return true;
+} // NativeExpression::evaluate
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,89 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_NativeExpression_h
+#define Natron_Engine_NativeExpression_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <memory>
+#include <string>
+
+#include "Engine/ViewIdx.h"
+#include "Engine/EngineFwd.h"
+
+// Maximum number of values on the evaluation stack of a native expression
+#define NATRON_NATIVE_EXPRESSION_MAX_STACK_DEPTH 64
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief A single-line knob expression compiled to a small stack program, which is evaluated without
+ * the Python interpreter, hence without taking the Python GIL from the render threads.
+ * Only the following subset of Python is recognized, with the Python semantics:
+ * - int and float literals, parentheses and the +, -, *, /, //, % and ** operators
+ * - the frame, view and dimension variables, and the pi and e constants
+ * - the functions of the math module that return a float (sin, cos, sqrt, pow, floor, atan2...), abs, min, max, int and float
+ * - the boxstep, linearstep, smoothstep, gaussstep, remap, mix and noise(x) functions of ExprUtils
+ * - curve(time[, dimension])
+ * - the get([time]), getValue([dimension]), getValueAtTime(time[, dimension]) and curve(time[, dimension]) functions of
+ *   the numeric parameters referenced by thisParam, thisNode.param, thisGroup.param, Node.param or Group.Node.param.
+ *   A node referenced by its name must still be activated when the expression is evaluated.
+ *   The components of the tuples returned by get() on multi-dimensional parameters are read with .x, .y, .z or .r, .g, .b, .a
+ * Any other expression is rejected by compile() and keeps being evaluated by Python.
+ * Operations that raise an exception in Python (division by zero, math domain errors...) make evaluate() fail,
+ * so that the caller falls back to Python which reports the error.
+ * This class is MT-safe once compiled.
+ **/
+struct NativeExpressionPrivate;
+class NativeExpression
+{
+public:
+
+    ~NativeExpression();
+
+    /**
+     * @brief Compiles the expression of the given dimension of the knob, resolving the parameters it references.
+     * Returns null if the expression is not in the supported subset.
+     * Must be called on the thread that sets the expression, since it looks up the nodes in the scope of the expression.
+     **/
+    static NativeExpressionPtr compile(const std::string& expression, KnobHelper* knob, int dimension);
+
+    /**
+     * @brief Evaluates the expression at the given time and view. Returns false if the evaluation failed, e.g. because a
+     * referenced parameter was deleted or an operation is invalid, in which case the expression must be evaluated by Python.
+     **/
+    bool evaluate(double time, ViewIdx view, double* result) const;
+
+private:
+
+    NativeExpression();
+
+    std::unique_ptr<NativeExpressionPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_NativeExpression_h
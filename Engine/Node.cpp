@@ -792,6 +792,44 @@ Node::computeHashInternal()
         qDebug() << "Node::computeHash(): inputs not initialized";
     }
 
+    bool contentBased = isContentBasedHashEnabled();
+
+    ///In content based mode, hash the values of the knobs that may change the output of the effect.
+    ///This is done before taking the knobsAge lock since it locks each knob in turn.
+    ///The knobs hash is cached until a knob of this node changes, so that nodes downstream of a change
+    ///do not hash all their knobs again.
+    U64 knobsHash = 0;
+    if (contentBased) {
+        //Mark the cache valid before reading the knobs: a change made meanwhile invalidates it again
+        if ( _imp->knobsContentHashValid.fetchAndStoreOrdered(1) ) {
+            knobsHash = _imp->knobsContentHash;
+        } else {
+            Hash64 knobsValuesHash;
+            bool dependsOnOtherKnobs = false;
+            const KnobsVec & knobs = _imp->effect->getKnobs();
+            for (KnobsVec::const_iterator it = knobs.begin(); it != knobs.end(); ++it) {
+                if ( !(*it)->getEvaluateOnChange() ) {
+                    continue;
+                }
+                (*it)->appendToHash(&knobsValuesHash);
+                for (int i = 0; i < (*it)->getDimension(); ++i) {
+                    if ( (*it)->isSlave(i) || !(*it)->getExpression(i).empty() ) {
+                        dependsOnOtherKnobs = true;
+                    }
+                }
+            }
+            knobsValuesHash.computeHash();
+            knobsHash = knobsValuesHash.value();
+            _imp->knobsContentHash = knobsHash;
+            if (dependsOnOtherKnobs) {
+                //The hash follows masters and expressions dependencies whose changes do not invalidate this node
+                _imp->knobsContentHashValid.fetchAndStoreOrdered(0);
+            }
+        }
+    }
+
+    U64 constantHashContribution = _imp->getConstantHashContribution();
+
     U64 oldHash, newHash;
     {
         QWriteLocker l(&_imp->knobsAgeMutex);
@@ -801,8 +839,12 @@ Node::computeHashInternal()
         ///reset the hash value
         _imp->hash.reset();
 
-        ///append the effect's own age
+        ///append the effect's own age. In content based mode, it is only incremented by changes that are not
+        ///reflected by the knobs values (e.g. a roto shape being edited or a file being reloaded).
         _imp->hash.append(_imp->knobsAge);
+        if (contentBased) {
+            _imp->hash.append(knobsHash);
+        }
 
         ///append all inputs hash
         RotoDrawableItemPtr attachedStroke = _imp->paintStroke.lock();
@@ -850,13 +892,8 @@ Node::computeHashInternal()
         //            _imp->hash.append(rotoAge);
         //        }
 
-        ///Also append the effect's label to distinguish 2 instances with the same parameters
-        Hash64_appendQString( &_imp->hash, QString::fromUtf8( getScriptName().c_str() ) );
-
-        ///Also append the project's creation time in the hash because 2 projects opened concurrently
-        ///could reproduce the same (especially simple graphs like Viewer-Reader)
-        qint64 creationTime =  getApp()->getProject()->getProjectCreationTime();
-        _imp->hash.append(creationTime);
+        ///Also append the effect's label and the project's creation time, see getConstantHashContribution()
+        _imp->hash.append(constantHashContribution);
 
         _imp->hash.computeHash();
 
@@ -866,27 +903,92 @@ Node::computeHashInternal()
 
     if (hashChanged) {
         _imp->effect->onNodeHashChanged(newHash);
+
+        /*
+         * With the knobs age, all cache entries for this node with a different hash are impossible to re-create again.
+         * In content based mode, setting back the knobs to previous values produces a previous hash again:
+         * keep the images of the most recent hashes.
+         */
+        std::vector<U64> hashesToKeep;
+        {
+            QWriteLocker l(&_imp->knobsAgeMutex);
+            if (contentBased) {
+                _imp->recentHashes.remove(newHash);
+                _imp->recentHashes.push_front(newHash);
+                int maxVariants = std::max( 1, appPTR->getCurrentSettings()->getNodeCacheVariantsCount() );
+                while ( (int)_imp->recentHashes.size() > maxVariants ) {
+                    _imp->recentHashes.pop_back();
+                }
+            } else {
+                _imp->recentHashes.clear();
+                _imp->recentHashes.push_back(newHash);
+            }
+            hashesToKeep.assign( _imp->recentHashes.begin(), _imp->recentHashes.end() );
+        }
         if ( _imp->nodeCreated && !getApp()->getProject()->isProjectClosing() ) {
             /*
-             * We changed the node hash. That means all cache entries for this node with a different hash
-             * are impossible to re-create again. Just discard them all. This is done in a separate thread.
+             * We changed the node hash. Discard all the images that cannot be produced anymore.
+             * This is done in a separate thread.
              */
-            removeAllImagesFromCacheWithMatchingIDAndDifferentKey(newHash);
+            removeAllImagesFromCacheWithMatchingIDAndDifferentKey(hashesToKeep);
         }
     }
 
     return hashChanged;
 } // Node::computeHashInternal
 
+U64
+Node::Implementation::getConstantHashContribution()
+{
+    {
+        QMutexLocker l(&nameMutex);
+        if (constantHashContribution) {
+            return constantHashContribution;
+        }
+    }
+
+    Hash64 constantHash;
+
+    ///Append the effect's label to distinguish 2 instances with the same parameters
+    Hash64_appendQString( &constantHash, QString::fromUtf8( _publicInterface->getScriptName_mt_safe().c_str() ) );
+
+    ///Also append the project's creation time in the hash because 2 projects opened concurrently
+    ///could reproduce the same (especially simple graphs like Viewer-Reader).
+    ///A node never outlives the project it was created in, whose creation time is set before any node is created.
+    constantHash.append( _publicInterface->getApp()->getProject()->getProjectCreationTime() );
+    constantHash.computeHash();
+
+    QMutexLocker l(&nameMutex);
+    constantHashContribution = constantHash.value();
+
+    return constantHashContribution;
+}
+
+/**
+ * @brief Returns a new identifier for a walk of computeHashRecursive: nodes visited during that walk are marked with it.
+ * Only called on the main thread.
+ **/
+static U64
+nextHashGeneration()
+{
+    static U64 generation = 0;
+
+    assert( QThread::currentThread() == qApp->thread() );
+
+    return ++generation;
+}
+
 void
-Node::computeHashRecursive(std::list<Node*>& marked)
+Node::computeHashRecursive(U64 generation,
+                           std::vector<Node*>* nodesVisited)
 {
-    if ( std::find(marked.begin(), marked.end(), this) != marked.end() ) {
+    if (_imp->hashGeneration == generation) {
         return;
     }
+    _imp->hashGeneration = generation;
+    nodesVisited->push_back(this);
 
     bool hasChanged = computeHashInternal();
-    marked.push_back(this);
     if (!hasChanged) {
         //Nothing changed, no need to recurse on outputs
         return;
@@ -906,7 +1008,7 @@ Node::computeHashRecursive(std::list<Node*>& marked)
         if ( isRotoPaint && attachedStroke && (attachedStroke->getContext()->getNode().get() == this) ) {
             continue;
         }
-        (*it)->computeHashRecursive(marked);
+        (*it)->computeHashRecursive(generation, nodesVisited);
     }
 
 
@@ -915,13 +1017,36 @@ Node::computeHashRecursive(std::list<Node*>& marked)
         NodesList allItems;
         _imp->rotoContext->getRotoPaintTreeNodes(&allItems);
         for (NodesList::iterator it = allItems.begin(); it != allItems.end(); ++it) {
-            (*it)->computeHashRecursive(marked);
+            (*it)->computeHashRecursive(generation, nodesVisited);
         }
     }
 }
 
 void
-Node::removeAllImagesFromCacheWithMatchingIDAndDifferentKey(U64 nodeHashKey)
+Node::setHashPropagationNodesVisited(const std::vector<Node*>& nodesVisited)
+{
+    for (std::vector<Node*>::const_iterator it = nodesVisited.begin(); it != nodesVisited.end(); ++it) {
+        QWriteLocker l(&(*it)->_imp->knobsAgeMutex);
+        (*it)->_imp->hashPropagationNodesVisited = (int)nodesVisited.size();
+    }
+}
+
+int
+Node::getHashPropagationNodesVisited() const
+{
+    QReadLocker l(&_imp->knobsAgeMutex);
+
+    return _imp->hashPropagationNodesVisited;
+}
+
+void
+Node::invalidateKnobsHash()
+{
+    _imp->knobsContentHashValid.fetchAndStoreOrdered(0);
+}
+
+void
+Node::removeAllImagesFromCacheWithMatchingIDAndDifferentKey(const std::vector<U64>& nodeHashesToKeep)
 {
     AppInstancePtr app = getApp();
 
@@ -933,13 +1058,9 @@ Node::removeAllImagesFromCacheWithMatchingIDAndDifferentKey(U64 nodeHashKey)
     if ( proj->isProjectClosing() || proj->isLoadingProject() ) {
         return;
     }
-    appPTR->removeAllImagesFromCacheWithMatchingIDAndDifferentKey(this, nodeHashKey);
-    appPTR->removeAllImagesFromDiskCacheWithMatchingIDAndDifferentKey(this, nodeHashKey);
-    ViewerInstance* isViewer = dynamic_cast<ViewerInstance*>( _imp->effect.get() );
-    if (isViewer) {
-        //Also remove from viewer cache
-        appPTR->removeAllTexturesFromCacheWithMatchingIDAndDifferentKey(this, nodeHashKey);
-    }
+    //Also remove from viewer cache for viewers
+    bool isViewer = dynamic_cast<ViewerInstance*>( _imp->effect.get() ) != 0;
+    appPTR->removeAllImagesFromCachesWithMatchingIDAndDifferentKey(this, nodeHashesToKeep, isViewer);
 }
 
 void
@@ -973,8 +1094,9 @@ Node::computeHash()
 
         return;
     }
-    std::list<Node*> marked;
-    computeHashRecursive(marked);
+    std::vector<Node*> nodesVisited;
+    computeHashRecursive(nextHashGeneration(), &nodesVisited);
+    setHashPropagationNodesVisited(nodesVisited);
 } // computeHash
 
 
@@ -1297,6 +1419,12 @@ Node::incrementKnobsAge()
     computeHash();
 }
 
+bool
+Node::isContentBasedHashEnabled() const
+{
+    return appPTR->getCurrentSettings()->isContentBasedNodeHashEnabled();
+}
+
 U64
 Node::getKnobsAge() const
 {
@@ -1523,13 +1651,18 @@ Node::isActivated() const
 std::string
 Node::makeCacheInfo() const
 {
-    std::size_t ram, disk;
+    std::size_t ram, compressed, disk;
 
-    appPTR->getMemoryStatsForCacheEntryHolder(this, &ram, &disk);
+    appPTR->getMemoryStatsForCacheEntryHolder(this, &ram, &compressed, &disk);
     QString ramSizeStr = printAsRAM( (U64)ram );
+    QString compressedSizeStr = printAsRAM( (U64)compressed );
     QString diskSizeStr = printAsRAM( (U64)disk );
     std::stringstream ss;
-    ss << "<b><font color=\"green\">Cache occupancy:</font></b> RAM: <font color=#c8c8c8>" << ramSizeStr.toStdString() << "</font> / Disk: <font color=#c8c8c8>" << diskSizeStr.toStdString() << "</font>";
+    ss << "<b><font color=\"green\">Cache occupancy:</font></b> RAM: <font color=#c8c8c8>" << ramSizeStr.toStdString() << "</font>";
+    if (compressed > 0) {
+        ss << " / Compressed RAM: <font color=#c8c8c8>" << compressedSizeStr.toStdString() << "</font>";
+    }
+    ss << " / Disk: <font color=#c8c8c8>" << diskSizeStr.toStdString() << "</font>";
 
     return ss.str();
 }
@@ -1599,6 +1732,7 @@ Node::makeInfoForInput(int inputNumber) const
                 break;
             case eImageBitDepthHalf:
                 depthStr = tr("16fp");
+                break;
             case eImageBitDepthNone:
                 break;
         }
@@ -3420,8 +3554,10 @@ Node::makePreviewImage(SequenceTime time,
             renderPreviewForDepth<unsigned short, 65535>(*img, elemCount, width, height, convertToSrgb, buf);
             break;
         }
-        case eImageBitDepthHalf:
+        case eImageBitDepthHalf: {
+            renderPreviewForDepth<Half, 1>(*img, elemCount, width, height, convertToSrgb, buf);
             break;
+        }
         case eImageBitDepthFloat: {
             renderPreviewForDepth<float, 1>(*img, elemCount, width, height, convertToSrgb, buf);
             break;
@@ -4912,12 +5048,14 @@ Node::onEffectKnobValueChanged(KnobI* what,
             ///When a group is disabled we have to force a hash change of all nodes inside otherwise the image will stay cached
 
             NodesList nodes = isGroup->getNodes();
-            std::list<Node*> markedNodes;
+            U64 generation = nextHashGeneration();
+            std::vector<Node*> nodesVisited;
             for (NodesList::iterator it = nodes.begin(); it != nodes.end(); ++it) {
                 //This will not trigger a hash recomputation
                 (*it)->incrementKnobsAge_internal();
-                (*it)->computeHashRecursive(markedNodes);
+                (*it)->computeHashRecursive(generation, &nodesVisited);
             }
+            setHashPropagationNodesVisited(nodesVisited);
         }
     } else if ( what == _imp->nodeLabelKnob.lock().get() ) {
         Q_EMIT nodeExtraLabelChanged( QString::fromUtf8( _imp->nodeLabelKnob.lock()->getValue().c_str() ) );
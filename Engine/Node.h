@@ -869,6 +869,12 @@ public:
 
     void refreshPreviewsRecursivelyUpstream(double time);
 
+    /**
+     * @brief Returns true if the node hash is computed from the values of the knobs (see Settings::isContentBasedNodeHashEnabled())
+     * in which case a knob change only needs the hash to be recomputed, otherwise the knobs age must be incremented.
+     **/
+    bool isContentBasedHashEnabled() const;
+
     void incrementKnobsAge();
 
     void incrementKnobsAge_internal();
@@ -878,6 +884,18 @@ public:
 
     U64 getKnobsAge() const;
 
+    /**
+     * @brief Returns the number of nodes whose hash was recomputed by the last hash propagation
+     * (e.g: following a parameter change) that reached this node. MT-safe.
+     **/
+    int getHashPropagationNodesVisited() const;
+
+    /**
+     * @brief Must be called when the value of a knob of this node changed so that the next computeHash()
+     * hashes the knobs values again in content based mode. MT-safe.
+     **/
+    void invalidateKnobsHash();
+
     void onAllKnobsSlaved(bool isSlave, KnobHolder* master);
 
     void onKnobSlaved(const KnobIPtr& slave, const KnobIPtr& master, int dimension, bool isSlave);
@@ -1278,7 +1296,7 @@ public:
 
     double getHostMixingValue(double time, ViewIdx view) const;
 
-    void removeAllImagesFromCacheWithMatchingIDAndDifferentKey(U64 nodeHashKey);
+    void removeAllImagesFromCacheWithMatchingIDAndDifferentKey(const std::vector<U64>& nodeHashesToKeep);
     void removeAllImagesFromCache(bool blocking);
 
     bool isDraftModeUsed() const;
@@ -1333,7 +1351,16 @@ private:
 
     bool setStreamWarningInternal(StreamWarningEnum warning, const QString& message);
 
-    void computeHashRecursive(std::list<Node*>& marked);
+    /**
+     * @brief Recomputes the hash of this node and of all the nodes downstream whose hash depends on it.
+     * Nodes already visited during the walk identified by generation are skipped.
+     **/
+    void computeHashRecursive(U64 generation, std::vector<Node*>* nodesVisited);
+
+    /**
+     * @brief Records on each node visited by a walk of computeHashRecursive the number of nodes that walk visited.
+     **/
+    static void setHashPropagationNodesVisited(const std::vector<Node*>& nodesVisited);
 
     /**
      * @brief Refreshes the node hash depending on its context (knobs age, inputs etc...)
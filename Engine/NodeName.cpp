@@ -364,6 +364,7 @@ Node::setNameInternal(const std::string& name,
     {
         QMutexLocker l(&_imp->nameMutex);
         _imp->scriptName = newName;
+        _imp->constantHashContribution = 0;
         mustSetCacheID = _imp->cacheID.empty();
         ///Set the label at the same time if the label is empty
         if ( _imp->label.empty() ) {
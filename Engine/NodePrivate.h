@@ -32,6 +32,7 @@
 #include "Timer.h" // gettimeofday()
 
 #include <QtCore/QWaitCondition>
+#include <QtCore/QAtomicInt>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QMutex>
 
@@ -160,6 +161,7 @@ public:
         , scriptName()
         , label()
         , cacheID()
+        , constantHashContribution(0)
         , deactivatedState()
         , activatedMutex()
         , activated(true)
@@ -177,6 +179,12 @@ public:
         , renderInstancesSharedMutex()
         , knobsAge(0)
         , knobsAgeMutex()
+        , hash()
+        , recentHashes()
+        , hashGeneration(0)
+        , hashPropagationNodesVisited(0)
+        , knobsContentHash(0)
+        , knobsContentHashValid()
         , masterNodeMutex()
         , masterNode()
         , nodeLinks()
@@ -261,6 +269,11 @@ public:
         gettimeofday(&lastInputNRenderStartedSlotCallTime, 0);
     }
 
+    /**
+     * @brief Returns the part of the node hash that only changes when the node is renamed.
+     **/
+    U64 getConstantHashContribution();
+
     void abortPreview_non_blocking();
 
     void abortPreview_blocking(bool allowPreviewRenders);
@@ -346,6 +359,7 @@ public:
     ///In order for the cache to be persistent, the cacheID is serialized with the node
     ///and 2 nodes cannot have the same cacheID.
     std::string cacheID;
+    U64 constantHashContribution; //< hash of scriptName and of the project creation time, 0 if it must be recomputed. Protected by nameMutex
     DeactivatedState deactivatedState;
     mutable QMutex activatedMutex;
     bool activated;
@@ -365,6 +379,11 @@ public:
     U64 knobsAge; //< the age of the knobs in this effect. It gets incremented every times the effect has its evaluate() function called.
     mutable QReadWriteLock knobsAgeMutex; //< protects knobsAge and hash
     Hash64 hash; //< recomputed every time knobsAge is changed.
+    std::list<U64> recentHashes; //< most recent first, the hashes for which images are kept in the caches. Protected by knobsAgeMutex
+    U64 hashGeneration; //< the last walk of computeHashRecursive that visited this node. Only accessed on the main thread
+    int hashPropagationNodesVisited; //< the number of nodes visited by the last walk of computeHashRecursive that visited this node. Protected by knobsAgeMutex
+    U64 knobsContentHash; //< in content based mode, the hash of the knobs values. Only accessed on the main thread
+    QAtomicInt knobsContentHashValid; //< 0 when a knob changed since knobsContentHash was computed
     mutable QMutex masterNodeMutex; //< protects masterNode and nodeLinks
     NodeWPtr masterNode; //< this points to the master when the node is a clone
     KnobLinkList nodeLinks; //< these point to the parents of the params links
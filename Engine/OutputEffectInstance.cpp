@@ -81,6 +81,7 @@ OutputEffectInstance::OutputEffectInstance(NodePtr node)
     : EffectInstance(node)
     , _outputEffectDataLock()
     , _renderSequenceRequests()
+    , _renderGroupWriters()
     , _engine()
 {
 }
@@ -89,6 +90,7 @@ OutputEffectInstance::OutputEffectInstance(const OutputEffectInstance& other)
 : EffectInstance(other)
 , _outputEffectDataLock()
 , _renderSequenceRequests()
+, _renderGroupWriters()
 , _engine(other._engine)
 {
 }
@@ -366,6 +368,30 @@ OutputEffectInstance::notifyRenderFinished()
     launchRenderSequence(newArgs);
 }
 
+void
+OutputEffectInstance::setRenderGroupWriters(const std::list<OutputEffectInstancePtr>& writers)
+{
+    QMutexLocker k(&_outputEffectDataLock);
+
+    _renderGroupWriters.assign( writers.begin(), writers.end() );
+}
+
+std::list<OutputEffectInstancePtr>
+OutputEffectInstance::getRenderGroupWriters() const
+{
+    std::list<OutputEffectInstancePtr> ret;
+    QMutexLocker k(&_outputEffectDataLock);
+
+    for (std::list<OutputEffectInstanceWPtr>::const_iterator it = _renderGroupWriters.begin(); it != _renderGroupWriters.end(); ++it) {
+        OutputEffectInstancePtr writer = it->lock();
+        if (writer) {
+            ret.push_back(writer);
+        }
+    }
+
+    return ret;
+}
+
 bool
 OutputEffectInstance::isSequentialRenderBeingAborted() const
 {
@@ -398,7 +424,8 @@ void
 OutputEffectInstance::reportStats(int time,
                                   ViewIdx view,
                                   double wallTime,
-                                  const std::map<NodePtr, NodeRenderStats > & stats)
+                                  const std::map<NodePtr, NodeRenderStats > & stats,
+                                  int hashPropagationNodesVisited)
 {
     std::string filename;
     KnobIPtr fileKnob = getKnobByName(kOfxImageEffectFileParamName);
@@ -433,6 +460,7 @@ OutputEffectInstance::reportStats(int time,
     }
 
     ofile << "Time spent to render frame (wall clock time): " << Timer::printAsTime(wallTime, false).toStdString() << std::endl;
+    ofile << "Nodes visited by the last hash propagation: " << hashPropagationNodesVisited << std::endl;
     for (std::map<NodePtr, NodeRenderStats >::const_iterator it = stats.begin(); it != stats.end(); ++it) {
         ofile << "------------------------------- " << it->first->getScriptName_mt_safe() << "------------------------------- " << std::endl;
         ofile << "Time spent rendering: " << Timer::printAsTime(it->second.getTotalTimeSpentRendering(), false).toStdString() << std::endl;
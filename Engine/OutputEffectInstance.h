@@ -63,6 +63,7 @@ private:
 
     mutable QMutex _outputEffectDataLock;
     std::list<RenderSequenceArgs> _renderSequenceRequests;
+    std::list<OutputEffectInstanceWPtr> _renderGroupWriters;
     RenderEnginePtr _engine;
 
 public:
@@ -103,6 +104,17 @@ public:
 
     void notifyRenderFinished();
 
+    /**
+     * @brief Sets the other writers rendered in the same pass by the next sequence render of this writer:
+     * each frame is rendered by this writer then by each of them on the same render thread, so that the images
+     * of the nodes they share upstream are rendered once and read back from the cache by the next writers.
+     * They must render the same frame range, and are rendered with the views of this writer.
+     * The caller clears the list once the render is finished.
+     **/
+    void setRenderGroupWriters(const std::list<OutputEffectInstancePtr>& writers);
+
+    std::list<OutputEffectInstancePtr> getRenderGroupWriters() const;
+
     void renderCurrentFrame(bool canAbort);
 
     void renderCurrentFrameWithRenderStats(bool canAbort);
@@ -111,7 +123,7 @@ public:
 
 
     virtual void initializeData() OVERRIDE FINAL;
-    virtual void reportStats(int time, ViewIdx view, double wallTime, const std::map<NodePtr, NodeRenderStats > & stats);
+    virtual void reportStats(int time, ViewIdx view, double wallTime, const std::map<NodePtr, NodeRenderStats > & stats, int hashPropagationNodesVisited);
 
 protected:
 
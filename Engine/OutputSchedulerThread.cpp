@@ -67,6 +67,7 @@
 #include "Engine/UpdateViewerParams.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/ViewerInstance.h"
+#include "Engine/ViewerPrefetcher.h"
 #include "Engine/WriteNode.h"
 
 #ifdef DEBUG
@@ -1565,7 +1566,7 @@ OutputSchedulerThread::notifyFrameRendered(int frame,
         double timeSpentForFrame;
         std::map<NodePtr, NodeRenderStats > statResults = stats->getStats(&timeSpentForFrame);
         if ( !statResults.empty() ) {
-            effect->reportStats(frame, viewIndex, timeSpentForFrame, statResults);
+            effect->reportStats(frame, viewIndex, timeSpentForFrame, statResults, stats->getHashPropagationNodesVisited());
         }
     }
 
@@ -1811,6 +1812,32 @@ OutputSchedulerThread::getLastRunArgs(RenderDirectionEnum* direction,
     *viewsToRender = _imp->lastPlaybackViewsToRender;
 }
 
+void
+OutputSchedulerThread::getUpcomingFrames(int frame,
+                                         int count,
+                                         std::vector<int>* frames) const
+{
+    QMutexLocker l(&_imp->framesToRenderMutex);
+    OutputSchedulerThreadStartArgsPtr runArgs = _imp->runArgs.lock();
+
+    if (!runArgs) {
+        return;
+    }
+    RenderDirectionEnum direction = runArgs->pushTimelineDirection;
+    PlaybackModeEnum pMode = _imp->engine->getPlaybackMode();
+    for (int i = 0; i < count; ++i) {
+        if ( !OutputSchedulerThreadPrivate::getNextFrameInSequence(pMode, direction, frame, runArgs->firstFrame, runArgs->lastFrame,
+                                                                   runArgs->frameStep, &frame, &direction) ) {
+            break;
+        }
+        // The range may be shorter than count
+        if ( std::find(frames->begin(), frames->end(), frame) != frames->end() ) {
+            break;
+        }
+        frames->push_back(frame);
+    }
+}
+
 void
 OutputSchedulerThread::renderFrameRange(bool isBlocking,
                                         bool enableRenderStats,
@@ -2140,6 +2167,8 @@ DefaultScheduler::DefaultScheduler(RenderEngine* engine,
     , _effect(effect)
     , _currentTimeMutex()
     , _currentTime(0)
+    , _renderGroupWritersMutex()
+    , _renderGroupWriters()
 {
     engine->setPlaybackMode(ePlaybackModeOnce);
 }
@@ -2193,11 +2222,39 @@ private:
             return;
         }
 
-        AbortableThread* isAbortableThread = dynamic_cast<AbortableThread*>( QThread::currentThread() );
+        // The other writers rendered in the same pass, after this one, see OutputEffectInstance::setRenderGroupWriters()
+        std::list<OutputEffectInstancePtr> writers;
+        DefaultScheduler* isDefaultScheduler = dynamic_cast<DefaultScheduler*>(_imp->scheduler);
+        if (isDefaultScheduler) {
+            writers = isDefaultScheduler->getRenderGroupWriters();
+        }
+        writers.push_front(output);
 
         ///Even if enableRenderStats is false, we at least profile the time spent rendering the frame when rendering with a Write node.
         ///Though we don't enable render stats for sequential renders (e.g: WriteFFMPEG) since this is 1 file.
         RenderStatsPtr stats = std::make_shared<RenderStats>(enableRenderStats);
+        stats->setHashPropagationNodesVisited( output->getNode()->getHashPropagationNodesVisited() );
+        for (std::list<OutputEffectInstancePtr>::const_iterator it = writers.begin(); it != writers.end(); ++it) {
+            if ( !renderWriterFrame(*it, time, viewsToRender, stats) ) {
+                return;
+            }
+        }
+
+        for (std::size_t view = 0; view < viewsToRender.size(); ++view) {
+            _imp->scheduler->notifyFrameRendered(time, viewsToRender[view], viewsToRender, stats, eSchedulingPolicyFFA);
+        }
+    } // renderFrame
+
+    /**
+     * @brief Runs the before frame render callback of the writer and renders the frame at the given time.
+     * Returns false if the frame must not be reported as rendered, any failure is notified to the scheduler.
+     **/
+    bool renderWriterFrame(const OutputEffectInstancePtr& output,
+                           int time,
+                           const std::vector<ViewIdx>& viewsToRender,
+                           const RenderStatsPtr& stats)
+    {
+        AbortableThread* isAbortableThread = dynamic_cast<AbortableThread*>( QThread::currentThread() );
         NodePtr outputNode = output->getNode();
         std::string cb = outputNode->getBeforeFrameRenderCallback();
         if ( !cb.empty() ) {
@@ -2209,13 +2266,13 @@ private:
                 output->getApp()->appendToScriptEditor( std::string("Failed to get signature of beforeFrameRendered callback: ")
                                                         + e.what() );
 
-                return;
+                return false;
             }
 
             if ( !error.empty() ) {
                 output->getApp()->appendToScriptEditor("Failed to get signature of beforeFrameRendered callback: " + error);
 
-                return;
+                return false;
             }
 
             std::string signatureError;
@@ -2224,7 +2281,7 @@ private:
             if ( (args.size() != 3) || (args[0] != "frame") || (args[1] != "thisNode") || (args[2] != "app") ) {
                 output->getApp()->appendToScriptEditor("Wrong signature of beforeFrameRendered callback: " + signatureError);
 
-                return;
+                return false;
             }
 
             std::stringstream ss;
@@ -2237,7 +2294,7 @@ private:
             } catch (const std::exception &e) {
                 _imp->scheduler->notifyRenderFailure( e.what() );
 
-                return;
+                return false;
             }
         }
 
@@ -2273,7 +2330,7 @@ private:
                 if (stat == eStatusFailed) {
                     _imp->scheduler->notifyRenderFailure("Error caught while rendering");
 
-                    return;
+                    return false;
                 }
                 std::list<ImagePlaneDesc> components;
                 ImageBitDepthEnum imageDepth;
@@ -2325,7 +2382,7 @@ private:
                     if (stat == eStatusFailed) {
                         _imp->scheduler->notifyRenderFailure("Error caught while rendering");
 
-                        return;
+                        return false;
                     }
                     frameRenderArgs.updateNodesRequest(request);
                 }
@@ -2353,22 +2410,18 @@ private:
                         _imp->scheduler->notifyRenderFailure("Error caught while rendering");
                     }
 
-                    return;
+                    return false;
                 }
 
-                ///If we need sequential rendering, pass the image to the output scheduler that will ensure the sequential ordering
-                /*if (!renderDirectly) {
-                    for (std::map<ImagePlaneDesc,ImagePtr>::iterator it = planes.begin(); it != planes.end(); ++it) {
-                        _imp->scheduler->appendToBuffer(time, viewsToRender[view], stats, std::dynamic_pointer_cast<BufferableObject>(it->second));
-                    }
-                   } else {*/
-                _imp->scheduler->notifyFrameRendered(time, viewsToRender[view], viewsToRender, stats, eSchedulingPolicyFFA);
-                //}
             }
         } catch (const std::exception& e) {
             _imp->scheduler->notifyRenderFailure( std::string("Error while rendering: ") + e.what() );
+
+            return false;
         }
-    } // renderFrame
+
+        return true;
+    } // renderWriterFrame
 };
 
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
@@ -2535,6 +2588,38 @@ DefaultScheduler::getSchedulingPolicy() const
        }*/
 }
 
+/**
+ * @brief Returns the effect of the writer which implements begin/endSequenceRender if the output renders
+ * sequentially (only WriteFFMPEG for now), or null otherwise.
+ **/
+static EffectInstancePtr
+getSequentialWriterEffect(const OutputEffectInstancePtr& output)
+{
+    EffectInstancePtr effect = output;
+    WriteNode* isWriteNode = dynamic_cast<WriteNode*>( output.get() );
+
+    if (isWriteNode) {
+        NodePtr embeddedWriter = isWriteNode->getEmbeddedWriter();
+        if (embeddedWriter) {
+            effect = embeddedWriter->getEffectInstance();
+        }
+    }
+    SequentialPreferenceEnum pref = effect->getSequentialPreference();
+    if ( (pref == eSequentialPreferenceOnlySequential) || (pref == eSequentialPreferencePreferSequential) ) {
+        return effect;
+    }
+
+    return EffectInstancePtr();
+}
+
+std::list<OutputEffectInstancePtr>
+DefaultScheduler::getRenderGroupWriters() const
+{
+    QMutexLocker k(&_renderGroupWritersMutex);
+
+    return _renderGroupWriters;
+}
+
 void
 DefaultScheduler::aboutToStartRender()
 {
@@ -2549,6 +2634,40 @@ DefaultScheduler::aboutToStartRender()
             _currentTime  = args->lastFrame;
         }
     }
+
+    std::list<OutputEffectInstancePtr> groupWriters = effect->getRenderGroupWriters();
+    {
+        QMutexLocker k(&_renderGroupWritersMutex);
+        _renderGroupWriters = groupWriters;
+    }
+
+    startWriterRender(effect);
+
+    // The writers rendered along with this one are started as if they had their own render, except that
+    // their frames are rendered by the threads of this scheduler
+    for (std::list<OutputEffectInstancePtr>::const_iterator it = groupWriters.begin(); it != groupWriters.end(); ++it) {
+        startWriterRender(*it);
+        (*it)->getRenderEngine()->s_renderStarted(true);
+
+        EffectInstancePtr sequentialEffect = getSequentialWriterEffect(*it);
+        if ( sequentialEffect &&
+             ( sequentialEffect->beginSequenceRender_public( args->firstFrame, args->lastFrame,
+                                                             args->frameStep,
+                                                             false,
+                                                             RenderScale::identity, true,
+                                                             true,
+                                                             false,
+                                                             ViewIdx(0),
+                                                             false /*useOpenGL*/,
+                                                             EffectInstance::OpenGLContextEffectDataPtr() ) == eStatusFailed ) ) {
+            notifyRenderFailure( (*it)->getScriptName_mt_safe() + ": " + tr("Failed to start the sequence render").toStdString() );
+        }
+    }
+} // DefaultScheduler::aboutToStartRender
+
+void
+DefaultScheduler::startWriterRender(const OutputEffectInstancePtr& effect)
+{
     bool isBackGround = appPTR->isBackground();
 
     if (!isBackGround) {
@@ -2604,12 +2723,44 @@ DefaultScheduler::aboutToStartRender()
             notifyRenderFailure( e.what() );
         }
     }
-} // DefaultScheduler::aboutToStartRender
+} // DefaultScheduler::startWriterRender
 
 void
 DefaultScheduler::onRenderStopped(bool aborted)
 {
     OutputEffectInstancePtr effect = _effect.lock();
+    std::list<OutputEffectInstancePtr> groupWriters;
+    {
+        QMutexLocker k(&_renderGroupWritersMutex);
+        groupWriters.swap(_renderGroupWriters);
+    }
+
+    OutputSchedulerThreadStartArgsPtr args = getCurrentRunArgs();
+    for (std::list<OutputEffectInstancePtr>::const_iterator it = groupWriters.begin(); it != groupWriters.end(); ++it) {
+        EffectInstancePtr sequentialEffect = getSequentialWriterEffect(*it);
+        if (sequentialEffect) {
+            ignore_result( sequentialEffect->endSequenceRender_public( args->firstFrame, args->lastFrame,
+                                                                       1,
+                                                                       !appPTR->isBackground(),
+                                                                       RenderScale::identity, true,
+                                                                       !appPTR->isBackground(),
+                                                                       false,
+                                                                       ViewIdx(0),
+                                                                       false /*use OpenGL render*/,
+                                                                       EffectInstance::OpenGLContextEffectDataPtr() ) );
+        }
+        (*it)->getRenderEngine()->s_renderFinished(aborted ? 1 : 0);
+        stopWriterRender(*it, aborted, false);
+    }
+
+    stopWriterRender(effect, aborted, true);
+}
+
+void
+DefaultScheduler::stopWriterRender(const OutputEffectInstancePtr& effect,
+                                   bool aborted,
+                                   bool notifyRenderFinished)
+{
     bool isBackGround = appPTR->isBackground();
 
     if (!isBackGround) {
@@ -2621,7 +2772,9 @@ DefaultScheduler::onRenderStopped(bool aborted)
         appPTR->writeToOutputPipe(longText, QString::fromUtf8(kRenderingFinishedStringShort), true);
     }
 
-    effect->notifyRenderFinished();
+    if (notifyRenderFinished) {
+        effect->notifyRenderFinished();
+    }
 
     std::string cb = effect->getNode()->getAfterRenderCallback();
     if ( !cb.empty() ) {
@@ -2669,7 +2822,7 @@ DefaultScheduler::onRenderStopped(bool aborted)
             //Ignore expcetions in callback since the render is finished anyway
         }
     }
-} // DefaultScheduler::onRenderStopped
+} // DefaultScheduler::stopWriterRender
 
 ////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////
@@ -2795,6 +2948,7 @@ private:
 
         if (enableRenderStats) {
             stats = std::make_shared<RenderStats>(enableRenderStats);
+            stats->setHashPropagationNodesVisited( _viewer->getNode()->getHashPropagationNodesVisited() );
         }
         ///The viewer always uses the scheduler thread to regulate the output rate, @see ViewerInstance::renderViewer_internal
         ///it calls appendToBuffer by itself
@@ -3100,6 +3254,9 @@ RenderEngine::renderCurrentFrameInternal(bool enableRenderStats,
     }
 
     _imp->currentFrameScheduler->renderCurrentFrame(enableRenderStats, canAbort);
+
+    // Once the current frame is started, prefetch the frames around it with the threads left
+    _imp->currentFrameScheduler->prefetchAroundCurrentFrame();
 }
 
 void
@@ -3334,6 +3491,31 @@ RenderEngine::getPlaybackMode() const
     return _imp->pbMode;
 }
 
+void
+RenderEngine::getUpcomingPlaybackFrames(int frame,
+                                        int count,
+                                        std::vector<int>* frames) const
+{
+    OutputSchedulerThread* scheduler;
+    {
+        QMutexLocker k(&_imp->schedulerCreationLock);
+        scheduler = _imp->scheduler;
+    }
+    if (scheduler) {
+        scheduler->getUpcomingFrames(frame, count, frames);
+    }
+}
+
+int
+RenderEngine::getPrefetchedFramesAheadCount() const
+{
+    if (!_imp->currentFrameScheduler) {
+        return 0;
+    }
+
+    return _imp->currentFrameScheduler->getPrefetchedFramesAheadCount();
+}
+
 void
 RenderEngine::setDesiredFPS(double d)
 {
@@ -3463,6 +3645,9 @@ struct ViewerCurrentFrameRequestSchedulerPrivate
     // Used to attribute an age to each renderCurrentFrameRequest
     U64 ageCounter;
 
+    // Renders the frames around the current frame with the idle threads
+    ViewerPrefetcher prefetcher;
+
     ViewerCurrentFrameRequestSchedulerPrivate(ViewerInstance* viewer)
         : viewer(viewer)
         , threadPool( QThreadPool::globalInstance() )
@@ -3473,6 +3658,7 @@ struct ViewerCurrentFrameRequestSchedulerPrivate
         , currentFrameRenderTasksCond()
         , currentFrameRenderTasks()
         , ageCounter(0)
+        , prefetcher(viewer)
     {
     }
 
@@ -3760,13 +3946,16 @@ ViewerCurrentFrameRequestSchedulerPrivate::processProducedFrame(const RenderStat
             if (stats) {
                 double timeSpent;
                 std::map<NodePtr, NodeRenderStats > ret = stats->getStats(&timeSpent);
-                viewer->reportStats(0, ViewIdx(0), timeSpent, ret);
+                viewer->reportStats(0, ViewIdx(0), timeSpent, ret, stats->getHashPropagationNodesVisited());
             }
 
             viewer->updateViewer(params);
         }
     }
 
+    // The viewer is idle: prefetch the next frames
+    prefetcher.startIdleRenders();
+
 
     ///At least redraw the viewer, we might be here when the user removed a node upstream of the viewer.
     viewer->redrawViewer();
@@ -3788,12 +3977,14 @@ ViewerCurrentFrameRequestScheduler::onAbortRequested(bool keepOldestRender)
 void
 ViewerCurrentFrameRequestScheduler::onQuitRequested(bool allowRestarts)
 {
+    _imp->prefetcher.abortPrefetch();
     _imp->backupThread.quitThread(allowRestarts);
 }
 
 void
 ViewerCurrentFrameRequestScheduler::onWaitForThreadToQuit()
 {
+    _imp->prefetcher.quitPrefetch();
     _imp->waitForRunnableTasks();
     _imp->backupThread.waitForThreadToQuit_enforce_blocking();
 }
@@ -3813,6 +4004,18 @@ ViewerCurrentFrameRequestScheduler::notifyFrameProduced(const BufferableObjectPt
     _imp->notifyFrameProduced(frames, stats,  request->age);
 }
 
+void
+ViewerCurrentFrameRequestScheduler::prefetchAroundCurrentFrame()
+{
+    _imp->prefetcher.prefetchAround( _imp->viewer->getTimeline()->currentFrame() );
+}
+
+int
+ViewerCurrentFrameRequestScheduler::getPrefetchedFramesAheadCount() const
+{
+    return _imp->prefetcher.getCachedAheadCount();
+}
+
 void
 ViewerCurrentFrameRequestScheduler::renderCurrentFrame(bool enableRenderStats,
                                                        bool canAbort)
@@ -3833,6 +4036,7 @@ ViewerCurrentFrameRequestScheduler::renderCurrentFrame(bool enableRenderStats,
     RenderStatsPtr stats;
     if (enableRenderStats) {
         stats.reset( new RenderStats(enableRenderStats) );
+        stats->setHashPropagationNodesVisited( _imp->viewer->getNode()->getHashPropagationNodesVisited() );
     }
 
     bool isTracking = _imp->viewer->isDoingPartialUpdates();
@@ -3912,7 +4116,7 @@ ViewerCurrentFrameRequestScheduler::renderCurrentFrame(bool enableRenderStats,
                 if ( stats && (i == 0) ) {
                     double timeSpent;
                     std::map<NodePtr, NodeRenderStats > statResults = stats->getStats(&timeSpent);
-                    _imp->viewer->reportStats(frame, view, timeSpent, statResults);
+                    _imp->viewer->reportStats(frame, view, timeSpent, statResults, stats->getHashPropagationNodesVisited());
                 }
                 _imp->viewer->updateViewer(args[i]->params);
                 args[i].reset();
@@ -28,6 +28,7 @@
 
 #include "Global/Macros.h"
 
+#include <list>
 #include <vector>
 
 #include <QtCore/QThread>
@@ -281,6 +282,12 @@ public:
 
     void getLastRunArgs(RenderDirectionEnum* direction, std::vector<ViewIdx>* viewsToRender) const;
 
+    /**
+     * @brief Returns at most count frames that will follow the given frame in the current playback,
+     * according to its frame range, direction and playback mode.
+     **/
+    void getUpcomingFrames(int frame, int count, std::vector<int>* frames) const;
+
     /**
      * @brief Returns the current number of render threads
      **/
@@ -478,6 +485,12 @@ public:
 
     virtual ~DefaultScheduler();
 
+    /**
+     * @brief Returns the writers rendered in the same pass as the output effect of this scheduler during the
+     * current render, see OutputEffectInstance::setRenderGroupWriters()
+     **/
+    std::list<OutputEffectInstancePtr> getRenderGroupWriters() const;
+
 private:
 
     virtual void processFrame(const BufferedFrames& frames) OVERRIDE FINAL;
@@ -496,9 +509,17 @@ private:
     virtual SchedulingPolicyEnum getSchedulingPolicy() const OVERRIDE FINAL;
     virtual void aboutToStartRender() OVERRIDE FINAL;
     virtual void onRenderStopped(bool aborted) OVERRIDE FINAL;
+
+    void startWriterRender(const OutputEffectInstancePtr& effect);
+    void stopWriterRender(const OutputEffectInstancePtr& effect, bool aborted, bool notifyRenderFinished);
+
     OutputEffectInstanceWPtr _effect;
     mutable QMutex _currentTimeMutex;
     int _currentTime;
+
+    // Protects _renderGroupWriters
+    mutable QMutex _renderGroupWritersMutex;
+    std::list<OutputEffectInstancePtr> _renderGroupWriters;
 };
 
 
@@ -562,6 +583,16 @@ public:
 
     void renderCurrentFrame(bool enableRenderStats, bool canAbort);
 
+    /**
+     * @brief Prefetches the frames around the current frame of the timeline in the viewer cache, see ViewerPrefetcher
+     **/
+    void prefetchAroundCurrentFrame();
+
+    /**
+     * @brief Returns the number of consecutive frames after the current frame which were prefetched in the viewer cache
+     **/
+    int getPrefetchedFramesAheadCount() const;
+
     void notifyFrameProduced(const BufferableObjectPtrList& frames, const RenderStatsPtr& stats, const ViewerCurrentFrameRequestSchedulerStartArgsPtr& request);
 
 private:
@@ -682,6 +713,18 @@ public:
      **/
     PlaybackModeEnum getPlaybackMode() const;
 
+    /**
+     * @brief Returns at most count frames that will be rendered after the given frame by the current playback,
+     * see OutputSchedulerThread::getUpcomingFrames()
+     **/
+    void getUpcomingPlaybackFrames(int frame, int count, std::vector<int>* frames) const;
+
+    /**
+     * @brief For a viewer, returns the number of consecutive frames after the current frame which were prefetched
+     * in the viewer cache when the viewer was idle. Returns 0 if prefetching is disabled.
+     **/
+    int getPrefetchedFramesAheadCount() const;
+
     /**
      * @brief Returns the desired user FPS that the internal scheduler should stick to
      **/
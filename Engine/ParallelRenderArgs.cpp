@@ -887,6 +887,7 @@ ParallelRenderArgs::ParallelRenderArgs()
     , rotoPaintNodes()
     , stats()
     , openGLContext()
+    , knobsSnapshot()
     , textureIndex(0)
     , currentThreadSafety(eRenderSafetyInstanceSafe)
     , currentOpenglSupport(ePluginOpenGLRenderSupportNone)
@@ -117,6 +117,9 @@ public:
     ///The OpenGL context to use for the render of this frame
     OSGLContextWPtr openGLContext;
 
+    ///The values of the knobs of the node when the render started, read by the render threads without locking the knobs
+    KnobValuesSnapshotPtr knobsSnapshot;
+
     ///The texture index of the viewer being rendered, only useful for abortable renders
     int textureIndex;
 
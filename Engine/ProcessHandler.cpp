@@ -25,6 +25,7 @@
 
 #include "ProcessHandler.h"
 
+#include <algorithm> // min, max
 #include <cassert>
 #include <stdexcept>
 
@@ -46,11 +47,13 @@
 #include "Engine/AppManager.h"
 #include "Engine/Node.h"
 #include "Engine/OutputEffectInstance.h"
+#include "Engine/Timer.h"
 
 NATRON_NAMESPACE_ENTER
 
 ProcessHandler::ProcessHandler(const QString & projectPath,
-                               OutputEffectInstance* writer)
+                               OutputEffectInstance* writer,
+                               const QStringList& extraArgs)
     : _process(new QProcess)
     , _writer(writer)
     , _ipcServer(0)
@@ -97,6 +100,7 @@ ProcessHandler::ProcessHandler(const QString & projectPath,
 
     _processArgs << QString::fromUtf8("-b") << QString::fromUtf8("-w") << QString::fromUtf8( writer->getScriptName_mt_safe().c_str() );
     _processArgs << QString::fromUtf8("--IPCpipe") <<  tmpFileName;
+    _processArgs << extraArgs;
     _processArgs << projectPath;
 
     ///connect the useful slots of the process
@@ -136,6 +140,26 @@ ProcessHandler::startProcess()
     _process->start(QCoreApplication::applicationFilePath(), _processArgs);
 }
 
+void
+ProcessHandler::sendFrameRange(int firstFrame,
+                               int lastFrame,
+                               int frameStep)
+{
+    if (!_bgProcessInputSocket) {
+        return;
+    }
+    QString message;
+    if (firstFrame > lastFrame) {
+        message = QString::fromUtf8(kNoMoreFramesShort);
+    } else {
+        message = QString::fromUtf8(kRenderFrameRangeShort) + QString::number(firstFrame) + QLatin1Char('-') + QString::number(lastFrame) +
+                  QLatin1Char(':') + QString::number(frameStep);
+    }
+    _bgProcessInputSocket->waitForConnected(5000);
+    _bgProcessInputSocket->write( ( message + QLatin1Char('\n') ).toUtf8() );
+    _bgProcessInputSocket->flush();
+}
+
 const QString &
 ProcessHandler::getProcessLog() const
 {
@@ -161,10 +185,19 @@ ProcessHandler::onDataWrittenToSocket()
     ///always running in the main thread
     assert( QThread::currentThread() == qApp->thread() );
 
-    QString str = QString::fromUtf8( _bgProcessOutputSocket->readLine() );
-    while ( str.endsWith( QLatin1Char('\n') ) ) {
-        str.chop(1);
+    // Several messages may have been written since the last time
+    while ( _bgProcessOutputSocket->canReadLine() ) {
+        QString str = QString::fromUtf8( _bgProcessOutputSocket->readLine() );
+        while ( str.endsWith( QLatin1Char('\n') ) ) {
+            str.chop(1);
+        }
+        onMessageReceived(str);
     }
+}
+
+void
+ProcessHandler::onMessageReceived(QString str)
+{
     _processLog.append( QString::fromUtf8("Message received: ") + str + QLatin1Char('\n') );
     if ( str.startsWith( QString::fromUtf8(kFrameRenderedStringShort) ) ) {
         str = str.remove( QString::fromUtf8(kFrameRenderedStringShort) );
@@ -181,6 +214,8 @@ ProcessHandler::onDataWrittenToSocket()
             //The report does not have extended timer infos
             Q_EMIT frameRendered(str.toInt(), progressPercent);
         }
+    } else if ( str.startsWith( QString::fromUtf8(kFrameRangeRequestedShort) ) ) {
+        Q_EMIT frameRangeRequested();
     } else if ( str.startsWith( QString::fromUtf8(kRenderingFinishedStringShort) ) ) {
         ///don't do anything
     } else if ( str.startsWith( QString::fromUtf8(kBgProcessServerCreatedShort) ) ) {
@@ -254,6 +289,8 @@ ProcessHandler::onProcessError(QProcess::ProcessError err)
 {
     if (err == QProcess::FailedToStart) {
         Dialogs::errorDialog( _writer->getScriptName(), tr("The render process failed to start.").toStdString() );
+        // finished() is not emitted for a process which did not start
+        Q_EMIT processFinished(1);
     } else if (err == QProcess::Crashed) {
         //@TODO: find out a way to get the backtrace
     }
@@ -283,6 +320,12 @@ ProcessInputChannel::ProcessInputChannel(const QString & mainProcessServerName)
     , _mustQuitMutex()
     , _mustQuitCond()
     , _mustQuit(false)
+    , _frameRangeMutex()
+    , _frameRangeCond()
+    , _frameRangeReceived(false)
+    , _firstFrame(0)
+    , _lastFrame(-1)
+    , _frameStep(1)
 {
     initialize();
     _backgroundIPCServer->moveToThread(this);
@@ -314,6 +357,25 @@ ProcessInputChannel::writeToOutputChannel(const QString & message)
     }
 }
 
+bool
+ProcessInputChannel::waitForFrameRange(int* firstFrame,
+                                       int* lastFrame,
+                                       int* frameStep)
+{
+    QMutexLocker k(&_frameRangeMutex);
+
+    _frameRangeReceived = false;
+    writeToOutputChannel( QString::fromUtf8(kFrameRangeRequestedShort) );
+    while (!_frameRangeReceived) {
+        _frameRangeCond.wait(&_frameRangeMutex);
+    }
+    *firstFrame = _firstFrame;
+    *lastFrame = _lastFrame;
+    *frameStep = _frameStep;
+
+    return _firstFrame <= _lastFrame;
+}
+
 void
 ProcessInputChannel::onNewConnectionPending()
 {
@@ -336,6 +398,38 @@ ProcessInputChannel::onInputChannelMessageReceived()
     if ( str.startsWith( QString::fromUtf8(kAbortRenderingStringShort) ) ) {
         qDebug() << "Aborting render!";
         appPTR->abortAnyProcessing();
+        {
+            // Do not render the next frames
+            QMutexLocker k(&_frameRangeMutex);
+            _firstFrame = 0;
+            _lastFrame = -1;
+            _frameRangeReceived = true;
+            _frameRangeCond.wakeAll();
+        }
+
+        return true;
+    } else if ( str.startsWith( QString::fromUtf8(kRenderFrameRangeShort) ) ) {
+        str.remove( QString::fromUtf8(kRenderFrameRangeShort) );
+        // firstFrame-lastFrame:frameStep, the frames may be negative
+        int stepPos = str.lastIndexOf( QLatin1Char(':') );
+        int lastPos = str.indexOf( QLatin1Char('-'), 1 );
+        QMutexLocker k(&_frameRangeMutex);
+        if ( (stepPos == -1) || (lastPos == -1) ) {
+            _firstFrame = 0;
+            _lastFrame = -1;
+        } else {
+            _firstFrame = str.left(lastPos).toInt();
+            _lastFrame = str.mid(lastPos + 1, stepPos - lastPos - 1).toInt();
+            _frameStep = std::max( 1, str.mid(stepPos + 1).toInt() );
+        }
+        _frameRangeReceived = true;
+        _frameRangeCond.wakeAll();
+    } else if ( str.startsWith( QString::fromUtf8(kNoMoreFramesShort) ) ) {
+        QMutexLocker k(&_frameRangeMutex);
+        _firstFrame = 0;
+        _lastFrame = -1;
+        _frameRangeReceived = true;
+        _frameRangeCond.wakeAll();
 
         return true;
     } else {
@@ -356,11 +450,21 @@ ProcessInputChannel::run()
 #endif
     for (;; ) {
         if ( _backgroundInputPipe->waitForReadyRead(100) ) {
-            if ( onInputChannelMessageReceived() ) {
-                qDebug() << "Background process now closing the input channel...";
+            // Several messages may have been written since the last time
+            while ( _backgroundInputPipe->canReadLine() ) {
+                if ( onInputChannelMessageReceived() ) {
+                    qDebug() << "Background process now closing the input channel...";
 
-                return;
+                    return;
+                }
             }
+        } else if (_backgroundInputPipe->state() != QLocalSocket::ConnectedState) {
+            // The main process is gone: do not wait for frames to render
+            QMutexLocker k(&_frameRangeMutex);
+            _firstFrame = 0;
+            _lastFrame = -1;
+            _frameRangeReceived = true;
+            _frameRangeCond.wakeAll();
         }
 
         QMutexLocker l(&_mustQuitMutex);
@@ -439,6 +543,274 @@ ProcessInputChannel::onOutputPipeConnectionMade()
     qDebug() << "The output channel was successfully created and connected.";
 }
 
+////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////
+//////////////////////// RenderFrameChunks /////////////////
+
+RenderFrameChunks::RenderFrameChunks(int firstFrame,
+                                     int lastFrame,
+                                     int frameStep,
+                                     int nWorkers)
+    : _firstFrame(firstFrame)
+    , _frameStep( std::max(1, frameStep) )
+    , _nWorkers( std::max(1, nWorkers) )
+    , _nFrames(0)
+    , _nextFrameIndex(0)
+    , _retriedChunks()
+    , _nRetriedChunks(0)
+{
+    if (firstFrame <= lastFrame) {
+        _nFrames = (lastFrame - firstFrame) / _frameStep + 1;
+    }
+}
+
+bool
+RenderFrameChunks::hasRemainingFrames() const
+{
+    return _nextFrameIndex < _nFrames || !_retriedChunks.empty();
+}
+
+bool
+RenderFrameChunks::getNextChunk(FrameChunk* chunk)
+{
+    if ( !_retriedChunks.empty() ) {
+        *chunk = _retriedChunks.front();
+        _retriedChunks.pop_front();
+
+        return true;
+    }
+    int nRemainingFrames = _nFrames - _nextFrameIndex;
+    if (nRemainingFrames <= 0) {
+        return false;
+    }
+    // Guided scheduling: large chunks first to limit the requests, small chunks last so that all the workers finish together
+    int nChunkFrames = std::max( 1, nRemainingFrames / (2 * _nWorkers) );
+    chunk->firstFrame = _firstFrame + _nextFrameIndex * _frameStep;
+    chunk->lastFrame = chunk->firstFrame + (nChunkFrames - 1) * _frameStep;
+    chunk->nFrames = nChunkFrames;
+    chunk->nRetries = 0;
+    _nextFrameIndex += nChunkFrames;
+
+    return true;
+}
+
+bool
+RenderFrameChunks::retryChunk(const FrameChunk & chunk)
+{
+    if (chunk.nRetries >= NATRON_RENDER_WORKER_MAX_RETRIES) {
+        return false;
+    }
+    FrameChunk retried = chunk;
+    ++retried.nRetries;
+    ++_nRetriedChunks;
+    _retriedChunks.push_back(retried);
+
+    return true;
+}
+
+void
+RenderFrameChunks::clearRetriedChunks()
+{
+    _retriedChunks.clear();
+}
+
+////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////
+//////////////////////// RenderWorkersPool /////////////////
+
+RenderWorkersPool::RenderWorkersPool(const QString & projectPath,
+                                     OutputEffectInstance* writer,
+                                     int firstFrame,
+                                     int lastFrame,
+                                     int frameStep,
+                                     bool enableRenderStats,
+                                     int nWorkers)
+    : QObject()
+    , _projectPath(projectPath)
+    , _writer(writer)
+    , _chunks(firstFrame, lastFrame, frameStep, nWorkers)
+    , _enableRenderStats(enableRenderStats)
+    , _nWorkers( std::max(1, nWorkers) )
+    , _nFramesRendered(0)
+    , _workers()
+    , _finishedProcesses()
+    , _nWorkersStarted(0)
+    , _failed(false)
+    , _timer()
+    , _eventLoop(0)
+{
+}
+
+RenderWorkersPool::~RenderWorkersPool()
+{
+}
+
+bool
+RenderWorkersPool::render()
+{
+    if (_chunks.getFramesCount() == 0) {
+        return true;
+    }
+
+    QString writerName = QString::fromUtf8( _writer->getScriptName_mt_safe().c_str() );
+    appPTR->writeToOutputPipe(writerName + tr(" ==> Rendering started with %1 processes").arg(_nWorkers),
+                              QString::fromUtf8(kRenderingStartedShort), true);
+
+    _timer.reset(new TimeLapse);
+    int nWorkers = std::min( _nWorkers, _chunks.getFramesCount() );
+    for (int i = 0; i < nWorkers; ++i) {
+        startWorker();
+    }
+
+    QEventLoop loop;
+    _eventLoop = &loop;
+    loop.exec();
+    _eventLoop = 0;
+
+    double timeSpentSec = _timer->getTimeSinceCreation();
+    QString longMessage = tr("%1 ==> Rendering finished: %2 frames rendered in %3 (%4 Fps) by %5 processes, %6 chunks of frames rendered again after a crash")
+                          .arg(writerName)
+                          .arg(_nFramesRendered)
+                          .arg( Timer::printAsTime(timeSpentSec, false) )
+                          .arg(timeSpentSec > 0 ? _nFramesRendered / timeSpentSec : 0., 0, 'f', 1)
+                          .arg(_nWorkersStarted)
+                          .arg( _chunks.getRetriedChunksCount() );
+    appPTR->writeToOutputPipe(longMessage, QString::fromUtf8(kRenderingFinishedStringShort), true);
+
+    return !_failed;
+} // RenderWorkersPool::render
+
+void
+RenderWorkersPool::startWorker()
+{
+    QStringList args;
+
+    args << QString::fromUtf8("--render-worker");
+    if (_enableRenderStats) {
+        args << QString::fromUtf8("-s");
+    }
+    ProcessHandlerPtr process = std::make_shared<ProcessHandler>(_projectPath, _writer, args);
+    QObject::connect( process.get(), SIGNAL(frameRangeRequested()), this, SLOT(onFrameRangeRequested()) );
+    QObject::connect( process.get(), SIGNAL(frameRendered(int,double)), this, SLOT(onFrameRendered(int,double)) );
+    QObject::connect( process.get(), SIGNAL(processFinished(int)), this, SLOT(onProcessFinished(int)) );
+
+    Worker& worker = _workers[process.get()];
+    worker.process = process;
+    worker.hasChunk = false;
+    worker.nChunkFramesRendered = 0;
+    worker.nFramesRendered = 0;
+    ++_nWorkersStarted;
+    process->startProcess();
+}
+
+void
+RenderWorkersPool::onFrameRangeRequested()
+{
+    ProcessHandler* process = qobject_cast<ProcessHandler*>( sender() );
+    std::map<ProcessHandler*, Worker>::iterator found = _workers.find(process);
+
+    if ( found == _workers.end() ) {
+        return;
+    }
+    Worker& worker = found->second;
+    worker.nChunkFramesRendered = 0;
+    if ( _failed || !_chunks.getNextChunk(&worker.chunk) ) {
+        worker.hasChunk = false;
+        process->sendFrameRange(0, -1, 1);
+
+        return;
+    }
+    worker.hasChunk = true;
+    process->sendFrameRange( worker.chunk.firstFrame, worker.chunk.lastFrame, _chunks.getFrameStep() );
+}
+
+void
+RenderWorkersPool::onFrameRendered(int frame,
+                                   double /*progress*/)
+{
+    ProcessHandler* process = qobject_cast<ProcessHandler*>( sender() );
+    std::map<ProcessHandler*, Worker>::iterator found = _workers.find(process);
+
+    if ( found == _workers.end() ) {
+        return;
+    }
+    ++found->second.nChunkFramesRendered;
+    ++found->second.nFramesRendered;
+    ++_nFramesRendered;
+
+    double fractionDone = (double)_nFramesRendered / _chunks.getFramesCount();
+    double timeSpentSinceStartSec = _timer->getTimeSinceCreation();
+    double estimatedFps = timeSpentSinceStartSec > 0 ? _nFramesRendered / timeSpentSinceStartSec : 0.;
+    double timeRemaining = timeSpentSinceStartSec / fractionDone - timeSpentSinceStartSec;
+    QString frameStr = QString::number(frame);
+    QString longMessage = tr("%1 ==> Frame: %2, Progress: %3%, %4 Fps, Time Remaining: %5")
+                          .arg( QString::fromUtf8( _writer->getScriptName_mt_safe().c_str() ) )
+                          .arg(frameStr)
+                          .arg( QString::number(fractionDone * 100, 'f', 1) )
+                          .arg( QString::number(estimatedFps, 'f', 1) )
+                          .arg( Timer::printAsTime(timeRemaining, true) );
+    QString shortMessage = QString::fromUtf8(kFrameRenderedStringShort) + frameStr + QString::fromUtf8(kProgressChangedStringShort) + QString::number(fractionDone);
+    appPTR->writeToOutputPipe(longMessage, shortMessage, true);
+}
+
+void
+RenderWorkersPool::onProcessFinished(int retCode)
+{
+    ProcessHandler* process = qobject_cast<ProcessHandler*>( sender() );
+    std::map<ProcessHandler*, Worker>::iterator found = _workers.find(process);
+
+    if ( found == _workers.end() ) {
+        return;
+    }
+    Worker worker = found->second;
+    _workers.erase(found);
+    // The process may not be deleted while it emits the signal
+    _finishedProcesses.push_back(worker.process);
+
+    if (retCode != 0) {
+        bool retried = false;
+        if (worker.hasChunk) {
+            // The frames of the chunk rendered before the crash are rendered again
+            _nFramesRendered -= worker.nChunkFramesRendered;
+            retried = _chunks.retryChunk(worker.chunk);
+        } else if ( (worker.nFramesRendered > 0) || (_nWorkersStarted < _nWorkers * (NATRON_RENDER_WORKER_MAX_RETRIES + 1)) ) {
+            // The worker failed before asking for frames: start another one unless they all fail
+            retried = true;
+        }
+        if (!retried) {
+            QString message;
+            if (worker.hasChunk) {
+                message = tr("%1 ==> A render process failed %2 times to render frames %3 to %4, aborting render.")
+                          .arg( QString::fromUtf8( _writer->getScriptName_mt_safe().c_str() ) )
+                          .arg(NATRON_RENDER_WORKER_MAX_RETRIES + 1)
+                          .arg(worker.chunk.firstFrame)
+                          .arg(worker.chunk.lastFrame);
+            } else {
+                message = tr("%1 ==> The render processes failed to start, aborting render.")
+                          .arg( QString::fromUtf8( _writer->getScriptName_mt_safe().c_str() ) );
+            }
+            std::cerr << message.toStdString() << std::endl;
+            abortRender();
+        } else if ( !_failed && _chunks.hasRemainingFrames() ) {
+            startWorker();
+        }
+    }
+
+    if ( _workers.empty() && _eventLoop ) {
+        _eventLoop->quit();
+    }
+} // RenderWorkersPool::onProcessFinished
+
+void
+RenderWorkersPool::abortRender()
+{
+    _failed = true;
+    _chunks.clearRetriedChunks();
+    for (std::map<ProcessHandler*, Worker>::iterator it = _workers.begin(); it != _workers.end(); ++it) {
+        it->second.process->onProcessCanceled();
+    }
+}
+
 NATRON_NAMESPACE_EXIT
 
 NATRON_NAMESPACE_USING
@@ -28,6 +28,10 @@
 
 #include "Global/Macros.h"
 
+#include <list>
+#include <map>
+#include <memory>
+
 CLANG_DIAG_OFF(deprecated)
 #include <QtCore/QProcess>
 #include <QtCore/QThread>
@@ -35,12 +39,16 @@ CLANG_DIAG_OFF(deprecated)
 #include <QtCore/QString>
 #include <QtCore/QMutex>
 #include <QtCore/QWaitCondition>
+#include <QtCore/QEventLoop>
 CLANG_DIAG_ON(deprecated)
 
 #include "Global/GlobalDefines.h"
 
 #include "Engine/EngineFwd.h"
 
+// Number of times the frames of a render worker which crashed are handed out again before the render fails
+#define NATRON_RENDER_WORKER_MAX_RETRIES 2
+
 NATRON_NAMESPACE_ENTER
 
 /**
@@ -98,14 +106,21 @@ class ProcessHandler
     QString _processLog; //< used to record the log of the process
     QStringList _processArgs;
 
+    /**
+     * @brief Handles a message written by the background process to the output socket.
+     **/
+    void onMessageReceived(QString message);
+
 public:
 
     /**
      * @brief Starts a new process which will load the project specified by "projectPath".
      * The process will render using the effect specified by writer.
+     * extraArgs are added to the command line of the process.
      **/
     ProcessHandler(const QString & projectPath,
-                   OutputEffectInstance* writer);
+                   OutputEffectInstance* writer,
+                   const QStringList& extraArgs = QStringList());
 
     virtual ~ProcessHandler();
 
@@ -166,6 +181,12 @@ public Q_SLOTS:
      **/
     void startProcess();
 
+    /**
+     * @brief Sends to a render worker the frames to render next, or that there are no more frames
+     * to render if firstFrame > lastFrame, in which case the process exits.
+     **/
+    void sendFrameRange(int firstFrame, int lastFrame, int frameStep);
+
 Q_SIGNALS:
 
     void deleted();
@@ -174,6 +195,11 @@ Q_SIGNALS:
 
     void processCanceled();
 
+    /**
+     * @brief Emitted when a render worker is ready to render frames, see sendFrameRange()
+     **/
+    void frameRangeRequested();
+
     /**
      * @brief Emitted when the process terminates. The parameter contains a return code:
      * 0: Everything went OK
@@ -212,6 +238,12 @@ public:
      **/
     void writeToOutputChannel(const QString & message);
 
+    /**
+     * @brief Asks the main process the next frames to render and waits for its answer.
+     * Returns false if there are no more frames to render or if the render was aborted.
+     **/
+    bool waitForFrameRange(int* firstFrame, int* lastFrame, int* frameStep);
+
 public Q_SLOTS:
 
     /**
@@ -255,6 +287,165 @@ private:
     mutable QMutex _mustQuitMutex;
     QWaitCondition _mustQuitCond;
     bool _mustQuit;
+
+    // Protects the frame range received from the main process
+    mutable QMutex _frameRangeMutex;
+    QWaitCondition _frameRangeCond;
+    bool _frameRangeReceived;
+    int _firstFrame, _lastFrame, _frameStep; //< firstFrame > lastFrame if there are no more frames to render
+};
+
+/**
+ * @brief Splits the frame range of a writer into the chunks of frames handed out to the render workers.
+ * The chunk size decreases as the render progresses (the remaining frames divided by twice the number of workers),
+ * so that all the workers finish at about the same time. The chunks of the workers which crashed are handed out
+ * again before the other frames, at most NATRON_RENDER_WORKER_MAX_RETRIES times.
+ **/
+class RenderFrameChunks
+{
+public:
+
+    struct FrameChunk
+    {
+        int firstFrame, lastFrame;
+        int nFrames;
+        int nRetries;
+
+        FrameChunk()
+            : firstFrame(0)
+            , lastFrame(-1)
+            , nFrames(0)
+            , nRetries(0)
+        {
+        }
+    };
+
+    RenderFrameChunks(int firstFrame,
+                      int lastFrame,
+                      int frameStep,
+                      int nWorkers);
+
+    int getFramesCount() const
+    {
+        return _nFrames;
+    }
+
+    int getFrameStep() const
+    {
+        return _frameStep;
+    }
+
+    /**
+     * @brief Returns the number of chunks that were handed out again after a crash.
+     **/
+    int getRetriedChunksCount() const
+    {
+        return _nRetriedChunks;
+    }
+
+    /**
+     * @brief Returns true if some frames were never handed out or some chunks must be handed out again.
+     **/
+    bool hasRemainingFrames() const;
+
+    /**
+     * @brief Returns in chunk the next frames to render, or false if all the frames were handed out.
+     **/
+    bool getNextChunk(FrameChunk* chunk);
+
+    /**
+     * @brief Hands out the frames of the chunk of a crashed worker again.
+     * Returns false if the chunk already failed NATRON_RENDER_WORKER_MAX_RETRIES + 1 times.
+     **/
+    bool retryChunk(const FrameChunk & chunk);
+
+    /**
+     * @brief Drops the chunks waiting to be handed out again, when the render is aborted.
+     **/
+    void clearRetriedChunks();
+
+private:
+
+    int _firstFrame, _frameStep;
+    int _nWorkers;
+    int _nFrames;
+
+    // Index of the next frame of the range which was never handed out
+    int _nextFrameIndex;
+
+    // Chunks of the workers which crashed, handed out again before the other frames
+    std::list<FrameChunk> _retriedChunks;
+    int _nRetriedChunks;
+};
+
+/**
+ * @brief Renders the frame range of a writer with several background processes on the local machine, the render workers.
+ * The project is rendered by each worker with the writer, but instead of the whole frame range the worker asks for the
+ * frames to render through the IPC pipe each time it is idle. The frames are handed out in chunks by RenderFrameChunks.
+ * If a worker crashes, its chunk is handed out again to a new worker.
+ * The progress of the workers is merged and printed as for a render in a single process.
+ * This is faster than rendering in a single process when the graph contains plug-ins that cannot render
+ * several frames concurrently.
+ **/
+class RenderWorkersPool
+    : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    RenderWorkersPool(const QString & projectPath,
+                      OutputEffectInstance* writer,
+                      int firstFrame,
+                      int lastFrame,
+                      int frameStep,
+                      bool enableRenderStats,
+                      int nWorkers);
+
+    virtual ~RenderWorkersPool();
+
+    /**
+     * @brief Renders all the frames, running an event loop until they are rendered.
+     * Returns false if some frames could not be rendered.
+     **/
+    bool render();
+
+public Q_SLOTS:
+
+    void onFrameRangeRequested();
+
+    void onFrameRendered(int frame, double progress);
+
+    void onProcessFinished(int retCode);
+
+private:
+
+    struct Worker
+    {
+        ProcessHandlerPtr process;
+        bool hasChunk;
+        RenderFrameChunks::FrameChunk chunk;
+        int nChunkFramesRendered;
+        int nFramesRendered;
+    };
+
+    void startWorker();
+
+    void abortRender();
+
+    QString _projectPath;
+    OutputEffectInstance* _writer;
+    RenderFrameChunks _chunks;
+    bool _enableRenderStats;
+    int _nWorkers;
+    int _nFramesRendered;
+
+    std::map<ProcessHandler*, Worker> _workers;
+    std::list<ProcessHandlerPtr> _finishedProcesses;
+    int _nWorkersStarted;
+    bool _failed;
+    std::unique_ptr<TimeLapse> _timer;
+    QEventLoop* _eventLoop;
 };
 
 NATRON_NAMESPACE_EXIT
@@ -32,6 +32,7 @@
 #include <cstdlib> // strtoul
 #include <cerrno> // errno
 #include <cassert>
+#include <cstring> // memcmp
 #include <stdexcept>
 
 #ifdef __NATRON_WIN32__
@@ -160,9 +161,7 @@ Project::create(const AppInstancePtr& appInstance)
 Project::~Project()
 {
     ///wait for all autosaves to finish
-    for (std::list<std::shared_ptr<QFutureWatcher<void> > >::iterator it = _imp->autoSaveFutures.begin(); it != _imp->autoSaveFutures.end(); ++it) {
-        (*it)->waitForFinished();
-    }
+    waitForBackgroundAutoSaves();
 
     ///Don't clear autosaves if the program is shutting down by user request.
     ///Even if the user replied she/he didn't want to save the current work, we keep an autosave of it.
@@ -271,6 +270,170 @@ Project::loadProject(const QString & path,
     return true;
 } // loadProject
 
+/**
+ * @brief Describes how a boost binary archive stores the fundamental types on this platform:
+ * the byte order followed by the size of the types the project serialization may contain.
+ **/
+static void
+getBinaryProjectPlatform(unsigned char platform[NATRON_PROJECT_BINARY_PLATFORM_SIZE])
+{
+    const U32 byteOrderMark = 0x01020304;
+
+    std::memcpy( platform, &byteOrderMark, sizeof(byteOrderMark) );
+    platform[4] = (unsigned char)sizeof(short);
+    platform[5] = (unsigned char)sizeof(int);
+    platform[6] = (unsigned char)sizeof(long);
+    platform[7] = (unsigned char)sizeof(long long);
+    platform[8] = (unsigned char)sizeof(float);
+    platform[9] = (unsigned char)sizeof(double);
+    platform[10] = (unsigned char)sizeof(std::size_t);
+    platform[11] = (unsigned char)sizeof(wchar_t);
+}
+
+/**
+ * @brief Writes the header that identifies a binary project file, see NATRON_PROJECT_BINARY_MAGIC.
+ **/
+static void
+writeBinaryProjectHeader(std::ostream& stream)
+{
+    // The version is stored in little endian so that any platform can read it
+    const U32 formatVersion = NATRON_PROJECT_BINARY_FORMAT_VERSION;
+    unsigned char version[4];
+
+    for (int i = 0; i < 4; ++i) {
+        version[i] = (unsigned char)( (formatVersion >> (8 * i)) & 0xff );
+    }
+
+    unsigned char platform[NATRON_PROJECT_BINARY_PLATFORM_SIZE];
+    getBinaryProjectPlatform(platform);
+
+    stream.write( NATRON_PROJECT_BINARY_MAGIC, sizeof(NATRON_PROJECT_BINARY_MAGIC) );
+    stream.write( reinterpret_cast<const char*>(version), sizeof(version) );
+    stream.write( reinterpret_cast<const char*>(platform), sizeof(platform) );
+}
+
+/**
+ * @brief If the stream starts with the binary project magic string, skips it and returns true.
+ * Otherwise the stream is rewound so that it can be read as an XML project.
+ **/
+static bool
+readBinaryProjectMagic(std::istream& stream)
+{
+    char magic[sizeof(NATRON_PROJECT_BINARY_MAGIC)];
+
+    stream.read( magic, sizeof(magic) );
+    if ( !stream || (std::memcmp( magic, NATRON_PROJECT_BINARY_MAGIC, sizeof(magic) ) != 0) ) {
+        stream.clear();
+        stream.seekg(0);
+
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief If the stream starts with a binary project header, skips it and returns true.
+ * Otherwise the stream is rewound so that it can be read as an XML project.
+ * Throws if the binary project cannot be read on this platform.
+ **/
+static bool
+readBinaryProjectHeader(std::istream& stream)
+{
+    if ( !readBinaryProjectMagic(stream) ) {
+        return false;
+    }
+
+    unsigned char version[4];
+    stream.read( reinterpret_cast<char*>(version), sizeof(version) );
+    if (!stream) {
+        throw std::runtime_error("Truncated binary project file");
+    }
+    U32 formatVersion = 0;
+    for (int i = 0; i < 4; ++i) {
+        formatVersion |= (U32)version[i] << (8 * i);
+    }
+    if (formatVersion > NATRON_PROJECT_BINARY_FORMAT_VERSION) {
+        throw std::runtime_error("This binary project was written by a more recent version of " NATRON_APPLICATION_NAME);
+    }
+
+    // Files of version 1 do not describe their platform
+    if (formatVersion >= NATRON_PROJECT_BINARY_FORMAT_VERSION_PLATFORM) {
+        unsigned char platform[NATRON_PROJECT_BINARY_PLATFORM_SIZE];
+        stream.read( reinterpret_cast<char*>(platform), sizeof(platform) );
+        if (!stream) {
+            throw std::runtime_error("Truncated binary project file");
+        }
+        unsigned char localPlatform[NATRON_PROJECT_BINARY_PLATFORM_SIZE];
+        getBinaryProjectPlatform(localPlatform);
+        if (std::memcmp( platform, localPlatform, sizeof(platform) ) != 0) {
+            throw std::runtime_error("This binary project was written on a platform with a different byte order or type sizes. "
+                                     "Convert it to XML with --convert-project on a compatible platform");
+        }
+    }
+
+    return true;
+}
+
+bool
+Project::isBinaryProjectFile(const QString& filePath)
+{
+    FStreamsSupport::ifstream ifile;
+
+    FStreamsSupport::open( &ifile, filePath.toStdString(), std::ios_base::in | std::ios_base::binary );
+    if (!ifile) {
+        return false;
+    }
+    try {
+        return readBinaryProjectMagic(ifile);
+    } catch (...) {
+        return false;
+    }
+}
+
+template <class Archive>
+bool
+Project::loadProjectArchive(Archive & iArchive,
+                            const QString & path,
+                            const QString & name,
+                            bool isAutoSave,
+                            bool* mustSave)
+{
+    bool ret;
+    bool bgProject;
+    {
+        FlagSetter __raii_loadingProjectInternal__(true, &_imp->isLoadingProjectInternal, &_imp->isLoadingProjectMutex);
+
+        iArchive >> boost::serialization::make_nvp("Background_project", bgProject);
+        ProjectSerialization projectSerializationObj( getApp() );
+        iArchive >> boost::serialization::make_nvp("Project", projectSerializationObj);
+        ret = load(projectSerializationObj, name, path, mustSave);
+    } // __raii_loadingProjectInternal__
+
+    if (!bgProject) {
+        getApp()->loadProjectGui(isAutoSave, iArchive);
+    }
+
+    return ret;
+}
+
+template <class Archive>
+void
+Project::saveProjectArchive(Archive & oArchive)
+{
+    bool bgProject = getApp()->isBackground();
+    oArchive << boost::serialization::make_nvp("Background_project", bgProject);
+    ProjectSerialization projectSerializationObj( getApp() );
+    save(&projectSerializationObj);
+    oArchive << boost::serialization::make_nvp("Project", projectSerializationObj);
+    if (!bgProject) {
+        AppInstancePtr app = getApp();
+        if (app) {
+            app->saveProjectGui(oArchive);
+        }
+    }
+}
+
 bool
 Project::loadProjectInternal(const QString & path,
                              const QString & name,
@@ -288,7 +451,7 @@ Project::loadProjectInternal(const QString & path,
 
     bool ret = false;
     FStreamsSupport::ifstream ifile;
-    FStreamsSupport::open( &ifile, filePath.toStdString() );
+    FStreamsSupport::open( &ifile, filePath.toStdString(), std::ios_base::in | std::ios_base::binary );
     if (!ifile) {
         throw std::runtime_error( tr("Failed to open %1").arg(filePath).toStdString() );
     }
@@ -317,19 +480,12 @@ Project::loadProjectInternal(const QString & path,
     LoadProjectSplashScreen_RAII __raii_splashscreen__(getApp(), name);
 
     try {
-        bool bgProject;
-        boost::archive::xml_iarchive iArchive(ifile);
-        {
-            FlagSetter __raii_loadingProjectInternal__(true, &_imp->isLoadingProjectInternal, &_imp->isLoadingProjectMutex);
-
-            iArchive >> boost::serialization::make_nvp("Background_project", bgProject);
-            ProjectSerialization projectSerializationObj( getApp() );
-            iArchive >> boost::serialization::make_nvp("Project", projectSerializationObj);
-            ret = load(projectSerializationObj, name, path, mustSave);
-        } // __raii_loadingProjectInternal__
-
-        if (!bgProject) {
-            getApp()->loadProjectGui(isAutoSave, iArchive);
+        if ( readBinaryProjectHeader(ifile) ) {
+            boost::archive::binary_iarchive iArchive(ifile);
+            ret = loadProjectArchive(iArchive, path, name, isAutoSave, mustSave);
+        } else {
+            boost::archive::xml_iarchive iArchive(ifile);
+            ret = loadProjectArchive(iArchive, path, name, isAutoSave, mustSave);
         }
     } catch (const std::exception &e) {
         const ProjectBeingLoadedInfo& pInfo = getApp()->getProjectBeingLoadedInfo();
@@ -543,13 +699,13 @@ nextBackup(const QString & filePath)
 }
 
 QString
-Project::saveProjectInternal(const QString & path,
-                             const QString & name,
-                             bool autoSave,
-                             bool updateProjectProperties)
+Project::getSaveFilePath(const QString & path,
+                         const QString & name,
+                         bool autoSave,
+                         bool updateProjectProperties,
+                         const QDateTime& time)
 {
     bool isRenderSave = name.contains( QString::fromUtf8("RENDER_SAVE") );
-    QDateTime time = QDateTime::currentDateTime();
     QString timeStr = time.toString();
     QString filePath;
 
@@ -591,16 +747,65 @@ Project::saveProjectInternal(const QString & path,
     }
 
     std::string newFilePath = _imp->runOnProjectSaveCallback(filePath.toStdString(), autoSave);
-    filePath = QString::fromUtf8( newFilePath.c_str() );
 
-    ///Use a temporary file to save, so if Natron crashes it doesn't corrupt the user save.
+    return QString::fromUtf8( newFilePath.c_str() );
+} // getSaveFilePath
+
+/**
+ * @brief Returns the file to write a project to before it replaces the actual file, so if Natron crashes it doesn't corrupt the user save.
+ **/
+static QString
+temporarySaveFilePath(const QDateTime& time)
+{
     QString tmpFilename = StandardPaths::writableLocation(StandardPaths::eStandardLocationTemp);
+
     StrUtils::ensureLastPathSeparator(tmpFilename);
     tmpFilename.append( QString::number( time.toMSecsSinceEpoch() ) );
 
+    return tmpFilename;
+}
+
+/**
+ * @brief Moves the temporary file written by a save to its final location.
+ **/
+static void
+replaceSavedFile(const QString & tmpFilename,
+                 const QString & filePath)
+{
+    if (!QFile::rename(tmpFilename, filePath)) {
+        // QFile::rename() may fail, e.g. if tmpFilename and filePath are not on the same partition
+        if (!QFile::copy(tmpFilename, filePath)) {
+            int nAttemps = 0;
+
+            while ( nAttemps < 10 && !fileCopy(tmpFilename, filePath) ) {
+                ++nAttemps;
+            }
+
+            if (nAttemps >= 10) {
+                throw std::runtime_error( "Failed to save to " + filePath.toStdString() );
+            }
+        }
+
+        QFile::remove(tmpFilename);
+    }
+}
+
+QString
+Project::saveProjectInternal(const QString & path,
+                             const QString & name,
+                             bool autoSave,
+                             bool updateProjectProperties)
+{
+    bool isRenderSave = name.contains( QString::fromUtf8("RENDER_SAVE") );
+    QDateTime time = QDateTime::currentDateTime();
+    QString timeStr = time.toString();
+    QString filePath = getSaveFilePath(path, name, autoSave, updateProjectProperties, time);
+    QString tmpFilename = temporarySaveFilePath(time);
+
+    bool binaryFormat = appPTR->getCurrentSettings()->isBinaryProjectFormatEnabled();
     {
         FStreamsSupport::ofstream ofile;
-        FStreamsSupport::open( &ofile, tmpFilename.toStdString() );
+        FStreamsSupport::open( &ofile, tmpFilename.toStdString(), binaryFormat ? (std::ios_base::out | std::ios_base::binary) : std::ios_base::out );
         if (!ofile) {
             throw std::runtime_error( tr("Failed to open file ").toStdString() + tmpFilename.toStdString() );
         }
@@ -616,17 +821,13 @@ Project::saveProjectInternal(const QString & path,
         }
 
         try {
-            boost::archive::xml_oarchive oArchive(ofile);
-            bool bgProject = getApp()->isBackground();
-            oArchive << boost::serialization::make_nvp("Background_project", bgProject);
-            ProjectSerialization projectSerializationObj( getApp() );
-            save(&projectSerializationObj);
-            oArchive << boost::serialization::make_nvp("Project", projectSerializationObj);
-            if (!bgProject) {
-                AppInstancePtr app = getApp();
-                if (app) {
-                    app->saveProjectGui(oArchive);
-                }
+            if (binaryFormat) {
+                writeBinaryProjectHeader(ofile);
+                boost::archive::binary_oarchive oArchive(ofile);
+                saveProjectArchive(oArchive);
+            } else {
+                boost::archive::xml_oarchive oArchive(ofile);
+                saveProjectArchive(oArchive);
             }
         } catch (...) {
             if (!autoSave && updateProjectProperties) {
@@ -655,22 +856,7 @@ Project::saveProjectInternal(const QString & path,
         }
     }
 
-    if (!QFile::rename(tmpFilename, filePath)) {
-        // QFile::rename() may fail, e.g. if tmpFilename and filePath are not on the same partition
-        if (!QFile::copy(tmpFilename, filePath)) {
-            int nAttemps = 0;
-
-            while ( nAttemps < 10 && !fileCopy(tmpFilename, filePath) ) {
-                ++nAttemps;
-            }
-
-            if (nAttemps >= 10) {
-                throw std::runtime_error( "Failed to save to " + filePath.toStdString() );
-            }
-        }
-
-        QFile::remove(tmpFilename);
-    }
+    replaceSavedFile(tmpFilename, filePath);
 
     if (!autoSave && updateProjectProperties) {
         QString lockFilePath = getLockAbsoluteFilePath();
@@ -703,6 +889,122 @@ Project::saveProjectInternal(const QString & path,
     return filePath;
 } // saveProjectInternal
 
+/**
+ * @brief Reads a project file without loading it. The GUI layout is only read if the app has a GUI,
+ * otherwise projectGui is left NULL. Returns true if the file was saved with a GUI layout.
+ **/
+template <class Archive>
+static bool
+readProjectFileForConversion(const AppInstancePtr& app,
+                             Archive & iArchive,
+                             ProjectSerialization* projectSerializationObj,
+                             ProjectGuiSerializationPtr* projectGui)
+{
+    bool bgProject;
+
+    iArchive >> boost::serialization::make_nvp("Background_project", bgProject);
+    iArchive >> boost::serialization::make_nvp("Project", *projectSerializationObj);
+    if (!bgProject) {
+        *projectGui = app->readProjectGui(iArchive);
+    }
+
+    return !bgProject;
+}
+
+/**
+ * @brief Writes a project file, it is a background project if projectGui is NULL.
+ **/
+template <class Archive>
+static void
+writeProjectFile(const AppInstancePtr& app,
+                 Archive & oArchive,
+                 const ProjectSerialization& projectSerializationObj,
+                 const ProjectGuiSerializationPtr& projectGui)
+{
+    bool bgProject = !projectGui;
+
+    oArchive << boost::serialization::make_nvp("Background_project", bgProject);
+    oArchive << boost::serialization::make_nvp("Project", projectSerializationObj);
+    if (projectGui) {
+        app->writeProjectGui(oArchive, *projectGui);
+    }
+}
+
+void
+Project::convertProjectFile(const QString& inputFilePath,
+                            const QString& outputFilePath)
+{
+    FStreamsSupport::ifstream ifile;
+    FStreamsSupport::open( &ifile, inputFilePath.toStdString(), std::ios_base::in | std::ios_base::binary );
+    if (!ifile) {
+        throw std::runtime_error( tr("Failed to open %1").arg(inputFilePath).toStdString() );
+    }
+
+    QFileInfo info(inputFilePath);
+    QString path = info.absolutePath();
+    StrUtils::ensureLastPathSeparator(path);
+
+    AppInstancePtr app = getApp();
+    bool inputIsBinary;
+    bool hasGuiLayout;
+    ProjectGuiSerializationPtr projectGui;
+    // The viewers are not created in background mode, their serialization is carried over as is
+    std::list<NodeSerializationPtr> viewersSerialization;
+    {
+        FlagSetter loadingProjectRAII(true, &_imp->isLoadingProject, &_imp->isLoadingProjectMutex);
+        FlagSetter loadingProjectInternalRAII(true, &_imp->isLoadingProjectInternal, &_imp->isLoadingProjectMutex);
+        ProjectSerialization projectSerializationObj( getApp() );
+
+        inputIsBinary = readBinaryProjectHeader(ifile);
+        if (inputIsBinary) {
+            boost::archive::binary_iarchive iArchive(ifile);
+            hasGuiLayout = readProjectFileForConversion(app, iArchive, &projectSerializationObj, &projectGui);
+        } else {
+            boost::archive::xml_iarchive iArchive(ifile);
+            hasGuiLayout = readProjectFileForConversion(app, iArchive, &projectSerializationObj, &projectGui);
+        }
+        if (hasGuiLayout && !projectGui) {
+            std::cout << tr("Warning: the GUI layout of %1 (node graph, panes) can only be read by %2 with a GUI, "
+                            "it is not part of the converted project.")
+                .arg(inputFilePath).arg( QString::fromUtf8(NATRON_APPLICATION_NAME) ).toStdString() << std::endl;
+        }
+
+        const std::list<NodeSerializationPtr>& nodes = projectSerializationObj.getNodesSerialization().getNodesSerialization();
+        for (std::list<NodeSerializationPtr>::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+            if ( ( (*it)->getPluginID() == PLUGINID_NATRON_VIEWER ) || ( (*it)->getPluginID() == "Viewer" ) ) {
+                viewersSerialization.push_back(*it);
+            }
+        }
+
+        bool mustSave = false;
+        if ( !load(projectSerializationObj, info.fileName(), path, &mustSave) ) {
+            throw std::runtime_error( tr("%1 could not be loaded entirely, it was not converted.").arg(inputFilePath).toStdString() );
+        }
+    }
+
+    ProjectSerialization projectSerializationObj( getApp() );
+    save(&projectSerializationObj);
+    if ( app->isBackground() ) {
+        for (std::list<NodeSerializationPtr>::const_iterator it = viewersSerialization.begin(); it != viewersSerialization.end(); ++it) {
+            projectSerializationObj.addNodeSerialization(*it);
+        }
+    }
+
+    FStreamsSupport::ofstream ofile;
+    FStreamsSupport::open( &ofile, outputFilePath.toStdString(), inputIsBinary ? std::ios_base::out : (std::ios_base::out | std::ios_base::binary) );
+    if (!ofile) {
+        throw std::runtime_error( tr("Failed to open file ").toStdString() + outputFilePath.toStdString() );
+    }
+    if (inputIsBinary) {
+        boost::archive::xml_oarchive oArchive(ofile);
+        writeProjectFile(app, oArchive, projectSerializationObj, projectGui);
+    } else {
+        writeBinaryProjectHeader(ofile);
+        boost::archive::binary_oarchive oArchive(ofile);
+        writeProjectFile(app, oArchive, projectSerializationObj, projectGui);
+    }
+} // Project::convertProjectFile
+
 void
 Project::autoSave()
 {
@@ -716,6 +1018,130 @@ Project::autoSave()
     saveProject_imp(path, name, true, true, 0);
 }
 
+bool
+Project::startBackgroundAutoSave()
+{
+    assert( QThread::currentThread() == qApp->thread() );
+
+    {
+        QMutexLocker l(&_imp->isLoadingProjectMutex);
+        if (_imp->isLoadingProject) {
+            return false;
+        }
+    }
+
+    {
+        QMutexLocker l(&_imp->isSavingProjectMutex);
+        if (_imp->isSavingProject) {
+            return false;
+        } else {
+            _imp->isSavingProject = true;
+        }
+    }
+
+    // Everything that reads the project is done here, the worker thread only writes the snapshot
+    ProjectAutoSaveSnapshotPtr snapshot = std::make_shared<ProjectAutoSaveSnapshot>();
+    try {
+        QString path = QString::fromUtf8( _imp->getProjectPath().c_str() );
+        QString name = QString::fromUtf8( _imp->getProjectFilename().c_str() );
+
+        ///Replace the last auto-save with a more recent one, once it is written
+        snapshot->previousAutoSaveFilePath = getLastAutoSaveFilePath();
+        if ( !snapshot->previousAutoSaveFilePath.isEmpty() ) {
+            snapshot->obsoleteAutoSaves.push_back(snapshot->previousAutoSaveFilePath);
+        }
+        if ( !path.isEmpty() ) {
+            QString projectPath = path;
+            StrUtils::ensureLastPathSeparator(projectPath);
+            snapshot->obsoleteAutoSaves.push_back( projectPath + name + QString::fromUtf8(".autosave") );
+        }
+
+        snapshot->time = QDateTime::currentDateTime();
+        snapshot->filePath = getSaveFilePath(path, name, true, true, snapshot->time);
+        snapshot->binaryFormat = appPTR->getCurrentSettings()->isBinaryProjectFormatEnabled();
+        snapshot->project = std::make_shared<ProjectSerialization>( getApp() );
+        save( snapshot->project.get() );
+        snapshot->projectGui = getApp()->captureProjectGui();
+    } catch (const std::exception & e) {
+        qDebug() << "Save failure: " << e.what();
+        QMutexLocker l(&_imp->isSavingProjectMutex);
+        _imp->isSavingProject = false;
+
+        return false;
+    }
+
+    {
+        QMutexLocker l(&_imp->projectLock);
+        _imp->lastAutoSave = snapshot->time;
+    }
+
+    std::shared_ptr<QFutureWatcher<void> > watcher = std::make_shared<QFutureWatcher<void> >();
+    QObject::connect( watcher.get(), SIGNAL(finished()), this, SLOT(onAutoSaveFutureFinished()) );
+    watcher->setFuture( QtConcurrent::run(this, &Project::writeAutoSaveSnapshot, snapshot) );
+    _imp->autoSaveFutures.push_back(watcher);
+
+    return true;
+} // Project::startBackgroundAutoSave
+
+void
+Project::writeAutoSaveSnapshot(const ProjectAutoSaveSnapshotPtr& snapshot)
+{
+    try {
+        QString tmpFilename = temporarySaveFilePath(snapshot->time);
+        {
+            FStreamsSupport::ofstream ofile;
+            FStreamsSupport::open( &ofile, tmpFilename.toStdString(), snapshot->binaryFormat ? (std::ios_base::out | std::ios_base::binary) : std::ios_base::out );
+            if (!ofile) {
+                throw std::runtime_error( tr("Failed to open file ").toStdString() + tmpFilename.toStdString() );
+            }
+            if (snapshot->binaryFormat) {
+                writeBinaryProjectHeader(ofile);
+                boost::archive::binary_oarchive oArchive(ofile);
+                writeProjectFile(getApp(), oArchive, *snapshot->project, snapshot->projectGui);
+            } else {
+                boost::archive::xml_oarchive oArchive(ofile);
+                writeProjectFile(getApp(), oArchive, *snapshot->project, snapshot->projectGui);
+            }
+        } // ofile
+        replaceSavedFile(tmpFilename, snapshot->filePath);
+
+        // The new auto-save is on disk: the previous ones can go
+        Q_FOREACH(const QString &obsoleteAutoSave, snapshot->obsoleteAutoSaves) {
+            if ( (obsoleteAutoSave != snapshot->filePath) && QFile::exists(obsoleteAutoSave) ) {
+                QFile::remove(obsoleteAutoSave);
+            }
+        }
+
+        QString projectPath = QString::fromUtf8( _imp->getProjectPath().c_str() );
+        QString projectFilename = QString::fromUtf8( _imp->getProjectFilename().c_str() );
+        Q_EMIT projectNameChanged(projectPath + projectFilename, true);
+    } catch (const std::exception & e) {
+        qDebug() << "Save failure: " << e.what();
+
+        // Keep pointing to the previous auto-save, which was not removed
+        QMutexLocker l(&_imp->projectLock);
+        if (_imp->lastAutoSaveFilePath == snapshot->filePath) {
+            _imp->lastAutoSaveFilePath = snapshot->previousAutoSaveFilePath;
+        }
+    }
+
+    {
+        QMutexLocker l(&_imp->isSavingProjectMutex);
+        _imp->isSavingProject = false;
+    }
+
+    ///Save caches ToC
+    appPTR->saveCaches();
+} // Project::writeAutoSaveSnapshot
+
+void
+Project::waitForBackgroundAutoSaves()
+{
+    for (std::list<std::shared_ptr<QFutureWatcher<void> > >::iterator it = _imp->autoSaveFutures.begin(); it != _imp->autoSaveFutures.end(); ++it) {
+        (*it)->waitForFinished();
+    }
+}
+
 void
 Project::triggerAutoSave()
 {
@@ -753,13 +1179,8 @@ Project::onAutoSaveTimerTriggered()
     ///If so launch an auto-save, otherwise, restart the timer.
     bool canAutoSave = !hasNodeRendering() && !getApp()->isShowingDialog();
 
-    if (canAutoSave) {
-        std::shared_ptr<QFutureWatcher<void> > watcher = std::make_shared<QFutureWatcher<void> >();
-        QObject::connect( watcher.get(), SIGNAL(finished()), this, SLOT(onAutoSaveFutureFinished()) );
-        watcher->setFuture( QtConcurrent::run(this, &Project::autoSave) );
-        _imp->autoSaveFutures.push_back(watcher);
-    } else {
-        ///If the auto-save failed because a render is in progress, try every 2 seconds to auto-save.
+    if ( !canAutoSave || !startBackgroundAutoSave() ) {
+        ///If the auto-save failed because a render or a save is in progress, try every 2 seconds to auto-save.
         ///We don't use the user-provided timeout interval here because it could be an inapropriate value.
         _imp->autoSaveTimer->start(2000);
     }
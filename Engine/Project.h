@@ -52,6 +52,7 @@ CLANG_DIAG_ON(uninitialized)
 NATRON_NAMESPACE_ENTER
 
 struct ProjectPrivate;
+struct ProjectAutoSaveSnapshot;
 
 class Project
     : public KnobHolder
@@ -109,6 +110,19 @@ public:
      **/
     void triggerAutoSave();
 
+    /**
+     * @brief Captures the project on the main thread and writes the auto-save from a worker thread,
+     * so that the user is only blocked while the serialization objects are filled, not while they are
+     * written to the file. Must be called on the main thread.
+     * @returns False if the project is being loaded or saved.
+     **/
+    bool startBackgroundAutoSave();
+
+    /**
+     * @brief Blocks until the auto-saves started by startBackgroundAutoSave() are written.
+     **/
+    void waitForBackgroundAutoSaves();
+
     /**
      * @brief Returns the path to where the auto save files are stored on disk.
      **/
@@ -117,6 +131,21 @@ public:
 
     bool findAutoSaveForProject(const QString& projectPath, const QString& projectName, QString* autoSaveFileName);
 
+    /**
+     * @brief Returns true if the given file is a project saved in the binary format, false
+     * if it is an XML project or cannot be read.
+     **/
+    static bool isBinaryProjectFile(const QString& filePath);
+
+    /**
+     * @brief Loads the project file at inputFilePath and writes it to outputFilePath in the other format:
+     * an XML project is converted to the binary format and a binary project to XML.
+     * The nodes are created to save the parameters like a regular save would, whereas the GUI layout
+     * stored in the file is carried over through AppInstance::readProjectGui(): it is dropped in background mode.
+     * This should be called on a project that has no node yet.
+     **/
+    void convertProjectFile(const QString& inputFilePath, const QString& outputFilePath);
+
     /**
      * @brief Returns true if the project is currently loading.
      **/
@@ -382,6 +411,16 @@ private:
 
     QString saveProjectInternal(const QString & path, const QString & name, bool autosave, bool updateProjectProperties);
 
+    QString getSaveFilePath(const QString & path, const QString & name, bool autoSave, bool updateProjectProperties, const QDateTime& time);
+
+    void writeAutoSaveSnapshot(const std::shared_ptr<ProjectAutoSaveSnapshot>& snapshot);
+
+    template <class Archive>
+    bool loadProjectArchive(Archive & iArchive, const QString & path, const QString & name, bool isAutoSave, bool* mustSave);
+
+    template <class Archive>
+    void saveProjectArchive(Archive & oArchive);
+
 
 
     void doResetEnd(bool aboutToQuit);
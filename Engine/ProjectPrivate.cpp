@@ -92,6 +92,7 @@ ProjectPrivate::ProjectPrivate(Project* project)
     , isSavingProjectMutex()
     , isSavingProject(false)
     , autoSaveTimer( new QTimer() )
+    , autoSaveFutures()
     , projectClosing(false)
     , tlsData( new TLSHolder<Project::ProjectTLSData>() )
 
@@ -36,6 +36,7 @@ CLANG_DIAG_OFF(uninitialized)
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDateTime>
 #include <QtCore/QString>
+#include <QtCore/QStringList>
 #include <QFuture>
 #include <QFutureWatcher>
 #include <QtCore/QMutex>
@@ -54,6 +55,24 @@ CLANG_DIAG_ON(uninitialized)
 
 NATRON_NAMESPACE_ENTER
 
+/**
+ * @brief The state of the project captured on the main thread by Project::startBackgroundAutoSave().
+ * The serialization objects do not read the live knobs, so a worker thread can write them to the file
+ * while the user keeps editing the project.
+ **/
+struct ProjectAutoSaveSnapshot
+{
+    QString filePath;
+    QString previousAutoSaveFilePath; //< restored as the last auto-save if this one fails
+    QStringList obsoleteAutoSaves; //< removed only once this auto-save is written, see Project::removeLastAutosave()
+    QDateTime time;
+    bool binaryFormat;
+    ProjectSerializationPtr project;
+    ProjectGuiSerializationPtr projectGui; //< NULL if there is no GUI, see AppInstance::captureProjectGui()
+};
+
+typedef std::shared_ptr<ProjectAutoSaveSnapshot> ProjectAutoSaveSnapshotPtr;
+
 struct ProjectPrivate
 {
     Q_DECLARE_TR_FUNCTIONS(Project)
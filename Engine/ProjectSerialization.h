@@ -35,6 +35,8 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
 // clang-format off
 GCC_DIAG_OFF(unused-parameter)
 // /opt/local/include/boost/serialization/smart_cast.hpp:254:25: warning: unused parameter 'u' [-Wunused-parameter]
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/xml_iarchive.hpp>
 #include <boost/archive/xml_oarchive.hpp>
 #include <boost/serialization/list.hpp>
@@ -73,6 +75,16 @@ GCC_DIAG_ON(unused-parameter)
 #define PROJECT_SERIALIZATION_CHANGE_VERSION_SERIALIZATION 6
 #define PROJECT_SERIALIZATION_VERSION PROJECT_SERIALIZATION_CHANGE_VERSION_SERIALIZATION
 
+// A binary project file starts with this magic string followed by the binary format version (4 bytes, little endian)
+// and a description of the platform that wrote it (byte order and size of the fundamental types),
+// then comes a boost binary archive holding the same objects as the XML archive of a regular project file.
+// Boost binary archives store the fundamental types as they are in memory, hence a binary project is only
+// read on a platform with the same description: use the XML format to exchange projects.
+#define NATRON_PROJECT_BINARY_MAGIC "NatronBinaryProject"
+#define NATRON_PROJECT_BINARY_FORMAT_VERSION_PLATFORM 2
+#define NATRON_PROJECT_BINARY_FORMAT_VERSION NATRON_PROJECT_BINARY_FORMAT_VERSION_PLATFORM
+#define NATRON_PROJECT_BINARY_PLATFORM_SIZE 12
+
 NATRON_NAMESPACE_ENTER
 
 class ProjectBeingLoadedInfo
@@ -154,6 +166,11 @@ public:
         return _nodes;
     }
 
+    void addNodeSerialization(const NodeSerializationPtr& s)
+    {
+        _nodes.addNodeSerialization(s);
+    }
+
     qint64 getCreationDate() const
     {
         return _creationDate;
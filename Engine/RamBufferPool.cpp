@@ -0,0 +1,319 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "RamBufferPool.h"
+
+#if defined(__NATRON_LINUX__)
+#include <sys/mman.h> // mmap, madvise
+#endif
+
+#include <cassert>
+#include <cstdlib> // malloc, free
+#include <new> // bad_alloc
+#include <utility>
+#include <vector>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
+
+// The maximum amount of free bytes until the caches set it
+#define NATRON_RAM_BUFFER_POOL_DEFAULT_MAX_FREE_BYTES (256 * 1024 * 1024)
+
+NATRON_NAMESPACE_ENTER
+
+static constexpr int
+floorLog2(std::size_t v)
+{
+    return v <= 1 ? 0 : 1 + floorLog2(v >> 1);
+}
+
+static constexpr int kMinBlockLog2 = floorLog2(NATRON_RAM_BUFFER_POOL_MIN_BLOCK_BYTES);
+static constexpr int kNSizeClasses = ( floorLog2(NATRON_RAM_BUFFER_POOL_MAX_BLOCK_BYTES) - kMinBlockLog2 ) * NATRON_RAM_BUFFER_POOL_CLASSES_PER_DOUBLING + 1;
+
+/**
+ * @brief Returns the index of the size class of a buffer of nBytes and the size of its blocks,
+ * or -1 if buffers of this size are not pooled.
+ **/
+static int
+getSizeClass(std::size_t nBytes,
+             std::size_t* blockSize)
+{
+    if ( (nBytes < NATRON_RAM_BUFFER_POOL_MIN_BLOCK_BYTES) || (nBytes > NATRON_RAM_BUFFER_POOL_MAX_BLOCK_BYTES) ) {
+        *blockSize = nBytes;
+
+        return -1;
+    }
+    int p = floorLog2(nBytes);
+    std::size_t step = ( (std::size_t)1 << p ) / NATRON_RAM_BUFFER_POOL_CLASSES_PER_DOUBLING;
+    std::size_t rounded = ( (nBytes + step - 1) / step ) * step;
+
+    // Rounding may reach the next power of two
+    p = floorLog2(rounded);
+    step = ( (std::size_t)1 << p ) / NATRON_RAM_BUFFER_POOL_CLASSES_PER_DOUBLING;
+    *blockSize = rounded;
+
+    return (p - kMinBlockLog2) * NATRON_RAM_BUFFER_POOL_CLASSES_PER_DOUBLING + (int)( ( rounded - ( (std::size_t)1 << p ) ) / step );
+}
+
+static void*
+systemAllocate(std::size_t nBytes)
+{
+#if defined(__NATRON_LINUX__)
+    if (nBytes >= NATRON_RAM_BUFFER_POOL_HUGE_PAGE_BYTES) {
+        void* ret = mmap(0, nBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ret == MAP_FAILED) {
+            return 0;
+        }
+#ifdef MADV_HUGEPAGE
+        // Fewer TLB misses and page faults when processing the image. This is only a hint.
+        madvise(ret, nBytes, MADV_HUGEPAGE);
+#endif
+
+        return ret;
+    }
+#endif
+
+    return malloc(nBytes);
+}
+
+static void
+systemFree(void* block,
+           std::size_t nBytes)
+{
+#if defined(__NATRON_LINUX__)
+    if (nBytes >= NATRON_RAM_BUFFER_POOL_HUGE_PAGE_BYTES) {
+        munmap(block, nBytes);
+
+        return;
+    }
+#else
+    Q_UNUSED(nBytes);
+#endif
+    free(block);
+}
+
+struct RamBufferPoolPrivate
+{
+    mutable QMutex lock; //< protects all members
+
+    // For each size class, the free blocks, most recently released last
+    std::vector<std::vector<void*> > freeBlocks;
+    RamBufferPoolStats stats;
+
+    RamBufferPoolPrivate()
+        : lock()
+        , freeBlocks(kNSizeClasses)
+        , stats()
+    {
+        stats.maximumFreeBytes = NATRON_RAM_BUFFER_POOL_DEFAULT_MAX_FREE_BYTES;
+    }
+
+    /**
+     * @brief Removes free blocks until at most targetFreeBytes are held, the largest blocks first.
+     * The blocks must be freed by the caller, after releasing the lock.
+     **/
+    void takeBlocksToTrim(std::size_t targetFreeBytes,
+                          std::vector<std::pair<void*, std::size_t> >* blocks)
+    {
+        for (int c = kNSizeClasses - 1; c >= 0 && stats.freeBytes > targetFreeBytes; --c) {
+            std::vector<void*>& classBlocks = freeBlocks[c];
+            if ( classBlocks.empty() ) {
+                continue;
+            }
+            std::size_t blockSize = getClassBlockSize(c);
+            // Free the least recently released blocks first
+            std::size_t nToFree = 0;
+            while ( nToFree < classBlocks.size() && stats.freeBytes > targetFreeBytes ) {
+                blocks->push_back( std::make_pair(classBlocks[nToFree], blockSize) );
+                stats.freeBytes -= blockSize;
+                ++nToFree;
+            }
+            classBlocks.erase( classBlocks.begin(), classBlocks.begin() + nToFree );
+        }
+    }
+
+    static std::size_t getClassBlockSize(int c)
+    {
+        int p = kMinBlockLog2 + c / NATRON_RAM_BUFFER_POOL_CLASSES_PER_DOUBLING;
+        std::size_t step = ( (std::size_t)1 << p ) / NATRON_RAM_BUFFER_POOL_CLASSES_PER_DOUBLING;
+
+        return ( (std::size_t)1 << p ) + (c % NATRON_RAM_BUFFER_POOL_CLASSES_PER_DOUBLING) * step;
+    }
+
+    void freeBlocksToSystem(const std::vector<std::pair<void*, std::size_t> >& blocks)
+    {
+        if ( blocks.empty() ) {
+            return;
+        }
+        QElapsedTimer timer;
+        timer.start();
+        for (std::size_t i = 0; i < blocks.size(); ++i) {
+            systemFree(blocks[i].first, blocks[i].second);
+        }
+        qint64 nsecs = timer.nsecsElapsed();
+
+        QMutexLocker k(&lock);
+        stats.nSystemFrees += blocks.size();
+        stats.systemNSecs += nsecs;
+    }
+};
+
+RamBufferPool*
+RamBufferPool::instance()
+{
+    // Intentionally leaked, see the header
+    static RamBufferPool* pool = new RamBufferPool();
+
+    return pool;
+}
+
+RamBufferPool::RamBufferPool()
+    : _imp( new RamBufferPoolPrivate() )
+{
+}
+
+RamBufferPool::~RamBufferPool()
+{
+    trim(0);
+}
+
+std::size_t
+RamBufferPool::getBlockSize(std::size_t nBytes)
+{
+    std::size_t ret;
+
+    getSizeClass(nBytes, &ret);
+
+    return ret;
+}
+
+void*
+RamBufferPool::allocate(std::size_t nBytes,
+                        std::size_t* blockSize)
+{
+    int sizeClass = getSizeClass(nBytes, blockSize);
+    {
+        QMutexLocker k(&_imp->lock);
+        ++_imp->stats.nAllocations;
+        _imp->stats.allocatedBytes += *blockSize;
+        if (sizeClass >= 0) {
+            std::vector<void*>& classBlocks = _imp->freeBlocks[sizeClass];
+            if ( !classBlocks.empty() ) {
+                void* ret = classBlocks.back();
+                classBlocks.pop_back();
+                _imp->stats.freeBytes -= *blockSize;
+                ++_imp->stats.nPoolHits;
+
+                return ret;
+            }
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    void* ret = systemAllocate(*blockSize);
+    if (!ret) {
+        // Give the free blocks of other sizes back to the system and retry
+        trim(0);
+        ret = systemAllocate(*blockSize);
+    }
+    qint64 nsecs = timer.nsecsElapsed();
+    {
+        QMutexLocker k(&_imp->lock);
+        ++_imp->stats.nSystemAllocations;
+        _imp->stats.systemNSecs += nsecs;
+    }
+    if (!ret) {
+        throw std::bad_alloc();
+    }
+
+    return ret;
+} // RamBufferPool::allocate
+
+void
+RamBufferPool::release(void* block,
+                       std::size_t blockSize)
+{
+    if (!block) {
+        return;
+    }
+    std::size_t classBlockSize;
+    int sizeClass = getSizeClass(blockSize, &classBlockSize);
+    assert(classBlockSize == blockSize);
+    if (sizeClass >= 0) {
+        QMutexLocker k(&_imp->lock);
+        if (_imp->stats.freeBytes + blockSize <= _imp->stats.maximumFreeBytes) {
+            _imp->freeBlocks[sizeClass].push_back(block);
+            _imp->stats.freeBytes += blockSize;
+
+            return;
+        }
+    }
+
+    std::vector<std::pair<void*, std::size_t> > blocks;
+    blocks.push_back( std::make_pair(block, blockSize) );
+    _imp->freeBlocksToSystem(blocks);
+}
+
+void
+RamBufferPool::trim(std::size_t targetFreeBytes)
+{
+    std::vector<std::pair<void*, std::size_t> > blocks;
+    {
+        QMutexLocker k(&_imp->lock);
+        _imp->takeBlocksToTrim(targetFreeBytes, &blocks);
+    }
+    _imp->freeBlocksToSystem(blocks);
+}
+
+void
+RamBufferPool::setMaximumFreeBytes(std::size_t maximumFreeBytes)
+{
+    std::vector<std::pair<void*, std::size_t> > blocks;
+    {
+        QMutexLocker k(&_imp->lock);
+        _imp->stats.maximumFreeBytes = maximumFreeBytes;
+        _imp->takeBlocksToTrim(maximumFreeBytes, &blocks);
+    }
+    _imp->freeBlocksToSystem(blocks);
+}
+
+std::size_t
+RamBufferPool::getFreeBytes() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->stats.freeBytes;
+}
+
+void
+RamBufferPool::getStats(RamBufferPoolStats* stats) const
+{
+    QMutexLocker k(&_imp->lock);
+
+    *stats = _imp->stats;
+}
+
+NATRON_NAMESPACE_EXIT
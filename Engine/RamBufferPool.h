@@ -0,0 +1,155 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_RamBufferPool_h
+#define Natron_Engine_RamBufferPool_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <memory>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+// Buffers smaller than this are not pooled: malloc is already fast for them
+#define NATRON_RAM_BUFFER_POOL_MIN_BLOCK_BYTES (64 * 1024)
+
+// Buffers larger than this are not pooled
+#define NATRON_RAM_BUFFER_POOL_MAX_BLOCK_BYTES ( (std::size_t)1 << 31 )
+
+// Number of size classes between two powers of two: a block wastes at most 1/8 of its size
+#define NATRON_RAM_BUFFER_POOL_CLASSES_PER_DOUBLING 8
+
+// On Linux, blocks at least this large are mapped directly and backed by transparent huge pages
+#define NATRON_RAM_BUFFER_POOL_HUGE_PAGE_BYTES (2 * 1024 * 1024)
+
+// Fraction of the RAM cache size that the free blocks of the pool may occupy
+#define NATRON_RAM_BUFFER_POOL_MAX_FREE_PERCENT 0.1
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Counters of the RamBufferPool since the application started.
+ **/
+struct RamBufferPoolStats
+{
+    // Number of blocks requested and their total size
+    U64 nAllocations;
+    U64 allocatedBytes;
+
+    // Number of blocks which were served from the pool instead of the system
+    U64 nPoolHits;
+
+    // Number of blocks allocated and freed by the system and the time spent doing so
+    U64 nSystemAllocations;
+    U64 nSystemFrees;
+    U64 systemNSecs;
+
+    // Bytes held in the free blocks of the pool
+    std::size_t freeBytes;
+    std::size_t maximumFreeBytes;
+
+    RamBufferPoolStats()
+        : nAllocations(0)
+        , allocatedBytes(0)
+        , nPoolHits(0)
+        , nSystemAllocations(0)
+        , nSystemFrees(0)
+        , systemNSecs(0)
+        , freeBytes(0)
+        , maximumFreeBytes(0)
+    {
+    }
+};
+
+/**
+ * @brief The allocator of the RamBuffer class, used by the images and frames stored in RAM.
+ * During playback and tiled renders, buffers of the same few sizes (same format, depth and mipmap level)
+ * are allocated and released constantly. Instead of returning released buffers to the system, the pool
+ * keeps them in free lists indexed by size class, so that the next buffer of the same class reuses the memory
+ * without a system call nor page faults.
+ * The free blocks are capped (see setMaximumFreeBytes()) and are counted in the memory used by the caches:
+ * the CacheCleanerThread trims them when the RAM cache exceeds its budget.
+ * This class is MT-safe.
+ **/
+struct RamBufferPoolPrivate;
+class RamBufferPool
+{
+public:
+
+    /**
+     * @brief Returns the pool of the application. It is never destroyed, so that buffers can still be
+     * released while static objects are destroyed at exit.
+     **/
+    static RamBufferPool* instance();
+
+    ~RamBufferPool();
+
+    /**
+     * @brief Returns the size of the block allocated for a buffer of the given size.
+     **/
+    static std::size_t getBlockSize(std::size_t nBytes);
+
+    /**
+     * @brief Returns a block of getBlockSize(nBytes) bytes, which is also set in blockSize.
+     * The content of the block is undefined.
+     * This function throws std::bad_alloc on failure.
+     **/
+    void* allocate(std::size_t nBytes, std::size_t* blockSize);
+
+    /**
+     * @brief Gives back a block returned by allocate(). It is kept for a later allocation unless the pool
+     * already holds the maximum amount of free bytes.
+     **/
+    void release(void* block, std::size_t blockSize);
+
+    /**
+     * @brief Frees blocks of the pool until it holds at most targetFreeBytes bytes.
+     **/
+    void trim(std::size_t targetFreeBytes);
+
+    /**
+     * @brief Sets the maximum number of bytes held in free blocks, trimming the pool if needed.
+     **/
+    void setMaximumFreeBytes(std::size_t maximumFreeBytes);
+
+    /**
+     * @brief Returns the number of bytes held in free blocks.
+     **/
+    std::size_t getFreeBytes() const;
+
+    void getStats(RamBufferPoolStats* stats) const;
+
+private:
+
+    RamBufferPool();
+
+    std::unique_ptr<RamBufferPoolPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_RamBufferPool_h
@@ -315,12 +315,16 @@ struct RenderStatsPrivate
     typedef std::map<NodeWPtr, NodeRenderStats, std::owner_less<NodeWPtr>> NodeInfosMap;
     NodeInfosMap nodeInfos;
 
+    //Number of nodes visited by the hash propagation preceding the render
+    int hashPropagationNodesVisited;
+
 
     RenderStatsPrivate()
         : lock()
         , totalTimeSpentForFrameTimer()
         , doNodesProfiling(false)
         , nodeInfos()
+        , hashPropagationNodesVisited(0)
     {
     }
 
@@ -454,4 +458,20 @@ RenderStats::getStats(double *totalTimeSpent) const
     return ret;
 }
 
+void
+RenderStats::setHashPropagationNodesVisited(int nodesVisited)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->hashPropagationNodesVisited = nodesVisited;
+}
+
+int
+RenderStats::getHashPropagationNodesVisited() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->hashPropagationNodesVisited;
+}
+
 NATRON_NAMESPACE_EXIT
@@ -139,6 +139,13 @@ public:
 
     std::map<NodePtr, NodeRenderStats > getStats(double *totalTimeSpent) const;
 
+    /**
+     * @brief The number of nodes whose hash was recomputed by the last change made to the graph
+     * (e.g: a parameter change) before this render started, see Node::getHashPropagationNodesVisited()
+     **/
+    void setHashPropagationNodesVisited(int nodesVisited);
+    int getHashPropagationNodesVisited() const;
+
 private:
 
     std::unique_ptr<RenderStatsPrivate> _imp;
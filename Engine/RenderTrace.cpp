@@ -0,0 +1,363 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "RenderTrace.h"
+
+#include <algorithm> // min, max
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+
+#include "Global/FStreamsSupport.h"
+
+#include "Engine/EffectInstance.h"
+
+NATRON_NAMESPACE_ENTER
+
+namespace {
+struct RenderTraceSpanData
+{
+    const char* name;
+    const char* category;
+    U64 startNSecs;
+    U64 endNSecs;
+    char label[NATRON_RENDER_TRACE_LABEL_LENGTH];
+};
+
+/*
+ * A slot of the ring buffer of a thread. The slot is protected by a sequence lock: sequence is 2 * i + 1 while
+ * the thread writes the span i to the slot and 2 * i + 2 once it is written, so that a reader can tell whether
+ * the copy it made is the span i and was not overwritten while it was copying it.
+ */
+struct RenderTraceSpanRecord
+{
+    std::atomic<U64> sequence;
+    RenderTraceSpanData data;
+
+    RenderTraceSpanRecord()
+        : sequence(0)
+        , data()
+    {
+    }
+};
+
+/*
+ * The spans of a thread. Only the thread writes spans, nSpans is incremented after a span is written
+ * so that the spans below it can be read by other threads.
+ */
+struct RenderTraceThreadBuffer
+{
+    std::vector<RenderTraceSpanRecord> spans;
+    std::atomic<U64> nSpans; // number of spans recorded since the thread started
+    std::atomic<U64> firstSpan; // spans before this one were removed by clear()
+    std::atomic<bool> threadExited;
+    int threadIndex;
+    std::string threadName;
+
+    RenderTraceThreadBuffer()
+        : spans(NATRON_RENDER_TRACE_SPANS_PER_THREAD)
+        , nSpans(0)
+        , firstSpan(0)
+        , threadExited(false)
+        , threadIndex(0)
+        , threadName()
+    {
+    }
+};
+
+typedef std::shared_ptr<RenderTraceThreadBuffer> RenderTraceThreadBufferPtr;
+
+/*
+ * Copies the spans of a thread still in its ring buffer. The spans overwritten by the thread while they are
+ * copied are skipped.
+ */
+void
+readSpans(const RenderTraceThreadBuffer& buffer,
+          std::vector<RenderTraceSpanData>* spans)
+{
+    U64 nSpans = buffer.nSpans.load(std::memory_order_acquire);
+    U64 firstSpan = std::max( buffer.firstSpan.load(), nSpans > NATRON_RENDER_TRACE_SPANS_PER_THREAD ? nSpans - NATRON_RENDER_TRACE_SPANS_PER_THREAD : 0 );
+
+    spans->reserve(nSpans - std::min(firstSpan, nSpans));
+    for (U64 i = firstSpan; i < nSpans; ++i) {
+        const RenderTraceSpanRecord& record = buffer.spans[i % NATRON_RENDER_TRACE_SPANS_PER_THREAD];
+        const U64 sequence = 2 * i + 2;
+        if (record.sequence.load(std::memory_order_acquire) != sequence) {
+            // Already overwritten
+            continue;
+        }
+        RenderTraceSpanData span;
+        std::memcpy( &span, &record.data, sizeof(span) );
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (record.sequence.load(std::memory_order_relaxed) != sequence) {
+            // Overwritten while copying
+            continue;
+        }
+        span.label[NATRON_RENDER_TRACE_LABEL_LENGTH - 1] = '\0';
+        spans->push_back(span);
+    }
+}
+
+struct RenderTraceThreadBufferHolder
+{
+    RenderTraceThreadBufferPtr buffer;
+
+    ~RenderTraceThreadBufferHolder()
+    {
+        if (buffer) {
+            // The spans are kept until clear() is called
+            buffer->threadExited = true;
+        }
+    }
+};
+
+// The buffers of all the threads which recorded spans
+struct RenderTraceBuffers
+{
+    QMutex lock;
+    std::list<RenderTraceThreadBufferPtr> buffers;
+    int nThreads;
+
+    RenderTraceBuffers()
+        : lock()
+        , buffers()
+        , nThreads(0)
+    {
+    }
+};
+
+RenderTraceBuffers&
+getRenderTraceBuffers()
+{
+    // Never destroyed: threads may still exit after the static objects are destroyed
+    static RenderTraceBuffers* buffers = new RenderTraceBuffers;
+
+    return *buffers;
+}
+
+thread_local RenderTraceThreadBufferHolder tlsRenderTraceBuffer;
+
+RenderTraceThreadBuffer*
+getThreadBuffer()
+{
+    RenderTraceThreadBufferPtr& buffer = tlsRenderTraceBuffer.buffer;
+
+    if (!buffer) {
+        buffer = std::make_shared<RenderTraceThreadBuffer>();
+        QThread* thread = QThread::currentThread();
+        if ( qApp && (thread == qApp->thread()) ) {
+            buffer->threadName = "Main thread";
+        } else if ( thread && !thread->objectName().isEmpty() ) {
+            buffer->threadName = thread->objectName().toStdString();
+        }
+        RenderTraceBuffers& buffers = getRenderTraceBuffers();
+        QMutexLocker k(&buffers.lock);
+        buffer->threadIndex = ++buffers.nThreads;
+        if ( buffer->threadName.empty() ) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "Thread %d", buffer->threadIndex);
+            buffer->threadName = name;
+        }
+        buffers.buffers.push_back(buffer);
+    }
+
+    return buffer.get();
+}
+
+void
+writeJSONString(std::ostream& os,
+                const char* str)
+{
+    os << '"';
+    for (const char* c = str; *c; ++c) {
+        if ( (*c == '"') || (*c == '\\') ) {
+            os << '\\' << *c;
+        } else if ( (unsigned char)*c < 0x20 ) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int)(unsigned char)*c);
+            os << escaped;
+        } else {
+            os << *c;
+        }
+    }
+    os << '"';
+}
+} // anon namespace
+
+std::atomic<bool> RenderTrace::_enabled(false);
+
+void
+RenderTrace::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+}
+
+void
+RenderTrace::clear()
+{
+    RenderTraceBuffers& buffers = getRenderTraceBuffers();
+    QMutexLocker k(&buffers.lock);
+
+    for (std::list<RenderTraceThreadBufferPtr>::iterator it = buffers.buffers.begin(); it != buffers.buffers.end();) {
+        if ( (*it)->threadExited ) {
+            it = buffers.buffers.erase(it);
+        } else {
+            (*it)->firstSpan = (*it)->nSpans.load(std::memory_order_acquire);
+            ++it;
+        }
+    }
+}
+
+U64
+RenderTrace::getTimestamp()
+{
+    return (U64)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void
+RenderTrace::addSpan(const char* name,
+                     const char* category,
+                     const char* label,
+                     U64 startNSecs,
+                     U64 endNSecs)
+{
+    RenderTraceThreadBuffer* buffer = getThreadBuffer();
+    U64 index = buffer->nSpans.load(std::memory_order_relaxed);
+    RenderTraceSpanRecord& record = buffer->spans[index % NATRON_RENDER_TRACE_SPANS_PER_THREAD];
+
+    record.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    RenderTraceSpanData& span = record.data;
+    span.name = name;
+    span.category = category;
+    span.startNSecs = startNSecs;
+    span.endNSecs = endNSecs;
+    std::strncpy(span.label, label, NATRON_RENDER_TRACE_LABEL_LENGTH - 1);
+    span.label[NATRON_RENDER_TRACE_LABEL_LENGTH - 1] = '\0';
+    record.sequence.store(2 * index + 2, std::memory_order_release);
+    buffer->nSpans.store(index + 1, std::memory_order_release);
+}
+
+bool
+RenderTrace::writeChromeTrace(const std::string& filePath,
+                              std::string* error)
+{
+    std::list<RenderTraceThreadBufferPtr> threadBuffers;
+    {
+        RenderTraceBuffers& buffers = getRenderTraceBuffers();
+        QMutexLocker k(&buffers.lock);
+        threadBuffers = buffers.buffers;
+    }
+
+    FStreamsSupport::ofstream ofile;
+    FStreamsSupport::open(&ofile, filePath);
+    if (!ofile) {
+        *error = "Failed to open " + filePath + " for writing";
+
+        return false;
+    }
+
+    // Timestamps are written in microseconds from the first span
+    U64 originNSecs = std::numeric_limits<U64>::max();
+    std::vector<std::vector<RenderTraceSpanData> > threadSpans( threadBuffers.size() );
+    std::size_t threadIndex = 0;
+    for (std::list<RenderTraceThreadBufferPtr>::const_iterator it = threadBuffers.begin(); it != threadBuffers.end(); ++it, ++threadIndex) {
+        readSpans(**it, &threadSpans[threadIndex]);
+        for (std::size_t i = 0; i < threadSpans[threadIndex].size(); ++i) {
+            originNSecs = std::min(originNSecs, threadSpans[threadIndex][i].startNSecs);
+        }
+    }
+
+    qint64 pid = QCoreApplication::applicationPid();
+    bool firstEvent = true;
+    ofile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    threadIndex = 0;
+    for (std::list<RenderTraceThreadBufferPtr>::const_iterator it = threadBuffers.begin(); it != threadBuffers.end(); ++it, ++threadIndex) {
+        const RenderTraceThreadBuffer& buffer = **it;
+        if (!firstEvent) {
+            ofile << ",\n";
+        }
+        firstEvent = false;
+        ofile << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer.threadIndex << ",\"args\":{\"name\":";
+        writeJSONString( ofile, buffer.threadName.c_str() );
+        ofile << "}}";
+
+        const std::vector<RenderTraceSpanData>& spans = threadSpans[threadIndex];
+        for (std::size_t i = 0; i < spans.size(); ++i) {
+            const RenderTraceSpanData& span = spans[i];
+            char times[64];
+            std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f",
+                          (span.startNSecs - originNSecs) / 1000., (span.endNSecs - span.startNSecs) / 1000.);
+            ofile << ",\n{\"name\":";
+            writeJSONString(ofile, span.name);
+            ofile << ",\"cat\":";
+            writeJSONString(ofile, span.category);
+            ofile << ",\"ph\":\"X\"," << times << ",\"pid\":" << pid << ",\"tid\":" << buffer.threadIndex;
+            if (span.label[0] != '\0') {
+                ofile << ",\"args\":{\"node\":";
+                writeJSONString(ofile, span.label);
+                ofile << "}";
+            }
+            ofile << "}";
+        }
+    }
+    ofile << "\n]}\n";
+    if (!ofile) {
+        *error = "Failed to write " + filePath;
+
+        return false;
+    }
+
+    return true;
+} // RenderTrace::writeChromeTrace
+
+RenderTraceSpan::RenderTraceSpan(const char* name,
+                                 const char* category,
+                                 const EffectInstance* effect)
+    : _name(name)
+    , _category(category)
+    , _startNSecs(0)
+{
+    _label[0] = '\0';
+    if ( !RenderTrace::isEnabled() ) {
+        return;
+    }
+    if (effect) {
+        std::string scriptName = effect->getScriptName_mt_safe();
+        std::strncpy(_label, scriptName.c_str(), NATRON_RENDER_TRACE_LABEL_LENGTH - 1);
+        _label[NATRON_RENDER_TRACE_LABEL_LENGTH - 1] = '\0';
+    }
+    _startNSecs = RenderTrace::getTimestamp();
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,135 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_RenderTrace_h
+#define Natron_Engine_RenderTrace_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <atomic>
+#include <string>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+// Number of spans kept for each thread: the oldest spans of a thread are overwritten by its new spans
+#define NATRON_RENDER_TRACE_SPANS_PER_THREAD (16 * 1024)
+
+// Maximum length of the label of a span, e.g. the script-name of a node
+#define NATRON_RENDER_TRACE_LABEL_LENGTH 40
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Records the time spent by each thread in the steps of the renders (renderRoI, tiles, cache look-ups,
+ * plug-in actions, Python GIL and OpenGL context waits...) as spans with a start and an end, to find where
+ * renders stall. The spans can be written as a Chrome trace (JSON), which can be opened in chrome://tracing
+ * or https://ui.perfetto.dev.
+ * Each thread writes its spans to its own ring buffer without any lock. When recording is disabled, which is
+ * the default, a span costs a relaxed atomic load.
+ * This class is MT-safe.
+ **/
+class RenderTrace
+{
+public:
+
+    static bool isEnabled()
+    {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Starts or stops recording the spans. The spans recorded previously are kept.
+     **/
+    static void setEnabled(bool enabled);
+
+    /**
+     * @brief Removes the spans recorded so far.
+     **/
+    static void clear();
+
+    /**
+     * @brief Returns the current time in nanoseconds, from a monotonic clock.
+     **/
+    static U64 getTimestamp();
+
+    /**
+     * @brief Records a span of the calling thread. name and category must be string literals.
+     **/
+    static void addSpan(const char* name, const char* category, const char* label, U64 startNSecs, U64 endNSecs);
+
+    /**
+     * @brief Writes the spans recorded so far to the given file as a Chrome trace.
+     * This may be called while recording: the spans overwritten in the ring buffers while writing are skipped.
+     * Returns false and sets error if the file could not be written.
+     **/
+    static bool writeChromeTrace(const std::string& filePath, std::string* error);
+
+private:
+
+    static std::atomic<bool> _enabled;
+};
+
+/**
+ * @brief Records a span of RenderTrace from its construction to its destruction, if recording is enabled.
+ **/
+class RenderTraceSpan
+{
+public:
+
+    RenderTraceSpan(const char* name,
+                    const char* category)
+        : _name(name)
+        , _category(category)
+        , _startNSecs( RenderTrace::isEnabled() ? RenderTrace::getTimestamp() : 0 )
+    {
+        _label[0] = '\0';
+    }
+
+    /**
+     * @brief Same as above, the span is labeled with the script-name of the node of the effect.
+     **/
+    RenderTraceSpan(const char* name,
+                    const char* category,
+                    const EffectInstance* effect);
+
+    ~RenderTraceSpan()
+    {
+        if (_startNSecs) {
+            RenderTrace::addSpan( _name, _category, _label, _startNSecs, RenderTrace::getTimestamp() );
+        }
+    }
+
+private:
+
+    const char* _name;
+    const char* _category;
+    U64 _startNSecs; //< 0 if recording was disabled when the span started
+    char _label[NATRON_RENDER_TRACE_LABEL_LENGTH];
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_RenderTrace_h
@@ -36,6 +36,7 @@
 
 #include <QtCore/QLineF>
 #include <QtCore/QDebug>
+#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
 
 //#define ROTO_RENDER_TRIANGLES_ONLY
 
@@ -60,6 +61,7 @@
 #include "Engine/RotoContextSerialization.h"
 #include "Engine/RotoDrawableItem.h"
 #include "Engine/RotoLayer.h"
+#include "Engine/RotoShapeRasterizer.h"
 #include "Engine/RotoStrokeItem.h"
 #include "Engine/Settings.h"
 #include "Engine/TimeLine.h"
@@ -2840,11 +2842,23 @@ RotoDrawableItem::renderMaskFromStroke(const ImagePlaneDesc& components,
     image->allocateMemory();
 
 
-    image = renderMaskInternal(pixelRod, components, startTime, endTime, mbFrameStep, time, inverted, depth, mipmapLevel, strokes, image);
+    image = renderMaskInternal(pixelRod, components, startTime, endTime, mbFrameStep, time, inverted, depth, mipmapLevel, strokes, image, false);
 
     return image;
 } // RotoDrawableItem::renderMaskFromStroke
 
+void
+RotoDrawableItem::renderShapeMask(const RectI& roi,
+                                  double time,
+                                  unsigned int mipmapLevel,
+                                  bool useCairo,
+                                  const ImagePtr& image)
+{
+    assert( dynamic_cast<Bezier*>(this) && !dynamic_cast<Bezier*>(this)->isOpenBezier() );
+    std::list<std::list<std::pair<Point, double> > > strokes;
+    renderMaskInternal(roi, image->getComponents(), time, time, 1., time, false, image->getBitDepth(), mipmapLevel, strokes, image, useCairo);
+}
+
 ImagePtr
 RotoDrawableItem::renderMaskInternal(const RectI & roi,
                                      const ImagePlaneDesc& components,
@@ -2856,7 +2870,8 @@ RotoDrawableItem::renderMaskInternal(const RectI & roi,
                                      const ImageBitDepthEnum depth,
                                      const unsigned int mipmapLevel,
                                      const std::list<std::list<std::pair<Point, double> > >& strokes,
-                                     const ImagePtr &image)
+                                     const ImagePtr &image,
+                                     const bool useCairo)
 {
     Q_UNUSED(startTime);
     Q_UNUSED(endTime);
@@ -2864,6 +2879,16 @@ RotoDrawableItem::renderMaskInternal(const RectI & roi,
     NodePtr node = getContext()->getNode();
     RotoStrokeItem* isStroke = dynamic_cast<RotoStrokeItem*>(this);
     Bezier* isBezier = dynamic_cast<Bezier*>(this);
+
+    if ( isBezier && !isBezier->isOpenBezier() && !useCairo ) {
+        // Closed shapes are rasterized directly in the image, without cairo
+        double shapeColor[3];
+        getColor(time, shapeColor);
+        RotoContextPrivate::renderBezierMask(isBezier, getOpacity(time), time, startTime, endTime, timeStep, mipmapLevel, shapeColor, inverted, roi, image.get());
+
+        return image;
+    }
+
     cairo_format_t cairoImgFormat;
     int srcNComps;
     bool doBuildUp = true;
@@ -2945,6 +2970,8 @@ RotoDrawableItem::renderMaskInternal(const RectI & roi,
         convertCairoImageToNatronImage_noColor<unsigned short, 65535>(imgWrapper.cairoImg, srcNComps, image.get(), roi, shapeColor, opacity, inverted, useOpacityToConvert);
         break;
     case eImageBitDepthHalf:
+        convertCairoImageToNatronImage_noColor<Half, 1>(imgWrapper.cairoImg, srcNComps, image.get(), roi, shapeColor, opacity, inverted, useOpacityToConvert);
+        break;
     case eImageBitDepthNone:
         assert(false);
         break;
@@ -3305,6 +3332,164 @@ RotoContextPrivate::renderBezier(cairo_t* cr,
     }
 } // RotoContextPrivate::renderBezier
 
+template <typename PIX, int maxValue, int dstNComps>
+static void
+convertRotoMaskToNatronImageForDstComponents(const float* mask,
+                                             std::size_t rowStride,
+                                             const RectI& tile,
+                                             Image::WriteAccess& acc,
+                                             double shapeColor[3],
+                                             double opacity,
+                                             bool inverted)
+{
+    // Same as convertCairoImageToNatronImage_noColor with useOpacity
+    const double r = shapeColor[0] * opacity;
+    const double g = shapeColor[1] * opacity;
+    const double b = shapeColor[2] * opacity;
+
+    for (int y = tile.y1; y < tile.y2; ++y, mask += rowStride) {
+        PIX* dstPix = (PIX*)acc.pixelAt(tile.x1, y);
+        assert(dstPix);
+
+        for (int x = 0; x < tile.width(); ++x, dstPix += dstNComps) {
+            float maskPixel = !inverted ? mask[x] * maxValue : (1.f - mask[x]) * maxValue;
+            switch (dstNComps) {
+            case 4:
+                dstPix[0] = PIX(maskPixel * r);
+                dstPix[1] = PIX(maskPixel * g);
+                dstPix[2] = PIX(maskPixel * b);
+                dstPix[3] = PIX(maskPixel * opacity);
+                break;
+            case 1:
+                dstPix[0] = PIX(maskPixel * opacity);
+                break;
+            case 3:
+                dstPix[0] = PIX(maskPixel * r);
+                dstPix[1] = PIX(maskPixel * g);
+                dstPix[2] = PIX(maskPixel * b);
+                break;
+            case 2:
+                dstPix[0] = PIX(maskPixel * r);
+                dstPix[1] = PIX(maskPixel * g);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+template <typename PIX, int maxValue>
+static void
+convertRotoMaskToNatronImage(const float* mask,
+                             std::size_t rowStride,
+                             const RectI& tile,
+                             Image::WriteAccess& acc,
+                             int dstNComps,
+                             double shapeColor[3],
+                             double opacity,
+                             bool inverted)
+{
+    switch (dstNComps) {
+    case 1:
+        convertRotoMaskToNatronImageForDstComponents<PIX, maxValue, 1>(mask, rowStride, tile, acc, shapeColor, opacity, inverted);
+        break;
+    case 2:
+        convertRotoMaskToNatronImageForDstComponents<PIX, maxValue, 2>(mask, rowStride, tile, acc, shapeColor, opacity, inverted);
+        break;
+    case 3:
+        convertRotoMaskToNatronImageForDstComponents<PIX, maxValue, 3>(mask, rowStride, tile, acc, shapeColor, opacity, inverted);
+        break;
+    case 4:
+        convertRotoMaskToNatronImageForDstComponents<PIX, maxValue, 4>(mask, rowStride, tile, acc, shapeColor, opacity, inverted);
+        break;
+    default:
+        break;
+    }
+}
+
+void
+RotoContextPrivate::renderBezierMask(const Bezier* bezier,
+                                     double opacity,
+                                     double time,
+                                     double startTime, double endTime, double mbFrameStep,
+                                     unsigned int mipmapLevel,
+                                     double shapeColor[3],
+                                     bool inverted,
+                                     const RectI& roi,
+                                     Image* image)
+{
+    // One rasterizer per motion blur sample, composited over each other as with cairo
+    std::vector<RotoShapeRasterizer> samples;
+
+    ///render the bezier only if finished (closed) and activated
+    if ( bezier->isCurveFinished() && bezier->isActivated(time) && ( bezier->getControlPointsCount() > 1 ) ) {
+        for (double t = startTime; t <= endTime; t += mbFrameStep) {
+            double featherDist = bezier->getFeatherDistance(t);
+
+            ///Adjust the feather distance so it takes the mipmap level into account
+            if (mipmapLevel != 0) {
+                featherDist /= (1 << mipmapLevel);
+            }
+
+            std::list<RotoFeatherVertex> featherMesh;
+            std::vector<Point> internalContour;
+            computeFeatherTriangles(bezier, t, mipmapLevel, featherDist, &featherMesh, &internalContour);
+
+            RotoShapeRasterizer rasterizer( bezier->getFeatherFallOff(t) );
+            rasterizer.addContour(internalContour);
+            assert(featherMesh.size() % 3 == 0);
+            for (std::list<RotoFeatherVertex>::const_iterator it = featherMesh.begin(); it != featherMesh.end(); ) {
+                const RotoFeatherVertex& v0 = *it++;
+                if ( it == featherMesh.end() ) {
+                    break;
+                }
+                const RotoFeatherVertex& v1 = *it++;
+                if ( it == featherMesh.end() ) {
+                    break;
+                }
+                const RotoFeatherVertex& v2 = *it++;
+                Point p0 = {v0.x, v0.y};
+                Point p1 = {v1.x, v1.y};
+                Point p2 = {v2.x, v2.y};
+                rasterizer.addFeatherTriangle(p0, v0.isInner, p1, v1.isInner, p2, v2.isInner);
+            }
+            samples.push_back(rasterizer);
+        }
+    }
+
+    const ImageBitDepthEnum depth = image->getBitDepth();
+    const int dstNComps = (int)image->getComponentsCount();
+    Image::WriteAccess acc = image->getWriteRights();
+
+    // Each tile is rasterized and written to the image by a different thread
+    std::vector<RectI> tiles = roi.splitIntoSmallerRects( appPTR->getMaxThreadCount() );
+    QtConcurrent::map( tiles,
+                       [&](const RectI& tile) {
+        std::vector<float> mask(tile.area(), 0.f);
+        for (std::vector<RotoShapeRasterizer>::const_iterator it = samples.begin(); it != samples.end(); ++it) {
+            it->renderTile(tile, &mask[0], tile.width());
+        }
+        switch (depth) {
+        case eImageBitDepthFloat:
+            convertRotoMaskToNatronImage<float, 1>(&mask[0], tile.width(), tile, acc, dstNComps, shapeColor, opacity, inverted);
+            break;
+        case eImageBitDepthByte:
+            convertRotoMaskToNatronImage<unsigned char, 255>(&mask[0], tile.width(), tile, acc, dstNComps, shapeColor, opacity, inverted);
+            break;
+        case eImageBitDepthShort:
+            convertRotoMaskToNatronImage<unsigned short, 65535>(&mask[0], tile.width(), tile, acc, dstNComps, shapeColor, opacity, inverted);
+            break;
+        case eImageBitDepthHalf:
+            convertRotoMaskToNatronImage<Half, 1>(&mask[0], tile.width(), tile, acc, dstNComps, shapeColor, opacity, inverted);
+            break;
+        case eImageBitDepthNone:
+            assert(false);
+            break;
+        }
+    } ).waitForFinished();
+} // RotoContextPrivate::renderBezierMask
+
 void
 RotoContextPrivate::renderFeather(const Bezier* bezier,
                                   double time,
@@ -3810,11 +3995,9 @@ static void tess_intersection_combine_callback(double coords[3], void */*data*/[
 }
 
 void
-RotoContextPrivate::computeTriangles(const Bezier * bezier, double time, unsigned int mipmapLevel, double featherDist,
-                                     std::list<RotoFeatherVertex>* featherMesh,
-                                     std::list<RotoTriangleFans>* internalFans,
-                                     std::list<RotoTriangles>* internalTriangles,
-                                     std::list<RotoTriangleStrips>* internalStrips)
+RotoContextPrivate::computeFeatherTriangles(const Bezier * bezier, double time, unsigned int mipmapLevel, double featherDist,
+                                            std::list<RotoFeatherVertex>* featherMesh,
+                                            std::vector<Point>* internalContour)
 {
     ///Note that we do not use the opacity when rendering the bezier, it is rendered with correct floating point opacity/color when converting
     ///to the Natron image.
@@ -3988,6 +4171,24 @@ RotoContextPrivate::computeTriangles(const Bezier * bezier, double time, unsigne
 
     } // for all points in polygon
 
+    for (std::list<std::list<ParametricPoint> >::const_iterator it = bezierPolygon.begin(); it != bezierPolygon.end(); ++it) {
+        for (std::list<ParametricPoint>::const_iterator it2 = it->begin(); it2 != it->end(); ++it2) {
+            Point p = {it2->x, it2->y};
+            internalContour->push_back(p);
+        }
+    }
+} // RotoContextPrivate::computeFeatherTriangles
+
+void
+RotoContextPrivate::computeTriangles(const Bezier * bezier, double time, unsigned int mipmapLevel, double featherDist,
+                                     std::list<RotoFeatherVertex>* featherMesh,
+                                     std::list<RotoTriangleFans>* internalFans,
+                                     std::list<RotoTriangles>* internalTriangles,
+                                     std::list<RotoTriangleStrips>* internalStrips)
+{
+    std::vector<Point> internalContour;
+    computeFeatherTriangles(bezier, time, mipmapLevel, featherDist, featherMesh, &internalContour);
+
     // Now tessellate the internal bezier using glu
     tessPolygonData tessData;
     tessData.internalStrips = internalStrips;
@@ -4008,11 +4209,9 @@ RotoContextPrivate::computeTriangles(const Bezier * bezier, double time, unsigne
     libtess_gluTessBeginPolygon(tesselator, (void*)&tessData);
     libtess_gluTessBeginContour(tesselator);
 
-    for (std::list<std::list<ParametricPoint> >::const_iterator it = bezierPolygon.begin(); it != bezierPolygon.end(); ++it) {
-        for (std::list<ParametricPoint>::const_iterator it2 = it->begin(); it2 != it->end(); ++it2) {
-            double coords[3] = {it2->x, it2->y, 1.};
-            libtess_gluTessVertex(tesselator, coords, (void*)&(*it2) /*per-vertex client data*/);
-        }
+    for (std::vector<Point>::iterator it = internalContour.begin(); it != internalContour.end(); ++it) {
+        double coords[3] = {it->x, it->y, 1.};
+        libtess_gluTessVertex(tesselator, coords, (void*)&(*it) /*per-vertex client data*/);
     }
 
 
@@ -4023,7 +4222,7 @@ RotoContextPrivate::computeTriangles(const Bezier * bezier, double time, unsigne
     // check for errors
     assert(tessData.error == 0);
 
-} // RotoContextPrivate::computeFeatherTriangles
+} // RotoContextPrivate::computeTriangles
 
 void
 RotoContextPrivate::renderInternalShape_cairo(const std::list<RotoTriangles>& triangles,
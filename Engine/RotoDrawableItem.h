@@ -206,6 +206,13 @@ public:
                                                   const unsigned int mipmapLevel,
                                                   const RectD& rotoNodeSrcRod);
 
+    /**
+     * @brief Renders the mask of a closed Bezier shape at the given time over roi, in image, as
+     * renderMaskFromStroke() does. If useCairo is true, the shape is rendered with cairo instead of
+     * RotoShapeRasterizer: this is used to compare both.
+     **/
+    void renderShapeMask(const RectI& roi, double time, unsigned int mipmapLevel, bool useCairo, const ImagePtr& image);
+
 private:
 
     ImagePtr renderMaskInternal(const RectI & roi,
@@ -218,7 +225,8 @@ private:
                                                 const ImageBitDepthEnum depth,
                                                 const unsigned int mipmapLevel,
                                                 const std::list<std::list<std::pair<Point, double> > >& strokes,
-                                                const ImagePtr &image);
+                                                const ImagePtr &image,
+                                                const bool useCairo);
 
 Q_SIGNALS:
 
@@ -0,0 +1,326 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "RotoShapeRasterizer.h"
+
+#include <algorithm> // min, max, sort, fill
+#include <cmath>
+#include <limits>
+
+NATRON_NAMESPACE_ENTER
+
+// The number of scanlines sampled in each row of pixels to anti-alias the internal shape. The coverage of a scanline
+// is computed exactly along x.
+static const int kSubScanlinesCount = 4;
+
+// The number of intervals of the fall-off lookup table
+static const int kFallOffLutSize = 256;
+
+RotoShapeRasterizer::RotoShapeRasterizer(double fallOff)
+    : _edges()
+    , _triangles()
+    , _fallOffLut(kFallOffLutSize + 1)
+{
+    // The feather patches of renderFeather_cairo() go from the shape to the feather along a cubic bezier whose
+    // control points are on the segment, at the fractions a and b of its length, and the opacity is linear in the
+    // parameter u of that bezier: find the u of each distance to the shape.
+    double fallOff2 = std::max(0., fallOff) * std::max(0., fallOff);
+    double a = 1. / (2. * fallOff2 + 1.);
+    double b = 2. / (fallOff2 + 2.);
+
+    for (int i = 0; i <= kFallOffLutSize; ++i) {
+        double distance = (double)i / kFallOffLutSize;
+        double uMin = 0.;
+        double uMax = 1.;
+        for (int j = 0; j < 32; ++j) {
+            double u = (uMin + uMax) / 2.;
+            double v = 1. - u;
+            double s = 3. * u * v * v * a + 3. * u * u * v * b + u * u * u;
+            if (s < distance) {
+                uMin = u;
+            } else {
+                uMax = u;
+            }
+        }
+        _fallOffLut[i] = (float)( 1. - (uMin + uMax) / 2. );
+    }
+}
+
+void
+RotoShapeRasterizer::addContour(const std::vector<Point>& contour)
+{
+    std::size_t nPoints = contour.size();
+
+    for (std::size_t i = 0; i < nPoints; ++i) {
+        const Point& p = contour[i];
+        const Point& q = contour[(i + 1) % nPoints];
+        if (p.y == q.y) {
+            // horizontal edges do not cross any scanline
+            continue;
+        }
+        Edge e;
+        if (p.y < q.y) {
+            e.x0 = p.x;
+            e.y0 = p.y;
+            e.x1 = q.x;
+            e.y1 = q.y;
+            e.winding = 1;
+        } else {
+            e.x0 = q.x;
+            e.y0 = q.y;
+            e.x1 = p.x;
+            e.y1 = p.y;
+            e.winding = -1;
+        }
+        e.dxdy = (e.x1 - e.x0) / (e.y1 - e.y0);
+        _edges.push_back(e);
+    }
+}
+
+void
+RotoShapeRasterizer::addFeatherTriangle(const Point& p0,
+                                        bool isInner0,
+                                        const Point& p1,
+                                        bool isInner1,
+                                        const Point& p2,
+                                        bool isInner2)
+{
+    FeatherTriangle t;
+
+    t.x[0] = p0.x;
+    t.y[0] = p0.y;
+    t.opacity[0] = isInner0 ? 1. : 0.;
+    t.x[1] = p1.x;
+    t.y[1] = p1.y;
+    t.opacity[1] = isInner1 ? 1. : 0.;
+    t.x[2] = p2.x;
+    t.y[2] = p2.y;
+    t.opacity[2] = isInner2 ? 1. : 0.;
+
+    double det = (t.y[1] - t.y[2]) * (t.x[0] - t.x[2]) + (t.x[2] - t.x[1]) * (t.y[0] - t.y[2]);
+    if (det == 0.) {
+        // degenerated triangle, e.g when the feather distance is 0 and the feather points are the control points
+        return;
+    }
+    t.xMin = std::min( t.x[0], std::min(t.x[1], t.x[2]) );
+    t.xMax = std::max( t.x[0], std::max(t.x[1], t.x[2]) );
+    t.yMin = std::min( t.y[0], std::min(t.y[1], t.y[2]) );
+    t.yMax = std::max( t.y[0], std::max(t.y[1], t.y[2]) );
+    _triangles.push_back(t);
+}
+
+RectI
+RotoShapeRasterizer::getPixelBounds() const
+{
+    if ( _edges.empty() && _triangles.empty() ) {
+        return RectI();
+    }
+    double xMin = std::numeric_limits<double>::infinity();
+    double xMax = -std::numeric_limits<double>::infinity();
+    double yMin = std::numeric_limits<double>::infinity();
+    double yMax = -std::numeric_limits<double>::infinity();
+    for (std::vector<Edge>::const_iterator it = _edges.begin(); it != _edges.end(); ++it) {
+        xMin = std::min( xMin, std::min(it->x0, it->x1) );
+        xMax = std::max( xMax, std::max(it->x0, it->x1) );
+        yMin = std::min(yMin, it->y0);
+        yMax = std::max(yMax, it->y1);
+    }
+    for (std::vector<FeatherTriangle>::const_iterator it = _triangles.begin(); it != _triangles.end(); ++it) {
+        xMin = std::min(xMin, it->xMin);
+        xMax = std::max(xMax, it->xMax);
+        yMin = std::min(yMin, it->yMin);
+        yMax = std::max(yMax, it->yMax);
+    }
+
+    return RectI( (int)std::floor(xMin), (int)std::floor(yMin), (int)std::ceil(xMax) + 1, (int)std::ceil(yMax) + 1 );
+}
+
+double
+RotoShapeRasterizer::getFeatherOpacity(double distance) const
+{
+    double index = std::max( 0., std::min(1., distance) ) * kFallOffLutSize;
+    int i = std::min( (int)index, kFallOffLutSize - 1 );
+    double f = index - i;
+    double opacity = _fallOffLut[i] * (1. - f) + _fallOffLut[i + 1] * f;
+
+    return opacity * opacity;
+}
+
+// Adds weight times the coverage of the span [xa, xb) to the pixels x1 to x2 of a row
+static inline void
+addSpanCoverage(double xa,
+                double xb,
+                int x1,
+                int x2,
+                float weight,
+                float* fill)
+{
+    xa = std::max(xa, (double)x1);
+    xb = std::min(xb, (double)x2);
+    if (xa >= xb) {
+        return;
+    }
+    int ia = (int)std::floor(xa);
+    int ib = (int)std::floor(xb);
+    if (ia == ib) {
+        fill[ia - x1] += weight * (float)(xb - xa);
+
+        return;
+    }
+    fill[ia - x1] += weight * (float)(ia + 1 - xa);
+    for (int i = ia + 1; i < ib; ++i) {
+        fill[i - x1] += weight;
+    }
+    if (ib < x2) {
+        fill[ib - x1] += weight * (float)(xb - ib);
+    }
+}
+
+void
+RotoShapeRasterizer::renderRowFill(const std::vector<const Edge*>& edges,
+                                   int y,
+                                   int x1,
+                                   int x2,
+                                   std::vector<std::pair<double, int> >* crossings,
+                                   float* fill) const
+{
+    const float weight = 1.f / kSubScanlinesCount;
+
+    for (int s = 0; s < kSubScanlinesCount; ++s) {
+        double yc = y + (s + 0.5) / kSubScanlinesCount;
+        crossings->clear();
+        for (std::vector<const Edge*>::const_iterator it = edges.begin(); it != edges.end(); ++it) {
+            const Edge& e = **it;
+            if ( (e.y0 <= yc) && (yc < e.y1) ) {
+                crossings->push_back( std::make_pair(e.x0 + (yc - e.y0) * e.dxdy, e.winding) );
+            }
+        }
+        if ( crossings->empty() ) {
+            continue;
+        }
+        std::sort( crossings->begin(), crossings->end() );
+
+        // non-zero winding rule
+        int winding = 0;
+        double spanStart = 0.;
+        for (std::vector<std::pair<double, int> >::const_iterator it = crossings->begin(); it != crossings->end(); ++it) {
+            int prevWinding = winding;
+            winding += it->second;
+            if ( (prevWinding == 0) && (winding != 0) ) {
+                spanStart = it->first;
+            } else if ( (prevWinding != 0) && (winding == 0) ) {
+                addSpanCoverage(spanStart, it->first, x1, x2, weight, fill);
+            }
+        }
+        if (winding != 0) {
+            // the edges on the right of the row were not kept
+            addSpanCoverage(spanStart, x2, x1, x2, weight, fill);
+        }
+    }
+}
+
+void
+RotoShapeRasterizer::renderRowFeather(const std::vector<const FeatherTriangle*>& triangles,
+                                      int y,
+                                      int x1,
+                                      int x2,
+                                      float* feather) const
+{
+    // The triangles are sampled at the center of the pixels, as the cairo meshes
+    const double py = y + 0.5;
+
+    for (std::vector<const FeatherTriangle*>::const_iterator it = triangles.begin(); it != triangles.end(); ++it) {
+        const FeatherTriangle& t = **it;
+        if ( (py < t.yMin) || (py > t.yMax) ) {
+            continue;
+        }
+        int xStart = std::max( x1, (int)std::floor(t.xMin) );
+        int xEnd = std::min( x2, (int)std::ceil(t.xMax) + 1 );
+        double det = (t.y[1] - t.y[2]) * (t.x[0] - t.x[2]) + (t.x[2] - t.x[1]) * (t.y[0] - t.y[2]);
+        for (int x = xStart; x < xEnd; ++x) {
+            double px = x + 0.5;
+            // barycentric coordinates
+            double l0 = ( (t.y[1] - t.y[2]) * (px - t.x[2]) + (t.x[2] - t.x[1]) * (py - t.y[2]) ) / det;
+            double l1 = ( (t.y[2] - t.y[0]) * (px - t.x[2]) + (t.x[0] - t.x[2]) * (py - t.y[2]) ) / det;
+            double l2 = 1. - l0 - l1;
+            if ( (l0 < 0.) || (l1 < 0.) || (l2 < 0.) ) {
+                continue;
+            }
+            double innerOpacity = l0 * t.opacity[0] + l1 * t.opacity[1] + l2 * t.opacity[2];
+            float opacity = (float)getFeatherOpacity(1. - innerOpacity);
+            float& dst = feather[x - x1];
+            dst = std::max(dst, opacity);
+        }
+    }
+}
+
+void
+RotoShapeRasterizer::renderTile(const RectI& tile,
+                                float* mask,
+                                std::size_t rowStride) const
+{
+    if ( tile.isNull() ) {
+        return;
+    }
+
+    // The edges and triangles crossing the tile: the edges on the right of the tile do not change the winding of
+    // its pixels
+    std::vector<const Edge*> edges;
+    for (std::vector<Edge>::const_iterator it = _edges.begin(); it != _edges.end(); ++it) {
+        if ( (it->y1 > tile.y1) && (it->y0 < tile.y2) && (std::min(it->x0, it->x1) < tile.x2) ) {
+            edges.push_back(&*it);
+        }
+    }
+    std::vector<const FeatherTriangle*> triangles;
+    for (std::vector<FeatherTriangle>::const_iterator it = _triangles.begin(); it != _triangles.end(); ++it) {
+        if ( (it->yMax >= tile.y1) && (it->yMin <= tile.y2) && (it->xMax >= tile.x1) && (it->xMin <= tile.x2) ) {
+            triangles.push_back(&*it);
+        }
+    }
+    if ( edges.empty() && triangles.empty() ) {
+        return;
+    }
+
+    const int width = tile.width();
+    std::vector<float> fill(width);
+    std::vector<float> feather(width);
+    std::vector<std::pair<double, int> > crossings;
+    for (int y = tile.y1; y < tile.y2; ++y) {
+        std::fill(fill.begin(), fill.end(), 0.f);
+        std::fill(feather.begin(), feather.end(), 0.f);
+        renderRowFill(edges, y, tile.x1, tile.x2, &crossings, &fill[0]);
+        renderRowFeather(triangles, y, tile.x1, tile.x2, &feather[0]);
+
+        // The internal shape is painted first, then the feather over it
+        float* dst = mask + (y - tile.y1) * rowStride;
+        for (int x = 0; x < width; ++x) {
+            float shape = std::min(fill[x], 1.f);
+            float m = shape + feather[x] * (1.f - shape);
+            dst[x] = m + dst[x] * (1.f - m);
+        }
+    }
+} // RotoShapeRasterizer::renderTile
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,116 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_RotoShapeRasterizer_h
+#define Natron_Engine_RotoShapeRasterizer_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/RectI.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Scanline rasterizer of the mask of a closed roto shape at one time: the internal shape is a polygon filled
+ * with the non-zero winding rule and anti-aliased, and the feather is a mesh of triangles going from the shape
+ * (opacity 1) to the feather points (opacity 0) with the fall-off of the shape.
+ * The mask is the same as the one cairo renders from the mesh patterns of RotoContextPrivate::renderFeather_cairo():
+ * the feather opacity is squared because the mesh pattern was both the source and the mask of the cairo context.
+ * Once the shape is added, renderTile() may be called concurrently on different tiles.
+ **/
+class RotoShapeRasterizer
+{
+    struct Edge
+    {
+        // y0 < y1
+        double x0, y0, x1, y1;
+        double dxdy;
+
+        // 1 if the contour goes down, -1 if it goes up
+        int winding;
+    };
+
+    struct FeatherTriangle
+    {
+        double x[3], y[3];
+
+        // 1 for the vertices on the shape, 0 for the vertices on the feather
+        double opacity[3];
+        double xMin, xMax, yMin, yMax;
+    };
+
+public:
+
+    explicit RotoShapeRasterizer(double fallOff);
+
+    /**
+     * @brief Adds a closed contour of the internal shape, in pixel coordinates.
+     **/
+    void addContour(const std::vector<Point>& contour);
+
+    /**
+     * @brief Adds a triangle of the feather mesh. isInner is true for a vertex on the shape, false for a vertex on
+     * the feather.
+     **/
+    void addFeatherTriangle(const Point& p0, bool isInner0,
+                            const Point& p1, bool isInner1,
+                            const Point& p2, bool isInner2);
+
+    /**
+     * @brief The pixels which may not be zero in the mask
+     **/
+    RectI getPixelBounds() const;
+
+    /**
+     * @brief Composites the mask of the shape over the mask of the pixels of tile: the value of the pixel (x, y)
+     * is mask[(y - tile.y1) * rowStride + x - tile.x1], in [0, 1].
+     **/
+    void renderTile(const RectI& tile, float* mask, std::size_t rowStride) const;
+
+private:
+
+    double getFeatherOpacity(double distance) const;
+
+    void renderRowFill(const std::vector<const Edge*>& edges, int y, int x1, int x2,
+                       std::vector<std::pair<double, int> >* crossings, float* fill) const;
+
+    void renderRowFeather(const std::vector<const FeatherTriangle*>& triangles, int y, int x1, int x2, float* feather) const;
+
+    std::vector<Edge> _edges;
+    std::vector<FeatherTriangle> _triangles;
+
+    // The feather opacity, indexed by the distance to the shape divided by the feather distance
+    std::vector<float> _fallOffLut;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_RotoShapeRasterizer_h
@@ -207,6 +207,16 @@ Settings::initializeKnobsGeneral()
                                       "last saved), *.~2~ (third last saved).") );
     _generalTab->addKnob(_saveVersions);
 
+    _binaryProjectFormat = AppManager::createKnob<KnobBool>( this, tr("Save projects in binary format") );
+    _binaryProjectFormat->setName("binaryProjectFormat");
+    _binaryProjectFormat->setHintToolTip( tr("When checked, projects and auto-saves are written in a compact binary format "
+                                             "which is much faster to load and save than the default XML format "
+                                             "for projects with many nodes and keyframes.\n"
+                                             "Binary projects can be opened regardless of this setting, but not by versions of %1 "
+                                             "prior to this one, nor by a build for a different architecture. "
+                                             "Use \"%1Renderer --convert-project\" to convert a project between the two formats.").arg( QString::fromUtf8(NATRON_APPLICATION_NAME) ) );
+    _generalTab->addKnob(_binaryProjectFormat);
+
     _hostName = AppManager::createKnob<KnobChoice>( this, tr("Appear to plug-ins as") );
     _hostName->setName("pluginHostName");
     _hostName->setHintToolTip( tr("%1 will appear with the name of the selected application to the OpenFX plug-ins. "
@@ -351,6 +361,14 @@ Settings::initializeKnobsThreading()
                                       "other prior tasks are done.") );
     _queueRenders->setName("queueRenders");
     _threadingPage->addKnob(_queueRenders);
+
+    _renderWritersTogether = AppManager::createKnob<KnobBool>( this, tr("Render writers sharing nodes in a single pass") );
+    _renderWritersTogether->setHintToolTip( tr("When checked, Write nodes rendered together in the background (e.g. from the command line) "
+                                               "over the same frame range and sharing nodes upstream are rendered in a single pass: "
+                                               "each frame of the shared nodes is rendered once for all of them instead of once per Write node. "
+                                               "This only applies to single-view projects rendered in the main process.") );
+    _renderWritersTogether->setName("renderWritersTogether");
+    _threadingPage->addKnob(_renderWritersTogether);
 } // Settings::initializeKnobsThreading
 
 void
@@ -1078,6 +1096,15 @@ Settings::initializeKnobsViewers()
                                       "Hover each option with the mouse for a detailed description.") );
     _viewersTab->addKnob(_texturesMode);
 
+    _linearViewerCache = AppManager::createKnob<KnobBool>( this, tr("Cache 8-bit viewer textures as linear") );
+    _linearViewerCache->setName("linearViewerCache");
+    _linearViewerCache->setHintToolTip( tr("When checked and the viewer textures bit depth is 8-bit, the viewer caches "
+                                           "linear floating-point textures which do not depend on the gain, gamma and "
+                                           "colorspace of the viewer. These are applied by the CPU when the texture is "
+                                           "displayed, so that changing them on a cached frame range does not render "
+                                           "the frames again. The size of cached textures is 4 times larger.") );
+    _viewersTab->addKnob(_linearViewerCache);
+
     _powerOf2Tiling = AppManager::createKnob<KnobInt>( this, tr("Viewer tile size is 2 to the power of...") );
     _powerOf2Tiling->setName("viewerTiling");
     _powerOf2Tiling->setHintToolTip( tr("The dimension of the viewer tiles is 2^n by 2^n (i.e. 256 by 256 pixels for n=8). "
@@ -1158,6 +1185,18 @@ Settings::initializeKnobsViewers()
                                             "displayed only for the render path for the current viewer "
                                             "inputs.") );
     _viewersTab->addKnob(_viewerOverlaysPath);
+
+    _viewerPrefetchFrames = AppManager::createKnob<KnobInt>( this, tr("Frames prefetched around the playhead") );
+    _viewerPrefetchFrames->setName("viewerPrefetchFrames");
+    _viewerPrefetchFrames->setMinimum(0);
+    _viewerPrefetchFrames->setMaximum(1000);
+    _viewerPrefetchFrames->disableSlider();
+    _viewerPrefetchFrames->setHintToolTip( tr("When greater than 0, the threads left idle by the viewer render the frames after the playhead "
+                                              "(in the playback direction) into the viewer cache, up to this number of frames, and the half of it "
+                                              "before the playhead, so that scrubbing and playback display them from the cache. "
+                                              "The closest frames are rendered first, frames ahead before frames behind. Moving the playhead "
+                                              "only changes the order of the remaining frames, while modifying the graph cancels the prefetch.") );
+    _viewersTab->addKnob(_viewerPrefetchFrames);
 } // Settings::initializeKnobsViewers
 
 void
@@ -1279,6 +1318,32 @@ Settings::initializeKnobsCaching()
     _unreachableRAMLabel->setAsLabel();
     _cachingTab->addKnob(_unreachableRAMLabel);
 
+    _compressedNodeCachePercent = AppManager::createKnob<KnobInt>( this, tr("Compressed node cache (% of the RAM used for caching)") );
+    _compressedNodeCachePercent->setName("compressedNodeCachePercent");
+    _compressedNodeCachePercent->disableSlider();
+    _compressedNodeCachePercent->setMinimum(0);
+    _compressedNodeCachePercent->setMaximum(90);
+    _compressedNodeCachePercent->setHintToolTip( tr("The images evicted from the node cache when it is full are kept "
+                                                    "compressed in RAM in this portion of the cache, instead of being "
+                                                    "deleted, and are decompressed when they are needed again. "
+                                                    "Lossless compression of floating point images saves typically "
+                                                    "between 20% and 50% of their size, so that more frames are "
+                                                    "held in the same amount of RAM, at the cost of the compression "
+                                                    "done by a background thread.\n"
+                                                    "Set to 0 to disable the compressed portion.") );
+    _cachingTab->addKnob(_compressedNodeCachePercent);
+
+    _nodeCacheHalfFloat = AppManager::createKnob<KnobBool>( this, tr("Cache floating point images as half float") );
+    _nodeCacheHalfFloat->setName("nodeCacheHalfFloat");
+    _nodeCacheHalfFloat->setHintToolTip( tr("When checked, the 32-bit floating point images rendered by the nodes "
+                                            "are stored in the node cache as 16-bit half floats, as in OpenEXR half "
+                                            "files, and converted back to 32-bit when they are read. "
+                                            "This halves the RAM used by the cache and the memory bandwidth of "
+                                            "the renders, so that twice as many frames can be cached, at the cost "
+                                            "of the precision: half floats have 11 significant bits, and "
+                                            "values above 65504 become infinite.") );
+    _cachingTab->addKnob(_nodeCacheHalfFloat);
+
     _maxViewerDiskCacheGB = AppManager::createKnob<KnobInt>( this, tr("Maximum playback disk cache size (GiB)") );
     _maxViewerDiskCacheGB->setName("maxViewerDiskCache");
     _maxViewerDiskCacheGB->disableSlider();
@@ -1287,6 +1352,18 @@ Settings::initializeKnobsCaching()
     _maxViewerDiskCacheGB->setHintToolTip( tr("The maximum size that may be used by the playback cache on disk (in GiB)") );
     _cachingTab->addKnob(_maxViewerDiskCacheGB);
 
+    _viewerCachePrefetchDepth = AppManager::createKnob<KnobInt>( this, tr("Playback disk cache read-ahead (frames)") );
+    _viewerCachePrefetchDepth->setName("viewerCachePrefetchDepth");
+    _viewerCachePrefetchDepth->disableSlider();
+    _viewerCachePrefetchDepth->setMinimum(0);
+    _viewerCachePrefetchDepth->setMaximum(100);
+    _viewerCachePrefetchDepth->setHintToolTip( tr("During playback, the frames of the playback cache stored on disk that are "
+                                                  "about to be displayed are read in advance by a background thread, "
+                                                  "so that playing back a cached range from disk does not stutter. "
+                                                  "This is the number of frames read ahead of the current frame. "
+                                                  "Set to 0 to disable reading ahead.") );
+    _cachingTab->addKnob(_viewerCachePrefetchDepth);
+
     _maxDiskCacheNodeGB = AppManager::createKnob<KnobInt>( this, tr("Maximum DiskCache node disk usage (GiB)") );
     _maxDiskCacheNodeGB->setName("maxDiskCacheNode");
     _maxDiskCacheNodeGB->disableSlider();
@@ -1295,6 +1372,39 @@ Settings::initializeKnobsCaching()
     _maxDiskCacheNodeGB->setHintToolTip( tr("The maximum size that may be used by the DiskCache node on disk (in GiB)") );
     _cachingTab->addKnob(_maxDiskCacheNodeGB);
 
+    _cacheShards = AppManager::createKnob<KnobInt>( this, tr("Number of cache shards") );
+    _cacheShards->setName("cacheShards");
+    _cacheShards->disableSlider();
+    _cacheShards->setMinimum(1);
+    _cacheShards->setMaximum(256);
+    _cacheShards->setHintToolTip( tr("WARNING: Changing this parameter requires a restart of the application. \n"
+                                     "The caches are split in this number of portions which can be accessed "
+                                     "concurrently by the render threads. Setting it to a value close to the "
+                                     "number of cores reduces the time render threads spend waiting on each other "
+                                     "on machines with many cores. When set to 1, the least recently used entries "
+                                     "of the whole cache are evicted first, otherwise eviction starts with the "
+                                     "portions holding the most data.") );
+    _cachingTab->addKnob(_cacheShards);
+
+    _contentBasedNodeHash = AppManager::createKnob<KnobBool>( this, tr("Identify cached images by parameter values") );
+    _contentBasedNodeHash->setName("contentBasedNodeHash");
+    _contentBasedNodeHash->setHintToolTip( tr("When checked, the images cached for a node are identified by the values, "
+                                              "animation curves and expressions of its parameters instead of by the number "
+                                              "of changes made to them. Setting back a parameter to a previous value "
+                                              "(e.g. by toggling a checkbox or by undoing a change) then re-uses the images "
+                                              "that were rendered with that value instead of rendering them again.") );
+    _cachingTab->addKnob(_contentBasedNodeHash);
+
+    _nodeCacheVariantsCount = AppManager::createKnob<KnobInt>( this, tr("Cached variants per node") );
+    _nodeCacheVariantsCount->setName("nodeCacheVariants");
+    _nodeCacheVariantsCount->disableSlider();
+    _nodeCacheVariantsCount->setMinimum(1);
+    _nodeCacheVariantsCount->setMaximum(64);
+    _nodeCacheVariantsCount->setHintToolTip( tr("When parameter values identify cached images, this is the number of "
+                                                "different sets of parameter values for which the images of a node are kept "
+                                                "in the caches. Images rendered with older values are removed from the caches.") );
+    _cachingTab->addKnob(_nodeCacheVariantsCount);
+
 
     _diskCachePath = AppManager::createKnob<KnobPath>( this, tr("Disk cache path") );
     _diskCachePath->setName("diskCachePath");
@@ -1469,6 +1579,7 @@ Settings::setDefaultValues()
     _autoSaveUnSavedProjects->setDefaultValue(true);
     _autoSaveDelay->setDefaultValue(5, 0);
     _saveVersions->setDefaultValue(1);
+    _binaryProjectFormat->setDefaultValue(false);
     _hostName->setDefaultValue(0);
     _customHostName->setDefaultValue(NATRON_ORGANIZATION_DOMAIN_TOPLEVEL "." NATRON_ORGANIZATION_DOMAIN_SUB "." NATRON_APPLICATION_NAME);
 
@@ -1481,6 +1592,7 @@ Settings::setDefaultValues()
     _nThreadsPerEffect->setDefaultValue(0);
     _renderInSeparateProcess->setDefaultValue(false, 0);
     _queueRenders->setDefaultValue(false);
+    _renderWritersTogether->setDefaultValue(true);
 
     // General/Rendering
     _convertNaNValues->setDefaultValue(true);
@@ -1534,13 +1646,20 @@ Settings::setDefaultValues()
     _aggressiveCaching->setDefaultValue(false);
     _maxRAMPercent->setDefaultValue(50, 0);
     _unreachableRAMPercent->setDefaultValue(20); // see https://github.com/NatronGitHub/Natron/issues/486
+    _compressedNodeCachePercent->setDefaultValue(0);
+    _nodeCacheHalfFloat->setDefaultValue(false);
     _maxViewerDiskCacheGB->setDefaultValue(5, 0);
+    _viewerCachePrefetchDepth->setDefaultValue(8);
     _maxDiskCacheNodeGB->setDefaultValue(10, 0);
+    _cacheShards->setDefaultValue(1);
+    _contentBasedNodeHash->setDefaultValue(false);
+    _nodeCacheVariantsCount->setDefaultValue(4);
     //_diskCachePath
     setCachingLabels();
 
     // Viewer
     _texturesMode->setDefaultValue(0, 0);
+    _linearViewerCache->setDefaultValue(false);
     _powerOf2Tiling->setDefaultValue(8, 0);
     _checkerboardTileSize->setDefaultValue(5);
     _checkerboardColor1->setDefaultValue(0.5, 0);
@@ -1557,6 +1676,7 @@ Settings::setDefaultValues()
     _maximumNodeViewerUIOpened->setDefaultValue(2);
     _viewerNumberKeys->setDefaultValue(true);
     _viewerOverlaysPath->setDefaultValue(true);
+    _viewerPrefetchFrames->setDefaultValue(0);
 
     // Nodegraph
     _autoScroll->setDefaultValue(false);
@@ -1784,7 +1904,7 @@ Settings::warnChangedKnobs(const std::vector<KnobI*>& knobs)
                     saveSetting( _warnOcioConfigKnobChanged.get() );
                 }
             }
-        } else if ( knobs[i] == _texturesMode.get() ) {
+        } else if ( ( knobs[i] == _texturesMode.get() ) || ( knobs[i] == _linearViewerCache.get() ) ) {
             AppInstanceVec apps = appPTR->getAppInstances();
             for (AppInstanceVec::iterator it = apps.begin(); it != apps.end(); ++it) {
                 std::list<ViewerInstance*> allViewers;
@@ -2289,6 +2409,10 @@ Settings::onKnobValueChanged(KnobI* k,
             appPTR->setApplicationsCachesMaximumMemoryPercent( getRamMaximumPercent() );
         }
         setCachingLabels();
+    } else if ( k == _compressedNodeCachePercent.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setApplicationsCachesMaximumMemoryPercent( getRamMaximumPercent() );
+        }
     } else if ( k == _diskCachePath.get() ) {
         QString path = QString::fromUtf8(_diskCachePath->getValue().c_str());
         qputenv(NATRON_DISK_CACHE_PATH_ENV_VAR, path.toUtf8());
@@ -2442,6 +2566,12 @@ Settings::getViewersBitDepth() const
     }
 }
 
+bool
+Settings::isLinearViewerCacheEnabled() const
+{
+    return _linearViewerCache->getValue();
+}
+
 int
 Settings::getViewerTilesPowerOf2() const
 {
@@ -2514,6 +2644,12 @@ Settings::viewerOverlaysPath() const
     return _viewerOverlaysPath->getValue();
 }
 
+int
+Settings::getViewerPrefetchFramesCount() const
+{
+    return _viewerPrefetchFrames->getValue();
+}
+
 ///////////////////////////////////////////////////////
 // "Caching" pane
 
@@ -2523,12 +2659,24 @@ Settings::isAggressiveCachingEnabled() const
     return _aggressiveCaching->getValue();
 }
 
+bool
+Settings::isNodeCacheHalfFloatEnabled() const
+{
+    return _nodeCacheHalfFloat->getValue();
+}
+
 double
 Settings::getRamMaximumPercent() const
 {
     return (double)_maxRAMPercent->getValue() / 100.;
 }
 
+double
+Settings::getCompressedNodeCachePercent() const
+{
+    return (double)_compressedNodeCachePercent->getValue() / 100.;
+}
+
 U64
 Settings::getMaximumViewerDiskCacheSize() const
 {
@@ -2541,6 +2689,30 @@ Settings::getMaximumDiskCacheNodeSize() const
     return (U64)( _maxDiskCacheNodeGB->getValue() ) * 1024 * 1024 * 1024;
 }
 
+int
+Settings::getViewerCachePrefetchDepth() const
+{
+    return _viewerCachePrefetchDepth->getValue();
+}
+
+int
+Settings::getCacheShardsCount() const
+{
+    return _cacheShards->getValue();
+}
+
+bool
+Settings::isContentBasedNodeHashEnabled() const
+{
+    return _contentBasedNodeHash->getValue();
+}
+
+int
+Settings::getNodeCacheVariantsCount() const
+{
+    return _nodeCacheVariantsCount->getValue();
+}
+
 ///////////////////////////////////////////////////
 
 double
@@ -2912,6 +3084,12 @@ Settings::saveVersions() const
     return _saveVersions->getValue();
 }
 
+bool
+Settings::isBinaryProjectFormatEnabled() const
+{
+    return _binaryProjectFormat->getValue();
+}
+
 
 bool
 Settings::isSnapToNodeEnabled() const
@@ -3845,6 +4023,12 @@ Settings::isRenderQueuingEnabled() const
     return _queueRenders->getValue();
 }
 
+bool
+Settings::isRenderWritersTogetherEnabled() const
+{
+    return _renderWritersTogether->getValue();
+}
+
 bool
 Settings::isFileDialogEnabledForNewWriters() const
 {
@@ -107,10 +107,20 @@ public:
 
     double getRamMaximumPercent() const;
 
+    double getCompressedNodeCachePercent() const;
+
     U64 getMaximumViewerDiskCacheSize() const;
 
+    int getViewerCachePrefetchDepth() const;
+
     U64 getMaximumDiskCacheNodeSize() const;
 
+    int getCacheShardsCount() const;
+
+    bool isContentBasedNodeHashEnabled() const;
+
+    int getNodeCacheVariantsCount() const;
+
     double getUnreachableRamPercent() const;
 
     bool getColorPickerLinear() const;
@@ -171,6 +181,8 @@ public:
 
     void setRenderQueuingEnabled(bool enabled);
 
+    bool isRenderWritersTogetherEnabled() const;
+
     void restoreDefault();
 
     int getMaximumUndoRedoNodeGraph() const;
@@ -181,6 +193,8 @@ public:
 
     int saveVersions() const;
 
+    bool isBinaryProjectFormatEnabled() const;
+
     bool isSnapToNodeEnabled() const;
 
     bool isCheckForUpdatesEnabled() const;
@@ -246,6 +260,7 @@ public:
     ///////////////////////////////////////////////////////
     // "Viewers" pane
     ImageBitDepthEnum getViewersBitDepth() const;
+    bool isLinearViewerCacheEnabled() const;
     int getViewerTilesPowerOf2() const;
     int getCheckerboardTileSize() const;
     void getCheckerboardColor1(double* r, double* g, double* b, double* a) const;
@@ -256,6 +271,11 @@ public:
     int getMaxOpenedNodesViewerContext() const;
     bool viewerNumberKeys() const;
     bool viewerOverlaysPath() const;
+
+    /**
+     * @brief Number of frames the viewer prefetcher renders ahead of the playhead, 0 if prefetching is disabled
+     **/
+    int getViewerPrefetchFramesCount() const;
     ///////////////////////////////////////////////////////
 
     bool areRGBPixelComponentsSupported() const;
@@ -280,6 +300,8 @@ public:
 
     bool isAggressiveCachingEnabled() const;
 
+    bool isNodeCacheHalfFloatEnabled() const;
+
     bool isAutoTurboEnabled() const;
 
     void setAutoTurboModeEnabled(bool e);
@@ -434,6 +456,7 @@ private:
     KnobBoolPtr _autoSaveUnSavedProjects;
     KnobIntPtr _autoSaveDelay;
     KnobIntPtr _saveVersions;
+    KnobBoolPtr _binaryProjectFormat;
     KnobChoicePtr _hostName;
     KnobStringPtr _customHostName;
 
@@ -445,6 +468,8 @@ private:
     KnobIntPtr _nThreadsPerEffect;
     KnobBoolPtr _renderInSeparateProcess;
     KnobBoolPtr _queueRenders;
+    /// Render the writers sharing upstream nodes in a single pass, see AppInstance::startWritersRendering()
+    KnobBoolPtr _renderWritersTogether;
 
     // General/Rendering
     KnobPagePtr _renderingPage;
@@ -520,15 +545,32 @@ private:
     KnobIntPtr _unreachableRAMPercent;
     KnobStringPtr _unreachableRAMLabel;
 
+    ///The percentage of the node cache RAM in which the images evicted from the node cache are kept compressed
+    KnobIntPtr _compressedNodeCachePercent;
+
+    ///When checked, the 32-bit floating point images of the node cache are stored as 16-bit half floats
+    KnobBoolPtr _nodeCacheHalfFloat;
+
     ///The total disk space allowed for all Natron's caches
     KnobIntPtr _maxViewerDiskCacheGB;
     KnobIntPtr _maxDiskCacheNodeGB;
+
+    ///How many frames of the playback disk cache are read ahead during playback
+    KnobIntPtr _viewerCachePrefetchDepth;
+
+    ///In how many independently locked portions the caches are split
+    KnobIntPtr _cacheShards;
+
+    ///Whether nodes hash the values of their parameters rather than their age, and how many hashes are kept in the caches
+    KnobBoolPtr _contentBasedNodeHash;
+    KnobIntPtr _nodeCacheVariantsCount;
     KnobPathPtr _diskCachePath;
     KnobButtonPtr _wipeDiskCache;
 
     // Viewer
     KnobPagePtr _viewersTab;
     KnobChoicePtr _texturesMode;
+    KnobBoolPtr _linearViewerCache;
     KnobIntPtr _powerOf2Tiling;
     KnobIntPtr _checkerboardTileSize;
     KnobColorPtr _checkerboardColor1;
@@ -539,6 +581,7 @@ private:
     KnobIntPtr _maximumNodeViewerUIOpened;
     KnobBoolPtr _viewerNumberKeys;
     KnobBoolPtr _viewerOverlaysPath;
+    KnobIntPtr _viewerPrefetchFrames;
 
     // Nodegraph
     KnobPagePtr _nodegraphTab;
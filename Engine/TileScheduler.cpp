@@ -0,0 +1,338 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "TileScheduler.h"
+
+#include <algorithm> // min, max
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <list>
+#include <vector>
+
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#ifdef DEBUG
+#include "Global/FloatingPointExceptions.h"
+#endif
+#include "Engine/AppManager.h"
+#include "Engine/ThreadPool.h"
+
+NATRON_NAMESPACE_ENTER
+
+struct TileSchedulerJob
+{
+    std::function<void(int)> func;
+    int nTasks;
+
+    // Index of the next task to execute: the calling thread and the thieves all claim tasks from it
+    std::atomic<int> nextTask;
+
+    // Number of tasks not yet finished
+    std::atomic<int> remainingTasks;
+
+    QMutex doneMutex; //< protects exception
+    QWaitCondition doneCond;
+    std::exception_ptr exception; //< the first exception thrown by a task
+
+    TileSchedulerJob(int nTasks,
+                     const std::function<void(int)>& func)
+        : func(func)
+        , nTasks(nTasks)
+        , nextTask(0)
+        , remainingTasks(nTasks)
+        , doneMutex()
+        , doneCond()
+        , exception()
+    {
+    }
+
+    /**
+     * @brief Claims the next task of the job, returns false if all tasks were claimed already.
+     **/
+    bool claimTask(int* index)
+    {
+        if (nextTask.load(std::memory_order_relaxed) >= nTasks) {
+            return false;
+        }
+        *index = nextTask.fetch_add(1);
+
+        return *index < nTasks;
+    }
+
+    bool hasTasksLeft() const
+    {
+        return nextTask.load(std::memory_order_relaxed) < nTasks;
+    }
+
+    void executeTask(int index)
+    {
+        try {
+            func(index);
+        } catch (...) {
+            QMutexLocker k(&doneMutex);
+            if (!exception) {
+                exception = std::current_exception();
+            }
+        }
+        if (remainingTasks.fetch_sub(1) == 1) {
+            QMutexLocker k(&doneMutex);
+            doneCond.wakeAll();
+        }
+    }
+};
+
+typedef std::shared_ptr<TileSchedulerJob> TileSchedulerJobPtr;
+
+class TileSchedulerThread;
+
+struct TileSchedulerPrivate
+{
+    mutable QMutex jobsMutex; //< protects jobs, threads and mustQuit
+    QWaitCondition jobsCond;
+
+    // The jobs that still have tasks to claim, in submission order
+    std::list<TileSchedulerJobPtr> jobs;
+    std::vector<TileSchedulerThread*> threads;
+    bool mustQuit;
+
+    // Workers with an index greater or equal to this do not steal work
+    std::atomic<int> nAllowedWorkers;
+
+    TileSchedulerPrivate()
+        : jobsMutex()
+        , jobsCond()
+        , jobs()
+        , threads()
+        , mustQuit(false)
+        , nAllowedWorkers(0)
+    {
+    }
+
+    /**
+     * @brief Returns the newest job which still has tasks to claim. Must be called with jobsMutex locked.
+     * The newest job is the deepest nested render, which the threads up the stack are waiting on.
+     **/
+    TileSchedulerJobPtr findJobToSteal() const
+    {
+        for (std::list<TileSchedulerJobPtr>::const_reverse_iterator it = jobs.rbegin(); it != jobs.rend(); ++it) {
+            if ( (*it)->hasTasksLeft() ) {
+                return *it;
+            }
+        }
+
+        return TileSchedulerJobPtr();
+    }
+
+    void startWorkers(int nWorkers);
+
+    void workerLoop(int workerIndex);
+};
+
+class TileSchedulerThread
+    : public QThread
+      , public AbortableThread
+{
+public:
+
+    TileSchedulerThread(TileSchedulerPrivate* imp,
+                        int workerIndex)
+        : QThread()
+        , AbortableThread(this)
+        , _imp(imp)
+        , _workerIndex(workerIndex)
+    {
+        setObjectName( QString::fromUtf8("TileScheduler") );
+        setThreadName("Tile scheduler");
+    }
+
+    virtual ~TileSchedulerThread() {}
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+#ifdef DEBUG
+        boost_adaptbx::floating_point::exception_trapping trap(boost_adaptbx::floating_point::exception_trapping::division_by_zero |
+                                                               boost_adaptbx::floating_point::exception_trapping::invalid |
+                                                               boost_adaptbx::floating_point::exception_trapping::overflow);
+#endif
+        _imp->workerLoop(_workerIndex);
+    }
+
+    TileSchedulerPrivate* _imp;
+    int _workerIndex;
+};
+
+void
+TileSchedulerPrivate::startWorkers(int nWorkers)
+{
+    // Called with jobsMutex locked
+    while ( (int)threads.size() < nWorkers ) {
+        TileSchedulerThread* thread = new TileSchedulerThread( this, (int)threads.size() );
+        threads.push_back(thread);
+        thread->start();
+    }
+}
+
+void
+TileSchedulerPrivate::workerLoop(int workerIndex)
+{
+    for (;;) {
+        TileSchedulerJobPtr job;
+        {
+            QMutexLocker k(&jobsMutex);
+            for (;;) {
+                if (mustQuit) {
+                    return;
+                }
+                if ( workerIndex < nAllowedWorkers.load() ) {
+                    job = findJobToSteal();
+                    if (job) {
+                        break;
+                    }
+                }
+                jobsCond.wait(&jobsMutex);
+            }
+        }
+
+        // Drain the job without taking the jobs lock again
+        appPTR->fetchAndAddNRunningThreads(1);
+        int index;
+        while ( job->claimTask(&index) ) {
+            job->executeTask(index);
+        }
+        appPTR->fetchAndAddNRunningThreads(-1);
+    }
+}
+
+TileScheduler::TileScheduler()
+    : _imp( new TileSchedulerPrivate() )
+{
+}
+
+TileScheduler::~TileScheduler()
+{
+    std::vector<TileSchedulerThread*> threads;
+    {
+        QMutexLocker k(&_imp->jobsMutex);
+        _imp->mustQuit = true;
+        threads = _imp->threads;
+        _imp->jobsCond.wakeAll();
+    }
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->wait();
+        delete threads[i];
+    }
+}
+
+int
+TileScheduler::getMaxConcurrency() const
+{
+    return std::max(1, QThreadPool::globalInstance()->maxThreadCount());
+}
+
+int
+TileScheduler::getNWorkerThreads() const
+{
+    QMutexLocker k(&_imp->jobsMutex);
+
+    return (int)_imp->threads.size();
+}
+
+void
+TileScheduler::run(int nTasks,
+                   const std::function<void(int)>& func)
+{
+    if (nTasks <= 0) {
+        return;
+    }
+
+    // The calling thread is one of the threads executing the tasks
+    int nWorkers = getMaxConcurrency() - 1;
+    if ( (nTasks == 1) || (nWorkers <= 0) ) {
+        std::exception_ptr exception;
+        for (int i = 0; i < nTasks; ++i) {
+            try {
+                func(i);
+            } catch (...) {
+                if (!exception) {
+                    exception = std::current_exception();
+                }
+            }
+        }
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+
+        return;
+    }
+
+    TileSchedulerJobPtr job = std::make_shared<TileSchedulerJob>(nTasks, func);
+    {
+        QMutexLocker k(&_imp->jobsMutex);
+        _imp->nAllowedWorkers = nWorkers;
+        _imp->startWorkers(nWorkers);
+        _imp->jobs.push_back(job);
+        if (nTasks - 1 >= nWorkers) {
+            _imp->jobsCond.wakeAll();
+        } else {
+            for (int i = 0; i < nTasks - 1; ++i) {
+                _imp->jobsCond.wakeOne();
+            }
+        }
+    }
+
+    // Execute our own tasks while the workers steal the others
+    int index;
+    while ( job->claimTask(&index) ) {
+        job->executeTask(index);
+    }
+
+    {
+        QMutexLocker k(&_imp->jobsMutex);
+        std::list<TileSchedulerJobPtr>::iterator found = std::find(_imp->jobs.begin(), _imp->jobs.end(), job);
+        assert( found != _imp->jobs.end() );
+        _imp->jobs.erase(found);
+    }
+
+    // Wait for the tasks stolen by the workers
+    std::exception_ptr exception;
+    {
+        QMutexLocker k(&job->doneMutex);
+        while (job->remainingTasks.load() > 0) {
+            job->doneCond.wait(&job->doneMutex);
+        }
+        exception = job->exception;
+    }
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+} // TileScheduler::run
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,88 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_TileScheduler_h
+#define Natron_Engine_TileScheduler_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <functional>
+#include <memory>
+
+#include "Engine/EngineFwd.h"
+
+// The number of pixels of a tile when host frame threading splits a render window.
+// 256x256 RGBA float pixels is 1MiB, which keeps a tile and its inputs in the L2/L3 caches.
+#define NATRON_TILE_SCHEDULER_TILE_PIXELS (256 * 256)
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief An executor dedicated to host frame threading (eRenderSafetyFullySafeFrame).
+ * Each call to run() publishes a job made of independent tasks (usually tiles) and the calling thread
+ * executes tasks of its own job until none is left, while idle worker threads steal tasks from
+ * the pending jobs, newest job first.
+ * Since the calling thread always participates, a render never blocks a thread waiting on
+ * a pool which is full and never degrades to one thread when the pool is busy: a nested render
+ * (e.g: an input pulled from within a tile) publishes its own job which the idle workers pick up first.
+ * The concurrency follows the maximum thread count of the global thread pool, which is
+ * controlled by the "Number of render threads" setting.
+ **/
+struct TileSchedulerPrivate;
+class TileScheduler
+{
+public:
+
+    TileScheduler();
+
+    ~TileScheduler();
+
+    /**
+     * @brief Calls func(i) for every i in [0, nTasks) and returns once they all returned.
+     * Tasks may be executed concurrently by the calling thread and the worker threads.
+     * While waiting, the calling thread only executes tasks of this job, so that thread-local
+     * data of the caller is never seen by an unrelated task.
+     * If a task throws, the remaining tasks are still executed and the first exception is rethrown.
+     **/
+    void run(int nTasks, const std::function<void(int)>& func);
+
+    /**
+     * @brief Returns the maximum number of threads (including the calling thread) that may execute the tasks of a job.
+     **/
+    int getMaxConcurrency() const;
+
+    /**
+     * @brief Returns the number of worker threads started so far.
+     **/
+    int getNWorkerThreads() const;
+
+private:
+
+    std::unique_ptr<TileSchedulerPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_TileScheduler_h
@@ -71,6 +71,7 @@ public:
         , view(0)
         , srcPremult(eImagePremultiplicationOpaque)
         , depth()
+        , applyDisplayTransform(false)
         , gain(1.)
         , gamma(1.)
         , offset(0.)
@@ -119,6 +120,7 @@ public:
     ViewIdx view; // the view
     ImagePremultiplicationEnum srcPremult; // the image premult
     ImageBitDepthEnum depth; // bitdepth of the texture
+    bool applyDisplayTransform; // the texture is linear floating point and is converted to 8-bit with the gain, gamma and lut when displayed
     double gain; // viewer gain
     double gamma; // viewer gamma
     double offset; // viewer offset
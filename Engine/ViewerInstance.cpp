@@ -31,6 +31,11 @@
 #include <cassert>
 #include <cstring> // for std::memcpy
 #include <limits>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 CLANG_DIAG_OFF(deprecated)
 #include <QtCore/QtGlobal>
@@ -604,6 +609,57 @@ ViewerInstance::getViewerArgsAndRenderViewer(SequenceTime time,
     return eViewerRenderRetCodeRender;
 } // ViewerInstance::getViewerArgsAndRenderViewer
 
+bool
+ViewerInstance::prefetchFrame(SequenceTime time,
+                              ViewIdx view,
+                              U64 viewerHash,
+                              const AbortableRenderInfoPtr& abortInfo)
+{
+    if (!_imp->uiContext) {
+        return false;
+    }
+
+    ViewerArgsPtr args[2];
+    bool mustRender = false;
+    for (int i = 0; i < 2; ++i) {
+        args[i] = std::make_shared<ViewerArgs>();
+        ViewerRenderRetCode stat = getRenderViewerArgsAndCheckCache( time, true, view, i, viewerHash, NodePtr(), abortInfo, RenderStatsPtr(), args[i].get() );
+        if ( (stat != eViewerRenderRetCodeRender) || !args[i]->params || args[i]->params->isViewerPaused ) {
+            args[i].reset();
+            continue;
+        }
+        if (args[i]->forceRender) {
+            // Leave the forced render to the render of the current frame
+            args[i]->forceRender = false;
+            QMutexLocker forceRenderLocker(&_imp->forceRenderMutex);
+            _imp->forceRender[i] = true;
+        }
+        if (args[i]->userRoIEnabled || args[i]->autoContrast || args[i]->isDoingPartialUpdates) {
+            // The textures would not be cached
+            return false;
+        }
+        if ( !args[i]->mustComputeRoDAndLookupCache && (args[i]->params->nbCachedTile > 0) &&
+             ( args[i]->params->nbCachedTile == (int)args[i]->params->tiles.size() ) ) {
+            // Already cached
+            args[i].reset();
+            continue;
+        }
+        mustRender = true;
+    }
+    if (!mustRender) {
+        return true;
+    }
+
+    ViewerRenderRetCode stat;
+    try {
+        stat = renderViewer(view, false, true, viewerHash, true, NodePtr(), true, args, ViewerCurrentFrameRequestSchedulerStartArgsPtr(), RenderStatsPtr());
+    } catch (...) {
+        stat = eViewerRenderRetCodeFail;
+    }
+
+    return stat == eViewerRenderRetCodeRender && !abortInfo->isAborted();
+} // ViewerInstance::prefetchFrame
+
 ViewerInstance::ViewerRenderRetCode
 ViewerInstance::renderViewer(ViewIdx view,
                              bool singleThreaded,
@@ -917,6 +973,13 @@ ViewerInstance::setupMinimalUpdateViewerParams(const SequenceTime time,
     // The user requested bitdepth of the textures
     outArgs->params->depth = _imp->uiContext->getBitDepth();
 
+    // With the linear viewer cache, 8-bit textures are rendered and cached as floating point textures which do not depend
+    // on the gain, gamma and lut, like the textures displayed by the shaders: these are applied in updateViewer()
+    if ( (outArgs->params->depth == eImageBitDepthByte) && appPTR->getCurrentSettings()->isLinearViewerCacheEnabled() ) {
+        outArgs->params->depth = eImageBitDepthFloat;
+        outArgs->params->applyDisplayTransform = true;
+    }
+
     // The frame number
     outArgs->params->time = time;
 
@@ -1072,6 +1135,17 @@ ViewerInstance::getViewerRoIAndTexture(const RectD& rod,
 
     if (useCache) {
         FrameEntryLocker entryLocker(_imp.get());
+
+        // During playback, read ahead the textures of the next frames from the disk portion of the cache
+        std::vector<int> upcomingFrames;
+        if (outArgs->params->isSequential) {
+            int prefetchDepth = appPTR->getCurrentSettings()->getViewerCachePrefetchDepth();
+            if (prefetchDepth > 0) {
+                getRenderEngine()->getUpcomingPlaybackFrames( (int)time, prefetchDepth, &upcomingFrames );
+            }
+        }
+        std::vector<U64> prefetchHashes;
+
         for (std::list<UpdateViewerParams::CachedTile>::iterator it = outArgs->params->tiles.begin(); it != outArgs->params->tiles.end(); ++it) {
             FrameKey key(getNode().get(),
                          outArgs->params->time,
@@ -1089,6 +1163,25 @@ ViewerInstance::getViewerRoIAndTexture(const RectD& rod,
                          outArgs->params->alphaLayer.getPlaneID() + outArgs->params->alphaChannelName,
                          outArgs->params->depth == eImageBitDepthFloat,
                          isDraftMode);
+            for (std::size_t i = 0; i < upcomingFrames.size(); ++i) {
+                FrameKey upcomingKey(getNode().get(),
+                                     upcomingFrames[i],
+                                     viewerHash,
+                                     outArgs->params->gain,
+                                     outArgs->params->gamma,
+                                     outArgs->params->lut,
+                                     (int)outArgs->params->depth,
+                                     outArgs->channels,
+                                     outArgs->params->view,
+                                     it->rect,
+                                     mipmapLevel,
+                                     inputToRenderName,
+                                     outArgs->params->layer,
+                                     outArgs->params->alphaLayer.getPlaneID() + outArgs->params->alphaChannelName,
+                                     outArgs->params->depth == eImageBitDepthFloat,
+                                     isDraftMode);
+                prefetchHashes.push_back( upcomingKey.getHash() );
+            }
             std::list<FrameEntryPtr> entries;
             bool hasTextureCached = appPTR->getTexture(key, &entries);
             if ( stats  && stats->isInDepthProfilingEnabled() ) {
@@ -1143,6 +1236,10 @@ ViewerInstance::getViewerRoIAndTexture(const RectD& rod,
                 ++outArgs->params->nbCachedTile;
             }
         }
+
+        if ( !prefetchHashes.empty() ) {
+            appPTR->prefetchTextures(prefetchHashes);
+        }
     }
 
 
@@ -2116,6 +2213,59 @@ findAutoContrastVminVmax(const ImagePtr inputImage,
     }
 } // findAutoContrastVminVmax
 
+/**
+ * @brief Fast path of scaleToTexture8bits_generic() for float RGBA images without gamma, luminance, matte nor input
+ * color-space: the rows are converted to 8.8 fixed point by Color::toUint8xxRow() (which uses SIMD instructions when available)
+ * and only the error diffusion is done per pixel. The output is the same as the generic code.
+ **/
+template <bool opaque, int rOffset, int gOffset, int bOffset>
+void
+scaleToTexture8bitsRGBAFloat(const RenderViewerArgs & args,
+                             const float* src_pixels,
+                             int srcRowElements,
+                             int width,
+                             int height,
+                             U32* dst_pixels,
+                             int dstRowElements)
+{
+    const int offsets[3] = { rOffset, gOffset, bOffset };
+    std::vector<unsigned short> rowBuffer(width * 3);
+    unsigned short* rows[3] = { &rowBuffer[0], &rowBuffer[width], &rowBuffer[2 * width] };
+
+    for (int y = 0; y < height;
+         ++y,
+         src_pixels += srcRowElements,
+         dst_pixels += dstRowElements) {
+        // coverity[dont_call]
+        int start = (int)( rand() % width );
+
+        Color::toUint8xxRow(args.colorSpace, src_pixels, width, 4, offsets, -1, true, args.gain, args.offset, rows);
+
+        for (int backward = 0; backward < 2; ++backward) {
+            int index = backward ? start - 1 : start;
+            unsigned error_r = 0x80;
+            unsigned error_g = 0x80;
+            unsigned error_b = 0x80;
+
+            while (index < width && index >= 0) {
+                // without color-space, the values are multiples of 0x100 and the error stays at 0x80
+                error_r = (error_r & 0xff) + rows[0][index];
+                error_g = (error_g & 0xff) + rows[1][index];
+                error_b = (error_b & 0xff) + rows[2][index];
+                assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
+                U8 uA = opaque ? 255 : (U8)Color::floatToInt<256>(src_pixels[index * 4 + 3]);
+                dst_pixels[index] = toBGRA( (U8)(error_r >> 8), (U8)(error_g >> 8), (U8)(error_b >> 8), uA );
+
+                if (backward) {
+                    --index;
+                } else {
+                    ++index;
+                }
+            }
+        }
+    }
+} // scaleToTexture8bitsRGBAFloat
+
 template <typename PIX, int maxValue, bool opaque, bool applyMatte, int rOffset, int gOffset, int bOffset>
 void
 scaleToTexture8bits_generic(const RectI& roi,
@@ -2156,6 +2306,13 @@ scaleToTexture8bits_generic(const RectI& roi,
         matteAcc = std::make_shared<Image::ReadAccess>( args.matteImage.get() );
     }
 
+    if ( (pixelSize == sizeof(float)) && (nComps == 4) && src_pixels && !applyMatte && !luminance &&
+         (args.gamma == 1.) && !args.srcColorSpace ) {
+        scaleToTexture8bitsRGBAFloat<opaque, rOffset, gOffset, bOffset>(args, (const float*)src_pixels, srcRowElements, x2 - x1, y2 - y1, dst_pixels, dstRowElements);
+
+        return;
+    }
+
     for (int y = y1; y < y2;
          ++y,
          dst_pixels += dstRowElements) {
@@ -2179,36 +2336,36 @@ scaleToTexture8bits_generic(const RectI& roi,
                 int uA = 0;
                 double a = 0;
                 if (nComps >= 4) {
-                    r = (src_pixels ? src_pixels[index * nComps + rOffset] : 0.);
-                    g = (src_pixels ? src_pixels[index * nComps + gOffset] : 0.);
-                    b = (src_pixels ? src_pixels[index * nComps + bOffset] : 0.);
+                    r = (src_pixels ? (double)src_pixels[index * nComps + rOffset] : 0.);
+                    g = (src_pixels ? (double)src_pixels[index * nComps + gOffset] : 0.);
+                    b = (src_pixels ? (double)src_pixels[index * nComps + bOffset] : 0.);
                     if (opaque) {
                         a = 1;
                         uA = 255;
                     } else {
-                        a = src_pixels ? src_pixels[index * nComps + 3] : 0;
+                        a = src_pixels ? (double)src_pixels[index * nComps + 3] : 0;
                         uA = Color::floatToInt<256>(a);
                     }
                 } else if (nComps == 3) {
                     // coverity[dead_error_line]
-                    r = (src_pixels && rOffset < nComps) ? src_pixels[index * nComps + rOffset] : 0.;
+                    r = (src_pixels && rOffset < nComps) ? (double)src_pixels[index * nComps + rOffset] : 0.;
                     // coverity[dead_error_line]
-                    g = (src_pixels && gOffset < nComps) ? src_pixels[index * nComps + gOffset] : 0.;
+                    g = (src_pixels && gOffset < nComps) ? (double)src_pixels[index * nComps + gOffset] : 0.;
                     // coverity[dead_error_line]
-                    b = (src_pixels && bOffset < nComps) ? src_pixels[index * nComps + bOffset] : 0.;
+                    b = (src_pixels && bOffset < nComps) ? (double)src_pixels[index * nComps + bOffset] : 0.;
                     a = (src_pixels ? 1 : 0);
                     uA = a * 255;
                 } else if (nComps == 2) {
                     // coverity[dead_error_line]
-                    r = (src_pixels && rOffset < nComps) ? src_pixels[index * nComps + rOffset] : 0.;
+                    r = (src_pixels && rOffset < nComps) ? (double)src_pixels[index * nComps + rOffset] : 0.;
                     // coverity[dead_error_line]
-                    g = (src_pixels && gOffset < nComps) ? src_pixels[index * nComps + gOffset] : 0.;
+                    g = (src_pixels && gOffset < nComps) ? (double)src_pixels[index * nComps + gOffset] : 0.;
                     b = 0;
                     a = (src_pixels ? 1 : 0);
                     uA = a * 255;
                 } else if (nComps == 1) {
                     // coverity[dead_error_line]
-                    r = (src_pixels && rOffset < nComps) ? src_pixels[index * nComps + rOffset] : 0.;
+                    r = (src_pixels && rOffset < nComps) ? (double)src_pixels[index * nComps + rOffset] : 0.;
                     g = b = r;
                     a = (src_pixels ? 1 : 0);
                     uA = a * 255;
@@ -2217,8 +2374,8 @@ scaleToTexture8bits_generic(const RectI& roi,
                 }
 
 
-                switch (pixelSize) {
-                case sizeof(unsigned char):     //byte
+                switch (maxValue) {
+                case 255:     //byte
                     if (args.srcColorSpace) {
                         r = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)r );
                         g = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)g );
@@ -2229,7 +2386,7 @@ scaleToTexture8bits_generic(const RectI& roi,
                         b = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)b );
                     }
                     break;
-                case sizeof(unsigned short):     //short
+                case 65535:     //short
                     if (args.srcColorSpace) {
                         r = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)r );
                         g = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)g );
@@ -2240,7 +2397,7 @@ scaleToTexture8bits_generic(const RectI& roi,
                         b = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned char)b );
                     }
                     break;
-                case sizeof(float):     //float
+                case 1:     //float or half
                     if (args.srcColorSpace) {
                         r = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(r);
                         g = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(g);
@@ -2310,11 +2467,11 @@ scaleToTexture8bits_generic(const RectI& roi,
                         const PIX* src_pixels = (const PIX*)matteAcc->pixelAt(x1 + index, y);
                         if (src_pixels) {
                             alphaMatteValue = (double)src_pixels[args.alphaChannelIndex];
-                            switch (pixelSize) {
-                            case sizeof(unsigned char):     //byte
+                            switch (maxValue) {
+                            case 255:     //byte
                                 alphaMatteValue = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)r );
                                 break;
-                            case sizeof(unsigned short):     //short
+                            case 65535:     //short
                                 alphaMatteValue = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned short)r );
                                 break;
                             default:
@@ -2498,13 +2655,163 @@ scaleToTexture8bits(const RectI& roi,
         scaleToTexture8bitsForDepth<unsigned short, 65535>(roi, args, viewer, tile, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        scaleToTexture8bitsForDepth<Half, 1>(roi, args, viewer, tile, output);
         break;
     case eImageBitDepthNone:
         break;
     }
 } // scaleToTexture8bits
 
+/**
+ * @brief Applies the gain, offset, gamma and color-space of args to the rows of a linear float RGBA texture and
+ * writes them as 8-bit BGRA, with the same error diffusion as scaleToTexture8bits_generic().
+ **/
+static void
+applyDisplayTransformToRows(const RenderViewerArgs & args,
+                            const std::vector<float>& gammaLut,
+                            const float* src_pixels,
+                            int srcRowElements,
+                            int width,
+                            int height,
+                            U32* dst_pixels,
+                            int dstRowElements)
+{
+    if (args.gamma == 1.) {
+        scaleToTexture8bitsRGBAFloat<false, 0, 1, 2>(args, src_pixels, srcRowElements, width, height, dst_pixels, dstRowElements);
+
+        return;
+    }
+
+    for (int y = 0; y < height;
+         ++y,
+         src_pixels += srcRowElements,
+         dst_pixels += dstRowElements) {
+        // coverity[dont_call]
+        int start = (int)( rand() % width );
+
+        for (int backward = 0; backward < 2; ++backward) {
+            int index = backward ? start - 1 : start;
+            unsigned error_r = 0x80;
+            unsigned error_g = 0x80;
+            unsigned error_b = 0x80;
+
+            while (index < width && index >= 0) {
+                double r = src_pixels[index * 4] * args.gain + args.offset;
+                double g = src_pixels[index * 4 + 1] * args.gain + args.offset;
+                double b = src_pixels[index * 4 + 2] * args.gain + args.offset;
+                if (args.gamma <= 0) {
+                    r = (r < 1.) ? 0. : (r == 1. ? 1. : std::numeric_limits<double>::infinity() );
+                    g = (g < 1.) ? 0. : (g == 1. ? 1. : std::numeric_limits<double>::infinity() );
+                    b = (b < 1.) ? 0. : (b == 1. ? 1. : std::numeric_limits<double>::infinity() );
+                } else {
+                    r = ViewerInstance::ViewerInstancePrivate::lookupGammaLut(gammaLut, r);
+                    g = ViewerInstance::ViewerInstancePrivate::lookupGammaLut(gammaLut, g);
+                    b = ViewerInstance::ViewerInstancePrivate::lookupGammaLut(gammaLut, b);
+                }
+
+                U8 uR, uG, uB;
+                if (!args.colorSpace) {
+                    uR = Color::floatToInt<256>(r);
+                    uG = Color::floatToInt<256>(g);
+                    uB = Color::floatToInt<256>(b);
+                } else {
+                    error_r = (error_r & 0xff) + args.colorSpace->toColorSpaceUint8xxFromLinearFloatFast(r);
+                    error_g = (error_g & 0xff) + args.colorSpace->toColorSpaceUint8xxFromLinearFloatFast(g);
+                    error_b = (error_b & 0xff) + args.colorSpace->toColorSpaceUint8xxFromLinearFloatFast(b);
+                    assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
+                    uR = (U8)(error_r >> 8);
+                    uG = (U8)(error_g >> 8);
+                    uB = (U8)(error_b >> 8);
+                }
+                U8 uA = (U8)Color::floatToInt<256>(src_pixels[index * 4 + 3]);
+                dst_pixels[index] = toBGRA(uR, uG, uB, uA);
+
+                if (backward) {
+                    --index;
+                } else {
+                    ++index;
+                }
+            }
+        }
+    }
+} // applyDisplayTransformToRows
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+struct DisplayTransformRows
+{
+    const float* src;
+    U32* dst;
+    int rowElements;
+    int width;
+    int height;
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+void
+ViewerInstance::applyDisplayTransform(const UpdateViewerParams& params,
+                                      std::vector<std::vector<U32> >* displayBuffers)
+{
+    assert(params.applyDisplayTransform && params.depth == eImageBitDepthFloat);
+
+    // The gamma of the viewer may have changed since the texture was rendered: use the one of params
+    std::vector<float> gammaLut;
+    if (params.gamma > 0. && params.gamma != 1.) {
+        ViewerInstancePrivate::fillGammaLut(params.gamma, &gammaLut);
+    }
+    const RenderViewerArgs args(ImageConstPtr(),
+                                ImageConstPtr(),
+                                eDisplayChannelsRGB,
+                                params.srcPremult,
+                                eImageBitDepthByte,
+                                params.gain,
+                                params.gamma,
+                                params.offset,
+                                0,
+                                lutFromColorspace(params.lut),
+                                -1,
+                                false,
+                                0);
+
+    // Split the tiles in bands of rows so that a single texture (when the texture cache is not used) is also
+    // converted by multiple threads
+    const int bandHeight = 64;
+    std::vector<DisplayTransformRows> bands;
+    displayBuffers->resize( params.tiles.size() );
+    std::size_t tileIndex = 0;
+    for (std::list<UpdateViewerParams::CachedTile>::const_iterator it = params.tiles.begin(); it != params.tiles.end(); ++it, ++tileIndex) {
+        if ( !it->ramBuffer || it->rect.isNull() ) {
+            (*displayBuffers)[tileIndex].clear();
+            continue;
+        }
+        const int rowElements = it->rectRounded.width();
+        assert(it->bytesCount == (std::size_t)it->rectRounded.area() * 4 * sizeof(float));
+        std::vector<U32>& buffer = (*displayBuffers)[tileIndex];
+        buffer.assign(it->rectRounded.area(), 0);
+
+        const std::size_t offset = (it->rect.y1 - it->rectRounded.y1) * rowElements + (it->rect.x1 - it->rectRounded.x1);
+        for (int y = it->rect.y1; y < it->rect.y2; y += bandHeight) {
+            DisplayTransformRows rows;
+            rows.src = (const float*)it->ramBuffer + (offset + (y - it->rect.y1) * rowElements) * 4;
+            rows.dst = &buffer[0] + offset + (y - it->rect.y1) * rowElements;
+            rows.rowElements = rowElements;
+            rows.width = it->rect.width();
+            rows.height = std::min(bandHeight, it->rect.y2 - y);
+            bands.push_back(rows);
+        }
+    }
+
+    std::function<void (const DisplayTransformRows&)> applyToRows = [&](const DisplayTransformRows& rows) {
+        applyDisplayTransformToRows(args, gammaLut, rows.src, rows.rowElements * 4, rows.width, rows.height, rows.dst, rows.rowElements);
+    };
+    if (bands.size() <= 1) {
+        std::for_each(bands.begin(), bands.end(), applyToRows);
+    } else {
+        QtConcurrent::map(bands, applyToRows).waitForFinished();
+    }
+} // ViewerInstance::applyDisplayTransform
+
 float
 ViewerInstance::interpolateGammaLut(float value)
 {
@@ -2535,6 +2842,45 @@ ViewerInstance::markAllOnGoingRendersAsAborted(bool keepOldestRender)
     }
 }
 
+/**
+ * @brief Fast path of scaleToTexture32bitsGeneric() for float RGBA images without luminance, matte nor input color-space:
+ * the pixels are only shuffled, 4 channels at a time with SSE2 when available.
+ **/
+template <bool opaque, int rOffset, int gOffset, int bOffset>
+void
+scaleToTexture32bitsRGBAFloat(const float* src_pixels,
+                              int srcRowElements,
+                              int width,
+                              int height,
+                              float* dst_pixels,
+                              int dstRowElements)
+{
+    for (int y = 0; y < height;
+         ++y,
+         src_pixels += srcRowElements,
+         dst_pixels += dstRowElements) {
+        int x = 0;
+#ifdef __SSE2__
+        const __m128 rgbMask = _mm_castsi128_ps( _mm_setr_epi32(-1, -1, -1, 0) );
+        const __m128 alphaOne = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+        for (; x < width; ++x) {
+            __m128 p = _mm_loadu_ps(src_pixels + x * 4);
+            p = _mm_shuffle_ps( p, p, _MM_SHUFFLE(3, bOffset, gOffset, rOffset) );
+            if (opaque) {
+                p = _mm_or_ps(_mm_and_ps(p, rgbMask), alphaOne);
+            }
+            _mm_storeu_ps(dst_pixels + x * 4, p);
+        }
+#endif
+        for (; x < width; ++x) {
+            dst_pixels[x * 4] = src_pixels[x * 4 + rOffset];
+            dst_pixels[x * 4 + 1] = src_pixels[x * 4 + gOffset];
+            dst_pixels[x * 4 + 2] = src_pixels[x * 4 + bOffset];
+            dst_pixels[x * 4 + 3] = opaque ? 1.f : src_pixels[x * 4 + 3];
+        }
+    }
+}
+
 template <typename PIX, int maxValue, bool opaque, bool applyMatte, int rOffset, int gOffset, int bOffset>
 void
 scaleToTexture32bitsGeneric(const RectI& roi,
@@ -2567,9 +2913,15 @@ scaleToTexture32bitsGeneric(const RectI& roi,
     const int y2 = args.renderOnlyRoI ? roi.y2 : tile.rect.y2;
     const int x1 = args.renderOnlyRoI ? roi.x1 : tile.rect.x1;
     const int x2 = args.renderOnlyRoI ? roi.x2 : tile.rect.x2;
-    const float* src_pixels = (const float*)acc.pixelAt(x1, y1);
+    const PIX* src_pixels = (const PIX*)acc.pixelAt(x1, y1);
     const int srcRowElements = (const int)args.inputImage->getRowElements();
 
+    if ( (pixelSize == sizeof(float)) && (nComps == 4) && src_pixels && !applyMatte && !luminance && !args.srcColorSpace ) {
+        scaleToTexture32bitsRGBAFloat<opaque, rOffset, gOffset, bOffset>( (const float*)src_pixels, srcRowElements, x2 - x1, y2 - y1, dst_pixels, dstRowElements);
+
+        return;
+    }
+
     for (int y = y1; y < y2;
          ++y,
          dst_pixels += dstRowElements) {
@@ -2581,32 +2933,32 @@ scaleToTexture32bitsGeneric(const RectI& roi,
             double a = 0.;
 
             if (nComps >= 4) {
-                r = (src_pixels && rOffset < nComps) ? src_pixels[x * nComps + rOffset] : 0.;
-                g = (src_pixels && gOffset < nComps) ? src_pixels[x * nComps + gOffset] : 0.;
-                b = (src_pixels && bOffset < nComps) ? src_pixels[x * nComps + bOffset] : 0.;
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[x * nComps + rOffset] : 0.;
+                g = (src_pixels && gOffset < nComps) ? (double)src_pixels[x * nComps + gOffset] : 0.;
+                b = (src_pixels && bOffset < nComps) ? (double)src_pixels[x * nComps + bOffset] : 0.;
                 if (opaque) {
                     a = 1.;
                 } else {
-                    a = src_pixels ? src_pixels[x * nComps + 3] : 0.;
+                    a = src_pixels ? (double)src_pixels[x * nComps + 3] : 0.;
                 }
             } else if (nComps == 3) {
                 // coverity[dead_error_line]
-                r = (src_pixels && rOffset < nComps) ? src_pixels[x * nComps + rOffset] : 0.;
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[x * nComps + rOffset] : 0.;
                 // coverity[dead_error_line]
-                g = (src_pixels && gOffset < nComps) ? src_pixels[x * nComps + gOffset] : 0.;
+                g = (src_pixels && gOffset < nComps) ? (double)src_pixels[x * nComps + gOffset] : 0.;
                 // coverity[dead_error_line]
-                b = (src_pixels && bOffset < nComps) ? src_pixels[x * nComps + bOffset] : 0.;
+                b = (src_pixels && bOffset < nComps) ? (double)src_pixels[x * nComps + bOffset] : 0.;
                 a = 1.;
             } else if (nComps == 2) {
                 // coverity[dead_error_line]
-                r = (src_pixels && rOffset < nComps) ? src_pixels[x * nComps + rOffset] : 0.;
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[x * nComps + rOffset] : 0.;
                 // coverity[dead_error_line]
-                g = (src_pixels && gOffset < nComps) ? src_pixels[x * nComps + gOffset] : 0.;
+                g = (src_pixels && gOffset < nComps) ? (double)src_pixels[x * nComps + gOffset] : 0.;
                 b = 0.;
                 a = 1.;
             } else if (nComps == 1) {
                 // coverity[dead_error_line]
-                r = (src_pixels && rOffset < nComps) ? src_pixels[x * nComps + rOffset] : 0.;
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[x * nComps + rOffset] : 0.;
                 g = b = r;
                 a = 1.;
             } else {
@@ -2614,8 +2966,8 @@ scaleToTexture32bitsGeneric(const RectI& roi,
             }
 
 
-            switch (pixelSize) {
-            case sizeof(unsigned char):
+            switch (maxValue) {
+            case 255:
                 if (args.srcColorSpace) {
                     r = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)r );
                     g = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)g );
@@ -2626,7 +2978,7 @@ scaleToTexture32bitsGeneric(const RectI& roi,
                     b = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)b );
                 }
                 break;
-            case sizeof(unsigned short):
+            case 65535:
                 if (args.srcColorSpace) {
                     r = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)r );
                     g = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)g );
@@ -2637,7 +2989,7 @@ scaleToTexture32bitsGeneric(const RectI& roi,
                     b = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned char)b );
                 }
                 break;
-            case sizeof(float):
+            case 1:     //float or half
                 if (args.srcColorSpace) {
                     r = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(r);
                     g = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(g);
@@ -2678,11 +3030,11 @@ scaleToTexture32bitsGeneric(const RectI& roi,
                     const PIX* src_pixels = (const PIX*)matteAcc->pixelAt(x, y);
                     if (src_pixels) {
                         alphaMatteValue = (double)src_pixels[args.alphaChannelIndex];
-                        switch (pixelSize) {
-                        case sizeof(unsigned char):     //byte
+                        switch (maxValue) {
+                        case 255:     //byte
                             alphaMatteValue = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)r );
                             break;
-                        case sizeof(unsigned short):     //short
+                        case 65535:     //short
                             alphaMatteValue = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned short)r );
                             break;
                         default:
@@ -2851,7 +3203,7 @@ scaleToTexture32bits(const RectI& roi,
         scaleToTexture32bitsForPremult<unsigned short, 65535>(roi, args, tile, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        scaleToTexture32bitsForPremult<Half, 1>(roi, args, tile, output);
         break;
     case eImageBitDepthNone:
         break;
@@ -2884,12 +3236,28 @@ ViewerInstance::ViewerInstancePrivate::updateViewer(UpdateViewerParamsPtr params
 
         assert( (params->isPartialRect && params->tiles.size() == 1) || !params->isPartialRect );
 
+        // The 8-bit buffers converted from the linear texture when the display transform is done on the CPU
+        std::vector<std::vector<U32> > displayBuffers;
+        if (params->applyDisplayTransform) {
+            ViewerInstance::applyDisplayTransform(*params, &displayBuffers);
+        }
+
         TexturePtr texture;
         bool isFirstTile = true;
-        for (std::list<UpdateViewerParams::CachedTile>::iterator it = params->tiles.begin(); it != params->tiles.end(); ++it) {
+        std::size_t tileIndex = 0;
+        for (std::list<UpdateViewerParams::CachedTile>::iterator it = params->tiles.begin(); it != params->tiles.end(); ++it, ++tileIndex) {
             if (!it->ramBuffer) {
                 continue;
             }
+            const unsigned char* ramBuffer = it->ramBuffer;
+            std::size_t bytesCount = it->bytesCount;
+            if (params->applyDisplayTransform) {
+                if ( displayBuffers[tileIndex].empty() ) {
+                    continue;
+                }
+                ramBuffer = (const unsigned char*)&displayBuffers[tileIndex][0];
+                bytesCount = displayBuffers[tileIndex].size() * sizeof(U32);
+            }
 
             // For cached tiles, some tiles might not have the standard tile, (i.e: the last tile column/row).
             // Since the internal buffer is rounded to the tile size anyway we want the glTexSubImage2D call to ensure
@@ -2900,7 +3268,7 @@ ViewerInstance::ViewerInstancePrivate::updateViewer(UpdateViewerParamsPtr params
             texRect.set(it->rectRounded);
     
             assert(params->roi.contains(texRect));
-            uiContext->transferBufferFromRAMtoGPU(it->ramBuffer, it->bytesCount, params->roi, params->roiNotRoundedToTileSize, texRect, params->textureIndex, params->isPartialRect, isFirstTile, &texture);
+            uiContext->transferBufferFromRAMtoGPU(ramBuffer, bytesCount, params->roi, params->roiNotRoundedToTileSize, texRect, params->textureIndex, params->isPartialRect, isFirstTile, &texture);
             isFirstTile = false;
         }
 
@@ -3483,7 +3851,8 @@ void
 ViewerInstance::reportStats(int time,
                             ViewIdx view,
                             double wallTime,
-                            const RenderStatsMap& stats)
+                            const RenderStatsMap& stats,
+                            int /*hashPropagationNodesVisited*/)
 {
     Q_EMIT renderStatsAvailable(time, view, wallTime, stats);
 }
@@ -29,6 +29,7 @@
 #include "Global/Macros.h"
 
 #include <string>
+#include <vector>
 
 #include "Engine/OutputEffectInstance.h"
 #include "Engine/ViewIdx.h"
@@ -211,6 +212,18 @@ public:
                                                      ViewerArgsPtr* argsA,
                                                      ViewerArgsPtr* argsB);
 
+    /**
+     * @brief Renders the frame at the given time in the viewer cache as it would be displayed now, without displaying it.
+     * The render ages of the viewer are left untouched so that this never prevents the display of another render.
+     * The render is aborted when abortInfo is aborted.
+     * Returns true if the frame is in the viewer cache when returning. Frames whose textures are not cached by the viewer
+     * (user RoI, auto-contrast, partial updates) are not rendered.
+     **/
+    bool prefetchFrame(SequenceTime time,
+                       ViewIdx view,
+                       U64 viewerHash,
+                       const AbortableRenderInfoPtr& abortInfo);
+
     void aboutToUpdateTextures();
 
     void updateViewer(UpdateViewerParamsPtr & frame);
@@ -289,6 +302,14 @@ public:
     void getTimelineBounds(int* first, int* last) const;
 
     static const Color::Lut* lutFromColorspace(ViewerColorSpaceEnum cs) WARN_UNUSED_RETURN;
+
+    /**
+     * @brief Converts the linear floating point tiles of params (for which applyDisplayTransform is set) to 8-bit BGRA
+     * buffers, applying the gain, offset, gamma and lut of params. This is done on the CPU by multiple threads when the
+     * texture is displayed. displayBuffers has one buffer per tile, of the size of the rounded rectangle of the tile.
+     **/
+    static void applyDisplayTransform(const UpdateViewerParams& params, std::vector<std::vector<U32> >* displayBuffers);
+
     virtual void onMetadataRefreshed(const NodeMetadata& metadata) OVERRIDE FINAL;
     virtual void onChannelsSelectorRefreshed() OVERRIDE FINAL;
 
@@ -315,7 +336,7 @@ public:
     void setDoingPartialUpdates(bool doing);
     bool isDoingPartialUpdates() const;
 
-    virtual void reportStats(int time, ViewIdx view, double wallTime, const RenderStatsMap& stats) OVERRIDE FINAL;
+    virtual void reportStats(int time, ViewIdx view, double wallTime, const RenderStatsMap& stats, int hashPropagationNodesVisited) OVERRIDE FINAL;
 
     ///Only callable on MT
     void setActivateInputChangeRequestedFromViewer(bool fromViewer);
@@ -318,22 +318,34 @@ public:
     void fillGammaLut(double gamma)
     {
         // gammaLookupMutex should already be locked
-        gammaLookup.resize(GAMMA_LUT_NB_VALUES + 1);
+        fillGammaLut(gamma, &gammaLookup);
+    }
+
+    float lookupGammaLut(float value) const
+    {
+        return lookupGammaLut(gammaLookup, value);
+    }
+
+    static void fillGammaLut(double gamma,
+                             std::vector<float>* lut)
+    {
+        lut->resize(GAMMA_LUT_NB_VALUES + 1);
         if (gamma <= 0) {
             // gamma = 0: everything is zero, except gamma(1)=1
-            std::fill(gammaLookup.begin(), gammaLookup.begin() + GAMMA_LUT_NB_VALUES, 0.f);
-            gammaLookup[GAMMA_LUT_NB_VALUES] = 1.f;
+            std::fill(lut->begin(), lut->begin() + GAMMA_LUT_NB_VALUES, 0.f);
+            (*lut)[GAMMA_LUT_NB_VALUES] = 1.f;
             return;
         }
         for (int position = 0; position <= GAMMA_LUT_NB_VALUES; ++position) {
             double parametricPos = double(position) / GAMMA_LUT_NB_VALUES;
             double value = std::pow(parametricPos, 1. / gamma);
             // set that in the lut
-            gammaLookup[position] = (float)std::max( 0., std::min(1., value) );
+            (*lut)[position] = (float)std::max( 0., std::min(1., value) );
         }
     }
 
-    float lookupGammaLut(float value) const
+    static float lookupGammaLut(const std::vector<float>& lut,
+                                float value)
     {
         if (value < 0.) {
             return 0.;
@@ -343,8 +355,8 @@ public:
             int i = (int)(value * GAMMA_LUT_NB_VALUES);
             assert(0 <= i && i <= GAMMA_LUT_NB_VALUES);
             float alpha = std::max( 0.f, std::min(value * GAMMA_LUT_NB_VALUES - i, 1.f) );
-            float a = gammaLookup[i];
-            float b = (i  < GAMMA_LUT_NB_VALUES) ? gammaLookup[i + 1] : 0.f;
+            float a = lut[i];
+            float b = (i  < GAMMA_LUT_NB_VALUES) ? lut[i + 1] : 0.f;
 
             return a * (1.f - alpha) + b * alpha;
         }
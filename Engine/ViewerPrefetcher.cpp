@@ -0,0 +1,371 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ViewerPrefetcher.h"
+
+#include <algorithm> // max
+#include <cassert>
+#include <limits>
+#include <list>
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#include "Engine/AbortableRenderInfo.h"
+#include "Engine/AppManager.h"
+#include "Engine/RenderTrace.h"
+#include "Engine/Settings.h"
+#include "Engine/ViewIdx.h"
+#include "Engine/ViewerInstance.h"
+
+NATRON_NAMESPACE_ENTER
+
+ViewerPrefetchQueue::ViewerPrefetchQueue()
+    : _playhead( std::numeric_limits<int>::min() )
+    , _forward(true)
+    , _first(0)
+    , _last(-1)
+    , _aheadCount(0)
+    , _cachedFrames()
+    , _renderedFrames()
+    , _renderingFrames()
+{
+}
+
+void
+ViewerPrefetchQueue::setPlayhead(int frame,
+                                 int first,
+                                 int last,
+                                 int aheadCount)
+{
+    // The frames ahead are in the direction the playhead last moved
+    if ( (_playhead != std::numeric_limits<int>::min()) && (frame != _playhead) ) {
+        _forward = frame > _playhead;
+    }
+    _playhead = frame;
+    _first = first;
+    _last = last;
+    _aheadCount = aheadCount;
+}
+
+bool
+ViewerPrefetchQueue::takeNextFrame(int* frame)
+{
+    if (_playhead == std::numeric_limits<int>::min()) {
+        return false;
+    }
+
+    const int direction = _forward ? 1 : -1;
+    int bestCost = std::numeric_limits<int>::max();
+
+    // The playhead itself is rendered by the viewer
+    for (int d = 1; d <= _aheadCount; ++d) {
+        int f = _playhead + direction * d;
+        if ( (f < _first) || (f > _last) ) {
+            break;
+        }
+        if ( !_renderedFrames.count(f) && !_renderingFrames.count(f) ) {
+            bestCost = d;
+            *frame = f;
+            break;
+        }
+    }
+    const int behindCount = _aheadCount / 2;
+    for (int d = 1; d <= behindCount && d * NATRON_VIEWER_PREFETCH_BEHIND_COST < bestCost; ++d) {
+        int f = _playhead - direction * d;
+        if ( (f < _first) || (f > _last) ) {
+            break;
+        }
+        if ( !_renderedFrames.count(f) && !_renderingFrames.count(f) ) {
+            bestCost = d * NATRON_VIEWER_PREFETCH_BEHIND_COST;
+            *frame = f;
+            break;
+        }
+    }
+    if ( bestCost == std::numeric_limits<int>::max() ) {
+        return false;
+    }
+    _renderingFrames.insert(*frame);
+
+    return true;
+}
+
+void
+ViewerPrefetchQueue::onFrameRendered(int frame,
+                                     bool cached,
+                                     bool aborted)
+{
+    _renderingFrames.erase(frame);
+    if (aborted) {
+        return;
+    }
+    _renderedFrames.insert(frame);
+    if (cached) {
+        _cachedFrames.insert(frame);
+    }
+}
+
+void
+ViewerPrefetchQueue::reset()
+{
+    // The frames being rendered are removed by onFrameRendered() once their render was aborted
+    _cachedFrames.clear();
+    _renderedFrames.clear();
+}
+
+bool
+ViewerPrefetchQueue::isFrameCached(int frame) const
+{
+    return _cachedFrames.count(frame) > 0;
+}
+
+int
+ViewerPrefetchQueue::getCachedAheadCount() const
+{
+    if (_playhead == std::numeric_limits<int>::min()) {
+        return 0;
+    }
+
+    const int direction = _forward ? 1 : -1;
+    int count = 0;
+    for (int f = _playhead + direction; f >= _first && f <= _last && _cachedFrames.count(f); f += direction) {
+        ++count;
+    }
+
+    return count;
+}
+
+struct ViewerPrefetcherPrivate
+    : public std::enable_shared_from_this<ViewerPrefetcherPrivate>
+{
+    ViewerInstance* viewer;
+    QThreadPool* threadPool;
+
+    // Protects all fields below
+    mutable QMutex lock;
+    QWaitCondition runnablesFinishedCond;
+    ViewerPrefetchQueue queue;
+    bool active; // false when prefetching was aborted
+    U64 viewerHash;
+    unsigned int mipmapLevel;
+    ViewIdx view;
+    std::list<AbortableRenderInfoPtr> ongoingRenders;
+    int nRunnables;
+
+    ViewerPrefetcherPrivate(ViewerInstance* viewer)
+        : viewer(viewer)
+        , threadPool( QThreadPool::globalInstance() )
+        , lock()
+        , runnablesFinishedCond()
+        , queue()
+        , active(false)
+        , viewerHash(0)
+        , mipmapLevel(0)
+        , view(0)
+        , ongoingRenders()
+        , nRunnables(0)
+    {
+    }
+
+    /**
+     * @brief Returns the number of threads of the pool which may prefetch: one thread is left to the renders of the viewer
+     **/
+    int getMaxRunnables_locked() const
+    {
+        int otherActiveThreads = threadPool->activeThreadCount() - nRunnables;
+
+        return threadPool->maxThreadCount() - 1 - otherActiveThreads;
+    }
+
+    void abortRenders_locked()
+    {
+        for (std::list<AbortableRenderInfoPtr>::iterator it = ongoingRenders.begin(); it != ongoingRenders.end(); ++it) {
+            (*it)->setAborted();
+        }
+    }
+
+    void startRunnables_locked();
+
+    void runPrefetch();
+};
+
+class ViewerPrefetchRunnable
+    : public QRunnable
+{
+    std::shared_ptr<ViewerPrefetcherPrivate> _imp;
+
+public:
+
+    ViewerPrefetchRunnable(const std::shared_ptr<ViewerPrefetcherPrivate>& imp)
+        : _imp(imp)
+    {
+    }
+
+    virtual ~ViewerPrefetchRunnable()
+    {
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _imp->runPrefetch();
+    }
+};
+
+void
+ViewerPrefetcherPrivate::startRunnables_locked()
+{
+    if (!active) {
+        return;
+    }
+    int maxRunnables = getMaxRunnables_locked();
+    while (nRunnables < maxRunnables) {
+        ++nRunnables;
+        threadPool->start( new ViewerPrefetchRunnable( shared_from_this() ) );
+    }
+}
+
+void
+ViewerPrefetcherPrivate::runPrefetch()
+{
+    for (;;) {
+        int frame;
+        U64 hash;
+        ViewIdx frameView;
+        AbortableRenderInfoPtr abortInfo;
+        {
+            QMutexLocker k(&lock);
+            // Stop when there are no more frames or when the pool is needed by other renders
+            if ( !active || (nRunnables > getMaxRunnables_locked()) || !queue.takeNextFrame(&frame) ) {
+                --nRunnables;
+                runnablesFinishedCond.wakeAll();
+
+                return;
+            }
+            hash = viewerHash;
+            frameView = view;
+            abortInfo = AbortableRenderInfo::create(true, 0);
+            ongoingRenders.push_back(abortInfo);
+        }
+
+        bool cached;
+        {
+            RenderTraceSpan traceSpan("prefetchFrame", "render", viewer);
+            cached = viewer->prefetchFrame(frame, frameView, hash, abortInfo);
+        }
+
+        ///This thread is done with this frame, clean-up its TLS
+        appPTR->getAppTLS()->cleanupTLSForThread();
+
+        QMutexLocker k(&lock);
+        ongoingRenders.remove(abortInfo);
+        queue.onFrameRendered( frame, cached, abortInfo->isAborted() );
+    }
+}
+
+ViewerPrefetcher::ViewerPrefetcher(ViewerInstance* viewer)
+    : _imp( std::make_shared<ViewerPrefetcherPrivate>(viewer) )
+{
+}
+
+ViewerPrefetcher::~ViewerPrefetcher()
+{
+    quitPrefetch();
+}
+
+void
+ViewerPrefetcher::prefetchAround(int frame)
+{
+    assert( QThread::currentThread() == qApp->thread() );
+
+    int aheadCount = appPTR->getCurrentSettings()->getViewerPrefetchFramesCount();
+    if ( (aheadCount <= 0) || (appPTR->getCurrentSettings()->getNumberOfThreads() == -1) || !_imp->viewer->isViewerUIVisible() ) {
+        abortPrefetch();
+
+        return;
+    }
+
+    int first, last;
+    _imp->viewer->getTimelineBounds(&first, &last);
+    U64 viewerHash = _imp->viewer->getHash();
+    unsigned int mipmapLevel = std::max( _imp->viewer->getMipmapLevel(), _imp->viewer->getMipmapLevelFromZoomFactor() );
+    int viewsCount = _imp->viewer->getRenderViewsCount();
+    ViewIdx view = viewsCount > 0 ? _imp->viewer->getViewerCurrentView() : ViewIdx(0);
+
+    QMutexLocker k(&_imp->lock);
+    if ( (viewerHash != _imp->viewerHash) || (mipmapLevel != _imp->mipmapLevel) || (view != _imp->view) ) {
+        // The frames prefetched so far are not the ones the viewer displays anymore
+        _imp->abortRenders_locked();
+        _imp->queue.reset();
+        _imp->viewerHash = viewerHash;
+        _imp->mipmapLevel = mipmapLevel;
+        _imp->view = view;
+    }
+    _imp->queue.setPlayhead(frame, first, last, aheadCount);
+    _imp->active = true;
+    _imp->startRunnables_locked();
+}
+
+void
+ViewerPrefetcher::startIdleRenders()
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->startRunnables_locked();
+}
+
+void
+ViewerPrefetcher::abortPrefetch()
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->active = false;
+    _imp->abortRenders_locked();
+}
+
+void
+ViewerPrefetcher::quitPrefetch()
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->active = false;
+    _imp->abortRenders_locked();
+    while (_imp->nRunnables > 0) {
+        _imp->runnablesFinishedCond.wait( k.mutex() );
+    }
+}
+
+int
+ViewerPrefetcher::getCachedAheadCount() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->queue.getCachedAheadCount();
+}
+
+NATRON_NAMESPACE_EXIT
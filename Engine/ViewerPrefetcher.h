@@ -0,0 +1,154 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_ViewerPrefetcher_h
+#define Natron_Engine_ViewerPrefetcher_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <memory>
+#include <set>
+
+#include "Engine/EngineFwd.h"
+
+// A frame behind the playhead is rendered after the frames ahead which are up to this many times farther from the playhead
+#define NATRON_VIEWER_PREFETCH_BEHIND_COST 2
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief The frames to prefetch around the playhead, in priority order: the closest frames first, a frame ahead of the
+ * playhead (in the direction it last moved) being preferred to a frame behind it at the same distance.
+ * Moving the playhead only re-orders the frames left to render: the frames being rendered and the frames already
+ * rendered are kept until reset() is called, e.g. when the graph changed.
+ * This class is not MT-safe.
+ **/
+class ViewerPrefetchQueue
+{
+public:
+
+    ViewerPrefetchQueue();
+
+    /**
+     * @brief Centers the queue on frame. aheadCount frames after the playhead and aheadCount / 2 frames before it,
+     * clamped to [first, last], are prefetched.
+     **/
+    void setPlayhead(int frame, int first, int last, int aheadCount);
+
+    int getPlayhead() const
+    {
+        return _playhead;
+    }
+
+    bool isPlayingForward() const
+    {
+        return _forward;
+    }
+
+    /**
+     * @brief Returns in frame the frame with the highest priority which is neither rendered nor being rendered,
+     * and marks it as being rendered. Returns false if there is no frame left to render.
+     **/
+    bool takeNextFrame(int* frame);
+
+    /**
+     * @brief Called when the render of a frame returned by takeNextFrame() finished. The frame is not rendered again
+     * until reset() is called, unless its render was aborted.
+     **/
+    void onFrameRendered(int frame, bool cached, bool aborted);
+
+    /**
+     * @brief Forgets the frames rendered so far.
+     **/
+    void reset();
+
+    bool isFrameCached(int frame) const;
+
+    /**
+     * @brief Returns the number of consecutive frames after the playhead which are cached.
+     **/
+    int getCachedAheadCount() const;
+
+private:
+
+    int _playhead;
+    bool _forward;
+    int _first, _last;
+    int _aheadCount;
+    std::set<int> _cachedFrames;
+    std::set<int> _renderedFrames; //< frames rendered, cached or not
+    std::set<int> _renderingFrames;
+};
+
+/**
+ * @brief Renders the frames around the playhead of a viewer into the viewer cache with the threads of the
+ * global thread pool left idle, so that scrubbing and playback display them from the cache.
+ * The number of frames is given by the "Frames prefetched around the playhead" setting.
+ * Prefetch renders never update the viewer and are aborted when the hash of the viewer changes.
+ * All functions must be called on the main thread, except getCachedAheadCount().
+ **/
+struct ViewerPrefetcherPrivate;
+class ViewerPrefetcher
+{
+public:
+
+    ViewerPrefetcher(ViewerInstance* viewer);
+
+    ~ViewerPrefetcher();
+
+    /**
+     * @brief Called when the viewer renders its current frame: re-centers the prefetch on frame and starts prefetching
+     * if threads are idle.
+     **/
+    void prefetchAround(int frame);
+
+    /**
+     * @brief Starts prefetching the remaining frames if threads are idle, e.g. after the viewer displayed its current frame.
+     **/
+    void startIdleRenders();
+
+    /**
+     * @brief Aborts the prefetch renders and stops prefetching until prefetchAround() is called.
+     **/
+    void abortPrefetch();
+
+    /**
+     * @brief Aborts the prefetch renders and blocks until they returned.
+     **/
+    void quitPrefetch();
+
+    /**
+     * @brief Returns the number of consecutive frames after the playhead which are in the viewer cache. MT-safe.
+     **/
+    int getCachedAheadCount() const;
+
+private:
+
+    std::shared_ptr<ViewerPrefetcherPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_ViewerPrefetcher_h
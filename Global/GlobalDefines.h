@@ -93,6 +93,15 @@ typedef OfxRangeD RangeD;
 
 #define kBgProcessServerCreatedShort "--bg_server_created"
 
+// A render worker (see --processes) asks for the next frames to render
+#define kFrameRangeRequestedShort "--frames_requested"
+
+// Followed by firstFrame-lastFrame:frameStep, the frames a render worker must render next
+#define kRenderFrameRangeShort "--render_frames"
+
+// There are no more frames to render, the render worker must exit
+#define kNoMoreFramesShort "--no_more_frames"
+
 //Increment this to wipe all disk cache structure and ensure that the user has a clean cache when starting the next version of Natron
 #define NATRON_CACHE_VERSION 4
 #define kNatronCacheVersionSettingsKey "NatronCacheVersionSettingsKey"
@@ -129,6 +129,12 @@ CLANG_DIAG_ON(uninitialized)
 #define kShortcutIDActionEnableRenderStats "enableRenderStats"
 #define kShortcutDescActionEnableRenderStats "Enable Render Statistics"
 
+#define kShortcutIDActionRecordRenderTrace "recordRenderTrace"
+#define kShortcutDescActionRecordRenderTrace "Record Render Trace"
+
+#define kShortcutIDActionExportRenderTrace "exportRenderTrace"
+#define kShortcutDescActionExportRenderTrace "Export Render Trace..."
+
 #define kShortcutIDActionRenderAll "renderAll"
 #define kShortcutDescActionRenderAll "Render All Writers"
 
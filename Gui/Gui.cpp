@@ -42,6 +42,7 @@ GCC_DIAG_UNUSED_PRIVATE_FIELD_ON
 
 #include "Engine/Node.h"
 #include "Engine/Project.h"
+#include "Engine/RenderTrace.h"
 #include "Engine/ViewerInstance.h"
 #include "Engine/Settings.h"
 
@@ -548,6 +549,14 @@ Gui::createMenuActions()
     _imp->enableRenderStats->setChecked(false);
     QObject::connect( _imp->enableRenderStats, SIGNAL(triggered()), this, SLOT(onEnableRenderStatsActionTriggered()) );
 
+    _imp->recordRenderTrace = new ActionWithShortcut(kShortcutGroupGlobal, kShortcutIDActionRecordRenderTrace, kShortcutDescActionRecordRenderTrace, this);
+    _imp->recordRenderTrace->setCheckable(true);
+    _imp->recordRenderTrace->setChecked( RenderTrace::isEnabled() );
+    QObject::connect( _imp->recordRenderTrace, SIGNAL(triggered()), this, SLOT(onRecordRenderTraceActionTriggered()) );
+
+    _imp->exportRenderTrace = new ActionWithShortcut(kShortcutGroupGlobal, kShortcutIDActionExportRenderTrace, kShortcutDescActionExportRenderTrace, this);
+    QObject::connect( _imp->exportRenderTrace, SIGNAL(triggered()), this, SLOT(exportRenderTrace()) );
+
     for (int c = 0; c < NATRON_MAX_RECENT_FILES; ++c) {
         _imp->actionsOpenRecentFile[c] = new QAction(this);
         _imp->actionsOpenRecentFile[c]->setVisible(false);
@@ -691,6 +700,9 @@ Gui::createMenuActions()
     _imp->menuRender->addAction(_imp->renderAllWriters);
     _imp->menuRender->addAction(_imp->renderSelectedNode);
     _imp->menuRender->addAction(_imp->enableRenderStats);
+    _imp->menuRender->addSeparator();
+    _imp->menuRender->addAction(_imp->recordRenderTrace);
+    _imp->menuRender->addAction(_imp->exportRenderTrace);
 
     _imp->cacheMenu->addAction(_imp->actionClearDiskCache);
     _imp->cacheMenu->addAction(_imp->actionClearPlayBackCache);
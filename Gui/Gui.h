@@ -308,6 +308,12 @@ public:
 
     void saveProjectGui(boost::archive::xml_oarchive & archive);
 
+    void loadProjectGui(bool isAutosave, boost::archive::binary_iarchive & obj) const;
+
+    void saveProjectGui(boost::archive::binary_oarchive & archive);
+
+    void saveProjectGui(ProjectGuiSerialization* serialization);
+
     void setColorPickersColor(double r, double g, double b, double a);
 
     void registerNewColorPicker(KnobColorPtr knob);
@@ -643,6 +649,10 @@ public Q_SLOTS:
 
     void onEnableRenderStatsActionTriggered();
 
+    void onRecordRenderTraceActionTriggered();
+
+    void exportRenderTrace();
+
     void onMaxVisibleDockablePanelChanged(int maxPanels);
 
     void clearAllVisiblePanels();
@@ -60,6 +60,7 @@
 #include "Gui/NodeGraph.h"
 #include "Gui/NodeGui.h"
 #include "Gui/ProjectGui.h"
+#include "Gui/ProjectGuiSerialization.h"
 #include "Gui/SequenceFileDialog.h"
 #include "Gui/Splitter.h"
 #include "Gui/TabWidget.h"
@@ -1472,6 +1473,27 @@ Gui::saveProjectGui(boost::archive::xml_oarchive & archive)
     _imp->_projectGui->save(archive);
 }
 
+void
+Gui::loadProjectGui(bool isAutosave, boost::archive::binary_iarchive & obj) const
+{
+    assert(_imp->_projectGui);
+    _imp->_projectGui->load(isAutosave, obj);
+}
+
+void
+Gui::saveProjectGui(boost::archive::binary_oarchive & archive)
+{
+    assert(_imp->_projectGui);
+    _imp->_projectGui->save(archive);
+}
+
+void
+Gui::saveProjectGui(ProjectGuiSerialization* serialization)
+{
+    assert(_imp->_projectGui);
+    serialization->initialize(_imp->_projectGui);
+}
+
 bool
 Gui::isAboutToClose() const
 {
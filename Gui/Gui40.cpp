@@ -51,6 +51,7 @@
 #include "Engine/Node.h"
 #include "Engine/Project.h"
 #include "Engine/ProcessHandler.h"
+#include "Engine/RenderTrace.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/ViewerInstance.h"
 
@@ -67,10 +68,13 @@
 #include "Gui/Splitter.h"
 #include "Gui/TabWidget.h"
 #include "Gui/ScriptEditor.h"
+#include "Gui/SequenceFileDialog.h"
 #include "Gui/ViewerGL.h"
 #include "Gui/ViewerTab.h"
 #include "Gui/NodeSettingsPanel.h"
 
+#include "Global/QtCompat.h" // removeFileExtension
+
 
 NATRON_NAMESPACE_ENTER
 
@@ -947,6 +951,48 @@ Gui::onEnableRenderStatsActionTriggered()
     }
 }
 
+void
+Gui::onRecordRenderTraceActionTriggered()
+{
+    assert( QThread::currentThread() == qApp->thread() );
+
+    bool checked = _imp->recordRenderTrace->isChecked();
+    if (checked) {
+        // Start a new trace
+        RenderTrace::clear();
+    }
+    RenderTrace::setEnabled(checked);
+}
+
+void
+Gui::exportRenderTrace()
+{
+    // Stop recording so that the trace is complete: the threads would otherwise overwrite their oldest spans while
+    // the trace is written
+    if ( _imp->recordRenderTrace->isChecked() ) {
+        _imp->recordRenderTrace->setChecked(false);
+        RenderTrace::setEnabled(false);
+    }
+
+    std::vector<std::string> filters;
+
+    filters.push_back("json");
+    SequenceFileDialog dialog( this, filters, false, SequenceFileDialog::eFileDialogModeSave, _imp->_lastSaveProjectOpenedDir.toStdString(), this, false );
+    if ( dialog.exec() ) {
+        std::string filename = dialog.filesToSave();
+        QString filenameCpy( QString::fromUtf8( filename.c_str() ) );
+        QString ext = QtCompat::removeFileExtension(filenameCpy);
+        if ( ext != QString::fromUtf8("json") ) {
+            filename.append(".json");
+        }
+
+        std::string error;
+        if ( !RenderTrace::writeChromeTrace(filename, &error) ) {
+            Dialogs::errorDialog( tr("Error").toStdString(), error, false );
+        }
+    }
+}
+
 void
 Gui::onTimelineTimeAboutToChange()
 {
@@ -33,6 +33,13 @@
 #include <QtCore/QMutex>
 #include <QtCore/QCoreApplication>
 
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
+GCC_DIAG_OFF(unused-parameter)
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+GCC_DIAG_ON(unused-parameter)
+
 #include "Engine/CLArgs.h"
 #include "Engine/Project.h"
 #include "Engine/CreateNodeArgs.h"
@@ -61,6 +68,7 @@
 #include "Gui/KnobGuiFile.h"
 #include "Gui/MultiInstancePanel.h"
 #include "Gui/ProgressPanel.h"
+#include "Gui/ProjectGuiSerialization.h"
 #include "Gui/ViewerTab.h"
 #include "Gui/SplashScreen.h"
 #include "Gui/ScriptEditor.h"
@@ -796,6 +804,66 @@ GuiAppInstance::saveProjectGui(boost::archive::xml_oarchive & archive)
     }
 }
 
+void
+GuiAppInstance::loadProjectGui(bool isAutosave, boost::archive::binary_iarchive & archive) const
+{
+    _imp->_gui->loadProjectGui(isAutosave, archive);
+}
+
+void
+GuiAppInstance::saveProjectGui(boost::archive::binary_oarchive & archive)
+{
+    if (_imp->_gui) {
+        _imp->_gui->saveProjectGui(archive);
+    }
+}
+
+ProjectGuiSerializationPtr
+GuiAppInstance::captureProjectGui()
+{
+    if (!_imp->_gui) {
+        return ProjectGuiSerializationPtr();
+    }
+    ProjectGuiSerializationPtr serialization = std::make_shared<ProjectGuiSerialization>();
+    _imp->_gui->saveProjectGui( serialization.get() );
+
+    return serialization;
+}
+
+ProjectGuiSerializationPtr
+GuiAppInstance::readProjectGui(boost::archive::xml_iarchive & archive) const
+{
+    ProjectGuiSerializationPtr serialization = std::make_shared<ProjectGuiSerialization>();
+
+    archive >> boost::serialization::make_nvp("ProjectGui", *serialization);
+
+    return serialization;
+}
+
+ProjectGuiSerializationPtr
+GuiAppInstance::readProjectGui(boost::archive::binary_iarchive & archive) const
+{
+    ProjectGuiSerializationPtr serialization = std::make_shared<ProjectGuiSerialization>();
+
+    archive >> boost::serialization::make_nvp("ProjectGui", *serialization);
+
+    return serialization;
+}
+
+void
+GuiAppInstance::writeProjectGui(boost::archive::xml_oarchive & archive,
+                                const ProjectGuiSerialization& serialization) const
+{
+    archive << boost::serialization::make_nvp("ProjectGui", serialization);
+}
+
+void
+GuiAppInstance::writeProjectGui(boost::archive::binary_oarchive & archive,
+                                const ProjectGuiSerialization& serialization) const
+{
+    archive << boost::serialization::make_nvp("ProjectGui", serialization);
+}
+
 void
 GuiAppInstance::setupViewersForViews(const std::vector<std::string>& viewNames)
 {
@@ -133,6 +133,13 @@ public:
                                               bool* stopAsking) OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual void loadProjectGui(bool isAutosave,  boost::archive::xml_iarchive & archive) const OVERRIDE FINAL;
     virtual void saveProjectGui(boost::archive::xml_oarchive & archive) OVERRIDE FINAL;
+    virtual void loadProjectGui(bool isAutosave,  boost::archive::binary_iarchive & archive) const OVERRIDE FINAL;
+    virtual void saveProjectGui(boost::archive::binary_oarchive & archive) OVERRIDE FINAL;
+    virtual ProjectGuiSerializationPtr captureProjectGui() OVERRIDE FINAL;
+    virtual ProjectGuiSerializationPtr readProjectGui(boost::archive::xml_iarchive & archive) const OVERRIDE FINAL;
+    virtual ProjectGuiSerializationPtr readProjectGui(boost::archive::binary_iarchive & archive) const OVERRIDE FINAL;
+    virtual void writeProjectGui(boost::archive::xml_oarchive & archive, const ProjectGuiSerialization& serialization) const OVERRIDE FINAL;
+    virtual void writeProjectGui(boost::archive::binary_oarchive & archive, const ProjectGuiSerialization& serialization) const OVERRIDE FINAL;
     virtual void notifyRenderStarted(const QString & sequenceName,
                                      int firstFrame, int lastFrame,
                                      int frameStep, bool canPause,
@@ -166,6 +166,8 @@ GuiPrivate::GuiPrivate(const GuiAppInstancePtr& app,
     , renderAllWriters(0)
     , renderSelectedNode(0)
     , enableRenderStats(0)
+    , recordRenderTrace(0)
+    , exportRenderTrace(0)
     , actionConnectInput()
     , actionImportLayout(0)
     , actionExportLayout(0)
@@ -119,6 +119,8 @@ public:
     ActionWithShortcut *renderAllWriters;
     ActionWithShortcut *renderSelectedNode;
     ActionWithShortcut *enableRenderStats;
+    ActionWithShortcut *recordRenderTrace;
+    ActionWithShortcut *exportRenderTrace;
     ActionWithShortcut* actionConnectInput[NATRON_CONNECT_INPUT_NB];
     ActionWithShortcut* actionImportLayout;
     ActionWithShortcut* actionExportLayout;
@@ -26,6 +26,7 @@
 #include "Histogram.h"
 
 #include <algorithm> // min, max
+#include <cmath>
 #include <stdexcept>
 
 #include <QHBoxLayout>
@@ -171,6 +172,8 @@ public:
 
 #else
     void drawHistogramCPU();
+
+    void drawScopeCPU();
 #endif
 
     //////////////////////////////////
@@ -379,6 +382,18 @@ Histogram::Histogram(Gui* gui,
     bAction->setText( QString::fromUtf8("B") );
     bAction->setData(5);
     _imp->modeActions->addAction(bAction);
+
+#ifndef NATRON_HISTOGRAM_USING_OPENGL
+    QAction* waveformAction = new QAction(_imp->modeMenu);
+    waveformAction->setText( tr("Waveform") );
+    waveformAction->setData(6);
+    _imp->modeActions->addAction(waveformAction);
+
+    QAction* vectorscopeAction = new QAction(_imp->modeMenu);
+    vectorscopeAction->setText( tr("Vectorscope") );
+    vectorscopeAction->setData(7);
+    _imp->modeActions->addAction(vectorscopeAction);
+#endif
     QList<QAction*> actions = _imp->modeActions->actions();
     for (int i = 0; i < actions.size(); ++i) {
         _imp->modeMenu->addAction( actions.at(i) );
@@ -1193,15 +1208,25 @@ Histogram::paintGL()
         glClear(GL_COLOR_BUFFER_BIT);
         glCheckErrorIgnoreOSXBug();
 
-        _imp->drawScale();
-        glCheckError();
+        // the scopes have their own axes: the scale and the pickers only apply to the histograms
+        bool isScope = _imp->mode == eDisplayModeWaveform || _imp->mode == eDisplayModeVectorscope;
+        if (!isScope) {
+            _imp->drawScale();
+            glCheckError();
+        }
 
         if (_imp->hasImage) {
 #ifndef NATRON_HISTOGRAM_USING_OPENGL
-            _imp->drawHistogramCPU();
+            if (isScope) {
+                _imp->drawScopeCPU();
+            } else {
+                _imp->drawHistogramCPU();
+            }
             glCheckError();
 #endif
-            if (_imp->drawCoordinates) {
+            if (isScope) {
+                // no picker
+            } else if (_imp->drawCoordinates) {
                 _imp->drawPicker();
                 glCheckError();
             }
@@ -1209,7 +1234,7 @@ Histogram::paintGL()
             _imp->drawWarnings();
             glCheckError();
 
-            if (_imp->showViewerPicker) {
+            if (_imp->showViewerPicker && !isScope) {
                 _imp->drawViewerPicker();
                 glCheckError();
             }
@@ -1368,6 +1393,8 @@ HistogramPrivate::updatePicker(double x)
     } else if (mode == Histogram::eDisplayModeB) {
         float b = histogram1[index];
         bValueStr = QString::fromUtf8("b=") + QString::number(b);
+    } else if ( (mode == Histogram::eDisplayModeWaveform) || (mode == Histogram::eDisplayModeVectorscope) ) {
+        // the scopes have no picker
     } else {
         assert(false);
     }
@@ -1532,6 +1559,11 @@ Histogram::computeHistogramAndRefresh(bool forceEvenIfNotVisible)
     RectI rect;
     ImagePtr image = _imp->getHistogramImage(&rect);
     if (image) {
+        if ( (_imp->mode == eDisplayModeWaveform) || (_imp->mode == eDisplayModeVectorscope) ) {
+            // the scopes always show the [0, 1] range
+            vmin = 0.;
+            vmax = 1.;
+        }
         _imp->histogramThread.computeHistogram(_imp->mode, image, rect, width(), vmin, vmax, _imp->filterSize);
     } else {
         _imp->hasImage = false;
@@ -2022,6 +2054,89 @@ HistogramPrivate::drawHistogramCPU()
     glCheckError();
 } // drawHistogramCPU
 
+void
+HistogramPrivate::drawScopeCPU()
+{
+    // always running in the main thread
+    assert( qApp && qApp->thread() == QThread::currentThread() );
+    assert( QOpenGLContext::currentContext() == widget->context() );
+
+    // see HistogramCPU::getMostRecentlyProducedHistogram()
+    const int rows = NATRON_HISTOGRAM_SCOPE_ROWS;
+    const int columns = (mode == Histogram::eDisplayModeWaveform) ? (int)binsCount : NATRON_HISTOGRAM_SCOPE_ROWS;
+    if ( (columns <= 0) || ( histogram1.size() != (std::size_t)rows * columns ) ) {
+        // the scope of the current mode was not produced yet
+        return;
+    }
+    float maxCount = *std::max_element( histogram1.begin(), histogram1.end() );
+    if (maxCount <= 0) {
+        return;
+    }
+    // use a log scale, otherwise only the few most frequent values would be visible
+    double logMaxCount = std::log(1. + maxCount);
+
+    // the scope fills the widget, with the lowest values at the bottom
+    QPointF topLeft = zoomCtx.toZoomCoordinates(0, 0);
+    QPointF btmRight = zoomCtx.toZoomCoordinates( widget->width(), widget->height() );
+    double binWidth = ( btmRight.x() - topLeft.x() ) / columns;
+    double binHeight = ( topLeft.y() - btmRight.y() ) / rows;
+
+    glCheckError();
+    {
+        GLProtectAttrib a(GL_COLOR_BUFFER_BIT | GL_LINE_BIT | GL_CURRENT_BIT | GL_ENABLE_BIT);
+
+        glEnable(GL_BLEND);
+        glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_ADD);
+        glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
+
+        glBegin(GL_QUADS);
+        for (int y = 0; y < rows; ++y) {
+            double binMinY = btmRight.y() + y * binHeight;
+            for (int x = 0; x < columns; ++x) {
+                float count = histogram1[y * columns + x];
+                if (count <= 0) {
+                    continue;
+                }
+                double intensity = std::log(1. + count) / logMaxCount;
+                if (mode == Histogram::eDisplayModeVectorscope) {
+                    // the color of the chroma at half luminance
+                    double cb = (x + 0.5) / columns - 0.5;
+                    double cr = (y + 0.5) / rows - 0.5;
+                    double r = std::max( 0., std::min(1., 0.5 + 1.402 * cr) );
+                    double g = std::max( 0., std::min(1., 0.5 - 0.344136 * cb - 0.714136 * cr) );
+                    double b = std::max( 0., std::min(1., 0.5 + 1.772 * cb) );
+                    glColor3f(r * intensity, g * intensity, b * intensity);
+                } else {
+                    glColor3f(0.398979 * intensity, 0.654707 * intensity, 0.398979 * intensity);
+                }
+                double binMinX = topLeft.x() + x * binWidth;
+                glVertex2d(binMinX, binMinY);
+                glVertex2d(binMinX + binWidth, binMinY);
+                glVertex2d(binMinX + binWidth, binMinY + binHeight);
+                glVertex2d(binMinX, binMinY + binHeight);
+            }
+        }
+        glEnd(); // GL_QUADS
+        glCheckErrorIgnoreOSXBug();
+
+        if (mode == Histogram::eDisplayModeVectorscope) {
+            // the neutral axes
+            double midX = ( topLeft.x() + btmRight.x() ) / 2.;
+            double midY = ( topLeft.y() + btmRight.y() ) / 2.;
+            glColor3f(0.398979, 0.398979, 0.398979);
+            glLineWidth(1. * _screenPixelRatio);
+            glBegin(GL_LINES);
+            glVertex2d( midX, btmRight.y() );
+            glVertex2d( midX, topLeft.y() );
+            glVertex2d( topLeft.x(), midY );
+            glVertex2d( btmRight.x(), midY );
+            glEnd();
+            glCheckErrorIgnoreOSXBug();
+        }
+    } // GLProtectAttrib a(GL_COLOR_BUFFER_BIT | GL_LINE_BIT | GL_CURRENT_BIT | GL_ENABLE_BIT);
+    glCheckError();
+} // drawScopeCPU
+
 #endif // ifndef NATRON_HISTOGRAM_USING_OPENGL
 
 void
@@ -62,7 +62,9 @@ public:
         eDisplayModeY,
         eDisplayModeR,
         eDisplayModeG,
-        eDisplayModeB
+        eDisplayModeB,
+        eDisplayModeWaveform,
+        eDisplayModeVectorscope
     };
 
     Histogram(Gui* gui,
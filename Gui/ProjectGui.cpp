@@ -38,6 +38,13 @@ CLANG_DIAG_OFF(uninitialized)
 CLANG_DIAG_ON(deprecated)
 CLANG_DIAG_ON(uninitialized)
 
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
+GCC_DIAG_OFF(unused-parameter)
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+GCC_DIAG_ON(unused-parameter)
+
 
 #include "Engine/Backdrop.h"
 #include "Engine/CreateNodeArgs.h"
@@ -262,9 +269,9 @@ AddFormatDialog::getFormat() const
 }
 
 // Version is handled in ProjectGuiSerialization
-template<>
+template<class Archive>
 void
-ProjectGui::save<boost::archive::xml_oarchive>(boost::archive::xml_oarchive & archive) const
+ProjectGui::save(Archive & archive) const
 {
     ProjectGuiSerialization projectGuiSerializationObj;
 
@@ -430,9 +437,10 @@ loadNodeGuiSerialization(Gui* gui,
     }
 } // loadNodeGuiSerialization
 
-template<>
+template<class Archive>
 void
-ProjectGui::load<boost::archive::xml_iarchive>(bool isAutosave,  boost::archive::xml_iarchive & archive)
+ProjectGui::load(bool isAutosave,
+                 Archive & archive)
 {
     ProjectGuiSerialization obj;
 
@@ -593,6 +601,13 @@ ProjectGui::load<boost::archive::xml_iarchive>(bool isAutosave,  boost::archive:
     _gui->centerAllNodeGraphsWithTimer();
 } // load
 
+// explicit template instantiations for the XML and binary project formats
+
+template void ProjectGui::save<boost::archive::xml_oarchive>(boost::archive::xml_oarchive & archive) const;
+template void ProjectGui::save<boost::archive::binary_oarchive>(boost::archive::binary_oarchive & archive) const;
+template void ProjectGui::load<boost::archive::xml_iarchive>(bool isAutosave, boost::archive::xml_iarchive & archive);
+template void ProjectGui::load<boost::archive::binary_iarchive>(bool isAutosave, boost::archive::binary_iarchive & archive);
+
 NodesGuiList
 ProjectGui::getVisibleNodes() const
 {
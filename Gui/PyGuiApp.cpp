@@ -33,6 +33,8 @@ CLANG_DIAG_OFF(uninitialized)
 CLANG_DIAG_ON(deprecated)
 CLANG_DIAG_ON(uninitialized)
 
+#include "Engine/Image.h"
+#include "Engine/ImageScopes.h"
 #include "Engine/Node.h"
 #include "Engine/NodeGroup.h"
 #include "Engine/PyNodeGroup.h"
@@ -884,5 +886,77 @@ PyViewer::getCurrentView() const
     return _viewer->getCurrentView().value();
 }
 
+/**
+ * @brief Returns the last image rendered by the viewer for the given input at the current zoom level, or null.
+ **/
+static ImagePtr
+getViewerLastRenderedImage(ViewerTab* viewer,
+                           int inputIndex)
+{
+    if ( (inputIndex < 0) || (inputIndex > 1) ) {
+        return ImagePtr();
+    }
+
+    return viewer->getViewer()->getLastRenderedImageByMipmapLevel( inputIndex, viewer->getInternalNode()->getMipmapLevelFromZoomFactor() );
+}
+
+std::vector<double>
+PyViewer::getHistogram(DisplayChannelsEnum channel,
+                       int binsCount,
+                       double vmin,
+                       double vmax,
+                       int inputIndex) const
+{
+    if ( !getInternalNode()->isActivated() ) {
+        return std::vector<double>();
+    }
+    ImagePtr image = getViewerLastRenderedImage(_viewer, inputIndex);
+    if (!image) {
+        return std::vector<double>();
+    }
+    std::vector<std::vector<float> > histograms;
+    ImageScopes::computeHistograms(image, image->getBounds(), std::vector<DisplayChannelsEnum>(1, channel), binsCount, vmin, vmax, &histograms);
+
+    return std::vector<double>( histograms[0].begin(), histograms[0].end() );
+}
+
+std::vector<double>
+PyViewer::getWaveform(DisplayChannelsEnum channel,
+                      int columnsCount,
+                      int binsCount,
+                      double vmin,
+                      double vmax,
+                      int inputIndex) const
+{
+    if ( !getInternalNode()->isActivated() ) {
+        return std::vector<double>();
+    }
+    ImagePtr image = getViewerLastRenderedImage(_viewer, inputIndex);
+    if (!image) {
+        return std::vector<double>();
+    }
+    std::vector<float> waveform;
+    ImageScopes::computeWaveform(image, image->getBounds(), channel, columnsCount, binsCount, vmin, vmax, &waveform);
+
+    return std::vector<double>( waveform.begin(), waveform.end() );
+}
+
+std::vector<double>
+PyViewer::getVectorscope(int size,
+                         int inputIndex) const
+{
+    if ( !getInternalNode()->isActivated() ) {
+        return std::vector<double>();
+    }
+    ImagePtr image = getViewerLastRenderedImage(_viewer, inputIndex);
+    if (!image) {
+        return std::vector<double>();
+    }
+    std::vector<float> vectorscope;
+    ImageScopes::computeVectorscope(image, image->getBounds(), size, &vectorscope);
+
+    return std::vector<double>( vectorscope.begin(), vectorscope.end() );
+}
+
 NATRON_PYTHON_NAMESPACE_EXIT
 NATRON_NAMESPACE_EXIT
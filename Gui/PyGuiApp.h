@@ -107,6 +107,26 @@ public:
 
     /* Python API: do not use ViewIdx */
     int getCurrentView() const;
+
+    /*
+     * The scopes of the last image rendered by the viewer for its A (inputIndex = 0) or B (inputIndex = 1) input,
+     * see ImageScopes. They are empty if there is no such image.
+     */
+    std::vector<double> getHistogram(NATRON_ENUM::DisplayChannelsEnum channel,
+                                     int binsCount = 256,
+                                     double vmin = 0.,
+                                     double vmax = 1.,
+                                     int inputIndex = 0) const;
+
+    std::vector<double> getWaveform(NATRON_ENUM::DisplayChannelsEnum channel,
+                                    int columnsCount = 256,
+                                    int binsCount = 256,
+                                    double vmin = 0.,
+                                    double vmax = 1.,
+                                    int inputIndex = 0) const;
+
+    std::vector<double> getVectorscope(int size = 256,
+                                       int inputIndex = 0) const;
 };
 
 class GuiApp
@@ -4345,6 +4345,14 @@ ViewerGL::getColorAt(double x,
                                               dstColorSpace,
                                               r, g, b, a);
         break;
+    case eImageBitDepthHalf:
+        gotval = getColorAtInternal<Half, 1>(image,
+                                             xPixel, yPixel,
+                                             forceLinear,
+                                             srcColorSpace,
+                                             dstColorSpace,
+                                             r, g, b, a);
+        break;
     default:
         gotval = false;
         break;
@@ -4512,6 +4520,12 @@ ViewerGL::getColorAtRect(const RectD &rect, // rectangle in canonical coordinate
                                                                    &rPix, &gPix, &bPix, &aPix);
                 break;
             case eImageBitDepthHalf:
+                gotval = getColorAtInternal<Half, 1>(image,
+                                                     xPixel, yPixel,
+                                                     forceLinear,
+                                                     srcColorSpace,
+                                                     dstColorSpace,
+                                                     &rPix, &gPix, &bPix, &aPix);
                 break;
             case eImageBitDepthFloat:
                 gotval = getColorAtInternal<float, 1>(image,
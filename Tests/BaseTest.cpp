@@ -25,11 +25,23 @@
 
 #include "Global/Macros.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include "BaseTest.h"
 
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QThread>
 #include <QtCore/QThreadPool>
 
 // ofxhPropertySuite.h:565:37: warning: 'this' pointer cannot be null in well-defined C++ code; comparison may be assumed to always evaluate to true [-Wtautological-undefined-compare]
@@ -49,14 +61,29 @@ CLANG_DIAG_ON(unknown-pragmas)
 #include "Engine/CreateNodeArgs.h"
 #include "Engine/Node.h"
 #include "Engine/Project.h"
+#include "Engine/ProjectSerialization.h" // NATRON_PROJECT_BINARY_MAGIC
 #include "Engine/AppManager.h"
 #include "Engine/AppInstance.h"
 #include "Engine/KnobTypes.h"
+#include "Engine/KnobFile.h"
 #include "Engine/EffectInstance.h"
+#include "Engine/OutputEffectInstance.h"
 #include "Engine/Plugin.h"
 #include "Engine/Curve.h"
 #include "Engine/CLArgs.h"
 #include "Engine/ViewIdx.h"
+#include "Engine/Image.h"
+#include "Engine/ImageParams.h"
+#include "Engine/Settings.h"
+#include "Engine/AbortableRenderInfo.h"
+#include "Engine/KnobValuesSnapshot.h"
+#include "Engine/ParallelRenderArgs.h"
+#include "Engine/TLSHolder.h"
+#include "Engine/RotoContext.h"
+#include "Engine/RotoShapeRasterizer.h"
+#include "Engine/Bezier.h"
+#include "Engine/BezierCP.h"
+#include "Engine/Transform.h"
 
 NATRON_NAMESPACE_USING
 
@@ -283,6 +310,117 @@ TEST_F(BaseTest, GenerateDot)
     QFile::remove(filePath);
 }
 
+static AppInstance::RenderWork
+makeRenderWork(const NodePtr& writer,
+               int firstFrame,
+               int lastFrame)
+{
+    AppInstance::RenderWork w;
+
+    w.writer = dynamic_cast<OutputEffectInstance*>( writer->getEffectInstance().get() );
+    assert(w.writer);
+    w.firstFrame = firstFrame;
+    w.lastFrame = lastFrame;
+    w.frameStep = 1;
+    w.useRenderStats = false;
+
+    return w;
+}
+
+// Returns the content of the file rendered by a writer with the given file name prefix at the given frame
+static QByteArray
+readRenderedFrame(const QString& dirPath,
+                  const char* prefix,
+                  int frame)
+{
+    QFile file( dirPath + QString::fromUtf8("/%1_%2.jpg").arg( QString::fromUtf8(prefix) ).arg(frame, 3, 10, QLatin1Char('0')) );
+
+    if ( !file.open(QIODevice::ReadOnly) ) {
+        return QByteArray();
+    }
+
+    return file.readAll();
+}
+
+// Writers sharing their upstream nodes are rendered in a single pass by the first of them: every writer of the group
+// still renders all its frames, with the same result as when the writers are rendered one after the other. A writer
+// rendering another frame range is rendered on its own.
+TEST_F(BaseTest, WritersSharingNodes)
+{
+    KnobBool* renderTogether = dynamic_cast<KnobBool*>( appPTR->getCurrentSettings()->getKnobByName("renderWritersTogether").get() );
+    ASSERT_TRUE(renderTogether != 0);
+    const bool renderTogetherWasEnabled = renderTogether->getValue();
+
+    QTemporaryDir dir;
+    ASSERT_TRUE( dir.isValid() );
+    const QString dirPath = dir.path();
+    const int firstFrame = 1;
+    const int lastFrame = 3;
+
+    Format f(0, 0, 64, 48, "WritersSharingNodes", 1.);
+    getApp()->getProject()->setOrAddProjectFormat(f);
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    KnobDouble* slope = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZSlope").get() );
+    ASSERT_TRUE(slope != 0);
+    slope->setValue(0.5);
+
+    const char* const prefixes[] = { "leader", "shared", "ownRange" };
+    std::vector<NodePtr> writers;
+    for (int i = 0; i < 3; ++i) {
+        NodePtr writer = createNode(_writeOIIOPluginID);
+        ASSERT_TRUE(writer);
+        writer->setOutputFilesForWriter( ( dirPath + QString::fromUtf8("/%1_###.jpg").arg( QString::fromUtf8(prefixes[i]) ) ).toStdString() );
+        connectNodes(generator, writer, 0, true);
+        writers.push_back(writer);
+    }
+
+    std::vector<std::vector<QByteArray> > frames[2];
+    for (int pass = 0; pass < 2; ++pass) {
+        // The first pass renders the writers one after the other, the second one in a single pass
+        renderTogether->setValue(pass == 1);
+        appPTR->clearNodeCache();
+
+        std::list<AppInstance::RenderWork> works;
+        works.push_back( makeRenderWork(writers[0], firstFrame, lastFrame) );
+        works.push_back( makeRenderWork(writers[1], firstFrame, lastFrame) );
+        works.push_back( makeRenderWork(writers[2], firstFrame, lastFrame - 1) );
+        getApp()->startWritersRendering(true, works);
+
+        frames[pass].resize( writers.size() );
+        for (std::size_t i = 0; i < writers.size(); ++i) {
+            for (int frame = firstFrame; frame <= lastFrame; ++frame) {
+                frames[pass][i].push_back( readRenderedFrame(dirPath, prefixes[i], frame) );
+                QFile::remove( dirPath + QString::fromUtf8("/%1_%2.jpg").arg( QString::fromUtf8(prefixes[i]) ).arg(frame, 3, 10, QLatin1Char('0')) );
+            }
+        }
+
+        // The group is only set for the duration of the render
+        for (std::size_t i = 0; i < writers.size(); ++i) {
+            OutputEffectInstance* writer = dynamic_cast<OutputEffectInstance*>( writers[i]->getEffectInstance().get() );
+            EXPECT_TRUE( writer->getRenderGroupWriters().empty() );
+        }
+    }
+
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int frame = 0; frame <= lastFrame - firstFrame; ++frame) {
+            EXPECT_FALSE( frames[pass][0][frame].isEmpty() ) << "pass " << pass << " frame " << frame;
+            // The writers read the same image
+            EXPECT_TRUE(frames[pass][1][frame] == frames[pass][0][frame]) << "pass " << pass << " frame " << frame;
+            if (frame < lastFrame - firstFrame) {
+                EXPECT_TRUE(frames[pass][2][frame] == frames[pass][0][frame]) << "pass " << pass << " frame " << frame;
+            } else {
+                // Outside of the range of the writer
+                EXPECT_TRUE( frames[pass][2][frame].isEmpty() );
+            }
+            // A single pass gives the same result
+            EXPECT_TRUE(frames[1][0][frame] == frames[0][0][frame]) << "frame " << frame;
+        }
+    }
+
+    renderTogether->setValue(renderTogetherWasEnabled);
+}
+
 TEST_F(BaseTest, SetValues)
 {
     NodePtr generator = createNode(_generatorPluginID);
@@ -323,3 +461,991 @@ TEST_F(BaseTest, SimpleNodeConnections) {
     disconnectNodes(generator, writer, false);
     connectNodes(generator, writer, 0, true);
 }
+
+///Setting back a parameter to its previous value must give back the previous node hash and the images cached with it
+TEST_F(BaseTest, ContentBasedHashRoundTrip)
+{
+    KnobBool* contentBasedHash = dynamic_cast<KnobBool*>( appPTR->getCurrentSettings()->getKnobByName("contentBasedNodeHash").get() );
+    ASSERT_TRUE(contentBasedHash != 0);
+    contentBasedHash->setValue(true);
+
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    KnobDouble* slope = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZSlope").get() );
+    ASSERT_TRUE(slope != 0);
+
+    generator->computeHash();
+    double originalValue = slope->getValue();
+    U64 originalHash = generator->getHashValue();
+
+    RectD rod(0, 0, 16, 16);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    ImageKey keptKey(generator.get(), originalHash, false, 0, ViewIdx(0), 1., false, false);
+    ImageKey staleKey(generator.get(), originalHash + 1, false, 0, ViewIdx(0), 1., false, false);
+    ImagePtr image;
+    appPTR->getImageOrCreate(keptKey, params, &image);
+    ASSERT_TRUE(image);
+    appPTR->getImageOrCreate(staleKey, params, &image);
+    ASSERT_TRUE(image);
+    image.reset();
+
+    slope->setValue(originalValue + 0.5);
+    EXPECT_NE( originalHash, generator->getHashValue() );
+
+    slope->setValue(originalValue);
+    EXPECT_EQ( originalHash, generator->getHashValue() );
+
+    // Images are removed asynchronously, once the event loop is reached: wait for the image of a hash that is not kept to be gone
+    std::list<ImagePtr> images;
+    for (int i = 0; i < 500 && appPTR->getImage(staleKey, &images); ++i) {
+        images.clear();
+        QCoreApplication::processEvents();
+        QThread::msleep(10);
+    }
+    images.clear();
+    EXPECT_FALSE( appPTR->getImage(staleKey, &images) );
+    images.clear();
+    EXPECT_TRUE( appPTR->getImage(keptKey, &images) );
+
+    contentBasedHash->setValue(false);
+    appPTR->clearNodeCache();
+}
+
+TEST_F(BaseTest, ContentBasedHashDownstream)
+{
+    KnobBool* contentBasedHash = dynamic_cast<KnobBool*>( appPTR->getCurrentSettings()->getKnobByName("contentBasedNodeHash").get() );
+    ASSERT_TRUE(contentBasedHash != 0);
+    contentBasedHash->setValue(true);
+
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    NodePtr writer = createNode(_writeOIIOPluginID);
+    ASSERT_TRUE(writer);
+    connectNodes(generator, writer, 0, true);
+
+    KnobDouble* slope = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZSlope").get() );
+    ASSERT_TRUE(slope != 0);
+    KnobOutputFile* filename = dynamic_cast<KnobOutputFile*>( writer->getKnobByName(kOfxImageEffectFileParamName).get() );
+    ASSERT_TRUE(filename != 0);
+    filename->setValue( std::string("test_###.exr") );
+
+    generator->computeHash();
+    U64 originalHash = writer->getHashValue();
+
+    // The writer knobs hash is cached: an upstream change must still be reflected in its hash
+    double originalSlope = slope->getValue();
+    slope->setValue(originalSlope + 0.5);
+    EXPECT_NE( originalHash, writer->getHashValue() );
+    EXPECT_EQ( 2, generator->getHashPropagationNodesVisited() );
+    EXPECT_EQ( 2, writer->getHashPropagationNodesVisited() );
+    slope->setValue(originalSlope);
+    EXPECT_EQ( originalHash, writer->getHashValue() );
+
+    // Changing a knob of the writer invalidates its cached knobs hash
+    filename->setValue( std::string("other_###.exr") );
+    EXPECT_NE( originalHash, writer->getHashValue() );
+    EXPECT_EQ( 1, writer->getHashPropagationNodesVisited() );
+    filename->setValue( std::string("test_###.exr") );
+    EXPECT_EQ( originalHash, writer->getHashValue() );
+
+    contentBasedHash->setValue(false);
+}
+
+static int
+countKeyFrames(const NodesList& nodes)
+{
+    int nKeys = 0;
+
+    for (NodesList::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+        const KnobsVec& knobs = (*it)->getEffectInstance()->getKnobs();
+        for (KnobsVec::const_iterator it2 = knobs.begin(); it2 != knobs.end(); ++it2) {
+            if ( !(*it2)->canAnimate() ) {
+                continue;
+            }
+            for (int d = 0; d < (*it2)->getDimension(); ++d) {
+                nKeys += (*it2)->getCurve(ViewIdx(0), d)->getKeyFramesCount();
+            }
+        }
+    }
+
+    return nKeys;
+}
+
+void
+BaseTest::createAnimatedGenerators(int nNodes,
+                                   int nKeyFrames)
+{
+    for (int i = 0; i < nNodes; ++i) {
+        NodePtr generator = createNode(_generatorPluginID);
+        ASSERT_TRUE(generator);
+        const KnobsVec& knobs = generator->getEffectInstance()->getKnobs();
+        for (KnobsVec::const_iterator it = knobs.begin(); it != knobs.end(); ++it) {
+            KnobDouble* isDouble = dynamic_cast<KnobDouble*>( it->get() );
+            if ( !isDouble || !isDouble->canAnimate() || isDouble->getIsSecret() ) {
+                continue;
+            }
+            for (int d = 0; d < isDouble->getDimension(); ++d) {
+                CurvePtr curve = isDouble->getCurve(ViewIdx(0), d);
+                for (int t = 0; t < nKeyFrames; ++t) {
+                    curve->addKeyFrame( KeyFrame( t, std::sin(t * 0.01 + i + d) ) );
+                }
+            }
+        }
+    }
+}
+
+///Save and load an animated project in the XML and binary formats, then convert it back to XML
+TEST_F(BaseTest, ProjectFileFormatsLoadSave)
+{
+    const int nNodes = 10;
+    const int nKeyFrames = 100;
+    ProjectPtr project = getApp()->getProject();
+
+    createAnimatedGenerators(nNodes, nKeyFrames);
+    const int nKeys = countKeyFrames( project->getNodes() );
+    ASSERT_GT(nKeys, 0);
+
+    KnobBool* binaryFormat = dynamic_cast<KnobBool*>( appPTR->getCurrentSettings()->getKnobByName("binaryProjectFormat").get() );
+    ASSERT_TRUE(binaryFormat != 0);
+
+    QTemporaryDir dir;
+    ASSERT_TRUE( dir.isValid() );
+    QString path = dir.path() + QLatin1Char('/');
+    const QString formats[2] = { QString::fromUtf8("XML"), QString::fromUtf8("binary") };
+
+    for (int binary = 0; binary < 2; ++binary) {
+        binaryFormat->setValue(binary != 0);
+        QString name = QString::fromUtf8("project-%1.ntp").arg(formats[binary]);
+
+        project->saveProject(path, name, 0);
+        EXPECT_EQ( binary != 0, Project::isBinaryProjectFile(path + name) );
+
+        EXPECT_TRUE( project->loadProject(path, name) );
+        EXPECT_EQ( nNodes, (int)project->getNodes().size() );
+        EXPECT_EQ( nKeys, countKeyFrames( project->getNodes() ) );
+    }
+
+    project->reset(false, true);
+    QString convertedName = QString::fromUtf8("project-converted.ntp");
+    project->convertProjectFile( path + QString::fromUtf8("project-binary.ntp"), path + convertedName );
+    EXPECT_FALSE( Project::isBinaryProjectFile(path + convertedName) );
+    EXPECT_TRUE( project->loadProject(path, convertedName) );
+    EXPECT_EQ( nKeys, countKeyFrames( project->getNodes() ) );
+
+    // The format is detected from the magic string only
+    EXPECT_FALSE( Project::isBinaryProjectFile( path + QString::fromUtf8("missing.ntp") ) );
+    QFile garbage( path + QString::fromUtf8("garbage.ntp") );
+    ASSERT_TRUE( garbage.open(QIODevice::WriteOnly) );
+    garbage.write("Natron");
+    garbage.close();
+    EXPECT_FALSE( Project::isBinaryProjectFile( garbage.fileName() ) );
+
+    // A binary project written on a platform with another byte order is refused
+    QFile binaryFile( path + QString::fromUtf8("project-binary.ntp") );
+    ASSERT_TRUE( binaryFile.open(QIODevice::ReadWrite) );
+    QByteArray contents = binaryFile.readAll();
+    const int platformOffset = (int)sizeof(NATRON_PROJECT_BINARY_MAGIC) + 4;
+    ASSERT_GT(contents.size(), platformOffset + NATRON_PROJECT_BINARY_PLATFORM_SIZE);
+    std::swap(contents.data()[platformOffset], contents.data()[platformOffset + 3]);
+    binaryFile.seek(0);
+    binaryFile.write(contents);
+    binaryFile.close();
+    project->reset(false, true);
+    EXPECT_TRUE( Project::isBinaryProjectFile( binaryFile.fileName() ) );
+    EXPECT_FALSE( project->loadProject( path, QString::fromUtf8("project-binary.ntp") ) );
+
+    binaryFormat->setValue(false);
+    project->reset(false, true);
+}
+
+static std::vector<std::string>
+getNodeNames(const NodesList& nodes)
+{
+    std::vector<std::string> names;
+
+    for (NodesList::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+        names.push_back( (*it)->getScriptName() );
+    }
+    std::sort( names.begin(), names.end() );
+
+    return names;
+}
+
+///A background auto-save writes the project as it was when it started, and replaces the previous auto-save once written
+TEST_F(BaseTest, BackgroundAutoSave)
+{
+    const int nNodes = 10;
+    const int nKeyFrames = 100;
+    ProjectPtr project = getApp()->getProject();
+
+    createAnimatedGenerators(nNodes, nKeyFrames);
+    const int nKeys = countKeyFrames( project->getNodes() );
+    const std::vector<std::string> nodeNames = getNodeNames( project->getNodes() );
+
+    QTemporaryDir dir;
+    ASSERT_TRUE( dir.isValid() );
+    QString path = dir.path() + QLatin1Char('/');
+    QString name = QString::fromUtf8("autosave.ntp");
+    project->saveProject(path, name, 0);
+
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE( project->startBackgroundAutoSave() );
+        project->waitForBackgroundAutoSaves();
+        // The second auto-save goes to the same file: it must not be removed as the previous auto-save
+        EXPECT_TRUE( QFile::exists( project->getLastAutoSaveFilePath() ) );
+    }
+
+    ASSERT_TRUE( project->startBackgroundAutoSave() );
+
+    // Edit the project while the auto-save is written: the file must contain the state at the time of the capture
+    const NodesList nodes = project->getNodes();
+    for (NodesList::const_iterator it = nodes.begin(); it != nodes.end(); ++it) {
+        const KnobsVec& knobs = (*it)->getEffectInstance()->getKnobs();
+        for (KnobsVec::const_iterator it2 = knobs.begin(); it2 != knobs.end(); ++it2) {
+            if ( (*it2)->canAnimate() && (*it2)->isAnimated(0) ) {
+                (*it2)->getCurve(ViewIdx(0), 0)->removeKeyFrameWithTime(0.);
+            }
+        }
+    }
+    ASSERT_LT( countKeyFrames( project->getNodes() ), nKeys );
+    project->waitForBackgroundAutoSaves();
+
+    QString autoSaveFilePath = project->getLastAutoSaveFilePath();
+    ASSERT_TRUE( QFile::exists(autoSaveFilePath) );
+    QFileInfo autoSaveInfo(autoSaveFilePath);
+    project->reset(false, true);
+    EXPECT_TRUE( project->loadProject(autoSaveInfo.absolutePath() + QLatin1Char('/'), autoSaveInfo.fileName(), false, false) );
+    EXPECT_TRUE( nodeNames == getNodeNames( project->getNodes() ) );
+    EXPECT_EQ( nKeys, countKeyFrames( project->getNodes() ) );
+
+    project->reset(false, true);
+}
+
+// An expression which is not in the native subset is evaluated through the compiled look-up of its Python function,
+// with the same results as the formatted call of the function that was interpreted before
+TEST_F(BaseTest, ExpressionEvaluation)
+{
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    KnobDouble* slope = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZSlope").get() );
+    ASSERT_TRUE(slope != 0);
+    // The list is not in the native subset
+    slope->setExpression(0, "[(frame % 10) * 0.01][0]", false, true);
+    ASSERT_TRUE( slope->isExpressionValid(0, 0) );
+
+    std::string function = getApp()->getAppIDString() + "." + generator->getFullyQualifiedName() + ".noiseZSlope.expression0";
+    // The values are read without clamping them to the range of the knob
+    const double times[] = { 0., 1., 7., 13., 2.5, 1000. };
+    for (std::size_t i = 0; i < sizeof(times) / sizeof(times[0]); ++i) {
+        slope->clearExpressionsResults(0);
+        double compiled = slope->getValueAtTime(times[i], 0, ViewSpec::current(), false);
+        EXPECT_NEAR(std::fmod(times[i], 10.) * 0.01, compiled, 1e-12);
+
+        std::stringstream ss;
+        ss << "ret = " << function << '(' << times[i] << ", 0)\n";
+        PythonGILLocker pgl;
+        PyObject* ret = 0;
+        std::string error;
+        ASSERT_TRUE( KnobHelper::executeExpression(ss.str(), &ret, &error) );
+        EXPECT_NEAR(PyFloat_AsDouble(ret), compiled, 1e-12);
+        Py_DECREF(ret);
+    }
+
+    // Integral frames are passed as Python ints
+    slope->setExpression(0, "[isinstance(frame, int)][0]", false, true);
+    ASSERT_TRUE( slope->isExpressionValid(0, 0) );
+    slope->clearExpressionsResults(0);
+    EXPECT_EQ( 1., slope->getValueAtTime(3., 0, ViewSpec::current(), false) );
+    EXPECT_EQ( 0., slope->getValueAtTime(2.5, 0, ViewSpec::current(), false) );
+
+    // Setting another expression releases the compiled look-up of the previous one
+    slope->setExpression(0, "[frame * 2][0]", false, true);
+    ASSERT_TRUE( slope->isExpressionValid(0, 0) );
+    slope->clearExpressionsResults(0);
+    EXPECT_EQ( 14., slope->getValueAtTime(7., 0, ViewSpec::current(), false) );
+}
+
+///Benchmark: evaluate an expression 1M times through the knob, which calls the compiled look-up of the expression function,
+///and by interpreting the formatted call of the function as it was done before.
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST_F(BaseTest, DISABLED_ExpressionEvaluationThroughput)
+{
+    const int nEvaluations = 1000000;
+    const int nFrames = 1000;
+
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    KnobDouble* slope = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZSlope").get() );
+    ASSERT_TRUE(slope != 0);
+    // The list is not in the native subset
+    slope->setExpression(0, "[(frame % 10) * 0.01][0]", false, true);
+    ASSERT_TRUE( slope->isExpressionValid(0, 0) );
+
+    QElapsedTimer timer;
+    timer.start();
+    double compiledSum = 0.;
+    for (int i = 0; i < nEvaluations; ++i) {
+        // Do not let the results of previous evaluations answer
+        slope->clearExpressionsResults(0);
+        compiledSum += slope->getValueAtTime(i % nFrames, 0);
+    }
+    double compiledMS = timer.nsecsElapsed() / 1000000.;
+
+    std::string function = getApp()->getAppIDString() + "." + generator->getFullyQualifiedName() + ".noiseZSlope.expression0";
+    double interpretedSum = 0.;
+    timer.start();
+    {
+        PythonGILLocker pgl;
+        for (int i = 0; i < nEvaluations; ++i) {
+            std::stringstream ss;
+            ss << "ret = " << function << '(' << (i % nFrames) << ", 0)\n";
+            PyObject* ret = 0;
+            std::string error;
+            ASSERT_TRUE( KnobHelper::executeExpression(ss.str(), &ret, &error) );
+            interpretedSum += PyFloat_AsDouble(ret);
+            Py_DECREF(ret);
+        }
+    }
+    double interpretedMS = timer.nsecsElapsed() / 1000000.;
+
+    std::cout << "Expression: " << nEvaluations << " evaluations, interpreted call " << interpretedMS << " ms, compiled "
+              << compiledMS << " ms" << std::endl;
+    EXPECT_NEAR(interpretedSum, compiledSum, 1e-6 * nEvaluations);
+}
+
+// Every operator, variable, function and parameter reference of the native subset gives the same values as Python.
+// Each expression is set on a knob, where it is evaluated natively, and wrapped in a list on another knob, which
+// keeps it out of the native subset so that Python evaluates it.
+TEST_F(BaseTest, NativeExpressionMatchesPython)
+{
+    NodePtr source = createNode(_generatorPluginID);
+    NodePtr nativeNode = createNode(_generatorPluginID);
+    NodePtr pythonNode = createNode(_generatorPluginID);
+    ASSERT_TRUE(source && nativeNode && pythonNode);
+    KnobDouble* sourceKnob = dynamic_cast<KnobDouble*>( source->getKnobByName("noiseZ").get() );
+    KnobDouble* nativeKnob = dynamic_cast<KnobDouble*>( nativeNode->getKnobByName("noiseZSlope").get() );
+    KnobDouble* pythonKnob = dynamic_cast<KnobDouble*>( pythonNode->getKnobByName("noiseZSlope").get() );
+    ASSERT_TRUE(sourceKnob != 0 && nativeKnob != 0 && pythonKnob != 0);
+    sourceKnob->setValueAtTime(0, 1., ViewSpec::all(), 0);
+    sourceKnob->setValueAtTime(10, 3., ViewSpec::all(), 0);
+    const std::string sourceName = source->getScriptName();
+
+    const char* const expressions[] = {
+        // Literals and operators, with the precedence and the semantics of Python
+        "1", "2.5", ".5", "1e-3", "frame", "view", "dimension", "pi", "e",
+        "frame + 0.25", "frame - 7", "frame * 1.5", "frame / 4", "-frame", "+frame", "--frame",
+        "frame // 4", "-frame // 4", "frame // -4", "frame % 4", "-frame % 4", "frame % -4", "frame % 2.5", "-frame % 2.5",
+        "frame ** 2", "2 ** -frame", "-2 ** 2", "2 ** 3 ** 2", "(frame + 1) * (frame - 1)", "1 - 2 - 3", "64 / 4 / 2",
+        "frame * 2 + 3 * frame - frame / 2 % 3", "10 - frame // 3 * 3",
+        // Functions
+        "sin(frame)", "cos(frame)", "tan(frame * 0.1)", "asin(frame / 100)", "acos(frame / 100)", "atan(frame)",
+        "atan2(frame, 3)", "sinh(frame * 0.1)", "cosh(frame * 0.1)", "tanh(frame)", "exp(frame * 0.1)",
+        "log(frame + 1)", "log(frame + 1, 2)", "log10(frame + 1)", "log2(frame + 1)", "sqrt(frame)", "pow(frame, 1.5)",
+        "fabs(-frame)", "fmod(frame, 3)", "fmod(-frame, 3)", "floor(frame / 3)", "ceil(frame / 3)", "trunc(-frame / 3)",
+        "hypot(frame, 4)", "degrees(frame)", "radians(frame)", "abs(3 - frame)", "min(frame, 3)", "max(frame, 3, 4.5)",
+        "int(-frame / 3)", "int(frame / 3)", "float(frame)",
+        "ExprUtils.boxstep(frame, 3)", "ExprUtils.linearstep(frame, 2, 8)", "ExprUtils.smoothstep(frame, 2, 8)",
+        "ExprUtils.gaussstep(frame, 2, 8)", "ExprUtils.remap(frame, 5, 2, 3, 1)", "ExprUtils.mix(1, 5, frame / 10)",
+        "ExprUtils.noise(frame * 0.37)", "NatronEngine.ExprUtils.mix(2, 4, 0.25)",
+        // Parameters
+        "thisParam.getValue()", "curve(frame)", "thisNode.noiseZ.get()",
+        "@.noiseZ.get()", "@.noiseZ.get(frame + 0.5)", "@.noiseZ.getValue()", "@.noiseZ.getValue(0)",
+        "@.noiseZ.getValueAtTime(frame / 2)", "@.noiseZ.getValueAtTime(frame, dimension)", "@.noiseZ.curve(frame * 0.75)",
+        "sin(@.noiseZ.get()) * frame",
+        0
+    };
+    const double times[] = { 0., 1., 3., 7.5, 10., 12., 25. };
+
+    for (int i = 0; expressions[i]; ++i) {
+        std::string expression = expressions[i];
+        for (std::size_t pos = expression.find('@'); pos != std::string::npos; pos = expression.find('@')) {
+            expression.replace(pos, 1, sourceName);
+        }
+        nativeKnob->setExpression(0, expression, false, true);
+        pythonKnob->setExpression(0, "[" + expression + "][0]", false, true);
+        ASSERT_TRUE( nativeKnob->isExpressionValid(0, 0) ) << expression;
+        ASSERT_TRUE( pythonKnob->isExpressionValid(0, 0) ) << expression;
+        for (std::size_t t = 0; t < sizeof(times) / sizeof(times[0]); ++t) {
+            double nativeValue = nativeKnob->getValueAtTime(times[t], 0, ViewSpec::current(), false);
+            double pythonValue = pythonKnob->getValueAtTime(times[t], 0, ViewSpec::current(), false);
+            EXPECT_NEAR( pythonValue, nativeValue, 1e-12 * std::max( 1., std::fabs(pythonValue) ) ) << expression << " at " << times[t];
+        }
+    }
+}
+
+// A parameter of a node referenced by its name is not read natively anymore once the node is deleted: Python evaluates
+// the expression and reports the missing node.
+TEST_F(BaseTest, NativeExpressionDeletedNode)
+{
+    NodePtr source = createNode(_generatorPluginID);
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(source && generator);
+    KnobDouble* sourceKnob = dynamic_cast<KnobDouble*>( source->getKnobByName("noiseZ").get() );
+    KnobDouble* knob = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZSlope").get() );
+    ASSERT_TRUE(sourceKnob != 0 && knob != 0);
+    sourceKnob->setValue(0.25, ViewSpec::all(), 0);
+
+    knob->setExpression(0, source->getScriptName() + ".noiseZ.get() * 2", false, true);
+    ASSERT_TRUE( knob->isExpressionValid(0, 0) );
+    EXPECT_EQ( 0.5, knob->getValueAtTime(1., 0, ViewSpec::current(), false) );
+
+    // The node is only deactivated, since it is still referenced here
+    source->destroyNode(true, false);
+    ASSERT_FALSE( source->isActivated() );
+    knob->clearExpressionsResults(0);
+    (void)knob->getValueAtTime(2., 0, ViewSpec::current(), false);
+    EXPECT_FALSE( knob->isExpressionValid(0, 0) );
+}
+
+// Evaluates from 1 to N threads an expression compiled to native code and the same expression evaluated by Python,
+// which serializes the threads on the GIL.
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST_F(BaseTest, DISABLED_ExpressionScaling)
+{
+    const int nEvaluationsPerThread = 20000;
+    const int nFrames = 1000;
+    const int maxThreads = std::max(1, QThread::idealThreadCount());
+
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    KnobDouble* nativeKnob = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZSlope").get() );
+    KnobDouble* pythonKnob = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZ").get() );
+    ASSERT_TRUE(nativeKnob != 0 && pythonKnob != 0);
+    nativeKnob->setExpression(0, "(frame % 10) * 0.01 + sin(frame)", false, true);
+    // The list is not in the native subset
+    pythonKnob->setExpression(0, "[(frame % 10) * 0.01 + sin(frame)][0]", false, true);
+    ASSERT_TRUE( nativeKnob->isExpressionValid(0, 0) && pythonKnob->isExpressionValid(0, 0) );
+
+    std::vector<int> threadCounts;
+    for (int nThreads = 1; nThreads < maxThreads; nThreads *= 2) {
+        threadCounts.push_back(nThreads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    KnobDouble* knobs[2] = { nativeKnob, pythonKnob };
+    const char* labels[2] = { "native", "Python" };
+    for (int k = 0; k < 2; ++k) {
+        double singleThreadMS = 0.;
+        for (std::size_t t = 0; t < threadCounts.size(); ++t) {
+            int nThreads = threadCounts[t];
+            std::vector<double> sums(nThreads, 0.);
+            std::vector<std::thread> threads;
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < nThreads; ++i) {
+                threads.push_back( std::thread([&, i]() {
+                    for (int j = 0; j < nEvaluationsPerThread; ++j) {
+                        // Each evaluation is at a new time, so that the results of previous evaluations do not answer
+                        sums[i] += knobs[k]->getValueAtTime(nFrames * (t * maxThreads + i) + j % nFrames + (double)j / nEvaluationsPerThread, 0);
+                    }
+                }) );
+            }
+            for (int i = 0; i < nThreads; ++i) {
+                threads[i].join();
+            }
+            double ms = std::max(1e-6, timer.nsecsElapsed() / 1000000.);
+            if (nThreads == 1) {
+                singleThreadMS = ms;
+            }
+            std::cout << "Expression scaling: " << labels[k] << ", " << nThreads << " threads x " << nEvaluationsPerThread
+                      << " evaluations: " << ms << " ms, throughput x" << nThreads * singleThreadMS / ms << std::endl;
+            knobs[k]->clearExpressionsResults(0);
+        }
+    }
+
+    // Both paths compute the same values
+    for (int i = 0; i < 100; ++i) {
+        double time = i * 1.5;
+        EXPECT_NEAR( nativeKnob->getValueAtTime(time, 0), pythonKnob->getValueAtTime(time, 0), 1e-12 );
+    }
+}
+
+// Looks-up and creates images in the node cache through AppManager::getImageOrCreate from 1 to N threads, as the
+// tiled renders do, and reports the throughput and the time spent waiting on the locks of the cache.
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST_F(BaseTest, DISABLED_NodeCacheContention)
+{
+    const int nOpsPerThread = 20000;
+    const int nDistinctKeys = 4096;
+    const int maxThreads = std::max(1, QThread::idealThreadCount());
+
+    RectD rod(0, 0, 32, 32);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    std::vector<int> threadCounts;
+    for (int nThreads = 1; nThreads < maxThreads; nThreads *= 2) {
+        threadCounts.push_back(nThreads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    std::cout << "Node cache contention: " << appPTR->getCurrentSettings()->getCacheShardsCount() << " shards" << std::endl;
+    for (std::size_t t = 0; t < threadCounts.size(); ++t) {
+        const int nThreads = threadCounts[t];
+        U64 lookupsBefore, contendedBefore, waitBefore;
+        appPTR->getNodeCacheLockStats(&lookupsBefore, &contendedBefore, &waitBefore);
+
+        std::atomic<int> nFailures(0);
+        std::vector<std::thread> threads;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < nThreads; ++i) {
+            threads.push_back( std::thread([&, i]() {
+                for (int j = 0; j < nOpsPerThread; ++j) {
+                    // A new range of keys for each thread count, so that the previous runs do not answer
+                    ImageKey key(0, (U64)( t * nDistinctKeys + (j * 7 + i) % nDistinctKeys ), false, 0, ViewIdx(0), 1., false, false);
+                    ImagePtr image;
+                    if ( !appPTR->getImageOrCreate(key, params, &image) ) {
+                        if (!image) {
+                            ++nFailures;
+                            continue;
+                        }
+                        image->allocateMemory();
+                    }
+                }
+            }) );
+        }
+        for (int i = 0; i < nThreads; ++i) {
+            threads[i].join();
+        }
+        const double secs = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+        EXPECT_EQ(0, (int)nFailures);
+
+        U64 lookups, contended, wait;
+        appPTR->getNodeCacheLockStats(&lookups, &contended, &wait);
+        EXPECT_EQ( (U64)nThreads * nOpsPerThread, lookups - lookupsBefore );
+        std::cout << "Node cache contention: " << nThreads << " threads x " << nOpsPerThread << " getImageOrCreate: "
+                  << (lookups - lookupsBefore) / secs << " ops/sec, " << contended - contendedBefore << " contended locks, "
+                  << (wait - waitBefore) / 1000000. << " ms waiting on locks" << std::endl;
+    }
+    appPTR->clearNodeCache();
+}
+
+// Reads the value of a dimension of a knob at the given time on a render thread of the effect
+static double
+readKnobOnRenderThread(const EffectInstancePtr& effect,
+                       const ParallelRenderArgsPtr& args,
+                       KnobDouble* knob,
+                       double time)
+{
+    double value = 0.;
+    std::thread thread([&]() {
+        effect->setParallelRenderArgsTLS(args);
+        value = knob->getValueAtTime(time, 0);
+        effect->invalidateParallelRenderArgsTLS();
+        appPTR->getAppTLS()->cleanupTLSForThread();
+    });
+
+    thread.join();
+
+    return value;
+}
+
+static ParallelRenderArgsPtr
+makeSnapshotRenderArgs(const EffectInstancePtr& effect)
+{
+    ParallelRenderArgsPtr args = std::make_shared<ParallelRenderArgs>();
+
+    args->abortInfo = AbortableRenderInfo::create(false, 0);
+    args->knobsSnapshot = KnobValuesSnapshot::create( effect->getKnobs_mt_safe() );
+
+    return args;
+}
+
+// The render threads read the knob values of the time the render started, the changes made meanwhile are seen
+// by the next render. The dimensions driven by an expression or slaved to another knob are read from the knob.
+TEST_F(BaseTest, KnobValuesSnapshot)
+{
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    EffectInstancePtr effect = generator->getEffectInstance();
+    KnobDouble* slope = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZSlope").get() );
+    ASSERT_TRUE(slope != 0);
+    KnobDouble* noiseZ = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZ").get() );
+    ASSERT_TRUE(noiseZ != 0);
+
+    // A constant value
+    slope->setValue(0.25);
+    ParallelRenderArgsPtr render1 = makeSnapshotRenderArgs(effect);
+    slope->setValue(0.75);
+    EXPECT_EQ( 0.25, readKnobOnRenderThread(effect, render1, slope, 3.) );
+    EXPECT_EQ( 0.75, slope->getValueAtTime(3., 0) );
+    ParallelRenderArgsPtr render2 = makeSnapshotRenderArgs(effect);
+    EXPECT_EQ( 0.75, readKnobOnRenderThread(effect, render2, slope, 3.) );
+
+    // An animated value
+    CurvePtr curve = slope->getCurve(ViewIdx(0), 0);
+    curve->addKeyFrame( KeyFrame(0., 0.) );
+    curve->addKeyFrame( KeyFrame(10., 1.) );
+    ParallelRenderArgsPtr render3 = makeSnapshotRenderArgs(effect);
+    ParallelRenderArgsPtr render4 = makeSnapshotRenderArgs(effect);
+    const KnobDimensionSnapshot* dim3 = render3->knobsSnapshot->getDimension(slope, 0);
+    const KnobDimensionSnapshot* dim4 = render4->knobsSnapshot->getDimension(slope, 0);
+    ASSERT_TRUE(dim3 && dim3->curve);
+    ASSERT_TRUE(dim4 && dim4->curve);
+    // The copy of the curve is shared until the curve changes
+    EXPECT_EQ(dim3->curve, dim4->curve);
+    const double valueAt5 = slope->getValueAtTime(5., 0);
+    curve->addKeyFrame( KeyFrame(5., 0.9) );
+    EXPECT_EQ( valueAt5, readKnobOnRenderThread(effect, render3, slope, 5.) );
+    EXPECT_EQ( 0.9, slope->getValueAtTime(5., 0) );
+    ParallelRenderArgsPtr render5 = makeSnapshotRenderArgs(effect);
+    const KnobDimensionSnapshot* dim5 = render5->knobsSnapshot->getDimension(slope, 0);
+    ASSERT_TRUE(dim5 && dim5->curve);
+    EXPECT_NE(dim3->curve, dim5->curve);
+    EXPECT_EQ( 0.9, readKnobOnRenderThread(effect, render5, slope, 5.) );
+
+    // A dimension driven by an expression is evaluated by the render thread
+    noiseZ->setExpression(0, "frame * 2", false, true);
+    ParallelRenderArgsPtr render6 = makeSnapshotRenderArgs(effect);
+    EXPECT_TRUE( render6->knobsSnapshot->getDimension(noiseZ, 0) == 0 );
+    EXPECT_EQ( 8., readKnobOnRenderThread(effect, render6, noiseZ, 4.) );
+    noiseZ->clearExpression(0, true);
+
+    // A slaved dimension reads the value of its master
+    NodePtr master = createNode(_generatorPluginID);
+    ASSERT_TRUE(master);
+    KnobIPtr masterSlope = master->getKnobByName("noiseZSlope");
+    ASSERT_TRUE(masterSlope);
+    dynamic_cast<KnobDouble*>( masterSlope.get() )->setValue(0.5);
+    ASSERT_TRUE( noiseZ->slaveTo(0, masterSlope, 0) );
+    ParallelRenderArgsPtr render7 = makeSnapshotRenderArgs(effect);
+    EXPECT_TRUE( render7->knobsSnapshot->getDimension(noiseZ, 0) == 0 );
+    EXPECT_EQ( 0.5, readKnobOnRenderThread(effect, render7, noiseZ, 4.) );
+    noiseZ->unSlave(0, false);
+}
+
+// Returns the snapshot of the knob values taken for a render of the frame as the render of each frame of a playback does
+static const KnobValuesSnapshot*
+getPlaybackFrameSnapshot(const NodePtr& node,
+                         double time)
+{
+    EffectInstancePtr effect = node->getEffectInstance();
+    AbortableRenderInfoPtr abortInfo = AbortableRenderInfo::create(false, 0);
+
+    effect->setParallelRenderArgsTLS(time, ViewIdx(0), false, true, node->getHashValue(), abortInfo, node, 1, NodeFrameRequestPtr(),
+                                     OSGLContextPtr(), -1, 0, false, false, NodesList(), eRenderSafetyFullySafe,
+                                     ePluginOpenGLRenderSupportNone, false, false, RenderStatsPtr());
+    const KnobValuesSnapshot* snapshot = effect->getKnobValuesSnapshotTLS();
+    effect->invalidateParallelRenderArgsTLS();
+
+    return snapshot;
+}
+
+// The knobs are not copied again for each frame of a playback: the snapshot is rebuilt only when the node hash changes
+TEST_F(BaseTest, KnobValuesSnapshotReusedDuringPlayback)
+{
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    KnobDouble* slope = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZSlope").get() );
+    ASSERT_TRUE(slope != 0);
+    slope->setValueAtTime(0, 0., ViewSpec::all(), 0);
+    slope->setValueAtTime(10, 1., ViewSpec::all(), 0);
+
+    const KnobValuesSnapshot* first = getPlaybackFrameSnapshot(generator, 0.);
+    ASSERT_TRUE(first != 0);
+    for (int f = 1; f < 10; ++f) {
+        EXPECT_EQ( first, getPlaybackFrameSnapshot(generator, f) ) << "frame " << f;
+    }
+
+    const U64 hash = generator->getHashValue();
+    slope->setValueAtTime(5., 0.5, ViewSpec::all(), 0);
+    ASSERT_NE( hash, generator->getHashValue() );
+    const KnobValuesSnapshot* changed = getPlaybackFrameSnapshot(generator, 5.);
+    ASSERT_TRUE(changed != 0);
+    EXPECT_NE(first, changed);
+    const KnobDimensionSnapshot* dim = changed->getDimension(slope, 0);
+    ASSERT_TRUE(dim && dim->curve);
+    EXPECT_EQ( 0.5, dim->getValueAtTime(5., false) );
+    EXPECT_EQ( changed, getPlaybackFrameSnapshot(generator, 6.) );
+}
+
+// Reads an animated knob from 1 to N render threads through the knob, which locks the knob and its curve,
+// and through the snapshot of the knob values held by the render arguments of the threads.
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST_F(BaseTest, DISABLED_KnobValuesSnapshotScaling)
+{
+    const int nReadsPerThread = 200000;
+    const int nFrames = 100;
+    const int maxThreads = std::max(1, QThread::idealThreadCount());
+
+    NodePtr generator = createNode(_generatorPluginID);
+    ASSERT_TRUE(generator);
+    EffectInstancePtr effect = generator->getEffectInstance();
+    KnobDouble* slope = dynamic_cast<KnobDouble*>( generator->getKnobByName("noiseZSlope").get() );
+    ASSERT_TRUE(slope != 0);
+    CurvePtr curve = slope->getCurve(ViewIdx(0), 0);
+    for (int t = 0; t < nFrames; t += 10) {
+        curve->addKeyFrame( KeyFrame( t, std::sin(t * 0.1) ) );
+    }
+
+    AbortableRenderInfoPtr abortInfo = AbortableRenderInfo::create(false, 0);
+    ParallelRenderArgsPtr args = std::make_shared<ParallelRenderArgs>();
+    args->abortInfo = abortInfo;
+    args->knobsSnapshot = KnobValuesSnapshot::create( effect->getKnobs_mt_safe() );
+
+    std::vector<int> threadCounts;
+    for (int nThreads = 1; nThreads < maxThreads; nThreads *= 2) {
+        threadCounts.push_back(nThreads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    const char* labels[2] = { "knob", "snapshot" };
+    double sums[2] = { 0., 0. };
+    for (int useSnapshot = 0; useSnapshot < 2; ++useSnapshot) {
+        double singleThreadMS = 0.;
+        for (std::size_t t = 0; t < threadCounts.size(); ++t) {
+            int nThreads = threadCounts[t];
+            std::vector<double> threadSums(nThreads, 0.);
+            std::vector<std::thread> threads;
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < nThreads; ++i) {
+                threads.push_back( std::thread([&, i]() {
+                    if (useSnapshot) {
+                        effect->setParallelRenderArgsTLS(args);
+                    }
+                    for (int j = 0; j < nReadsPerThread; ++j) {
+                        threadSums[i] += slope->getValueAtTime( (j % (nFrames * 4)) * 0.25, 0 );
+                    }
+                    if (useSnapshot) {
+                        effect->invalidateParallelRenderArgsTLS();
+                    }
+                    appPTR->getAppTLS()->cleanupTLSForThread();
+                }) );
+            }
+            for (int i = 0; i < nThreads; ++i) {
+                threads[i].join();
+            }
+            double ms = std::max(1e-6, timer.nsecsElapsed() / 1000000.);
+            if (nThreads == 1) {
+                singleThreadMS = ms;
+                sums[useSnapshot] = threadSums[0];
+            }
+            std::cout << "Knob values scaling: " << labels[useSnapshot] << ", " << nThreads << " threads x " << nReadsPerThread
+                      << " reads: " << ms << " ms, throughput x" << nThreads * singleThreadMS / ms << std::endl;
+        }
+    }
+
+    // Both paths read the same values
+    EXPECT_NEAR(sums[0], sums[1], 1e-9);
+}
+
+// The bounding boxes of an animated shape at the motion blur samples of a frame, whose control points are
+// evaluated at all the samples at once, are the same as the ones computed at each time separately
+TEST_F(BaseTest, BezierBoundingBoxAtTimes)
+{
+    NodePtr roto = createNode( QString::fromUtf8(PLUGINID_NATRON_ROTO) );
+    ASSERT_TRUE(roto);
+    RotoContextPtr context = roto->getRotoContext();
+    ASSERT_TRUE(context);
+    BezierPtr shape = context->makeEllipse(200., 200., 50., true, 0.);
+    ASSERT_TRUE(shape);
+
+    // Move each control point and its bezier points differently between 3 keyframes
+    const BezierCPs& cps = shape->getControlPoints();
+    ASSERT_FALSE( cps.empty() );
+    int i = 0;
+    for (BezierCPs::const_iterator it = cps.begin(); it != cps.end(); ++it, ++i) {
+        double x, y, leftX, leftY, rightX, rightY;
+        (*it)->getPointsAtTime(false, 0., ViewIdx(0), &x, &y, &leftX, &leftY, &rightX, &rightY);
+        if (i == 1) {
+            // The tangents of a broken point are not realigned
+            (*it)->setBroken(true);
+        }
+        for (int k = 0; k < 3; ++k) {
+            const double time = k * 10.;
+            const double dx = k * (10. + i * 3.);
+            const double dy = k * k * (5. - i * 2.);
+            (*it)->setPositionAtTime(false, time, x + dx, y + dy);
+            (*it)->setLeftBezierPointAtTime(false, time, leftX + dx - k * i, leftY + dy);
+            (*it)->setRightBezierPointAtTime(false, time, rightX + dx, rightY + dy + k * i);
+        }
+    }
+
+    // Motion blur samples around keyframes, between them and outside of them
+    std::vector<double> times;
+    for (double t = -2.; t <= 23.; t += 0.25) {
+        times.push_back(t);
+    }
+    std::vector<Transform::Matrix3x3> transforms( times.size() );
+    std::vector<RectD> bboxes( times.size() );
+    for (std::size_t t = 0; t < times.size(); ++t) {
+        shape->getTransformAtTime(times[t], &transforms[t]);
+        bboxes[t].setupInfinity();
+    }
+
+    // Each control point
+    const int nTimes = (int)times.size();
+    std::vector<double> values(6 * nTimes);
+    for (BezierCPs::const_iterator it = cps.begin(); it != cps.end(); ++it) {
+        (*it)->getPointsAtTimes(false, &times[0], nTimes, ViewIdx(0), &values[0], &values[nTimes], &values[2 * nTimes],
+                                &values[3 * nTimes], &values[4 * nTimes], &values[5 * nTimes]);
+        for (int t = 0; t < nTimes; ++t) {
+            double p[6];
+            (*it)->getPointsAtTime(false, times[t], ViewIdx(0), &p[0], &p[1], &p[2], &p[3], &p[4], &p[5]);
+            for (int c = 0; c < 6; ++c) {
+                EXPECT_EQ(p[c], values[c * nTimes + t]) << "time " << times[t] << " coordinate " << c;
+            }
+        }
+    }
+
+    // The whole shape
+    Bezier::bezierSegmentListBboxUpdateAtTimes(false, cps, true, false, times, ViewIdx(0), 0, transforms, &bboxes);
+    for (std::size_t t = 0; t < times.size(); ++t) {
+        RectD bbox;
+        bbox.setupInfinity();
+        Bezier::bezierSegmentListBboxUpdate(false, cps, true, false, times[t], ViewIdx(0), 0, transforms[t], &bbox);
+        EXPECT_EQ(bbox.x1, bboxes[t].x1) << "time " << times[t];
+        EXPECT_EQ(bbox.y1, bboxes[t].y1) << "time " << times[t];
+        EXPECT_EQ(bbox.x2, bboxes[t].x2) << "time " << times[t];
+        EXPECT_EQ(bbox.y2, bboxes[t].y2) << "time " << times[t];
+    }
+}
+
+// Creates feathered ellipses of various sizes, feather distances and fall-offs
+static void
+makeRasterizerTestShapes(const RotoContextPtr& context,
+                         int nShapes,
+                         std::vector<BezierPtr>* shapes)
+{
+    for (int i = 0; i < nShapes; ++i) {
+        BezierPtr shape = context->makeEllipse( 100. + (i % 25) * 70., 100. + (i / 25) * 70., 40. + (i % 7) * 10., true, 0. );
+        ASSERT_TRUE(shape);
+        shape->setFeatherDistance( (i % 5) * 8., 0. );
+        shape->setFeatherFallOff( 0.5 + (i % 4) * 0.5, 0. );
+        shapes->push_back(shape);
+    }
+}
+
+static ImagePtr
+renderRasterizerTestMask(const BezierPtr& shape,
+                         bool useCairo)
+{
+    RectD bbox = shape->getBoundingBox(0.);
+    RectI roi = bbox.toPixelEnclosing(0, 1.);
+    ImagePtr mask = std::make_shared<Image>(ImagePlaneDesc::getAlphaComponents(), bbox, roi, 0, 1., eImageBitDepthFloat,
+                                            eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    shape->renderShapeMask(roi, 0., 0, useCairo, mask);
+
+    return mask;
+}
+
+// Renders the masks of feathered roto shapes with the scanline rasterizer and with cairo: the masks must be the
+// same, except on the edges of the shapes which cairo does not anti-alias.
+TEST_F(BaseTest, RotoShapeRasterizer)
+{
+    NodePtr roto = createNode( QString::fromUtf8(PLUGINID_NATRON_ROTO) );
+    ASSERT_TRUE(roto);
+    RotoContextPtr context = roto->getRotoContext();
+    ASSERT_TRUE(context);
+
+    std::vector<BezierPtr> shapes;
+    makeRasterizerTestShapes(context, 140, &shapes);
+    ASSERT_EQ( (std::size_t)140, shapes.size() );
+
+    double sumDiff = 0.;
+    U64 nPixels = 0;
+    U64 nDifferentPixels = 0;
+    for (std::size_t i = 0; i < shapes.size(); ++i) {
+        ImagePtr rasterizerMask = renderRasterizerTestMask(shapes[i], false);
+        ImagePtr cairoMask = renderRasterizerTestMask(shapes[i], true);
+        RectI roi = shapes[i]->getBoundingBox(0.).toPixelEnclosing(0, 1.);
+
+        Image::ReadAccess rasterizerAcc = rasterizerMask->getReadRights();
+        Image::ReadAccess cairoAcc = cairoMask->getReadRights();
+        double shapeSum = 0.;
+        for (int y = roi.y1; y < roi.y2; ++y) {
+            const float* rasterizerPix = (const float*)rasterizerAcc.pixelAt(roi.x1, y);
+            const float* cairoPix = (const float*)cairoAcc.pixelAt(roi.x1, y);
+            for (int x = 0; x < roi.width(); ++x) {
+                double diff = std::abs(rasterizerPix[x] - cairoPix[x]);
+                sumDiff += diff;
+                shapeSum += rasterizerPix[x];
+                if (diff > 0.25) {
+                    ++nDifferentPixels;
+                }
+            }
+        }
+        // The shape covers its bounding box at least partially
+        EXPECT_GT(shapeSum, 0.) << "shape " << i;
+        nPixels += roi.area();
+    }
+
+    ASSERT_GT(nPixels, (U64)0);
+    EXPECT_LT(sumDiff / nPixels, 0.01);
+    EXPECT_LT( (double)nDifferentPixels / nPixels, 0.02 );
+}
+
+// The tiles of the RoI are rasterized concurrently: rasterizing a feathered ellipse tile by tile, with tiles which
+// do not fall on the scanlines nor on the pixels of the shape, must give exactly the mask of the whole RoI.
+TEST_F(BaseTest, RotoShapeRasterizerTiles)
+{
+    const int nPoints = 40;
+    const double twoPi = 8. * std::atan(1.);
+    RotoShapeRasterizer rasterizer(1.5);
+    std::vector<Point> contour, feather;
+
+    for (int i = 0; i < nPoints; ++i) {
+        double a = twoPi * i / nPoints;
+        Point p, f;
+        p.x = 50.3 + 30. * std::cos(a);
+        p.y = 40.7 + 22. * std::sin(a);
+        f.x = 50.3 + 38. * std::cos(a);
+        f.y = 40.7 + 30. * std::sin(a);
+        contour.push_back(p);
+        feather.push_back(f);
+    }
+    rasterizer.addContour(contour);
+    for (int i = 0; i < nPoints; ++i) {
+        int next = (i + 1) % nPoints;
+        rasterizer.addFeatherTriangle(contour[i], true, contour[next], true, feather[i], false);
+        rasterizer.addFeatherTriangle(contour[next], true, feather[next], false, feather[i], false);
+    }
+
+    const RectI bounds = rasterizer.getPixelBounds();
+    ASSERT_FALSE( bounds.isNull() );
+    std::vector<float> whole(bounds.area(), 0.f);
+    rasterizer.renderTile(bounds, &whole[0], bounds.width());
+
+    std::vector<float> tiled(bounds.area(), 0.f);
+    for (int y = bounds.y1; y < bounds.y2; y += 7) {
+        for (int x = bounds.x1; x < bounds.x2; x += 13) {
+            RectI tile( x, y, std::min(x + 13, bounds.x2), std::min(y + 7, bounds.y2) );
+            rasterizer.renderTile(tile, &tiled[(tile.y1 - bounds.y1) * bounds.width() + tile.x1 - bounds.x1], bounds.width());
+        }
+    }
+
+    EXPECT_TRUE(whole == tiled);
+    // The center of the ellipse is opaque
+    EXPECT_EQ( 1.f, whole[(40 - bounds.y1) * bounds.width() + 50 - bounds.x1] );
+}
+
+// Times the masks of 500 shapes with the scanline rasterizer and with cairo.
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST_F(BaseTest, DISABLED_RotoShapeRasterizerBenchmark)
+{
+    const int nShapes = 500;
+
+    NodePtr roto = createNode( QString::fromUtf8(PLUGINID_NATRON_ROTO) );
+    ASSERT_TRUE(roto);
+    RotoContextPtr context = roto->getRotoContext();
+    ASSERT_TRUE(context);
+
+    std::vector<BezierPtr> shapes;
+    makeRasterizerTestShapes(context, nShapes, &shapes);
+
+    qint64 ns[2] = { 0, 0 };
+    for (int useCairo = 0; useCairo < 2; ++useCairo) {
+        QElapsedTimer timer;
+        timer.start();
+        for (std::size_t i = 0; i < shapes.size(); ++i) {
+            renderRasterizerTestMask(shapes[i], useCairo != 0);
+        }
+        ns[useCairo] = timer.nsecsElapsed();
+    }
+    std::cout << "Roto masks of " << nShapes << " shapes: rasterizer " << ns[0] / 1000000. << " ms, cairo "
+              << ns[1] / 1000000. << " ms" << std::endl;
+}
@@ -79,6 +79,10 @@ protected:
     ///disconnection is expected to succeed, and vice versa.
     void disconnectNodes(NodePtr input, NodePtr output, bool expectedReturnvalue);
 
+    ///Creates nNodes generators whose double parameters have nKeyFrames keyframes per dimension,
+    ///which makes a project that is long to save.
+    void createAnimatedGenerators(int nNodes, int nKeyFrames);
+
     void registerTestPlugins();
 
     ///////////////Pointers to plug-ins that might be used by all the tests. This makes
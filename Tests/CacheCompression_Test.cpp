@@ -0,0 +1,286 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+
+#include "Global/Macros.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "Engine/CacheCompression.h"
+
+NATRON_NAMESPACE_USING
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+enum DataPatternEnum
+{
+    eDataPatternZeros = 0,
+    eDataPatternText, // repeats of a short sequence, whose matches overlap the bytes they produce
+    eDataPatternSmooth, // slowly varying floats, as in a render
+    eDataPatternRandom // incompressible
+};
+
+std::vector<unsigned char>
+makeData(DataPatternEnum pattern,
+         std::size_t size,
+         unsigned int seed = 1)
+{
+    std::vector<unsigned char> data(size);
+
+    switch (pattern) {
+    case eDataPatternZeros:
+        break;
+    case eDataPatternText: {
+        const char text[] = "natron cache ";
+        for (std::size_t i = 0; i < size; ++i) {
+            data[i] = (unsigned char)text[i % (sizeof(text) - 1)];
+        }
+        break;
+    }
+    case eDataPatternSmooth: {
+        for (std::size_t i = 0; i + sizeof(float) <= size; i += sizeof(float)) {
+            float v = 0.5f + 0.001f * (float)( (i / sizeof(float)) % 1000 );
+            std::memcpy(&data[i], &v, sizeof(float));
+        }
+        break;
+    }
+    case eDataPatternRandom: {
+        // A linear congruential generator, so that the data does not depend on the platform
+        U32 state = seed;
+        for (std::size_t i = 0; i < size; ++i) {
+            state = state * 1664525U + 1013904223U;
+            data[i] = (unsigned char)(state >> 24);
+        }
+        break;
+    }
+    }
+
+    return data;
+}
+
+const DataPatternEnum allPatterns[] = { eDataPatternZeros, eDataPatternText, eDataPatternSmooth, eDataPatternRandom };
+
+// Sizes around the limits of the coder: the last literals, the minimum match and the 4 bits of the lengths
+const std::size_t lzSizes[] = { 0, 1, 4, 5, 11, 12, 13, 15, 16, 19, 20, 64, 255, 256, 270, 1000, 65535 + 100, 300000 };
+
+// Compresses and decompresses data with the LZ coder. dstCapacity is the size of data if 0.
+// Returns the compressed size, 0 if the data did not compress.
+std::size_t
+lzRoundTrip(const std::vector<unsigned char>& data,
+            std::size_t dstCapacity = 0)
+{
+    if (dstCapacity == 0) {
+        dstCapacity = data.size();
+    }
+    std::vector<unsigned char> compressed(dstCapacity + 1);
+    std::size_t compressedSize = CacheCompression::lzCompress(data.empty() ? 0 : &data[0], data.size(), &compressed[0], dstCapacity);
+    EXPECT_LT(compressedSize, dstCapacity + (dstCapacity == 0 ? 1 : 0) );
+    if (compressedSize == 0) {
+        return 0;
+    }
+
+    std::vector<unsigned char> decompressed( data.size() + 1, 0xAB );
+    EXPECT_TRUE( CacheCompression::lzDecompress(&compressed[0], compressedSize, &decompressed[0], data.size()) );
+    // Nothing is written past the end
+    EXPECT_EQ(0xAB, decompressed.back());
+    decompressed.pop_back();
+    EXPECT_TRUE(decompressed == data);
+
+    // Every truncation of the compressed data is detected
+    for (std::size_t truncated = 0; truncated < compressedSize; truncated += 1 + truncated / 16) {
+        EXPECT_FALSE( CacheCompression::lzDecompress(&compressed[0], truncated, &decompressed[0], data.size()) ) << truncated << " / " << compressedSize;
+    }
+    // So is a wrong output size
+    if ( !data.empty() ) {
+        EXPECT_FALSE( CacheCompression::lzDecompress(&compressed[0], compressedSize, &decompressed[0], data.size() - 1) );
+    }
+
+    return compressedSize;
+}
+
+// Compresses and decompresses data with compress()
+std::vector<unsigned char>
+roundTrip(const std::vector<unsigned char>& data,
+          std::size_t elementSize)
+{
+    std::vector<unsigned char> compressed;
+
+    CacheCompression::compress(data.empty() ? 0 : &data[0], data.size(), elementSize, &compressed);
+    EXPECT_EQ( data.size(), CacheCompression::getDecompressedSize(compressed) );
+
+    std::vector<unsigned char> decompressed( data.size() + 1, 0xAB );
+    EXPECT_TRUE( CacheCompression::decompress(compressed, &decompressed[0], data.size()) );
+    EXPECT_EQ(0xAB, decompressed.back());
+    decompressed.pop_back();
+    EXPECT_TRUE(decompressed == data);
+
+    return compressed;
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+TEST(CacheCompression, LzRoundTrip)
+{
+    for (std::size_t p = 0; p < sizeof(allPatterns) / sizeof(allPatterns[0]); ++p) {
+        for (std::size_t s = 0; s < sizeof(lzSizes) / sizeof(lzSizes[0]); ++s) {
+            SCOPED_TRACE( testing::Message() << "pattern " << allPatterns[p] << ", " << lzSizes[s] << " bytes" );
+            std::vector<unsigned char> data = makeData(allPatterns[p], lzSizes[s]);
+            std::size_t compressedSize = lzRoundTrip(data);
+            if (lzSizes[s] <= 12) {
+                // Too small to hold a match
+                EXPECT_EQ( (std::size_t)0, compressedSize );
+            } else if ( (allPatterns[p] == eDataPatternRandom) ) {
+                EXPECT_EQ( (std::size_t)0, compressedSize );
+            } else if ( (allPatterns[p] != eDataPatternSmooth) && (lzSizes[s] >= 64) ) {
+                // The floats only compress once their bytes are shuffled, see RoundTrip
+                EXPECT_GT( compressedSize, (std::size_t)0 );
+                EXPECT_LT(compressedSize, lzSizes[s] / 4 + 16);
+            }
+            // With enough room, anything is encoded, as literals if needed
+            EXPECT_GT( lzRoundTrip(data, data.size() + data.size() / 255 + 16), (std::size_t)0 );
+        }
+    }
+
+    // Matches close to the largest offset: a block of random sequences of 8 bytes each repeated once, so that the
+    // coder finds matches everywhere and does not skip over the data, then the same block again
+    std::vector<unsigned char> sequences = makeData(eDataPatternRandom, 65520 / 2);
+    std::vector<unsigned char> block;
+    for (std::size_t i = 0; i < sequences.size(); i += 8) {
+        block.insert( block.end(), sequences.begin() + i, sequences.begin() + i + 8 );
+        block.insert( block.end(), sequences.begin() + i, sequences.begin() + i + 8 );
+    }
+    std::vector<unsigned char> data(block);
+    data.insert( data.end(), block.begin(), block.end() );
+    EXPECT_GT( lzRoundTrip(data), (std::size_t)0 );
+    // A block repeated too far behind to be matched
+    block = makeData(eDataPatternRandom, 70000, 7);
+    data = block;
+    data.insert( data.end(), block.begin(), block.end() );
+    EXPECT_EQ( (std::size_t)0, lzRoundTrip(data) );
+}
+
+TEST(CacheCompression, LzCorruptedInput)
+{
+    // 4 literals then a match of 4 bytes (token, literals, offset), then the last sequence, without literals
+    const unsigned char valid[] = { 0x40, 'a', 'b', 'c', 'd', 0x04, 0x00, 0x00 };
+    unsigned char out[9];
+    ASSERT_TRUE( CacheCompression::lzDecompress(valid, sizeof(valid), out, 8) );
+    EXPECT_EQ( 0, std::memcmp(out, "abcdabcd", 8) );
+    // Without the last sequence
+    EXPECT_FALSE( CacheCompression::lzDecompress(valid, sizeof(valid) - 1, out, 8) );
+
+    // An offset of 0
+    const unsigned char nullOffset[] = { 0x40, 'a', 'b', 'c', 'd', 0x00, 0x00 };
+    EXPECT_FALSE( CacheCompression::lzDecompress(nullOffset, sizeof(nullOffset), out, 8) );
+    // An offset before the start of the output
+    const unsigned char farOffset[] = { 0x40, 'a', 'b', 'c', 'd', 0x05, 0x00 };
+    EXPECT_FALSE( CacheCompression::lzDecompress(farOffset, sizeof(farOffset), out, 8) );
+    // A match longer than the output
+    const unsigned char longMatch[] = { 0x41, 'a', 'b', 'c', 'd', 0x04, 0x00 };
+    EXPECT_FALSE( CacheCompression::lzDecompress(longMatch, sizeof(longMatch), out, 8) );
+    // A literals length longer than the input
+    const unsigned char longLiterals[] = { 0xF0, 0xFF, 0xFF, 'a' };
+    EXPECT_FALSE( CacheCompression::lzDecompress(longLiterals, sizeof(longLiterals), out, 8) );
+
+    // Random changes of the compressed data never read nor write out of the buffers
+    std::vector<unsigned char> data = makeData(eDataPatternText, 5000);
+    std::vector<unsigned char> compressed( data.size() );
+    std::size_t compressedSize = CacheCompression::lzCompress(&data[0], data.size(), &compressed[0], compressed.size());
+    ASSERT_GT( compressedSize, (std::size_t)0 );
+    compressed.resize(compressedSize);
+    std::vector<unsigned char> noise = makeData(eDataPatternRandom, 3000, 3);
+    std::vector<unsigned char> decompressed( data.size() );
+    for (std::size_t i = 0; i + 3 <= noise.size(); i += 3) {
+        std::vector<unsigned char> corrupted(compressed);
+        corrupted[(noise[i] << 8 | noise[i + 1]) % corrupted.size()] = noise[i + 2];
+        CacheCompression::lzDecompress(&corrupted[0], corrupted.size(), &decompressed[0], decompressed.size());
+    }
+}
+
+TEST(CacheCompression, RoundTrip)
+{
+    const std::size_t elementSizes[] = { 1, 2, 3, 4, 16 };
+    // Sizes which are not multiples of the element sizes, and several chunks
+    const std::size_t sizes[] = { 0, 1, 7, 11, 12, 13, 1001, NATRON_CACHE_COMPRESSION_CHUNK_BYTES - 1, NATRON_CACHE_COMPRESSION_CHUNK_BYTES + 3,
+                                  2 * NATRON_CACHE_COMPRESSION_CHUNK_BYTES + NATRON_CACHE_COMPRESSION_CHUNK_BYTES / 2 };
+
+    for (std::size_t p = 0; p < sizeof(allPatterns) / sizeof(allPatterns[0]); ++p) {
+        for (std::size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+            std::vector<unsigned char> data = makeData(allPatterns[p], sizes[s]);
+            for (std::size_t e = 0; e < sizeof(elementSizes) / sizeof(elementSizes[0]); ++e) {
+                SCOPED_TRACE( testing::Message() << "pattern " << allPatterns[p] << ", " << sizes[s] << " bytes, elements of " << elementSizes[e] << " bytes" );
+                std::vector<unsigned char> compressed = roundTrip(data, elementSizes[e]);
+                const std::size_t chunkBytes = NATRON_CACHE_COMPRESSION_CHUNK_BYTES / elementSizes[e] * elementSizes[e];
+                const std::size_t nChunks = (sizes[s] + chunkBytes - 1) / chunkBytes;
+                if ( (allPatterns[p] == eDataPatternRandom) || (sizes[s] <= 12) ) {
+                    // The chunks are stored as is: a header of 16 bytes and the size of each chunk
+                    EXPECT_EQ(16 + nChunks * 4 + sizes[s], compressed.size());
+                } else if ( (sizes[s] > 1000) && ( (allPatterns[p] != eDataPatternSmooth) || (elementSizes[e] % 4 == 0) ) ) {
+                    // The floats compress once the bytes of each component are shuffled into planes
+                    EXPECT_LT( compressed.size(), sizes[s] );
+                }
+            }
+        }
+    }
+}
+
+TEST(CacheCompression, CorruptedInput)
+{
+    // Several chunks, a compressed one and a raw one
+    std::vector<unsigned char> data = makeData(eDataPatternSmooth, NATRON_CACHE_COMPRESSION_CHUNK_BYTES);
+    std::vector<unsigned char> noise = makeData(eDataPatternRandom, NATRON_CACHE_COMPRESSION_CHUNK_BYTES / 2);
+    data.insert( data.end(), noise.begin(), noise.end() );
+    std::vector<unsigned char> compressed;
+    CacheCompression::compress(&data[0], data.size(), 4, &compressed);
+    std::vector<unsigned char> decompressed( data.size() );
+    ASSERT_TRUE( CacheCompression::decompress(compressed, &decompressed[0], decompressed.size()) );
+
+    // Every truncation is detected
+    for (std::size_t truncated = 0; truncated < compressed.size(); truncated += 1 + truncated / 8) {
+        std::vector<unsigned char> truncatedData( compressed.begin(), compressed.begin() + truncated );
+        EXPECT_FALSE( CacheCompression::decompress(truncatedData, &decompressed[0], decompressed.size()) ) << truncated << " / " << compressed.size();
+    }
+    std::vector<unsigned char> empty;
+    EXPECT_EQ( (std::size_t)0, CacheCompression::getDecompressedSize(empty) );
+    EXPECT_FALSE( CacheCompression::decompress(empty, &decompressed[0], decompressed.size()) );
+
+    // A wrong size
+    EXPECT_FALSE( CacheCompression::decompress(compressed, &decompressed[0], decompressed.size() - 1) );
+
+    // A corrupted header: the element size, the chunks count or the size of a chunk
+    const std::size_t headerOffsets[] = { 8, 12, 16, 20 };
+    for (std::size_t i = 0; i < sizeof(headerOffsets) / sizeof(headerOffsets[0]); ++i) {
+        std::vector<unsigned char> corrupted(compressed);
+        corrupted[headerOffsets[i]] ^= 0x5A;
+        if (headerOffsets[i] == 8) {
+            // An element size of 0
+            std::memset(&corrupted[8], 0, 4);
+        }
+        EXPECT_FALSE( CacheCompression::decompress(corrupted, &decompressed[0], decompressed.size()) ) << "offset " << headerOffsets[i];
+    }
+}
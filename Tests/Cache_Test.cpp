@@ -0,0 +1,695 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <gtest/gtest.h>
+
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
+// clang-format off
+GCC_DIAG_OFF(unused-parameter)
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/list.hpp>
+#include <boost/serialization/string.hpp>
+#include <boost/serialization/utility.hpp>
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+GCC_DIAG_ON(unused-parameter)
+// clang-format on
+
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QThread>
+
+#include "Engine/AppManager.h"
+#include "Engine/Cache.h"
+#include "Engine/CacheJournal.h"
+#include "Engine/FrameEntry.h"
+#include "Engine/Image.h"
+#include "Engine/ImageParams.h"
+#include "Engine/RamBufferPool.h"
+#include "Engine/ViewIdx.h"
+
+NATRON_NAMESPACE_USING
+
+class CacheShards
+    : public ::testing::TestWithParam<int>
+{
+};
+
+// Hammers a cache split in GetParam() shards from many threads, with a memory budget that only holds a fraction of
+// the entries, so that entries are inserted, looked-up and evicted across all the shards.
+TEST_P(CacheShards, ConcurrentGetOrCreate)
+{
+    const int nShards = GetParam();
+    const int nThreads = std::max(2, QThread::idealThreadCount() * 2);
+    const int nOpsPerThread = 2000;
+    const int nDistinctKeys = 1024;
+    const int nEntriesInBudget = 64;
+
+    RectD rod(0, 0, 16, 16);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    const CacheEntryStorageInfo& info = params->getStorageInfo();
+    const std::size_t entryBytes = info.dataTypeSize * info.numComponents * info.bounds.area();
+    const std::size_t budget = entryBytes * nEntriesInBudget;
+    Cache<Image> cache("CacheShardsTest", 1, budget, 1., nShards);
+    ASSERT_EQ( nShards, cache.getShardsCount() );
+
+    std::atomic<int> nFailures(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; ++t) {
+        threads.push_back( std::thread([&, t]() {
+            for (int i = 0; i < nOpsPerThread; ++i) {
+                ImageKey key(0, (U64)( (i * 7 + t) % nDistinctKeys ), false, 0, ViewIdx(0), 1., false, false);
+                ImagePtr image;
+                cache.getOrCreate(key, params, 0, &image);
+                if (!image) {
+                    ++nFailures;
+                } else {
+                    image->allocateMemory();
+                }
+            }
+        }) );
+    }
+    for (std::size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    EXPECT_EQ(0, (int)nFailures);
+
+    U64 nLookups, nContendedLocks, lockWaitNSecs;
+    cache.getLockStats(&nLookups, &nContendedLocks, &lockWaitNSecs);
+    EXPECT_EQ( (U64)nThreads * nOpsPerThread, nLookups );
+
+    // Let the cleaner thread bring the cache back under its budget. A thread may allocate its entry while another one
+    // is evicting, hence the margin of one entry per thread.
+    cache.waitForDeleterThread();
+    std::vector<std::size_t> shardsSize;
+    cache.getShardsMemorySize(&shardsSize);
+    ASSERT_EQ( (std::size_t)nShards, shardsSize.size() );
+    std::size_t totalSize = 0;
+    for (int i = 0; i < nShards; ++i) {
+        totalSize += shardsSize[i];
+    }
+    EXPECT_EQ( cache.getMemoryCacheSize(), totalSize );
+    EXPECT_LE( totalSize, budget + nThreads * entryBytes );
+
+    // Evicting from the shards holding the most data brings the total under the limit, whichever shard is full
+    cache.clearExceedingEntries();
+    EXPECT_LT( (double)cache.getMemoryCacheSize(), NATRON_CACHE_LIMIT_PERCENT * budget );
+
+    // Entries of every shard can be found again
+    cache.clear();
+    std::vector<ImagePtr> images;
+    for (int i = 0; i < nEntriesInBudget / 2; ++i) {
+        ImageKey key(0, (U64)i, false, 0, ViewIdx(0), 1., false, false);
+        ImagePtr image;
+        EXPECT_FALSE( cache.getOrCreate(key, params, 0, &image) );
+        ASSERT_TRUE(image);
+        image->allocateMemory();
+        images.push_back(image);
+    }
+    cache.getShardsMemorySize(&shardsSize);
+    for (int i = 0; i < nShards; ++i) {
+        EXPECT_GT( shardsSize[i], (std::size_t)0 );
+    }
+    for (int i = 0; i < nEntriesInBudget / 2; ++i) {
+        ImageKey key(0, (U64)i, false, 0, ViewIdx(0), 1., false, false);
+        std::list<ImagePtr> entries;
+        EXPECT_TRUE( cache.get(key, &entries) );
+        ASSERT_EQ( (std::size_t)1, entries.size() );
+        EXPECT_EQ( images[i], entries.front() );
+    }
+    images.clear();
+    cache.clear();
+    cache.waitForDeleterThread();
+
+    // A single thread within the budget of a cache never waits on its locks: the cleaner thread is not started
+    Cache<Image> serialCache("CacheShardsSerialTest", 1, budget, 1., nShards);
+    for (int i = 0; i < nEntriesInBudget / 2; ++i) {
+        ImageKey key(0, (U64)i, false, 0, ViewIdx(0), 1., false, false);
+        ImagePtr image;
+        serialCache.getOrCreate(key, params, 0, &image);
+        ASSERT_TRUE(image);
+        image->allocateMemory();
+        std::list<ImagePtr> entries;
+        EXPECT_TRUE( serialCache.get(key, &entries) );
+    }
+    serialCache.getLockStats(&nLookups, &nContendedLocks, &lockWaitNSecs);
+    EXPECT_EQ( (U64)nEntriesInBudget, nLookups );
+    EXPECT_EQ( (U64)0, nContendedLocks );
+    EXPECT_EQ( (U64)0, lockWaitNSecs );
+    serialCache.clear();
+    serialCache.waitForDeleterThread();
+}
+
+INSTANTIATE_TEST_CASE_P(Cache, CacheShards, ::testing::Values(1, 4, 16));
+
+static float
+getCompressionTestPixel(bool noise,
+                        int frame,
+                        int x,
+                        int y,
+                        int c)
+{
+    if (noise) {
+        // Incompressible: the chunks of the frames are stored as is
+        U32 h = (U32)x * 73856093U ^ (U32)y * 19349663U ^ (U32)(frame * 4 + c) * 83492791U;
+        h ^= h >> 13;
+        h *= 0x5bd1e995U;
+        h ^= h >> 15;
+
+        return (float)(h & 0xFFFFFF) / 0x1000000;
+    }
+
+    // A smooth image with a different gradient per channel, like a render
+    return c == 3 ? 1.f : 0.5f + 0.4f * std::sin(x * 0.01f + frame + c) * std::cos(y * 0.013f - c);
+}
+
+// Fills a cache with more float frames than its memory portion holds, so that the least recently used ones are
+// kept in its compressed portion, then reads back the compressed frames.
+static void
+checkCompressedPortion(bool noise)
+{
+    const int nFrames = 32;
+    RectD rod(0, 0, 512, 270);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthFloat, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    const CacheEntryStorageInfo& info = params->getStorageInfo();
+    const std::size_t frameBytes = info.dataTypeSize * info.numComponents * info.bounds.area();
+    // The frames are split in several chunks by the compression
+    ASSERT_GT(frameBytes, (std::size_t)NATRON_CACHE_COMPRESSION_CHUNK_BYTES);
+
+    // The cache has the RAM of 12 frames: 4 in the memory portion, the rest for the compressed portion
+    const double ramFrames = 12.;
+    Cache<Image> cache("CompressedPortionTest", 1, frameBytes * ramFrames, 4.5 / ramFrames);
+    cache.setMaximumCompressedSize(7.5 / ramFrames);
+
+    std::vector<std::weak_ptr<Image> > frames;
+    std::vector<ImageKey> keys;
+    for (int f = 0; f < nFrames; ++f) {
+        keys.push_back( ImageKey(0, 1, true, f, ViewIdx(0), 1., false, false) );
+        ImagePtr image;
+        cache.getOrCreate(keys.back(), params, 0, &image);
+        ASSERT_TRUE(image);
+        image->allocateMemory();
+        const RectI bounds = image->getBounds();
+        Image::WriteAccess acc = image->getWriteRights();
+        for (int y = bounds.y1; y < bounds.y2; ++y) {
+            float* pix = (float*)acc.pixelAt(bounds.x1, y);
+            for (int x = bounds.x1; x < bounds.x2; ++x) {
+                for (int c = 0; c < 4; ++c) {
+                    *pix++ = getCompressionTestPixel(noise, f, x, y, c);
+                }
+            }
+        }
+        frames.push_back(image);
+    }
+
+    // Wait for the compressor thread
+    for (int i = 0; i < 200; ++i) {
+        bool compressing = false;
+        for (int f = 0; f < nFrames; ++f) {
+            ImagePtr image = frames[f].lock();
+            if ( image && (image->getCompressedPortionSize() > 0) && !image->isCompressed() ) {
+                compressing = true;
+            }
+        }
+        if (!compressing) {
+            break;
+        }
+        QThread::msleep(50);
+    }
+    std::size_t compressedSize = cache.getCompressedCacheSize();
+
+    std::vector<int> compressedFrames;
+    for (int f = 0; f < nFrames; ++f) {
+        ImagePtr image = frames[f].lock();
+        if ( image && image->isCompressed() ) {
+            compressedFrames.push_back(f);
+        }
+    }
+    ASSERT_FALSE( compressedFrames.empty() );
+    EXPECT_LE( compressedSize, (std::size_t)(frameBytes * 7.5) );
+    if (noise) {
+        // Stored as is, with the headers of the chunks
+        EXPECT_GE(compressedSize, compressedFrames.size() * frameBytes);
+    } else {
+        EXPECT_LT(compressedSize, compressedFrames.size() * frameBytes);
+    }
+
+    // The frame is decompressed without the lock of the shard: the threads looking it up meanwhile must find
+    // the same entry rather than creating another one
+    {
+        const int f = compressedFrames.front();
+        const int nThreads = 4;
+        std::vector<ImagePtr> found(nThreads);
+        std::atomic<int> nFound(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; ++t) {
+            threads.push_back( std::thread([&, t]() {
+                if ( cache.getOrCreate(keys[f], params, 0, &found[t]) ) {
+                    ++nFound;
+                }
+            }) );
+        }
+        for (std::size_t t = 0; t < threads.size(); ++t) {
+            threads[t].join();
+        }
+        EXPECT_EQ(nThreads, nFound.load());
+        for (int t = 1; t < nThreads; ++t) {
+            EXPECT_EQ( found[0].get(), found[t].get() );
+        }
+        EXPECT_FALSE( found[0]->isCompressed() );
+    }
+
+    // Read back the compressed frames, the most recently used first as a playback going backwards would
+    for (int i = (int)compressedFrames.size() - 1; i >= 0; --i) {
+        const int f = compressedFrames[i];
+        std::list<ImagePtr> entries;
+        ASSERT_TRUE( cache.get(keys[f], &entries) );
+        ASSERT_EQ( (std::size_t)1, entries.size() );
+
+        const ImagePtr& image = entries.front();
+        EXPECT_FALSE( image->isCompressed() );
+        const RectI bounds = image->getBounds();
+        Image::ReadAccess acc = image->getReadRights();
+        bool equal = true;
+        for (int y = bounds.y1; y < bounds.y2 && equal; ++y) {
+            const float* pix = (const float*)acc.pixelAt(bounds.x1, y);
+            for (int x = bounds.x1; x < bounds.x2 && equal; ++x) {
+                for (int c = 0; c < 4; ++c) {
+                    equal &= ( *pix++ == getCompressionTestPixel(noise, f, x, y, c) );
+                }
+            }
+        }
+        EXPECT_TRUE(equal) << "frame " << f;
+    }
+
+    cache.waitForDeleterThread();
+}
+
+TEST(Cache, CompressedPortion)
+{
+    checkCompressedPortion(false);
+}
+
+TEST(Cache, CompressedPortionIncompressible)
+{
+    checkCompressedPortion(true);
+}
+
+// The pixels stored by the mixed tiles of the bitmap of a cached image are counted in its size and in the cache
+TEST(Cache, BitmapMemoryAccounting)
+{
+    RectD rod(0, 0, 1000, 500);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthByte, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    Cache<Image> cache("BitmapMemoryAccountingTest", 1, 64 * 1024 * 1024, 1.);
+    ImageKey key(0, 1, false, 0, ViewIdx(0), 1., false, false);
+    ImagePtr image;
+
+    cache.getOrCreate(key, params, 0, &image);
+    ASSERT_TRUE(image);
+    image->allocateMemory();
+    const std::size_t allocatedSize = image->size();
+    EXPECT_EQ( allocatedSize, cache.getMemoryCacheSize() );
+
+    // A rectangle that does not fall on the tile grid makes the tiles on its edges store their pixels
+    image->markForRendered( RectI(10, 10, 300, 200) );
+    EXPECT_GT( image->size(), allocatedSize );
+    EXPECT_EQ( image->size(), cache.getMemoryCacheSize() );
+    image->markForRendering( RectI(500, 100, 530, 300) );
+    EXPECT_EQ( image->size(), cache.getMemoryCacheSize() );
+
+    // Once the bitmap is uniform again, the tiles only store their state
+    image->markForRendered( image->getBounds() );
+    EXPECT_EQ( allocatedSize, image->size() );
+    EXPECT_EQ( allocatedSize, cache.getMemoryCacheSize() );
+
+    // The size removed from the cache with the entry is the one it accounted
+    image->clearBitmap( RectI(1, 1, 2, 2) );
+    image.reset();
+    cache.clear();
+    cache.waitForDeleterThread();
+    EXPECT_EQ( (std::size_t)0, cache.getMemoryCacheSize() );
+}
+
+// The free blocks of the RamBufferPool count in the RAM budget of the cache: they are given back to the system
+// before any entry is evicted
+TEST(Cache, BufferPoolTrimmedBeforeEviction)
+{
+    const std::size_t maxBytes = 32 * 1024 * 1024;
+    const std::size_t blockBytes = 4 * 1024 * 1024;
+    RamBufferPool* pool = RamBufferPool::instance();
+    RamBufferPoolStats initial;
+
+    pool->getStats(&initial);
+    // Start from an empty pool
+    pool->setMaximumFreeBytes(0);
+    pool->setMaximumFreeBytes(2 * maxBytes);
+
+    RectD rod(0, 0, 1024, 1024);
+    ImageParamsPtr params = Image::makeParams(rod, 1., 0, false, ImagePlaneDesc::getRGBAComponents(),
+                                              eImageBitDepthByte, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    Cache<Image> cache("BufferPoolTrimTest", 1, maxBytes, 1.);
+    ImageKey key(0, 1, false, 0, ViewIdx(0), 1., false, false);
+    {
+        ImagePtr image;
+        cache.getOrCreate(key, params, 0, &image);
+        ASSERT_TRUE(image);
+        image->allocateMemory();
+    }
+    const std::size_t entriesSize = cache.getMemoryCacheSize();
+    ASSERT_GT( entriesSize, (std::size_t)0 );
+
+    // Released buffers stay in the pool: with the entry, they exceed the budget of the cache
+    {
+        RamBuffer<char> buffers[8];
+        for (int i = 0; i < 8; ++i) {
+            buffers[i].resize(blockBytes);
+        }
+    }
+    ASSERT_GE( entriesSize + pool->getFreeBytes(), (std::size_t)(NATRON_CACHE_LIMIT_PERCENT * maxBytes) );
+
+    cache.clearExceedingEntries();
+
+    // The pool was trimmed to the room left by the entries, which were all kept
+    EXPECT_LE( entriesSize + pool->getFreeBytes(), (std::size_t)(NATRON_CACHE_LIMIT_PERCENT * maxBytes) );
+    EXPECT_GT( pool->getFreeBytes(), (std::size_t)0 );
+    EXPECT_EQ( entriesSize, cache.getMemoryCacheSize() );
+    std::list<ImagePtr> entries;
+    EXPECT_TRUE( cache.get(key, &entries) );
+
+    entries.clear();
+    cache.clear();
+    cache.waitForDeleterThread();
+    pool->setMaximumFreeBytes(0);
+    pool->setMaximumFreeBytes(initial.maximumFreeBytes);
+}
+
+static std::string
+makeJournalPayload(int i)
+{
+    // About the size of a serialized image entry: key, params and file path
+    std::ostringstream ss;
+    ss << "entry" << i << std::string(160, 'x');
+
+    return ss.str();
+}
+
+static void
+addJournalRecord(CacheJournal& journal,
+                 int i)
+{
+    std::string payload = makeJournalPayload(i);
+
+    journal.appendAdd( (U64)i, CacheJournal::getEntryLocation("CachePart0", i), payload.data(), payload.size() );
+}
+
+static std::vector<int>
+getRestoredJournalRecords(const CacheJournal& journal)
+{
+    std::vector<int> ret;
+    const std::vector<CacheJournal::Record>& records = journal.getRestoredRecords();
+
+    for (std::size_t i = 0; i < records.size(); ++i) {
+        EXPECT_EQ( makeJournalPayload( (int)records[i].hash ), std::string(records[i].payload, records[i].payloadSize) );
+        ret.push_back( (int)records[i].hash );
+    }
+
+    return ret;
+}
+
+// Only the entries committed by a sync point survive a crash
+TEST(CacheJournal, CrashRecovery)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE( dir.isValid() );
+    std::string filePath = dir.path().toStdString() + "/journal.ntc";
+    const unsigned int version = 1;
+
+    {
+        CacheJournal journal;
+        EXPECT_FALSE( journal.open(filePath, version) );
+        journal.finishRestore();
+        addJournalRecord(journal, 0);
+        addJournalRecord(journal, 1);
+        addJournalRecord(journal, 2);
+        journal.sync();
+        journal.appendRemove( 1, CacheJournal::getEntryLocation("CachePart0", 1) );
+        // Not committed when the application "crashes"
+        addJournalRecord(journal, 3);
+    }
+    {
+        CacheJournal journal;
+        EXPECT_TRUE( journal.open(filePath, version) );
+        EXPECT_EQ( std::vector<int>({0, 2}), getRestoredJournalRecords(journal) );
+        journal.finishRestore();
+        addJournalRecord(journal, 4);
+        // Added and removed within the same sync point
+        addJournalRecord(journal, 5);
+        journal.appendRemove( 5, CacheJournal::getEntryLocation("CachePart0", 5) );
+        journal.sync();
+    }
+    {
+        CacheJournal journal;
+        EXPECT_TRUE( journal.open(filePath, version) );
+        EXPECT_EQ( std::vector<int>({0, 2, 4}), getRestoredJournalRecords(journal) );
+        journal.finishRestore();
+    }
+
+    // The compacted journal replaces the previous one and keeps the same records
+    {
+        CacheJournal journal;
+        EXPECT_TRUE( journal.open(filePath, version) );
+        std::vector<CacheJournal::Record> records = journal.getRestoredRecords();
+        std::vector<std::string> payloads;
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            payloads.push_back( std::string(records[i].payload, records[i].payloadSize) );
+        }
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            records[i].payload = payloads[i].data();
+        }
+        journal.finishRestore();
+        journal.rewrite(records);
+        EXPECT_FALSE( QFile::exists( QString::fromUtf8( (filePath + ".tmp").c_str() ) ) );
+        addJournalRecord(journal, 6);
+        journal.sync();
+    }
+    {
+        CacheJournal journal;
+        EXPECT_TRUE( journal.open(filePath, version) );
+        EXPECT_EQ( std::vector<int>({0, 2, 4, 6}), getRestoredJournalRecords(journal) );
+        journal.finishRestore();
+        addJournalRecord(journal, 7);
+        journal.sync();
+    }
+    {
+        CacheJournal journal;
+        EXPECT_TRUE( journal.open(filePath, version) );
+        EXPECT_EQ( std::vector<int>({0, 2, 4, 6, 7}), getRestoredJournalRecords(journal) );
+        journal.finishRestore();
+    }
+
+    // Tear the last sync point as if the application crashed while writing it
+    {
+        QFile file( QString::fromUtf8( filePath.c_str() ) );
+        ASSERT_TRUE( file.open(QIODevice::ReadWrite) );
+        file.resize(file.size() - 5);
+    }
+    {
+        CacheJournal journal;
+        EXPECT_TRUE( journal.open(filePath, version) );
+        EXPECT_EQ( std::vector<int>({0, 2, 4, 6}), getRestoredJournalRecords(journal) );
+        journal.finishRestore();
+    }
+
+    // A journal of another cache version is discarded
+    {
+        CacheJournal journal;
+        EXPECT_FALSE( journal.open(filePath, version + 1) );
+        EXPECT_TRUE( journal.getRestoredRecords().empty() );
+    }
+}
+
+// Compares the startup and quit times of the journal against serializing the whole table of contents
+// with boost as it was done before, with 100k entries in the cache.
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST(CacheJournal, DISABLED_StartupTime)
+{
+    const int nEntries = 100000;
+    const int nNewEntriesPerSession = 100;
+
+    QTemporaryDir dir;
+    ASSERT_TRUE( dir.isValid() );
+    std::string journalPath = dir.path().toStdString() + "/journal.ntc";
+    std::string tocPath = dir.path().toStdString() + "/restoreFile.ntc";
+
+    std::list<std::pair<U64, std::string> > toc;
+    {
+        CacheJournal journal;
+        journal.open(journalPath, 1);
+        journal.finishRestore();
+        for (int i = 0; i < nEntries; ++i) {
+            addJournalRecord(journal, i);
+            toc.push_back( std::make_pair( (U64)i, makeJournalPayload(i) ) );
+        }
+        journal.sync();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    {
+        std::ofstream ofile(tocPath.c_str(), std::ios::binary);
+        boost::archive::binary_oarchive oArchive(ofile);
+        oArchive << toc;
+    }
+    double tocSaveMSecs = timer.nsecsElapsed() / 1e6;
+
+    timer.restart();
+    std::list<std::pair<U64, std::string> > restoredToc;
+    {
+        std::ifstream ifile(tocPath.c_str(), std::ios::binary);
+        boost::archive::binary_iarchive iArchive(ifile);
+        iArchive >> restoredToc;
+    }
+    double tocRestoreMSecs = timer.nsecsElapsed() / 1e6;
+    EXPECT_EQ( (std::size_t)nEntries, restoredToc.size() );
+
+    timer.restart();
+    CacheJournal journal;
+    EXPECT_TRUE( journal.open(journalPath, 1) );
+    std::size_t nRestored = journal.getRestoredRecords().size();
+    double journalRestoreMSecs = timer.nsecsElapsed() / 1e6;
+    EXPECT_EQ( (std::size_t)nEntries, nRestored );
+    journal.finishRestore();
+
+    timer.restart();
+    for (int i = nEntries; i < nEntries + nNewEntriesPerSession; ++i) {
+        addJournalRecord(journal, i);
+    }
+    journal.sync();
+    double journalSaveMSecs = timer.nsecsElapsed() / 1e6;
+
+    std::cout << "Cache table of contents with " << nEntries << " entries: boost archive restore " << tocRestoreMSecs
+              << " ms, save " << tocSaveMSecs << " ms; journal restore " << journalRestoreMSecs << " ms, save of "
+              << nNewEntriesPerSession << " new entries " << journalSaveMSecs << " ms" << std::endl;
+}
+
+static FrameKey
+makePrefetchTestKey(int frame)
+{
+    return FrameKey(0, frame, 1, 1., 1., 0, (int)eImageBitDepthByte, 0, ViewIdx(0), TextureRect(0, 0, 256, 256, 256, 1.), 0,
+                    "Read1", ImagePlaneDesc::getRGBAComponents(), std::string(), false, false);
+}
+
+// Plays a range of frames stored in the disk portion of a tiled cache, reading ahead the next frames with
+// Cache::prefetch() as the viewer does, and checks that the frames read were prefetched.
+TEST(CachePrefetch, PlaybackFromDisk)
+{
+    const int nFrames = 24;
+    const int prefetchDepth = 4;
+    const int tileSize = 256;
+    const std::size_t tileBytes = tileSize * tileSize * 4;
+    FrameParamsPtr params = std::make_shared<FrameParams>(RectI(0, 0, tileSize, tileSize), (int)eImageBitDepthByte,
+                                                          RectI(0, 0, tileSize, tileSize), ImagePtr() );
+
+    Cache<FrameEntry> cache("CachePrefetchTest", 1, tileBytes * nFrames * 4, 0.5);
+    cache.setTiled(true, tileBytes);
+    QDir cacheDir( cache.getCachePath() );
+    ASSERT_TRUE( cacheDir.mkpath( QString::fromUtf8(".") ) );
+
+    std::vector<U64> hashes;
+    for (int f = 0; f < nFrames; ++f) {
+        FrameKey key = makePrefetchTestKey(f);
+        FrameEntryPtr entry;
+        EXPECT_FALSE( cache.getOrCreate(key, params, 0, &entry) );
+        ASSERT_TRUE(entry);
+        entry->allocateMemory();
+        std::fill(entry->data(), entry->data() + tileBytes, (U8)f);
+        hashes.push_back( key.getHash() );
+    }
+
+    U64 nHitsBefore, nMissesBefore, nTilesPrefetched;
+    cache.getPrefetchStats(&nHitsBefore, &nMissesBefore, &nTilesPrefetched);
+
+    // Without read-ahead every frame read from the disk portion is a miss
+    for (int f = 0; f < nFrames; ++f) {
+        std::list<FrameEntryPtr> entries;
+        ASSERT_TRUE( cache.get(makePrefetchTestKey(f), &entries) );
+        ASSERT_EQ( (std::size_t)1, entries.size() );
+        EXPECT_EQ( (U8)f, entries.front()->data()[tileBytes - 1] );
+    }
+    U64 nHits, nMisses;
+    cache.getPrefetchStats(&nHits, &nMisses, &nTilesPrefetched);
+    EXPECT_EQ( nHitsBefore, nHits );
+    EXPECT_EQ( nMissesBefore + nFrames, nMisses );
+
+    // With read-ahead only the first frame is a miss. Requests overlap: a frame already prefetched is not requested
+    // again, and hashes which are not in the cache are ignored.
+    for (int f = 0; f < nFrames; ++f) {
+        std::vector<U64> next;
+        for (int n = f + 1; n <= f + prefetchDepth && n < nFrames; ++n) {
+            next.push_back(hashes[n]);
+        }
+        next.push_back( makePrefetchTestKey(nFrames + f).getHash() );
+        cache.prefetch(next);
+
+        std::list<FrameEntryPtr> entries;
+        ASSERT_TRUE( cache.get(makePrefetchTestKey(f), &entries) );
+        ASSERT_EQ( (std::size_t)1, entries.size() );
+        EXPECT_EQ( (U8)f, entries.front()->data()[0] );
+    }
+    U64 nHitsAfter, nMissesAfter;
+    cache.getPrefetchStats(&nHitsAfter, &nMissesAfter, &nTilesPrefetched);
+    EXPECT_EQ( nHits + nFrames - 1, nHitsAfter );
+    EXPECT_EQ( nMisses + 1, nMissesAfter );
+    EXPECT_LE( nTilesPrefetched, (U64)(nFrames - 1) );
+
+    // Frames not in the cache are neither hits nor misses
+    std::list<FrameEntryPtr> entries;
+    EXPECT_FALSE( cache.get(makePrefetchTestKey(nFrames), &entries) );
+    cache.getPrefetchStats(&nHits, &nMisses, &nTilesPrefetched);
+    EXPECT_EQ(nHitsAfter, nHits);
+    EXPECT_EQ(nMissesAfter, nMisses);
+
+    cache.clear();
+    cache.waitForDeleterThread();
+    cacheDir.removeRecursively();
+}
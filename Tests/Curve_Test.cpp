@@ -25,10 +25,14 @@
 
 #include "Global/Macros.h"
 
+#include <cmath>
+#include <iostream>
+#include <vector>
 #include <gtest/gtest.h>
 
 #include <QtCore/QString>
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
 
 #include "Engine/Curve.h"
 
@@ -125,3 +129,132 @@ TEST(Curve, Basic)
 }
 
 
+
+static void
+addTestKeyFrames(Curve* c,
+                 int nKeys)
+{
+    const KeyframeTypeEnum types[] = { eKeyframeTypeSmooth, eKeyframeTypeLinear, eKeyframeTypeConstant, eKeyframeTypeCatmullRom, eKeyframeTypeCubic };
+
+    for (int i = 0; i < nKeys; ++i) {
+        EXPECT_TRUE( c->addKeyFrame( KeyFrame( i * 3., std::sin(i * 0.7) * 100., 0., 0., types[i % 5] ) ) );
+    }
+}
+
+// getValuesAt() evaluates the curve as getValueAt() does at each time, whatever the order of the times
+TEST(Curve, GetValuesAt)
+{
+    // Sorted times, unsorted times and times outside of the keyframes
+    std::vector<double> times;
+    for (double t = -10.; t < 160.; t += 0.37) {
+        times.push_back(t);
+    }
+    for (int i = 0; i < 200; ++i) {
+        times.push_back( (i * 7919) % 1700 * 0.1 - 10. );
+    }
+    std::vector<double> values( times.size() );
+
+    for (int periodic = 0; periodic < 2; ++periodic) {
+        for (int ranged = 0; ranged < 2; ++ranged) {
+            Curve c;
+            // setPeriodic() removes the keyframes
+            c.setPeriodic(periodic != 0);
+            if (ranged) {
+                // The values of the keyframes go beyond the range, so that the clamped values differ
+                c.setYRange(-50., 50.);
+            }
+            addTestKeyFrames(&c, 50);
+            for (int clamp = 0; clamp < 2; ++clamp) {
+                c.getValuesAt(&times[0], (int)times.size(), &values[0], clamp != 0);
+                for (std::size_t i = 0; i < times.size(); ++i) {
+                    EXPECT_EQ(c.getValueAt(times[i], clamp != 0), values[i]) << "time " << times[i];
+                }
+            }
+        }
+    }
+
+    // An empty curve is zero everywhere
+    Curve empty;
+    values.assign(times.size(), 1.);
+    empty.getValuesAt(&times[0], (int)times.size(), &values[0]);
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        EXPECT_EQ(0., values[i]);
+    }
+}
+
+// Evaluates a curve with many keyframes at increasing times with getValueAt() and with getValuesAt().
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST(Curve, DISABLED_GetValuesAtBenchmark)
+{
+    const int nKeys = 2000;
+    const int nTimes = 200000;
+    Curve c;
+
+    addTestKeyFrames(&c, nKeys);
+
+    std::vector<double> times(nTimes);
+    for (int i = 0; i < nTimes; ++i) {
+        times[i] = (double)i * nKeys * 3. / nTimes;
+    }
+    std::vector<double> values(nTimes);
+    std::vector<double> batchValues(nTimes);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < nTimes; ++i) {
+        values[i] = c.getValueAt(times[i]);
+    }
+    const double singleMS = timer.nsecsElapsed() / 1000000.;
+
+    timer.restart();
+    c.getValuesAt(&times[0], nTimes, &batchValues[0]);
+    const double batchMS = timer.nsecsElapsed() / 1000000.;
+
+    EXPECT_TRUE(values == batchValues);
+    std::cout << "Curve with " << nKeys << " keyframes evaluated at " << nTimes << " times: "
+              << singleMS << " ms with getValueAt, " << batchMS << " ms with getValuesAt" << std::endl;
+}
+
+TEST(Curve, GetValueAtUnlocked)
+{
+    Curve c;
+
+    // Sorted times, unsorted times and times outside of the keyframes
+    std::vector<double> times;
+    for (double t = -10.; t < 160.; t += 0.37) {
+        times.push_back(t);
+    }
+    for (int i = 0; i < 200; ++i) {
+        times.push_back( (i * 7919) % 1700 * 0.1 - 10. );
+    }
+
+    // The copy of a curve, read without locking it
+    for (int periodic = 0; periodic < 2; ++periodic) {
+        // setPeriodic() removes the keyframes
+        c.setPeriodic(periodic != 0);
+        addTestKeyFrames(&c, 50);
+        Curve copy(c);
+        for (std::size_t i = 0; i < times.size(); ++i) {
+            EXPECT_EQ( c.getValueAt(times[i], false), copy.getValueAtUnlocked(times[i]) );
+        }
+    }
+
+    // Adding a keyframe is seen by the next evaluation and by the next read-only copy, the previous copy is unchanged
+    CurvePtr readOnlyCopy = c.getReadOnlyCopy();
+    EXPECT_EQ( readOnlyCopy, c.getReadOnlyCopy() );
+    const double previousValue = c.getValueAt(1.5, false);
+    EXPECT_TRUE( c.addKeyFrame( KeyFrame(1.5, 1000.) ) );
+    EXPECT_EQ( 1000., c.getValueAt(1.5, false) );
+    EXPECT_EQ( previousValue, readOnlyCopy->getValueAtUnlocked(1.5) );
+    CurvePtr newReadOnlyCopy = c.getReadOnlyCopy();
+    EXPECT_NE(readOnlyCopy, newReadOnlyCopy);
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        EXPECT_EQ( c.getValueAt(times[i], false), newReadOnlyCopy->getValueAtUnlocked(times[i]) );
+    }
+
+    // An empty curve is zero everywhere
+    Curve empty;
+    for (std::size_t i = 0; i < times.size(); ++i) {
+        EXPECT_EQ( 0., empty.getValueAt(times[i]) );
+    }
+}
@@ -25,14 +25,40 @@
 
 #include "Global/Macros.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <cstring>
+#include <iostream>
 #include <gtest/gtest.h>
 
+#include <QtCore/QElapsedTimer>
+
+#include "Engine/Half.h"
 #include "Engine/Image.h"
+#include "Engine/ImageScopes.h"
+#include "Engine/Lut.h"
+#include "Engine/RamBufferPool.h"
 #include "Engine/ViewIdx.h"
 
 NATRON_NAMESPACE_USING
 
+static bool
+bitmapOnlyContains(const Bitmap& bm,
+                   const RectI& rect,
+                   int state)
+{
+    for (int y = rect.y1; y < rect.y2; ++y) {
+        for (int x = rect.x1; x < rect.x2; ++x) {
+            if (bm.getPixel(x, y) != state) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 TEST(BitmapTest,
      SimpleRect)
 {
@@ -52,8 +78,7 @@ TEST(BitmapTest,
     ASSERT_TRUE(rod == nonRenderedRectsUnion);
 
     ///assert that the "underlying" bitmap is clean
-    const char* map = bm.getBitmap();
-    ASSERT_TRUE( !std::memchr( map, 1, rod.area() ) );
+    ASSERT_TRUE( bitmapOnlyContains(bm, rod, 0) );
     ASSERT_TRUE( bm.isNonMarked(rod) );
 
     RectI halfRoD(0, 0, 100, 50);
@@ -69,14 +94,12 @@ TEST(BitmapTest,
 
 
     ///assert that the underlying bitmap is marked as expected
-    const char* start = map;
 
     ///check that there are only ones in the rendered half
-    ASSERT_TRUE( !memchr( start, 0, halfRoD.area() ) );
+    ASSERT_TRUE( bitmapOnlyContains(bm, halfRoD, 1) );
 
     ///check that there are only 0s in the non rendered half
-    start = map + halfRoD.area();
-    ASSERT_TRUE( !memchr( start, 1, halfRoD.area() ) );
+    ASSERT_TRUE( bitmapOnlyContains(bm, nonRenderedHalf, 0) );
 
     ///mark for renderer the other half of the rod
     bm.markForRendered(nonRenderedHalf);
@@ -85,7 +108,7 @@ TEST(BitmapTest,
     nonRenderedRects.clear();
     bm.minimalNonMarkedRects(rod, nonRenderedRects);
     ASSERT_TRUE( nonRenderedRects.empty() );
-    ASSERT_TRUE( !memchr( map, 0, rod.area() ) );
+    ASSERT_TRUE( bitmapOnlyContains(bm, rod, 1) );
 
     ///More complex example where A,B,C,D are not rendered check that both trimap & bitmap yield the same result
     // BBBBBBBBBBBBBB
@@ -117,6 +140,388 @@ TEST(BitmapTest,
     EXPECT_TRUE(nonRenderedRects.size() == 3);
 } // TEST
 
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+/**
+ * @brief The previous implementation of the Bitmap, with one char per pixel, used as a reference for the tiled one:
+ * the queries must return the same rectangles, in the same order.
+ **/
+class ReferenceBitmap
+{
+public:
+    ReferenceBitmap(const RectI& bounds)
+        : _bounds(bounds)
+        , _map(bounds.area(), 0)
+    {
+    }
+
+    int getPixel(int x,
+                 int y) const
+    {
+        return _map[(y - _bounds.y1) * _bounds.width() + (x - _bounds.x1)];
+    }
+
+    void markFor(const RectI& roi,
+                 char value)
+    {
+        const RectI rect = roi.intersect(_bounds);
+
+        for (int y = rect.y1; y < rect.y2; ++y) {
+            std::memset(&_map[(y - _bounds.y1) * _bounds.width() + (rect.x1 - _bounds.x1)], value, rect.width());
+        }
+    }
+
+    bool isNonMarked(const RectI& roi) const
+    {
+        const RectI rect = roi.intersect(_bounds);
+
+        for (int y = rect.y1; y < rect.y2; ++y) {
+            for (int x = rect.x1; x < rect.x2; ++x) {
+                if ( getPixel(x, y) ) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    template <int trimap>
+    RectI minimalNonMarkedBbox(const RectI& roi,
+                               bool* isBeingRenderedElsewhere) const
+    {
+        RectI bbox = roi;
+
+        while ( bbox.y1 < bbox.y2 && isLineMarked(RectI(bbox.x1, bbox.y1, bbox.x2, bbox.y1 + 1), trimap, isBeingRenderedElsewhere) ) {
+            ++bbox.y1;
+        }
+        while ( bbox.y2 > bbox.y1 && isLineMarked(RectI(bbox.x1, bbox.y2 - 1, bbox.x2, bbox.y2), trimap, isBeingRenderedElsewhere) ) {
+            --bbox.y2;
+        }
+        if ( bbox.isNull() ) {
+            return bbox;
+        }
+        while ( bbox.x1 < bbox.x2 && isLineMarked(RectI(bbox.x1, bbox.y1, bbox.x1 + 1, bbox.y2), trimap, isBeingRenderedElsewhere) ) {
+            ++bbox.x1;
+        }
+        while ( bbox.x2 > bbox.x1 && isLineMarked(RectI(bbox.x2 - 1, bbox.y1, bbox.x2, bbox.y2), trimap, isBeingRenderedElsewhere) ) {
+            --bbox.x2;
+        }
+
+        return bbox;
+    }
+
+    template <int trimap>
+    void minimalNonMarkedRects(const RectI& roi,
+                               std::list<RectI>& ret,
+                               bool* isBeingRenderedElsewhere) const
+    {
+        const RectI intersection = roi.intersect(_bounds);
+
+        if (roi != intersection) {
+            if ( (_bounds.x1 > roi.x1) && (_bounds.y2 > _bounds.y1) ) {
+                ret.push_back( RectI(roi.x1, _bounds.y1, _bounds.x1, _bounds.y2) );
+            }
+            if ( (roi.x2 > roi.x1) && (_bounds.y1 > roi.y1) ) {
+                ret.push_back( RectI(roi.x1, roi.y1, roi.x2, _bounds.y1) );
+            }
+            if ( (roi.x2 > _bounds.x2) && (_bounds.y2 > _bounds.y1) ) {
+                ret.push_back( RectI(_bounds.x2, _bounds.y1, roi.x2, _bounds.y2) );
+            }
+            if ( (roi.x2 > roi.x1) && (roi.y2 > _bounds.y2) ) {
+                ret.push_back( RectI(roi.x1, _bounds.y2, roi.x2, roi.y2) );
+            }
+        }
+        if ( intersection.isNull() ) {
+            return;
+        }
+
+        const RectI bboxM = minimalNonMarkedBbox<trimap>(intersection, isBeingRenderedElsewhere);
+        if ( bboxM.isNull() ) {
+            return;
+        }
+
+        // Trim the rows and columns with nothing rendered from each side of the bounding box, A at the bottom,
+        // B at the top, then C on the left and D on the right of what remains
+        RectI bboxX = bboxM;
+        RectI bboxA = bboxX;
+        bboxA.y2 = bboxX.y1;
+        while ( bboxX.y1 < bboxX.y2 && isLineNonMarked(RectI(bboxX.x1, bboxX.y1, bboxX.x2, bboxX.y1 + 1), trimap, isBeingRenderedElsewhere) ) {
+            bboxA.y2 = ++bboxX.y1;
+        }
+        if ( !bboxA.isNull() ) {
+            ret.push_back(bboxA);
+        }
+
+        RectI bboxB = bboxX;
+        bboxB.y1 = bboxX.y2;
+        while ( bboxX.y2 > bboxX.y1 && isLineNonMarked(RectI(bboxX.x1, bboxX.y2 - 1, bboxX.x2, bboxX.y2), trimap, isBeingRenderedElsewhere) ) {
+            bboxB.y1 = --bboxX.y2;
+        }
+        if ( !bboxB.isNull() ) {
+            ret.push_back(bboxB);
+        }
+
+        RectI bboxC = bboxX;
+        bboxC.x2 = bboxX.x1;
+        while ( bboxX.y1 < bboxX.y2 && bboxX.x1 < bboxX.x2 &&
+                isLineNonMarked(RectI(bboxX.x1, bboxX.y1, bboxX.x1 + 1, bboxX.y2), trimap, isBeingRenderedElsewhere) ) {
+            bboxC.x2 = ++bboxX.x1;
+        }
+        if ( !bboxC.isNull() ) {
+            ret.push_back(bboxC);
+        }
+
+        RectI bboxD = bboxX;
+        bboxD.x1 = bboxX.x2;
+        while ( bboxX.y1 < bboxX.y2 && bboxX.x2 > bboxX.x1 &&
+                isLineNonMarked(RectI(bboxX.x2 - 1, bboxX.y1, bboxX.x2, bboxX.y2), trimap, isBeingRenderedElsewhere) ) {
+            bboxD.x1 = --bboxX.x2;
+        }
+        if ( !bboxD.isNull() ) {
+            ret.push_back(bboxD);
+        }
+
+        bboxX = minimalNonMarkedBbox<trimap>(bboxX, isBeingRenderedElsewhere);
+        if ( !bboxX.isNull() ) {
+            ret.push_back(bboxX);
+        }
+    }
+
+private:
+
+    /**
+     * @brief Returns true if the line has no pixel to render (0, or 2 without trimap). With trimap, the line is
+     * being rendered elsewhere if it contains a 2.
+     **/
+    bool isLineMarked(const RectI& line,
+                      bool trimap,
+                      bool* isBeingRenderedElsewhere) const
+    {
+        bool metUnavailablePixel = false;
+
+        for (int y = line.y1; y < line.y2; ++y) {
+            for (int x = line.x1; x < line.x2; ++x) {
+                const int state = getPixel(x, y);
+                if ( (state == 0) || ( (state == 2) && !trimap ) ) {
+                    return false;
+                }
+                metUnavailablePixel |= (state == 2);
+            }
+        }
+        if (metUnavailablePixel) {
+            *isBeingRenderedElsewhere = true;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Returns true if the line has nothing rendered (no 1, and no 2 with trimap). With trimap, the line is
+     * being rendered elsewhere if its first pixel that is not 0 is a 2.
+     **/
+    bool isLineNonMarked(const RectI& line,
+                         bool trimap,
+                         bool* isBeingRenderedElsewhere) const
+    {
+        for (int y = line.y1; y < line.y2; ++y) {
+            for (int x = line.x1; x < line.x2; ++x) {
+                const int state = getPixel(x, y);
+                if (state == 1) {
+                    return false;
+                } else if ( (state == 2) && trimap ) {
+                    *isBeingRenderedElsewhere = true;
+
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    RectI _bounds;
+    std::vector<char> _map;
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+static bool
+rectsEqual(const std::list<RectI>& a,
+           const std::list<RectI>& b)
+{
+    if ( a.size() != b.size() ) {
+        return false;
+    }
+    for (std::list<RectI>::const_iterator itA = a.begin(), itB = b.begin(); itA != a.end(); ++itA, ++itB) {
+        if ( !(*itA == *itB) ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Checks that the queries of bm on roi return what the per pixel implementation returns
+static void
+expectSameQueries(const Bitmap& bm,
+                  const ReferenceBitmap& reference,
+                  const RectI& roi)
+{
+    const RectI inside = roi.intersect( bm.getBounds() );
+
+    if ( !inside.isNull() ) {
+        EXPECT_TRUE( bm.minimalNonMarkedBbox(inside) == reference.minimalNonMarkedBbox<0>(inside, NULL) );
+
+        bool beingRenderedElsewhere = false;
+        bool referenceBeingRenderedElsewhere = false;
+        EXPECT_TRUE( bm.minimalNonMarkedBbox_trimap(inside, &beingRenderedElsewhere) ==
+                     reference.minimalNonMarkedBbox<1>(inside, &referenceBeingRenderedElsewhere) );
+        EXPECT_EQ(referenceBeingRenderedElsewhere, beingRenderedElsewhere);
+
+        EXPECT_EQ( reference.isNonMarked(inside), bm.isNonMarked(inside) );
+    }
+
+    std::list<RectI> rects, referenceRects;
+    bm.minimalNonMarkedRects(roi, rects);
+    reference.minimalNonMarkedRects<0>(roi, referenceRects, NULL);
+    EXPECT_TRUE( rectsEqual(referenceRects, rects) );
+
+    rects.clear();
+    referenceRects.clear();
+    bool beingRenderedElsewhere = false;
+    bool referenceBeingRenderedElsewhere = false;
+    bm.minimalNonMarkedRects_trimap(roi, rects, &beingRenderedElsewhere);
+    reference.minimalNonMarkedRects<1>(roi, referenceRects, &referenceBeingRenderedElsewhere);
+    EXPECT_TRUE( rectsEqual(referenceRects, rects) );
+    EXPECT_EQ(referenceBeingRenderedElsewhere, beingRenderedElsewhere);
+}
+
+static RectI
+makeRandomRect(const RectI& area,
+               int maxSize)
+{
+    // coverity[dont_call]
+    int x1 = area.x1 + rand() % area.width();
+    // coverity[dont_call]
+    int y1 = area.y1 + rand() % area.height();
+
+    // coverity[dont_call]
+    return RectI( x1, y1, x1 + 1 + rand() % maxSize, y1 + 1 + rand() % maxSize );
+}
+
+// The bitmap is stored by tiles: check that rectangles that do not fall on the tile grid are marked and
+// queried exactly as with the previous bitmap of one char per pixel
+TEST(BitmapTest,
+     TileEdges)
+{
+    RectI rod(-70, -10, 190, 150);
+    Bitmap bm(rod);
+    ReferenceBitmap reference(rod);
+
+    srand(2000);
+    for (int i = 0; i < 200; ++i) {
+        // small rectangles make mixed tiles, large ones make uniform tiles
+        RectI rect = makeRandomRect(rod, i % 2 ? 20 : 150);
+        // coverity[dont_call]
+        int state = rand() % 3;
+        if (state == 0) {
+            bm.clear(rect);
+        } else if (state == 1) {
+            bm.markForRendered(rect);
+        } else {
+            bm.markForRendering(rect);
+        }
+        reference.markFor(rect, (char)state);
+
+        for (int y = rod.y1; y < rod.y2; ++y) {
+            for (int x = rod.x1; x < rod.x2; ++x) {
+                ASSERT_EQ( reference.getPixel(x, y), bm.getPixel(x, y) );
+            }
+        }
+
+        expectSameQueries(bm, reference, rod);
+        for (int q = 0; q < 5; ++q) {
+            // regions of interest inside the bitmap and partially outside of it
+            expectSameQueries( bm, reference, makeRandomRect(RectI(rod.x1 - 20, rod.y1 - 20, rod.x2, rod.y2), 150) );
+        }
+    }
+} // TEST
+
+// Renders a few tiles of an 8K frame, as when the viewer renders a portion of the image
+static void
+markRandomTiles(Bitmap* bm,
+                ReferenceBitmap* reference)
+{
+    const RectI& rod = bm->getBounds();
+
+    srand(2000);
+    for (int i = 0; i < 40; ++i) {
+        // coverity[dont_call]
+        int x1 = rand() % (rod.width() - 256);
+        // coverity[dont_call]
+        int y1 = rand() % (rod.height() - 256);
+        bm->markForRendered( RectI(x1, y1, x1 + 256, y1 + 256) );
+        if (reference) {
+            reference->markFor(RectI(x1, y1, x1 + 256, y1 + 256), 1);
+        }
+    }
+}
+
+TEST(BitmapTest,
+     Memory)
+{
+    RectI rod(0, 0, 8192, 4320);
+    Bitmap bm(rod);
+    const std::size_t uniformSize = bm.getMemorySize();
+
+    // The tiles only store their state while they are uniform, including when rendered on the tile grid
+    EXPECT_EQ( bm.getTilesCount() * ( sizeof(unsigned char) + sizeof(std::vector<unsigned char>) ), uniformSize );
+    bm.markForRendered( RectI(NATRON_BITMAP_TILE_SIZE, 0, 10 * NATRON_BITMAP_TILE_SIZE, 3 * NATRON_BITMAP_TILE_SIZE) );
+    EXPECT_EQ( uniformSize, bm.getMemorySize() );
+
+    // A mixed tile stores 2 bits per pixel
+    bm.markForRendered( RectI(0, 0, 1, 1) );
+    EXPECT_EQ( uniformSize + NATRON_BITMAP_TILE_SIZE * NATRON_BITMAP_TILE_SIZE / 4, bm.getMemorySize() );
+    bm.clear( RectI(0, 0, 1, 1) );
+    EXPECT_EQ( uniformSize, bm.getMemorySize() );
+
+    bm.clear(rod);
+    ReferenceBitmap reference(rod);
+    markRandomTiles(&bm, &reference);
+    EXPECT_LT( bm.getMemorySize(), (std::size_t)rod.area() / 8 );
+    expectSameQueries(bm, reference, rod);
+} // TEST
+
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST(BitmapTest,
+     DISABLED_QueryBenchmark)
+{
+    RectI rod(0, 0, 8192, 4320);
+    Bitmap bm(rod);
+    ReferenceBitmap reference(rod);
+
+    markRandomTiles(&bm, &reference);
+    std::cout << "Bitmap memory: " << bm.getMemorySize() << " bytes (" << rod.area() << " bytes with one byte per pixel)" << std::endl;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < 20; ++i) {
+        std::list<RectI> nonRenderedRects;
+        bm.minimalNonMarkedRects(rod, nonRenderedRects);
+    }
+    double tiledMSecs = timer.nsecsElapsed() / 1e6;
+
+    timer.restart();
+    for (int i = 0; i < 20; ++i) {
+        std::list<RectI> nonRenderedRects;
+        reference.minimalNonMarkedRects<0>(rod, nonRenderedRects, NULL);
+    }
+    double referenceMSecs = timer.nsecsElapsed() / 1e6;
+    std::cout << "20 minimalNonMarkedRects queries on an 8K bitmap: " << tiledMSecs << " ms, " << referenceMSecs
+              << " ms with one byte per pixel" << std::endl;
+} // TEST
+
 TEST(ImageKeyTest, Equality) {
     srand(2000);
     // coverity[dont_call]
@@ -160,3 +565,585 @@ TEST(ImageKeyTest, Difference) {
     ASSERT_TRUE(keyHash1 != keyHash2);
 }
 
+// Touches one byte per page, like a render writing the buffer would
+static void
+touchPages(char* data,
+           std::size_t nBytes)
+{
+    for (std::size_t i = 0; i < nBytes; i += 4096) {
+        data[i] = (char)i;
+    }
+}
+
+// The buffers of a few frames of playback: a full and a half resolution image, as with the mipmap levels of
+// the viewer, and an 8-bit texture
+static const std::size_t playbackBufferSizes[] = {
+    (std::size_t)1920 * 1080 * 4 * sizeof(float), (std::size_t)960 * 540 * 4 * sizeof(float), (std::size_t)1920 * 1080 * 4
+};
+static const int nPlaybackBufferSizes = sizeof(playbackBufferSizes) / sizeof(playbackBufferSizes[0]);
+
+// Only the buffers of the first frame reach the system, the next frames reuse them from the pool and the free
+// blocks are given back to the system when trimmed.
+TEST(RamBufferPool, PlaybackAllocations)
+{
+    const int nFrames = 20;
+    RamBufferPool* pool = RamBufferPool::instance();
+    RamBufferPoolStats initial;
+
+    pool->getStats(&initial);
+    // Start from an empty pool that can hold the buffers of a frame
+    pool->setMaximumFreeBytes(0);
+    pool->setMaximumFreeBytes( (std::size_t)256 * 1024 * 1024 );
+    EXPECT_EQ( (std::size_t)0, pool->getFreeBytes() );
+
+    RamBufferPoolStats before;
+    pool->getStats(&before);
+    std::size_t frameBlockBytes = 0;
+    for (int i = 0; i < nPlaybackBufferSizes; ++i) {
+        frameBlockBytes += RamBufferPool::getBlockSize(playbackBufferSizes[i]);
+        EXPECT_GE( RamBufferPool::getBlockSize(playbackBufferSizes[i]), playbackBufferSizes[i] );
+    }
+    for (int f = 0; f < nFrames; ++f) {
+        RamBuffer<char> buffers[nPlaybackBufferSizes];
+        for (int i = 0; i < nPlaybackBufferSizes; ++i) {
+            buffers[i].resize(playbackBufferSizes[i]);
+            ASSERT_TRUE(buffers[i].getData() != 0);
+            touchPages(buffers[i].getData(), playbackBufferSizes[i]);
+        }
+        EXPECT_EQ( (std::size_t)0, pool->getFreeBytes() );
+    }
+    RamBufferPoolStats after;
+    pool->getStats(&after);
+
+    EXPECT_EQ( (U64)nFrames * nPlaybackBufferSizes, after.nAllocations - before.nAllocations );
+    EXPECT_EQ( (U64)nPlaybackBufferSizes, after.nSystemAllocations - before.nSystemAllocations );
+    EXPECT_EQ( (U64)(nFrames - 1) * nPlaybackBufferSizes, after.nPoolHits - before.nPoolHits );
+    EXPECT_EQ( before.nSystemFrees, after.nSystemFrees );
+    EXPECT_EQ( frameBlockBytes, pool->getFreeBytes() );
+
+    pool->trim(0);
+    pool->getStats(&after);
+    EXPECT_EQ( (std::size_t)0, after.freeBytes );
+    EXPECT_EQ( before.nSystemFrees + nPlaybackBufferSizes, after.nSystemFrees );
+
+    pool->setMaximumFreeBytes(initial.maximumFreeBytes);
+}
+
+// Compares the allocations of a few frames of playback with the system allocator and with the RamBufferPool.
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST(RamBufferPool, DISABLED_PlaybackAllocationsThroughput)
+{
+    const int nFrames = 100;
+    const std::size_t* sizes = playbackBufferSizes;
+    const int nSizes = nPlaybackBufferSizes;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int f = 0; f < nFrames; ++f) {
+        char* buffers[nPlaybackBufferSizes];
+        for (int i = 0; i < nSizes; ++i) {
+            buffers[i] = (char*)malloc(sizes[i]);
+            ASSERT_TRUE(buffers[i] != 0);
+            touchPages(buffers[i], sizes[i]);
+        }
+        for (int i = 0; i < nSizes; ++i) {
+            free(buffers[i]);
+        }
+    }
+    double systemSeconds = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+
+    RamBufferPoolStats before;
+    RamBufferPool::instance()->getStats(&before);
+    timer.restart();
+    for (int f = 0; f < nFrames; ++f) {
+        RamBuffer<char> buffers[nPlaybackBufferSizes];
+        for (int i = 0; i < nSizes; ++i) {
+            buffers[i].resize(sizes[i]);
+            touchPages(buffers[i].getData(), sizes[i]);
+        }
+    }
+    double poolSeconds = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+    RamBufferPoolStats after;
+    RamBufferPool::instance()->getStats(&after);
+    U64 nAllocations = after.nAllocations - before.nAllocations;
+
+    std::cout << "RamBufferPool: " << nFrames << " frames, " << nSizes << " buffers per frame" << std::endl;
+    std::cout << "  system allocator: " << systemSeconds * 1000. << " ms, "
+              << (nFrames * nSizes) / systemSeconds << " allocations/s" << std::endl;
+    std::cout << "  pool: " << poolSeconds * 1000. << " ms, " << nAllocations / poolSeconds << " allocations/s, "
+              << (after.nPoolHits - before.nPoolHits) << " pool hits, "
+              << (after.nSystemAllocations - before.nSystemAllocations) << " system allocations taking "
+              << (after.systemNSecs - before.systemNSecs) / 1e6 << " ms" << std::endl;
+}
+
+// The histogram of a channel computed pixel by pixel with pixelAt, as HistogramCPU used to
+static void
+computeReferenceHistogram(const ImagePtr& image,
+                          const RectI& bounds,
+                          DisplayChannelsEnum channel,
+                          int binsCount,
+                          double vmin,
+                          double vmax,
+                          std::vector<float>* histo)
+{
+    histo->assign(binsCount, 0.f);
+    double binSize = (vmax - vmin) / binsCount;
+    Image::ReadAccess acc = image->getReadRights();
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        for (int x = bounds.x1; x < bounds.x2; ++x) {
+            const float *pix = (const float*)acc.pixelAt(x, y);
+            float v;
+            if (channel == eDisplayChannelsY) {
+                v = 0.299 * pix[0] + 0.587 * pix[1] + 0.114 * pix[2];
+            } else {
+                v = pix[(int)channel - (int)eDisplayChannelsR];
+            }
+            if ( (vmin <= v) && (v < vmax) ) {
+                (*histo)[(int)( (v - vmin) / binSize )] += 1.f;
+            }
+        }
+    }
+}
+
+// The waveform of the luminance computed pixel by pixel, see ImageScopes::computeWaveform()
+static void
+computeReferenceWaveform(const ImagePtr& image,
+                         const RectI& bounds,
+                         int columnsCount,
+                         int binsCount,
+                         double vmin,
+                         double vmax,
+                         std::vector<float>* waveform)
+{
+    waveform->assign(columnsCount * binsCount, 0.f);
+    double binSize = (vmax - vmin) / binsCount;
+    Image::ReadAccess acc = image->getReadRights();
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        for (int x = bounds.x1; x < bounds.x2; ++x) {
+            const float *pix = (const float*)acc.pixelAt(x, y);
+            float v = 0.299 * pix[0] + 0.587 * pix[1] + 0.114 * pix[2];
+            if ( (vmin <= v) && (v < vmax) ) {
+                int column = (x - bounds.x1) * columnsCount / bounds.width();
+                (*waveform)[(int)( (v - vmin) / binSize ) * columnsCount + column] += 1.f;
+            }
+        }
+    }
+}
+
+// The vectorscope computed pixel by pixel, see ImageScopes::computeVectorscope()
+static void
+computeReferenceVectorscope(const ImagePtr& image,
+                            const RectI& bounds,
+                            int size,
+                            std::vector<float>* vectorscope)
+{
+    vectorscope->assign(size * size, 0.f);
+    Image::ReadAccess acc = image->getReadRights();
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        for (int x = bounds.x1; x < bounds.x2; ++x) {
+            const float *pix = (const float*)acc.pixelAt(x, y);
+            double cb = -0.168736 * pix[0] - 0.331264 * pix[1] + 0.5 * pix[2];
+            double cr = 0.5 * pix[0] - 0.418688 * pix[1] - 0.081312 * pix[2];
+            if ( (cb < -0.5) || (cb > 0.5) || (cr < -0.5) || (cr > 0.5) ) {
+                continue;
+            }
+            int u = std::min( size - 1, (int)( (cb + 0.5) * size ) );
+            int v = std::min( size - 1, (int)( (cr + 0.5) * size ) );
+            (*vectorscope)[v * size + u] += 1.f;
+        }
+    }
+}
+
+// Returns the sum of the differences between the bins of two scopes of the same size
+static double
+getScopesDifference(const std::vector<float>& a,
+                    const std::vector<float>& b)
+{
+    double diff = 0.;
+
+    for (std::size_t i = 0; i < a.size() && i < b.size(); ++i) {
+        diff += std::abs(a[i] - b[i]);
+    }
+
+    return diff;
+}
+
+// Fills an RGBA float image with random values, some of them slightly out of [0, 1[
+static ImagePtr
+makeScopesTestImage(const RectI& bounds)
+{
+    RectD rod(bounds.x1, bounds.y1, bounds.x2, bounds.y2);
+    ImagePtr image = std::make_shared<Image>(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., eImageBitDepthFloat,
+                                             eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+
+    srand(2000);
+    Image::WriteAccess acc = image->getWriteRights();
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        float* pix = (float*)acc.pixelAt(bounds.x1, y);
+        for (int i = 0; i < bounds.width() * 4; ++i) {
+            // coverity[dont_call]
+            pix[i] = -0.1f + 1.2f * (rand() / (float)RAND_MAX);
+        }
+    }
+
+    return image;
+}
+
+// The histograms computed by ImageScopes match the ones computed pixel by pixel, for each channel mode of the viewer
+// histogram, over a part of an image whose origin is not 0
+TEST(ImageScopes, Histograms)
+{
+    const int binsCount = 100;
+    const double vmin = 0.;
+    const double vmax = 1.;
+    const DisplayChannelsEnum channels[] = {
+        eDisplayChannelsR, eDisplayChannelsG, eDisplayChannelsB, eDisplayChannelsA, eDisplayChannelsY
+    };
+    const int nChannels = sizeof(channels) / sizeof(channels[0]);
+    ImagePtr image = makeScopesTestImage( RectI(-37, 11, 300, 228) );
+    const RectI rect(-20, 20, 251, 201);
+
+    std::vector<std::vector<float> > singleHistograms;
+    for (int c = 0; c < nChannels; ++c) {
+        std::vector<float> reference;
+        computeReferenceHistogram(image, rect, channels[c], binsCount, vmin, vmax, &reference);
+        std::vector<std::vector<float> > histograms;
+        ImageScopes::computeHistograms(image, rect, std::vector<DisplayChannelsEnum>(1, channels[c]), binsCount, vmin, vmax, &histograms);
+        ASSERT_EQ( (std::size_t)1, histograms.size() );
+        ASSERT_EQ( (std::size_t)binsCount, histograms[0].size() );
+
+        // the bins are computed in float, so pixels right on the edge of a bin may be counted in the next one
+        double referenceTotal = 0., total = 0., nMoved = 0.;
+        for (int i = 0; i < binsCount; ++i) {
+            referenceTotal += reference[i];
+            total += histograms[0][i];
+            nMoved += std::abs(histograms[0][i] - reference[i]);
+        }
+        EXPECT_NEAR( referenceTotal, total, rect.area() * 1e-4 );
+        EXPECT_LE( nMoved, rect.area() * 1e-4 );
+        singleHistograms.push_back(histograms[0]);
+    }
+
+    // RGB mode: the 3 histograms in a single pass are the ones of each channel
+    std::vector<DisplayChannelsEnum> rgb(channels, channels + 3);
+    std::vector<std::vector<float> > histograms;
+    ImageScopes::computeHistograms(image, rect, rgb, binsCount, vmin, vmax, &histograms);
+    ASSERT_EQ( (std::size_t)3, histograms.size() );
+    for (int c = 0; c < 3; ++c) {
+        EXPECT_TRUE(histograms[c] == singleHistograms[c]);
+    }
+
+    // The waveform and the vectorscope match the ones computed pixel by pixel, up to the pixels on the edge of a bin
+    std::vector<float> waveform, referenceWaveform;
+    ImageScopes::computeWaveform(image, rect, eDisplayChannelsY, 64, 32, -1., 2., &waveform);
+    computeReferenceWaveform(image, rect, 64, 32, -1., 2., &referenceWaveform);
+    ASSERT_EQ( (std::size_t)64 * 32, waveform.size() );
+    // Every luminance is in range: each column counts all the pixels of its image columns
+    double waveformTotal = 0.;
+    for (int column = 0; column < 64; ++column) {
+        double total = 0., referenceTotal = 0.;
+        for (int bin = 0; bin < 32; ++bin) {
+            total += waveform[bin * 64 + column];
+            referenceTotal += referenceWaveform[bin * 64 + column];
+        }
+        EXPECT_EQ(referenceTotal, total) << "column " << column;
+        waveformTotal += total;
+    }
+    EXPECT_EQ( (double)rect.area(), waveformTotal );
+    EXPECT_LE( getScopesDifference(waveform, referenceWaveform), rect.area() * 1e-4 );
+
+    std::vector<float> vectorscope, referenceVectorscope;
+    ImageScopes::computeVectorscope(image, rect, 64, &vectorscope);
+    computeReferenceVectorscope(image, rect, 64, &referenceVectorscope);
+    ASSERT_EQ( (std::size_t)64 * 64, vectorscope.size() );
+    EXPECT_LE( getScopesDifference(vectorscope, referenceVectorscope), rect.area() * 1e-4 );
+}
+
+// Computes the histograms of 4K and 8K RGBA float images with ImageScopes and pixel by pixel,
+// for each channel mode of the viewer histogram.
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST(ImageScopes, DISABLED_HistogramBenchmark)
+{
+    const int binsCount = 1280; // the histogram widget uses 5 times its width
+    const double vmin = 0.;
+    const double vmax = 1.;
+    const RectI formats[] = {
+        RectI(0, 0, 3840, 2160), RectI(0, 0, 7680, 4320)
+    };
+    const DisplayChannelsEnum channels[] = {
+        eDisplayChannelsR, eDisplayChannelsG, eDisplayChannelsB, eDisplayChannelsA, eDisplayChannelsY
+    };
+    const int nChannels = sizeof(channels) / sizeof(channels[0]);
+
+    for (int f = 0; f < 2; ++f) {
+        const RectI& bounds = formats[f];
+        ImagePtr image = makeScopesTestImage(bounds);
+
+        std::cout << "ImageScopes: " << bounds.width() << "x" << bounds.height() << " RGBA float image, " << binsCount << " bins" << std::endl;
+        QElapsedTimer timer;
+        double referenceRGBSeconds = 0.;
+        for (int c = 0; c < nChannels; ++c) {
+            std::vector<float> reference;
+            timer.start();
+            computeReferenceHistogram(image, bounds, channels[c], binsCount, vmin, vmax, &reference);
+            double referenceSeconds = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+            if (c < 3) {
+                referenceRGBSeconds += referenceSeconds;
+            }
+
+            std::vector<std::vector<float> > histograms;
+            timer.restart();
+            ImageScopes::computeHistograms(image, bounds, std::vector<DisplayChannelsEnum>(1, channels[c]), binsCount, vmin, vmax, &histograms);
+            double scopesSeconds = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+
+            // the bins are computed in float, so pixels right on the edge of a bin may be counted in the next one
+            ASSERT_EQ( (std::size_t)binsCount, histograms[0].size() );
+            double nMoved = 0.;
+            for (int i = 0; i < binsCount; ++i) {
+                nMoved += std::abs(histograms[0][i] - reference[i]);
+            }
+            EXPECT_LE( nMoved, bounds.area() * 1e-4 );
+
+            std::cout << "  channel " << (int)channels[c] << ": pixelAt " << referenceSeconds * 1000. << " ms, ImageScopes "
+                      << scopesSeconds * 1000. << " ms (x" << referenceSeconds / scopesSeconds << ")" << std::endl;
+        }
+
+        // RGB mode: the 3 histograms in a single pass
+        std::vector<DisplayChannelsEnum> rgb(channels, channels + 3);
+        std::vector<std::vector<float> > histograms;
+        timer.restart();
+        ImageScopes::computeHistograms(image, bounds, rgb, binsCount, vmin, vmax, &histograms);
+        double scopesRGBSeconds = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+        ASSERT_EQ( (std::size_t)3, histograms.size() );
+        std::cout << "  RGB: pixelAt " << referenceRGBSeconds * 1000. << " ms, ImageScopes "
+                  << scopesRGBSeconds * 1000. << " ms (x" << referenceRGBSeconds / scopesRGBSeconds << ")" << std::endl;
+
+        // the waveform and vectorscope count every pixel in range exactly once
+        std::vector<float> waveform;
+        timer.restart();
+        ImageScopes::computeWaveform(image, bounds, eDisplayChannelsY, 512, 256, -1., 2., &waveform);
+        double waveformSeconds = timer.nsecsElapsed() / 1e9;
+        double total = 0.;
+        for (std::size_t i = 0; i < waveform.size(); ++i) {
+            total += waveform[i];
+        }
+        EXPECT_EQ( (double)bounds.area(), total );
+
+        std::vector<float> vectorscope;
+        timer.restart();
+        ImageScopes::computeVectorscope(image, bounds, 256, &vectorscope);
+        double vectorscopeSeconds = timer.nsecsElapsed() / 1e9;
+        EXPECT_EQ( (std::size_t)256 * 256, vectorscope.size() );
+        std::cout << "  waveform: " << waveformSeconds * 1000. << " ms, vectorscope: " << vectorscopeSeconds * 1000. << " ms" << std::endl;
+    }
+} // TEST
+
+TEST(Half, RoundTrip)
+{
+    // every half that is not a NaN converts to a float and back to itself
+    for (U32 bits = 0; bits < 0x10000; ++bits) {
+        float f = Half::bitsToFloat( (U16)bits );
+        if (f != f) {
+            continue;
+        }
+        ASSERT_EQ( bits, (U32)Half::floatToBits(f) );
+    }
+
+    // floats in the half normal range are rounded to 11 significant bits, larger values overflow to infinity
+    EXPECT_EQ( 65504.f, (float)Half(65504.f) );
+    EXPECT_TRUE( std::isinf( (float)Half(65536.f) ) );
+    EXPECT_EQ( 0.5f, (float)Half(0.5f) );
+
+    // the row conversions give the same result with the F16C instructions and the scalar code
+    const int n = 100003; // not a multiple of the vector size
+    std::vector<float> values(n);
+    srand(2023);
+    for (int i = 0; i < n; ++i) {
+        // coverity[dont_call]
+        values[i] = ( (rand() / (float)RAND_MAX) - 0.2f ) * std::pow( 2.f, (float)(rand() % 40 - 24) );
+    }
+    std::vector<Half> scalarHalfs(n), simdHalfs(n);
+    std::vector<float> scalarFloats(n), simdFloats(n);
+    Color::SIMDLevelEnum level = Color::getSIMDLevel();
+    Color::setSIMDLevel(Color::eSIMDLevelScalar);
+    floatToHalfRow(&values[0], &scalarHalfs[0], n);
+    halfToFloatRow(&scalarHalfs[0], &scalarFloats[0], n);
+    Color::setSIMDLevel(level);
+    floatToHalfRow(&values[0], &simdHalfs[0], n);
+    halfToFloatRow(&simdHalfs[0], &simdFloats[0], n);
+    for (int i = 0; i < n; ++i) {
+        ASSERT_EQ( scalarHalfs[i].bits(), simdHalfs[i].bits() );
+        ASSERT_EQ( scalarFloats[i], simdFloats[i] );
+        if (std::abs(values[i]) >= 6.1035e-05f) { // smallest normal half
+            EXPECT_LE( std::abs(scalarFloats[i] - values[i]), std::abs(values[i]) * (1.f / 2048) );
+        } else {
+            EXPECT_LE( std::abs(scalarFloats[i] - values[i]), std::ldexp(1.f, -25) ); // half of the smallest subnormal half
+        }
+    }
+}
+
+static ImagePtr
+makeRGBAImage(const RectI& bounds,
+              ImageBitDepthEnum depth)
+{
+    const RectD rod(bounds.x1, bounds.y1, bounds.x2, bounds.y2);
+
+    return std::make_shared<Image>(ImagePlaneDesc::getRGBAComponents(), rod, bounds, 0, 1., depth,
+                                   eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+}
+
+// Fills a float image with HDR values in [-0.5, 8[
+static void
+fillHDRImage(const ImagePtr& image,
+             int seed)
+{
+    const RectI bounds = image->getBounds();
+
+    srand(seed);
+    Image::WriteAccess acc = image->getWriteRights();
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        float* pix = (float*)acc.pixelAt(bounds.x1, y);
+        for (int i = 0; i < bounds.width() * 4; ++i) {
+            // coverity[dont_call]
+            pix[i] = -0.5f + 8.5f * (rand() / (float)RAND_MAX);
+        }
+    }
+}
+
+// Checks that dst is src rounded to half
+static void
+expectHalfPrecision(const ImagePtr& src,
+                    const ImagePtr& dst)
+{
+    const RectI bounds = src->getBounds();
+    Image::ReadAccess srcAcc = src->getReadRights();
+    Image::ReadAccess dstAcc = dst->getReadRights();
+
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        const float* srcPix = (const float*)srcAcc.pixelAt(bounds.x1, y);
+        const float* dstPix = (const float*)dstAcc.pixelAt(bounds.x1, y);
+        for (int i = 0; i < bounds.width() * 4; ++i) {
+            ASSERT_LE( std::abs(dstPix[i] - srcPix[i]), std::max( std::abs(srcPix[i]) * (1.f / 2048), std::ldexp(1.f, -25) ) );
+        }
+    }
+}
+
+// Converts a RGBA float image to half and back, as when it is written to and read from the node cache
+TEST(Half, ImageCacheConversion)
+{
+    const RectI bounds(0, 0, 1001, 563); // rows that are not a multiple of the vector size
+    ImagePtr floatImage = makeRGBAImage(bounds, eImageBitDepthFloat);
+    ImagePtr halfImage = makeRGBAImage(bounds, eImageBitDepthHalf);
+    ImagePtr floatCopy = makeRGBAImage(bounds, eImageBitDepthFloat);
+    fillHDRImage(floatImage, 2024);
+
+    // the cached half image takes half the memory of the float one
+    EXPECT_EQ( floatImage->dataSize(), 2 * halfImage->dataSize() );
+
+    floatImage->convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, halfImage.get() );
+    {
+        Image::ReadAccess srcAcc = floatImage->getReadRights();
+        Image::ReadAccess halfAcc = halfImage->getReadRights();
+        for (int y = bounds.y1; y < bounds.y2; ++y) {
+            const float* src = (const float*)srcAcc.pixelAt(bounds.x1, y);
+            const Half* half = (const Half*)halfAcc.pixelAt(bounds.x1, y);
+            for (int i = 0; i < bounds.width() * 4; ++i) {
+                ASSERT_EQ( Half::floatToBits(src[i]), half[i].bits() );
+            }
+        }
+    }
+
+    halfImage->convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, floatCopy.get() );
+    expectHalfPrecision(floatImage, floatCopy);
+}
+
+// Checks that each pixel of the half image is the pixel of the float image rounded to half
+static void
+expectRoundedToHalf(const ImagePtr& floatImage,
+                    const ImagePtr& halfImage)
+{
+    const RectI bounds = floatImage->getBounds();
+    ASSERT_TRUE( bounds == halfImage->getBounds() );
+    Image::ReadAccess floatAcc = floatImage->getReadRights();
+    Image::ReadAccess halfAcc = halfImage->getReadRights();
+
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        const float* floatPix = (const float*)floatAcc.pixelAt(bounds.x1, y);
+        const Half* halfPix = (const Half*)halfAcc.pixelAt(bounds.x1, y);
+        for (int i = 0; i < bounds.width() * 4; ++i) {
+            ASSERT_EQ( Half::floatToBits(floatPix[i]), halfPix[i].bits() ) << "x " << bounds.x1 + i / 4 << " y " << y;
+        }
+    }
+}
+
+// The kernels instantiated for half compute in float and round their result: on an image whose values are
+// representable in half, they give the result of the float kernels rounded to half.
+TEST(Half, ImageKernelsMatchFloat)
+{
+    const RectI bounds(0, 0, 1001, 563); // odd, so that the last mipmap row and column only have one source pixel
+    const RectD rod(bounds.x1, bounds.y1, bounds.x2, bounds.y2);
+    ImagePtr source = makeRGBAImage(bounds, eImageBitDepthFloat);
+    ImagePtr halfImage = makeRGBAImage(bounds, eImageBitDepthHalf);
+    ImagePtr floatImage = makeRGBAImage(bounds, eImageBitDepthFloat);
+    fillHDRImage(source, 2025);
+    source->convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, halfImage.get() );
+    halfImage->convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, floatImage.get() );
+
+    const RectI fillRect(100, 50, 400, 300);
+    halfImage->fill(fillRect, 0.3f, 1.7f, -0.2f, 0.6f);
+    floatImage->fill(fillRect, 0.3f, 1.7f, -0.2f, 0.6f);
+    expectRoundedToHalf(floatImage, halfImage);
+
+    const RectI premultRect(200, 100, 701, 400);
+    halfImage->premultImage(premultRect);
+    floatImage->premultImage(premultRect);
+    expectRoundedToHalf(floatImage, halfImage);
+
+    ImagePtr halfCopy = makeRGBAImage(bounds, eImageBitDepthHalf);
+    halfCopy->pasteFrom(*halfImage, bounds, false);
+    expectRoundedToHalf(floatImage, halfCopy);
+
+    const RectI mipmapBounds = bounds.downscalePowerOfTwoSmallestEnclosing(1);
+    ImagePtr halfMipmap = std::make_shared<Image>(ImagePlaneDesc::getRGBAComponents(), rod, mipmapBounds, 1, 1., eImageBitDepthHalf,
+                                                  eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    ImagePtr floatMipmap = std::make_shared<Image>(ImagePlaneDesc::getRGBAComponents(), rod, mipmapBounds, 1, 1., eImageBitDepthFloat,
+                                                   eImagePremultiplicationPremultiplied, eImageFieldingOrderNone);
+    halfImage->downscaleMipmap(rod, bounds, 0, 1, false, halfMipmap.get() );
+    floatImage->downscaleMipmap(rod, bounds, 0, 1, false, floatMipmap.get() );
+    expectRoundedToHalf(floatMipmap, halfMipmap);
+}
+
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+// Compares the conversion time of a 4K RGBA float image to half and back with a float to float copy.
+TEST(Half, DISABLED_ImageCacheBenchmark)
+{
+    const RectI bounds(0, 0, 3840, 2160);
+    ImagePtr floatImage = makeRGBAImage(bounds, eImageBitDepthFloat);
+    ImagePtr halfImage = makeRGBAImage(bounds, eImageBitDepthHalf);
+    ImagePtr floatCopy = makeRGBAImage(bounds, eImageBitDepthFloat);
+    fillHDRImage(floatImage, 2024);
+
+    QElapsedTimer timer;
+    timer.start();
+    floatCopy->pasteFrom(*floatImage, bounds, false);
+    double copySeconds = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+
+    timer.restart();
+    floatImage->convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, halfImage.get() );
+    double toHalfSeconds = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+
+    timer.restart();
+    halfImage->convertToFormat(bounds, eViewerColorSpaceLinear, eViewerColorSpaceLinear, -1, false, false, floatCopy.get() );
+    double toFloatSeconds = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+
+    expectHalfPrecision(floatImage, floatCopy);
+
+    double mb = 1024. * 1024.;
+    double floatMB = floatImage->dataSize() / mb;
+    double halfMB = halfImage->dataSize() / mb;
+    std::cout << "Half: " << bounds.width() << "x" << bounds.height() << " RGBA image, float " << floatMB << " MiB, half "
+              << halfMB << " MiB" << std::endl;
+    std::cout << "  float copy: " << copySeconds * 1000. << " ms (" << floatMB / copySeconds << " MiB/s)" << std::endl;
+    std::cout << "  float to half: " << toHalfSeconds * 1000. << " ms (" << floatMB / toHalfSeconds << " MiB/s of float)" << std::endl;
+    std::cout << "  half to float: " << toFloatSeconds * 1000. << " ms (" << floatMB / toFloatSeconds << " MiB/s of float)" << std::endl;
+}
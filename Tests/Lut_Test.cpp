@@ -25,9 +25,16 @@
 
 #include "Global/Macros.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <iostream>
+#include <vector>
 #include <gtest/gtest.h>
+
+#include <QtCore/QElapsedTimer>
+
 #include "Engine/Lut.h"
+#include "Engine/RectI.h"
 
 NATRON_NAMESPACE_USING
 using namespace NATRON_NAMESPACE::Color;
@@ -52,3 +59,143 @@ TEST(Lut, IntConversions) {
         EXPECT_EQ( i, uint8xxToChar( charToUint8xx(i) ) );
     }
 }
+
+// Reference conversion of toUint8xxRow(), written with the per-value functions
+static unsigned short
+referenceUint8xx(const Lut* lut,
+                 const float* pixel,
+                 const int offsets[3],
+                 int c,
+                 int alphaOffset,
+                 bool applyGainOffset,
+                 double gain,
+                 double offset)
+{
+    float v = pixel[offsets[c]] * ( (alphaOffset >= 0) ? pixel[alphaOffset] : 1.f );
+    if (applyGainOffset) {
+        v = (float)(v * gain + offset);
+    }
+
+    return lut ? lut->toColorSpaceUint8xxFromLinearFloatFast(v) : charToUint8xx( (unsigned char)floatToInt<256>(v) );
+}
+
+static void
+fillRandomPixels(std::vector<float>& pixels)
+{
+    for (std::size_t i = 0; i < pixels.size(); ++i) {
+        int r = std::rand() % 16;
+        if (r == 0) {
+            pixels[i] = -(std::rand() % 1000) / 100.f;
+        } else if (r == 1) {
+            pixels[i] = 2.f + (std::rand() % 1000) / 10.f;
+        } else {
+            pixels[i] = (std::rand() % 100001) / 100000.f;
+        }
+    }
+}
+
+TEST(Lut, RowConversionMatchesScalar) {
+    const Lut* srgb = LutManager::sRGBLut();
+    srgb->validate();
+    const int W = 1031; // not a multiple of the vector sizes
+    std::vector<float> pixels(W * 4);
+    std::vector<unsigned short> buffer(W * 3);
+    unsigned short* rows[3] = { &buffer[0], &buffer[W], &buffer[2 * W] };
+
+    std::srand(1);
+    for (int level = eSIMDLevelScalar; level <= eSIMDLevelAVX2; ++level) {
+        setSIMDLevel( (SIMDLevelEnum)level );
+        for (int iteration = 0; iteration < 64; ++iteration) {
+            fillRandomPixels(pixels);
+            const Lut* lut = (iteration % 2) ? srgb : 0;
+            const int offsets[3] = { std::rand() % 4, std::rand() % 4, std::rand() % 4 };
+            const int alphaOffset = (iteration % 4 < 2) ? 3 : -1;
+            const bool applyGainOffset = iteration % 3 == 0;
+            const double gain = 1.7, offset = -0.15;
+            toUint8xxRow(lut, &pixels[0], W, 4, offsets, alphaOffset, applyGainOffset, gain, offset, rows);
+            for (int x = 0; x < W; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    ASSERT_EQ( referenceUint8xx(lut, &pixels[x * 4], offsets, c, alphaOffset, applyGainOffset, gain, offset), rows[c][x] );
+                }
+            }
+        }
+    }
+    setSIMDLevel(eSIMDLevelAVX2);
+}
+
+// Every instruction set must give the same result as the scalar code, including the error diffusion of to_byte_packed.
+TEST(Lut, PackedConversionsMatchScalar) {
+    const Lut* srgb = LutManager::sRGBLut();
+    const RectI bounds(0, 0, 517, 33);
+    std::vector<float> pixels(bounds.area() * 4);
+    std::vector<unsigned char> bytes(bounds.area() * 4);
+
+    std::srand(2);
+    fillRandomPixels(pixels);
+    for (std::size_t i = 0; i < bytes.size(); ++i) {
+        bytes[i] = (unsigned char)(std::rand() % 256);
+    }
+
+    const PixelPackingEnum packings[2] = { ePixelPackingRGBA, ePixelPackingBGRA };
+    for (int premult = 0; premult < 2; ++premult) {
+        for (int p = 0; p < 2; ++p) {
+            std::vector<unsigned char> refBytes( bytes.size() ), simdBytes( bytes.size() );
+            std::vector<float> refFloats( pixels.size() ), simdFloats( pixels.size() );
+
+            setSIMDLevel(eSIMDLevelScalar);
+            std::srand(3); // to_byte_packed uses rand() to pick the start of the error diffusion
+            srgb->to_byte_packed(&refBytes[0], &pixels[0], bounds, bounds, bounds, ePixelPackingRGBA, packings[p], true, premult);
+            srgb->from_byte_packed(&refFloats[0], &bytes[0], bounds, bounds, bounds, packings[p], packings[p], false, premult);
+
+            for (int level = eSIMDLevelSSE41; level <= eSIMDLevelAVX2; ++level) {
+                setSIMDLevel( (SIMDLevelEnum)level );
+                std::srand(3);
+                srgb->to_byte_packed(&simdBytes[0], &pixels[0], bounds, bounds, bounds, ePixelPackingRGBA, packings[p], true, premult);
+                srgb->from_byte_packed(&simdFloats[0], &bytes[0], bounds, bounds, bounds, packings[p], packings[p], false, premult);
+
+                EXPECT_TRUE(refBytes == simdBytes) << "level " << level << " premult " << premult << " packing " << p;
+                EXPECT_TRUE(refFloats == simdFloats) << "level " << level << " premult " << premult << " packing " << p;
+            }
+        }
+    }
+
+    // Contiguous planar rows, with and without alpha
+    const int W = bounds.area();
+    std::vector<float> refPlanar(W), simdPlanar(W);
+    for (int useAlpha = 0; useAlpha < 2; ++useAlpha) {
+        const unsigned char* alpha = useAlpha ? &bytes[W] : NULL;
+        setSIMDLevel(eSIMDLevelScalar);
+        srgb->from_byte_planar(&refPlanar[0], &bytes[0], W, alpha);
+        for (int level = eSIMDLevelSSE41; level <= eSIMDLevelAVX2; ++level) {
+            setSIMDLevel( (SIMDLevelEnum)level );
+            srgb->from_byte_planar(&simdPlanar[0], &bytes[0], W, alpha);
+            EXPECT_TRUE(refPlanar == simdPlanar) << "level " << level << " alpha " << useAlpha;
+        }
+    }
+    setSIMDLevel(eSIMDLevelAVX2);
+}
+
+// Benchmark, see the "benchmarks" target in CMakeLists.txt. The results are checked by PackedConversionsMatchScalar.
+// Reports the throughput of the float to 8-bit conversion of a 4K RGBA image for each instruction set.
+TEST(Lut, DISABLED_ToBytePackedThroughput) {
+    const Lut* srgb = LutManager::sRGBLut();
+    const RectI bounds(0, 0, 3840, 2160);
+    std::vector<float> pixels(bounds.area() * 4);
+    std::vector<unsigned char> bytes(bounds.area() * 4);
+    const char* levelNames[3] = { "scalar", "SSE4.1", "AVX2" };
+
+    std::srand(4);
+    fillRandomPixels(pixels);
+    srgb->validate();
+    setSIMDLevel(eSIMDLevelAVX2);
+    const int maxLevel = getSIMDLevel();
+    for (int level = eSIMDLevelScalar; level <= maxLevel; ++level) {
+        setSIMDLevel( (SIMDLevelEnum)level );
+        QElapsedTimer timer;
+        timer.start();
+        srgb->to_byte_packed(&bytes[0], &pixels[0], bounds, bounds, bounds, ePixelPackingRGBA, ePixelPackingBGRA, true, true);
+        double seconds = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+        std::cout << "Lut::to_byte_packed (" << levelNames[level] << "): " << bounds.area() / seconds / 1e6 << " Mpixels/s" << std::endl;
+    }
+    setSIMDLevel(eSIMDLevelAVX2);
+}
@@ -0,0 +1,149 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+
+#include "Global/Macros.h"
+
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "Engine/ProcessHandler.h"
+
+NATRON_NAMESPACE_USING
+
+// Hands out all the chunks of the range and checks that they cover each frame of the range exactly once, in order,
+// with chunk sizes that never increase
+static void
+checkChunksCoverRange(int firstFrame,
+                      int lastFrame,
+                      int frameStep,
+                      int nWorkers)
+{
+    SCOPED_TRACE( testing::Message() << "range " << firstFrame << "-" << lastFrame << " step " << frameStep << ", " << nWorkers << " workers" );
+    RenderFrameChunks chunks(firstFrame, lastFrame, frameStep, nWorkers);
+
+    std::vector<int> expectedFrames;
+    for (int frame = firstFrame; frame <= lastFrame; frame += frameStep) {
+        expectedFrames.push_back(frame);
+    }
+    EXPECT_EQ( (int)expectedFrames.size(), chunks.getFramesCount() );
+
+    std::vector<int> frames;
+    int previousChunkSize = chunks.getFramesCount();
+    RenderFrameChunks::FrameChunk chunk;
+    while ( chunks.getNextChunk(&chunk) ) {
+        ASSERT_GE(chunk.nFrames, 1);
+        EXPECT_LE(chunk.nFrames, previousChunkSize);
+        EXPECT_EQ(0, chunk.nRetries);
+        EXPECT_EQ( chunk.lastFrame, chunk.firstFrame + (chunk.nFrames - 1) * frameStep );
+        for (int frame = chunk.firstFrame; frame <= chunk.lastFrame; frame += frameStep) {
+            frames.push_back(frame);
+        }
+        previousChunkSize = chunk.nFrames;
+        ASSERT_LE( frames.size(), expectedFrames.size() );
+    }
+    EXPECT_TRUE(frames == expectedFrames);
+    EXPECT_FALSE( chunks.hasRemainingFrames() );
+    EXPECT_FALSE( chunks.getNextChunk(&chunk) );
+}
+
+TEST(RenderFrameChunks,
+     ChunkBoundaries)
+{
+    checkChunksCoverRange(1, 100, 1, 2);
+    checkChunksCoverRange(1, 100, 1, 7);
+    checkChunksCoverRange(-10, 10, 1, 3);
+    // The last frame is not on the step
+    checkChunksCoverRange(1, 11, 3, 2);
+    checkChunksCoverRange(0, 999, 7, 4);
+    // More workers than frames
+    checkChunksCoverRange(1, 3, 1, 8);
+    checkChunksCoverRange(5, 5, 1, 4);
+
+    // Guided scheduling: the remaining frames divided by twice the number of workers
+    RenderFrameChunks chunks(1, 100, 1, 2);
+    RenderFrameChunks::FrameChunk chunk;
+    ASSERT_TRUE( chunks.getNextChunk(&chunk) );
+    EXPECT_EQ(1, chunk.firstFrame);
+    EXPECT_EQ(25, chunk.lastFrame);
+    ASSERT_TRUE( chunks.getNextChunk(&chunk) );
+    EXPECT_EQ(26, chunk.firstFrame);
+    EXPECT_EQ(43, chunk.lastFrame);
+
+    // Empty ranges and invalid parameters
+    RenderFrameChunks emptyRange(10, 1, 1, 2);
+    EXPECT_EQ( 0, emptyRange.getFramesCount() );
+    EXPECT_FALSE( emptyRange.hasRemainingFrames() );
+    EXPECT_FALSE( emptyRange.getNextChunk(&chunk) );
+    RenderFrameChunks noStep(1, 4, 0, 0);
+    EXPECT_EQ( 4, noStep.getFramesCount() );
+    ASSERT_TRUE( noStep.getNextChunk(&chunk) );
+    EXPECT_EQ(1, chunk.firstFrame);
+    EXPECT_EQ(2, chunk.lastFrame);
+}
+
+TEST(RenderFrameChunks,
+     RetryFailedChunk)
+{
+    RenderFrameChunks chunks(1, 40, 2, 2);
+    RenderFrameChunks::FrameChunk first, second, chunk;
+
+    ASSERT_TRUE( chunks.getNextChunk(&first) );
+    ASSERT_TRUE( chunks.getNextChunk(&second) );
+
+    // The chunk of a crashed worker is handed out again before the frames which were never handed out
+    ASSERT_TRUE( chunks.retryChunk(first) );
+    EXPECT_EQ( 1, chunks.getRetriedChunksCount() );
+    ASSERT_TRUE( chunks.getNextChunk(&chunk) );
+    EXPECT_EQ(first.firstFrame, chunk.firstFrame);
+    EXPECT_EQ(first.lastFrame, chunk.lastFrame);
+    EXPECT_EQ(first.nFrames, chunk.nFrames);
+    EXPECT_EQ(1, chunk.nRetries);
+    ASSERT_TRUE( chunks.getNextChunk(&chunk) );
+    EXPECT_EQ(second.lastFrame + 2, chunk.firstFrame);
+
+    // A chunk is retried at most NATRON_RENDER_WORKER_MAX_RETRIES times
+    chunk = second;
+    for (int i = 0; i < NATRON_RENDER_WORKER_MAX_RETRIES; ++i) {
+        ASSERT_TRUE( chunks.retryChunk(chunk) );
+        ASSERT_TRUE( chunks.getNextChunk(&chunk) );
+        EXPECT_EQ(second.firstFrame, chunk.firstFrame);
+        EXPECT_EQ(i + 1, chunk.nRetries);
+    }
+    EXPECT_FALSE( chunks.retryChunk(chunk) );
+    EXPECT_EQ( 1 + NATRON_RENDER_WORKER_MAX_RETRIES, chunks.getRetriedChunksCount() );
+
+    // A retried chunk keeps the render going after all the other frames were handed out
+    while ( chunks.getNextChunk(&chunk) ) {
+    }
+    EXPECT_FALSE( chunks.hasRemainingFrames() );
+    ASSERT_TRUE( chunks.retryChunk(first) );
+    EXPECT_TRUE( chunks.hasRemainingFrames() );
+
+    // Aborting the render drops the chunks to retry
+    chunks.clearRetriedChunks();
+    EXPECT_FALSE( chunks.hasRemainingFrames() );
+    EXPECT_FALSE( chunks.getNextChunk(&chunk) );
+}
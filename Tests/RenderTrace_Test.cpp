@@ -0,0 +1,192 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+
+#include "Engine/RenderTrace.h"
+
+NATRON_NAMESPACE_USING
+
+static int
+countOccurrences(const std::string& str,
+                 const std::string& pattern)
+{
+    int count = 0;
+
+    for (std::size_t pos = str.find(pattern); pos != std::string::npos; pos = str.find(pattern, pos + pattern.size())) {
+        ++count;
+    }
+
+    return count;
+}
+
+static std::string
+writeTrace()
+{
+    std::string filePath = QDir::tempPath().toStdString() + "/RenderTrace_Test.json";
+    std::string error;
+
+    EXPECT_TRUE( RenderTrace::writeChromeTrace(filePath, &error) ) << error;
+    std::ifstream ifile( filePath.c_str() );
+    std::string trace( (std::istreambuf_iterator<char>(ifile)), std::istreambuf_iterator<char>() );
+    QFile::remove( QString::fromUtf8( filePath.c_str() ) );
+
+    return trace;
+}
+
+TEST(RenderTrace, DisabledSpansAreNotRecorded)
+{
+    RenderTrace::setEnabled(false);
+    RenderTrace::clear();
+
+    for (int i = 0; i < 1000; ++i) {
+        RenderTraceSpan span("disabled", "test");
+    }
+
+    EXPECT_EQ( 0, countOccurrences(writeTrace(), "\"disabled\"") );
+}
+
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+TEST(RenderTrace, DISABLED_DisabledSpanCost)
+{
+    RenderTrace::setEnabled(false);
+
+    const int nSpans = 10000000;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < nSpans; ++i) {
+        RenderTraceSpan span("disabled", "test");
+    }
+    std::cout << "Disabled span: " << timer.nsecsElapsed() / (double)nSpans << " ns" << std::endl;
+}
+
+TEST(RenderTrace, SpansOfEachThreadAreExported)
+{
+    RenderTrace::clear();
+    RenderTrace::setEnabled(true);
+
+    const int nThreads = 4;
+    const int nSpansPerThread = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; ++t) {
+        threads.push_back( std::thread([] {
+            for (int i = 0; i < nSpansPerThread; ++i) {
+                RenderTraceSpan span("tile", "render");
+            }
+        }) );
+    }
+    for (std::size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    // The ring buffer of a thread only keeps its last spans
+    std::thread overflowingThread([] {
+        for (int i = 0; i < NATRON_RENDER_TRACE_SPANS_PER_THREAD + 100; ++i) {
+            RenderTraceSpan span("overflow", "render");
+        }
+    });
+    overflowingThread.join();
+    RenderTrace::setEnabled(false);
+
+    std::string trace = writeTrace();
+    EXPECT_EQ( nThreads * nSpansPerThread, countOccurrences(trace, "\"name\":\"tile\"") );
+    EXPECT_EQ( NATRON_RENDER_TRACE_SPANS_PER_THREAD, countOccurrences(trace, "\"name\":\"overflow\"") );
+    EXPECT_EQ( (std::size_t)0, trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[") );
+
+    // The spans of the threads which exited are removed
+    RenderTrace::clear();
+    EXPECT_EQ( 0, countOccurrences(writeTrace(), "\"ph\":\"X\"") );
+}
+
+// The trace may be written while threads record spans: the spans overwritten while they are copied are skipped
+// instead of being written half-updated
+TEST(RenderTrace, ExportWhileRecording)
+{
+    RenderTrace::clear();
+    RenderTrace::setEnabled(true);
+
+    // The duration of each span in microseconds is also its label, so that a span mixing two records can be detected
+    const int nThreads = 2;
+    std::atomic<bool> stop(false);
+    std::atomic<int> nThreadsRecording(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nThreads; ++t) {
+        threads.push_back( std::thread([&stop, &nThreadsRecording] {
+            for (U64 i = 0; !stop.load() || i < 2 * NATRON_RENDER_TRACE_SPANS_PER_THREAD; ++i) {
+                if (i == 100) {
+                    ++nThreadsRecording;
+                }
+                const int durationUSecs = (int)(i % 7);
+                const std::string label = std::to_string(durationUSecs);
+                const U64 startNSecs = 1000000 + i * 10000;
+                RenderTrace::addSpan( "busy", "test", label.c_str(), startNSecs, startNSecs + durationUSecs * 1000 );
+            }
+        }) );
+    }
+
+    while (nThreadsRecording.load() < nThreads) {
+        std::this_thread::yield();
+    }
+    int nSpansChecked = 0;
+    for (int pass = 0; pass < 20; ++pass) {
+        std::string trace = writeTrace();
+        // No ASSERT while the threads run: they must be joined
+        EXPECT_EQ( (std::size_t)0, trace.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[") );
+        EXPECT_NE( std::string::npos, trace.rfind("\n]}\n") );
+        for (std::size_t pos = trace.find("\"name\":\"busy\""); pos != std::string::npos; pos = trace.find("\"name\":\"busy\"", pos + 1)) {
+            std::size_t durPos = trace.find("\"dur\":", pos);
+            std::size_t nodePos = trace.find("\"node\":\"", pos);
+            if ( (durPos == std::string::npos) || (nodePos == std::string::npos) ) {
+                ADD_FAILURE() << "Incomplete span in the trace";
+                break;
+            }
+            int durationUSecs = (int)std::atof( trace.c_str() + durPos + 6 );
+            int label = std::atoi( trace.c_str() + nodePos + 8 );
+            EXPECT_EQ(label, durationUSecs);
+            ++nSpansChecked;
+        }
+    }
+    stop = true;
+    for (std::size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+    RenderTrace::setEnabled(false);
+    EXPECT_GT(nSpansChecked, 0);
+    RenderTrace::clear();
+}
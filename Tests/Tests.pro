@@ -43,6 +43,8 @@ SOURCES += \
     google-test/src/gtest-all.cc \
     google-mock/src/gmock-all.cc \
     BaseTest.cpp \
+    Cache_Test.cpp \
+    CacheCompression_Test.cpp \
     Curve_Test.cpp \
     FileSystemModel_Test.cpp \
     Hash64_Test.cpp \
@@ -50,7 +52,12 @@ SOURCES += \
     KnobFile_Test.cpp \
     Lut_Test.cpp \
     OSGLContext_Test.cpp \
+    ProcessHandler_Test.cpp \
+    RenderTrace_Test.cpp \
+    TileScheduler_Test.cpp \
     Tracker_Test.cpp \
+    ViewerDisplayTransform_Test.cpp \
+    ViewerPrefetcher_Test.cpp \
     wmain.cpp
 
 HEADERS += \
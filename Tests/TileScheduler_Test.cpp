@@ -0,0 +1,255 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+
+#include "Engine/AppManager.h"
+#include "Engine/RectI.h"
+#include "Engine/TileScheduler.h"
+
+NATRON_NAMESPACE_USING
+
+static const int kBenchWidth = 3840;
+static const int kBenchHeight = 2160;
+static const int kBenchChainDepth = 8;
+
+// One pixel-wise effect of the chain, applied in place
+static void
+processTile(std::vector<float>& buffer,
+            int width,
+            int level,
+            const RectI& tile)
+{
+    for (int y = tile.y1; y < tile.y2; ++y) {
+        float* p = &buffer[(std::size_t)y * width + tile.x1];
+        for (int x = tile.x1; x < tile.x2; ++x, ++p) {
+            if (level == 0) {
+                *p = ( (x ^ y) & 255 ) / 255.f;
+            } else {
+                *p = std::sqrt(*p * *p * 0.5f + 0.25f) + std::sin(*p) * 0.1f;
+            }
+        }
+    }
+}
+
+// Renders the given level of the chain like EffectInstance::renderRoI does for eRenderSafetyFullySafeFrame effects:
+// the rect is split in tiles and each tile pulls its input from within the tile (a nested job)
+static void
+renderChain(TileScheduler* scheduler,
+            std::vector<float>& buffer,
+            int width,
+            int level,
+            const RectI& rect)
+{
+    int nTiles = (int)std::max( (U64)scheduler->getMaxConcurrency(), rect.area() / NATRON_TILE_SCHEDULER_TILE_PIXELS );
+    std::vector<RectI> tiles = rect.splitIntoSmallerRects(nTiles);
+
+    scheduler->run( (int)tiles.size(), [&](int i) {
+        if (level > 0) {
+            renderChain(scheduler, buffer, width, level - 1, tiles[i]);
+        }
+        processTile(buffer, width, level, tiles[i]);
+    } );
+}
+
+TEST(TileScheduler, ExecutesEveryTaskOnce)
+{
+    TileScheduler* scheduler = appPTR->getTileScheduler();
+    const int nOuter = 64;
+    const int nInner = 32;
+    std::vector<std::atomic<int> > counts(nOuter * nInner);
+
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        counts[i] = 0;
+    }
+    scheduler->run(nOuter, [&](int i) {
+        scheduler->run(nInner, [&](int j) {
+            ++counts[i * nInner + j];
+        });
+    });
+    for (std::size_t i = 0; i < counts.size(); ++i) {
+        EXPECT_EQ(1, (int)counts[i]);
+    }
+
+}
+
+// A task that throws does not prevent the other tasks from running, with one thread or several
+TEST(TileScheduler, RethrowsAfterAllTasks)
+{
+    TileScheduler* scheduler = appPTR->getTileScheduler();
+    QThreadPool* pool = QThreadPool::globalInstance();
+    const int originalMaxThreads = pool->maxThreadCount();
+    const int nTasks = 16;
+
+    for (int nThreads = 1; nThreads <= 2; ++nThreads) {
+        pool->setMaxThreadCount( (nThreads == 1) ? 1 : std::max(2, QThread::idealThreadCount()) );
+        std::atomic<int> nExecuted(0);
+        EXPECT_THROW( scheduler->run(nTasks, [&](int i) {
+            ++nExecuted;
+            if ( (i == 3) || (i == 7) ) {
+                throw std::runtime_error("task failed");
+            }
+        }), std::runtime_error );
+        EXPECT_EQ(nTasks, (int)nExecuted);
+    }
+    pool->setMaxThreadCount(originalMaxThreads);
+}
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// Occupies a thread of the global thread pool until released
+class BlockingRunnable
+    : public QRunnable
+{
+public:
+    BlockingRunnable(QSemaphore* release)
+        : _release(release)
+    {
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _release->acquire();
+    }
+
+private:
+    QSemaphore* _release;
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+// The tasks of a job run on several threads even when all the threads of the global pool are busy, where the
+// QtConcurrent based rendering fell back to a single thread
+TEST(TileScheduler, ConcurrentWhenPoolIsBusy)
+{
+    TileScheduler* scheduler = appPTR->getTileScheduler();
+    QThreadPool* pool = QThreadPool::globalInstance();
+    const int originalMaxThreads = pool->maxThreadCount();
+
+    pool->setMaxThreadCount( std::max(2, QThread::idealThreadCount()) );
+    QSemaphore release;
+    const int nBusy = pool->maxThreadCount();
+    for (int i = 0; i < nBusy; ++i) {
+        pool->start( new BlockingRunnable(&release) );
+    }
+    EXPECT_GE( pool->activeThreadCount(), pool->maxThreadCount() );
+
+    // Each task waits for the other one, which can only arrive if it runs on another thread
+    std::atomic<int> nArrived(0);
+    std::atomic<int> nMet(0);
+    scheduler->run(2, [&](int) {
+        ++nArrived;
+        QElapsedTimer timer;
+        timer.start();
+        while ( (nArrived.load() < 2) && (timer.elapsed() < 10000) ) {
+            QThread::yieldCurrentThread();
+        }
+        if (timer.elapsed() < 10000) {
+            ++nMet;
+        }
+    });
+    EXPECT_EQ(2, (int)nMet);
+    EXPECT_GE(scheduler->getNWorkerThreads(), 1);
+
+    release.release(nBusy);
+    pool->waitForDone();
+    pool->setMaxThreadCount(originalMaxThreads);
+}
+
+// Nested jobs of a deep chain must produce the same image whatever the number of threads
+TEST(TileScheduler, DeepChainMatchesSingleThread)
+{
+    TileScheduler* scheduler = appPTR->getTileScheduler();
+    QThreadPool* pool = QThreadPool::globalInstance();
+    const int originalMaxThreads = pool->maxThreadCount();
+    const int width = 512;
+    const int height = 384;
+    const RectI frame(0, 0, width, height);
+
+    std::vector<float> reference( (std::size_t)width * height );
+    std::vector<float> buffer( reference.size() );
+
+    pool->setMaxThreadCount(1);
+    renderChain(scheduler, reference, width, kBenchChainDepth - 1, frame);
+    pool->setMaxThreadCount( std::max(2, QThread::idealThreadCount()) );
+    renderChain(scheduler, buffer, width, kBenchChainDepth - 1, frame);
+    pool->setMaxThreadCount(originalMaxThreads);
+
+    EXPECT_TRUE(buffer == reference);
+}
+
+// Benchmark, see the "benchmarks" target in CMakeLists.txt.
+// Renders a deep chain of host frame threaded effects at 4K and reports the scaling from 1 to N threads.
+TEST(TileScheduler, DISABLED_DeepChainScaling)
+{
+    TileScheduler* scheduler = appPTR->getTileScheduler();
+    QThreadPool* pool = QThreadPool::globalInstance();
+    const int originalMaxThreads = pool->maxThreadCount();
+    const int maxThreads = std::max(1, QThread::idealThreadCount());
+    const RectI frame(0, 0, kBenchWidth, kBenchHeight);
+
+    std::vector<float> reference( (std::size_t)kBenchWidth * kBenchHeight );
+    std::vector<float> buffer( reference.size() );
+    double singleThreadSeconds = 0.;
+
+    std::vector<int> threadCounts;
+    for (int nThreads = 1; nThreads < maxThreads; nThreads *= 2) {
+        threadCounts.push_back(nThreads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    for (std::size_t t = 0; t < threadCounts.size(); ++t) {
+        int nThreads = threadCounts[t];
+        pool->setMaxThreadCount(nThreads);
+        std::vector<float>& output = (nThreads == 1) ? reference : buffer;
+        QElapsedTimer timer;
+        timer.start();
+        renderChain(scheduler, output, kBenchWidth, kBenchChainDepth - 1, frame);
+        double seconds = std::max(1e-9, timer.nsecsElapsed() / 1e9);
+        if (nThreads == 1) {
+            singleThreadSeconds = seconds;
+        } else {
+            EXPECT_TRUE(buffer == reference);
+        }
+        std::cout << "TileScheduler: " << kBenchChainDepth << " effects at " << kBenchWidth << "x" << kBenchHeight << ", "
+                  << nThreads << " threads: " << seconds * 1000. << " ms, speedup x" << singleThreadSeconds / seconds << std::endl;
+    }
+
+    pool->setMaxThreadCount(originalMaxThreads);
+}
@@ -0,0 +1,277 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <QtCore/QElapsedTimer>
+
+#include "Engine/ViewerInstance.h"
+#include "Engine/UpdateViewerParams.h"
+#include "Engine/FrameKey.h"
+#include "Engine/ImagePlaneDesc.h"
+#include "Engine/TextureRect.h"
+#include "Engine/ViewIdx.h"
+
+NATRON_NAMESPACE_USING
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+const int kTileSize = 128;
+
+// A frame of the linear viewer cache: 2 tiles, the second one is not full
+struct LinearFrame
+{
+    std::vector<float> tiles[2];
+
+    explicit LinearFrame(float value)
+    {
+        for (int i = 0; i < 2; ++i) {
+            tiles[i].resize(kTileSize * kTileSize * 4);
+            for (std::size_t p = 0; p < tiles[i].size(); p += 4) {
+                tiles[i][p] = value;
+                tiles[i][p + 1] = value / 2;
+                tiles[i][p + 2] = 0.f;
+                tiles[i][p + 3] = 1.f;
+            }
+        }
+    }
+
+    void fillParams(UpdateViewerParams* params)
+    {
+        params->tiles.clear();
+        for (int i = 0; i < 2; ++i) {
+            UpdateViewerParams::CachedTile tile;
+            tile.rectRounded.set(i * kTileSize, 0, (i + 1) * kTileSize, kTileSize);
+            tile.rect.set(i * kTileSize, 0, i == 0 ? kTileSize : 2 * kTileSize - 16, kTileSize);
+            tile.isCached = true;
+            tile.ramBuffer = (unsigned char*)&tiles[i][0];
+            tile.bytesCount = tiles[i].size() * sizeof(float);
+            params->tiles.push_back(tile);
+        }
+    }
+};
+
+int
+channel(U32 pixel,
+        int shift)
+{
+    return (pixel >> shift) & 0xff;
+}
+
+// Returns the number of pixels of the display buffers which differ by more than 1 in a channel
+int
+countDifferentPixels(const std::vector<std::vector<U32> >& a,
+                     const std::vector<std::vector<U32> >& b)
+{
+    if ( a.size() != b.size() ) {
+        return -1;
+    }
+    int count = 0;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if ( a[i].size() != b[i].size() ) {
+            return -1;
+        }
+        for (std::size_t p = 0; p < a[i].size(); ++p) {
+            for (int shift = 0; shift < 32; shift += 8) {
+                if (std::abs( channel(a[i][p], shift) - channel(b[i][p], shift) ) > 1) {
+                    ++count;
+                    break;
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+// The key of a tile of the viewer cache, as ViewerInstance builds it: the textures are displayed by the shaders
+// (or by the display transform post-pass of the linear viewer cache) when they are floating point
+FrameKey
+makeViewerFrameKey(double gain,
+                   double gamma,
+                   int lut,
+                   ImageBitDepthEnum depth)
+{
+    return FrameKey(0, 10, 1234, gain, gamma, lut, (int)depth, 0, ViewIdx(0), TextureRect(0, 0, kTileSize, kTileSize, kTileSize, 1.),
+                    0, "A", ImagePlaneDesc::getRGBAComponents(), std::string(), depth == eImageBitDepthFloat, false);
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+/*
+ * The frames of the linear viewer cache are floating point textures: changing the gain, gamma or color-space of the
+ * viewer must find the same cached frames, whereas 8-bit textures are cached again for each display transform.
+ */
+TEST(ViewerDisplayTransform, LinearFrameKey)
+{
+    const U64 linearHash = makeViewerFrameKey(1., 1., eViewerColorSpaceSRGB, eImageBitDepthFloat).getHash();
+
+    EXPECT_EQ( linearHash, makeViewerFrameKey(4., 1., eViewerColorSpaceSRGB, eImageBitDepthFloat).getHash() );
+    EXPECT_EQ( linearHash, makeViewerFrameKey(1., 2.2, eViewerColorSpaceSRGB, eImageBitDepthFloat).getHash() );
+    EXPECT_EQ( linearHash, makeViewerFrameKey(1., 1., eViewerColorSpaceRec709, eImageBitDepthFloat).getHash() );
+
+    const U64 byteHash = makeViewerFrameKey(1., 1., eViewerColorSpaceSRGB, eImageBitDepthByte).getHash();
+    EXPECT_NE( linearHash, byteHash );
+    EXPECT_NE( byteHash, makeViewerFrameKey(4., 1., eViewerColorSpaceSRGB, eImageBitDepthByte).getHash() );
+    EXPECT_NE( byteHash, makeViewerFrameKey(1., 2.2, eViewerColorSpaceSRGB, eImageBitDepthByte).getHash() );
+    EXPECT_NE( byteHash, makeViewerFrameKey(1., 1., eViewerColorSpaceRec709, eImageBitDepthByte).getHash() );
+}
+
+TEST(ViewerDisplayTransform, GainGammaLut)
+{
+    LinearFrame frame(0.25f);
+    UpdateViewerParams params;
+
+    params.depth = eImageBitDepthFloat;
+    params.applyDisplayTransform = true;
+    params.lut = eViewerColorSpaceLinear;
+    frame.fillParams(&params);
+
+    std::vector<std::vector<U32> > buffers;
+    params.gain = 2.;
+    ViewerInstance::applyDisplayTransform(params, &buffers);
+    ASSERT_EQ( 2u, buffers.size() );
+    ASSERT_EQ( (std::size_t)kTileSize * kTileSize, buffers[1].size() );
+    // BGRA: alpha, red, green, blue from the most significant byte
+    EXPECT_EQ( 255, channel(buffers[0][0], 24) );
+    EXPECT_NEAR( 128, channel(buffers[0][0], 16), 1 );
+    EXPECT_NEAR( 64, channel(buffers[0][0], 8), 1 );
+    EXPECT_EQ( 0, channel(buffers[0][0], 0) );
+    // The pixels of the rounded tile outside of the tile are black
+    EXPECT_NEAR( 128, channel(buffers[1][kTileSize - 17], 16), 1 );
+    EXPECT_EQ( 0u, buffers[1][kTileSize - 16] );
+
+    params.gain = 1.;
+    params.gamma = 2.;
+    ViewerInstance::applyDisplayTransform(params, &buffers);
+    EXPECT_NEAR( 128, channel(buffers[1][kTileSize * kTileSize - 17], 16), 1 );
+
+    params.gamma = 1.;
+    params.lut = eViewerColorSpaceSRGB;
+    ViewerInstance::applyDisplayTransform(params, &buffers);
+    // 0.25 linear is 0.537 in sRGB
+    EXPECT_NEAR( 137, channel(buffers[0][0], 16), 1 );
+}
+
+/*
+ * Toggling the gain of the viewer on cached frames: the display transform is applied again to the linear frames,
+ * which are not modified, so toggling back gives the same display buffers.
+ */
+TEST(ViewerDisplayTransform, GainToggle)
+{
+    const int nFrames = 8;
+    std::vector<LinearFrame*> frames;
+
+    for (int i = 0; i < nFrames; ++i) {
+        frames.push_back( new LinearFrame( (float)(i + 1) / (2 * nFrames) ) );
+    }
+
+    UpdateViewerParams params;
+    params.depth = eImageBitDepthFloat;
+    params.applyDisplayTransform = true;
+    params.lut = eViewerColorSpaceSRGB;
+
+    std::vector<std::vector<std::vector<U32> > > firstBuffers(nFrames);
+    std::vector<std::vector<U32> > buffers;
+    for (int t = 0; t < 3; ++t) {
+        params.gain = (t % 2) ? 4. : 1.;
+        for (int i = 0; i < nFrames; ++i) {
+            frames[i]->fillParams(&params);
+            ViewerInstance::applyDisplayTransform(params, &buffers);
+            ASSERT_EQ( 2u, buffers.size() );
+            if (t == 0) {
+                firstBuffers[i] = buffers;
+            } else if (t == 1) {
+                // The gain brightens the red and green channels, blue stays black
+                EXPECT_GT( channel(buffers[0][0], 16), channel(firstBuffers[i][0][0], 16) ) << "frame " << i;
+                EXPECT_GT( channel(buffers[0][0], 8), channel(firstBuffers[i][0][0], 8) ) << "frame " << i;
+                EXPECT_EQ( 0, channel(buffers[0][0], 0) );
+            } else {
+                // Same as the first time, up to the dithering
+                EXPECT_EQ( 0, countDifferentPixels(buffers, firstBuffers[i]) ) << "frame " << i;
+            }
+        }
+    }
+    // The frames with a higher value are brighter
+    for (int i = 1; i < nFrames; ++i) {
+        EXPECT_GT( channel(firstBuffers[i][0][0], 16), channel(firstBuffers[i - 1][0][0], 16) );
+    }
+
+    for (int i = 0; i < nFrames; ++i) {
+        delete frames[i];
+    }
+}
+
+/*
+ * Toggling the gain of the viewer on a cached range of 200 frames: with the linear viewer cache, the frames are
+ * not rendered again and only the display transform is applied when each frame is displayed.
+ * Benchmark, see the "benchmarks" target in CMakeLists.txt.
+ */
+TEST(ViewerDisplayTransform, DISABLED_GainToggleBenchmark)
+{
+    const int nFrames = 200;
+    const int nToggles = 4;
+    std::vector<LinearFrame*> frames;
+
+    for (int i = 0; i < nFrames; ++i) {
+        frames.push_back( new LinearFrame( (float)i / nFrames ) );
+    }
+
+    UpdateViewerParams params;
+    params.depth = eImageBitDepthFloat;
+    params.applyDisplayTransform = true;
+    params.lut = eViewerColorSpaceSRGB;
+
+    std::vector<std::vector<U32> > buffers;
+    QElapsedTimer timer;
+    timer.start();
+    int nonBlackFrames = 0;
+    for (int t = 0; t < nToggles; ++t) {
+        params.gain = (t % 2) ? 1. : 4.;
+        for (int i = 0; i < nFrames; ++i) {
+            frames[i]->fillParams(&params);
+            ViewerInstance::applyDisplayTransform(params, &buffers);
+            if ( (buffers[0][0] & 0xffffff) != 0 ) {
+                ++nonBlackFrames;
+            }
+        }
+    }
+    const qint64 elapsed = timer.elapsed();
+    EXPECT_GT(nonBlackFrames, 0);
+
+    const double pixels = (double)nToggles * nFrames * 2 * kTileSize * kTileSize;
+    std::cout << "Display transform of " << nFrames << " cached frames, " << nToggles << " gain changes: "
+              << elapsed << " ms, " << pixels / 1000. / std::max( (qint64)1, elapsed ) << " Mpixels/s" << std::endl;
+
+    for (int i = 0; i < nFrames; ++i) {
+        delete frames[i];
+    }
+}
@@ -0,0 +1,204 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * (C) 2018-2023 The Natron developers
+ * (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <set>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "Engine/ViewerPrefetcher.h"
+
+NATRON_NAMESPACE_USING
+
+TEST(ViewerPrefetchQueue, FramesAheadFirst)
+{
+    ViewerPrefetchQueue queue;
+
+    queue.setPlayhead(10, 1, 100, 4);
+    // Scrubbing backward: the frames ahead are before the playhead
+    queue.setPlayhead(9, 1, 100, 4);
+
+    std::vector<int> frames;
+    int frame;
+    while ( queue.takeNextFrame(&frame) ) {
+        frames.push_back(frame);
+        queue.onFrameRendered(frame, true, false);
+    }
+    // 8 and 7 are closer than 10 with the behind cost of 2
+    const int expected[] = { 8, 7, 10, 6, 5, 11 };
+    ASSERT_EQ(sizeof(expected) / sizeof(expected[0]), frames.size());
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        EXPECT_EQ(expected[i], frames[i]);
+    }
+    EXPECT_EQ( 4, queue.getCachedAheadCount() );
+
+    // Moving the playhead keeps the frames rendered, aborted frames are rendered again
+    queue.setPlayhead(8, 1, 100, 4);
+    ASSERT_TRUE( queue.takeNextFrame(&frame) );
+    EXPECT_EQ(9, frame);
+    queue.onFrameRendered(frame, true, true);
+    ASSERT_TRUE( queue.takeNextFrame(&frame) );
+    EXPECT_EQ(9, frame);
+    queue.onFrameRendered(frame, true, false);
+    ASSERT_TRUE( queue.takeNextFrame(&frame) );
+    EXPECT_EQ(4, frame);
+
+    queue.reset();
+    EXPECT_EQ( 0, queue.getCachedAheadCount() );
+    EXPECT_FALSE( queue.isFrameCached(7) );
+}
+
+/*
+ * Scripted scrubbing: the playhead moves by one frame at each step, alternately backward and forward over frames
+ * not displayed yet, and stops for a few steps at the end of each move, as when looking for a frame.
+ * At each step, the idle threads have the time to render a fraction of a frame. A frame is displayed from the cache
+ * if it was rendered before the playhead reached it.
+ * The prefetch queue is compared to rendering the frames after the playhead, throwing away the frame being rendered
+ * each time the playhead moves, as playback does when it is restarted by scrubbing.
+ * With the prefetch queue, the number of frames cached ahead reported at the end of each pause is appended to
+ * cachedAheadAtPauses if not NULL.
+ */
+static const int kScrubFirstFrame = 1;
+static const int kScrubLastFrame = 300;
+static const int kPrefetchFramesCount = 16;
+static const double kIdleFramesPerStep = 0.5;
+static const int kPauseSteps = 8;
+
+static std::vector<int>
+getScrubbingScript()
+{
+    std::vector<int> frames;
+    const int targets[] = { 110, 170, 60, 230, 20, 280 };
+    int frame = 150;
+
+    for (std::size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); ++i) {
+        int direction = targets[i] > frame ? 1 : -1;
+        for (; frame != targets[i]; frame += direction) {
+            frames.push_back(frame);
+        }
+        for (int p = 0; p < kPauseSteps; ++p) {
+            frames.push_back(frame);
+        }
+    }
+
+    return frames;
+}
+
+static int
+simulateScrubbing(const std::vector<int>& script,
+                  bool usePrefetchQueue,
+                  std::vector<int>* cachedAheadAtPauses = 0)
+{
+    ViewerPrefetchQueue queue;
+    std::set<int> cache;
+    int nCached = 0;
+    double progress = 0.;
+    int renderingFrame = 0;
+    bool isRendering = false;
+
+    for (std::size_t i = 0; i < script.size(); ++i) {
+        const int frame = script[i];
+        if ( (i > 0) && (frame == script[i - 1]) ) {
+            // The viewer displays the same frame
+        } else {
+            if ( cache.count(frame) ) {
+                ++nCached;
+            }
+            cache.insert(frame);
+            if (usePrefetchQueue) {
+                // The frame being prefetched keeps rendering while the playhead moves
+                queue.setPlayhead(frame, kScrubFirstFrame, kScrubLastFrame, kPrefetchFramesCount);
+            } else {
+                progress = 0.;
+                isRendering = false;
+            }
+        }
+
+        progress += kIdleFramesPerStep;
+        for (;;) {
+            if (!isRendering) {
+                if (usePrefetchQueue) {
+                    isRendering = queue.takeNextFrame(&renderingFrame);
+                } else {
+                    for (int f = frame + 1; f <= std::min(frame + kPrefetchFramesCount, kScrubLastFrame); ++f) {
+                        if ( !cache.count(f) ) {
+                            renderingFrame = f;
+                            isRendering = true;
+                            break;
+                        }
+                    }
+                }
+                if (!isRendering) {
+                    progress = 0.;
+                    break;
+                }
+            }
+            if (progress < 1.) {
+                break;
+            }
+            progress -= 1.;
+            isRendering = false;
+            cache.insert(renderingFrame);
+            if (usePrefetchQueue) {
+                queue.onFrameRendered(renderingFrame, true, false);
+            }
+        }
+
+        const bool isPauseEnd = (i > 0) && (frame == script[i - 1]) && ( (i + 1 == script.size()) || (script[i + 1] != frame) );
+        if (usePrefetchQueue && isPauseEnd && cachedAheadAtPauses) {
+            cachedAheadAtPauses->push_back( queue.getCachedAheadCount() );
+        }
+    }
+
+    return nCached;
+}
+
+TEST(ViewerPrefetchQueue, ScrubbingCacheHits)
+{
+    std::vector<int> script = getScrubbingScript();
+    int nDisplayedFrames = 1;
+    for (std::size_t i = 1; i < script.size(); ++i) {
+        if (script[i] != script[i - 1]) {
+            ++nDisplayedFrames;
+        }
+    }
+    ASSERT_EQ(851, nDisplayedFrames);
+
+    // The simulation is deterministic
+    std::vector<int> cachedAheadAtPauses;
+    int nCachedWithQueue = simulateScrubbing(script, true, &cachedAheadAtPauses);
+    int nCachedForwardOnly = simulateScrubbing(script, false);
+    EXPECT_EQ(663, nCachedWithQueue);
+    EXPECT_EQ(598, nCachedForwardOnly);
+
+    // During each pause, 4 frames are rendered: the frame which was being rendered when the playhead stopped,
+    // then the 2 frames ahead of the playhead before the frame behind it
+    ASSERT_EQ( (std::size_t)6, cachedAheadAtPauses.size() );
+    for (std::size_t i = 0; i < cachedAheadAtPauses.size(); ++i) {
+        EXPECT_EQ(2, cachedAheadAtPauses[i]) << "pause " << i;
+    }
+}